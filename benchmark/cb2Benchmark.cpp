@@ -0,0 +1,594 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Headless benchmark of a few standard scenes. It needs nothing besides the
+// library sources, for example:
+//
+//   g++ -O2 -std=c++11 -I../src -I<cinder>/include cb2Benchmark.cpp <library objects> -lpthread
+//
+// Every run prints one JSON object per line, so the output can be diffed and
+// collected by scripts. Run with -help for the options.
+
+#include <CinderBox2D/CinderBox2D.h>
+#include <CinderBox2D/Common/cb2ThreadPool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+
+typedef void cb2SceneFunction(cb2World* world, int scale);
+
+struct cb2Scene
+{
+	const char* name;
+	cb2SceneFunction* create;
+};
+
+// A deterministic random number generator, so every run builds the same scene.
+static unsigned int s_seed = 12345;
+
+static float RandomFloat(float lo, float hi)
+{
+	s_seed = 1664525 * s_seed + 1013904223;
+	float r = float(s_seed >> 8) / float(1 << 24);
+	return lo + (hi - lo) * r;
+}
+
+static cb2Body* CreateGround(cb2World* world, float halfWidth)
+{
+	cb2BodyDef bd;
+	cb2Body* ground = world->CreateBody(&bd);
+
+	cb2EdgeShape edge;
+	edge.Set(ci::Vec2f(-halfWidth, 0.0f), ci::Vec2f(halfWidth, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+	return ground;
+}
+
+// A pyramid of boxes resting on the ground, the classic stacking test.
+static void CreatePyramid(cb2World* world, int scale)
+{
+	int rows = int(20.0f * sqrtf(float(scale)) + 0.5f);
+	CreateGround(world, 10.0f * rows);
+
+	cb2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	for (int row = 0; row < rows; ++row)
+	{
+		for (int i = 0; i < rows - row; ++i)
+		{
+			cb2BodyDef bd;
+			bd.type = cb2_dynamicBody;
+			bd.position.set((i - 0.5f * rows) * 1.0f + row * 0.5f, 0.5f + row * 1.0f);
+			cb2Body* body = world->CreateBody(&bd);
+			body->CreateFixture(&box, 5.0f);
+		}
+	}
+}
+
+// A motorized box tumbling small boxes, lots of contacts that never sleep.
+static void CreateTumbler(cb2World* world, int scale)
+{
+	cb2BodyDef gd;
+	cb2Body* ground = world->CreateBody(&gd);
+
+	cb2BodyDef bd;
+	bd.type = cb2_dynamicBody;
+	bd.allowSleep = false;
+	bd.position.set(0.0f, 10.0f);
+	cb2Body* tumbler = world->CreateBody(&bd);
+
+	float size = 10.0f * sqrtf(float(scale));
+	cb2PolygonShape wall;
+	wall.SetAsBox(0.5f, size, ci::Vec2f(size, 0.0f), 0.0f);
+	tumbler->CreateFixture(&wall, 5.0f);
+	wall.SetAsBox(0.5f, size, ci::Vec2f(-size, 0.0f), 0.0f);
+	tumbler->CreateFixture(&wall, 5.0f);
+	wall.SetAsBox(size, 0.5f, ci::Vec2f(0.0f, size), 0.0f);
+	tumbler->CreateFixture(&wall, 5.0f);
+	wall.SetAsBox(size, 0.5f, ci::Vec2f(0.0f, -size), 0.0f);
+	tumbler->CreateFixture(&wall, 5.0f);
+
+	cb2RevoluteJointDef jd;
+	jd.Initialize(ground, tumbler, ci::Vec2f(0.0f, 10.0f));
+	jd.motorSpeed = 0.05f * cb2_pi;
+	jd.maxMotorTorque = 1e8f;
+	jd.enableMotor = true;
+	world->CreateJoint(&jd);
+
+	cb2PolygonShape box;
+	box.SetAsBox(0.125f, 0.125f);
+
+	int count = 800 * scale;
+	int side = int(sqrtf(float(count))) + 1;
+	float spacing = 1.6f * size / side;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2BodyDef bd;
+		bd.type = cb2_dynamicBody;
+		bd.position.set(-0.8f * size + spacing * (i % side), 10.0f - 0.8f * size + spacing * (i / side));
+		cb2Body* body = world->CreateBody(&bd);
+		body->CreateFixture(&box, 1.0f);
+	}
+}
+
+// Circles of mixed sizes poured into a container.
+static void CreateManyCircles(cb2World* world, int scale)
+{
+	int count = 2000 * scale;
+	float halfWidth = 20.0f * sqrtf(float(scale));
+
+	cb2Body* ground = CreateGround(world, halfWidth);
+	cb2EdgeShape edge;
+	edge.Set(ci::Vec2f(-halfWidth, 0.0f), ci::Vec2f(-halfWidth, 4.0f * halfWidth));
+	ground->CreateFixture(&edge, 0.0f);
+	edge.Set(ci::Vec2f(halfWidth, 0.0f), ci::Vec2f(halfWidth, 4.0f * halfWidth));
+	ground->CreateFixture(&edge, 0.0f);
+
+	int columns = int(2.0f * halfWidth / 0.6f) - 1;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2CircleShape circle;
+		circle.m_radius = RandomFloat(0.1f, 0.25f);
+
+		cb2BodyDef bd;
+		bd.type = cb2_dynamicBody;
+		bd.position.set(-halfWidth + 0.6f * (1 + i % columns), 0.5f + 0.6f * (i / columns));
+		cb2Body* body = world->CreateBody(&bd);
+
+		cb2FixtureDef fd;
+		fd.shape = &circle;
+		fd.density = 1.0f;
+		fd.friction = 0.2f;
+		body->CreateFixture(&fd);
+	}
+}
+
+// A grid of circles connected by revolute joints and pinned along the top row.
+static void CreateJointGrid(cb2World* world, int scale)
+{
+	int side = int(40.0f * sqrtf(float(scale)) + 0.5f);
+
+	cb2BodyDef gd;
+	cb2Body* ground = world->CreateBody(&gd);
+
+	cb2CircleShape circle;
+	circle.m_radius = 0.4f;
+
+	cb2FixtureDef fd;
+	fd.shape = &circle;
+	fd.density = 1.0f;
+	fd.filter.groupIndex = -1;
+
+	cb2Body** bodies = (cb2Body**)cb2Alloc(side * side * sizeof(cb2Body*));
+	for (int i = 0; i < side; ++i)
+	{
+		for (int j = 0; j < side; ++j)
+		{
+			cb2BodyDef bd;
+			bd.type = i == 0 && (j % 8 == 0 || j == side - 1) ? cb2_staticBody : cb2_dynamicBody;
+			bd.position.set(1.0f * j, -1.0f * i);
+			cb2Body* body = world->CreateBody(&bd);
+			body->CreateFixture(&fd);
+
+			cb2RevoluteJointDef jd;
+			if (i > 0)
+			{
+				jd.Initialize(bodies[(i - 1) * side + j], body, ci::Vec2f(1.0f * j, -1.0f * i + 0.5f));
+				world->CreateJoint(&jd);
+			}
+			if (j > 0)
+			{
+				jd.Initialize(bodies[i * side + j - 1], body, ci::Vec2f(1.0f * j - 0.5f, -1.0f * i));
+				world->CreateJoint(&jd);
+			}
+
+			bodies[i * side + j] = body;
+		}
+	}
+	cb2Free(bodies);
+
+	CB2_NOT_USED(ground);
+}
+
+static cb2Body* CreateLimb(cb2World* world, const ci::Vec2f& position, float hx, float hy)
+{
+	cb2BodyDef bd;
+	bd.type = cb2_dynamicBody;
+	bd.position = position;
+	cb2Body* body = world->CreateBody(&bd);
+
+	cb2PolygonShape box;
+	box.SetAsBox(hx, hy);
+
+	cb2FixtureDef fd;
+	fd.shape = &box;
+	fd.density = 1.0f;
+	fd.friction = 0.6f;
+	fd.filter.groupIndex = -1;
+	body->CreateFixture(&fd);
+	return body;
+}
+
+static void ConnectLimbs(cb2World* world, cb2Body* a, cb2Body* b, const ci::Vec2f& anchor, float lower, float upper)
+{
+	cb2RevoluteJointDef jd;
+	jd.Initialize(a, b, anchor);
+	jd.enableLimit = true;
+	jd.lowerAngle = lower;
+	jd.upperAngle = upper;
+	jd.enableMotor = true;
+	jd.maxMotorTorque = 2.0f;
+	world->CreateJoint(&jd);
+}
+
+// Ragdolls of ten limbs with joint limits dropped in a pile.
+static void CreateRagdolls(cb2World* world, int scale)
+{
+	int count = 60 * scale;
+	int columns = int(10.0f * sqrtf(float(scale)) + 0.5f);
+	CreateGround(world, 2.0f * columns + 20.0f);
+
+	for (int i = 0; i < count; ++i)
+	{
+		ci::Vec2f p(2.0f * (i % columns - 0.5f * columns), 3.0f + 4.0f * (i / columns));
+
+		cb2Body* torso = CreateLimb(world, p, 0.25f, 0.5f);
+		cb2Body* head = CreateLimb(world, p + ci::Vec2f(0.0f, 0.75f), 0.2f, 0.2f);
+		ConnectLimbs(world, torso, head, p + ci::Vec2f(0.0f, 0.5f), -0.25f * cb2_pi, 0.25f * cb2_pi);
+
+		for (int side = -1; side <= 1; side += 2)
+		{
+			cb2Body* upperArm = CreateLimb(world, p + ci::Vec2f(0.35f * side, 0.15f), 0.08f, 0.3f);
+			ConnectLimbs(world, torso, upperArm, p + ci::Vec2f(0.35f * side, 0.45f), -0.5f * cb2_pi, 0.5f * cb2_pi);
+			cb2Body* lowerArm = CreateLimb(world, p + ci::Vec2f(0.35f * side, -0.45f), 0.07f, 0.3f);
+			ConnectLimbs(world, upperArm, lowerArm, p + ci::Vec2f(0.35f * side, -0.15f), 0.0f, 0.75f * cb2_pi);
+
+			cb2Body* upperLeg = CreateLimb(world, p + ci::Vec2f(0.12f * side, -0.85f), 0.1f, 0.35f);
+			ConnectLimbs(world, torso, upperLeg, p + ci::Vec2f(0.12f * side, -0.5f), -0.25f * cb2_pi, 0.5f * cb2_pi);
+			cb2Body* lowerLeg = CreateLimb(world, p + ci::Vec2f(0.12f * side, -1.55f), 0.08f, 0.35f);
+			ConnectLimbs(world, upperLeg, lowerLeg, p + ci::Vec2f(0.12f * side, -1.2f), -0.75f * cb2_pi, 0.0f);
+		}
+	}
+}
+
+// Mixed bodies falling onto a long chain shape terrain.
+static void CreateChainTerrain(cb2World* world, int scale)
+{
+	int vertexCount = 400 * scale + 1;
+	float dx = 0.5f;
+	float x0 = -0.5f * dx * (vertexCount - 1);
+
+	ci::Vec2f* vertices = (ci::Vec2f*)cb2Alloc(vertexCount * sizeof(ci::Vec2f));
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		float x = x0 + dx * i;
+		vertices[i].set(x, 2.0f * sinf(0.1f * x) + 0.5f * sinf(0.7f * x));
+	}
+	vertices[0].y = 20.0f;
+	vertices[vertexCount - 1].y = 20.0f;
+
+	cb2BodyDef gd;
+	cb2Body* ground = world->CreateBody(&gd);
+	cb2ChainShape chain;
+	chain.CreateChain(vertices, vertexCount);
+	ground->CreateFixture(&chain, 0.0f);
+	cb2Free(vertices);
+
+	cb2PolygonShape box;
+	box.SetAsBox(0.25f, 0.25f);
+	cb2CircleShape circle;
+	circle.m_radius = 0.25f;
+	cb2PolygonShape triangle;
+	ci::Vec2f points[3] = { ci::Vec2f(-0.3f, 0.0f), ci::Vec2f(0.3f, 0.0f), ci::Vec2f(0.0f, 0.5f) };
+	triangle.set(points, 3);
+
+	cb2Shape* shapes[3] = { &box, &circle, &triangle };
+
+	int count = 1000 * scale;
+	int columns = int(-2.0f * x0 / 1.0f) - 2;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2BodyDef bd;
+		bd.type = cb2_dynamicBody;
+		bd.position.set(x0 + 1.0f * (1 + i % columns), 5.0f + 1.0f * (i / columns));
+		cb2Body* body = world->CreateBody(&bd);
+		body->CreateFixture(shapes[i % 3], 1.0f);
+	}
+}
+
+// Fast bullets fired at walls of thin boxes, dominated by continuous collision.
+static void CreateBullets(cb2World* world, int scale)
+{
+	int wallCount = 4 * scale;
+	CreateGround(world, 20.0f * wallCount + 100.0f);
+
+	cb2PolygonShape plank;
+	plank.SetAsBox(0.1f, 1.0f);
+
+	for (int w = 0; w < wallCount; ++w)
+	{
+		float x = 20.0f * (w - 0.5f * wallCount);
+		for (int i = 0; i < 10; ++i)
+		{
+			cb2BodyDef bd;
+			bd.type = cb2_dynamicBody;
+			bd.position.set(x, 1.0f + 2.0f * i);
+			cb2Body* body = world->CreateBody(&bd);
+			body->CreateFixture(&plank, 1.0f);
+		}
+	}
+
+	cb2CircleShape circle;
+	circle.m_radius = 0.1f;
+
+	int bulletCount = 25 * wallCount;
+	for (int i = 0; i < bulletCount; ++i)
+	{
+		int w = i % wallCount;
+		float x = 20.0f * (w - 0.5f * wallCount) - 10.0f;
+
+		cb2BodyDef bd;
+		bd.type = cb2_dynamicBody;
+		bd.bullet = true;
+		bd.position.set(x - 2.0f * (i / wallCount), 0.5f + RandomFloat(0.0f, 18.0f));
+		bd.linearVelocity.set(RandomFloat(200.0f, 400.0f), 0.0f);
+		cb2Body* body = world->CreateBody(&bd);
+		body->CreateFixture(&circle, 10.0f);
+	}
+}
+
+static const cb2Scene s_scenes[] =
+{
+	{ "pyramid", CreatePyramid },
+	{ "tumbler", CreateTumbler },
+	{ "many_circles", CreateManyCircles },
+	{ "joint_grid", CreateJointGrid },
+	{ "ragdolls", CreateRagdolls },
+	{ "chain_terrain", CreateChainTerrain },
+	{ "bullets", CreateBullets }
+};
+
+static const int s_sceneCount = sizeof(s_scenes) / sizeof(s_scenes[0]);
+
+// The sum of the profile over the measured steps.
+static void AddProfile(cb2Profile* sum, const cb2Profile& p)
+{
+	sum->step += p.step;
+	sum->collide += p.collide;
+	sum->solve += p.solve;
+	sum->solveInit += p.solveInit;
+	sum->solveVelocity += p.solveVelocity;
+	sum->solvePosition += p.solvePosition;
+	sum->broadphase += p.broadphase;
+	sum->synchronizeFixtures += p.synchronizeFixtures;
+	sum->updatePairs += p.updatePairs;
+	sum->solveTOI += p.solveTOI;
+	sum->awakeBodyCount += p.awakeBodyCount;
+	sum->islandCount += p.islandCount;
+	sum->touchingContactCount += p.touchingContactCount;
+	sum->pairCount += p.pairCount;
+	sum->proxyReinsertCount += p.proxyReinsertCount;
+	sum->toiEventCount += p.toiEventCount;
+	sum->stackFallbackCount += p.stackFallbackCount;
+}
+
+static void RunScene(const cb2Scene& scene, int scale, int threadCount, int warmupSteps, int stepCount)
+{
+	s_seed = 12345;
+
+	cb2ThreadPool* pool = NULL;
+	if (threadCount > 1)
+	{
+		pool = new cb2ThreadPool(threadCount);
+	}
+
+	cb2World* world = new cb2World(ci::Vec2f(0.0f, -10.0f));
+	world->SetTaskScheduler(pool);
+	scene.create(world, scale);
+
+	const float timeStep = 1.0f / 60.0f;
+	const int velocityIterations = 8;
+	const int positionIterations = 3;
+
+	for (int i = 0; i < warmupSteps; ++i)
+	{
+		world->Step(timeStep, velocityIterations, positionIterations);
+	}
+
+	cb2Profile sum;
+	memset(&sum, 0, sizeof(sum));
+
+	double totalMs = 0.0, minMs = 1e30, maxMs = 0.0;
+	for (int i = 0; i < stepCount; ++i)
+	{
+		cb2Timer timer;
+		world->Step(timeStep, velocityIterations, positionIterations);
+		double ms = timer.GetMilliseconds();
+
+		totalMs += ms;
+		minMs = ms < minMs ? ms : minMs;
+		maxMs = ms > maxMs ? ms : maxMs;
+		AddProfile(&sum, world->GetProfile());
+	}
+
+	// A position checksum, so changes in behavior show up next to the timings.
+	double checksum = 0.0;
+	for (cb2Body* b = world->GetBodyList(); b; b = b->GetNext())
+	{
+		const ci::Vec2f& p = b->GetPosition();
+		checksum += p.x + 2.0 * p.y;
+	}
+
+	double n = stepCount > 0 ? double(stepCount) : 1.0;
+	double meanMs = totalMs / n;
+
+	printf("{\"scene\":\"%s\",\"scale\":%d,\"threads\":%d,\"steps\":%d,"
+		"\"bodies\":%d,\"contacts\":%d,\"joints\":%d,"
+		"\"ms_per_step\":%.4f,\"min_ms\":%.4f,\"max_ms\":%.4f,\"steps_per_sec\":%.1f,"
+		"\"profile\":{\"step\":%.4f,\"collide\":%.4f,\"solve\":%.4f,\"solve_init\":%.4f,"
+		"\"solve_velocity\":%.4f,\"solve_position\":%.4f,\"broadphase\":%.4f,"
+		"\"synchronize_fixtures\":%.4f,\"update_pairs\":%.4f,\"solve_toi\":%.4f},"
+		"\"counters\":{\"awake_bodies\":%.1f,\"islands\":%.1f,\"touching_contacts\":%.1f,"
+		"\"pairs\":%.1f,\"proxy_reinserts\":%.1f,\"toi_events\":%.1f,\"stack_fallbacks\":%.1f},"
+		"\"checksum\":%.6f}\n",
+		scene.name, scale, threadCount, stepCount,
+		world->GetBodyCount(), world->GetContactCount(), world->GetJointCount(),
+		meanMs, minMs < 1e30 ? minMs : 0.0, maxMs, meanMs > 0.0 ? 1000.0 / meanMs : 0.0,
+		sum.step / n, sum.collide / n, sum.solve / n, sum.solveInit / n,
+		sum.solveVelocity / n, sum.solvePosition / n, sum.broadphase / n,
+		sum.synchronizeFixtures / n, sum.updatePairs / n, sum.solveTOI / n,
+		sum.awakeBodyCount / n, sum.islandCount / n, sum.touchingContactCount / n,
+		sum.pairCount / n, sum.proxyReinsertCount / n, sum.toiEventCount / n, sum.stackFallbackCount / n,
+		checksum);
+	fflush(stdout);
+
+	delete world;
+	delete pool;
+}
+
+// Parse a comma separated list of positive integers.
+static int ParseList(const char* text, int* values, int capacity)
+{
+	int count = 0;
+	while (*text && count < capacity)
+	{
+		int value = atoi(text);
+		if (value > 0)
+		{
+			values[count++] = value;
+		}
+
+		const char* comma = strchr(text, ',');
+		if (comma == NULL)
+		{
+			break;
+		}
+		text = comma + 1;
+	}
+	return count;
+}
+
+static void PrintUsage(const char* program)
+{
+	printf("usage: %s [options]\n", program);
+	printf("  -scene name     run only this scene, may be repeated\n");
+	printf("  -scales 1,2,4   body count multipliers\n");
+	printf("  -threads 1,4    thread counts, 1 runs without a task scheduler\n");
+	printf("  -steps n        measured steps per run (default 500)\n");
+	printf("  -warmup n       steps before measuring (default 60)\n");
+	printf("  -list           print the scene names\n");
+}
+
+int main(int argc, char** argv)
+{
+	int scales[16] = { 1, 2, 4 };
+	int scaleCount = 3;
+
+	int hardwareThreads = int(std::thread::hardware_concurrency());
+	int threads[16] = { 1, 2, 4 };
+	int threadCount = 3;
+	if (hardwareThreads > 4)
+	{
+		threads[threadCount++] = hardwareThreads;
+	}
+
+	bool selected[s_sceneCount];
+	bool anySelected = false;
+	memset(selected, 0, sizeof(selected));
+
+	int stepCount = 500;
+	int warmupSteps = 60;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "-list") == 0)
+		{
+			for (int j = 0; j < s_sceneCount; ++j)
+			{
+				printf("%s\n", s_scenes[j].name);
+			}
+			return 0;
+		}
+		else if (strcmp(arg, "-scene") == 0 && value)
+		{
+			int j = 0;
+			while (j < s_sceneCount && strcmp(s_scenes[j].name, value) != 0)
+			{
+				++j;
+			}
+			if (j == s_sceneCount)
+			{
+				fprintf(stderr, "unknown scene %s\n", value);
+				return 1;
+			}
+			selected[j] = true;
+			anySelected = true;
+			++i;
+		}
+		else if (strcmp(arg, "-scales") == 0 && value)
+		{
+			scaleCount = ParseList(value, scales, 16);
+			++i;
+		}
+		else if (strcmp(arg, "-threads") == 0 && value)
+		{
+			threadCount = ParseList(value, threads, 16);
+			++i;
+		}
+		else if (strcmp(arg, "-steps") == 0 && value)
+		{
+			stepCount = atoi(value);
+			++i;
+		}
+		else if (strcmp(arg, "-warmup") == 0 && value)
+		{
+			warmupSteps = atoi(value);
+			++i;
+		}
+		else
+		{
+			PrintUsage(argv[0]);
+			return strcmp(arg, "-help") == 0 ? 0 : 1;
+		}
+	}
+
+	for (int i = 0; i < s_sceneCount; ++i)
+	{
+		if (anySelected && selected[i] == false)
+		{
+			continue;
+		}
+
+		for (int j = 0; j < scaleCount; ++j)
+		{
+			for (int k = 0; k < threadCount; ++k)
+			{
+				RunScene(s_scenes[i], scales[j], threads[k], warmupSteps, stepCount);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,579 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Microbenchmarks of the collision kernels, the dynamic tree and the block
+// allocator. Built like cb2Benchmark.cpp:
+//
+//   g++ -O2 -std=c++11 -I../src -I<cinder>/include cb2MicroBenchmark.cpp <library objects>
+//
+// The inputs are random but seeded, so every run and every build sees the same
+// data. Each benchmark prints one JSON object per line with the time per call
+// and a checksum of the results, which catches kernels that changed behavior.
+
+#include <CinderBox2D/CinderBox2D.h>
+#include <CinderBox2D/Common/cb2BlockAllocator.h>
+#include <CinderBox2D/Collision/cb2DynamicTree.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2CircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2PolygonAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2PolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2EdgeAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2EdgeAndPolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2ChainAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2ChainAndPolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2CapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2CapsuleAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2PolygonAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2EdgeAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2ChainAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndPolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndCapsuleContact.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// The number of distinct inputs of each benchmark. They are cycled through until
+// the benchmark has made its calls.
+static const int s_sampleCount = 1024;
+
+static unsigned int s_seed = 12345;
+
+static float RandomFloat(float lo, float hi)
+{
+	s_seed = 1664525 * s_seed + 1013904223;
+	float r = float(s_seed >> 8) / float(1 << 24);
+	return lo + (hi - lo) * r;
+}
+
+static cb2Transform RandomTransform(float xRange, float yRange)
+{
+	ci::Vec2f p(RandomFloat(-xRange, xRange), RandomFloat(-yRange, yRange));
+	return cb2Transform(p, cb2Rot(RandomFloat(-cb2_pi, cb2_pi)));
+}
+
+static void RandomPolygon(cb2PolygonShape* polygon, float radius)
+{
+	ci::Vec2f points[cb2_maxPolygonVertices];
+	for (int i = 0; i < cb2_maxPolygonVertices; ++i)
+	{
+		float angle = 2.0f * cb2_pi * (i + RandomFloat(0.0f, 0.8f)) / cb2_maxPolygonVertices;
+		float r = radius * RandomFloat(0.6f, 1.0f);
+		points[i].set(r * cosf(angle), r * sinf(angle));
+	}
+	polygon->set(points, cb2_maxPolygonVertices);
+}
+
+static const char* s_filter = NULL;
+static int s_callCount = 200000;
+
+static bool IsSelected(const char* name)
+{
+	return s_filter == NULL || strstr(name, s_filter) != NULL;
+}
+
+static void Report(const char* name, int calls, float ms, double checksum)
+{
+	printf("{\"bench\":\"%s\",\"calls\":%d,\"ns_per_call\":%.2f,\"checksum\":%.6f}\n",
+		name, calls, calls > 0 ? 1e6 * ms / calls : 0.0, checksum);
+	fflush(stdout);
+}
+
+// The shapes the contacts are made of. Chains and heightfields span [-2, 2] so the
+// second shape is posed over one of their children.
+struct cb2ShapeSet
+{
+	cb2CircleShape circle;
+	cb2PolygonShape polygon;
+	cb2EdgeShape edge;
+	cb2ChainShape chain;
+	cb2CapsuleShape capsule;
+	cb2HeightfieldShape heightfield;
+};
+
+static const int s_terrainCount = 9;
+static const float s_terrainSpacing = 0.5f;
+
+static void CreateShapes(cb2ShapeSet* shapes)
+{
+	shapes->circle.m_radius = 0.5f;
+	RandomPolygon(&shapes->polygon, 0.5f);
+	shapes->edge.Set(ci::Vec2f(-2.0f, 0.0f), ci::Vec2f(2.0f, 0.0f));
+	shapes->capsule.Set(ci::Vec2f(-0.4f, 0.0f), ci::Vec2f(0.4f, 0.0f), 0.25f);
+
+	ci::Vec2f vertices[s_terrainCount];
+	float heights[s_terrainCount];
+	for (int i = 0; i < s_terrainCount; ++i)
+	{
+		heights[i] = RandomFloat(-0.2f, 0.2f);
+		vertices[i].set(-2.0f + s_terrainSpacing * i, heights[i]);
+	}
+	shapes->chain.CreateChain(vertices, s_terrainCount);
+	shapes->heightfield.Create(heights, s_terrainCount, s_terrainSpacing);
+}
+
+struct cb2ContactBench
+{
+	const char* name;
+	cb2ContactCreateFcn* create;
+	cb2ContactDestroyFcn* destroy;
+	cb2Shape::Type typeA;
+	cb2Shape::Type typeB;
+};
+
+// The pairs registered in cb2Contact::InitializeRegisters.
+static const cb2ContactBench s_contactBenches[] =
+{
+	{ "contact_circle_circle", cb2CircleContact::Create, cb2CircleContact::Destroy, cb2Shape::e_circle, cb2Shape::e_circle },
+	{ "contact_polygon_circle", cb2PolygonAndCircleContact::Create, cb2PolygonAndCircleContact::Destroy, cb2Shape::e_polygon, cb2Shape::e_circle },
+	{ "contact_polygon_polygon", cb2PolygonContact::Create, cb2PolygonContact::Destroy, cb2Shape::e_polygon, cb2Shape::e_polygon },
+	{ "contact_edge_circle", cb2EdgeAndCircleContact::Create, cb2EdgeAndCircleContact::Destroy, cb2Shape::e_edge, cb2Shape::e_circle },
+	{ "contact_edge_polygon", cb2EdgeAndPolygonContact::Create, cb2EdgeAndPolygonContact::Destroy, cb2Shape::e_edge, cb2Shape::e_polygon },
+	{ "contact_chain_circle", cb2ChainAndCircleContact::Create, cb2ChainAndCircleContact::Destroy, cb2Shape::e_chain, cb2Shape::e_circle },
+	{ "contact_chain_polygon", cb2ChainAndPolygonContact::Create, cb2ChainAndPolygonContact::Destroy, cb2Shape::e_chain, cb2Shape::e_polygon },
+	{ "contact_capsule_capsule", cb2CapsuleContact::Create, cb2CapsuleContact::Destroy, cb2Shape::e_capsule, cb2Shape::e_capsule },
+	{ "contact_capsule_circle", cb2CapsuleAndCircleContact::Create, cb2CapsuleAndCircleContact::Destroy, cb2Shape::e_capsule, cb2Shape::e_circle },
+	{ "contact_polygon_capsule", cb2PolygonAndCapsuleContact::Create, cb2PolygonAndCapsuleContact::Destroy, cb2Shape::e_polygon, cb2Shape::e_capsule },
+	{ "contact_edge_capsule", cb2EdgeAndCapsuleContact::Create, cb2EdgeAndCapsuleContact::Destroy, cb2Shape::e_edge, cb2Shape::e_capsule },
+	{ "contact_chain_capsule", cb2ChainAndCapsuleContact::Create, cb2ChainAndCapsuleContact::Destroy, cb2Shape::e_chain, cb2Shape::e_capsule },
+	{ "contact_heightfield_circle", cb2HeightfieldAndCircleContact::Create, cb2HeightfieldAndCircleContact::Destroy, cb2Shape::e_heightfield, cb2Shape::e_circle },
+	{ "contact_heightfield_polygon", cb2HeightfieldAndPolygonContact::Create, cb2HeightfieldAndPolygonContact::Destroy, cb2Shape::e_heightfield, cb2Shape::e_polygon },
+	{ "contact_heightfield_capsule", cb2HeightfieldAndCapsuleContact::Create, cb2HeightfieldAndCapsuleContact::Destroy, cb2Shape::e_heightfield, cb2Shape::e_capsule }
+};
+
+static const int s_contactBenchCount = sizeof(s_contactBenches) / sizeof(s_contactBenches[0]);
+
+static const cb2Shape* GetShape(const cb2ShapeSet& shapes, cb2Shape::Type type)
+{
+	switch (type)
+	{
+	case cb2Shape::e_circle:
+		return &shapes.circle;
+	case cb2Shape::e_polygon:
+		return &shapes.polygon;
+	case cb2Shape::e_edge:
+		return &shapes.edge;
+	case cb2Shape::e_chain:
+		return &shapes.chain;
+	case cb2Shape::e_capsule:
+		return &shapes.capsule;
+	case cb2Shape::e_heightfield:
+		return &shapes.heightfield;
+	default:
+		cb2Assert(false);
+		return NULL;
+	}
+}
+
+// Contacts need fixtures, so the shapes are attached to two bodies of a world and
+// each contact is evaluated directly against random poses of the second shape.
+static void RunContactBenches(const cb2ShapeSet& shapes)
+{
+	cb2World world(ci::Vec2f(0.0f, 0.0f));
+	cb2BodyDef bd;
+	cb2Body* bodyA = world.CreateBody(&bd);
+	cb2Body* bodyB = world.CreateBody(&bd);
+
+	cb2Fixture* fixturesA[cb2Shape::e_typeCount];
+	cb2Fixture* fixturesB[cb2Shape::e_typeCount];
+	for (int i = 0; i < cb2Shape::e_typeCount; ++i)
+	{
+		fixturesA[i] = NULL;
+		fixturesB[i] = NULL;
+		if (i == cb2Shape::e_circle || i == cb2Shape::e_polygon || i == cb2Shape::e_capsule)
+		{
+			fixturesB[i] = bodyB->CreateFixture(GetShape(shapes, cb2Shape::Type(i)), 0.0f);
+		}
+		fixturesA[i] = bodyA->CreateFixture(GetShape(shapes, cb2Shape::Type(i)), 0.0f);
+	}
+
+	cb2BlockAllocator allocator;
+	cb2Transform* transforms = (cb2Transform*)cb2Alloc(s_sampleCount * sizeof(cb2Transform));
+	cb2Contact** contacts = (cb2Contact**)cb2Alloc(s_sampleCount * sizeof(cb2Contact*));
+	cb2Transform xfA(ci::Vec2f(0.0f, 0.0f), cb2Rot(0.0f));
+
+	for (int b = 0; b < s_contactBenchCount; ++b)
+	{
+		const cb2ContactBench& bench = s_contactBenches[b];
+		if (IsSelected(bench.name) == false)
+		{
+			continue;
+		}
+
+		cb2Fixture* fixtureA = fixturesA[bench.typeA];
+		cb2Fixture* fixtureB = fixturesB[bench.typeB];
+		bool terrain = bench.typeA == cb2Shape::e_chain || bench.typeA == cb2Shape::e_heightfield;
+
+		// Chains and heightfields get a contact per child, the one under the pose is used.
+		cb2Contact* children[s_terrainCount];
+		int childCount = fixtureA->GetShape()->GetChildCount();
+		for (int i = 0; i < childCount; ++i)
+		{
+			children[i] = bench.create(fixtureA, i, fixtureB, 0, &allocator);
+		}
+
+		s_seed = 1000 + b;
+		for (int i = 0; i < s_sampleCount; ++i)
+		{
+			if (terrain)
+			{
+				transforms[i] = RandomTransform(1.9f, 0.7f);
+				int child = int((transforms[i].p.x + 2.0f) / s_terrainSpacing);
+				child = cb2Clamp(child, 0, childCount - 1);
+				contacts[i] = children[child];
+			}
+			else if (bench.typeA == cb2Shape::e_edge)
+			{
+				transforms[i] = RandomTransform(1.9f, 0.7f);
+				contacts[i] = children[0];
+			}
+			else
+			{
+				transforms[i] = RandomTransform(1.0f, 1.0f);
+				contacts[i] = children[0];
+			}
+
+			// Heightfields start at x = 0.
+			if (bench.typeA == cb2Shape::e_heightfield)
+			{
+				transforms[i].p.x += 2.0f;
+			}
+		}
+
+		double checksum = 0.0;
+		cb2Timer timer;
+		for (int i = 0; i < s_callCount; ++i)
+		{
+			int index = i & (s_sampleCount - 1);
+			cb2Manifold manifold;
+			contacts[index]->Evaluate(&manifold, xfA, transforms[index]);
+			checksum += manifold.pointCount;
+		}
+		float ms = timer.GetMilliseconds();
+		Report(bench.name, s_callCount, ms, checksum);
+
+		for (int i = 0; i < childCount; ++i)
+		{
+			bench.destroy(children[i], &allocator);
+		}
+	}
+
+	cb2Free(contacts);
+	cb2Free(transforms);
+}
+
+static void RunDistanceBenches(const cb2ShapeSet& shapes)
+{
+	cb2DistanceInput* inputs = (cb2DistanceInput*)cb2Alloc(s_sampleCount * sizeof(cb2DistanceInput));
+	s_seed = 2000;
+	for (int i = 0; i < s_sampleCount; ++i)
+	{
+		cb2DistanceInput* input = inputs + i;
+		new (input) cb2DistanceInput();
+		input->proxyA.set(&shapes.polygon, 0);
+		input->proxyB.set(i & 1 ? (const cb2Shape*)&shapes.capsule : (const cb2Shape*)&shapes.polygon, 0);
+		input->transformA = cb2Transform(ci::Vec2f(0.0f, 0.0f), cb2Rot(0.0f));
+		input->transformB = RandomTransform(2.0f, 2.0f);
+		input->useRadii = true;
+	}
+
+	if (IsSelected("distance"))
+	{
+		double checksum = 0.0;
+		cb2Timer timer;
+		for (int i = 0; i < s_callCount; ++i)
+		{
+			cb2SimplexCache cache;
+			cache.count = 0;
+			cb2DistanceOutput output;
+			cb2Distance(&output, &cache, inputs + (i & (s_sampleCount - 1)));
+			checksum += output.distance;
+		}
+		Report("distance", s_callCount, timer.GetMilliseconds(), checksum);
+	}
+
+	if (IsSelected("toi"))
+	{
+		double checksum = 0.0;
+		int calls = s_callCount / 4;
+		cb2Timer timer;
+		for (int i = 0; i < calls; ++i)
+		{
+			const cb2DistanceInput* input = inputs + (i & (s_sampleCount - 1));
+
+			// Sweep the second shape from its pose through the first one.
+			cb2TOIInput toiInput;
+			toiInput.proxyA = input->proxyA;
+			toiInput.proxyB = input->proxyB;
+			toiInput.sweepA.localCenter.set(0.0f, 0.0f);
+			toiInput.sweepA.c0.set(0.0f, 0.0f);
+			toiInput.sweepA.c.set(0.0f, 0.0f);
+			toiInput.sweepA.a0 = 0.0f;
+			toiInput.sweepA.a = 0.0f;
+			toiInput.sweepA.alpha0 = 0.0f;
+			toiInput.sweepB.localCenter.set(0.0f, 0.0f);
+			toiInput.sweepB.c0 = 4.0f * input->transformB.p;
+			toiInput.sweepB.c = -input->transformB.p;
+			toiInput.sweepB.a0 = input->transformB.q.GetAngle();
+			toiInput.sweepB.a = toiInput.sweepB.a0 + 1.0f;
+			toiInput.sweepB.alpha0 = 0.0f;
+			toiInput.tMax = 1.0f;
+
+			cb2TOIOutput output;
+			cb2TimeOfImpact(&output, &toiInput);
+			checksum += output.t + output.state;
+		}
+		Report("toi", calls, timer.GetMilliseconds(), checksum);
+	}
+
+	cb2Free(inputs);
+}
+
+struct cb2TreeQueryCounter
+{
+	bool QueryCallback(int proxyId)
+	{
+		CB2_NOT_USED(proxyId);
+		++count;
+		return true;
+	}
+
+	int count;
+};
+
+struct cb2TreeRayCastCounter
+{
+	float RayCastCallback(const cb2RayCastInput& input, int proxyId)
+	{
+		CB2_NOT_USED(proxyId);
+		++count;
+		return input.maxFraction;
+	}
+
+	int count;
+};
+
+static void RunTreeBenches()
+{
+	if (IsSelected("tree") == false)
+	{
+		return;
+	}
+
+	// A world of small boxes scattered over a square.
+	const int proxyCount = 8192;
+	const float extent = 200.0f;
+
+	cb2DynamicTree tree;
+	int* proxies = (int*)cb2Alloc(proxyCount * sizeof(int));
+	cb2AABB* boxes = (cb2AABB*)cb2Alloc(proxyCount * sizeof(cb2AABB));
+
+	s_seed = 3000;
+	for (int i = 0; i < proxyCount; ++i)
+	{
+		ci::Vec2f c(RandomFloat(-extent, extent), RandomFloat(-extent, extent));
+		ci::Vec2f r(RandomFloat(0.2f, 1.0f), RandomFloat(0.2f, 1.0f));
+		boxes[i].lowerBound = c - r;
+		boxes[i].upperBound = c + r;
+		proxies[i] = tree.CreateProxy(boxes[i], NULL);
+	}
+
+	cb2AABB* queries = (cb2AABB*)cb2Alloc(s_sampleCount * sizeof(cb2AABB));
+	cb2RayCastInput* rays = (cb2RayCastInput*)cb2Alloc(s_sampleCount * sizeof(cb2RayCastInput));
+	ci::Vec2f* moves = (ci::Vec2f*)cb2Alloc(s_sampleCount * sizeof(ci::Vec2f));
+	for (int i = 0; i < s_sampleCount; ++i)
+	{
+		ci::Vec2f c(RandomFloat(-extent, extent), RandomFloat(-extent, extent));
+		ci::Vec2f r(RandomFloat(1.0f, 5.0f), RandomFloat(1.0f, 5.0f));
+		queries[i].lowerBound = c - r;
+		queries[i].upperBound = c + r;
+
+		rays[i].p1 = c;
+		rays[i].p2 = c + ci::Vec2f(RandomFloat(-50.0f, 50.0f), RandomFloat(-50.0f, 50.0f));
+		rays[i].maxFraction = 1.0f;
+
+		moves[i].set(RandomFloat(-0.5f, 0.5f), RandomFloat(-0.5f, 0.5f));
+	}
+
+	if (IsSelected("tree_query"))
+	{
+		cb2TreeQueryCounter counter;
+		counter.count = 0;
+		int calls = s_callCount / 4;
+		cb2Timer timer;
+		for (int i = 0; i < calls; ++i)
+		{
+			tree.Query(&counter, queries[i & (s_sampleCount - 1)]);
+		}
+		Report("tree_query", calls, timer.GetMilliseconds(), counter.count);
+	}
+
+	if (IsSelected("tree_raycast"))
+	{
+		cb2TreeRayCastCounter counter;
+		counter.count = 0;
+		int calls = s_callCount / 4;
+		cb2Timer timer;
+		for (int i = 0; i < calls; ++i)
+		{
+			tree.RayCast(&counter, rays[i & (s_sampleCount - 1)]);
+		}
+		Report("tree_raycast", calls, timer.GetMilliseconds(), counter.count);
+	}
+
+	if (IsSelected("tree_move_proxy"))
+	{
+		// Random walks, so some moves stay in the fat AABB and some reinsert.
+		int reinsertCount = 0;
+		cb2Timer timer;
+		for (int i = 0; i < s_callCount; ++i)
+		{
+			int index = i % proxyCount;
+			const ci::Vec2f& d = moves[i & (s_sampleCount - 1)];
+			boxes[index].lowerBound += d;
+			boxes[index].upperBound += d;
+			if (tree.MoveProxy(proxies[index], boxes[index], d))
+			{
+				++reinsertCount;
+			}
+		}
+		Report("tree_move_proxy", s_callCount, timer.GetMilliseconds(), reinsertCount);
+	}
+
+	cb2Free(moves);
+	cb2Free(rays);
+	cb2Free(queries);
+	cb2Free(boxes);
+	cb2Free(proxies);
+}
+
+static void RunAllocatorBench()
+{
+	if (IsSelected("block_allocator") == false)
+	{
+		return;
+	}
+
+	// Allocate and free blocks of mixed sizes in a shuffled order, like contacts
+	// and fixtures coming and going.
+	const int slotCount = 256;
+	void* slots[slotCount];
+	int sizes[slotCount];
+	memset(slots, 0, sizeof(slots));
+
+	s_seed = 4000;
+	int* picks = (int*)cb2Alloc(s_sampleCount * sizeof(int));
+	for (int i = 0; i < s_sampleCount; ++i)
+	{
+		picks[i] = int(RandomFloat(0.0f, float(slotCount) - 0.001f));
+	}
+	for (int i = 0; i < slotCount; ++i)
+	{
+		sizes[i] = 16 + 16 * int(RandomFloat(0.0f, 15.99f));
+	}
+
+	cb2BlockAllocator allocator;
+	double checksum = 0.0;
+	cb2Timer timer;
+	for (int i = 0; i < s_callCount; ++i)
+	{
+		int slot = picks[i & (s_sampleCount - 1)];
+		if (slots[slot])
+		{
+			allocator.Free(slots[slot], sizes[slot]);
+			slots[slot] = NULL;
+		}
+		else
+		{
+			slots[slot] = allocator.Allocate(sizes[slot]);
+			checksum += 1.0;
+		}
+	}
+	float ms = timer.GetMilliseconds();
+	Report("block_allocator", s_callCount, ms, checksum);
+
+	for (int i = 0; i < slotCount; ++i)
+	{
+		if (slots[i])
+		{
+			allocator.Free(slots[i], sizes[i]);
+		}
+	}
+	cb2Free(picks);
+}
+
+static void RunPolygonSetBench()
+{
+	if (IsSelected("polygon_set") == false)
+	{
+		return;
+	}
+
+	// Point clouds of full size, the hull keeps some of them.
+	ci::Vec2f* points = (ci::Vec2f*)cb2Alloc(s_sampleCount * cb2_maxPolygonVertices * sizeof(ci::Vec2f));
+	s_seed = 5000;
+	for (int i = 0; i < s_sampleCount * cb2_maxPolygonVertices; ++i)
+	{
+		points[i].set(RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f));
+	}
+
+	double checksum = 0.0;
+	int calls = s_callCount / 4;
+	cb2PolygonShape polygon;
+	cb2Timer timer;
+	for (int i = 0; i < calls; ++i)
+	{
+		polygon.set(points + (i & (s_sampleCount - 1)) * cb2_maxPolygonVertices, cb2_maxPolygonVertices);
+		checksum += polygon.m_count;
+	}
+	Report("polygon_set", calls, timer.GetMilliseconds(), checksum);
+
+	cb2Free(points);
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+		{
+			s_filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "-calls") == 0 && i + 1 < argc)
+		{
+			s_callCount = atoi(argv[++i]);
+		}
+		else
+		{
+			printf("usage: %s [-filter substring] [-calls n]\n", argv[0]);
+			return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+		}
+	}
+
+	cb2ShapeSet shapes;
+	CreateShapes(&shapes);
+
+	RunContactBenches(shapes);
+	RunDistanceBenches(shapes);
+	RunTreeBenches();
+	RunAllocatorBench();
+	RunPolygonSetBench();
+
+	return 0;
+}
@@ -32,15 +32,24 @@ For discussion please visit http://box2d.org/forum
 // These include files constitute the main Box2D API
 
 #include <CinderBox2D/Common/cb2Settings.h>
+#include <CinderBox2D/Common/cb2BatchMath.h>
 #include <CinderBox2D/Common/cb2Draw.h>
+#include <CinderBox2D/Common/cb2DrawBatch.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
 #include <CinderBox2D/Common/cb2Timer.h>
+#include <CinderBox2D/Common/cb2Trace.h>
 
 #include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
 
 #include <CinderBox2D/Collision/cb2BroadPhase.h>
+#include <CinderBox2D/Collision/cb2ConvexDecomposition.h>
 #include <CinderBox2D/Collision/cb2Distance.h>
 #include <CinderBox2D/Collision/cb2DynamicTree.h>
 #include <CinderBox2D/Collision/cb2TimeOfImpact.h>
@@ -50,6 +59,12 @@ For discussion please visit http://box2d.org/forum
 #include <CinderBox2D/Dynamics/cb2WorldCallbacks.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
 #include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2WorldView.h>
+#include <CinderBox2D/Dynamics/cb2CommandQueue.h>
+#include <CinderBox2D/Dynamics/cb2CharacterController.h>
+#include <CinderBox2D/Dynamics/cb2Replication.h>
+#include <CinderBox2D/Dynamics/cb2WorldPartition.h>
+#include <CinderBox2D/Dynamics/cb2StaticLayer.h>
 
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
 
@@ -65,4 +80,10 @@ For discussion please visit http://box2d.org/forum
 #include <CinderBox2D/Dynamics/Joints/cb2WeldJoint.h>
 #include <CinderBox2D/Dynamics/Joints/cb2WheelJoint.h>
 
+#include <CinderBox2D/Dynamics/Controllers/cb2BuoyancyController.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2RadialGravityController.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2WindController.h>
+
+#include <CinderBox2D/Particle/cb2ParticleSystem.h>
+
 #endif
@@ -0,0 +1,200 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <new>
+
+void cb2CapsuleShape::Set(const ci::Vec2f& v1, const ci::Vec2f& v2, float radius)
+{
+	cb2Assert(cb2DistanceSquared(v1, v2) > cb2_linearSlop * cb2_linearSlop);
+	cb2Assert(radius > 0.0f);
+	m_vertex1 = v1;
+	m_vertex2 = v2;
+	m_radius = radius;
+}
+
+cb2Shape* cb2CapsuleShape::Clone(cb2BlockAllocator* allocator) const
+{
+	void* mem = allocator->Allocate(sizeof(cb2CapsuleShape));
+	cb2CapsuleShape* clone = new (mem) cb2CapsuleShape;
+	*clone = *this;
+	return clone;
+}
+
+int cb2CapsuleShape::GetChildCount() const
+{
+	return 1;
+}
+
+bool cb2CapsuleShape::TestPoint(const cb2Transform& transform, const ci::Vec2f& p) const
+{
+	ci::Vec2f pLocal = cb2MulT(transform, p);
+
+	// Distance to the closest point of the segment.
+	ci::Vec2f e = m_vertex2 - m_vertex1;
+	float t = cb2Clamp(cb2Dot(pLocal - m_vertex1, e) / cb2Dot(e, e), 0.0f, 1.0f);
+	ci::Vec2f d = pLocal - (m_vertex1 + t * e);
+	return cb2Dot(d, d) <= m_radius * m_radius;
+}
+
+// Ray cast against an end cap in the capsule frame. Same as cb2CircleShape::RayCast.
+static bool cb2RayCastCap(float* fraction, ci::Vec2f* normal, const ci::Vec2f& p1, const ci::Vec2f& d,
+						  const ci::Vec2f& center, float radius, float maxFraction)
+{
+	ci::Vec2f s = p1 - center;
+	float b = cb2Dot(s, s) - radius * radius;
+	float c = cb2Dot(s, d);
+	float dd = cb2Dot(d, d);
+	float sigma = c * c - dd * b;
+	if (sigma < 0.0f || dd < cb2_epsilon)
+	{
+		return false;
+	}
+
+	float a = -(c + cb2Sqrt(sigma));
+	if (0.0f <= a && a <= maxFraction * dd)
+	{
+		a /= dd;
+		*fraction = a;
+		*normal = s + a * d;
+		normal->normalize();
+		return true;
+	}
+
+	return false;
+}
+
+// The sides of the capsule are the segment offset by the radius along the
+// normal u, so the ray p1 + t * d hits them where
+// v1 +/- radius * u + s * a = p1 + t * d
+// Outside the segment range the ray can only hit an end cap.
+bool cb2CapsuleShape::RayCast(cb2RayCastOutput* output, const cb2RayCastInput& input,
+							const cb2Transform& xf, int childIndex) const
+{
+	CB2_NOT_USED(childIndex);
+
+	// Put the ray into the capsule's frame of reference.
+	ci::Vec2f p1 = cb2MulT(xf.q, input.p1 - xf.p);
+	ci::Vec2f p2 = cb2MulT(xf.q, input.p2 - xf.p);
+	ci::Vec2f d = p2 - p1;
+
+	ci::Vec2f a = m_vertex2 - m_vertex1;
+	float length = a.length();
+	a *= 1.0f / length;
+
+	ci::Vec2f q = p1 - m_vertex1;
+	float qa = cb2Dot(q, a);
+	ci::Vec2f qp = q - qa * a;
+
+	float fraction;
+	ci::Vec2f normal;
+	bool hit = false;
+
+	if (cb2Dot(qp, qp) < m_radius * m_radius)
+	{
+		// The ray starts between the side lines. Inside the capsule nothing
+		// is hit, otherwise only the cap it starts beyond can be.
+		if (qa < 0.0f)
+		{
+			hit = cb2RayCastCap(&fraction, &normal, p1, d, m_vertex1, m_radius, input.maxFraction);
+		}
+		else if (qa > length)
+		{
+			hit = cb2RayCastCap(&fraction, &normal, p1, d, m_vertex2, m_radius, input.maxFraction);
+		}
+	}
+	else
+	{
+		// Hit the side facing the ray origin.
+		ci::Vec2f u(a.y, -a.x);
+		if (cb2Dot(qp, u) < 0.0f)
+		{
+			u = -u;
+		}
+
+		float numerator = m_radius - cb2Dot(q, u);
+		float denominator = cb2Dot(d, u);
+		if (denominator < 0.0f)
+		{
+			float t = numerator / denominator;
+			if (t <= input.maxFraction)
+			{
+				float s = qa + t * cb2Dot(d, a);
+				if (s < 0.0f)
+				{
+					hit = cb2RayCastCap(&fraction, &normal, p1, d, m_vertex1, m_radius, input.maxFraction);
+				}
+				else if (s > length)
+				{
+					hit = cb2RayCastCap(&fraction, &normal, p1, d, m_vertex2, m_radius, input.maxFraction);
+				}
+				else
+				{
+					fraction = t;
+					normal = u;
+					hit = true;
+				}
+			}
+		}
+	}
+
+	if (hit == false)
+	{
+		return false;
+	}
+
+	output->fraction = fraction;
+	output->normal = cb2Mul(xf.q, normal);
+	return true;
+}
+
+void cb2CapsuleShape::ComputeAABB(cb2AABB* aabb, const cb2Transform& xf, int childIndex) const
+{
+	CB2_NOT_USED(childIndex);
+
+	ci::Vec2f v1 = cb2Mul(xf, m_vertex1);
+	ci::Vec2f v2 = cb2Mul(xf, m_vertex2);
+
+	ci::Vec2f r(m_radius, m_radius);
+	aabb->lowerBound = cb2Min(v1, v2) - r;
+	aabb->upperBound = cb2Max(v1, v2) + r;
+}
+
+// The capsule is a box of length l and width 2r plus two half discs. The
+// centroid of a half disc is 4r/(3pi) from its flat side, which the parallel
+// axis theorem uses to move each half disc out to its end of the box.
+void cb2CapsuleShape::ComputeMass(cb2MassData* massData, float density) const
+{
+	float rr = m_radius * m_radius;
+	float length = cb2Distance(m_vertex1, m_vertex2);
+	float ll = length * length;
+
+	float boxMass = density * 2.0f * m_radius * length;
+	float circleMass = density * cb2_pi * rr;
+
+	massData->mass = boxMass + circleMass;
+	massData->center = 0.5f * (m_vertex1 + m_vertex2);
+
+	float lc = 4.0f * m_radius / (3.0f * cb2_pi);
+	float h = 0.5f * length;
+	float circleInertia = circleMass * (0.5f * rr + h * h + 2.0f * h * lc);
+	float boxInertia = boxMass * (4.0f * rr + ll) / 12.0f;
+
+	// inertia about the local origin
+	massData->I = circleInertia + boxInertia + massData->mass * cb2Dot(massData->center, massData->center);
+}
@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_CAPSULE_SHAPE_H
+#define CB2_CAPSULE_SHAPE_H
+
+#include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+
+/// A capsule is a line segment swept by a circle: the convex hull of two
+/// circles of the same radius. It collides like a rounded polygon but costs
+/// a single fixture, and its mass and ray casts are computed exactly.
+class cb2CapsuleShape : public cb2Shape
+{
+public:
+	cb2CapsuleShape();
+
+	/// Set the centers of the two end caps and the radius. The centers must
+	/// be further apart than cb2_linearSlop; use a circle otherwise.
+	void Set(const ci::Vec2f& v1, const ci::Vec2f& v2, float radius);
+
+	/// Implement cb2Shape.
+	cb2Shape* Clone(cb2BlockAllocator* allocator) const;
+
+	/// @see cb2Shape::GetChildCount
+	int GetChildCount() const;
+
+	/// @see cb2Shape::TestPoint
+	bool TestPoint(const cb2Transform& transform, const ci::Vec2f& p) const;
+
+	/// Implement cb2Shape.
+	bool RayCast(cb2RayCastOutput* output, const cb2RayCastInput& input,
+				const cb2Transform& transform, int childIndex) const;
+
+	/// @see cb2Shape::ComputeAABB
+	void ComputeAABB(cb2AABB* aabb, const cb2Transform& transform, int childIndex) const;
+
+	/// @see cb2Shape::ComputeMass
+	void ComputeMass(cb2MassData* massData, float density) const;
+
+	/// The centers of the end caps. These are adjacent so they can be
+	/// used as a two vertex array.
+	ci::Vec2f m_vertex1, m_vertex2;
+};
+
+inline cb2CapsuleShape::cb2CapsuleShape()
+{
+	m_type = e_capsule;
+	m_radius = 0.0f;
+	m_vertex1.set(0.0f, 0.0f);
+	m_vertex2.set(0.0f, 0.0f);
+}
+
+#endif
@@ -23,7 +23,17 @@
 
 cb2ChainShape::~cb2ChainShape()
 {
-	cb2Free(m_vertices);
+	if (m_edgeTree)
+	{
+		m_edgeTree->~cb2DynamicTree();
+		cb2Free(m_edgeTree);
+		m_edgeTree = NULL;
+	}
+
+	if (m_borrowedVertices == false)
+	{
+		cb2Free(m_vertices);
+	}
 	m_vertices = NULL;
 	m_count = 0;
 }
@@ -73,6 +83,22 @@ void cb2ChainShape::CreateChain(const ci::Vec2f* vertices, int count)
 	cb2::setZero(m_nextVertex);
 }
 
+void cb2ChainShape::BorrowChain(const ci::Vec2f* vertices, int count)
+{
+	cb2Assert(m_vertices == NULL && m_count == 0);
+	cb2Assert(count >= 2);
+
+	m_count = count;
+	m_vertices = const_cast<ci::Vec2f*>(vertices);
+	m_borrowedVertices = true;
+
+	m_hasPrevVertex = false;
+	m_hasNextVertex = false;
+
+	cb2::setZero(m_prevVertex);
+	cb2::setZero(m_nextVertex);
+}
+
 void cb2ChainShape::SetPrevVertex(const ci::Vec2f& prevVertex)
 {
 	m_prevVertex = prevVertex;
@@ -94,9 +120,41 @@ cb2Shape* cb2ChainShape::Clone(cb2BlockAllocator* allocator) const
 	clone->m_nextVertex = m_nextVertex;
 	clone->m_hasPrevVertex = m_hasPrevVertex;
 	clone->m_hasNextVertex = m_hasNextVertex;
+	clone->m_useEdgeTree = m_useEdgeTree;
+	if (m_useEdgeTree)
+	{
+		clone->BuildEdgeTree();
+	}
 	return clone;
 }
 
+void cb2ChainShape::BuildEdgeTree()
+{
+	cb2Assert(m_edgeTree == NULL);
+	void* mem = cb2Alloc(sizeof(cb2DynamicTree));
+	m_edgeTree = new (mem) cb2DynamicTree;
+
+	cb2Transform xf;
+	xf.SetIdentity();
+	int edgeCount = m_count - 1;
+	cb2AABB* aabbs = (cb2AABB*)cb2Alloc(edgeCount * sizeof(cb2AABB));
+	void** userData = (void**)cb2Alloc(edgeCount * sizeof(void*));
+	int* proxyIds = (int*)cb2Alloc(edgeCount * sizeof(int));
+	for (int i = 0; i < edgeCount; ++i)
+	{
+		ComputeAABB(aabbs + i, xf, i);
+		userData[i] = (void*)(size_t)i;
+	}
+
+	// The edges never move, so build the whole tree at once with the binned SAH.
+	m_edgeTree->CreateProxies(edgeCount, aabbs, userData, proxyIds);
+	m_edgeTree->FreeScratch();
+
+	cb2Free(proxyIds);
+	cb2Free(userData);
+	cb2Free(aabbs);
+}
+
 int cb2ChainShape::GetChildCount() const
 {
 	// edge count = vertex count - 1
@@ -142,11 +200,65 @@ bool cb2ChainShape::TestPoint(const cb2Transform& xf, const ci::Vec2f& p) const
 	return false;
 }
 
+// Keeps the closest edge hit of a ray cast against the edge tree.
+struct cb2ChainRayCastWrapper
+{
+	float RayCastCallback(const cb2RayCastInput& input, int proxyId)
+	{
+		int index = (int)(size_t)tree->GetUserData(proxyId);
+		cb2EdgeShape edge;
+		edge.m_vertex1 = chain->m_vertices[index];
+		edge.m_vertex2 = chain->m_vertices[index + 1];
+
+		cb2Transform xf;
+		xf.SetIdentity();
+		cb2RayCastOutput output;
+		if (edge.RayCast(&output, input, xf, 0))
+		{
+			hit = true;
+			result = output;
+			return output.fraction;
+		}
+
+		return input.maxFraction;
+	}
+
+	const cb2ChainShape* chain;
+	const cb2DynamicTree* tree;
+	cb2RayCastOutput result;
+	bool hit;
+};
+
 bool cb2ChainShape::RayCast(cb2RayCastOutput* output, const cb2RayCastInput& input,
 							const cb2Transform& xf, int childIndex) const
 {
 	cb2Assert(childIndex < m_count);
 
+	if (childIndex == e_allChildren)
+	{
+		cb2Assert(m_edgeTree != NULL);
+
+		// Cast in the frame of the tree.
+		cb2RayCastInput localInput;
+		localInput.p1 = cb2MulT(xf.q, input.p1 - xf.p);
+		localInput.p2 = cb2MulT(xf.q, input.p2 - xf.p);
+		localInput.maxFraction = input.maxFraction;
+
+		cb2ChainRayCastWrapper wrapper;
+		wrapper.chain = this;
+		wrapper.tree = m_edgeTree;
+		wrapper.hit = false;
+		m_edgeTree->RayCast(&wrapper, localInput);
+		if (wrapper.hit == false)
+		{
+			return false;
+		}
+
+		output->fraction = wrapper.result.fraction;
+		output->normal = cb2Mul(xf.q, wrapper.result.normal);
+		return true;
+	}
+
 	cb2EdgeShape edgeShape;
 
 	int i1 = childIndex;
@@ -166,6 +278,22 @@ void cb2ChainShape::ComputeAABB(cb2AABB* aabb, const cb2Transform& xf, int child
 {
 	cb2Assert(childIndex < m_count);
 
+	if (childIndex == e_allChildren)
+	{
+		ci::Vec2f lower = cb2Mul(xf, m_vertices[0]);
+		ci::Vec2f upper = lower;
+		for (int i = 1; i < m_count; ++i)
+		{
+			ci::Vec2f v = cb2Mul(xf, m_vertices[i]);
+			lower = cb2Min(lower, v);
+			upper = cb2Max(upper, v);
+		}
+
+		aabb->lowerBound = lower;
+		aabb->upperBound = upper;
+		return;
+	}
+
 	int i1 = childIndex;
 	int i2 = childIndex + 1;
 	if (i2 == m_count)
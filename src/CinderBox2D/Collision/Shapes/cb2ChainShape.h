@@ -20,6 +20,7 @@
 #define CB2_CHAIN_SHAPE_H
 
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Collision/cb2DynamicTree.h>
 
 class cb2EdgeShape;
 
@@ -47,6 +48,11 @@ public:
 	/// @param count the vertex count
 	void CreateChain(const ci::Vec2f* vertices, int count);
 
+	/// Create a chain on vertices that stay owned by the caller, for example in a
+	/// mapped level file. They must outlive the shape, clones copy them.
+	/// @see cb2World::LoadLevel
+	void BorrowChain(const ci::Vec2f* vertices, int count);
+
 	/// Establish connectivity to a vertex that precedes the first vertex.
 	/// Don't call this for loops.
 	void SetPrevVertex(const ci::Vec2f& prevVertex);
@@ -79,7 +85,13 @@ public:
 	/// @see cb2Shape::ComputeMass
 	void ComputeMass(cb2MassData* massData, float density) const;
 
-	/// The vertices. Owned by this class.
+	/// Query the edge tree for the edges whose AABBs overlap an AABB in world
+	/// coordinates. The callback gets bool QueryEdge(int index) for each edge and
+	/// returns false to stop the query.
+	template <typename T>
+	void QueryEdges(T* callback, const cb2AABB& aabb, const cb2Transform& transform) const;
+
+	/// The vertices. Owned by this class unless they are borrowed.
 	ci::Vec2f* m_vertices;
 
 	/// The vertex count.
@@ -87,6 +99,35 @@ public:
 
 	ci::Vec2f m_prevVertex, m_nextVertex;
 	bool m_hasPrevVertex, m_hasNextVertex;
+
+	/// Keep the edges in a tree of the chain and give the fixture a single broad-phase
+	/// proxy, with the child index e_allChildren, instead of one per edge. This keeps
+	/// long chains such as terrain from flooding the broad-phase tree. Set this before
+	/// creating the fixture.
+	bool m_useEdgeTree;
+
+	/// The edges in the local frame, built for the fixture's clone of the shape
+	/// when m_useEdgeTree is set. Owned by this class.
+	cb2DynamicTree* m_edgeTree;
+
+private:
+
+	void BuildEdgeTree();
+
+	bool m_borrowedVertices;
+};
+
+// Maps the tree proxies of cb2ChainShape::QueryEdges to edge indices.
+template <typename T>
+struct cb2ChainEdgeQuery
+{
+	bool QueryCallback(int proxyId)
+	{
+		return callback->QueryEdge((int)(size_t)tree->GetUserData(proxyId));
+	}
+
+	const cb2DynamicTree* tree;
+	T* callback;
 };
 
 inline cb2ChainShape::cb2ChainShape()
@@ -97,6 +138,20 @@ inline cb2ChainShape::cb2ChainShape()
 	m_count = 0;
 	m_hasPrevVertex = false;
 	m_hasNextVertex = false;
+	m_useEdgeTree = false;
+	m_edgeTree = NULL;
+	m_borrowedVertices = false;
+}
+
+template <typename T>
+inline void cb2ChainShape::QueryEdges(T* callback, const cb2AABB& aabb, const cb2Transform& xf) const
+{
+	cb2Assert(m_edgeTree != NULL);
+
+	cb2ChainEdgeQuery<T> query;
+	query.tree = m_edgeTree;
+	query.callback = callback;
+	m_edgeTree->Query(&query, cb2MulT(xf, aabb));
 }
 
 #endif
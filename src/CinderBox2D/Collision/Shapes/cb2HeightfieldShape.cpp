@@ -0,0 +1,199 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
+#include <new>
+#include <memory.h>
+
+cb2HeightfieldShape::~cb2HeightfieldShape()
+{
+	cb2Free(m_heights);
+	cb2Free(m_holes);
+	m_heights = NULL;
+	m_holes = NULL;
+	m_count = 0;
+}
+
+void cb2HeightfieldShape::Create(const float* heights, int count, float spacing, const bool* holes)
+{
+	cb2Assert(m_heights == NULL && m_count == 0);
+	cb2Assert(count >= 2);
+	// If the code crashes here, it means your samples are too close together.
+	cb2Assert(spacing > cb2_linearSlop);
+
+	m_count = count;
+	m_spacing = spacing;
+	m_heights = (float*)cb2Alloc(count * sizeof(float));
+	memcpy(m_heights, heights, count * sizeof(float));
+
+	if (holes)
+	{
+		m_holes = (bool*)cb2Alloc((count - 1) * sizeof(bool));
+		memcpy(m_holes, holes, (count - 1) * sizeof(bool));
+	}
+
+	m_minHeight = heights[0];
+	m_maxHeight = heights[0];
+	for (int i = 1; i < count; ++i)
+	{
+		m_minHeight = cb2Min(m_minHeight, heights[i]);
+		m_maxHeight = cb2Max(m_maxHeight, heights[i]);
+	}
+}
+
+cb2Shape* cb2HeightfieldShape::Clone(cb2BlockAllocator* allocator) const
+{
+	void* mem = allocator->Allocate(sizeof(cb2HeightfieldShape));
+	cb2HeightfieldShape* clone = new (mem) cb2HeightfieldShape;
+	clone->Create(m_heights, m_count, m_spacing, m_holes);
+	clone->m_radius = m_radius;
+	return clone;
+}
+
+int cb2HeightfieldShape::GetChildCount() const
+{
+	// cell count = sample count - 1
+	return m_count - 1;
+}
+
+void cb2HeightfieldShape::GetChildEdge(cb2EdgeShape* edge, int index) const
+{
+	cb2Assert(0 <= index && index < m_count - 1);
+	edge->m_type = cb2Shape::e_edge;
+	edge->m_radius = m_radius;
+
+	edge->m_vertex1.set(index * m_spacing, m_heights[index]);
+	edge->m_vertex2.set((index + 1) * m_spacing, m_heights[index + 1]);
+
+	// A neighbor that is a hole leaves a free end.
+	edge->m_hasVertex0 = index > 0 && IsHole(index - 1) == false;
+	if (edge->m_hasVertex0)
+	{
+		edge->m_vertex0.set((index - 1) * m_spacing, m_heights[index - 1]);
+	}
+
+	edge->m_hasVertex3 = index < m_count - 2 && IsHole(index + 1) == false;
+	if (edge->m_hasVertex3)
+	{
+		edge->m_vertex3.set((index + 2) * m_spacing, m_heights[index + 2]);
+	}
+}
+
+bool cb2HeightfieldShape::TestPoint(const cb2Transform& xf, const ci::Vec2f& p) const
+{
+	CB2_NOT_USED(xf);
+	CB2_NOT_USED(p);
+	return false;
+}
+
+bool cb2HeightfieldShape::RayCast(cb2RayCastOutput* output, const cb2RayCastInput& input,
+									const cb2Transform& xf, int childIndex) const
+{
+	cb2Assert(childIndex < m_count - 1);
+
+	cb2EdgeShape edge;
+	if (childIndex != e_allChildren)
+	{
+		edge.m_vertex1.set(childIndex * m_spacing, m_heights[childIndex]);
+		edge.m_vertex2.set((childIndex + 1) * m_spacing, m_heights[childIndex + 1]);
+		return edge.RayCast(output, input, xf, 0);
+	}
+
+	// Cast in the local frame.
+	cb2RayCastInput localInput;
+	localInput.p1 = cb2MulT(xf.q, input.p1 - xf.p);
+	localInput.p2 = cb2MulT(xf.q, input.p2 - xf.p);
+	localInput.maxFraction = input.maxFraction;
+
+	ci::Vec2f p1 = localInput.p1;
+	ci::Vec2f p2 = p1 + input.maxFraction * (localInput.p2 - localInput.p1);
+	if (cb2Max(p1.y, p2.y) < m_minHeight || cb2Min(p1.y, p2.y) > m_maxHeight)
+	{
+		return false;
+	}
+
+	// Walk the columns under the ray in the order the ray crosses them. The
+	// columns do not overlap, so the first hit is the closest.
+	float inverseSpacing = 1.0f / m_spacing;
+	int cellCount = m_count - 1;
+	float x1 = floorf(p1.x * inverseSpacing);
+	float x2 = floorf(p2.x * inverseSpacing);
+	if (cb2Max(x1, x2) < 0.0f || cb2Min(x1, x2) > (float)(cellCount - 1))
+	{
+		return false;
+	}
+
+	int i1 = (int)cb2Clamp(x1, 0.0f, (float)(cellCount - 1));
+	int i2 = (int)cb2Clamp(x2, 0.0f, (float)(cellCount - 1));
+	int step = i1 <= i2 ? 1 : -1;
+
+	cb2Transform identity;
+	identity.SetIdentity();
+
+	for (int i = i1; ; i += step)
+	{
+		if (IsHole(i) == false)
+		{
+			edge.m_vertex1.set(i * m_spacing, m_heights[i]);
+			edge.m_vertex2.set((i + 1) * m_spacing, m_heights[i + 1]);
+			if (edge.RayCast(output, localInput, identity, 0))
+			{
+				output->normal = cb2Mul(xf.q, output->normal);
+				return true;
+			}
+		}
+
+		if (i == i2)
+		{
+			break;
+		}
+	}
+
+	return false;
+}
+
+void cb2HeightfieldShape::ComputeAABB(cb2AABB* aabb, const cb2Transform& xf, int childIndex) const
+{
+	cb2Assert(childIndex < m_count - 1);
+
+	if (childIndex == e_allChildren)
+	{
+		cb2AABB localAABB;
+		localAABB.lowerBound.set(0.0f, m_minHeight);
+		localAABB.upperBound.set((m_count - 1) * m_spacing, m_maxHeight);
+		*aabb = cb2Mul(xf, localAABB);
+		return;
+	}
+
+	ci::Vec2f v1 = cb2Mul(xf, ci::Vec2f(childIndex * m_spacing, m_heights[childIndex]));
+	ci::Vec2f v2 = cb2Mul(xf, ci::Vec2f((childIndex + 1) * m_spacing, m_heights[childIndex + 1]));
+
+	aabb->lowerBound = cb2Min(v1, v2);
+	aabb->upperBound = cb2Max(v1, v2);
+}
+
+void cb2HeightfieldShape::ComputeMass(cb2MassData* massData, float density) const
+{
+	CB2_NOT_USED(density);
+
+	massData->mass = 0.0f;
+	cb2::setZero(massData->center);
+	massData->I = 0.0f;
+}
@@ -0,0 +1,155 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_HEIGHTFIELD_SHAPE_H
+#define CB2_HEIGHTFIELD_SHAPE_H
+
+#include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Collision/cb2Collision.h>
+
+class cb2EdgeShape;
+
+/// A heightfield is terrain given as height samples at a fixed spacing along the
+/// local x-axis. Sample i is at (i * m_spacing, m_heights[i]) and each cell between
+/// two samples is an edge child, smoothed like a chain by its neighbors. Cells may
+/// be holes, leaving gaps between platforms.
+/// The fixture gets a single broad-phase proxy and the cells under a box are found
+/// by indexing the columns, so a level costs one fixture instead of thousands.
+/// The samples are allocated using cb2Alloc.
+class cb2HeightfieldShape : public cb2Shape
+{
+public:
+	cb2HeightfieldShape();
+
+	/// The destructor frees the samples using cb2Free.
+	~cb2HeightfieldShape();
+
+	/// Create the heightfield.
+	/// @param heights an array of heights, these are copied
+	/// @param count the sample count, at least two
+	/// @param spacing the distance between samples along the x-axis
+	/// @param holes an optional array with a flag per cell, count - 1 of them.
+	/// Cells with the flag set do not collide. These are copied.
+	void Create(const float* heights, int count, float spacing, const bool* holes = NULL);
+
+	/// Implement cb2Shape. Samples are cloned using cb2Alloc.
+	cb2Shape* Clone(cb2BlockAllocator* allocator) const;
+
+	/// @see cb2Shape::GetChildCount
+	int GetChildCount() const;
+
+	/// Get the edge of a cell, with the neighboring cells as ghost vertices.
+	void GetChildEdge(cb2EdgeShape* edge, int index) const;
+
+	/// Is a cell a hole?
+	bool IsHole(int index) const;
+
+	/// This always return false.
+	/// @see cb2Shape::TestPoint
+	bool TestPoint(const cb2Transform& transform, const ci::Vec2f& p) const;
+
+	/// Implement cb2Shape. With e_allChildren this walks the columns under the ray
+	/// and reports the closest hit.
+	bool RayCast(cb2RayCastOutput* output, const cb2RayCastInput& input,
+					const cb2Transform& transform, int childIndex) const;
+
+	/// @see cb2Shape::ComputeAABB
+	void ComputeAABB(cb2AABB* aabb, const cb2Transform& transform, int childIndex) const;
+
+	/// Heightfields have zero mass.
+	/// @see cb2Shape::ComputeMass
+	void ComputeMass(cb2MassData* massData, float density) const;
+
+	/// Find the cells that are not holes and whose AABBs overlap an AABB in world
+	/// coordinates. The callback gets bool QueryEdge(int index) for each cell and
+	/// returns false to stop the query.
+	template <typename T>
+	void QueryEdges(T* callback, const cb2AABB& aabb, const cb2Transform& transform) const;
+
+	/// The heights. Owned by this class.
+	float* m_heights;
+
+	/// The hole flags, one per cell, or NULL if there are none. Owned by this class.
+	bool* m_holes;
+
+	/// The sample count.
+	int m_count;
+
+	/// The distance between samples.
+	float m_spacing;
+
+	/// The range of the heights.
+	float m_minHeight, m_maxHeight;
+};
+
+inline cb2HeightfieldShape::cb2HeightfieldShape()
+{
+	m_type = e_heightfield;
+	m_radius = cb2_polygonRadius;
+	m_heights = NULL;
+	m_holes = NULL;
+	m_count = 0;
+	m_spacing = 1.0f;
+	m_minHeight = 0.0f;
+	m_maxHeight = 0.0f;
+}
+
+inline bool cb2HeightfieldShape::IsHole(int index) const
+{
+	cb2Assert(0 <= index && index < m_count - 1);
+	return m_holes != NULL && m_holes[index];
+}
+
+template <typename T>
+inline void cb2HeightfieldShape::QueryEdges(T* callback, const cb2AABB& aabb, const cb2Transform& xf) const
+{
+	cb2AABB localAABB = cb2MulT(xf, aabb);
+	if (localAABB.upperBound.y < m_minHeight || localAABB.lowerBound.y > m_maxHeight)
+	{
+		return;
+	}
+
+	// The columns under the box.
+	float inverseSpacing = 1.0f / m_spacing;
+	int cellCount = m_count - 1;
+	int lower = (int)cb2Clamp(floorf(localAABB.lowerBound.x * inverseSpacing), 0.0f, (float)cellCount);
+	int upper = (int)cb2Clamp(floorf(localAABB.upperBound.x * inverseSpacing), -1.0f, (float)(cellCount - 1));
+
+	for (int i = lower; i <= upper; ++i)
+	{
+		if (m_holes != NULL && m_holes[i])
+		{
+			continue;
+		}
+
+		float h1 = m_heights[i];
+		float h2 = m_heights[i + 1];
+		if (cb2Max(h1, h2) < localAABB.lowerBound.y || cb2Min(h1, h2) > localAABB.upperBound.y)
+		{
+			continue;
+		}
+
+		if (callback->QueryEdge(i) == false)
+		{
+			return;
+		}
+	}
+}
+
+#endif
@@ -17,6 +17,7 @@
 */
 
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Common/cb2BatchMath.h>
 #include <new>
 
 cb2Shape* cb2PolygonShape::Clone(cb2BlockAllocator* allocator) const
@@ -39,6 +40,7 @@ void cb2PolygonShape::SetAsBox(float hx, float hy)
 	m_normals[2].set(0.0f, 1.0f);
 	m_normals[3].set(-1.0f, 0.0f);
 	cb2::setZero(m_centroid);
+	UpdateLanes();
 }
 
 void cb2PolygonShape::SetAsBox(float hx, float hy, const ci::Vec2f& center, float angle)
@@ -64,6 +66,30 @@ void cb2PolygonShape::SetAsBox(float hx, float hy, const ci::Vec2f& center, floa
 		m_vertices[i] = cb2Mul(xf, m_vertices[i]);
 		m_normals[i] = cb2Mul(xf.q, m_normals[i]);
 	}
+
+	UpdateLanes();
+}
+
+void cb2PolygonShape::UpdateLanes()
+{
+	cb2Assert(0 < m_count && m_count <= cb2_maxPolygonVertices);
+	for (int i = 0; i < cb2_maxPolygonLanes; ++i)
+	{
+		// Copies of the first vertex never win over it in a search.
+		int j = i < m_count ? i : 0;
+		m_vertexX[i] = m_vertices[j].x;
+		m_vertexY[i] = m_vertices[j].y;
+		m_normalX[i] = m_normals[j].x;
+		m_normalY[i] = m_normals[j].y;
+	}
+
+	// The opposite vertices of a parallelogram share their midpoint.
+	m_box = false;
+	if (m_count == 4)
+	{
+		ci::Vec2f d = m_vertices[0] + m_vertices[2] - m_vertices[1] - m_vertices[3];
+		m_box = cb2Abs(d.x) + cb2Abs(d.y) <= 0.001f * cb2_linearSlop;
+	}
 }
 
 int cb2PolygonShape::GetChildCount() const
@@ -238,6 +264,8 @@ void cb2PolygonShape::set(const ci::Vec2f* vertices, int count)
 
 	// Compute the polygon centroid.
 	m_centroid = ComputeCentroid(m_vertices, m);
+
+	UpdateLanes();
 }
 
 bool cb2PolygonShape::TestPoint(const cb2Transform& xf, const ci::Vec2f& p) const
@@ -332,15 +360,8 @@ void cb2PolygonShape::ComputeAABB(cb2AABB* aabb, const cb2Transform& xf, int chi
 {
 	CB2_NOT_USED(childIndex);
 
-	ci::Vec2f lower = cb2Mul(xf, m_vertices[0]);
-	ci::Vec2f upper = lower;
-
-	for (int i = 1; i < m_count; ++i)
-	{
-		ci::Vec2f v = cb2Mul(xf, m_vertices[i]);
-		lower = cb2Min(lower, v);
-		upper = cb2Max(upper, v);
-	}
+	ci::Vec2f lower, upper;
+	cb2BoundBatch(xf, m_vertexX, m_vertexY, m_count, &lower, &upper);
 
 	ci::Vec2f r(m_radius, m_radius);
 	aabb->lowerBound = lower - r;
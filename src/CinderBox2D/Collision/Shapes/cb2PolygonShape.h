@@ -20,6 +20,7 @@
 #define CB2_POLYGON_SHAPE_H
 
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Common/cb2Simd.h>
 
 /// A convex polygon. It is assumed that the interior of the polygon is to
 /// the left of each edge.
@@ -78,10 +79,26 @@ public:
 	/// @returns true if valid
 	bool Validate() const;
 
+	/// Copy the vertices and normals into the lane arrays and find out whether the
+	/// polygon is a box. set and SetAsBox do this, call it after changing m_vertices
+	/// or m_normals yourself.
+	void UpdateLanes();
+
 	ci::Vec2f m_centroid;
 	ci::Vec2f m_vertices[cb2_maxPolygonVertices];
 	ci::Vec2f m_normals[cb2_maxPolygonVertices];
 	int m_count;
+
+	/// True for boxes and other parallelograms, two of them skip half the separating
+	/// axis tests in cb2CollidePolygons. UpdateLanes sets it.
+	bool m_box;
+
+	/// The vertices and normals stored by coordinate for the SIMD support searches,
+	/// padded to whole vectors with copies of the first one.
+	float m_vertexX[cb2_maxPolygonLanes];
+	float m_vertexY[cb2_maxPolygonLanes];
+	float m_normalX[cb2_maxPolygonLanes];
+	float m_normalY[cb2_maxPolygonLanes];
 };
 
 inline cb2PolygonShape::cb2PolygonShape()
@@ -89,6 +106,7 @@ inline cb2PolygonShape::cb2PolygonShape()
 	m_type = e_polygon;
 	m_radius = cb2_polygonRadius;
 	m_count = 0;
+	m_box = false;
 }
 
 inline const ci::Vec2f& cb2PolygonShape::GetVertex(int index) const
@@ -49,9 +49,29 @@ public:
 		e_edge = 1,
 		e_polygon = 2,
 		e_chain = 3,
-		e_typeCount = 4
+		e_capsule = 4,
+		e_heightfield = 5,
+		e_typeCount = 6
 	};
 
+	enum
+	{
+		/// The child index of a broad-phase proxy shared by all children of a shape.
+		/// Ray casts and AABBs with this index cover all children.
+		e_allChildren = -1
+	};
+
+	cb2Shape() : m_shareCount(0) {}
+
+	/// Copies of a shape are never shared.
+	cb2Shape(const cb2Shape& other) : m_type(other.m_type), m_radius(other.m_radius), m_shareCount(0) {}
+	cb2Shape& operator=(const cb2Shape& other)
+	{
+		m_type = other.m_type;
+		m_radius = other.m_radius;
+		return *this;
+	}
+
 	virtual ~cb2Shape() {}
 
 	/// Clone the concrete shape using the provided allocator.
@@ -91,6 +111,11 @@ public:
 
 	Type m_type;
 	float m_radius;
+
+	/// The number of fixtures and world references holding a shared shape, see
+	/// cb2World::CreateSharedShape. This is 0 for shapes that are not shared and
+	/// negative for the shapes of a cb2StaticLayer, which are not counted.
+	int m_shareCount;
 };
 
 inline cb2Shape::Type cb2Shape::GetType() const
@@ -17,50 +17,409 @@
 */
 
 #include <CinderBox2D/Collision/cb2BroadPhase.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
 
-cb2BroadPhase::cb2BroadPhase()
+// The digit size of the pair radix sort.
+#define cb2_pairRadixBits	11
+
+cb2BroadPhase::cb2BroadPhase(cb2AllocatorInterface* allocator)
+	: m_allocator(allocator), m_tree(allocator), m_staticTree(allocator), m_grid(allocator),
+	m_queryTree(allocator), m_staticQueryTree(allocator)
 {
+	m_gridEnabled = false;
+
+	m_staticInsertCount = 0;
+	m_staticProxyCount = 0;
+	m_queryTreeIndex = 0;
+
+	m_queryTreeEnabled = false;
+
 	m_proxyCount = 0;
+	m_reinsertCount = 0;
+
+	m_categoryPruning = true;
 
 	m_pairCapacity = 16;
 	m_pairCount = 0;
-	m_pairBuffer = (cb2Pair*)cb2Alloc(m_pairCapacity * sizeof(cb2Pair));
+	m_pairBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_pairCapacity * sizeof(cb2Pair));
+
+	m_sortBuffer = NULL;
+	m_sortCapacity = 0;
 
 	m_moveCapacity = 16;
 	m_moveCount = 0;
-	m_moveBuffer = (int*)cb2Alloc(m_moveCapacity * sizeof(int));
+	m_moveBuffer = (int*)cb2Alloc(m_allocator, m_moveCapacity * sizeof(int));
+
+	m_taskScheduler = NULL;
+	m_threadPairs = NULL;
+	m_threadPairCount = 0;
 }
 
 cb2BroadPhase::~cb2BroadPhase()
 {
-	cb2Free(m_moveBuffer);
-	cb2Free(m_pairBuffer);
+	SetTaskScheduler(NULL);
+	cb2Free(m_allocator, m_moveBuffer);
+	cb2Free(m_allocator, m_pairBuffer);
+	cb2Free(m_allocator, m_sortBuffer);
+}
+
+void cb2BroadPhase::SetTaskScheduler(cb2TaskScheduler* scheduler)
+{
+	for (int i = 0; i < m_threadPairCount; ++i)
+	{
+		cb2Free(m_allocator, m_threadPairs[i].pairs);
+	}
+	cb2Free(m_allocator, m_threadPairs);
+	m_threadPairs = NULL;
+	m_threadPairCount = 0;
+
+	m_taskScheduler = scheduler;
+
+	if (m_taskScheduler)
+	{
+		m_threadPairCount = m_taskScheduler->GetThreadCount();
+		m_threadPairs = (cb2PairBuffer*)cb2Alloc(m_allocator, m_threadPairCount * sizeof(cb2PairBuffer));
+		for (int i = 0; i < m_threadPairCount; ++i)
+		{
+			cb2PairBuffer* buffer = m_threadPairs + i;
+			buffer->allocator = m_allocator;
+			buffer->capacity = 16;
+			buffer->count = 0;
+			buffer->pairs = (cb2Pair*)cb2Alloc(m_allocator, buffer->capacity * sizeof(cb2Pair));
+			buffer->queryProxyId = e_nullProxy;
+			buffer->queryTree = 0;
+		}
+	}
 }
 
-int cb2BroadPhase::CreateProxy(const cb2AABB& aabb, void* userData)
+void cb2BroadPhase::SetQueryTreeEnabled(bool flag)
 {
-	int proxyId = m_tree.CreateProxy(aabb, userData);
+	m_queryTreeEnabled = flag;
+	if (flag)
+	{
+		UpdateQueryTree();
+	}
+	else
+	{
+		m_queryTree.Clear();
+		m_staticQueryTree.Clear();
+	}
+}
+
+void cb2BroadPhase::UpdateQueryTree()
+{
+	if (m_queryTreeEnabled == false)
+	{
+		return;
+	}
+
+	if (m_queryTree.IsCurrent(m_tree) == false)
+	{
+		m_queryTree.Build(m_tree);
+	}
+
+	if (m_staticQueryTree.IsCurrent(m_staticTree) == false)
+	{
+		m_staticQueryTree.Build(m_staticTree);
+	}
+}
+
+void cb2BroadPhase::SetGridCellSize(float cellSize)
+{
+	cb2Assert(m_proxyCount == m_staticProxyCount);
+	cb2Assert(cellSize >= 0.0f);
+	m_gridEnabled = cellSize > 0.0f;
+	if (m_gridEnabled)
+	{
+		m_grid.SetCellSize(cellSize);
+	}
+}
+
+int cb2BroadPhase::CreateProxy(const cb2AABB& aabb, void* userData, bool isStatic)
+{
+	// A shared static tree takes no more proxies.
+	isStatic = isStatic && m_staticTree.IsShared() == false;
+
+	int proxyId;
+	if (isStatic)
+	{
+		proxyId = 2 * m_staticTree.CreateProxy(aabb, userData) + 1;
+		++m_staticInsertCount;
+		++m_staticProxyCount;
+	}
+	else if (m_gridEnabled)
+	{
+		proxyId = 2 * m_grid.CreateProxy(aabb, userData);
+	}
+	else
+	{
+		proxyId = 2 * m_tree.CreateProxy(aabb, userData);
+	}
+
 	++m_proxyCount;
 	BufferMove(proxyId);
 	return proxyId;
 }
 
+void cb2BroadPhase::CreateProxies(int count, const cb2AABB* aabbs, void** userData, int* proxyIds, bool isStatic)
+{
+	isStatic = isStatic && m_staticTree.IsShared() == false;
+
+	// The tree picks between insertion and a bulk rebuild on its own.
+	if (isStatic)
+	{
+		m_staticTree.CreateProxies(count, aabbs, userData, proxyIds);
+		m_staticProxyCount += count;
+	}
+	else if (m_gridEnabled)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			proxyIds[i] = m_grid.CreateProxy(aabbs[i], userData[i]);
+		}
+	}
+	else
+	{
+		m_tree.CreateProxies(count, aabbs, userData, proxyIds);
+	}
+
+	m_proxyCount += count;
+	for (int i = 0; i < count; ++i)
+	{
+		proxyIds[i] = 2 * proxyIds[i] + (isStatic ? 1 : 0);
+		BufferMove(proxyIds[i]);
+	}
+}
+
 void cb2BroadPhase::DestroyProxy(int proxyId)
 {
 	UnBufferMove(proxyId);
+	RemoveProxy(proxyId);
+}
+
+void cb2BroadPhase::DestroyProxies(int* proxyIds, int count)
+{
+	std::sort(proxyIds, proxyIds + count);
+	for (int i = 0; i < m_moveCount; ++i)
+	{
+		if (std::binary_search(proxyIds, proxyIds + count, m_moveBuffer[i]))
+		{
+			m_moveBuffer[i] = e_nullProxy;
+		}
+	}
+
+	// Split the ids by tree so that each tree can remove its batch at once.
+	int* nodeIds = (int*)cb2Alloc(m_allocator, cb2Max(count, 1) * sizeof(int));
+	int staticCount = 0;
+	int dynamicCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (IsStaticProxy(proxyIds[i]) == false)
+		{
+			nodeIds[dynamicCount++] = GetNodeId(proxyIds[i]);
+		}
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		if (IsStaticProxy(proxyIds[i]))
+		{
+			nodeIds[dynamicCount + staticCount++] = GetNodeId(proxyIds[i]);
+		}
+	}
+
+	m_proxyCount -= count;
+	m_staticProxyCount -= staticCount;
+	m_staticTree.DestroyProxies(nodeIds + dynamicCount, staticCount);
+	if (m_gridEnabled)
+	{
+		for (int i = 0; i < dynamicCount; ++i)
+		{
+			m_grid.DestroyProxy(nodeIds[i]);
+		}
+	}
+	else
+	{
+		m_tree.DestroyProxies(nodeIds, dynamicCount);
+	}
+
+	cb2Free(m_allocator, nodeIds);
+}
+
+void cb2BroadPhase::RemoveProxy(int proxyId)
+{
 	--m_proxyCount;
-	m_tree.DestroyProxy(proxyId);
+	if (IsStaticProxy(proxyId))
+	{
+		--m_staticProxyCount;
+		m_staticTree.DestroyProxy(GetNodeId(proxyId));
+	}
+	else if (m_gridEnabled)
+	{
+		m_grid.DestroyProxy(GetNodeId(proxyId));
+	}
+	else
+	{
+		m_tree.DestroyProxy(GetNodeId(proxyId));
+	}
 }
 
 void cb2BroadPhase::MoveProxy(int proxyId, const cb2AABB& aabb, const ci::Vec2f& displacement)
 {
-	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	bool buffer;
+	if (IsStaticProxy(proxyId))
+	{
+		buffer = m_staticTree.MoveProxy(GetNodeId(proxyId), aabb, displacement);
+	}
+	else if (m_gridEnabled)
+	{
+		buffer = m_grid.MoveProxy(GetNodeId(proxyId), aabb, displacement);
+	}
+	else
+	{
+		buffer = m_tree.MoveProxy(GetNodeId(proxyId), aabb, displacement);
+	}
+
 	if (buffer)
 	{
+		++m_reinsertCount;
 		BufferMove(proxyId);
 	}
 }
 
+void cb2BroadPhase::MoveProxies(const int* proxyIds, const cb2AABB* aabbs, int count)
+{
+	// Split the proxies by tree, the static ones go last.
+	int* nodeIds = (int*)cb2Alloc(m_allocator, cb2Max(count, 1) * sizeof(int));
+	cb2AABB* nodeAABBs = (cb2AABB*)cb2Alloc(m_allocator, cb2Max(count, 1) * sizeof(cb2AABB));
+	int dynamicCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (IsStaticProxy(proxyIds[i]) == false)
+		{
+			nodeIds[dynamicCount] = GetNodeId(proxyIds[i]);
+			nodeAABBs[dynamicCount++] = aabbs[i];
+		}
+	}
+	int staticCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (IsStaticProxy(proxyIds[i]))
+		{
+			nodeIds[dynamicCount + staticCount] = GetNodeId(proxyIds[i]);
+			nodeAABBs[dynamicCount + staticCount++] = aabbs[i];
+		}
+	}
+
+	int* staticIds = nodeIds + dynamicCount;
+	int movedCount = m_staticTree.MoveProxies(staticIds, nodeAABBs + dynamicCount, staticCount);
+	for (int i = 0; i < movedCount; ++i)
+	{
+		BufferMove(2 * staticIds[i] + 1);
+	}
+	m_reinsertCount += movedCount;
+
+	if (m_gridEnabled)
+	{
+		ci::Vec2f displacement(0.0f, 0.0f);
+		for (int i = 0; i < dynamicCount; ++i)
+		{
+			if (m_grid.MoveProxy(nodeIds[i], nodeAABBs[i], displacement))
+			{
+				++m_reinsertCount;
+				BufferMove(2 * nodeIds[i]);
+			}
+		}
+	}
+	else
+	{
+		movedCount = m_tree.MoveProxies(nodeIds, nodeAABBs, dynamicCount);
+		for (int i = 0; i < movedCount; ++i)
+		{
+			BufferMove(2 * nodeIds[i]);
+		}
+		m_reinsertCount += movedCount;
+	}
+
+	cb2Free(m_allocator, nodeAABBs);
+	cb2Free(m_allocator, nodeIds);
+}
+
+void cb2BroadPhase::SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits)
+{
+	if (IsStaticProxy(proxyId))
+	{
+		m_staticTree.SetProxyFilter(GetNodeId(proxyId), categoryBits, maskBits);
+	}
+	else if (m_gridEnabled)
+	{
+		m_grid.SetProxyFilter(GetNodeId(proxyId), categoryBits, maskBits);
+	}
+	else
+	{
+		m_tree.SetProxyFilter(GetNodeId(proxyId), categoryBits, maskBits);
+	}
+}
+
+void cb2BroadPhase::Reserve(int movingCount, int staticCount)
+{
+	cb2Assert(movingCount >= 0 && staticCount >= 0);
+
+	if (m_gridEnabled)
+	{
+		m_grid.Reserve(movingCount);
+	}
+	else
+	{
+		m_tree.Reserve(2 * movingCount);
+	}
+	m_staticTree.Reserve(2 * staticCount);
+
+	// New proxies are buffered until the next UpdatePairs.
+	int moveCount = movingCount + staticCount;
+	if (moveCount > m_moveCapacity)
+	{
+		int* oldBuffer = m_moveBuffer;
+		m_moveCapacity = moveCount;
+		m_moveBuffer = (int*)cb2Alloc(m_allocator, m_moveCapacity * sizeof(int));
+		memcpy(m_moveBuffer, oldBuffer, m_moveCount * sizeof(int));
+		cb2Free(m_allocator, oldBuffer);
+	}
+}
+
+void cb2BroadPhase::ReservePairs(int pairCount)
+{
+	cb2Assert(pairCount >= 0);
+
+	if (pairCount > m_pairCapacity)
+	{
+		cb2Pair* oldBuffer = m_pairBuffer;
+		m_pairCapacity = pairCount;
+		m_pairBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_pairCapacity * sizeof(cb2Pair));
+		memcpy(m_pairBuffer, oldBuffer, m_pairCount * sizeof(cb2Pair));
+		cb2Free(m_allocator, oldBuffer);
+	}
+
+	if (m_sortCapacity < m_pairCapacity)
+	{
+		cb2Free(m_allocator, m_sortBuffer);
+		m_sortCapacity = m_pairCapacity;
+		m_sortBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_sortCapacity * sizeof(cb2Pair));
+	}
+
+	// The threads split the moved proxies, but one of them may find all the pairs.
+	for (int i = 0; i < m_threadPairCount; ++i)
+	{
+		cb2PairBuffer* buffer = m_threadPairs + i;
+		if (pairCount > buffer->capacity)
+		{
+			cb2Free(m_allocator, buffer->pairs);
+			buffer->capacity = pairCount;
+			buffer->pairs = (cb2Pair*)cb2Alloc(m_allocator, buffer->capacity * sizeof(cb2Pair));
+		}
+	}
+}
+
 void cb2BroadPhase::TouchProxy(int proxyId)
 {
 	BufferMove(proxyId);
@@ -72,9 +431,9 @@ void cb2BroadPhase::BufferMove(int proxyId)
 	{
 		int* oldBuffer = m_moveBuffer;
 		m_moveCapacity *= 2;
-		m_moveBuffer = (int*)cb2Alloc(m_moveCapacity * sizeof(int));
+		m_moveBuffer = (int*)cb2Alloc(m_allocator, m_moveCapacity * sizeof(int));
 		memcpy(m_moveBuffer, oldBuffer, m_moveCount * sizeof(int));
-		cb2Free(oldBuffer);
+		cb2Free(m_allocator, oldBuffer);
 	}
 
 	m_moveBuffer[m_moveCount] = proxyId;
@@ -92,9 +451,11 @@ void cb2BroadPhase::UnBufferMove(int proxyId)
 	}
 }
 
-// This is called from cb2DynamicTree::Query when we are gathering pairs.
-bool cb2BroadPhase::QueryCallback(int proxyId)
+// This is called from the tree and grid queries when we are gathering pairs.
+bool cb2BroadPhase::QueryCallback(int nodeId)
 {
+	int proxyId = 2 * nodeId + m_queryTreeIndex;
+
 	// A proxy cannot form a pair with itself.
 	if (proxyId == m_queryProxyId)
 	{
@@ -106,9 +467,9 @@ bool cb2BroadPhase::QueryCallback(int proxyId)
 	{
 		cb2Pair* oldBuffer = m_pairBuffer;
 		m_pairCapacity *= 2;
-		m_pairBuffer = (cb2Pair*)cb2Alloc(m_pairCapacity * sizeof(cb2Pair));
+		m_pairBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_pairCapacity * sizeof(cb2Pair));
 		memcpy(m_pairBuffer, oldBuffer, m_pairCount * sizeof(cb2Pair));
-		cb2Free(oldBuffer);
+		cb2Free(m_allocator, oldBuffer);
 	}
 
 	m_pairBuffer[m_pairCount].proxyIdA = cb2Min(proxyId, m_queryProxyId);
@@ -117,3 +478,385 @@ bool cb2BroadPhase::QueryCallback(int proxyId)
 
 	return true;
 }
+
+bool cb2PairBuffer::QueryCallback(int nodeId)
+{
+	int proxyId = 2 * nodeId + queryTree;
+
+	// A proxy cannot form a pair with itself.
+	if (proxyId == queryProxyId)
+	{
+		return true;
+	}
+
+	// Grow the pair buffer as needed.
+	if (count == capacity)
+	{
+		cb2Pair* oldPairs = pairs;
+		capacity *= 2;
+		pairs = (cb2Pair*)cb2Alloc(allocator, capacity * sizeof(cb2Pair));
+		memcpy(pairs, oldPairs, count * sizeof(cb2Pair));
+		cb2Free(allocator, oldPairs);
+	}
+
+	pairs[count].proxyIdA = cb2Min(proxyId, queryProxyId);
+	pairs[count].proxyIdB = cb2Max(proxyId, queryProxyId);
+	++count;
+
+	return true;
+}
+
+void cb2BroadPhase::FindPairsTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_TRACE_ZONE_COUNT("FindPairsTask", end - begin);
+
+	cb2BroadPhase* broadPhase = (cb2BroadPhase*)context;
+	cb2PairBuffer* buffer = broadPhase->m_threadPairs + threadIndex;
+
+	for (int i = begin; i < end; ++i)
+	{
+		buffer->queryProxyId = broadPhase->m_moveBuffer[i];
+		if (buffer->queryProxyId == e_nullProxy)
+		{
+			continue;
+		}
+
+		const cb2AABB& fatAABB = broadPhase->GetFatAABB(buffer->queryProxyId);
+		unsigned short maskBits = broadPhase->GetPairMaskBits(buffer->queryProxyId);
+		buffer->queryTree = 0;
+		broadPhase->QueryMoving(buffer, fatAABB, maskBits);
+
+		if (IsStaticProxy(buffer->queryProxyId) == false)
+		{
+			buffer->queryTree = 1;
+			broadPhase->m_staticTree.Query(buffer, fatAABB, maskBits);
+		}
+	}
+}
+
+void cb2BroadPhase::FindPairs()
+{
+	// Reset pair buffer
+	m_pairCount = 0;
+
+	// Level geometry is usually created body by body. Once that doubled the static
+	// tree, give it a bulk build, it only changes rarely after that.
+	if (m_staticInsertCount > 0 && 2 * m_staticInsertCount >= m_staticProxyCount)
+	{
+		m_staticTree.RebuildTopDown();
+		m_staticInsertCount = 0;
+	}
+
+	if (m_taskScheduler && m_moveCount > 64)
+	{
+		for (int i = 0; i < m_threadPairCount; ++i)
+		{
+			m_threadPairs[i].count = 0;
+		}
+
+		// The tree is read only while the queries run, each thread has its own pairs.
+		void* group = m_taskScheduler->EnqueueRange(FindPairsTask, this, m_moveCount, 32);
+		m_taskScheduler->Wait(group);
+
+		int pairCount = 0;
+		for (int i = 0; i < m_threadPairCount; ++i)
+		{
+			pairCount += m_threadPairs[i].count;
+		}
+
+		if (pairCount > m_pairCapacity)
+		{
+			cb2Free(m_allocator, m_pairBuffer);
+			while (m_pairCapacity < pairCount)
+			{
+				m_pairCapacity *= 2;
+			}
+			m_pairBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_pairCapacity * sizeof(cb2Pair));
+		}
+
+		for (int i = 0; i < m_threadPairCount; ++i)
+		{
+			memcpy(m_pairBuffer + m_pairCount, m_threadPairs[i].pairs, m_threadPairs[i].count * sizeof(cb2Pair));
+			m_pairCount += m_threadPairs[i].count;
+		}
+	}
+	else
+	{
+		// Perform tree queries for all moving proxies.
+		for (int i = 0; i < m_moveCount; ++i)
+		{
+			m_queryProxyId = m_moveBuffer[i];
+			if (m_queryProxyId == e_nullProxy)
+			{
+				continue;
+			}
+
+			// We have to query the tree with the fat AABB so that
+			// we don't fail to create a pair that may touch later.
+			const cb2AABB& fatAABB = GetFatAABB(m_queryProxyId);
+
+			// Query tree, create pairs and add them pair buffer. Static
+			// proxies don't pair with each other. Subtrees without a category
+			// in the mask of the proxy are skipped.
+			unsigned short maskBits = GetPairMaskBits(m_queryProxyId);
+			m_queryTreeIndex = 0;
+			QueryMoving(this, fatAABB, maskBits);
+
+			if (IsStaticProxy(m_queryProxyId) == false)
+			{
+				m_queryTreeIndex = 1;
+				m_staticTree.Query(this, fatAABB, maskBits);
+			}
+		}
+	}
+
+	// Reset move buffer
+	m_moveCount = 0;
+
+	// Sort the pair buffer to expose duplicates. This also makes the pair order
+	// independent of how the queries were split between threads.
+	SortPairs();
+}
+
+// One stable counting sort pass on a digit of proxy id A or B. Returns false
+// without moving the pairs if they all have the same digit.
+static bool cb2SortPairDigit(const cb2Pair* pairs, cb2Pair* sorted, int count, bool keyA, int shift)
+{
+	const int mask = (1 << cb2_pairRadixBits) - 1;
+	int starts[1 << cb2_pairRadixBits];
+	memset(starts, 0, sizeof(starts));
+
+	for (int i = 0; i < count; ++i)
+	{
+		int key = keyA ? pairs[i].proxyIdA : pairs[i].proxyIdB;
+		++starts[(key >> shift) & mask];
+	}
+
+	int start = 0;
+	for (int i = 0; i <= mask; ++i)
+	{
+		int digitCount = starts[i];
+		if (digitCount == count)
+		{
+			return false;
+		}
+		starts[i] = start;
+		start += digitCount;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int key = keyA ? pairs[i].proxyIdA : pairs[i].proxyIdB;
+		sorted[starts[(key >> shift) & mask]++] = pairs[i];
+	}
+
+	return true;
+}
+
+// Big wake ups produce hundreds of thousands of pairs, these get a least
+// significant digit radix sort on proxy id B and then A. The result is the
+// order of cb2PairLessThan.
+void cb2BroadPhase::SortPairs()
+{
+	if (m_pairCount < 256)
+	{
+		std::sort(m_pairBuffer, m_pairBuffer + m_pairCount, cb2PairLessThan);
+		return;
+	}
+
+	if (m_sortCapacity < m_pairCapacity)
+	{
+		cb2Free(m_allocator, m_sortBuffer);
+		m_sortCapacity = m_pairCapacity;
+		m_sortBuffer = (cb2Pair*)cb2Alloc(m_allocator, m_sortCapacity * sizeof(cb2Pair));
+	}
+
+	int bits = 0;
+	for (int i = 0; i < m_pairCount; ++i)
+	{
+		bits |= m_pairBuffer[i].proxyIdB;
+	}
+
+	int digitCount = 0;
+	while (bits >> (cb2_pairRadixBits * digitCount))
+	{
+		++digitCount;
+	}
+
+	cb2Pair* pairs = m_pairBuffer;
+	cb2Pair* sorted = m_sortBuffer;
+	for (int key = 0; key < 2; ++key)
+	{
+		for (int digit = 0; digit < digitCount; ++digit)
+		{
+			// Proxy id A is never above proxy id B, so B sets the digit count.
+			if (cb2SortPairDigit(pairs, sorted, m_pairCount, key == 1, cb2_pairRadixBits * digit))
+			{
+				cb2Pair* swap = pairs;
+				pairs = sorted;
+				sorted = swap;
+			}
+		}
+	}
+
+	if (pairs != m_pairBuffer)
+	{
+		memcpy(m_pairBuffer, pairs, m_pairCount * sizeof(cb2Pair));
+	}
+}
+
+void cb2BroadPhase::Save(cb2Snapshot* snapshot, bool keepShared) const
+{
+	snapshot->Write(m_gridEnabled);
+	snapshot->Write(m_categoryPruning);
+	snapshot->Write(m_proxyCount);
+	snapshot->Write(m_staticProxyCount);
+	snapshot->Write(m_staticInsertCount);
+	snapshot->Write(m_reinsertCount);
+
+	if (keepShared)
+	{
+		snapshot->Write(m_staticTree.IsShared());
+	}
+	if (keepShared == false || m_staticTree.IsShared() == false)
+	{
+		m_staticTree.Save(snapshot);
+	}
+	if (m_gridEnabled)
+	{
+		m_grid.Save(snapshot);
+	}
+	else
+	{
+		m_tree.Save(snapshot);
+	}
+
+	snapshot->Write(m_moveCount);
+	snapshot->Write(m_moveBuffer, m_moveCount * sizeof(int));
+}
+
+void cb2BroadPhase::SaveStaticTree(cb2Snapshot* snapshot) const
+{
+	m_staticTree.Save(snapshot);
+}
+
+bool cb2BroadPhase::LoadStaticTree(cb2Snapshot* snapshot, int proxyCount)
+{
+	cb2Assert(proxyCount >= 0);
+	if (m_staticTree.Load(snapshot) == false)
+	{
+		return false;
+	}
+
+	if (proxyCount != m_staticTree.GetProxyCount())
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	m_proxyCount += proxyCount - m_staticProxyCount;
+	m_staticProxyCount = proxyCount;
+	m_staticInsertCount = 0;
+	return true;
+}
+
+void cb2BroadPhase::ShareStaticTree(const cb2BroadPhase* broadPhase)
+{
+	cb2Assert(broadPhase != this && broadPhase->m_staticTree.IsShared() == false);
+	m_staticTree.Share(&broadPhase->m_staticTree);
+	m_proxyCount += broadPhase->m_staticProxyCount - m_staticProxyCount;
+	m_staticProxyCount = broadPhase->m_staticProxyCount;
+	m_staticInsertCount = 0;
+}
+
+bool cb2BroadPhase::Load(cb2Snapshot* snapshot, bool keepShared)
+{
+	bool gridEnabled = snapshot->ReadBool();
+	bool categoryPruning = snapshot->ReadBool();
+	int proxyCount = snapshot->Read<int>();
+	int staticProxyCount = snapshot->Read<int>();
+	int staticInsertCount = snapshot->Read<int>();
+	int reinsertCount = snapshot->Read<int>();
+	if (snapshot->IsValid() == false || staticProxyCount < 0 || staticProxyCount > proxyCount)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	// A shared tree stays as it is, it cannot have changed.
+	bool shared = keepShared && snapshot->ReadBool();
+	if (snapshot->IsValid() == false || shared != (keepShared && m_staticTree.IsShared()))
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	if (shared == false && m_staticTree.Load(snapshot) == false)
+	{
+		return false;
+	}
+
+	if (gridEnabled ? m_grid.Load(snapshot) == false : m_tree.Load(snapshot) == false)
+	{
+		return false;
+	}
+
+	int moveCount = snapshot->ReadCount(sizeof(int));
+	if (snapshot->IsValid() == false)
+	{
+		return false;
+	}
+
+	if (moveCount > m_moveCapacity)
+	{
+		cb2Free(m_allocator, m_moveBuffer);
+		m_moveCapacity = moveCount;
+		m_moveBuffer = (int*)cb2Alloc(m_allocator, m_moveCapacity * sizeof(int));
+	}
+	snapshot->Read(m_moveBuffer, moveCount * sizeof(int));
+	m_moveCount = moveCount;
+
+	m_gridEnabled = gridEnabled;
+	m_categoryPruning = categoryPruning;
+	m_proxyCount = proxyCount;
+	m_staticProxyCount = staticProxyCount;
+	m_staticInsertCount = staticInsertCount;
+	m_reinsertCount = reinsertCount;
+	m_pairCount = 0;
+
+	// The counts must be those of the loaded proxies, so each proxy gets its user data.
+	int movingCount = gridEnabled ? m_grid.GetProxyCount() : m_tree.GetProxyCount();
+	if (staticProxyCount != m_staticTree.GetProxyCount() || proxyCount != staticProxyCount + movingCount)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	// The moved proxies are looked up by UpdatePairs.
+	for (int i = 0; i < m_moveCount; ++i)
+	{
+		int proxyId = m_moveBuffer[i];
+		if (proxyId != e_nullProxy && IsProxy(proxyId) == false)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool cb2BroadPhase::IsProxy(int proxyId) const
+{
+	if (proxyId < 0)
+	{
+		return false;
+	}
+
+	if (IsStaticProxy(proxyId))
+	{
+		return m_staticTree.IsProxy(GetNodeId(proxyId));
+	}
+
+	return m_gridEnabled ? m_grid.IsProxy(GetNodeId(proxyId)) : m_tree.IsProxy(GetNodeId(proxyId));
+}
@@ -20,10 +20,16 @@
 #define CB2_BROAD_PHASE_H
 
 #include <CinderBox2D/Common/cb2Settings.h>
+#include <CinderBox2D/Common/cb2Trace.h>
 #include <CinderBox2D/Collision/cb2Collision.h>
 #include <CinderBox2D/Collision/cb2DynamicTree.h>
+#include <CinderBox2D/Collision/cb2UniformGrid.h>
+#include <CinderBox2D/Collision/cb2WideTree.h>
 #include <algorithm>
 
+class cb2TaskScheduler;
+class cb2Snapshot;
+
 struct cb2Pair
 {
 	int proxyIdA;
@@ -31,9 +37,68 @@ struct cb2Pair
 	int next;
 };
 
+/// The pairs found by one thread of a parallel UpdatePairs.
+struct cb2PairBuffer
+{
+	bool QueryCallback(int nodeId);
+
+	cb2AllocatorInterface* allocator;
+	cb2Pair* pairs;
+	int count;
+	int capacity;
+	int queryProxyId;
+	int queryTree;
+};
+
+/// Turns the node ids of one tree of the broad-phase into proxy ids for a
+/// query, ray-cast or shape cast callback, and remembers how the callback
+/// clipped or ended the traversal so the other tree can carry on from there.
+template <typename T>
+struct cb2ProxyCallback
+{
+	bool QueryCallback(int nodeId)
+	{
+		proceed = callback->QueryCallback(2 * nodeId + tree);
+		return proceed;
+	}
+
+	float RayCastCallback(const cb2RayCastInput& input, int nodeId)
+	{
+		float value = callback->RayCastCallback(input, 2 * nodeId + tree);
+		if (value == 0.0f)
+		{
+			proceed = false;
+		}
+		else if (value > 0.0f)
+		{
+			maxFraction = value;
+		}
+		return value;
+	}
+
+	float ShapeCastCallback(float fraction, int nodeId)
+	{
+		float value = callback->ShapeCastCallback(fraction, 2 * nodeId + tree);
+		if (value == 0.0f)
+		{
+			proceed = false;
+		}
+		return value;
+	}
+
+	T* callback;
+	int tree;
+	bool proceed;
+	float maxFraction;
+};
+
 /// The broad-phase is used for computing pairs and performing volume queries and ray casts.
 /// This broad-phase does not persist pairs. Instead, this reports potentially new pairs.
 /// It is up to the client to consume the new pairs and to track subsequent overlap.
+/// Static proxies live in a tree of their own. Moving proxies are paired against
+/// both trees, static proxies only against the moving tree, so static geometry is
+/// never reshaped by moving bodies and never paired with itself. The moving proxies
+/// can go into a uniform grid instead of their tree, see SetGridCellSize.
 class cb2BroadPhase
 {
 public:
@@ -43,20 +108,40 @@ public:
 		e_nullProxy = -1
 	};
 
-	cb2BroadPhase();
+	/// @param allocator where the tree and pair buffers live, NULL for cb2Alloc.
+	cb2BroadPhase(cb2AllocatorInterface* allocator = NULL);
 	~cb2BroadPhase();
 
 	/// Create a proxy with an initial AABB. Pairs are not reported until
 	/// UpdatePairs is called.
-	int CreateProxy(const cb2AABB& aabb, void* userData);
+	/// @param isStatic put the proxy in the static tree. Static proxies may still
+	/// move but they never pair with each other. A shared static tree takes no
+	/// proxies, they go to the moving proxies then.
+	int CreateProxy(const cb2AABB& aabb, void* userData, bool isStatic = false);
+
+	/// Create many proxies at once.
+	/// @see cb2DynamicTree::CreateProxies
+	void CreateProxies(int count, const cb2AABB* aabbs, void** userData, int* proxyIds, bool isStatic = false);
+
+	/// Is this proxy in the static tree?
+	static bool IsStaticProxy(int proxyId) { return (proxyId & 1) == 1; }
 
 	/// Destroy a proxy. It is up to the client to remove any pairs.
 	void DestroyProxy(int proxyId);
 
+	/// Destroy many proxies at once. Unlike DestroyProxy this scans the move buffer
+	/// only once, and big batches are removed from the trees in bulk, see
+	/// cb2DynamicTree::DestroyProxies. The proxy ids are sorted in place.
+	void DestroyProxies(int* proxyIds, int count);
+
 	/// Call MoveProxy as many times as you like, then when you are done
 	/// call UpdatePairs to finalized the proxy pairs (for your time step).
 	void MoveProxy(int proxyId, const cb2AABB& aabb, const ci::Vec2f& displacement);
 
+	/// Move many proxies at once without a displacement, as when their bodies are
+	/// teleported. Each tree takes its batch at once, see cb2DynamicTree::MoveProxies.
+	void MoveProxies(const int* proxyIds, const cb2AABB* aabbs, int count);
+
 	/// Call to trigger a re-processing of it's pairs on the next call to UpdatePairs.
 	void TouchProxy(int proxyId);
 
@@ -72,14 +157,72 @@ public:
 	/// Get the number of proxies.
 	int GetProxyCount() const;
 
+	/// Grow the pools for this many moving and static proxies, so creating them does
+	/// not have to copy the trees or the move buffer. The moving proxies are reserved
+	/// in the grid if it is enabled, so call this after SetGridCellSize.
+	void Reserve(int movingCount, int staticCount);
+
+	/// Grow the pair buffers for this many pairs found by one UpdatePairs, the buffer
+	/// of each task scheduler thread included.
+	void ReservePairs(int pairCount);
+
+	/// Get how often a proxy moved out of its fat AABB.
+	int GetProxyReinsertCount(int proxyId) const;
+
+	/// Get how often any proxy moved out of its fat AABB.
+	int GetReinsertCount() const { return m_reinsertCount; }
+
+	/// Set the collision filter of a proxy, see cb2DynamicTree::SetProxyFilter. With
+	/// category pruning UpdatePairs only reports the pairs where the category bits of
+	/// each proxy match the mask bits of the proxy that found it.
+	void SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits);
+
+	/// Turn category pruning of the pairs on or off, it is on by default.
+	void SetCategoryPruning(bool flag) { m_categoryPruning = flag; }
+	bool GetCategoryPruning() const { return m_categoryPruning; }
+
 	/// Update the pairs. This results in pair callbacks. This can only add pairs.
 	template <typename T>
 	void UpdatePairs(T* callback);
 
+	/// Run the tree queries of UpdatePairs on a task scheduler. The pairs are
+	/// still reported on the calling thread and in the same order. Pass NULL to
+	/// query on the calling thread only.
+	void SetTaskScheduler(cb2TaskScheduler* scheduler);
+
+	/// Keep four wide copies of the trees for Query and RayCast, see cb2WideTree.
+	/// A copy is only used while it matches its tree, UpdateQueryTree refreshes them.
+	void SetQueryTreeEnabled(bool flag);
+	bool GetQueryTreeEnabled() const { return m_queryTreeEnabled; }
+
+	/// Rebuild the wide query trees if they are enabled and the trees changed since.
+	void UpdateQueryTree();
+
+	/// Keep the moving proxies in a cb2UniformGrid rather than a tree. This pays off
+	/// for many moving proxies of about the same size, with cells about twice as
+	/// big as they are. Static proxies stay in their tree. Only allowed while there
+	/// are no moving proxies.
+	/// @param cellSize the cell size, 0 to go back to the tree.
+	void SetGridCellSize(float cellSize);
+
+	/// Get the cell size of the grid, 0 if the moving proxies are in a tree.
+	float GetGridCellSize() const { return m_gridEnabled ? m_grid.GetCellSize() : 0.0f; }
+
+	/// Rebuild a small part of the moving tree to keep it from degrading. The static
+	/// tree gets a full rebuild instead, once half of it was inserted one by one.
+	/// @see cb2DynamicTree::Rebalance
+	void RebalanceTree(int leafBudget);
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
+	/// @param maskBits skip the proxies that have none of these category bits.
 	template <typename T>
-	void Query(T* callback, const cb2AABB& aabb) const;
+	void Query(T* callback, const cb2AABB& aabb, unsigned short maskBits = 0xFFFF) const;
+
+	/// Query an AABB for the proxies that are not static and whose category bits
+	/// overlap maskBits. Whole subtrees of other categories are skipped.
+	template <typename T>
+	void QueryMovingProxies(T* callback, const cb2AABB& aabb, unsigned short maskBits) const;
 
 	/// Ray-cast against the proxies in the tree. This relies on the callback
 	/// to perform a exact ray-cast in the case were the proxy contains a shape.
@@ -88,16 +231,22 @@ public:
 	/// number of proxies in the tree.
 	/// @param input the ray-cast input data. The ray extends from p1 to p1 + maxFraction * (p2 - p1).
 	/// @param callback a callback class that is called for each proxy that is hit by the ray.
+	/// @param maskBits skip the proxies that have none of these category bits.
 	template <typename T>
-	void RayCast(T* callback, const cb2RayCastInput& input) const;
+	void RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits = 0xFFFF) const;
 
-	/// Get the height of the embedded tree.
+	/// Sweep an AABB against the proxies in the tree.
+	/// @see cb2DynamicTree::ShapeCast
+	template <typename T>
+	void ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const;
+
+	/// Get the height of the taller embedded tree.
 	int GetTreeHeight() const;
 
-	/// Get the balance of the embedded tree.
+	/// Get the balance of the embedded trees.
 	int GetTreeBalance() const;
 
-	/// Get the quality metric of the embedded tree.
+	/// Get the quality metric of the worse embedded tree.
 	float GetTreeQuality() const;
 
 	/// Shift the world origin. Useful for large worlds.
@@ -105,18 +254,90 @@ public:
 	/// @param newOrigin the new origin with respect to the old origin
 	void ShiftOrigin(const ci::Vec2f& newOrigin);
 
+	/// Save the trees or grid and the move buffer, without the user data.
+	/// @param keepShared leave out a shared static tree, see ShareStaticTree.
+	void Save(cb2Snapshot* snapshot, bool keepShared = false) const;
+
+	/// Replace all proxies by saved ones with the same ids, see cb2DynamicTree::Load.
+	/// The wide query trees are rebuilt when they are next updated. Returns false
+	/// for a bad snapshot, the broad-phase may then hold part of it.
+	/// @param keepShared as passed to Save, a shared static tree is then kept.
+	bool Load(cb2Snapshot* snapshot, bool keepShared = false);
+
+	/// Set the user data of a loaded proxy.
+	void SetUserData(int proxyId, void* userData);
+
+	/// Get the number of proxies in the static tree.
+	int GetStaticProxyCount() const { return m_staticProxyCount; }
+
+	/// Save the static tree alone, see cb2World::SaveLevel.
+	void SaveStaticTree(cb2Snapshot* snapshot) const;
+
+	/// Replace the static tree by a saved one that holds proxyCount proxies, without
+	/// inserting them one by one. The proxies of the static tree before are dropped
+	/// without being destroyed, so it is normally empty. The proxies have no user data
+	/// and the moving proxies do not know about them until they are touched.
+	bool LoadStaticTree(cb2Snapshot* snapshot, int proxyCount);
+
+	/// Use the static tree of another broad-phase instead of one of its own, like
+	/// LoadStaticTree does with a saved one, see cb2DynamicTree::Share. The other
+	/// broad-phase must outlive this one and keep its static tree unchanged. The
+	/// shared proxies cannot be changed, and static proxies created from now on go
+	/// to the moving proxies.
+	void ShareStaticTree(const cb2BroadPhase* broadPhase);
+
+	/// Is the static tree shared with another broad-phase?
+	bool IsStaticTreeShared() const { return m_staticTree.IsShared(); }
+
+	/// Is the id one of a proxy? Ids from a snapshot are checked with this.
+	bool IsProxy(int proxyId) const;
+
 private:
 
 	friend class cb2DynamicTree;
+	friend class cb2UniformGrid;
+
+	// Proxy ids are the ids in the tree or grid with the static tree in the low bit.
+	static int GetNodeId(int proxyId) { return proxyId >> 1; }
+
+	// Query the tree or grid of the moving proxies.
+	template <typename T>
+	void QueryMoving(T* callback, const cb2AABB& aabb, unsigned short maskBits) const;
+
+	// The mask the pairs of a proxy are pruned with.
+	unsigned short GetPairMaskBits(int proxyId) const;
 
 	void BufferMove(int proxyId);
 	void UnBufferMove(int proxyId);
+	void RemoveProxy(int proxyId);
+
+	bool QueryCallback(int nodeId);
+
+	// Fill the pair buffer with the sorted pairs of the moved proxies.
+	void FindPairs();
+	void SortPairs();
+	static void FindPairsTask(void* context, int begin, int end, int threadIndex);
 
-	bool QueryCallback(int proxyId);
+	cb2AllocatorInterface* m_allocator;
 
 	cb2DynamicTree m_tree;
+	cb2DynamicTree m_staticTree;
+
+	cb2UniformGrid m_grid;
+	bool m_gridEnabled;
+
+	// Static proxies created one by one since the static tree was last rebuilt.
+	int m_staticInsertCount;
+	int m_staticProxyCount;
+
+	cb2WideTree m_queryTree;
+	cb2WideTree m_staticQueryTree;
+	bool m_queryTreeEnabled;
 
 	int m_proxyCount;
+	int m_reinsertCount;
+
+	bool m_categoryPruning;
 
 	int* m_moveBuffer;
 	int m_moveCapacity;
@@ -126,7 +347,16 @@ private:
 	int m_pairCapacity;
 	int m_pairCount;
 
+	// Scratch for the radix sort of the pair buffer.
+	cb2Pair* m_sortBuffer;
+	int m_sortCapacity;
+
 	int m_queryProxyId;
+	int m_queryTreeIndex;
+
+	cb2TaskScheduler* m_taskScheduler;
+	cb2PairBuffer* m_threadPairs;
+	int m_threadPairCount;
 };
 
 /// This is used to sort pairs.
@@ -145,21 +375,72 @@ inline bool cb2PairLessThan(const cb2Pair& pair1, const cb2Pair& pair2)
 	return false;
 }
 
+inline void cb2BroadPhase::SetUserData(int proxyId, void* userData)
+{
+	if (IsStaticProxy(proxyId))
+	{
+		m_staticTree.SetUserData(GetNodeId(proxyId), userData);
+	}
+	else if (m_gridEnabled)
+	{
+		m_grid.SetUserData(GetNodeId(proxyId), userData);
+	}
+	else
+	{
+		m_tree.SetUserData(GetNodeId(proxyId), userData);
+	}
+}
+
 inline void* cb2BroadPhase::GetUserData(int proxyId) const
 {
-	return m_tree.GetUserData(proxyId);
+	if (IsStaticProxy(proxyId))
+	{
+		return m_staticTree.GetUserData(GetNodeId(proxyId));
+	}
+
+	if (m_gridEnabled)
+	{
+		return m_grid.GetUserData(GetNodeId(proxyId));
+	}
+
+	return m_tree.GetUserData(GetNodeId(proxyId));
 }
 
 inline bool cb2BroadPhase::TestOverlap(int proxyIdA, int proxyIdB) const
 {
-	const cb2AABB& aabbA = m_tree.GetFatAABB(proxyIdA);
-	const cb2AABB& aabbB = m_tree.GetFatAABB(proxyIdB);
+	const cb2AABB& aabbA = GetFatAABB(proxyIdA);
+	const cb2AABB& aabbB = GetFatAABB(proxyIdB);
 	return cb2TestOverlap(aabbA, aabbB);
 }
 
 inline const cb2AABB& cb2BroadPhase::GetFatAABB(int proxyId) const
 {
-	return m_tree.GetFatAABB(proxyId);
+	if (IsStaticProxy(proxyId))
+	{
+		return m_staticTree.GetFatAABB(GetNodeId(proxyId));
+	}
+
+	if (m_gridEnabled)
+	{
+		return m_grid.GetFatAABB(GetNodeId(proxyId));
+	}
+
+	return m_tree.GetFatAABB(GetNodeId(proxyId));
+}
+
+inline int cb2BroadPhase::GetProxyReinsertCount(int proxyId) const
+{
+	if (IsStaticProxy(proxyId))
+	{
+		return m_staticTree.GetReinsertCount(GetNodeId(proxyId));
+	}
+
+	if (m_gridEnabled)
+	{
+		return m_grid.GetReinsertCount(GetNodeId(proxyId));
+	}
+
+	return m_tree.GetReinsertCount(GetNodeId(proxyId));
 }
 
 inline int cb2BroadPhase::GetProxyCount() const
@@ -169,55 +450,39 @@ inline int cb2BroadPhase::GetProxyCount() const
 
 inline int cb2BroadPhase::GetTreeHeight() const
 {
-	return m_tree.GetHeight();
+	return cb2Max(m_tree.GetHeight(), m_staticTree.GetHeight());
 }
 
 inline int cb2BroadPhase::GetTreeBalance() const
 {
-	return m_tree.GetMaxBalance();
+	return cb2Max(m_tree.GetMaxBalance(), m_staticTree.GetMaxBalance());
 }
 
 inline float cb2BroadPhase::GetTreeQuality() const
 {
-	return m_tree.GetAreaRatio();
+	return cb2Max(m_tree.GetAreaRatio(), m_staticTree.GetAreaRatio());
+}
+
+inline void cb2BroadPhase::RebalanceTree(int leafBudget)
+{
+	m_tree.Rebalance(leafBudget);
 }
 
 template <typename T>
 void cb2BroadPhase::UpdatePairs(T* callback)
 {
-	// Reset pair buffer
-	m_pairCount = 0;
-
-	// Perform tree queries for all moving proxies.
-	for (int i = 0; i < m_moveCount; ++i)
-	{
-		m_queryProxyId = m_moveBuffer[i];
-		if (m_queryProxyId == e_nullProxy)
-		{
-			continue;
-		}
-
-		// We have to query the tree with the fat AABB so that
-		// we don't fail to create a pair that may touch later.
-		const cb2AABB& fatAABB = m_tree.GetFatAABB(m_queryProxyId);
-
-		// Query tree, create pairs and add them pair buffer.
-		m_tree.Query(this, fatAABB);
-	}
+	CB2_TRACE_ZONE_COUNT("UpdatePairs", m_moveCount);
 
-	// Reset move buffer
-	m_moveCount = 0;
-
-	// Sort the pair buffer to expose duplicates.
-	std::sort(m_pairBuffer, m_pairBuffer + m_pairCount, cb2PairLessThan);
+	FindPairs();
 
 	// Send the pairs back to the client.
+	CB2_TRACE_ZONE_COUNT("AddPairs", m_pairCount);
 	int i = 0;
 	while (i < m_pairCount)
 	{
 		cb2Pair* primaryPair = m_pairBuffer + i;
-		void* userDataA = m_tree.GetUserData(primaryPair->proxyIdA);
-		void* userDataB = m_tree.GetUserData(primaryPair->proxyIdB);
+		void* userDataA = GetUserData(primaryPair->proxyIdA);
+		void* userDataB = GetUserData(primaryPair->proxyIdB);
 
 		callback->AddPair(userDataA, userDataB);
 		++i;
@@ -239,20 +504,158 @@ void cb2BroadPhase::UpdatePairs(T* callback)
 }
 
 template <typename T>
-inline void cb2BroadPhase::Query(T* callback, const cb2AABB& aabb) const
+inline void cb2BroadPhase::QueryMoving(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
+{
+	if (m_gridEnabled)
+	{
+		m_grid.Query(callback, aabb, maskBits);
+	}
+	else
+	{
+		m_tree.Query(callback, aabb, maskBits);
+	}
+}
+
+inline unsigned short cb2BroadPhase::GetPairMaskBits(int proxyId) const
+{
+	if (m_categoryPruning == false)
+	{
+		return 0xFFFF;
+	}
+
+	if (IsStaticProxy(proxyId))
+	{
+		return m_staticTree.GetMaskBits(GetNodeId(proxyId));
+	}
+
+	if (m_gridEnabled)
+	{
+		return m_grid.GetMaskBits(GetNodeId(proxyId));
+	}
+
+	return m_tree.GetMaskBits(GetNodeId(proxyId));
+}
+
+template <typename T>
+inline void cb2BroadPhase::Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
+{
+	cb2ProxyCallback<T> proxyCallback;
+	proxyCallback.callback = callback;
+	proxyCallback.proceed = true;
+
+	proxyCallback.tree = 0;
+	if (m_gridEnabled)
+	{
+		m_grid.Query(&proxyCallback, aabb, maskBits);
+	}
+	else if (m_queryTreeEnabled && m_queryTree.IsCurrent(m_tree))
+	{
+		m_queryTree.Query(&proxyCallback, aabb, maskBits);
+	}
+	else
+	{
+		m_tree.Query(&proxyCallback, aabb, maskBits);
+	}
+
+	if (proxyCallback.proceed == false)
+	{
+		return;
+	}
+
+	proxyCallback.tree = 1;
+	if (m_queryTreeEnabled && m_staticQueryTree.IsCurrent(m_staticTree))
+	{
+		m_staticQueryTree.Query(&proxyCallback, aabb, maskBits);
+	}
+	else
+	{
+		m_staticTree.Query(&proxyCallback, aabb, maskBits);
+	}
+}
+
+template <typename T>
+inline void cb2BroadPhase::QueryMovingProxies(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
 {
-	m_tree.Query(callback, aabb);
+	cb2ProxyCallback<T> proxyCallback;
+	proxyCallback.callback = callback;
+	proxyCallback.proceed = true;
+	proxyCallback.tree = 0;
+	QueryMoving(&proxyCallback, aabb, maskBits);
 }
 
 template <typename T>
-inline void cb2BroadPhase::RayCast(T* callback, const cb2RayCastInput& input) const
+inline void cb2BroadPhase::RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const
 {
-	m_tree.RayCast(callback, input);
+	cb2ProxyCallback<T> proxyCallback;
+	proxyCallback.callback = callback;
+	proxyCallback.proceed = true;
+	proxyCallback.maxFraction = input.maxFraction;
+
+	proxyCallback.tree = 0;
+	if (m_gridEnabled)
+	{
+		m_grid.RayCast(&proxyCallback, input, maskBits);
+	}
+	else if (m_queryTreeEnabled && m_queryTree.IsCurrent(m_tree))
+	{
+		m_queryTree.RayCast(&proxyCallback, input, maskBits);
+	}
+	else
+	{
+		m_tree.RayCast(&proxyCallback, input, maskBits);
+	}
+
+	if (proxyCallback.proceed == false)
+	{
+		return;
+	}
+
+	// Carry on with the ray clipped by the moving proxies.
+	cb2RayCastInput staticInput = input;
+	staticInput.maxFraction = proxyCallback.maxFraction;
+
+	proxyCallback.tree = 1;
+	if (m_queryTreeEnabled && m_staticQueryTree.IsCurrent(m_staticTree))
+	{
+		m_staticQueryTree.RayCast(&proxyCallback, staticInput, maskBits);
+	}
+	else
+	{
+		m_staticTree.RayCast(&proxyCallback, staticInput, maskBits);
+	}
+}
+
+template <typename T>
+inline void cb2BroadPhase::ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const
+{
+	cb2ProxyCallback<T> proxyCallback;
+	proxyCallback.callback = callback;
+	proxyCallback.proceed = true;
+
+	proxyCallback.tree = 0;
+	if (m_gridEnabled)
+	{
+		m_grid.ShapeCast(&proxyCallback, aabb, translation);
+	}
+	else
+	{
+		m_tree.ShapeCast(&proxyCallback, aabb, translation);
+	}
+
+	if (proxyCallback.proceed == false)
+	{
+		return;
+	}
+
+	proxyCallback.tree = 1;
+	m_staticTree.ShapeCast(&proxyCallback, aabb, translation);
 }
 
 inline void cb2BroadPhase::ShiftOrigin(const ci::Vec2f& newOrigin)
 {
 	m_tree.ShiftOrigin(newOrigin);
+	m_staticTree.ShiftOrigin(newOrigin);
+	m_grid.ShiftOrigin(newOrigin);
 }
 
 #endif
@@ -0,0 +1,388 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Collision/cb2Collision.h>
+#include <CinderBox2D/Collision/cb2Distance.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+
+// Closest points of the segments p1-q1 and p2-q2, from Real-Time Collision
+// Detection by Christer Ericson, section 5.1.9. Neither segment is degenerate.
+static float cb2SegmentDistanceSquared(ci::Vec2f* c1, ci::Vec2f* c2, float* f1, float* f2,
+									   const ci::Vec2f& p1, const ci::Vec2f& q1,
+									   const ci::Vec2f& p2, const ci::Vec2f& q2)
+{
+	ci::Vec2f d1 = q1 - p1;
+	ci::Vec2f d2 = q2 - p2;
+	ci::Vec2f r = p1 - p2;
+	float dd1 = cb2Dot(d1, d1);
+	float dd2 = cb2Dot(d2, d2);
+	float d12 = cb2Dot(d1, d2);
+	float rd1 = cb2Dot(r, d1);
+	float rd2 = cb2Dot(r, d2);
+
+	// Parallel segments have a range of closest points, any will do.
+	float denominator = dd1 * dd2 - d12 * d12;
+	float s = 0.0f;
+	if (denominator > cb2_epsilon * dd1 * dd2)
+	{
+		s = cb2Clamp((d12 * rd2 - rd1 * dd2) / denominator, 0.0f, 1.0f);
+	}
+
+	float t = (d12 * s + rd2) / dd2;
+	if (t < 0.0f)
+	{
+		t = 0.0f;
+		s = cb2Clamp(-rd1 / dd1, 0.0f, 1.0f);
+	}
+	else if (t > 1.0f)
+	{
+		t = 1.0f;
+		s = cb2Clamp((d12 - rd1) / dd1, 0.0f, 1.0f);
+	}
+
+	*f1 = s;
+	*f2 = t;
+	*c1 = p1 + s * d1;
+	*c2 = p2 + t * d2;
+	return cb2DistanceSquared(*c1, *c2);
+}
+
+// A capsule is a two sided polygon with the capsule radius, which lets the
+// polygon and edge colliders handle its sides.
+static void cb2MakeCapsulePolygon(cb2PolygonShape* polygon, const cb2CapsuleShape* capsule)
+{
+	ci::Vec2f normal = cb2Cross(capsule->m_vertex2 - capsule->m_vertex1, 1.0f);
+	normal.normalize();
+
+	polygon->m_count = 2;
+	polygon->m_vertices[0] = capsule->m_vertex1;
+	polygon->m_vertices[1] = capsule->m_vertex2;
+	polygon->m_normals[0] = normal;
+	polygon->m_normals[1] = -normal;
+	polygon->m_centroid = 0.5f * (capsule->m_vertex1 + capsule->m_vertex2);
+	polygon->m_radius = capsule->m_radius;
+	polygon->UpdateLanes();
+}
+
+// Single point manifold between the closest points of two cores, given in the
+// frames of A and B.
+static void cb2MakeCapsulePoint(cb2Manifold* manifold, const ci::Vec2f& localPointA, const ci::Vec2f& localPointB,
+								int indexA, int indexB)
+{
+	manifold->type = cb2Manifold::e_circles;
+	manifold->localPoint = localPointA;
+	cb2::setZero(manifold->localNormal);
+	manifold->pointCount = 1;
+
+	cb2ManifoldPoint* mp = manifold->points + 0;
+	mp->localPoint = localPointB;
+	mp->id.cf.indexA = (unsigned char)indexA;
+	mp->id.cf.indexB = (unsigned char)indexB;
+	mp->id.cf.typeA = cb2ContactFeature::e_vertex;
+	mp->id.cf.typeB = cb2ContactFeature::e_vertex;
+}
+
+void cb2CollideCapsuleAndCircle(
+	cb2Manifold* manifold,
+	const cb2CapsuleShape* capsuleA, const cb2Transform& xfA,
+	const cb2CircleShape* circleB, const cb2Transform& xfB)
+{
+	manifold->pointCount = 0;
+
+	// Compute the circle in the frame of the capsule.
+	ci::Vec2f c = cb2MulT(xfA, cb2Mul(xfB, circleB->m_p));
+
+	ci::Vec2f v1 = capsuleA->m_vertex1;
+	ci::Vec2f v2 = capsuleA->m_vertex2;
+	ci::Vec2f e = v2 - v1;
+	float t = cb2Dot(c - v1, e) / cb2Dot(e, e);
+
+	ci::Vec2f p;
+	if (t <= 0.0f)
+	{
+		p = v1;
+	}
+	else if (t >= 1.0f)
+	{
+		p = v2;
+	}
+	else
+	{
+		p = v1 + t * e;
+	}
+
+	ci::Vec2f d = c - p;
+	float radius = capsuleA->m_radius + circleB->m_radius;
+	if (cb2Dot(d, d) > radius * radius)
+	{
+		return;
+	}
+
+	manifold->pointCount = 1;
+	manifold->points[0].localPoint = circleB->m_p;
+	manifold->points[0].id.key = 0;
+
+	if (0.0f < t && t < 1.0f)
+	{
+		// The circle touches a side, which keeps the normal fixed while it rolls.
+		ci::Vec2f normal = cb2Cross(e, 1.0f);
+		normal.normalize();
+		if (cb2Dot(d, normal) < 0.0f)
+		{
+			normal = -normal;
+		}
+
+		manifold->type = cb2Manifold::e_faceA;
+		manifold->localNormal = normal;
+		manifold->localPoint = p;
+	}
+	else
+	{
+		manifold->type = cb2Manifold::e_circles;
+		cb2::setZero(manifold->localNormal);
+		manifold->localPoint = p;
+	}
+}
+
+// The side of one capsule that the other rests on is the reference face. The
+// other core is clipped to the length of the reference face, which gives two
+// points for a capsule lying on another. Caps touching each other get the
+// single point between the closest points of the cores.
+void cb2CollideCapsules(
+	cb2Manifold* manifold,
+	const cb2CapsuleShape* capsuleA, const cb2Transform& xfA,
+	const cb2CapsuleShape* capsuleB, const cb2Transform& xfB)
+{
+	manifold->pointCount = 0;
+
+	// Work in the frame of A.
+	cb2Transform xf = cb2MulT(xfA, xfB);
+	ci::Vec2f p1 = capsuleA->m_vertex1;
+	ci::Vec2f q1 = capsuleA->m_vertex2;
+	ci::Vec2f p2 = cb2Mul(xf, capsuleB->m_vertex1);
+	ci::Vec2f q2 = cb2Mul(xf, capsuleB->m_vertex2);
+
+	ci::Vec2f c1, c2;
+	float f1, f2;
+	float distanceSquared = cb2SegmentDistanceSquared(&c1, &c2, &f1, &f2, p1, q1, p2, q2);
+
+	float radius = capsuleA->m_radius + capsuleB->m_radius;
+	if (distanceSquared > radius * radius)
+	{
+		return;
+	}
+
+	bool interior1 = 0.0f < f1 && f1 < 1.0f;
+	bool interior2 = 0.0f < f2 && f2 < 1.0f;
+	if (interior1 || interior2)
+	{
+		// A side is touched. The reference face is the side most perpendicular
+		// to the closest points, with a tolerance in favor of A so that parallel
+		// capsules keep their feature ids.
+		ci::Vec2f u1 = q1 - p1;
+		ci::Vec2f u2 = q2 - p2;
+		u1.normalize();
+		u2.normalize();
+		ci::Vec2f d12 = c2 - c1;
+		bool flip = cb2Abs(cb2Cross(u2, d12)) > cb2Abs(cb2Cross(u1, d12)) + 0.1f * cb2_linearSlop;
+		ci::Vec2f r1 = flip ? p2 : p1;
+		ci::Vec2f r2 = flip ? q2 : q1;
+		ci::Vec2f i1 = flip ? p1 : p2;
+		ci::Vec2f i2 = flip ? q1 : q2;
+		ci::Vec2f cr = flip ? c2 : c1;
+		ci::Vec2f cj = flip ? c1 : c2;
+
+		ci::Vec2f tangent = r2 - r1;
+		float length = tangent.length();
+		tangent *= 1.0f / length;
+
+		// The normal points from the reference core to the incident core. Crossing
+		// cores have no closest point direction, use their centers.
+		ci::Vec2f normal(-tangent.y, tangent.x);
+		ci::Vec2f d = cj - cr;
+		if (cb2Dot(d, d) < cb2_epsilon * cb2_epsilon)
+		{
+			d = (i1 + i2) - (r1 + r2);
+		}
+		if (cb2Dot(d, normal) < 0.0f)
+		{
+			normal = -normal;
+		}
+
+		float s1 = cb2Dot(i1 - r1, tangent);
+		float s2 = cb2Dot(i2 - r1, tangent);
+		ci::Vec2f vLower = i1, vUpper = i2;
+		int idLower = 0, idUpper = 1;
+		if (s1 > s2)
+		{
+			cb2Swap(s1, s2);
+			cb2Swap(vLower, vUpper);
+			cb2Swap(idLower, idUpper);
+		}
+
+		// An incident core across the reference face clips to a single point.
+		if (s2 - s1 > cb2_linearSlop && s1 < length && s2 > 0.0f)
+		{
+			ci::Vec2f delta = (vUpper - vLower) * (1.0f / (s2 - s1));
+			if (s1 < 0.0f)
+			{
+				vLower = vLower - s1 * delta;
+			}
+			if (s2 > length)
+			{
+				vUpper = vUpper - (s2 - length) * delta;
+			}
+
+			ci::Vec2f clipPoints[2] = { vLower, vUpper };
+			int ids[2] = { idLower, idUpper };
+			int pointCount = 0;
+			for (int i = 0; i < 2; ++i)
+			{
+				float separation = cb2Dot(clipPoints[i] - r1, normal);
+				if (separation <= radius)
+				{
+					cb2ManifoldPoint* mp = manifold->points + pointCount;
+					mp->id.cf.indexA = 0;
+					mp->id.cf.indexB = (unsigned char)ids[i];
+					mp->id.cf.typeA = cb2ContactFeature::e_face;
+					mp->id.cf.typeB = cb2ContactFeature::e_vertex;
+					if (flip)
+					{
+						mp->localPoint = clipPoints[i];
+						cb2Swap(mp->id.cf.indexA, mp->id.cf.indexB);
+						cb2Swap(mp->id.cf.typeA, mp->id.cf.typeB);
+					}
+					else
+					{
+						mp->localPoint = cb2MulT(xf, clipPoints[i]);
+					}
+					++pointCount;
+				}
+			}
+
+			if (pointCount > 0)
+			{
+				manifold->pointCount = pointCount;
+				if (flip)
+				{
+					manifold->type = cb2Manifold::e_faceB;
+					manifold->localNormal = cb2MulT(xf.q, normal);
+					manifold->localPoint = cb2MulT(xf, r1);
+				}
+				else
+				{
+					manifold->type = cb2Manifold::e_faceA;
+					manifold->localNormal = normal;
+					manifold->localPoint = r1;
+				}
+				return;
+			}
+		}
+	}
+
+	cb2MakeCapsulePoint(manifold, c1, cb2MulT(xf, c2), f1 < 0.5f ? 0 : 1, f2 < 0.5f ? 0 : 1);
+}
+
+// The distance between the cores tells whether a polygon vertex touches one of
+// the caps. Its normal is not the normal of any face, so it gets a single point
+// along the closest points. Everything else goes through cb2CollidePolygons.
+void cb2CollidePolygonAndCapsule(
+	cb2Manifold* manifold,
+	const cb2PolygonShape* polygonA, const cb2Transform& xfA,
+	const cb2CapsuleShape* capsuleB, const cb2Transform& xfB)
+{
+	manifold->pointCount = 0;
+
+	cb2DistanceInput input;
+	input.proxyA.set(polygonA, 0);
+	input.proxyB.set(capsuleB, 0);
+	input.transformA = xfA;
+	input.transformB = xfB;
+	input.useRadii = false;
+
+	cb2SimplexCache cache;
+	cache.count = 0;
+
+	cb2DistanceOutput output;
+	cb2Distance(&output, &cache, &input);
+
+	float radius = polygonA->m_radius + capsuleB->m_radius;
+	if (output.distance > radius)
+	{
+		return;
+	}
+
+	if (cache.count == 1 && output.distance > 0.1f * cb2_linearSlop)
+	{
+		cb2MakeCapsulePoint(manifold, cb2MulT(xfA, output.pointA), cb2MulT(xfB, output.pointB),
+							cache.indexA[0], cache.indexB[0]);
+		return;
+	}
+
+	cb2PolygonShape polygonB;
+	cb2MakeCapsulePolygon(&polygonB, capsuleB);
+	cb2CollidePolygons(manifold, polygonA, xfA, &polygonB, xfB);
+}
+
+// Same as cb2CollidePolygonAndCapsule. Only the free ends of the edge get the
+// single point, at connected ends the edge collider keeps the normal in the
+// range that avoids snagging on the neighbours.
+void cb2CollideEdgeAndCapsule(
+	cb2Manifold* manifold,
+	const cb2EdgeShape* edgeA, const cb2Transform& xfA,
+	const cb2CapsuleShape* capsuleB, const cb2Transform& xfB)
+{
+	manifold->pointCount = 0;
+
+	cb2DistanceInput input;
+	input.proxyA.set(edgeA, 0);
+	input.proxyB.set(capsuleB, 0);
+	input.transformA = xfA;
+	input.transformB = xfB;
+	input.useRadii = false;
+
+	cb2SimplexCache cache;
+	cache.count = 0;
+
+	cb2DistanceOutput output;
+	cb2Distance(&output, &cache, &input);
+
+	float radius = edgeA->m_radius + capsuleB->m_radius;
+	if (output.distance > radius)
+	{
+		return;
+	}
+
+	if (cache.count == 1 && output.distance > 0.1f * cb2_linearSlop)
+	{
+		bool connected = cache.indexA[0] == 0 ? edgeA->m_hasVertex0 : edgeA->m_hasVertex3;
+		if (connected == false)
+		{
+			cb2MakeCapsulePoint(manifold, cb2MulT(xfA, output.pointA), cb2MulT(xfB, output.pointB),
+								cache.indexA[0], cache.indexB[0]);
+			return;
+		}
+	}
+
+	cb2PolygonShape polygonB;
+	cb2MakeCapsulePolygon(&polygonB, capsuleB);
+	cb2CollideEdgeAndPolygon(manifold, edgeA, xfA, &polygonB, xfB);
+}
@@ -19,6 +19,7 @@
 #include <CinderBox2D/Collision/cb2Collision.h>
 #include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Common/cb2Simd.h>
 
 void cb2CollideCircles(
 	cb2Manifold* manifold,
@@ -48,6 +49,75 @@ void cb2CollideCircles(
 	manifold->points[0].id.key = 0;
 }
 
+void cb2CollideCircles(const cb2CollidePair* pairs, int count)
+{
+	int i = 0;
+	for (; i + cb2_simdWidth <= count; i += cb2_simdWidth)
+	{
+		const cb2CollidePair* p0 = pairs + i;
+		const cb2CollidePair* p1 = p0 + 1;
+		const cb2CollidePair* p2 = p0 + 2;
+		const cb2CollidePair* p3 = p0 + 3;
+		const cb2CircleShape* a0 = static_cast<const cb2CircleShape*>(p0->shapeA);
+		const cb2CircleShape* a1 = static_cast<const cb2CircleShape*>(p1->shapeA);
+		const cb2CircleShape* a2 = static_cast<const cb2CircleShape*>(p2->shapeA);
+		const cb2CircleShape* a3 = static_cast<const cb2CircleShape*>(p3->shapeA);
+		const cb2CircleShape* b0 = static_cast<const cb2CircleShape*>(p0->shapeB);
+		const cb2CircleShape* b1 = static_cast<const cb2CircleShape*>(p1->shapeB);
+		const cb2CircleShape* b2 = static_cast<const cb2CircleShape*>(p2->shapeB);
+		const cb2CircleShape* b3 = static_cast<const cb2CircleShape*>(p3->shapeB);
+
+		// The same operations as cb2Mul and cb2Dot in cb2CollideCircles, four pairs at a time.
+		cb2FloatW qc = cb2SetW(p0->xfA->q.c, p1->xfA->q.c, p2->xfA->q.c, p3->xfA->q.c);
+		cb2FloatW qs = cb2SetW(p0->xfA->q.s, p1->xfA->q.s, p2->xfA->q.s, p3->xfA->q.s);
+		cb2FloatW cx = cb2SetW(a0->m_p.x, a1->m_p.x, a2->m_p.x, a3->m_p.x);
+		cb2FloatW cy = cb2SetW(a0->m_p.y, a1->m_p.y, a2->m_p.y, a3->m_p.y);
+		cb2FloatW ax = cb2AddW(cb2SubW(cb2MulW(qc, cx), cb2MulW(qs, cy)), cb2SetW(p0->xfA->p.x, p1->xfA->p.x, p2->xfA->p.x, p3->xfA->p.x));
+		cb2FloatW ay = cb2AddW(cb2AddW(cb2MulW(qs, cx), cb2MulW(qc, cy)), cb2SetW(p0->xfA->p.y, p1->xfA->p.y, p2->xfA->p.y, p3->xfA->p.y));
+
+		qc = cb2SetW(p0->xfB->q.c, p1->xfB->q.c, p2->xfB->q.c, p3->xfB->q.c);
+		qs = cb2SetW(p0->xfB->q.s, p1->xfB->q.s, p2->xfB->q.s, p3->xfB->q.s);
+		cx = cb2SetW(b0->m_p.x, b1->m_p.x, b2->m_p.x, b3->m_p.x);
+		cy = cb2SetW(b0->m_p.y, b1->m_p.y, b2->m_p.y, b3->m_p.y);
+		cb2FloatW bx = cb2AddW(cb2SubW(cb2MulW(qc, cx), cb2MulW(qs, cy)), cb2SetW(p0->xfB->p.x, p1->xfB->p.x, p2->xfB->p.x, p3->xfB->p.x));
+		cb2FloatW by = cb2AddW(cb2AddW(cb2MulW(qs, cx), cb2MulW(qc, cy)), cb2SetW(p0->xfB->p.y, p1->xfB->p.y, p2->xfB->p.y, p3->xfB->p.y));
+
+		cb2FloatW dx = cb2SubW(bx, ax);
+		cb2FloatW dy = cb2SubW(by, ay);
+		cb2FloatW distSqr = cb2AddW(cb2MulW(dx, dx), cb2MulW(dy, dy));
+		cb2FloatW radius = cb2AddW(cb2SetW(a0->m_radius, a1->m_radius, a2->m_radius, a3->m_radius),
+								   cb2SetW(b0->m_radius, b1->m_radius, b2->m_radius, b3->m_radius));
+		int touching = cb2MaskBitsW(cb2GreaterEqualW(cb2MulW(radius, radius), distSqr));
+
+		for (int j = 0; j < cb2_simdWidth; ++j)
+		{
+			const cb2CollidePair* pair = p0 + j;
+			cb2Manifold* manifold = pair->manifold;
+			if ((touching & (1 << j)) == 0)
+			{
+				manifold->pointCount = 0;
+				continue;
+			}
+
+			manifold->type = cb2Manifold::e_circles;
+			manifold->localPoint = static_cast<const cb2CircleShape*>(pair->shapeA)->m_p;
+			cb2::setZero(manifold->localNormal);
+			manifold->pointCount = 1;
+
+			manifold->points[0].localPoint = static_cast<const cb2CircleShape*>(pair->shapeB)->m_p;
+			manifold->points[0].id.key = 0;
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		const cb2CollidePair* pair = pairs + i;
+		cb2CollideCircles(pair->manifold,
+						static_cast<const cb2CircleShape*>(pair->shapeA), *pair->xfA,
+						static_cast<const cb2CircleShape*>(pair->shapeB), *pair->xfB);
+	}
+}
+
 void cb2CollidePolygonAndCircle(
 	cb2Manifold* manifold,
 	const cb2PolygonShape* polygonA, const cb2Transform& xfA,
@@ -59,28 +129,43 @@ void cb2CollidePolygonAndCircle(
 	ci::Vec2f c = cb2Mul(xfB, circleB->m_p);
 	ci::Vec2f cLocal = cb2MulT(xfA, c);
 
-	// Find the min separating edge.
-	int normalIndex = 0;
-	float separation = -cb2_maxFloat;
+	// Find the min separating edge, a vector of edges at a time.
 	float radius = polygonA->m_radius + circleB->m_radius;
 	int vertexCount = polygonA->m_count;
 	const ci::Vec2f* vertices = polygonA->m_vertices;
 	const ci::Vec2f* normals = polygonA->m_normals;
 
-	for (int i = 0; i < vertexCount; ++i)
+	cb2FloatW cx = cb2SplatW(cLocal.x);
+	cb2FloatW cy = cb2SplatW(cLocal.y);
+	cb2FloatW values[cb2_maxPolygonLanes / cb2_simdWidth];
+	cb2FloatW best = cb2SplatW(-cb2_maxFloat);
+	int groupCount = (vertexCount + cb2_simdWidth - 1) / cb2_simdWidth;
+	for (int i = 0; i < groupCount; ++i)
 	{
-		float s = cb2Dot(normals[i], cLocal - vertices[i]);
+		int offset = cb2_simdWidth * i;
+		cb2FloatW dx = cb2SubW(cx, cb2LoadW(polygonA->m_vertexX + offset));
+		cb2FloatW dy = cb2SubW(cy, cb2LoadW(polygonA->m_vertexY + offset));
+		values[i] = cb2AddW(cb2MulW(cb2LoadW(polygonA->m_normalX + offset), dx), cb2MulW(cb2LoadW(polygonA->m_normalY + offset), dy));
+		best = cb2MaxW(best, values[i]);
+	}
 
-		if (s > radius)
-		{
-			// Early out.
-			return;
-		}
+	float separation = cb2MaxLaneW(best);
+	if (separation > radius)
+	{
+		// Early out.
+		return;
+	}
 
-		if (s > separation)
+	// The first edge of the largest separation, like a scalar scan.
+	int normalIndex = 0;
+	cb2FloatW m = cb2SplatW(separation);
+	for (int i = 0; i < groupCount; ++i)
+	{
+		int bits = cb2MaskBitsW(cb2GreaterEqualW(values[i], m));
+		if (bits)
 		{
-			separation = s;
-			normalIndex = i;
+			normalIndex = cb2_simdWidth * i + ((bits & 1) ? 0 : (bits & 2) ? 1 : (bits & 4) ? 2 : 3);
+			break;
 		}
 	}
 
@@ -152,3 +237,14 @@ void cb2CollidePolygonAndCircle(
 		manifold->points[0].id.key = 0;
 	}
 }
+
+void cb2CollidePolygonsAndCircles(const cb2CollidePair* pairs, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const cb2CollidePair* pair = pairs + i;
+		cb2CollidePolygonAndCircle(pair->manifold,
+								static_cast<const cb2PolygonShape*>(pair->shapeA), *pair->xfA,
+								static_cast<const cb2CircleShape*>(pair->shapeB), *pair->xfB);
+	}
+}
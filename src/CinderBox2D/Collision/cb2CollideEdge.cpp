@@ -432,7 +432,7 @@ void cb2EPCollider::Collide(cb2Manifold* manifold, const cb2EdgeShape* edgeA, co
 		m_polygonB.normals[i] = cb2Mul(m_xf.q, polygonB->m_normals[i]);
 	}
 	
-	m_radius = 2.0f * cb2_polygonRadius;
+	m_radius = polygonB->m_radius + edgeA->m_radius;
 	
 	manifold->pointCount = 0;
 	
@@ -19,48 +19,155 @@
 #include <CinderBox2D/Collision/cb2Collision.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
 
-// Find the max separation between poly1 and poly2 using edge normals from poly1.
-static float cb2FindMaxSeparation(int* edgeIndex,
-								 const cb2PolygonShape* poly1, const cb2Transform& xf1,
-								 const cb2PolygonShape* poly2, const cb2Transform& xf2)
+// Find the separation of poly2 from edge i of poly1, xf takes poly1 into the frame of poly2.
+static inline float cb2EdgeSeparation(int i, const cb2PolygonShape* poly1, const cb2Transform& xf,
+									  const cb2PolygonShape* poly2)
 {
-	int count1 = poly1->m_count;
 	int count2 = poly2->m_count;
-	const ci::Vec2f* n1s = poly1->m_normals;
-	const ci::Vec2f* v1s = poly1->m_vertices;
-	const ci::Vec2f* v2s = poly2->m_vertices;
-	cb2Transform xf = cb2MulT(xf2, xf1);
+
+	// Get poly1 normal in frame2.
+	ci::Vec2f n = cb2Mul(xf.q, poly1->m_normals[i]);
+	ci::Vec2f v1 = cb2Mul(xf, poly1->m_vertices[i]);
+
+	// Find deepest point for normal i, a vector of vertices at a time.
+	cb2FloatW nx = cb2SplatW(n.x);
+	cb2FloatW ny = cb2SplatW(n.y);
+	cb2FloatW v1x = cb2SplatW(v1.x);
+	cb2FloatW v1y = cb2SplatW(v1.y);
+	cb2FloatW si = cb2SplatW(cb2_maxFloat);
+	for (int j = 0; j < count2; j += cb2_simdWidth)
+	{
+		cb2FloatW dx = cb2SubW(cb2LoadW(poly2->m_vertexX + j), v1x);
+		cb2FloatW dy = cb2SubW(cb2LoadW(poly2->m_vertexY + j), v1y);
+		si = cb2MinW(si, cb2AddW(cb2MulW(nx, dx), cb2MulW(ny, dy)));
+	}
+
+	return cb2MinLaneW(si);
+}
+
+// cb2FindMaxSeparation for two boxes. Opposite edges of a box share their normal up
+// to the sign, so two axes give the separations of all four edges.
+static float cb2FindBoxSeparation(int* edgeIndex, float* secondSeparation,
+								 const cb2PolygonShape* poly1, const cb2Transform& xf,
+								 const cb2PolygonShape* poly2)
+{
+	// poly2 spans c2 +- h1 +- h2 with h1 and h2 half its edges.
+	const ci::Vec2f* vs2 = poly2->m_vertices;
+	ci::Vec2f d = 0.5f * (vs2[0] + vs2[2]) - xf.p;
+	ci::Vec2f e1 = vs2[1] - vs2[0];
+	ci::Vec2f e2 = vs2[2] - vs2[1];
+
+	float separations[4];
+	for (int i = 0; i < 2; ++i)
+	{
+		// The edge planes are n.v = offset in the frame of poly1.
+		const ci::Vec2f& localNormal = poly1->m_normals[i];
+		ci::Vec2f n = cb2Mul(xf.q, localNormal);
+		float center = cb2Dot(n, d);
+		float extent = 0.5f * (cb2Abs(cb2Dot(n, e1)) + cb2Abs(cb2Dot(n, e2)));
+		separations[i] = center - extent - cb2Dot(localNormal, poly1->m_vertices[i]);
+		separations[i + 2] = -center - extent - cb2Dot(poly1->m_normals[i + 2], poly1->m_vertices[i + 2]);
+	}
 
 	int bestIndex = 0;
 	float maxSeparation = -cb2_maxFloat;
-	for (int i = 0; i < count1; ++i)
+	float secondMax = -cb2_maxFloat;
+	for (int i = 0; i < 4; ++i)
 	{
-		// Get poly1 normal in frame2.
-		ci::Vec2f n = cb2Mul(xf.q, n1s[i]);
-		ci::Vec2f v1 = cb2Mul(xf, v1s[i]);
-
-		// Find deepest point for normal i.
-		float si = cb2_maxFloat;
-		for (int j = 0; j < count2; ++j)
+		float si = separations[i];
+		if (si > maxSeparation)
 		{
-			float sij = cb2Dot(n, v2s[j] - v1);
-			if (sij < si)
-	{
-				si = sij;
+			secondMax = maxSeparation;
+			maxSeparation = si;
+			bestIndex = i;
+		}
+		else if (si > secondMax)
+		{
+			secondMax = si;
+		}
 	}
+
+	*edgeIndex = bestIndex;
+	*secondSeparation = secondMax;
+	return maxSeparation;
+}
+
+// Find the max separation between poly1 and poly2 using edge normals from poly1.
+// The separation of the runner-up edge goes to secondSeparation.
+static float cb2FindMaxSeparation(int* edgeIndex, float* secondSeparation,
+								 const cb2PolygonShape* poly1, const cb2Transform& xf,
+								 const cb2PolygonShape* poly2)
+{
+	if (poly1->m_box && poly2->m_box)
+	{
+		return cb2FindBoxSeparation(edgeIndex, secondSeparation, poly1, xf, poly2);
 	}
 
+	int count1 = poly1->m_count;
+
+	int bestIndex = 0;
+	float maxSeparation = -cb2_maxFloat;
+	float secondMax = -cb2_maxFloat;
+	for (int i = 0; i < count1; ++i)
+	{
+		float si = cb2EdgeSeparation(i, poly1, xf, poly2);
+
 		if (si > maxSeparation)
 		{
+			secondMax = maxSeparation;
 			maxSeparation = si;
 			bestIndex = i;
 		}
+		else if (si > secondMax)
+		{
+			secondMax = si;
+		}
 	}
 
 	*edgeIndex = bestIndex;
+	*secondSeparation = secondMax;
 	return maxSeparation;
 }
 
+// Find the max separation like cb2FindMaxSeparation, but keep to the edge of the last
+// search while poly2 cannot have moved far enough relative to poly1 to change it.
+// xf21 takes poly2 into the frame of poly1.
+static float cb2FindMaxSeparation(int* edgeIndex, cb2SeparationCache* cache,
+								 const cb2PolygonShape* poly1, const cb2Transform& xf,
+								 const cb2PolygonShape* poly2, const cb2Transform& xf21)
+{
+	if (cache->gap > 0.0f)
+	{
+		// The separation of each edge is a distance to the vertices of poly2. In the
+		// frame of poly1 these moved by at most this much since the search. The 1-norms
+		// bound the lengths from above.
+		float radius2 = 0.0f;
+		for (int i = 0; i < poly2->m_count; ++i)
+		{
+			const ci::Vec2f& v = poly2->m_vertices[i];
+			radius2 = cb2Max(radius2, cb2Abs(v.x) + cb2Abs(v.y));
+		}
+
+		ci::Vec2f dp = xf21.p - cache->xf.p;
+		float dq = cb2Abs(xf21.q.s - cache->xf.q.s) + cb2Abs(xf21.q.c - cache->xf.q.c);
+		float drift = cb2Abs(dp.x) + cb2Abs(dp.y) + dq * radius2;
+
+		// The best edge moved down and the runner-up moved up by at most the drift.
+		if (2.0f * drift + 0.1f * cb2_linearSlop < cache->gap)
+		{
+			*edgeIndex = cache->edge;
+			return cb2EdgeSeparation(cache->edge, poly1, xf, poly2);
+		}
+	}
+
+	float secondSeparation;
+	float separation = cb2FindMaxSeparation(edgeIndex, &secondSeparation, poly1, xf, poly2);
+	cache->xf = xf21;
+	cache->gap = separation - secondSeparation;
+	cache->edge = *edgeIndex;
+	return separation;
+}
+
 static void cb2FindIncidentEdge(cb2ClipVertex c[2],
 							 const cb2PolygonShape* poly1, const cb2Transform& xf1, int edge1,
 							 const cb2PolygonShape* poly2, const cb2Transform& xf2)
@@ -69,25 +176,14 @@ static void cb2FindIncidentEdge(cb2ClipVertex c[2],
 
 	int count2 = poly2->m_count;
 	const ci::Vec2f* vertices2 = poly2->m_vertices;
-	const ci::Vec2f* normals2 = poly2->m_normals;
 
 	cb2Assert(0 <= edge1 && edge1 < poly1->m_count);
 
 	// Get the normal of the reference edge in poly2's frame.
 	ci::Vec2f normal1 = cb2MulT(xf2.q, cb2Mul(xf1.q, normals1[edge1]));
 
-	// Find the incident edge on poly2.
-	int index = 0;
-	float minDot = cb2_maxFloat;
-	for (int i = 0; i < count2; ++i)
-	{
-		float dot = cb2Dot(normal1, normals2[i]);
-		if (dot < minDot)
-		{
-			minDot = dot;
-			index = i;
-		}
-	}
+	// Find the incident edge on poly2, the normal most against normal1.
+	int index = cb2SupportW(poly2->m_normalX, poly2->m_normalY, count2, -normal1.x, -normal1.y);
 
 	// Build the clip vertices for the incident edge.
 	int i1 = index;
@@ -116,17 +212,48 @@ static void cb2FindIncidentEdge(cb2ClipVertex c[2],
 void cb2CollidePolygons(cb2Manifold* manifold,
 					  const cb2PolygonShape* polyA, const cb2Transform& xfA,
 					  const cb2PolygonShape* polyB, const cb2Transform& xfB)
+{
+	cb2CollidePolygons(manifold, polyA, xfA, polyB, xfB, NULL);
+}
+
+void cb2CollidePolygons(cb2Manifold* manifold,
+					  const cb2PolygonShape* polyA, const cb2Transform& xfA,
+					  const cb2PolygonShape* polyB, const cb2Transform& xfB,
+					  cb2SeparationCache cache[2])
 {
 	manifold->pointCount = 0;
 	float totalRadius = polyA->m_radius + polyB->m_radius;
+	float secondSeparation;
+
+	// The polygons in the frame of each other.
+	cb2Transform xfAB = cb2MulT(xfB, xfA);
+	cb2Transform xfBA = cb2MulT(xfA, xfB);
 
 	int edgeA = 0;
-	float separationA = cb2FindMaxSeparation(&edgeA, polyA, xfA, polyB, xfB);
+	float separationA;
+	if (cache)
+	{
+		separationA = cb2FindMaxSeparation(&edgeA, cache + 0, polyA, xfAB, polyB, xfBA);
+	}
+	else
+	{
+		separationA = cb2FindMaxSeparation(&edgeA, &secondSeparation, polyA, xfAB, polyB);
+	}
+
 	if (separationA > totalRadius)
 		return;
 
 	int edgeB = 0;
-	float separationB = cb2FindMaxSeparation(&edgeB, polyB, xfB, polyA, xfA);
+	float separationB;
+	if (cache)
+	{
+		separationB = cb2FindMaxSeparation(&edgeB, cache + 1, polyB, xfBA, polyA, xfAB);
+	}
+	else
+	{
+		separationB = cb2FindMaxSeparation(&edgeB, &secondSeparation, polyB, xfBA, polyA);
+	}
+
 	if (separationB > totalRadius)
 		return;
 
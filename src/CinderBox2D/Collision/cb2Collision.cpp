@@ -250,3 +250,47 @@ bool cb2TestOverlap(	const cb2Shape* shapeA, int indexA,
 
 	return output.distance < 10.0f * cb2_epsilon;
 }
+
+void cb2ComputeFatAABB(cb2AABB* fatAABB, const cb2AABB& aabb, const ci::Vec2f& displacement,
+					   cb2ProxyMotion* motion)
+{
+	// Proxies that keep leaving their fat AABB right away look further ahead.
+	if (motion->moveCount <= 2)
+	{
+		motion->multiplier = cb2Min(2.0f * motion->multiplier, cb2_aabbMaxMultiplier);
+	}
+	else if (motion->moveCount > 16)
+	{
+		motion->multiplier = cb2Max(0.5f * motion->multiplier, cb2_aabbMultiplier);
+	}
+	motion->moveCount = 0;
+	++motion->reinsertCount;
+
+	// Extend AABB. A bigger margin costs large proxies little.
+	ci::Vec2f h = aabb.GetExtents();
+	float extension = cb2_aabbExtension + cb2Min(cb2_aabbSizeExtension * cb2Min(h.x, h.y), 4.0f * cb2_aabbExtension);
+	ci::Vec2f r(extension, extension);
+	fatAABB->lowerBound = aabb.lowerBound - r;
+	fatAABB->upperBound = aabb.upperBound + r;
+
+	// Predict AABB displacement.
+	ci::Vec2f d = motion->multiplier * displacement;
+
+	if (d.x < 0.0f)
+	{
+		fatAABB->lowerBound.x += d.x;
+	}
+	else
+	{
+		fatAABB->upperBound.x += d.x;
+	}
+
+	if (d.y < 0.0f)
+	{
+		fatAABB->lowerBound.y += d.y;
+	}
+	else
+	{
+		fatAABB->upperBound.y += d.y;
+	}
+}
@@ -27,6 +27,7 @@
 /// queries, and TOI queries.
 
 class cb2Shape;
+class cb2CapsuleShape;
 class cb2CircleShape;
 class cb2EdgeShape;
 class cb2PolygonShape;
@@ -143,6 +144,15 @@ struct cb2ClipVertex
 	cb2ContactID id;
 };
 
+/// The face of one polygon that is farthest out of the other, kept between calls of
+/// cb2CollidePolygons. The cache is empty until gap is positive.
+struct cb2SeparationCache
+{
+	cb2Transform xf;	///< the other polygon in the frame of this one at the last search
+	float gap;			///< the best separation minus the second best at the last search
+	int edge;			///< the face with the best separation
+};
+
 /// Ray-cast input data. The ray extends from p1 to p1 + maxFraction * (p2 - p1).
 struct cb2RayCastInput
 {
@@ -215,6 +225,28 @@ struct cb2AABB
 	ci::Vec2f upperBound;	///< the upper vertex
 };
 
+/// How a broad-phase proxy moved so far. The dynamic tree and the uniform grid
+/// keep one per proxy to fit its fat AABB margins, see cb2ComputeFatAABB.
+struct cb2ProxyMotion
+{
+	/// Start out with the margins of cb2Settings.h.
+	void Reset()
+	{
+		multiplier = cb2_aabbMultiplier;
+		moveCount = 0;
+		reinsertCount = 0;
+	}
+
+	/// The displacement prediction, between cb2_aabbMultiplier and cb2_aabbMaxMultiplier.
+	float multiplier;
+
+	/// The moves since the proxy last left its fat AABB.
+	int moveCount;
+
+	/// The number of times the proxy left its fat AABB.
+	int reinsertCount;
+};
+
 /// Compute the collision manifold between two circles.
 void cb2CollideCircles(cb2Manifold* manifold,
 					  const cb2CircleShape* circleA, const cb2Transform& xfA,
@@ -225,11 +257,41 @@ void cb2CollidePolygonAndCircle(cb2Manifold* manifold,
 							   const cb2PolygonShape* polygonA, const cb2Transform& xfA,
 							   const cb2CircleShape* circleB, const cb2Transform& xfB);
 
+/// A shape pair for the batch collide functions. Both shapes have one child.
+struct cb2CollidePair
+{
+	const cb2Shape* shapeA;
+	const cb2Shape* shapeB;
+	const cb2Transform* xfA;
+	const cb2Transform* xfB;
+	cb2Manifold* manifold;	///< receives the result
+};
+
+typedef void cb2CollideBatchFcn(const cb2CollidePair* pairs, int count);
+
+/// Compute the collision manifolds of circle pairs, four at a time. The results
+/// are the same as from cb2CollideCircles.
+void cb2CollideCircles(const cb2CollidePair* pairs, int count);
+
+/// Compute the collision manifolds of polygon and circle pairs. The results are the
+/// same as from cb2CollidePolygonAndCircle.
+void cb2CollidePolygonsAndCircles(const cb2CollidePair* pairs, int count);
+
 /// Compute the collision manifold between two polygons.
 void cb2CollidePolygons(cb2Manifold* manifold,
 					   const cb2PolygonShape* polygonA, const cb2Transform& xfA,
 					   const cb2PolygonShape* polygonB, const cb2Transform& xfB);
 
+/// Compute the collision manifold between two polygons, starting from the reference
+/// faces of the last call. The faces are only searched again once the polygons moved
+/// far enough relative to each other that a face could have changed, so the manifold
+/// is the same as without the cache.
+/// @param cache one entry per polygon, kept between calls for the same pair.
+void cb2CollidePolygons(cb2Manifold* manifold,
+					   const cb2PolygonShape* polygonA, const cb2Transform& xfA,
+					   const cb2PolygonShape* polygonB, const cb2Transform& xfB,
+					   cb2SeparationCache cache[2]);
+
 /// Compute the collision manifold between an edge and a circle.
 void cb2CollideEdgeAndCircle(cb2Manifold* manifold,
 							   const cb2EdgeShape* polygonA, const cb2Transform& xfA,
@@ -240,6 +302,26 @@ void cb2CollideEdgeAndPolygon(cb2Manifold* manifold,
 							   const cb2EdgeShape* edgeA, const cb2Transform& xfA,
 							   const cb2PolygonShape* circleB, const cb2Transform& xfB);
 
+/// Compute the collision manifold between a capsule and a circle.
+void cb2CollideCapsuleAndCircle(cb2Manifold* manifold,
+								const cb2CapsuleShape* capsuleA, const cb2Transform& xfA,
+								const cb2CircleShape* circleB, const cb2Transform& xfB);
+
+/// Compute the collision manifold between two capsules.
+void cb2CollideCapsules(cb2Manifold* manifold,
+						const cb2CapsuleShape* capsuleA, const cb2Transform& xfA,
+						const cb2CapsuleShape* capsuleB, const cb2Transform& xfB);
+
+/// Compute the collision manifold between a polygon and a capsule.
+void cb2CollidePolygonAndCapsule(cb2Manifold* manifold,
+								 const cb2PolygonShape* polygonA, const cb2Transform& xfA,
+								 const cb2CapsuleShape* capsuleB, const cb2Transform& xfB);
+
+/// Compute the collision manifold between an edge and a capsule.
+void cb2CollideEdgeAndCapsule(cb2Manifold* manifold,
+							  const cb2EdgeShape* edgeA, const cb2Transform& xfA,
+							  const cb2CapsuleShape* capsuleB, const cb2Transform& xfB);
+
 /// Clipping for contact manifolds.
 int cb2ClipSegmentToLine(cb2ClipVertex vOut[2], const cb2ClipVertex vIn[2],
 							const ci::Vec2f& normal, float offset, int vertexIndexA);
@@ -249,6 +331,21 @@ bool cb2TestOverlap(	const cb2Shape* shapeA, int indexA,
 					const cb2Shape* shapeB, int indexB,
 					const cb2Transform& xfA, const cb2Transform& xfB);
 
+/// Compute a new fat AABB for a proxy that moved out of its old one. Proxies that
+/// left within a few moves predict more of their displacement, those that stayed
+/// inside for long go back to cb2_aabbMultiplier. The margin also grows with the
+/// size of the proxy, see cb2_aabbSizeExtension.
+/// @param displacement the displacement of the last move.
+/// @param motion the motion of the proxy, this counts the reinsertion.
+void cb2ComputeFatAABB(cb2AABB* fatAABB, const cb2AABB& aabb, const ci::Vec2f& displacement,
+					   cb2ProxyMotion* motion);
+
+/// Bound an AABB given in the local frame of a transform in world coordinates.
+cb2AABB cb2Mul(const cb2Transform& xf, const cb2AABB& aabb);
+
+/// Bound an AABB given in world coordinates in the local frame of a transform.
+cb2AABB cb2MulT(const cb2Transform& xf, const cb2AABB& aabb);
+
 // ---------------- Inline Functions ------------------------------------------
 
 inline bool cb2AABB::IsValid() const
@@ -274,4 +371,30 @@ inline bool cb2TestOverlap(const cb2AABB& a, const cb2AABB& b)
 	return true;
 }
 
+inline cb2AABB cb2Mul(const cb2Transform& xf, const cb2AABB& aabb)
+{
+	ci::Vec2f center = cb2Mul(xf, aabb.GetCenter());
+	ci::Vec2f h = aabb.GetExtents();
+	float c = cb2Abs(xf.q.c), s = cb2Abs(xf.q.s);
+	ci::Vec2f extents(c * h.x + s * h.y, s * h.x + c * h.y);
+
+	cb2AABB worldAABB;
+	worldAABB.lowerBound = center - extents;
+	worldAABB.upperBound = center + extents;
+	return worldAABB;
+}
+
+inline cb2AABB cb2MulT(const cb2Transform& xf, const cb2AABB& aabb)
+{
+	ci::Vec2f center = cb2MulT(xf, aabb.GetCenter());
+	ci::Vec2f h = aabb.GetExtents();
+	float c = cb2Abs(xf.q.c), s = cb2Abs(xf.q.s);
+	ci::Vec2f extents(c * h.x + s * h.y, s * h.x + c * h.y);
+
+	cb2AABB localAABB;
+	localAABB.lowerBound = center - extents;
+	localAABB.upperBound = center + extents;
+	return localAABB;
+}
+
 #endif
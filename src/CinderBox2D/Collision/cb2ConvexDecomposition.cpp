@@ -0,0 +1,498 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Collision/cb2ConvexDecomposition.h>
+#include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <algorithm>
+#include <memory.h>
+
+// Vertices closer than this are welded, like cb2PolygonShape::set does.
+static const float cb2_decompositionWeldSquared = 0.5f * cb2_linearSlop;
+
+// A vertex this close to the line through its neighbours is collinear.
+static const float cb2_decompositionTolerance = 0.1f * cb2_linearSlop;
+
+// "CB2D" and the format version of saved pieces.
+static const unsigned int cb2_decompositionMagic = 0x44324243;
+static const int cb2_decompositionVersion = 1;
+
+// A piece of the polygon during the merge, as indices of its vertices.
+struct cb2ConvexPiece
+{
+	int indices[cb2_maxPolygonVertices];
+	int count;
+	int parent;
+};
+
+// A diagonal of the triangulation, between the two pieces on its sides.
+struct cb2ConvexDiagonal
+{
+	bool operator<(const cb2ConvexDiagonal& other) const
+	{
+		if (i1 != other.i1)
+		{
+			return i1 < other.i1;
+		}
+		return i2 < other.i2;
+	}
+
+	int i1;
+	int i2;
+	int piece;
+	int otherPiece;
+	float lengthSquared;
+};
+
+static bool cb2LongerDiagonal(const cb2ConvexDiagonal& a, const cb2ConvexDiagonal& b)
+{
+	return a.lengthSquared > b.lengthSquared;
+}
+
+// The distance of b to the left of the line from a to c, negative for a reflex b.
+static float cb2GetTurn(const ci::Vec2f& a, const ci::Vec2f& b, const ci::Vec2f& c)
+{
+	float length = cb2Distance(a, c);
+	if (length < cb2_epsilon)
+	{
+		return 0.0f;
+	}
+	return cb2Cross(b - a, c - b) / length;
+}
+
+// Inside or on the boundary of the counter-clockwise triangle.
+static bool cb2InTriangle(const ci::Vec2f& p, const ci::Vec2f& a, const ci::Vec2f& b, const ci::Vec2f& c)
+{
+	return cb2Cross(b - a, p - a) >= 0.0f && cb2Cross(c - b, p - b) >= 0.0f && cb2Cross(a - c, p - c) >= 0.0f;
+}
+
+static int cb2FindPiece(cb2ConvexPiece* pieces, int index)
+{
+	while (pieces[index].parent != index)
+	{
+		pieces[index].parent = pieces[pieces[index].parent].parent;
+		index = pieces[index].parent;
+	}
+	return index;
+}
+
+// Merge piece q into piece p across the diagonal between vertices i1 and i2.
+static bool cb2MergePieces(cb2ConvexPiece* p, const cb2ConvexPiece* q, int i1, int i2,
+						   const ci::Vec2f* points, int maxVertexCount)
+{
+	// p runs a to b along the diagonal, q runs b to a.
+	int k = 0;
+	while (k < p->count)
+	{
+		int a = p->indices[k];
+		int b = p->indices[(k + 1) % p->count];
+		if ((a == i1 && b == i2) || (a == i2 && b == i1))
+		{
+			break;
+		}
+		++k;
+	}
+
+	int m = 0;
+	int a = p->indices[k];
+	while (m < q->count && q->indices[m] != a)
+	{
+		++m;
+	}
+	if (k == p->count || m == q->count)
+	{
+		return false;
+	}
+	cb2Assert(q->indices[(m + q->count - 1) % q->count] == p->indices[(k + 1) % p->count]);
+
+	// From b around p to a, then on around q back to b.
+	int merged[2 * cb2_maxPolygonVertices];
+	int count = 0;
+	for (int i = 1; i <= p->count; ++i)
+	{
+		merged[count++] = p->indices[(k + i) % p->count];
+	}
+	for (int i = 1; i < q->count - 1; ++i)
+	{
+		merged[count++] = q->indices[(m + i) % q->count];
+	}
+
+	// Only the ends of the diagonal, a and then b, can turn the wrong way. A straight
+	// one is dropped.
+	int ends[2] = { p->count - 1, 0 };
+	for (int e = 0; e < 2; ++e)
+	{
+		int i = ends[e];
+		const ci::Vec2f& v0 = points[merged[(i + count - 1) % count]];
+		const ci::Vec2f& v1 = points[merged[i]];
+		const ci::Vec2f& v2 = points[merged[(i + 1) % count]];
+		float turn = cb2GetTurn(v0, v1, v2);
+		if (turn < -cb2_decompositionTolerance)
+		{
+			return false;
+		}
+
+		if (turn <= cb2_decompositionTolerance)
+		{
+			memmove(merged + i, merged + i + 1, (count - i - 1) * sizeof(int));
+			--count;
+		}
+	}
+
+	if (count > maxVertexCount)
+	{
+		return false;
+	}
+
+	memcpy(p->indices, merged, count * sizeof(int));
+	p->count = count;
+	return true;
+}
+
+cb2ConvexDecomposition::cb2ConvexDecomposition(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
+	m_vertices = NULL;
+	m_starts = NULL;
+	m_polygonCount = 0;
+	m_vertexCapacity = 0;
+	m_polygonCapacity = 0;
+}
+
+cb2ConvexDecomposition::~cb2ConvexDecomposition()
+{
+	cb2Free(m_allocator, m_vertices);
+	cb2Free(m_allocator, m_starts);
+}
+
+void cb2ConvexDecomposition::Clear()
+{
+	m_polygonCount = 0;
+}
+
+void cb2ConvexDecomposition::Reserve(int vertexCount, int polygonCount)
+{
+	if (vertexCount > m_vertexCapacity)
+	{
+		cb2Free(m_allocator, m_vertices);
+		m_vertexCapacity = vertexCount;
+		m_vertices = (ci::Vec2f*)cb2Alloc(m_allocator, m_vertexCapacity * sizeof(ci::Vec2f));
+	}
+
+	if (polygonCount + 1 > m_polygonCapacity)
+	{
+		cb2Free(m_allocator, m_starts);
+		m_polygonCapacity = polygonCount + 1;
+		m_starts = (int*)cb2Alloc(m_allocator, m_polygonCapacity * sizeof(int));
+	}
+}
+
+bool cb2ConvexDecomposition::Decompose(const ci::Vec2f* vertices, int count, int maxVertexCount)
+{
+	cb2Assert(3 <= maxVertexCount && maxVertexCount <= cb2_maxPolygonVertices);
+	maxVertexCount = cb2Clamp(maxVertexCount, 3, cb2_maxPolygonVertices);
+	Clear();
+
+	// Weld the vertices and wind them counter-clockwise.
+	ci::Vec2f* points = (ci::Vec2f*)cb2Alloc(m_allocator, cb2Max(count, 1) * sizeof(ci::Vec2f));
+	int n = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (n == 0 || cb2DistanceSquared(vertices[i], points[n - 1]) >= cb2_decompositionWeldSquared)
+		{
+			points[n++] = vertices[i];
+		}
+	}
+	while (n > 1 && cb2DistanceSquared(points[n - 1], points[0]) < cb2_decompositionWeldSquared)
+	{
+		--n;
+	}
+
+	float area = 0.0f;
+	for (int i = 0; i < n; ++i)
+	{
+		area += cb2Cross(points[i], points[(i + 1) % n]);
+	}
+	if (area < 0.0f)
+	{
+		std::reverse(points, points + n);
+	}
+
+	// Drop straight vertices, they are never ears.
+	bool dropped = true;
+	while (dropped && n >= 3)
+	{
+		dropped = false;
+		for (int i = 0; i < n && n >= 3; ++i)
+		{
+			float turn = cb2GetTurn(points[(i + n - 1) % n], points[i], points[(i + 1) % n]);
+			if (cb2Abs(turn) <= cb2_decompositionTolerance)
+			{
+				memmove(points + i, points + i + 1, (n - i - 1) * sizeof(ci::Vec2f));
+				--n;
+				dropped = true;
+			}
+		}
+	}
+
+	if (n < 3)
+	{
+		cb2Free(m_allocator, points);
+		return false;
+	}
+
+	// Ear clipping, each ear is a triangle piece.
+	int* prev = (int*)cb2Alloc(m_allocator, n * sizeof(int));
+	int* next = (int*)cb2Alloc(m_allocator, n * sizeof(int));
+	cb2ConvexPiece* pieces = (cb2ConvexPiece*)cb2Alloc(m_allocator, (n - 2) * sizeof(cb2ConvexPiece));
+	for (int i = 0; i < n; ++i)
+	{
+		prev[i] = (i + n - 1) % n;
+		next[i] = (i + 1) % n;
+	}
+
+	int pieceCount = 0;
+	int remaining = n;
+	int i = 0;
+	int misses = 0;
+	bool success = true;
+	while (remaining > 3)
+	{
+		int a = prev[i];
+		int c = next[i];
+		bool ear = cb2GetTurn(points[a], points[i], points[c]) > cb2_decompositionTolerance;
+		for (int j = next[c]; ear && j != a; j = next[j])
+		{
+			// Only reflex vertices can be inside a convex corner.
+			bool reflex = cb2GetTurn(points[prev[j]], points[j], points[next[j]]) <= cb2_decompositionTolerance;
+			ear = (reflex && cb2InTriangle(points[j], points[a], points[i], points[c])) == false;
+		}
+
+		bool straight = false;
+		if (ear == false && misses > remaining)
+		{
+			// No ears left, which only happens when clipping made a vertex straight.
+			straight = cb2Abs(cb2GetTurn(points[a], points[i], points[c])) <= cb2_decompositionTolerance;
+			if (straight == false && misses > 2 * remaining)
+			{
+				success = false;
+				break;
+			}
+		}
+
+		if (ear || straight)
+		{
+			if (ear)
+			{
+				cb2ConvexPiece* piece = pieces + pieceCount;
+				piece->indices[0] = a;
+				piece->indices[1] = i;
+				piece->indices[2] = c;
+				piece->count = 3;
+				piece->parent = pieceCount;
+				++pieceCount;
+			}
+
+			next[a] = c;
+			prev[c] = a;
+			--remaining;
+			misses = 0;
+			i = a;
+		}
+		else
+		{
+			++misses;
+			i = next[i];
+		}
+	}
+
+	if (success && cb2GetTurn(points[prev[i]], points[i], points[next[i]]) > cb2_decompositionTolerance)
+	{
+		cb2ConvexPiece* piece = pieces + pieceCount;
+		piece->indices[0] = prev[i];
+		piece->indices[1] = i;
+		piece->indices[2] = next[i];
+		piece->count = 3;
+		piece->parent = pieceCount;
+		++pieceCount;
+	}
+
+	cb2Free(m_allocator, next);
+	cb2Free(m_allocator, prev);
+
+	if (success == false || pieceCount == 0)
+	{
+		cb2Free(m_allocator, pieces);
+		cb2Free(m_allocator, points);
+		return false;
+	}
+
+	// Pair up the triangle edges that are not on the boundary, they are the diagonals.
+	cb2ConvexDiagonal* edges = (cb2ConvexDiagonal*)cb2Alloc(m_allocator, 3 * pieceCount * sizeof(cb2ConvexDiagonal));
+	int edgeCount = 0;
+	for (int p = 0; p < pieceCount; ++p)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int i1 = pieces[p].indices[k];
+			int i2 = pieces[p].indices[(k + 1) % 3];
+			if (i2 == (i1 + 1) % n)
+			{
+				continue;
+			}
+
+			cb2ConvexDiagonal* edge = edges + edgeCount++;
+			edge->i1 = cb2Min(i1, i2);
+			edge->i2 = cb2Max(i1, i2);
+			edge->piece = p;
+			edge->lengthSquared = cb2DistanceSquared(points[i1], points[i2]);
+		}
+	}
+	std::sort(edges, edges + edgeCount);
+
+	cb2ConvexDiagonal* diagonals = (cb2ConvexDiagonal*)cb2Alloc(m_allocator, cb2Max(edgeCount, 1) * sizeof(cb2ConvexDiagonal));
+	int diagonalCount = 0;
+	for (int k = 0; k + 1 < edgeCount; ++k)
+	{
+		if (edges[k].i1 == edges[k + 1].i1 && edges[k].i2 == edges[k + 1].i2)
+		{
+			diagonals[diagonalCount] = edges[k];
+			diagonals[diagonalCount].otherPiece = edges[k + 1].piece;
+			++diagonalCount;
+			++k;
+		}
+	}
+	cb2Free(m_allocator, edges);
+
+	// Merge across the longest diagonals first, which tends to leave fewer pieces.
+	std::stable_sort(diagonals, diagonals + diagonalCount, cb2LongerDiagonal);
+
+	int polygonCount = pieceCount;
+	for (int k = 0; k < diagonalCount; ++k)
+	{
+		const cb2ConvexDiagonal& d = diagonals[k];
+		int p = cb2FindPiece(pieces, d.piece);
+		int q = cb2FindPiece(pieces, d.otherPiece);
+		if (p != q && cb2MergePieces(pieces + p, pieces + q, d.i1, d.i2, points, maxVertexCount))
+		{
+			pieces[q].parent = p;
+			--polygonCount;
+		}
+	}
+	cb2Free(m_allocator, diagonals);
+
+	int vertexCount = 0;
+	for (int p = 0; p < pieceCount; ++p)
+	{
+		if (pieces[p].parent == p)
+		{
+			vertexCount += pieces[p].count;
+		}
+	}
+
+	Reserve(vertexCount, polygonCount);
+	m_starts[0] = 0;
+	for (int p = 0; p < pieceCount; ++p)
+	{
+		if (pieces[p].parent != p)
+		{
+			continue;
+		}
+
+		int start = m_starts[m_polygonCount];
+		for (int k = 0; k < pieces[p].count; ++k)
+		{
+			m_vertices[start + k] = points[pieces[p].indices[k]];
+		}
+		m_starts[++m_polygonCount] = start + pieces[p].count;
+	}
+	cb2Assert(m_polygonCount == polygonCount);
+
+	cb2Free(m_allocator, pieces);
+	cb2Free(m_allocator, points);
+	return true;
+}
+
+const ci::Vec2f* cb2ConvexDecomposition::GetPolygon(int index, int* count) const
+{
+	cb2Assert(0 <= index && index < m_polygonCount);
+	*count = m_starts[index + 1] - m_starts[index];
+	return m_vertices + m_starts[index];
+}
+
+void cb2ConvexDecomposition::GetShape(int index, cb2PolygonShape* shape) const
+{
+	int count;
+	const ci::Vec2f* vertices = GetPolygon(index, &count);
+	shape->set(vertices, count);
+}
+
+void cb2ConvexDecomposition::Save(cb2Snapshot* snapshot) const
+{
+	cb2Assert(snapshot->IsLoading() == false);
+	snapshot->Write(cb2_decompositionMagic);
+	snapshot->Write(cb2_decompositionVersion);
+	snapshot->Write(m_polygonCount);
+	for (int i = 0; i < m_polygonCount; ++i)
+	{
+		int count;
+		const ci::Vec2f* vertices = GetPolygon(i, &count);
+		snapshot->Write(count);
+		snapshot->Write(vertices, count * sizeof(ci::Vec2f));
+	}
+}
+
+bool cb2ConvexDecomposition::Load(cb2Snapshot* snapshot)
+{
+	cb2Assert(snapshot->IsLoading());
+	Clear();
+
+	unsigned int magic = snapshot->Read<unsigned int>();
+	int version = snapshot->Read<int>();
+	int polygonCount = snapshot->ReadCount(sizeof(int) + 3 * sizeof(ci::Vec2f));
+	if (snapshot->IsValid() == false || magic != cb2_decompositionMagic || version != cb2_decompositionVersion)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	Reserve(polygonCount * cb2_maxPolygonVertices, polygonCount);
+	m_starts[0] = 0;
+	for (int i = 0; i < polygonCount; ++i)
+	{
+		int count = snapshot->Read<int>();
+		if (snapshot->IsValid() == false || count < 3 || count > cb2_maxPolygonVertices)
+		{
+			snapshot->Invalidate();
+			Clear();
+			return false;
+		}
+
+		snapshot->Read(m_vertices + m_starts[i], count * sizeof(ci::Vec2f));
+		m_starts[i + 1] = m_starts[i] + count;
+	}
+
+	if (snapshot->IsValid() == false)
+	{
+		return false;
+	}
+
+	m_polygonCount = polygonCount;
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_CONVEX_DECOMPOSITION_H
+#define CB2_CONVEX_DECOMPOSITION_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+
+class cb2PolygonShape;
+class cb2Snapshot;
+
+/// Splits a concave polygon into few convex pieces that fit cb2PolygonShape, so
+/// concave art needs fewer fixtures, proxies and contacts than with a triangle per
+/// fixture. The polygon is triangulated by ear clipping, then neighbouring pieces are
+/// merged across their shared diagonals, longest first, as long as the result stays
+/// convex and within the vertex limit (Hertel-Mehlhorn). This gives at most four
+/// times the minimal number of pieces and usually close to it.
+///
+/// Vertices closer than cb2PolygonShape::set welds them are merged and collinear
+/// vertices are dropped first, so every piece can be set on a polygon shape as is.
+/// Decomposing is meant for load time, Save and Load cache the pieces.
+class cb2ConvexDecomposition
+{
+public:
+	/// @param allocator where the pieces live, NULL for cb2Alloc.
+	cb2ConvexDecomposition(cb2AllocatorInterface* allocator = NULL);
+	~cb2ConvexDecomposition();
+
+	/// Decompose a simple polygon without holes, in either winding.
+	/// @param maxVertexCount the most vertices of a piece, in [3, cb2_maxPolygonVertices].
+	/// @return false if the polygon intersects itself or is degenerate, there are no
+	/// pieces then.
+	bool Decompose(const ci::Vec2f* vertices, int count, int maxVertexCount = cb2_maxPolygonVertices);
+
+	/// Get the number of convex pieces.
+	int GetPolygonCount() const { return m_polygonCount; }
+
+	/// Get the vertices of a piece in counter-clockwise order.
+	const ci::Vec2f* GetPolygon(int index, int* count) const;
+
+	/// Set a polygon shape to a piece.
+	void GetShape(int index, cb2PolygonShape* shape) const;
+
+	/// Save the pieces, for example to a cache file next to the art.
+	void Save(cb2Snapshot* snapshot) const;
+
+	/// Load pieces saved by Save. Returns false for bad data, there are no pieces then.
+	bool Load(cb2Snapshot* snapshot);
+
+	/// Drop the pieces.
+	void Clear();
+
+private:
+
+	cb2ConvexDecomposition(const cb2ConvexDecomposition&);
+	cb2ConvexDecomposition& operator=(const cb2ConvexDecomposition&);
+
+	void Reserve(int vertexCount, int polygonCount);
+
+	cb2AllocatorInterface* m_allocator;
+
+	// The vertices of piece i are m_vertices[m_starts[i], m_starts[i + 1]).
+	ci::Vec2f* m_vertices;
+	int* m_starts;
+	int m_polygonCount;
+	int m_vertexCapacity;
+	int m_polygonCapacity;
+};
+
+#endif
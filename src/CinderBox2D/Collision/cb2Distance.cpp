@@ -21,9 +21,15 @@
 #include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
+
+#include <atomic>
 
 // GJK using Voronoi regions (Christer Ericson) and Barycentric coordinates.
-int cb2_gjkCalls, cb2_gjkIters, cb2_gjkMaxIters;
+// GJK profiling counters. These are bumped from the parallel TOI pass, so they
+// are relaxed atomics and the maximum is only approximate.
+std::atomic<int> cb2_gjkCalls, cb2_gjkIters, cb2_gjkMaxIters;
 
 void cb2DistanceProxy::set(const cb2Shape* shape, int index)
 {
@@ -35,6 +41,8 @@ void cb2DistanceProxy::set(const cb2Shape* shape, int index)
 			m_vertices = &circle->m_p;
 			m_count = 1;
 			m_radius = circle->m_radius;
+			m_vertexX = NULL;
+			m_vertexY = NULL;
 		}
 		break;
 
@@ -44,6 +52,8 @@ void cb2DistanceProxy::set(const cb2Shape* shape, int index)
 			m_vertices = polygon->m_vertices;
 			m_count = polygon->m_count;
 			m_radius = polygon->m_radius;
+			m_vertexX = polygon->m_vertexX;
+			m_vertexY = polygon->m_vertexY;
 		}
 		break;
 
@@ -65,6 +75,8 @@ void cb2DistanceProxy::set(const cb2Shape* shape, int index)
 			m_vertices = m_buffer;
 			m_count = 2;
 			m_radius = chain->m_radius;
+			m_vertexX = NULL;
+			m_vertexY = NULL;
 		}
 		break;
 
@@ -74,6 +86,36 @@ void cb2DistanceProxy::set(const cb2Shape* shape, int index)
 			m_vertices = &edge->m_vertex1;
 			m_count = 2;
 			m_radius = edge->m_radius;
+			m_vertexX = NULL;
+			m_vertexY = NULL;
+		}
+		break;
+
+	case cb2Shape::e_capsule:
+		{
+			const cb2CapsuleShape* capsule = static_cast<const cb2CapsuleShape*>(shape);
+			m_vertices = &capsule->m_vertex1;
+			m_count = 2;
+			m_radius = capsule->m_radius;
+			m_vertexX = NULL;
+			m_vertexY = NULL;
+		}
+		break;
+
+	case cb2Shape::e_heightfield:
+		{
+			const cb2HeightfieldShape* heightfield = static_cast<const cb2HeightfieldShape*>(shape);
+			cb2Assert(0 <= index && index < heightfield->m_count - 1);
+
+			float spacing = heightfield->m_spacing;
+			m_buffer[0].set(index * spacing, heightfield->m_heights[index]);
+			m_buffer[1].set((index + 1) * spacing, heightfield->m_heights[index + 1]);
+
+			m_vertices = m_buffer;
+			m_count = 2;
+			m_radius = heightfield->m_radius;
+			m_vertexX = NULL;
+			m_vertexY = NULL;
 		}
 		break;
 
@@ -445,7 +487,7 @@ void cb2Distance(cb2DistanceOutput* output,
 				cb2SimplexCache* cache,
 				const cb2DistanceInput* input)
 {
-	++cb2_gjkCalls;
+	cb2_gjkCalls.fetch_add(1, std::memory_order_relaxed);
 
 	const cb2DistanceProxy* proxyA = &input->proxyA;
 	const cb2DistanceProxy* proxyB = &input->proxyB;
@@ -541,7 +583,6 @@ void cb2Distance(cb2DistanceOutput* output,
 
 		// Iteration count is equated to the number of support point calls.
 		++iter;
-		++cb2_gjkIters;
 
 		// Check for duplicate support points. This is the main termination criteria.
 		bool duplicate = false;
@@ -564,7 +605,11 @@ void cb2Distance(cb2DistanceOutput* output,
 		++simplex.m_count;
 	}
 
-	cb2_gjkMaxIters = cb2Max(cb2_gjkMaxIters, iter);
+	cb2_gjkIters.fetch_add(iter, std::memory_order_relaxed);
+	if (iter > cb2_gjkMaxIters.load(std::memory_order_relaxed))
+	{
+		cb2_gjkMaxIters.store(iter, std::memory_order_relaxed);
+	}
 
 	// Prepare output.
 	simplex.GetWitnessPoints(&output->pointA, &output->pointB);
@@ -601,3 +646,149 @@ void cb2Distance(cb2DistanceOutput* output,
 		}
 	}
 }
+
+bool cb2ShapeCast(cb2ShapeCastOutput* output, const cb2ShapeCastInput* input)
+{
+	output->iterations = 0;
+	output->lambda = 1.0f;
+	output->normal = ci::Vec2f::zero();
+	output->point = ci::Vec2f::zero();
+
+	const cb2DistanceProxy* proxyA = &input->proxyA;
+	const cb2DistanceProxy* proxyB = &input->proxyB;
+
+	float radiusA = cb2Max(proxyA->m_radius, cb2_polygonRadius);
+	float radiusB = cb2Max(proxyB->m_radius, cb2_polygonRadius);
+	float radius = radiusA + radiusB;
+
+	cb2Transform xfA = input->transformA;
+	cb2Transform xfB = input->transformB;
+
+	ci::Vec2f r = input->translationB;
+	ci::Vec2f n = ci::Vec2f::zero();
+	float lambda = 0.0f;
+
+	// Initial simplex.
+	cb2Simplex simplex;
+	simplex.m_count = 0;
+
+	// Get simplex vertices as an array.
+	cb2SimplexVertex* vertices = &simplex.m_v1;
+
+	// Get support point in -r direction.
+	int indexA = proxyA->GetSupport(cb2MulT(xfA.q, -r));
+	ci::Vec2f wA = cb2Mul(xfA, proxyA->GetVertex(indexA));
+	int indexB = proxyB->GetSupport(cb2MulT(xfB.q, r));
+	ci::Vec2f wB = cb2Mul(xfB, proxyB->GetVertex(indexB));
+	ci::Vec2f v = wA - wB;
+
+	// Sigma is the target distance between the cores.
+	float sigma = cb2Max(cb2_polygonRadius, radius - cb2_polygonRadius);
+	const float tolerance = 0.5f * cb2_linearSlop;
+
+	// Main iteration loop.
+	const int k_maxIters = 20;
+	int iter = 0;
+	while (iter < k_maxIters && v.length() - sigma > tolerance)
+	{
+		cb2Assert(simplex.m_count < 3);
+
+		output->iterations += 1;
+
+		// Support in direction -v (A - B).
+		indexA = proxyA->GetSupport(cb2MulT(xfA.q, -v));
+		wA = cb2Mul(xfA, proxyA->GetVertex(indexA));
+		indexB = proxyB->GetSupport(cb2MulT(xfB.q, v));
+		wB = cb2Mul(xfB, proxyB->GetVertex(indexB));
+		ci::Vec2f p = wA - wB;
+
+		// -v is a normal at p.
+		v.normalize();
+
+		// Intersect the ray with the plane.
+		float vp = cb2Dot(v, p);
+		float vr = cb2Dot(v, r);
+		if (vp - sigma > lambda * vr)
+		{
+			if (vr <= 0.0f)
+			{
+				// Miss.
+				return false;
+			}
+
+			lambda = (vp - sigma) / vr;
+			if (lambda > 1.0f)
+			{
+				// Miss.
+				return false;
+			}
+
+			n = -v;
+			simplex.m_count = 0;
+		}
+
+		// Reverse the simplex since it works with B - A. Shift by lambda * r because
+		// we want the closest point to the current clip point. The support point p
+		// is not shifted because the plane equation is formed in unshifted space.
+		cb2SimplexVertex* vertex = vertices + simplex.m_count;
+		vertex->indexA = indexB;
+		vertex->wA = wB + lambda * r;
+		vertex->indexB = indexA;
+		vertex->wB = wA;
+		vertex->w = vertex->wB - vertex->wA;
+		vertex->a = 1.0f;
+		simplex.m_count += 1;
+
+		switch (simplex.m_count)
+		{
+		case 1:
+			break;
+
+		case 2:
+			simplex.Solve2();
+			break;
+
+		case 3:
+			simplex.Solve3();
+			break;
+
+		default:
+			cb2Assert(false);
+		}
+
+		// If we have 3 points, then the origin is in the corresponding triangle.
+		if (simplex.m_count == 3)
+		{
+			// Overlap.
+			return false;
+		}
+
+		// Get the search direction.
+		v = simplex.GetClosestPoint();
+
+		// The iteration count is equated to the number of support point calls.
+		++iter;
+	}
+
+	if (iter == 0)
+	{
+		// Initial overlap.
+		return false;
+	}
+
+	// Prepare output.
+	ci::Vec2f pointA, pointB;
+	simplex.GetWitnessPoints(&pointB, &pointA);
+
+	if (v.lengthSquared() > 0.0f)
+	{
+		n = -v;
+		n.normalize();
+	}
+
+	output->point = pointA + radiusA * n;
+	output->normal = n;
+	output->lambda = lambda;
+	output->iterations = iter;
+	return true;
+}
@@ -21,6 +21,7 @@
 #define CB2_DISTANCE_H
 
 #include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2Simd.h>
 
 class cb2Shape;
 
@@ -28,7 +29,7 @@ class cb2Shape;
 /// It encapsulates any shape.
 struct cb2DistanceProxy
 {
-	cb2DistanceProxy() : m_vertices(NULL), m_count(0), m_radius(0.0f) {}
+	cb2DistanceProxy() : m_vertices(NULL), m_count(0), m_radius(0.0f), m_vertexX(NULL), m_vertexY(NULL) {}
 
 	/// Initialize the proxy using the given shape. The shape
 	/// must remain in scope while the proxy is in use.
@@ -50,6 +51,11 @@ struct cb2DistanceProxy
 	const ci::Vec2f* m_vertices;
 	int m_count;
 	float m_radius;
+
+	/// The polygon lane arrays for the SIMD support search, NULL for the others.
+	/// @see cb2PolygonShape::m_vertexX
+	const float* m_vertexX;
+	const float* m_vertexY;
 };
 
 /// Used to warm start cb2Distance.
@@ -84,12 +90,36 @@ struct cb2DistanceOutput
 };
 
 /// Compute the closest points between two shapes. Supports any combination of:
-/// cb2CircleShape, cb2PolygonShape, cb2EdgeShape. The simplex cache is input/output.
+/// cb2CircleShape, cb2PolygonShape, cb2EdgeShape, cb2CapsuleShape. The simplex cache is input/output.
 /// On the first call set cb2SimplexCache.count to zero.
 void cb2Distance(cb2DistanceOutput* output,
 				cb2SimplexCache* cache, 
 				const cb2DistanceInput* input);
 
+/// Input for cb2ShapeCast. Shape B moves by translationB, shape A stays put.
+struct cb2ShapeCastInput
+{
+	cb2DistanceProxy proxyA;
+	cb2DistanceProxy proxyB;
+	cb2Transform transformA;
+	cb2Transform transformB;
+	ci::Vec2f translationB;
+};
+
+/// Output for cb2ShapeCast.
+struct cb2ShapeCastOutput
+{
+	ci::Vec2f point;	///< the hit point on shape A
+	ci::Vec2f normal;	///< the surface normal of shape A at the hit point
+	float lambda;		///< the fraction of translationB travelled before the hit
+	int iterations;	///< number of GJK iterations used
+};
+
+/// Sweep shape B along a translation against shape A, using GJK ray-casting on
+/// the Minkowski difference (Gino van den Bergen, "Smooth Mesh Contacts with GJK").
+/// @return true on a hit, false on a miss or when the shapes overlap initially.
+bool cb2ShapeCast(cb2ShapeCastOutput* output, const cb2ShapeCastInput* input);
+
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -106,6 +136,11 @@ inline const ci::Vec2f& cb2DistanceProxy::GetVertex(int index) const
 
 inline int cb2DistanceProxy::GetSupport(const ci::Vec2f& d) const
 {
+	if (m_vertexX)
+	{
+		return cb2SupportW(m_vertexX, m_vertexY, m_count, d.x, d.y);
+	}
+
 	int bestIndex = 0;
 	float bestValue = cb2Dot(m_vertices[0], d);
 	for (int i = 1; i < m_count; ++i)
@@ -123,6 +158,11 @@ inline int cb2DistanceProxy::GetSupport(const ci::Vec2f& d) const
 
 inline const ci::Vec2f& cb2DistanceProxy::GetSupportVertex(const ci::Vec2f& d) const
 {
+	if (m_vertexX)
+	{
+		return m_vertices[cb2SupportW(m_vertexX, m_vertexY, m_count, d.x, d.y)];
+	}
+
 	int bestIndex = 0;
 	float bestValue = cb2Dot(m_vertices[0], d);
 	for (int i = 1; i < m_count; ++i)
@@ -17,16 +17,34 @@
 */
 
 #include <CinderBox2D/Collision/cb2DynamicTree.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 #include <memory.h>
 
-cb2DynamicTree::cb2DynamicTree()
+// Grow a scratch buffer to at least size bytes, dropping its contents.
+static inline void* cb2ReserveScratch(cb2AllocatorInterface* allocator, void** scratch, int* capacity, int size)
 {
+	if (size > *capacity)
+	{
+		cb2Free(allocator, *scratch);
+		*capacity = cb2Max(size, 2 * *capacity);
+		*scratch = cb2Alloc(allocator, *capacity);
+	}
+	return *scratch;
+}
+
+cb2DynamicTree::cb2DynamicTree(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
 	m_root = cb2_nullNode;
 
 	m_nodeCapacity = 16;
 	m_nodeCount = 0;
-	m_nodes = (cb2TreeNode*)cb2Alloc(m_nodeCapacity * sizeof(cb2TreeNode));
+	m_nodes = (cb2TreeNode*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(cb2TreeNode));
 	memset(m_nodes, 0, m_nodeCapacity * sizeof(cb2TreeNode));
+	m_userData = (void**)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(void*));
+	memset(m_userData, 0, m_nodeCapacity * sizeof(void*));
+	m_motion = (cb2ProxyMotion*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(cb2ProxyMotion));
+	m_maskBits = (unsigned short*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(unsigned short));
 
 	// Build a linked list for the free list.
 	for (int i = 0; i < m_nodeCapacity - 1; ++i)
@@ -38,42 +56,108 @@ cb2DynamicTree::cb2DynamicTree()
 	m_nodes[m_nodeCapacity-1].height = -1;
 	m_freeList = 0;
 
+	m_leafScratch = NULL;
+	m_leafScratchSize = 0;
+	m_buildScratch = NULL;
+	m_buildScratchSize = 0;
+
 	m_path = 0;
 
 	m_insertionCount = 0;
+
+	m_version = 0;
+	m_shared = false;
 }
 
 cb2DynamicTree::~cb2DynamicTree()
 {
 	// This frees the entire tree in one shot.
-	cb2Free(m_nodes);
+	FreePool();
+	FreeScratch();
+}
+
+void cb2DynamicTree::FreeScratch()
+{
+	cb2Free(m_allocator, m_leafScratch);
+	cb2Free(m_allocator, m_buildScratch);
+	m_leafScratch = NULL;
+	m_leafScratchSize = 0;
+	m_buildScratch = NULL;
+	m_buildScratchSize = 0;
+}
+
+// Free the node pool, or only the user data of a tree that shares its nodes.
+void cb2DynamicTree::FreePool()
+{
+	if (m_shared == false)
+	{
+		cb2Free(m_allocator, m_nodes);
+		cb2Free(m_allocator, m_motion);
+		cb2Free(m_allocator, m_maskBits);
+	}
+	cb2Free(m_allocator, m_userData);
+}
+
+// Grow the node pool, adding the new nodes to the front of the free list.
+void cb2DynamicTree::GrowPool(int capacity)
+{
+	cb2Assert(m_shared == false);
+	cb2Assert(capacity > m_nodeCapacity);
+
+	int oldCapacity = m_nodeCapacity;
+	m_nodeCapacity = capacity;
+
+	cb2TreeNode* oldNodes = m_nodes;
+	m_nodes = (cb2TreeNode*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(cb2TreeNode));
+	memcpy(m_nodes, oldNodes, oldCapacity * sizeof(cb2TreeNode));
+	cb2Free(m_allocator, oldNodes);
+
+	void** oldUserData = m_userData;
+	m_userData = (void**)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(void*));
+	memcpy(m_userData, oldUserData, oldCapacity * sizeof(void*));
+	cb2Free(m_allocator, oldUserData);
+
+	cb2ProxyMotion* oldMotion = m_motion;
+	m_motion = (cb2ProxyMotion*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(cb2ProxyMotion));
+	memcpy(m_motion, oldMotion, oldCapacity * sizeof(cb2ProxyMotion));
+	cb2Free(m_allocator, oldMotion);
+
+	unsigned short* oldMaskBits = m_maskBits;
+	m_maskBits = (unsigned short*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(unsigned short));
+	memcpy(m_maskBits, oldMaskBits, oldCapacity * sizeof(unsigned short));
+	cb2Free(m_allocator, oldMaskBits);
+
+	// Build a linked list for the free list. The parent
+	// pointer becomes the "next" pointer.
+	for (int i = oldCapacity; i < m_nodeCapacity - 1; ++i)
+	{
+		m_nodes[i].next = i + 1;
+		m_nodes[i].height = -1;
+	}
+	m_nodes[m_nodeCapacity-1].next = m_freeList;
+	m_nodes[m_nodeCapacity-1].height = -1;
+	m_freeList = oldCapacity;
+}
+
+void cb2DynamicTree::Reserve(int nodeCount)
+{
+	if (nodeCount > m_nodeCapacity)
+	{
+		GrowPool(nodeCount);
+	}
 }
 
 // Allocate a node from the pool. Grow the pool if necessary.
 int cb2DynamicTree::AllocateNode()
 {
+	cb2Assert(m_shared == false);
 	// Expand the node pool as needed.
 	if (m_freeList == cb2_nullNode)
 	{
 		cb2Assert(m_nodeCount == m_nodeCapacity);
 
 		// The free list is empty. Rebuild a bigger pool.
-		cb2TreeNode* oldNodes = m_nodes;
-		m_nodeCapacity *= 2;
-		m_nodes = (cb2TreeNode*)cb2Alloc(m_nodeCapacity * sizeof(cb2TreeNode));
-		memcpy(m_nodes, oldNodes, m_nodeCount * sizeof(cb2TreeNode));
-		cb2Free(oldNodes);
-
-		// Build a linked list for the free list. The parent
-		// pointer becomes the "next" pointer.
-		for (int i = m_nodeCount; i < m_nodeCapacity - 1; ++i)
-		{
-			m_nodes[i].next = i + 1;
-			m_nodes[i].height = -1;
-		}
-		m_nodes[m_nodeCapacity-1].next = cb2_nullNode;
-		m_nodes[m_nodeCapacity-1].height = -1;
-		m_freeList = m_nodeCount;
+		GrowPool(2 * m_nodeCapacity);
 	}
 
 	// Peel a node off the free list.
@@ -83,7 +167,9 @@ int cb2DynamicTree::AllocateNode()
 	m_nodes[nodeId].child1 = cb2_nullNode;
 	m_nodes[nodeId].child2 = cb2_nullNode;
 	m_nodes[nodeId].height = 0;
-	m_nodes[nodeId].userData = NULL;
+	m_nodes[nodeId].categoryBits = 0xFFFF;
+	m_userData[nodeId] = NULL;
+	m_maskBits[nodeId] = 0xFFFF;
 	++m_nodeCount;
 	return nodeId;
 }
@@ -91,6 +177,7 @@ int cb2DynamicTree::AllocateNode()
 // Return a node to the pool.
 void cb2DynamicTree::FreeNode(int nodeId)
 {
+	cb2Assert(m_shared == false);
 	cb2Assert(0 <= nodeId && nodeId < m_nodeCapacity);
 	cb2Assert(0 < m_nodeCount);
 	m_nodes[nodeId].next = m_freeList;
@@ -110,7 +197,8 @@ int cb2DynamicTree::CreateProxy(const cb2AABB& aabb, void* userData)
 	ci::Vec2f r(cb2_aabbExtension, cb2_aabbExtension);
 	m_nodes[proxyId].aabb.lowerBound = aabb.lowerBound - r;
 	m_nodes[proxyId].aabb.upperBound = aabb.upperBound + r;
-	m_nodes[proxyId].userData = userData;
+	m_userData[proxyId] = userData;
+	m_motion[proxyId].Reset();
 	m_nodes[proxyId].height = 0;
 
 	InsertLeaf(proxyId);
@@ -118,6 +206,43 @@ int cb2DynamicTree::CreateProxy(const cb2AABB& aabb, void* userData)
 	return proxyId;
 }
 
+void cb2DynamicTree::CreateProxies(int count, const cb2AABB* aabbs, void** userData, int* proxyIds)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	int leafCount = (m_nodeCount + 1) / 2;
+
+	// Fatten the aabbs.
+	ci::Vec2f r(cb2_aabbExtension, cb2_aabbExtension);
+	for (int i = 0; i < count; ++i)
+	{
+		int proxyId = AllocateNode();
+		m_nodes[proxyId].aabb.lowerBound = aabbs[i].lowerBound - r;
+		m_nodes[proxyId].aabb.upperBound = aabbs[i].upperBound + r;
+		m_userData[proxyId] = userData[i];
+		m_motion[proxyId].Reset();
+		m_nodes[proxyId].height = 0;
+		proxyIds[i] = proxyId;
+	}
+
+	// A rebuild costs about as much as inserting half of the leaves. Smaller
+	// batches are inserted one by one, a subtree over scattered leaves would have
+	// a huge AABB and slow down every query that passes through it.
+	if (2 * count >= leafCount)
+	{
+		RebuildTopDown();
+		return;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		InsertLeaf(proxyIds[i]);
+	}
+}
+
 void cb2DynamicTree::DestroyProxy(int proxyId)
 {
 	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -127,12 +252,63 @@ void cb2DynamicTree::DestroyProxy(int proxyId)
 	FreeNode(proxyId);
 }
 
+void cb2DynamicTree::Clear()
+{
+	cb2Assert(m_shared == false);
+	for (int i = 0; i < m_nodeCapacity - 1; ++i)
+	{
+		m_nodes[i].next = i + 1;
+		m_nodes[i].height = -1;
+	}
+	m_nodes[m_nodeCapacity-1].next = cb2_nullNode;
+	m_nodes[m_nodeCapacity-1].height = -1;
+	m_freeList = 0;
+	m_nodeCount = 0;
+	m_root = cb2_nullNode;
+	++m_version;
+}
+
+void cb2DynamicTree::DestroyProxies(const int* proxyIds, int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	int leafCount = (m_nodeCount + 1) / 2;
+
+	// Unlinking a leaf refits and rotates its whole path to the root. Past the
+	// same break-even as CreateProxies it is cheaper to drop the leaves and
+	// rebuild the survivors.
+	if (2 * count >= leafCount)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			cb2Assert(0 <= proxyIds[i] && proxyIds[i] < m_nodeCapacity);
+			cb2Assert(m_nodes[proxyIds[i]].IsLeaf());
+			FreeNode(proxyIds[i]);
+		}
+
+		RebuildTopDown();
+		return;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		DestroyProxy(proxyIds[i]);
+	}
+}
+
 bool cb2DynamicTree::MoveProxy(int proxyId, const cb2AABB& aabb, const ci::Vec2f& displacement)
 {
+	cb2Assert(m_shared == false);
 	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
 
 	cb2Assert(m_nodes[proxyId].IsLeaf());
 
+	cb2ProxyMotion* motion = m_motion + proxyId;
+	++motion->moveCount;
+
 	if (m_nodes[proxyId].aabb.Contains(aabb))
 	{
 		return false;
@@ -140,42 +316,101 @@ bool cb2DynamicTree::MoveProxy(int proxyId, const cb2AABB& aabb, const ci::Vec2f
 
 	RemoveLeaf(proxyId);
 
-	// Extend AABB.
-	cb2AABB b = aabb;
-	ci::Vec2f r(cb2_aabbExtension, cb2_aabbExtension);
-	b.lowerBound = b.lowerBound - r;
-	b.upperBound = b.upperBound + r;
+	cb2ComputeFatAABB(&m_nodes[proxyId].aabb, aabb, displacement, motion);
 
-	// Predict AABB displacement.
-	ci::Vec2f d = cb2_aabbMultiplier * displacement;
+	InsertLeaf(proxyId);
+	return true;
+}
 
-	if (d.x < 0.0f)
+int cb2DynamicTree::MoveProxies(int* proxyIds, const cb2AABB* aabbs, int count)
+{
+	cb2Assert(m_shared == false);
+	int movedCount = 0;
+	for (int i = 0; i < count; ++i)
 	{
-		b.lowerBound.x += d.x;
+		int proxyId = proxyIds[i];
+		cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+		cb2Assert(m_nodes[proxyId].IsLeaf());
+
+		++m_motion[proxyId].moveCount;
+		if (m_nodes[proxyId].aabb.Contains(aabbs[i]) == false)
+		{
+			++movedCount;
+		}
 	}
-	else
+
+	if (movedCount == 0)
 	{
-		b.upperBound.x += d.x;
+		return 0;
 	}
 
-	if (d.y < 0.0f)
+	// The same break-even as CreateProxies. The leaves keep their place in the
+	// tree until it is rebuilt, so they are only given their new AABBs.
+	int leafCount = (m_nodeCount + 1) / 2;
+	bool rebuild = 2 * movedCount >= leafCount;
+
+	ci::Vec2f displacement(0.0f, 0.0f);
+	movedCount = 0;
+	for (int i = 0; i < count; ++i)
 	{
-		b.lowerBound.y += d.y;
+		int proxyId = proxyIds[i];
+		if (m_nodes[proxyId].aabb.Contains(aabbs[i]))
+		{
+			continue;
+		}
+
+		if (rebuild)
+		{
+			cb2ComputeFatAABB(&m_nodes[proxyId].aabb, aabbs[i], displacement, m_motion + proxyId);
+		}
+		else
+		{
+			RemoveLeaf(proxyId);
+			cb2ComputeFatAABB(&m_nodes[proxyId].aabb, aabbs[i], displacement, m_motion + proxyId);
+			InsertLeaf(proxyId);
+		}
+
+		proxyIds[movedCount++] = proxyId;
 	}
-	else
+
+	if (rebuild)
 	{
-		b.upperBound.y += d.y;
+		RebuildTopDown();
 	}
 
-	m_nodes[proxyId].aabb = b;
+	return movedCount;
+}
 
-	InsertLeaf(proxyId);
-	return true;
+void cb2DynamicTree::SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits)
+{
+	cb2Assert(m_shared == false);
+	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	cb2Assert(m_nodes[proxyId].IsLeaf());
+
+	m_maskBits[proxyId] = maskBits;
+	if (m_nodes[proxyId].categoryBits == categoryBits)
+	{
+		return;
+	}
+
+	m_nodes[proxyId].categoryBits = categoryBits;
+	++m_version;
+
+	// Bits may have been removed, so the ancestors are recomputed.
+	int index = m_nodes[proxyId].parent;
+	while (index != cb2_nullNode)
+	{
+		cb2TreeNode* node = m_nodes + index;
+		node->categoryBits = m_nodes[node->child1].categoryBits | m_nodes[node->child2].categoryBits;
+		index = node->parent;
+	}
 }
 
 void cb2DynamicTree::InsertLeaf(int leaf)
 {
+	cb2Assert(m_shared == false);
 	++m_insertionCount;
+	++m_version;
 
 	if (m_root == cb2_nullNode)
 	{
@@ -261,9 +496,10 @@ void cb2DynamicTree::InsertLeaf(int leaf)
 	int oldParent = m_nodes[sibling].parent;
 	int newParent = AllocateNode();
 	m_nodes[newParent].parent = oldParent;
-	m_nodes[newParent].userData = NULL;
+	m_userData[newParent] = NULL;
 	m_nodes[newParent].aabb.Combine(leafAABB, m_nodes[sibling].aabb);
 	m_nodes[newParent].height = m_nodes[sibling].height + 1;
+	m_nodes[newParent].categoryBits = m_nodes[leaf].categoryBits | m_nodes[sibling].categoryBits;
 
 	if (oldParent != cb2_nullNode)
 	{
@@ -305,6 +541,7 @@ void cb2DynamicTree::InsertLeaf(int leaf)
 		cb2Assert(child2 != cb2_nullNode);
 
 		m_nodes[index].height = 1 + cb2Max(m_nodes[child1].height, m_nodes[child2].height);
+		m_nodes[index].categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
 		m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
 
 		index = m_nodes[index].parent;
@@ -315,6 +552,9 @@ void cb2DynamicTree::InsertLeaf(int leaf)
 
 void cb2DynamicTree::RemoveLeaf(int leaf)
 {
+	cb2Assert(m_shared == false);
+	++m_version;
+
 	if (leaf == m_root)
 	{
 		m_root = cb2_nullNode;
@@ -358,6 +598,7 @@ void cb2DynamicTree::RemoveLeaf(int leaf)
 
 			m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
 			m_nodes[index].height = 1 + cb2Max(m_nodes[child1].height, m_nodes[child2].height);
+			m_nodes[index].categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
 
 			index = m_nodes[index].parent;
 		}
@@ -437,7 +678,9 @@ int cb2DynamicTree::Balance(int iA)
 			C->aabb.Combine(A->aabb, F->aabb);
 
 			A->height = 1 + cb2Max(B->height, G->height);
+			A->categoryBits = B->categoryBits | G->categoryBits;
 			C->height = 1 + cb2Max(A->height, F->height);
+			C->categoryBits = A->categoryBits | F->categoryBits;
 		}
 		else
 		{
@@ -448,7 +691,9 @@ int cb2DynamicTree::Balance(int iA)
 			C->aabb.Combine(A->aabb, G->aabb);
 
 			A->height = 1 + cb2Max(B->height, F->height);
+			A->categoryBits = B->categoryBits | F->categoryBits;
 			C->height = 1 + cb2Max(A->height, G->height);
+			C->categoryBits = A->categoryBits | G->categoryBits;
 		}
 
 		return iC;
@@ -497,7 +742,9 @@ int cb2DynamicTree::Balance(int iA)
 			B->aabb.Combine(A->aabb, D->aabb);
 
 			A->height = 1 + cb2Max(C->height, E->height);
+			A->categoryBits = C->categoryBits | E->categoryBits;
 			B->height = 1 + cb2Max(A->height, D->height);
+			B->categoryBits = A->categoryBits | D->categoryBits;
 		}
 		else
 		{
@@ -508,7 +755,9 @@ int cb2DynamicTree::Balance(int iA)
 			B->aabb.Combine(A->aabb, E->aabb);
 
 			A->height = 1 + cb2Max(C->height, D->height);
+			A->categoryBits = C->categoryBits | D->categoryBits;
 			B->height = 1 + cb2Max(A->height, E->height);
+			B->categoryBits = A->categoryBits | E->categoryBits;
 		}
 
 		return iB;
@@ -646,6 +895,8 @@ void cb2DynamicTree::ValidateMetrics(int index) const
 	cb2Assert(aabb.lowerBound == node->aabb.lowerBound);
 	cb2Assert(aabb.upperBound == node->aabb.upperBound);
 
+	cb2Assert(node->categoryBits == (m_nodes[child1].categoryBits | m_nodes[child2].categoryBits));
+
 	ValidateMetrics(child1);
 	ValidateMetrics(child2);
 }
@@ -691,9 +942,124 @@ int cb2DynamicTree::GetMaxBalance() const
 	return maxBalance;
 }
 
+void cb2DynamicTree::Rebalance(int leafBudget)
+{
+	cb2Assert(m_shared == false);
+	if (m_root == cb2_nullNode || leafBudget < 2)
+	{
+		return;
+	}
+
+	// Descend one bit of the path per level until the subtree is small enough. The
+	// low bits change fastest, so consecutive calls split at the root and sweep
+	// the whole tree before coming back to a subtree.
+	int* leaves = (int*)cb2ReserveScratch(m_allocator, &m_leafScratch, &m_leafScratchSize, leafBudget * sizeof(int));
+	int leafCount = 0;
+	int subtree = m_root;
+	unsigned int bit = 0;
+	for (;;)
+	{
+		leafCount = GatherLeaves(subtree, leaves, leafBudget);
+		if (leafCount <= leafBudget)
+		{
+			break;
+		}
+
+		int child1 = m_nodes[subtree].child1;
+		int child2 = m_nodes[subtree].child2;
+		subtree = ((m_path >> bit) & 1) ? child2 : child1;
+
+		bit = (bit + 1) & 31;
+	}
+
+	++m_path;
+
+	if (leafCount < 3)
+	{
+		// Nothing to improve.
+		return;
+	}
+
+	++m_version;
+
+	// Free the internal nodes of the subtree, then rebuild it over the same leaves.
+	// The bounds of the subtree stay the same, only the heights above change.
+	int parent = m_nodes[subtree].parent;
+	bool isChild1 = parent != cb2_nullNode && m_nodes[parent].child1 == subtree;
+
+	cb2GrowableStack<int, 256> stack;
+	stack.Push(subtree);
+	while (stack.GetCount() > 0)
+	{
+		int nodeId = stack.Pop();
+		if (m_nodes[nodeId].IsLeaf())
+		{
+			continue;
+		}
+
+		stack.Push(m_nodes[nodeId].child1);
+		stack.Push(m_nodes[nodeId].child2);
+		FreeNode(nodeId);
+	}
+
+	int root = BuildTopDown(leaves, leafCount);
+	m_nodes[root].parent = parent;
+	if (parent == cb2_nullNode)
+	{
+		m_root = root;
+	}
+	else if (isChild1)
+	{
+		m_nodes[parent].child1 = root;
+	}
+	else
+	{
+		m_nodes[parent].child2 = root;
+	}
+
+	for (int index = parent; index != cb2_nullNode; index = m_nodes[index].parent)
+	{
+		int child1 = m_nodes[index].child1;
+		int child2 = m_nodes[index].child2;
+		m_nodes[index].height = 1 + cb2Max(m_nodes[child1].height, m_nodes[child2].height);
+		m_nodes[index].categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
+	}
+}
+
+// Store up to capacity leaves of a subtree and return the leaf count, or
+// capacity + 1 if there are more.
+int cb2DynamicTree::GatherLeaves(int nodeId, int* leaves, int capacity) const
+{
+	int count = 0;
+	cb2GrowableStack<int, 256> stack;
+	stack.Push(nodeId);
+	while (stack.GetCount() > 0)
+	{
+		const cb2TreeNode* node = m_nodes + stack.Pop();
+		if (node->IsLeaf() == false)
+		{
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+			continue;
+		}
+
+		if (count == capacity)
+		{
+			return capacity + 1;
+		}
+
+		leaves[count++] = (int)(node - m_nodes);
+	}
+
+	return count;
+}
+
 void cb2DynamicTree::RebuildBottomUp()
 {
-	int* nodes = (int*)cb2Alloc(m_nodeCount * sizeof(int));
+	cb2Assert(m_shared == false);
+	++m_version;
+
+	int* nodes = (int*)cb2Alloc(m_allocator, m_nodeCount * sizeof(int));
 	int count = 0;
 
 	// Build array of leaves. Free the rest.
@@ -750,6 +1116,7 @@ void cb2DynamicTree::RebuildBottomUp()
 		parent->child1 = index1;
 		parent->child2 = index2;
 		parent->height = 1 + cb2Max(child1->height, child2->height);
+		parent->categoryBits = child1->categoryBits | child2->categoryBits;
 		parent->aabb.Combine(child1->aabb, child2->aabb);
 		parent->parent = cb2_nullNode;
 
@@ -762,13 +1129,360 @@ void cb2DynamicTree::RebuildBottomUp()
 	}
 
 	m_root = nodes[0];
-	cb2Free(nodes);
+	cb2Free(m_allocator, nodes);
 
 	Validate();
 }
 
+void cb2DynamicTree::RebuildTopDown()
+{
+	cb2Assert(m_shared == false);
+	if (m_nodeCount == 0)
+	{
+		return;
+	}
+
+	++m_version;
+
+	int* leaves = (int*)cb2ReserveScratch(m_allocator, &m_leafScratch, &m_leafScratchSize, m_nodeCount * sizeof(int));
+	int count = 0;
+
+	// Build array of leaves. Free the rest.
+	for (int i = 0; i < m_nodeCapacity; ++i)
+	{
+		if (m_nodes[i].height < 0)
+		{
+			// free node in pool
+			continue;
+		}
+
+		if (m_nodes[i].IsLeaf())
+		{
+			leaves[count] = i;
+			++count;
+		}
+		else
+		{
+			FreeNode(i);
+		}
+	}
+
+	m_root = count > 0 ? BuildTopDown(leaves, count) : cb2_nullNode;
+}
+
+// Scratch copy of a leaf for the top-down build.
+struct cb2TreeBuildLeaf
+{
+	cb2AABB aabb;
+	ci::Vec2f center;
+	int id;
+	int bin;
+};
+
+// A range of leaves waiting to become the child of a node.
+struct cb2TreeBuildTask
+{
+	int begin;
+	int end;
+	int parent;
+	bool isChild1;
+
+	// Bounds of the leaf centers in the range.
+	cb2AABB centers;
+};
+
+// Build a subtree over the leaves and return its root. The leaves array is reordered.
+int cb2DynamicTree::BuildTopDown(int* leaves, int count)
+{
+	cb2Assert(count > 0);
+
+	if (count == 1)
+	{
+		m_nodes[leaves[0]].parent = cb2_nullNode;
+		return leaves[0];
+	}
+
+	// Partition a compact copy of the leaves, chasing node ids on every level is
+	// dominated by cache misses. A binary tree over count leaves has count - 1
+	// internal nodes, their ids follow the copies.
+	int scratchSize = count * sizeof(cb2TreeBuildLeaf) + (count - 1) * sizeof(int);
+	void* scratch = cb2ReserveScratch(m_allocator, &m_buildScratch, &m_buildScratchSize, scratchSize);
+	cb2TreeBuildLeaf* buildLeaves = (cb2TreeBuildLeaf*)scratch;
+	cb2TreeBuildTask task;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2TreeBuildLeaf* leaf = buildLeaves + i;
+		leaf->aabb = m_nodes[leaves[i]].aabb;
+		leaf->center = leaf->aabb.GetCenter();
+		leaf->id = leaves[i];
+
+		if (i == 0)
+		{
+			task.centers.lowerBound = leaf->center;
+			task.centers.upperBound = leaf->center;
+		}
+		else
+		{
+			task.centers.lowerBound = cb2Min(task.centers.lowerBound, leaf->center);
+			task.centers.upperBound = cb2Max(task.centers.upperBound, leaf->center);
+		}
+	}
+
+	int* internals = (int*)(buildLeaves + count);
+	int internalCount = 0;
+	int root = cb2_nullNode;
+
+	cb2GrowableStack<cb2TreeBuildTask, 64> stack;
+	task.begin = 0;
+	task.end = count;
+	task.parent = cb2_nullNode;
+	task.isChild1 = true;
+	stack.Push(task);
+
+	while (stack.GetCount() > 0)
+	{
+		task = stack.Pop();
+
+		int nodeId;
+		if (task.end - task.begin == 1)
+		{
+			nodeId = buildLeaves[task.begin].id;
+		}
+		else
+		{
+			cb2TreeBuildTask child1, child2;
+			int split = task.begin + PartitionLeaves(buildLeaves + task.begin, task.end - task.begin,
+				task.centers, &child1.centers, &child2.centers);
+
+			nodeId = AllocateNode();
+			internals[internalCount++] = nodeId;
+
+			child2.begin = split;
+			child2.end = task.end;
+			child2.parent = nodeId;
+			child2.isChild1 = false;
+			stack.Push(child2);
+
+			child1.begin = task.begin;
+			child1.end = split;
+			child1.parent = nodeId;
+			child1.isChild1 = true;
+			stack.Push(child1);
+		}
+
+		m_nodes[nodeId].parent = task.parent;
+		if (task.parent == cb2_nullNode)
+		{
+			root = nodeId;
+		}
+		else if (task.isChild1)
+		{
+			m_nodes[task.parent].child1 = nodeId;
+		}
+		else
+		{
+			m_nodes[task.parent].child2 = nodeId;
+		}
+	}
+
+	cb2Assert(internalCount == count - 1);
+
+	// Parents were allocated before their children, so walking backwards
+	// visits the children first.
+	for (int i = internalCount - 1; i >= 0; --i)
+	{
+		cb2TreeNode* node = m_nodes + internals[i];
+		const cb2TreeNode* child1 = m_nodes + node->child1;
+		const cb2TreeNode* child2 = m_nodes + node->child2;
+		node->height = 1 + cb2Max(child1->height, child2->height);
+		node->categoryBits = child1->categoryBits | child2->categoryBits;
+		node->aabb.Combine(child1->aabb, child2->aabb);
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		leaves[i] = buildLeaves[i].id;
+	}
+
+	return root;
+}
+
+// Split the leaves along the longest axis of their centers, at the bin boundary
+// with the smallest surface area heuristic cost. Returns the size of the first
+// half and the center bounds of both halves.
+int cb2DynamicTree::PartitionLeaves(cb2TreeBuildLeaf* leaves, int count, const cb2AABB& centers,
+									cb2AABB* centers1, cb2AABB* centers2)
+{
+	cb2Assert(count > 1);
+
+	if (count == 2)
+	{
+		// Both halves are leaves and their center bounds are not used.
+		return 1;
+	}
+
+	ci::Vec2f extent = centers.upperBound - centers.lowerBound;
+	int axis = extent.x >= extent.y ? 0 : 1;
+	float axisLower = cb2::getElement(centers.lowerBound, axis);
+	float axisExtent = cb2::getElement(extent, axis);
+	if (axisExtent < cb2_epsilon)
+	{
+		// The centers coincide, any split is as good as another.
+		*centers1 = centers;
+		*centers2 = centers;
+		return count / 2;
+	}
+
+	struct cb2TreeBin
+	{
+		cb2AABB aabb;
+		cb2AABB centers;
+		int count;
+	};
+
+	cb2TreeBin bins[cb2_treeBinCount];
+	for (int i = 0; i < cb2_treeBinCount; ++i)
+	{
+		bins[i].count = 0;
+	}
+
+	float scale = cb2_treeBinCount / axisExtent;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2TreeBuildLeaf* leaf = leaves + i;
+		int binIndex = cb2Min(int(scale * (cb2::getElement(leaf->center, axis) - axisLower)), cb2_treeBinCount - 1);
+		leaf->bin = binIndex;
+
+		cb2TreeBin* bin = bins + binIndex;
+		if (bin->count == 0)
+		{
+			bin->aabb = leaf->aabb;
+			bin->centers.lowerBound = leaf->center;
+			bin->centers.upperBound = leaf->center;
+		}
+		else
+		{
+			bin->aabb.Combine(leaf->aabb);
+			bin->centers.lowerBound = cb2Min(bin->centers.lowerBound, leaf->center);
+			bin->centers.upperBound = cb2Max(bin->centers.upperBound, leaf->center);
+		}
+		++bin->count;
+	}
+
+	// Sweep from the right to get the cost of everything right of each plane.
+	// Plane i lies between bins i - 1 and i.
+	float rightCost[cb2_treeBinCount];
+	cb2AABB rightAABB;
+	int rightCount = 0;
+	for (int i = cb2_treeBinCount - 1; i > 0; --i)
+	{
+		if (bins[i].count > 0)
+		{
+			if (rightCount == 0)
+			{
+				rightAABB = bins[i].aabb;
+			}
+			else
+			{
+				rightAABB.Combine(bins[i].aabb);
+			}
+			rightCount += bins[i].count;
+		}
+		rightCost[i] = rightCount > 0 ? rightCount * rightAABB.GetPerimeter() : cb2_maxFloat;
+	}
+
+	// Sweep from the left and keep the cheapest plane.
+	float minCost = cb2_maxFloat;
+	int bestPlane = 0;
+	cb2AABB leftAABB;
+	int leftCount = 0;
+	for (int i = 1; i < cb2_treeBinCount; ++i)
+	{
+		if (bins[i - 1].count > 0)
+		{
+			if (leftCount == 0)
+			{
+				leftAABB = bins[i - 1].aabb;
+			}
+			else
+			{
+				leftAABB.Combine(bins[i - 1].aabb);
+			}
+			leftCount += bins[i - 1].count;
+		}
+
+		if (leftCount == 0 || leftCount == count)
+		{
+			continue;
+		}
+
+		float cost = leftCount * leftAABB.GetPerimeter() + rightCost[i];
+		if (cost < minCost)
+		{
+			minCost = cost;
+			bestPlane = i;
+		}
+	}
+
+	cb2Assert(bestPlane > 0);
+
+	// Gather the center bounds of both halves from the bins.
+	bool empty1 = true;
+	bool empty2 = true;
+	for (int i = 0; i < cb2_treeBinCount; ++i)
+	{
+		if (bins[i].count == 0)
+		{
+			continue;
+		}
+
+		bool& empty = i < bestPlane ? empty1 : empty2;
+		cb2AABB* bounds = i < bestPlane ? centers1 : centers2;
+		if (empty)
+		{
+			*bounds = bins[i].centers;
+			empty = false;
+		}
+		else
+		{
+			bounds->Combine(bins[i].centers);
+		}
+	}
+
+	// Partition in place.
+	int i = 0;
+	int j = count - 1;
+	for (;;)
+	{
+		while (i <= j && leaves[i].bin < bestPlane)
+		{
+			++i;
+		}
+
+		while (i <= j && leaves[j].bin >= bestPlane)
+		{
+			--j;
+		}
+
+		if (i >= j)
+		{
+			break;
+		}
+
+		cb2Swap(leaves[i], leaves[j]);
+		++i;
+		--j;
+	}
+
+	cb2Assert(0 < i && i < count);
+	return i;
+}
+
 void cb2DynamicTree::ShiftOrigin(const ci::Vec2f& newOrigin)
 {
+	cb2Assert(m_shared == false);
+	++m_version;
+
 	// Build array of leaves. Free the rest.
 	for (int i = 0; i < m_nodeCapacity; ++i)
 	{
@@ -776,3 +1490,175 @@ void cb2DynamicTree::ShiftOrigin(const ci::Vec2f& newOrigin)
 		m_nodes[i].aabb.upperBound -= newOrigin;
 	}
 }
+
+void cb2DynamicTree::Save(cb2Snapshot* snapshot) const
+{
+	snapshot->Write(m_nodeCapacity);
+	snapshot->Write(m_nodeCount);
+	snapshot->Write(m_root);
+	snapshot->Write(m_freeList);
+	snapshot->Write(m_path);
+	snapshot->Write(m_insertionCount);
+	snapshot->Write(m_nodes, m_nodeCapacity * sizeof(cb2TreeNode));
+	snapshot->Write(m_motion, m_nodeCapacity * sizeof(cb2ProxyMotion));
+	snapshot->Write(m_maskBits, m_nodeCapacity * sizeof(unsigned short));
+}
+
+// Check that the nodes form a tree from root plus a free list, together holding
+// every node once. With each child pointing back to its parent the walk from the
+// root cannot visit a node twice, so counting the nodes is enough.
+static bool cb2CheckLinks(const cb2TreeNode* nodes, int capacity, int nodeCount, int root, int freeList)
+{
+	int count = 0;
+	if (root != cb2_nullNode)
+	{
+		if (nodes[root].parent != cb2_nullNode)
+		{
+			return false;
+		}
+
+		cb2GrowableStack<int, 256> stack;
+		stack.Push(root);
+		while (stack.GetCount() > 0)
+		{
+			int index = stack.Pop();
+			const cb2TreeNode* node = nodes + index;
+			if (++count > nodeCount)
+			{
+				return false;
+			}
+
+			int child1 = node->child1;
+			int child2 = node->child2;
+			if (child1 == cb2_nullNode)
+			{
+				if (child2 != cb2_nullNode || node->height != 0)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if (child1 < 0 || child1 >= capacity || child2 < 0 || child2 >= capacity || child1 == child2)
+			{
+				return false;
+			}
+
+			const cb2TreeNode* node1 = nodes + child1;
+			const cb2TreeNode* node2 = nodes + child2;
+			if (node1->parent != index || node2->parent != index ||
+				node1->height < 0 || node2->height < 0 ||
+				node->height != 1 + cb2Max(node1->height, node2->height))
+			{
+				return false;
+			}
+
+			stack.Push(child1);
+			stack.Push(child2);
+		}
+	}
+
+	if (count != nodeCount)
+	{
+		return false;
+	}
+
+	// The free list holds the rest, a cycle never reaches the end of the list.
+	int freeCount = capacity - nodeCount;
+	int index = freeList;
+	for (int i = 0; i < freeCount; ++i)
+	{
+		if (index == cb2_nullNode || nodes[index].height != -1)
+		{
+			return false;
+		}
+
+		index = nodes[index].next;
+		if (index < cb2_nullNode || index >= capacity)
+		{
+			return false;
+		}
+	}
+
+	return index == cb2_nullNode;
+}
+
+bool cb2DynamicTree::Load(cb2Snapshot* snapshot)
+{
+	int capacity = snapshot->ReadCount(sizeof(cb2TreeNode));
+	int nodeCount = snapshot->Read<int>();
+	int root = snapshot->Read<int>();
+	int freeList = snapshot->Read<int>();
+	unsigned int path = snapshot->Read<unsigned int>();
+	int insertionCount = snapshot->Read<int>();
+	if (snapshot->IsValid() == false || capacity == 0 || nodeCount < 0 || nodeCount > capacity ||
+		root < cb2_nullNode || root >= capacity || freeList < cb2_nullNode || freeList >= capacity)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	cb2TreeNode* nodes = (cb2TreeNode*)cb2Alloc(m_allocator, capacity * sizeof(cb2TreeNode));
+	cb2ProxyMotion* motion = (cb2ProxyMotion*)cb2Alloc(m_allocator, capacity * sizeof(cb2ProxyMotion));
+	unsigned short* maskBits = (unsigned short*)cb2Alloc(m_allocator, capacity * sizeof(unsigned short));
+	snapshot->Read(nodes, capacity * sizeof(cb2TreeNode));
+	snapshot->Read(motion, capacity * sizeof(cb2ProxyMotion));
+	snapshot->Read(maskBits, capacity * sizeof(unsigned short));
+
+	// The traversals trust the links, so a corrupt snapshot must not get through.
+	if (snapshot->IsValid() && cb2CheckLinks(nodes, capacity, nodeCount, root, freeList) == false)
+	{
+		snapshot->Invalidate();
+	}
+
+	if (snapshot->IsValid() == false)
+	{
+		cb2Free(m_allocator, nodes);
+		cb2Free(m_allocator, motion);
+		cb2Free(m_allocator, maskBits);
+		return false;
+	}
+
+	FreePool();
+	m_shared = false;
+
+	m_nodes = nodes;
+	m_motion = motion;
+	m_maskBits = maskBits;
+	m_userData = (void**)cb2Alloc(m_allocator, capacity * sizeof(void*));
+	memset(m_userData, 0, capacity * sizeof(void*));
+
+	m_nodeCapacity = capacity;
+	m_nodeCount = nodeCount;
+	m_root = root;
+	m_freeList = freeList;
+	m_path = path;
+	m_insertionCount = insertionCount;
+
+	// The wide trees built from the old nodes are stale now.
+	++m_version;
+	return true;
+}
+
+void cb2DynamicTree::Share(const cb2DynamicTree* tree)
+{
+	cb2Assert(tree != this && tree->m_shared == false);
+	FreePool();
+	m_shared = true;
+
+	m_nodes = tree->m_nodes;
+	m_motion = tree->m_motion;
+	m_maskBits = tree->m_maskBits;
+	m_userData = (void**)cb2Alloc(m_allocator, tree->m_nodeCapacity * sizeof(void*));
+	memset(m_userData, 0, tree->m_nodeCapacity * sizeof(void*));
+
+	m_nodeCapacity = tree->m_nodeCapacity;
+	m_nodeCount = tree->m_nodeCount;
+	m_root = tree->m_root;
+	m_freeList = tree->m_freeList;
+	m_path = tree->m_path;
+	m_insertionCount = tree->m_insertionCount;
+
+	// The wide trees built from the old nodes are stale now.
+	++m_version;
+}
@@ -24,7 +24,12 @@
 
 #define cb2_nullNode (-1)
 
+struct cb2TreeBuildLeaf;
+class cb2Snapshot;
+
 /// A node in the dynamic tree. The client does not interact with this directly.
+/// The user data lives in a separate array so a node is 32 bytes and two nodes
+/// share a cache line during traversal.
 struct cb2TreeNode
 {
 	bool IsLeaf() const
@@ -35,8 +40,6 @@ struct cb2TreeNode
 	/// Enlarged AABB
 	cb2AABB aabb;
 
-	void* userData;
-
 	union
 	{
 		int parent;
@@ -47,7 +50,11 @@ struct cb2TreeNode
 	int child2;
 
 	// leaf = 0, free node = -1
-	int height;
+	short height;
+
+	// The category bits of a leaf, the union of those of the leaves below otherwise,
+	// so queries can skip subtrees that do not match their mask.
+	unsigned short categoryBits;
 };
 
 /// A dynamic AABB tree broad-phase, inspired by Nathanael Presson's btDbvt.
@@ -62,7 +69,8 @@ class cb2DynamicTree
 {
 public:
 	/// Constructing the tree initializes the node pool.
-	cb2DynamicTree();
+	/// @param allocator where the node pool lives, NULL for cb2Alloc.
+	cb2DynamicTree(cb2AllocatorInterface* allocator = NULL);
 
 	/// Destroy the tree, freeing the node pool.
 	~cb2DynamicTree();
@@ -70,15 +78,41 @@ public:
 	/// Create a proxy. Provide a tight fitting AABB and a userData pointer.
 	int CreateProxy(const cb2AABB& aabb, void* userData);
 
+	/// Create many proxies at once. If the batch is big compared to the tree, the
+	/// whole tree is rebuilt top-down with a binned SAH, which is much faster than
+	/// inserting the proxies one by one and gives a better tree.
+	/// @param count the number of proxies.
+	/// @param aabbs the tight fitting AABBs, one per proxy.
+	/// @param userData the user data, one per proxy.
+	/// @param proxyIds receives the proxy ids, one per proxy.
+	void CreateProxies(int count, const cb2AABB* aabbs, void** userData, int* proxyIds);
+
 	/// Destroy a proxy. This asserts if the id is invalid.
 	void DestroyProxy(int proxyId);
 
+	/// Destroy many proxies at once. If the batch is big compared to the tree, the
+	/// leaves are freed without unlinking them and the rest of the tree is rebuilt
+	/// top-down, like CreateProxies.
+	void DestroyProxies(const int* proxyIds, int count);
+
+	/// Destroy all proxies, keeping the node pool.
+	void Clear();
+
 	/// Move a proxy with a swepted AABB. If the proxy has moved outside of its fattened AABB,
 	/// then the proxy is removed from the tree and re-inserted. Otherwise
 	/// the function returns immediately.
 	/// @return true if the proxy was re-inserted.
 	bool MoveProxy(int proxyId, const cb2AABB& aabb1, const ci::Vec2f& displacement);
 
+	/// Move many proxies at once without a displacement, as when they are teleported.
+	/// The proxies that left their fattened AABB are re-inserted. If they are many
+	/// compared to the tree, the whole tree is rebuilt top-down instead, like
+	/// CreateProxies.
+	/// @param proxyIds the proxies, on return the re-inserted ones come first in order.
+	/// @param aabbs the tight fitting AABBs, one per proxy.
+	/// @return the number of re-inserted proxies.
+	int MoveProxies(int* proxyIds, const cb2AABB* aabbs, int count);
+
 	/// Get proxy user data.
 	/// @return the proxy user data or 0 if the id is invalid.
 	void* GetUserData(int proxyId) const;
@@ -86,10 +120,26 @@ public:
 	/// Get the fat AABB for a proxy.
 	const cb2AABB& GetFatAABB(int proxyId) const;
 
+	/// Get the AABB of the root, which holds the fat AABBs of all proxies. The tree
+	/// must not be empty.
+	const cb2AABB& GetRootAABB() const;
+
+	/// Get how often a proxy moved out of its fat AABB.
+	int GetReinsertCount(int proxyId) const;
+
+	/// Set the collision filter of a proxy, see cb2Filter. The category bits are
+	/// what queries test their mask against, the mask bits are stored for the
+	/// queries of this proxy. Both are 0xFFFF for a new proxy.
+	void SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits);
+
+	/// Get the mask bits of a proxy.
+	unsigned short GetMaskBits(int proxyId) const;
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
+	/// @param maskBits skip the proxies that have none of these category bits.
 	template <typename T>
-	void Query(T* callback, const cb2AABB& aabb) const;
+	void Query(T* callback, const cb2AABB& aabb, unsigned short maskBits = 0xFFFF) const;
 
 	/// Ray-cast against the proxies in the tree. This relies on the callback
 	/// to perform a exact ray-cast in the case were the proxy contains a shape.
@@ -98,8 +148,18 @@ public:
 	/// number of proxies in the tree.
 	/// @param input the ray-cast input data. The ray extends from p1 to p1 + maxFraction * (p2 - p1).
 	/// @param callback a callback class that is called for each proxy that is hit by the ray.
+	/// @param maskBits skip the proxies that have none of these category bits.
 	template <typename T>
-	void RayCast(T* callback, const cb2RayCastInput& input) const;
+	void RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits = 0xFFFF) const;
+
+	/// Sweep an AABB through the tree. This is a ray-cast of the box center against
+	/// the proxies grown by the box extents. The callback performs the exact shape
+	/// cast and the filtering, it gets the current maximum fraction of the translation
+	/// and returns the new one: 0 terminates, the current value continues unchanged.
+	/// @param aabb the box at the start of the sweep.
+	/// @param translation the sweep, it must not be zero.
+	template <typename T>
+	void ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const;
 
 	/// Validate this tree. For testing.
 	void Validate() const;
@@ -115,48 +175,135 @@ public:
 	/// Get the ratio of the sum of the node areas to the root area.
 	float GetAreaRatio() const;
 
+	/// Improve the tree a little by rebuilding one small subtree with the binned
+	/// SAH of RebuildTopDown. Each call walks down from the root to a different
+	/// subtree, so the whole tree is covered over time. Cheap enough to call
+	/// every step.
+	/// @param leafBudget the most leaves the rebuilt subtree may have.
+	void Rebalance(int leafBudget);
+
 	/// Build an optimal tree. Very expensive. For testing.
 	void RebuildBottomUp();
 
+	/// Rebuild the tree top-down with a binned SAH. This is O(n log n) and gives
+	/// a tree of similar quality to incremental insertion. The scratch memory of
+	/// the build is kept for the next one, so rebuilds of a steady size do not
+	/// allocate.
+	void RebuildTopDown();
+
+	/// Free the scratch memory kept by the rebuilds, for trees that are built once.
+	void FreeScratch();
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
 	void ShiftOrigin(const ci::Vec2f& newOrigin);
 
+	/// Get a counter that changes whenever the structure or the bounds of the tree
+	/// change. Derived structures such as cb2WideTree use it to tell if they are stale.
+	unsigned int GetVersion() const { return m_version; }
+
+	/// Save the nodes as they are, without the user data.
+	void Save(cb2Snapshot* snapshot) const;
+
+	/// Replace the nodes by saved ones, keeping the proxy ids. The user data of
+	/// the proxies is NULL until it is set again. Returns false for a bad snapshot,
+	/// the tree is unchanged then.
+	bool Load(cb2Snapshot* snapshot);
+
+	/// Set the user data of a proxy, for proxies that were loaded.
+	void SetUserData(int proxyId, void* userData);
+
+	/// Use the nodes of another tree instead of nodes of its own, so many trees can
+	/// hold the same proxies with user data of their own. The other tree must outlive
+	/// this one and stay unchanged. A sharing tree cannot be changed either, only its
+	/// user data, until Load gives it nodes of its own again.
+	void Share(const cb2DynamicTree* tree);
+
+	/// Does this tree use the nodes of another one?
+	bool IsShared() const { return m_shared; }
+
+	/// Get the size of the node pool, every proxy id is below it.
+	int GetNodeCapacity() const { return m_nodeCapacity; }
+
+	/// Is the id one of a proxy, a leaf of the tree? Ids from a snapshot are checked with this.
+	bool IsProxy(int proxyId) const
+	{
+		return 0 <= proxyId && proxyId < m_nodeCapacity && m_nodes[proxyId].height == 0;
+	}
+
+	/// Get the number of proxies, a tree of n proxies uses 2n - 1 nodes.
+	int GetProxyCount() const { return m_root == cb2_nullNode ? 0 : (m_nodeCount + 1) / 2; }
+
+	/// Grow the node pool to hold at least this many nodes, so creating proxies does not
+	/// have to copy the pool later. A tree of n proxies uses 2n - 1 nodes.
+	void Reserve(int nodeCount);
+
 private:
 
+	friend class cb2WideTree;
+
 	int AllocateNode();
 	void FreeNode(int node);
+	void GrowPool(int capacity);
+	void FreePool();
 
 	void InsertLeaf(int node);
 	void RemoveLeaf(int node);
 
 	int Balance(int index);
 
+	int BuildTopDown(int* leaves, int count);
+	int GatherLeaves(int nodeId, int* leaves, int capacity) const;
+	static int PartitionLeaves(cb2TreeBuildLeaf* leaves, int count, const cb2AABB& centers,
+							   cb2AABB* centers1, cb2AABB* centers2);
+
 	int ComputeHeight() const;
 	int ComputeHeight(int nodeId) const;
 
 	void ValidateStructure(int index) const;
 	void ValidateMetrics(int index) const;
 
+	cb2AllocatorInterface* m_allocator;
+
 	int m_root;
 
 	cb2TreeNode* m_nodes;
+	void** m_userData;
+	cb2ProxyMotion* m_motion;
+	unsigned short* m_maskBits;
 	int m_nodeCount;
 	int m_nodeCapacity;
 
 	int m_freeList;
 
+	/// Grow-only scratch of the top-down builds: the leaf ids of the callers, and
+	/// the leaf copies and internal nodes of BuildTopDown.
+	void* m_leafScratch;
+	int m_leafScratchSize;
+	void* m_buildScratch;
+	int m_buildScratchSize;
+
 	/// This is used to incrementally traverse the tree for re-balancing.
 	unsigned int m_path;
 
 	int m_insertionCount;
+
+	unsigned int m_version;
+
+	bool m_shared;
 };
 
 inline void* cb2DynamicTree::GetUserData(int proxyId) const
 {
 	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
-	return m_nodes[proxyId].userData;
+	return m_userData[proxyId];
+}
+
+inline void cb2DynamicTree::SetUserData(int proxyId, void* userData)
+{
+	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	m_userData[proxyId] = userData;
 }
 
 inline const cb2AABB& cb2DynamicTree::GetFatAABB(int proxyId) const
@@ -165,8 +312,26 @@ inline const cb2AABB& cb2DynamicTree::GetFatAABB(int proxyId) const
 	return m_nodes[proxyId].aabb;
 }
 
+inline const cb2AABB& cb2DynamicTree::GetRootAABB() const
+{
+	cb2Assert(m_root != cb2_nullNode);
+	return m_nodes[m_root].aabb;
+}
+
+inline int cb2DynamicTree::GetReinsertCount(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	return m_motion[proxyId].reinsertCount;
+}
+
+inline unsigned short cb2DynamicTree::GetMaskBits(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	return m_maskBits[proxyId];
+}
+
 template <typename T>
-inline void cb2DynamicTree::Query(T* callback, const cb2AABB& aabb) const
+inline void cb2DynamicTree::Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
 {
 	cb2GrowableStack<int, 256> stack;
 	stack.Push(m_root);
@@ -181,7 +346,7 @@ inline void cb2DynamicTree::Query(T* callback, const cb2AABB& aabb) const
 
 		const cb2TreeNode* node = m_nodes + nodeId;
 
-		if (cb2TestOverlap(node->aabb, aabb))
+		if ((node->categoryBits & maskBits) != 0 && cb2TestOverlap(node->aabb, aabb))
 		{
 			if (node->IsLeaf())
 			{
@@ -201,7 +366,7 @@ inline void cb2DynamicTree::Query(T* callback, const cb2AABB& aabb) const
 }
 
 template <typename T>
-inline void cb2DynamicTree::RayCast(T* callback, const cb2RayCastInput& input) const
+inline void cb2DynamicTree::RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const
 {
 	ci::Vec2f p1 = input.p1;
 	ci::Vec2f p2 = input.p2;
@@ -239,7 +404,7 @@ inline void cb2DynamicTree::RayCast(T* callback, const cb2RayCastInput& input) c
 
 		const cb2TreeNode* node = m_nodes + nodeId;
 
-		if (cb2TestOverlap(node->aabb, segmentAABB) == false)
+		if ((node->categoryBits & maskBits) == 0 || cb2TestOverlap(node->aabb, segmentAABB) == false)
 		{
 			continue;
 		}
@@ -286,4 +451,81 @@ inline void cb2DynamicTree::RayCast(T* callback, const cb2RayCastInput& input) c
 	}
 }
 
+template <typename T>
+inline void cb2DynamicTree::ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const
+{
+	ci::Vec2f p1 = aabb.GetCenter();
+	ci::Vec2f extension = aabb.GetExtents();
+	ci::Vec2f r = translation;
+	cb2Assert(r.lengthSquared() > 0.0f);
+	r.normalize();
+
+	// v is perpendicular to the segment.
+	ci::Vec2f v = cb2Cross(1.0f, r);
+	ci::Vec2f abs_v = cb2Abs(v);
+
+	float maxFraction = 1.0f;
+
+	// Build a bounding box for the swept box.
+	cb2AABB sweptAABB;
+	{
+		ci::Vec2f t = p1 + maxFraction * translation;
+		sweptAABB.lowerBound = cb2Min(p1, t) - extension;
+		sweptAABB.upperBound = cb2Max(p1, t) + extension;
+	}
+
+	cb2GrowableStack<int, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int nodeId = stack.Pop();
+		if (nodeId == cb2_nullNode)
+		{
+			continue;
+		}
+
+		const cb2TreeNode* node = m_nodes + nodeId;
+
+		if (cb2TestOverlap(node->aabb, sweptAABB) == false)
+		{
+			continue;
+		}
+
+		// Separating axis for the segment against the grown node box.
+		ci::Vec2f c = node->aabb.GetCenter();
+		ci::Vec2f h = node->aabb.GetExtents() + extension;
+		float separation = cb2Abs(cb2Dot(v, p1 - c)) - cb2Dot(abs_v, h);
+		if (separation > 0.0f)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf())
+		{
+			float value = callback->ShapeCastCallback(maxFraction, nodeId);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the shape cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update the swept bounding box.
+				maxFraction = value;
+				ci::Vec2f t = p1 + maxFraction * translation;
+				sweptAABB.lowerBound = cb2Min(p1, t) - extension;
+				sweptAABB.upperBound = cb2Max(p1, t) + extension;
+			}
+		}
+		else
+		{
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+		}
+	}
+}
+
 #endif
@@ -24,10 +24,13 @@
 #include <CinderBox2D/Common/cb2Timer.h>
 
 #include <stdio.h>
+#include <atomic>
 
-float cb2_toiTime, cb2_toiMaxTime;
-int cb2_toiCalls, cb2_toiIters, cb2_toiMaxIters;
-int cb2_toiRootIters, cb2_toiMaxRootIters;
+// TOI profiling counters. The world computes TOIs in parallel, so these are
+// relaxed atomics and the maxima and total time are only approximate.
+std::atomic<float> cb2_toiTime, cb2_toiMaxTime;
+std::atomic<int> cb2_toiCalls, cb2_toiIters, cb2_toiMaxIters;
+std::atomic<int> cb2_toiRootIters, cb2_toiMaxRootIters;
 
 //
 struct cb2SeparationFunction
@@ -250,16 +253,24 @@ struct cb2SeparationFunction
 	ci::Vec2f m_axis;
 };
 
+void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
+{
+	cb2SimplexCache cache;
+	cache.count = 0;
+	cb2TimeOfImpact(output, input, &cache);
+}
+
 // CCD via the local separating axis method. This seeks progression
 // by computing the largest time at which separation is maintained.
-void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
+void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input, cb2SimplexCache* cache)
 {
 	cb2Timer timer;
 
-	++cb2_toiCalls;
+	cb2_toiCalls.fetch_add(1, std::memory_order_relaxed);
 
 	output->state = cb2TOIOutput::e_unknown;
 	output->t = input->tMax;
+	output->iterations = 0;
 
 	const cb2DistanceProxy* proxyA = &input->proxyA;
 	const cb2DistanceProxy* proxyB = &input->proxyB;
@@ -283,9 +294,7 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 	const int k_maxIterations = 20;	// TODO_ERIN cb2Settings
 	int iter = 0;
 
-	// Prepare input for distance query.
-	cb2SimplexCache cache;
-	cache.count = 0;
+	// Prepare input for distance query. A stale cache is flushed by cb2Distance.
 	cb2DistanceInput distanceInput;
 	distanceInput.proxyA = input->proxyA;
 	distanceInput.proxyB = input->proxyB;
@@ -304,7 +313,7 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 		distanceInput.transformA = xfA;
 		distanceInput.transformB = xfB;
 		cb2DistanceOutput distanceOutput;
-		cb2Distance(&distanceOutput, &cache, &distanceInput);
+		cb2Distance(&distanceOutput, cache, &distanceInput);
 
 		// If the shapes are overlapped, we give up on continuous collision.
 		if (distanceOutput.distance <= 0.0f)
@@ -325,7 +334,7 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 
 		// Initialize the separating axis.
 		cb2SeparationFunction fcn;
-		fcn.Initialize(&cache, proxyA, sweepA, proxyB, sweepB, t1);
+		fcn.Initialize(cache, proxyA, sweepA, proxyB, sweepB, t1);
 #if 0
 		// Dump the curve seen by the root finder
 		{
@@ -423,7 +432,6 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 				}
 
 				++rootIterCount;
-				++cb2_toiRootIters;
 
 				float s = fcn.Evaluate(indexA, indexB, t);
 
@@ -452,7 +460,11 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 				}
 			}
 
-			cb2_toiMaxRootIters = cb2Max(cb2_toiMaxRootIters, rootIterCount);
+			cb2_toiRootIters.fetch_add(rootIterCount, std::memory_order_relaxed);
+			if (rootIterCount > cb2_toiMaxRootIters.load(std::memory_order_relaxed))
+			{
+				cb2_toiMaxRootIters.store(rootIterCount, std::memory_order_relaxed);
+			}
 
 			++pushBackIter;
 
@@ -463,7 +475,6 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 		}
 
 		++iter;
-		++cb2_toiIters;
 
 		if (done)
 		{
@@ -479,9 +490,17 @@ void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input)
 		}
 	}
 
-	cb2_toiMaxIters = cb2Max(cb2_toiMaxIters, iter);
+	output->iterations = iter;
+	cb2_toiIters.fetch_add(iter, std::memory_order_relaxed);
+	if (iter > cb2_toiMaxIters.load(std::memory_order_relaxed))
+	{
+		cb2_toiMaxIters.store(iter, std::memory_order_relaxed);
+	}
 
 	float time = timer.GetMilliseconds();
-	cb2_toiMaxTime = cb2Max(cb2_toiMaxTime, time);
-	cb2_toiTime += time;
+	if (time > cb2_toiMaxTime.load(std::memory_order_relaxed))
+	{
+		cb2_toiMaxTime.store(time, std::memory_order_relaxed);
+	}
+	cb2_toiTime.store(cb2_toiTime.load(std::memory_order_relaxed) + time, std::memory_order_relaxed);
 }
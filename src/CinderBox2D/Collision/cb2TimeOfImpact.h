@@ -46,6 +46,7 @@ struct cb2TOIOutput
 
 	State state;
 	float t;
+	int iterations;	///< number of root finder iterations used
 };
 
 /// Compute the upper bound on time before two shapes penetrate. Time is represented as
@@ -55,4 +56,9 @@ struct cb2TOIOutput
 /// Note: use cb2Distance to compute the contact point and normal at the time of impact.
 void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input);
 
+/// Same as above with a simplex cache that warm starts the distance queries. On return
+/// the cache holds the last simplex, keep it per shape pair from step to step. Use a
+/// count of zero the first time.
+void cb2TimeOfImpact(cb2TOIOutput* output, const cb2TOIInput* input, cb2SimplexCache* cache);
+
 #endif
@@ -0,0 +1,548 @@
+/*
+* Copyright (c) 2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Collision/cb2UniformGrid.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <memory.h>
+
+cb2UniformGrid::cb2UniformGrid(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
+
+	m_cellSize = 1.0f;
+	m_inverseCellSize = 1.0f;
+
+	m_proxyCapacity = 16;
+	m_proxyCount = 0;
+	m_proxies = (cb2GridProxy*)cb2Alloc(m_allocator, m_proxyCapacity * sizeof(cb2GridProxy));
+	memset((void*)m_proxies, 0, m_proxyCapacity * sizeof(cb2GridProxy));
+
+	// Build a linked list for the free list.
+	for (int i = 0; i < m_proxyCapacity - 1; ++i)
+	{
+		m_proxies[i].next = i + 1;
+	}
+	m_proxies[m_proxyCapacity-1].next = e_nullProxy;
+	m_freeList = 0;
+
+	m_bucketCount = 64;
+	m_buckets = (cb2GridBucket*)cb2Alloc(m_allocator, m_bucketCount * sizeof(cb2GridBucket));
+	memset(m_buckets, 0, m_bucketCount * sizeof(cb2GridBucket));
+	m_cellCount = 0;
+
+	m_largeCapacity = 4;
+	m_largeCount = 0;
+	m_largeProxies = (int*)cb2Alloc(m_allocator, m_largeCapacity * sizeof(int));
+}
+
+cb2UniformGrid::~cb2UniformGrid()
+{
+	for (int i = 0; i < m_bucketCount; ++i)
+	{
+		cb2Free(m_allocator, m_buckets[i].proxyIds);
+	}
+	cb2Free(m_allocator, m_buckets);
+	cb2Free(m_allocator, m_largeProxies);
+	cb2Free(m_allocator, m_proxies);
+}
+
+void cb2UniformGrid::SetCellSize(float cellSize)
+{
+	cb2Assert(m_proxyCount == 0);
+	cb2Assert(cellSize > 0.0f);
+	m_cellSize = cellSize;
+	m_inverseCellSize = 1.0f / cellSize;
+}
+
+// Grow the proxy pool, adding the new proxies to the front of the free list.
+void cb2UniformGrid::GrowPool(int capacity)
+{
+	cb2Assert(capacity > m_proxyCapacity);
+
+	int oldCapacity = m_proxyCapacity;
+	m_proxyCapacity = capacity;
+
+	cb2GridProxy* oldProxies = m_proxies;
+	m_proxies = (cb2GridProxy*)cb2Alloc(m_allocator, m_proxyCapacity * sizeof(cb2GridProxy));
+	memcpy(m_proxies, oldProxies, oldCapacity * sizeof(cb2GridProxy));
+	memset((void*)(m_proxies + oldCapacity), 0, (m_proxyCapacity - oldCapacity) * sizeof(cb2GridProxy));
+	cb2Free(m_allocator, oldProxies);
+
+	// Build a linked list for the free list.
+	for (int i = oldCapacity; i < m_proxyCapacity - 1; ++i)
+	{
+		m_proxies[i].next = i + 1;
+	}
+	m_proxies[m_proxyCapacity-1].next = m_freeList;
+	m_freeList = oldCapacity;
+}
+
+void cb2UniformGrid::Reserve(int proxyCount)
+{
+	if (proxyCount > m_proxyCapacity)
+	{
+		GrowPool(proxyCount);
+	}
+
+	// With cells about twice the proxy size a proxy is listed in up to four cells.
+	int bucketCount = m_bucketCount;
+	while (2 * bucketCount < 4 * proxyCount)
+	{
+		bucketCount *= 2;
+	}
+
+	if (bucketCount != m_bucketCount)
+	{
+		Rehash(bucketCount);
+	}
+}
+
+int cb2UniformGrid::CreateProxy(const cb2AABB& aabb, void* userData)
+{
+	// Expand the proxy pool as needed.
+	if (m_freeList == e_nullProxy)
+	{
+		cb2Assert(m_proxyCount == m_proxyCapacity);
+
+		// The free list is empty. Rebuild a bigger pool.
+		GrowPool(2 * m_proxyCapacity);
+	}
+
+	// Peel a proxy off the free list.
+	int proxyId = m_freeList;
+	cb2GridProxy* proxy = m_proxies + proxyId;
+	m_freeList = proxy->next;
+	++m_proxyCount;
+
+	// Fatten the aabb.
+	ci::Vec2f r(cb2_aabbExtension, cb2_aabbExtension);
+	proxy->aabb.lowerBound = aabb.lowerBound - r;
+	proxy->aabb.upperBound = aabb.upperBound + r;
+	proxy->userData = userData;
+	proxy->categoryBits = 0xFFFF;
+	proxy->maskBits = 0xFFFF;
+	proxy->motion.Reset();
+
+	InsertProxy(proxyId);
+
+	return proxyId;
+}
+
+void cb2UniformGrid::DestroyProxy(int proxyId)
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	cb2Assert(m_proxies[proxyId].next == e_usedProxy || m_proxies[proxyId].next == e_largeProxy);
+
+	RemoveProxy(proxyId);
+
+	// Return the proxy to the pool.
+	m_proxies[proxyId].next = m_freeList;
+	m_proxies[proxyId].userData = NULL;
+	m_freeList = proxyId;
+	--m_proxyCount;
+}
+
+bool cb2UniformGrid::MoveProxy(int proxyId, const cb2AABB& aabb, const ci::Vec2f& displacement)
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+
+	cb2GridProxy* proxy = m_proxies + proxyId;
+	cb2Assert(proxy->next == e_usedProxy || proxy->next == e_largeProxy);
+
+	++proxy->motion.moveCount;
+
+	if (proxy->aabb.Contains(aabb))
+	{
+		return false;
+	}
+
+	RemoveProxy(proxyId);
+
+	cb2ComputeFatAABB(&proxy->aabb, aabb, displacement, &proxy->motion);
+
+	InsertProxy(proxyId);
+	return true;
+}
+
+void cb2UniformGrid::InsertProxy(int proxyId)
+{
+	PlaceProxy(proxyId);
+
+	// Keep the buckets short.
+	if (m_cellCount > 2 * m_bucketCount)
+	{
+		Rehash(2 * m_bucketCount);
+	}
+}
+
+// List the proxy in the cells of its fat AABB, or with the large proxies.
+void cb2UniformGrid::PlaceProxy(int proxyId)
+{
+	cb2GridProxy* proxy = m_proxies + proxyId;
+	proxy->lowerX = ComputeCell(proxy->aabb.lowerBound.x);
+	proxy->lowerY = ComputeCell(proxy->aabb.lowerBound.y);
+	proxy->upperX = ComputeCell(proxy->aabb.upperBound.x);
+	proxy->upperY = ComputeCell(proxy->aabb.upperBound.y);
+
+	float cellCount = (proxy->upperX - proxy->lowerX + 1.0f) * (proxy->upperY - proxy->lowerY + 1.0f);
+	if (cellCount > (float)e_maxProxyCells)
+	{
+		if (m_largeCount == m_largeCapacity)
+		{
+			int* oldProxies = m_largeProxies;
+			m_largeCapacity *= 2;
+			m_largeProxies = (int*)cb2Alloc(m_allocator, m_largeCapacity * sizeof(int));
+			memcpy(m_largeProxies, oldProxies, m_largeCount * sizeof(int));
+			cb2Free(m_allocator, oldProxies);
+		}
+
+		m_largeProxies[m_largeCount] = proxyId;
+		++m_largeCount;
+		proxy->next = e_largeProxy;
+		return;
+	}
+
+	proxy->next = e_usedProxy;
+
+	for (int y = proxy->lowerY; y <= proxy->upperY; ++y)
+	{
+		for (int x = proxy->lowerX; x <= proxy->upperX; ++x)
+		{
+			cb2GridBucket* bucket = m_buckets + GetBucket(x, y);
+
+			// Two cells of the proxy may share a bucket, list it once.
+			bool listed = false;
+			for (int i = 0; i < bucket->count; ++i)
+			{
+				if (bucket->proxyIds[i] == proxyId)
+				{
+					listed = true;
+					break;
+				}
+			}
+
+			if (listed)
+			{
+				continue;
+			}
+
+			if (bucket->count == bucket->capacity)
+			{
+				int* oldProxyIds = bucket->proxyIds;
+				bucket->capacity = cb2Max(2 * bucket->capacity, 4);
+				bucket->proxyIds = (int*)cb2Alloc(m_allocator, bucket->capacity * sizeof(int));
+				if (oldProxyIds)
+				{
+					memcpy(bucket->proxyIds, oldProxyIds, bucket->count * sizeof(int));
+					cb2Free(m_allocator, oldProxyIds);
+				}
+			}
+
+			bucket->proxyIds[bucket->count] = proxyId;
+			++bucket->count;
+			++m_cellCount;
+		}
+	}
+}
+
+void cb2UniformGrid::RemoveProxy(int proxyId)
+{
+	cb2GridProxy* proxy = m_proxies + proxyId;
+
+	if (proxy->next == e_largeProxy)
+	{
+		for (int i = 0; i < m_largeCount; ++i)
+		{
+			if (m_largeProxies[i] == proxyId)
+			{
+				--m_largeCount;
+				m_largeProxies[i] = m_largeProxies[m_largeCount];
+				break;
+			}
+		}
+		return;
+	}
+
+	for (int y = proxy->lowerY; y <= proxy->upperY; ++y)
+	{
+		for (int x = proxy->lowerX; x <= proxy->upperX; ++x)
+		{
+			// The proxy is gone from this bucket if it shares it with another of its cells.
+			cb2GridBucket* bucket = m_buckets + GetBucket(x, y);
+			for (int i = 0; i < bucket->count; ++i)
+			{
+				if (bucket->proxyIds[i] == proxyId)
+				{
+					--bucket->count;
+					bucket->proxyIds[i] = bucket->proxyIds[bucket->count];
+					--m_cellCount;
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Empty the buckets and list all proxies again.
+void cb2UniformGrid::Rehash(int bucketCount)
+{
+	if (bucketCount != m_bucketCount)
+	{
+		for (int i = 0; i < m_bucketCount; ++i)
+		{
+			cb2Free(m_allocator, m_buckets[i].proxyIds);
+		}
+		cb2Free(m_allocator, m_buckets);
+
+		m_bucketCount = bucketCount;
+		m_buckets = (cb2GridBucket*)cb2Alloc(m_allocator, m_bucketCount * sizeof(cb2GridBucket));
+		memset(m_buckets, 0, m_bucketCount * sizeof(cb2GridBucket));
+	}
+	else
+	{
+		for (int i = 0; i < m_bucketCount; ++i)
+		{
+			m_buckets[i].count = 0;
+		}
+	}
+
+	m_cellCount = 0;
+	m_largeCount = 0;
+
+	for (int i = 0; i < m_proxyCapacity; ++i)
+	{
+		int next = m_proxies[i].next;
+		if (next == e_usedProxy || next == e_largeProxy)
+		{
+			PlaceProxy(i);
+		}
+	}
+}
+
+void cb2UniformGrid::ShiftOrigin(const ci::Vec2f& newOrigin)
+{
+	// Shift all AABBs, they move to other cells.
+	for (int i = 0; i < m_proxyCapacity; ++i)
+	{
+		cb2GridProxy* proxy = m_proxies + i;
+		if (proxy->next == e_usedProxy || proxy->next == e_largeProxy)
+		{
+			proxy->aabb.lowerBound -= newOrigin;
+			proxy->aabb.upperBound -= newOrigin;
+		}
+	}
+
+	Rehash(m_bucketCount);
+}
+
+void cb2UniformGrid::Save(cb2Snapshot* snapshot) const
+{
+	snapshot->Write(m_cellSize);
+	snapshot->Write(m_proxyCapacity);
+	snapshot->Write(m_proxyCount);
+	snapshot->Write(m_freeList);
+	snapshot->Write(m_proxies, m_proxyCapacity * sizeof(cb2GridProxy));
+
+	snapshot->Write(m_bucketCount);
+	snapshot->Write(m_cellCount);
+	for (int i = 0; i < m_bucketCount; ++i)
+	{
+		const cb2GridBucket* bucket = m_buckets + i;
+		snapshot->Write(bucket->count);
+		snapshot->Write(bucket->proxyIds, bucket->count * sizeof(int));
+	}
+
+	snapshot->Write(m_largeCount);
+	snapshot->Write(m_largeProxies, m_largeCount * sizeof(int));
+}
+
+// A list of ids of proxies marked with next, NULL if there are none or the snapshot
+// went bad.
+static int* cb2LoadProxyIds(cb2Snapshot* snapshot, cb2AllocatorInterface* allocator, int count,
+							 const cb2GridProxy* proxies, int proxyCapacity, int next)
+{
+	if (count == 0 || snapshot->IsValid() == false)
+	{
+		return NULL;
+	}
+
+	int* proxyIds = (int*)cb2Alloc(allocator, count * sizeof(int));
+	snapshot->Read(proxyIds, count * sizeof(int));
+	for (int i = 0; i < count; ++i)
+	{
+		if (proxyIds[i] < 0 || proxyIds[i] >= proxyCapacity || proxies[proxyIds[i]].next != next)
+		{
+			snapshot->Invalidate();
+		}
+	}
+
+	if (snapshot->IsValid() == false)
+	{
+		cb2Free(allocator, proxyIds);
+		return NULL;
+	}
+	return proxyIds;
+}
+
+// Check that proxyCount proxies are in use and the free list holds the others, a
+// cycle never reaches the end of the list. The proxies in cells must cover no more
+// cells than PlaceProxy lets them, RemoveProxy walks them all.
+static bool cb2CheckProxies(const cb2GridProxy* proxies, int proxyCapacity, int proxyCount, int freeList)
+{
+	int usedCount = 0;
+	for (int i = 0; i < proxyCapacity; ++i)
+	{
+		const cb2GridProxy* proxy = proxies + i;
+		if (proxy->next == cb2UniformGrid::e_usedProxy)
+		{
+			float cellCount = (proxy->upperX - proxy->lowerX + 1.0f) * (proxy->upperY - proxy->lowerY + 1.0f);
+			if (proxy->lowerX > proxy->upperX || proxy->lowerY > proxy->upperY ||
+				cellCount > (float)cb2UniformGrid::e_maxProxyCells)
+			{
+				return false;
+			}
+		}
+
+		if (proxy->next == cb2UniformGrid::e_usedProxy || proxy->next == cb2UniformGrid::e_largeProxy)
+		{
+			++usedCount;
+		}
+	}
+
+	if (usedCount != proxyCount)
+	{
+		return false;
+	}
+
+	int index = freeList;
+	for (int i = 0; i < proxyCapacity - proxyCount; ++i)
+	{
+		if (index == cb2UniformGrid::e_nullProxy)
+		{
+			return false;
+		}
+
+		index = proxies[index].next;
+		if (index < cb2UniformGrid::e_nullProxy || index >= proxyCapacity)
+		{
+			return false;
+		}
+	}
+
+	return index == cb2UniformGrid::e_nullProxy;
+}
+
+bool cb2UniformGrid::Load(cb2Snapshot* snapshot)
+{
+	float cellSize = snapshot->Read<float>();
+	int proxyCapacity = snapshot->ReadCount(sizeof(cb2GridProxy));
+	int proxyCount = snapshot->Read<int>();
+	int freeList = snapshot->Read<int>();
+	if (snapshot->IsValid() == false || (cellSize > 0.0f) == false || proxyCapacity == 0 ||
+		proxyCount < 0 || proxyCount > proxyCapacity || freeList < e_nullProxy || freeList >= proxyCapacity)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	cb2GridProxy* proxies = (cb2GridProxy*)cb2Alloc(m_allocator, proxyCapacity * sizeof(cb2GridProxy));
+	snapshot->Read(proxies, proxyCapacity * sizeof(cb2GridProxy));
+	for (int i = 0; i < proxyCapacity; ++i)
+	{
+		proxies[i].userData = NULL;
+	}
+
+	// CreateProxy takes the free list as it is, so it must hold just the unused proxies.
+	if (snapshot->IsValid() && cb2CheckProxies(proxies, proxyCapacity, proxyCount, freeList) == false)
+	{
+		snapshot->Invalidate();
+	}
+
+	// The bucket count must stay a power of two for the hash.
+	int bucketCount = snapshot->ReadCount(sizeof(int));
+	int cellCount = snapshot->Read<int>();
+	if (bucketCount == 0 || (bucketCount & (bucketCount - 1)) != 0)
+	{
+		snapshot->Invalidate();
+	}
+
+	cb2GridBucket* buckets = NULL;
+	if (snapshot->IsValid())
+	{
+		buckets = (cb2GridBucket*)cb2Alloc(m_allocator, bucketCount * sizeof(cb2GridBucket));
+		memset(buckets, 0, bucketCount * sizeof(cb2GridBucket));
+		for (int i = 0; i < bucketCount && snapshot->IsValid(); ++i)
+		{
+			cb2GridBucket* bucket = buckets + i;
+			bucket->count = snapshot->ReadCount(sizeof(int));
+			bucket->proxyIds = cb2LoadProxyIds(snapshot, m_allocator, bucket->count, proxies, proxyCapacity, e_usedProxy);
+			bucket->capacity = bucket->proxyIds ? bucket->count : 0;
+			if (bucket->proxyIds == NULL)
+			{
+				bucket->count = 0;
+			}
+		}
+	}
+
+	int largeCount = snapshot->ReadCount(sizeof(int));
+	int* largeProxies = cb2LoadProxyIds(snapshot, m_allocator, largeCount, proxies, proxyCapacity, e_largeProxy);
+
+	if (snapshot->IsValid() == false)
+	{
+		if (buckets)
+		{
+			for (int i = 0; i < bucketCount; ++i)
+			{
+				cb2Free(m_allocator, buckets[i].proxyIds);
+			}
+		}
+		cb2Free(m_allocator, buckets);
+		cb2Free(m_allocator, largeProxies);
+		cb2Free(m_allocator, proxies);
+		return false;
+	}
+
+	for (int i = 0; i < m_bucketCount; ++i)
+	{
+		cb2Free(m_allocator, m_buckets[i].proxyIds);
+	}
+	cb2Free(m_allocator, m_buckets);
+	cb2Free(m_allocator, m_largeProxies);
+	cb2Free(m_allocator, m_proxies);
+
+	m_cellSize = cellSize;
+	m_inverseCellSize = 1.0f / cellSize;
+	m_proxies = proxies;
+	m_proxyCapacity = proxyCapacity;
+	m_proxyCount = proxyCount;
+	m_freeList = freeList;
+	m_buckets = buckets;
+	m_bucketCount = bucketCount;
+	m_cellCount = cellCount;
+
+	// Keep room for the list to grow like the constructor does.
+	m_largeCapacity = cb2Max(largeCount, 4);
+	m_largeCount = largeCount;
+	m_largeProxies = (int*)cb2Alloc(m_allocator, m_largeCapacity * sizeof(int));
+	if (largeProxies)
+	{
+		memcpy(m_largeProxies, largeProxies, largeCount * sizeof(int));
+		cb2Free(m_allocator, largeProxies);
+	}
+	return true;
+}
@@ -0,0 +1,553 @@
+/*
+* Copyright (c) 2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_UNIFORM_GRID_H
+#define CB2_UNIFORM_GRID_H
+
+#include <CinderBox2D/Collision/cb2Collision.h>
+
+class cb2Snapshot;
+
+/// A proxy in the uniform grid. The client does not interact with this directly.
+struct cb2GridProxy
+{
+	/// Enlarged AABB
+	cb2AABB aabb;
+
+	void* userData;
+
+	/// The collision filter, see cb2DynamicTree::SetProxyFilter.
+	unsigned short categoryBits;
+	unsigned short maskBits;
+
+	/// How the proxy moved, for the margins of the fat AABB.
+	cb2ProxyMotion motion;
+
+	/// The cells covered by the enlarged AABB.
+	int lowerX, lowerY;
+	int upperX, upperY;
+
+	/// The next free proxy, cb2UniformGrid::e_usedProxy while in use and
+	/// cb2UniformGrid::e_largeProxy if the proxy is too big for the cells.
+	int next;
+};
+
+/// The proxies of the grid cells that hash to the same bucket.
+struct cb2GridBucket
+{
+	int* proxyIds;
+	int count;
+	int capacity;
+};
+
+/// A uniform grid of square cells, an alternative to cb2DynamicTree for many moving
+/// proxies of about the same size, such as particles. The cells are hashed into
+/// buckets, so the grid is unbounded. A proxy is listed in every cell its fat AABB
+/// touches, proxies that would touch more than e_maxProxyCells cells are kept in a
+/// list of their own instead. The proxy interface matches cb2DynamicTree, including
+/// the fattening of the AABBs.
+///
+/// Proxies are pooled and relocatable, so we use proxy indices rather than pointers.
+class cb2UniformGrid
+{
+public:
+	enum
+	{
+		e_nullProxy = -1,
+		e_usedProxy = -2,
+		e_largeProxy = -3,
+		e_maxProxyCells = 16
+	};
+
+	/// Constructing the grid initializes the proxy pool.
+	/// @param allocator where the pools live, NULL for cb2Alloc.
+	cb2UniformGrid(cb2AllocatorInterface* allocator = NULL);
+
+	/// Destroy the grid, freeing the pools.
+	~cb2UniformGrid();
+
+	/// Set the width of a cell. About twice the size of a typical proxy works well.
+	/// This asserts if the grid has proxies.
+	void SetCellSize(float cellSize);
+	float GetCellSize() const { return m_cellSize; }
+
+	/// Create a proxy. Provide a tight fitting AABB and a userData pointer.
+	int CreateProxy(const cb2AABB& aabb, void* userData);
+
+	/// Destroy a proxy. This asserts if the id is invalid.
+	void DestroyProxy(int proxyId);
+
+	/// Move a proxy with a swepted AABB. If the proxy has moved outside of its fattened AABB,
+	/// then the proxy is moved to the cells of a new fattened AABB. Otherwise
+	/// the function returns immediately.
+	/// @return true if the proxy was moved.
+	bool MoveProxy(int proxyId, const cb2AABB& aabb1, const ci::Vec2f& displacement);
+
+	/// Get proxy user data.
+	void* GetUserData(int proxyId) const;
+
+	/// Get the fat AABB for a proxy.
+	const cb2AABB& GetFatAABB(int proxyId) const;
+
+	/// Get how often a proxy moved out of its fat AABB.
+	int GetReinsertCount(int proxyId) const;
+
+	/// @see cb2DynamicTree::SetProxyFilter
+	void SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits);
+
+	/// Get the mask bits of a proxy.
+	unsigned short GetMaskBits(int proxyId) const;
+
+	/// Get the number of proxies.
+	int GetProxyCount() const { return m_proxyCount; }
+
+	/// Get the size of the proxy pool, every proxy id is below it.
+	int GetProxyCapacity() const { return m_proxyCapacity; }
+
+	/// Is the id one of a proxy in use? Ids from a snapshot are checked with this.
+	bool IsProxy(int proxyId) const
+	{
+		return 0 <= proxyId && proxyId < m_proxyCapacity &&
+			(m_proxies[proxyId].next == e_usedProxy || m_proxies[proxyId].next == e_largeProxy);
+	}
+
+	/// Grow the proxy pool to hold at least this many proxies and the cell buckets
+	/// for their cells, so creating proxies does not have to copy the pool or rehash
+	/// the cells later.
+	void Reserve(int proxyCount);
+
+	/// Query an AABB for overlapping proxies. The callback class
+	/// is called once for each proxy that overlaps the supplied AABB.
+	/// @param maskBits skip the proxies that have none of these category bits.
+	template <typename T>
+	void Query(T* callback, const cb2AABB& aabb, unsigned short maskBits = 0xFFFF) const;
+
+	/// Ray-cast against the proxies in the grid, see cb2DynamicTree::RayCast. The cells
+	/// are walked from p1 on, so the ray is clipped early when the callback clips it.
+	/// @param maskBits skip the proxies that have none of these category bits.
+	template <typename T>
+	void RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits = 0xFFFF) const;
+
+	/// Sweep an AABB through the grid, see cb2DynamicTree::ShapeCast.
+	template <typename T>
+	void ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const;
+
+	/// Shift the world origin. Useful for large worlds.
+	/// The shift formula is: position -= newOrigin
+	/// @param newOrigin the new origin with respect to the old origin
+	void ShiftOrigin(const ci::Vec2f& newOrigin);
+
+	/// @see cb2DynamicTree::Save
+	void Save(cb2Snapshot* snapshot) const;
+
+	/// @see cb2DynamicTree::Load
+	bool Load(cb2Snapshot* snapshot);
+
+	/// @see cb2DynamicTree::SetUserData
+	void SetUserData(int proxyId, void* userData);
+
+private:
+
+	void GrowPool(int capacity);
+	int ComputeCell(float x) const;
+	int GetBucket(int x, int y) const;
+
+	void InsertProxy(int proxyId);
+	void PlaceProxy(int proxyId);
+	void RemoveProxy(int proxyId);
+	void Rehash(int bucketCount);
+
+	cb2AllocatorInterface* m_allocator;
+
+	float m_cellSize;
+	float m_inverseCellSize;
+
+	cb2GridProxy* m_proxies;
+	int m_proxyCount;
+	int m_proxyCapacity;
+	int m_freeList;
+
+	cb2GridBucket* m_buckets;
+	int m_bucketCount;
+
+	/// The number of cells listed in the buckets.
+	int m_cellCount;
+
+	/// The proxies too big for the cells.
+	int* m_largeProxies;
+	int m_largeCount;
+	int m_largeCapacity;
+};
+
+/// Does the segment swept by a box miss another box? The segment is given
+/// by p1, its normal v and |v|, see cb2DynamicTree::RayCast.
+inline bool cb2SeparatedFromSegment(const cb2AABB& aabb, const ci::Vec2f& extension,
+	const ci::Vec2f& p1, const ci::Vec2f& v, const ci::Vec2f& abs_v)
+{
+	// Separating axis for segment (Gino, p80).
+	// |dot(v, p1 - c)| > dot(|v|, h)
+	ci::Vec2f c = aabb.GetCenter();
+	ci::Vec2f h = aabb.GetExtents() + extension;
+	return cb2Abs(cb2Dot(v, p1 - c)) - cb2Dot(abs_v, h) > 0.0f;
+}
+
+/// Clips the shape cast of cb2UniformGrid::ShapeCast while the grid reports the
+/// proxies overlapping the swept box.
+template <typename T>
+struct cb2GridSweep
+{
+	bool QueryCallback(int proxyId)
+	{
+		const cb2AABB& aabb = grid->GetFatAABB(proxyId);
+		if (cb2TestOverlap(aabb, sweptAABB) == false ||
+			cb2SeparatedFromSegment(aabb, extension, p1, v, abs_v))
+		{
+			return true;
+		}
+
+		float value = callback->ShapeCastCallback(maxFraction, proxyId);
+		if (value == 0.0f)
+		{
+			// The client has terminated the shape cast.
+			return false;
+		}
+
+		if (value > 0.0f)
+		{
+			// Update the swept bounding box.
+			maxFraction = value;
+			ci::Vec2f t = p1 + maxFraction * translation;
+			sweptAABB.lowerBound = cb2Min(p1, t) - extension;
+			sweptAABB.upperBound = cb2Max(p1, t) + extension;
+		}
+		return true;
+	}
+
+	T* callback;
+	const cb2UniformGrid* grid;
+	ci::Vec2f p1, extension, translation;
+	ci::Vec2f v, abs_v;
+	float maxFraction;
+	cb2AABB sweptAABB;
+};
+
+inline void cb2UniformGrid::SetUserData(int proxyId, void* userData)
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	m_proxies[proxyId].userData = userData;
+}
+
+inline void* cb2UniformGrid::GetUserData(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	return m_proxies[proxyId].userData;
+}
+
+inline const cb2AABB& cb2UniformGrid::GetFatAABB(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	return m_proxies[proxyId].aabb;
+}
+
+inline int cb2UniformGrid::GetReinsertCount(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	return m_proxies[proxyId].motion.reinsertCount;
+}
+
+inline void cb2UniformGrid::SetProxyFilter(int proxyId, unsigned short categoryBits, unsigned short maskBits)
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	m_proxies[proxyId].categoryBits = categoryBits;
+	m_proxies[proxyId].maskBits = maskBits;
+}
+
+inline unsigned short cb2UniformGrid::GetMaskBits(int proxyId) const
+{
+	cb2Assert(0 <= proxyId && proxyId < m_proxyCapacity);
+	return m_proxies[proxyId].maskBits;
+}
+
+inline int cb2UniformGrid::ComputeCell(float x) const
+{
+	// Keep far away proxies from overflowing the cell coordinates.
+	float cell = floorf(cb2Clamp(x * m_inverseCellSize, -1.0e9f, 1.0e9f));
+	return (int)cell;
+}
+
+inline int cb2UniformGrid::GetBucket(int x, int y) const
+{
+	unsigned int hash = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+	return (int)((hash ^ (hash >> 16)) & (unsigned int)(m_bucketCount - 1));
+}
+
+template <typename T>
+inline void cb2UniformGrid::Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
+{
+	for (int i = 0; i < m_largeCount; ++i)
+	{
+		int proxyId = m_largeProxies[i];
+		if ((m_proxies[proxyId].categoryBits & maskBits) != 0 && cb2TestOverlap(m_proxies[proxyId].aabb, aabb))
+		{
+			bool proceed = callback->QueryCallback(proxyId);
+			if (proceed == false)
+			{
+				return;
+			}
+		}
+	}
+
+	int lowerX = ComputeCell(aabb.lowerBound.x);
+	int lowerY = ComputeCell(aabb.lowerBound.y);
+	int upperX = ComputeCell(aabb.upperBound.x);
+	int upperY = ComputeCell(aabb.upperBound.y);
+
+	// A query over more cells than there are proxies is cheaper on the proxies.
+	float queryCells = (upperX - lowerX + 1.0f) * (upperY - lowerY + 1.0f);
+	if (queryCells > (float)m_proxyCount)
+	{
+		for (int proxyId = 0; proxyId < m_proxyCapacity; ++proxyId)
+		{
+			const cb2GridProxy* proxy = m_proxies + proxyId;
+			if (proxy->next == e_usedProxy && (proxy->categoryBits & maskBits) != 0 && cb2TestOverlap(proxy->aabb, aabb))
+			{
+				bool proceed = callback->QueryCallback(proxyId);
+				if (proceed == false)
+				{
+					return;
+				}
+			}
+		}
+		return;
+	}
+
+	for (int y = lowerY; y <= upperY; ++y)
+	{
+		for (int x = lowerX; x <= upperX; ++x)
+		{
+			const cb2GridBucket* bucket = m_buckets + GetBucket(x, y);
+			for (int i = 0; i < bucket->count; ++i)
+			{
+				int proxyId = bucket->proxyIds[i];
+				const cb2GridProxy* proxy = m_proxies + proxyId;
+
+				// Only the first cell shared with the query reports a proxy. This
+				// also skips the proxies of other cells in the same bucket.
+				if (x != cb2Max(proxy->lowerX, lowerX) || y != cb2Max(proxy->lowerY, lowerY))
+				{
+					continue;
+				}
+
+				if ((proxy->categoryBits & maskBits) != 0 && cb2TestOverlap(proxy->aabb, aabb))
+				{
+					bool proceed = callback->QueryCallback(proxyId);
+					if (proceed == false)
+					{
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+template <typename T>
+inline void cb2UniformGrid::RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const
+{
+	ci::Vec2f p1 = input.p1;
+	ci::Vec2f p2 = input.p2;
+	ci::Vec2f d = p2 - p1;
+	ci::Vec2f r = d;
+	cb2Assert(r.lengthSquared() > 0.0f);
+	r.normalize();
+
+	// v is perpendicular to the segment.
+	ci::Vec2f v = cb2Cross(1.0f, r);
+	ci::Vec2f abs_v = cb2Abs(v);
+	ci::Vec2f zero(0.0f, 0.0f);
+
+	float maxFraction = input.maxFraction;
+
+	// Build a bounding box for the segment.
+	cb2AABB segmentAABB;
+	{
+		ci::Vec2f t = p1 + maxFraction * d;
+		segmentAABB.lowerBound = cb2Min(p1, t);
+		segmentAABB.upperBound = cb2Max(p1, t);
+	}
+
+	cb2RayCastInput subInput;
+	subInput.p1 = input.p1;
+	subInput.p2 = input.p2;
+
+	for (int i = 0; i < m_largeCount; ++i)
+	{
+		int proxyId = m_largeProxies[i];
+		const cb2AABB& aabb = m_proxies[proxyId].aabb;
+		if ((m_proxies[proxyId].categoryBits & maskBits) == 0 ||
+			cb2TestOverlap(aabb, segmentAABB) == false ||
+			cb2SeparatedFromSegment(aabb, zero, p1, v, abs_v))
+		{
+			continue;
+		}
+
+		subInput.maxFraction = maxFraction;
+		float value = callback->RayCastCallback(subInput, proxyId);
+		if (value == 0.0f)
+		{
+			// The client has terminated the ray cast.
+			return;
+		}
+
+		if (value > 0.0f)
+		{
+			// Update segment bounding box.
+			maxFraction = value;
+			ci::Vec2f t = p1 + maxFraction * d;
+			segmentAABB.lowerBound = cb2Min(p1, t);
+			segmentAABB.upperBound = cb2Max(p1, t);
+		}
+	}
+
+	// Walk the cells the segment crosses (Amanatides and Woo). The walk never turns
+	// back, so a proxy is reported in the first of its cells, the one entered
+	// from a cell it does not cover.
+	int x = ComputeCell(p1.x);
+	int y = ComputeCell(p1.y);
+	int stepX = d.x > 0.0f ? 1 : -1;
+	int stepY = d.y > 0.0f ? 1 : -1;
+	float deltaX = d.x != 0.0f ? m_cellSize / cb2Abs(d.x) : cb2_maxFloat;
+	float deltaY = d.y != 0.0f ? m_cellSize / cb2Abs(d.y) : cb2_maxFloat;
+	float nextX = cb2_maxFloat;
+	float nextY = cb2_maxFloat;
+	if (d.x != 0.0f)
+	{
+		nextX = ((x + (stepX > 0 ? 1 : 0)) * m_cellSize - p1.x) / d.x;
+	}
+	if (d.y != 0.0f)
+	{
+		nextY = ((y + (stepY > 0 ? 1 : 0)) * m_cellSize - p1.y) / d.y;
+	}
+
+	int previousX = x;
+	int previousY = y;
+	bool first = true;
+
+	for (;;)
+	{
+		const cb2GridBucket* bucket = m_buckets + GetBucket(x, y);
+		for (int i = 0; i < bucket->count; ++i)
+		{
+			int proxyId = bucket->proxyIds[i];
+			const cb2GridProxy* proxy = m_proxies + proxyId;
+
+			if (x < proxy->lowerX || proxy->upperX < x || y < proxy->lowerY || proxy->upperY < y)
+			{
+				// Another cell of the same bucket.
+				continue;
+			}
+
+			if (first == false &&
+				proxy->lowerX <= previousX && previousX <= proxy->upperX &&
+				proxy->lowerY <= previousY && previousY <= proxy->upperY)
+			{
+				// Already reported.
+				continue;
+			}
+
+			if ((proxy->categoryBits & maskBits) == 0 ||
+				cb2TestOverlap(proxy->aabb, segmentAABB) == false ||
+				cb2SeparatedFromSegment(proxy->aabb, zero, p1, v, abs_v))
+			{
+				continue;
+			}
+
+			subInput.maxFraction = maxFraction;
+			float value = callback->RayCastCallback(subInput, proxyId);
+			if (value == 0.0f)
+			{
+				// The client has terminated the ray cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				maxFraction = value;
+				ci::Vec2f t = p1 + maxFraction * d;
+				segmentAABB.lowerBound = cb2Min(p1, t);
+				segmentAABB.upperBound = cb2Max(p1, t);
+			}
+		}
+
+		previousX = x;
+		previousY = y;
+		first = false;
+
+		if (nextX < nextY)
+		{
+			if (nextX > maxFraction)
+			{
+				break;
+			}
+			x += stepX;
+			nextX += deltaX;
+		}
+		else
+		{
+			if (nextY > maxFraction)
+			{
+				break;
+			}
+			y += stepY;
+			nextY += deltaY;
+		}
+	}
+}
+
+template <typename T>
+inline void cb2UniformGrid::ShapeCast(T* callback, const cb2AABB& aabb, const ci::Vec2f& translation) const
+{
+	cb2GridSweep<T> sweep;
+	sweep.callback = callback;
+	sweep.grid = this;
+	sweep.p1 = aabb.GetCenter();
+	sweep.extension = aabb.GetExtents();
+	sweep.translation = translation;
+
+	ci::Vec2f r = translation;
+	cb2Assert(r.lengthSquared() > 0.0f);
+	r.normalize();
+
+	// v is perpendicular to the segment.
+	sweep.v = cb2Cross(1.0f, r);
+	sweep.abs_v = cb2Abs(sweep.v);
+
+	sweep.maxFraction = 1.0f;
+
+	// Build a bounding box for the swept box.
+	ci::Vec2f t = sweep.p1 + translation;
+	sweep.sweptAABB.lowerBound = cb2Min(sweep.p1, t) - sweep.extension;
+	sweep.sweptAABB.upperBound = cb2Max(sweep.p1, t) + sweep.extension;
+
+	// The sweep shrinks its box as it goes, the cells stay those of the full sweep.
+	cb2AABB sweptAABB = sweep.sweptAABB;
+	Query(&sweep, sweptAABB);
+}
+
+#endif
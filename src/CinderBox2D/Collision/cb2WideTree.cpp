@@ -0,0 +1,164 @@
+/*
+* Copyright (c) 2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Collision/cb2WideTree.h>
+#include <float.h>
+
+cb2WideTree::cb2WideTree(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
+	m_source = NULL;
+	m_version = 0;
+	m_root = cb2_nullNode;
+	m_nodes = NULL;
+	m_nodeCount = 0;
+	m_nodeCapacity = 0;
+}
+
+cb2WideTree::~cb2WideTree()
+{
+	cb2Free(m_allocator, m_nodes);
+}
+
+void cb2WideTree::Clear()
+{
+	cb2Free(m_allocator, m_nodes);
+	m_nodes = NULL;
+	m_nodeCount = 0;
+	m_nodeCapacity = 0;
+	m_root = cb2_nullNode;
+	m_source = NULL;
+}
+
+void cb2WideTree::Build(const cb2DynamicTree& tree)
+{
+	m_source = &tree;
+	m_version = tree.GetVersion();
+	m_nodeCount = 0;
+	m_root = cb2_nullNode;
+
+	if (tree.m_root == cb2_nullNode)
+	{
+		return;
+	}
+
+	// Every wide node but a lone leaf root has at least two children, so there
+	// are fewer wide nodes than leaves.
+	int leafCount = (tree.m_nodeCount + 1) / 2;
+	if (m_nodeCapacity < leafCount)
+	{
+		cb2Free(m_allocator, m_nodes);
+		m_nodeCapacity = leafCount;
+		m_nodes = (cb2WideTreeNode*)cb2Alloc(m_allocator, m_nodeCapacity * sizeof(cb2WideTreeNode));
+	}
+
+	m_root = BuildNode(tree, tree.m_root);
+}
+
+// Collapse the binary subtree below nodeId into a wide node. The children with the
+// largest perimeter are opened first, they are the most likely to be rejected
+// together.
+int cb2WideTree::BuildNode(const cb2DynamicTree& tree, int nodeId)
+{
+	const cb2TreeNode* nodes = tree.m_nodes;
+
+	int lanes[cb2_simdWidth];
+	int laneCount = 0;
+
+	if (nodes[nodeId].IsLeaf())
+	{
+		lanes[laneCount++] = nodeId;
+	}
+	else
+	{
+		lanes[laneCount++] = nodes[nodeId].child1;
+		lanes[laneCount++] = nodes[nodeId].child2;
+	}
+
+	while (laneCount < cb2_simdWidth)
+	{
+		int best = -1;
+		float bestPerimeter = -1.0f;
+		for (int i = 0; i < laneCount; ++i)
+		{
+			const cb2TreeNode* node = nodes + lanes[i];
+			if (node->IsLeaf() == false && node->aabb.GetPerimeter() > bestPerimeter)
+			{
+				best = i;
+				bestPerimeter = node->aabb.GetPerimeter();
+			}
+		}
+
+		if (best == -1)
+		{
+			break;
+		}
+
+		int opened = lanes[best];
+		lanes[best] = nodes[opened].child1;
+		lanes[laneCount++] = nodes[opened].child2;
+	}
+
+	cb2Assert(m_nodeCount < m_nodeCapacity);
+	int index = m_nodeCount++;
+
+	cb2WideTreeNode* wide = m_nodes + index;
+	wide->leafMask = 0;
+
+	for (int i = 0; i < cb2_simdWidth; ++i)
+	{
+		if (i >= laneCount)
+		{
+			wide->lowerX[i] = FLT_MAX;
+			wide->lowerY[i] = FLT_MAX;
+			wide->upperX[i] = -FLT_MAX;
+			wide->upperY[i] = -FLT_MAX;
+			wide->children[i] = cb2_nullNode;
+			wide->categoryBits[i] = 0;
+			continue;
+		}
+
+		const cb2TreeNode* node = nodes + lanes[i];
+		wide->lowerX[i] = node->aabb.lowerBound.x;
+		wide->lowerY[i] = node->aabb.lowerBound.y;
+		wide->upperX[i] = node->aabb.upperBound.x;
+		wide->upperY[i] = node->aabb.upperBound.y;
+		wide->categoryBits[i] = node->categoryBits;
+
+		if (node->IsLeaf())
+		{
+			wide->children[i] = lanes[i];
+			wide->leafMask |= 1 << i;
+		}
+		else
+		{
+			wide->children[i] = cb2_nullNode;
+		}
+	}
+
+	for (int i = 0; i < laneCount; ++i)
+	{
+		if ((m_nodes[index].leafMask & (1 << i)) == 0)
+		{
+			int child = BuildNode(tree, lanes[i]);
+			m_nodes[index].children[i] = child;
+		}
+	}
+
+	return index;
+}
@@ -0,0 +1,247 @@
+/*
+* Copyright (c) 2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_WIDE_TREE_H
+#define CB2_WIDE_TREE_H
+
+#include <CinderBox2D/Collision/cb2DynamicTree.h>
+#include <CinderBox2D/Common/cb2Simd.h>
+
+/// A node of the wide tree, the bounds of up to four children in lanes.
+struct cb2WideTreeNode
+{
+	float lowerX[cb2_simdWidth];
+	float lowerY[cb2_simdWidth];
+	float upperX[cb2_simdWidth];
+	float upperY[cb2_simdWidth];
+
+	/// A wide node index, or a proxy id for the lanes in leafMask. Unused lanes
+	/// have inverted bounds and never pass a test.
+	int children[cb2_simdWidth];
+	int leafMask;
+
+	/// The category bits of each child, see cb2TreeNode::categoryBits.
+	unsigned short categoryBits[cb2_simdWidth];
+};
+
+/// A read-only four wide copy of a cb2DynamicTree, for query heavy workloads.
+/// Each node tests the AABBs of four children at once with SIMD, and the tree is
+/// half as deep as the binary tree. It holds the fat AABBs of a snapshot of the
+/// dynamic tree and has to be rebuilt after the dynamic tree changes, see
+/// IsCurrent. Queries report the same proxies as the dynamic tree, in a
+/// different order.
+class cb2WideTree
+{
+public:
+	/// @param allocator where the nodes live, NULL for cb2Alloc.
+	cb2WideTree(cb2AllocatorInterface* allocator = NULL);
+	~cb2WideTree();
+
+	/// Rebuild from the current state of a dynamic tree. This takes linear time.
+	void Build(const cb2DynamicTree& tree);
+
+	/// Release the nodes. The tree is then current for no dynamic tree.
+	void Clear();
+
+	/// Is this a copy of the current state of the given dynamic tree?
+	bool IsCurrent(const cb2DynamicTree& tree) const;
+
+	/// Query an AABB for overlapping proxies.
+	/// @see cb2DynamicTree::Query
+	template <typename T>
+	void Query(T* callback, const cb2AABB& aabb, unsigned short maskBits = 0xFFFF) const;
+
+	/// Ray-cast against the proxies in the tree.
+	/// @see cb2DynamicTree::RayCast
+	template <typename T>
+	void RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits = 0xFFFF) const;
+
+private:
+
+	int BuildNode(const cb2DynamicTree& tree, int nodeId);
+
+	cb2AllocatorInterface* m_allocator;
+
+	const cb2DynamicTree* m_source;
+	unsigned int m_version;
+
+	int m_root;
+
+	cb2WideTreeNode* m_nodes;
+	int m_nodeCount;
+	int m_nodeCapacity;
+};
+
+inline bool cb2WideTree::IsCurrent(const cb2DynamicTree& tree) const
+{
+	return m_source == &tree && m_version == tree.GetVersion();
+}
+
+template <typename T>
+inline void cb2WideTree::Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
+{
+	if (m_root == cb2_nullNode)
+	{
+		return;
+	}
+
+	cb2FloatW lowerX = cb2SplatW(aabb.lowerBound.x);
+	cb2FloatW lowerY = cb2SplatW(aabb.lowerBound.y);
+	cb2FloatW upperX = cb2SplatW(aabb.upperBound.x);
+	cb2FloatW upperY = cb2SplatW(aabb.upperBound.y);
+
+	cb2GrowableStack<int, 128> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		const cb2WideTreeNode* node = m_nodes + stack.Pop();
+
+		cb2FloatW overlapX = cb2AndW(cb2GreaterEqualW(cb2LoadW(node->upperX), lowerX), cb2GreaterEqualW(upperX, cb2LoadW(node->lowerX)));
+		cb2FloatW overlapY = cb2AndW(cb2GreaterEqualW(cb2LoadW(node->upperY), lowerY), cb2GreaterEqualW(upperY, cb2LoadW(node->lowerY)));
+		int hits = cb2MaskBitsW(cb2AndW(overlapX, overlapY));
+
+		for (int i = 0; i < cb2_simdWidth; ++i)
+		{
+			if ((hits & (1 << i)) == 0 || (node->categoryBits[i] & maskBits) == 0)
+			{
+				continue;
+			}
+
+			if (node->leafMask & (1 << i))
+			{
+				bool proceed = callback->QueryCallback(node->children[i]);
+				if (proceed == false)
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.Push(node->children[i]);
+			}
+		}
+	}
+}
+
+template <typename T>
+inline void cb2WideTree::RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const
+{
+	if (m_root == cb2_nullNode)
+	{
+		return;
+	}
+
+	ci::Vec2f p1 = input.p1;
+	ci::Vec2f p2 = input.p2;
+	ci::Vec2f r = p2 - p1;
+	cb2Assert(r.lengthSquared() > 0.0f);
+	r.normalize();
+
+	// v is perpendicular to the segment.
+	ci::Vec2f v = cb2Cross(1.0f, r);
+	ci::Vec2f abs_v = cb2Abs(v);
+
+	// Separating axis for segment (Gino, p80).
+	// |dot(v, p1 - c)| > dot(|v|, h)
+
+	float maxFraction = input.maxFraction;
+
+	// Build a bounding box for the segment.
+	ci::Vec2f t = p1 + maxFraction * (p2 - p1);
+	cb2FloatW segmentLowerX = cb2SplatW(cb2Min(p1.x, t.x));
+	cb2FloatW segmentLowerY = cb2SplatW(cb2Min(p1.y, t.y));
+	cb2FloatW segmentUpperX = cb2SplatW(cb2Max(p1.x, t.x));
+	cb2FloatW segmentUpperY = cb2SplatW(cb2Max(p1.y, t.y));
+
+	cb2FloatW p1X = cb2SplatW(p1.x);
+	cb2FloatW p1Y = cb2SplatW(p1.y);
+	cb2FloatW vX = cb2SplatW(v.x);
+	cb2FloatW vY = cb2SplatW(v.y);
+	cb2FloatW absX = cb2SplatW(abs_v.x);
+	cb2FloatW absY = cb2SplatW(abs_v.y);
+	cb2FloatW half = cb2SplatW(0.5f);
+	cb2FloatW zero = cb2ZeroW();
+
+	cb2GrowableStack<int, 128> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		const cb2WideTreeNode* node = m_nodes + stack.Pop();
+
+		cb2FloatW nodeLowerX = cb2LoadW(node->lowerX);
+		cb2FloatW nodeLowerY = cb2LoadW(node->lowerY);
+		cb2FloatW nodeUpperX = cb2LoadW(node->upperX);
+		cb2FloatW nodeUpperY = cb2LoadW(node->upperY);
+
+		cb2FloatW overlapX = cb2AndW(cb2GreaterEqualW(nodeUpperX, segmentLowerX), cb2GreaterEqualW(segmentUpperX, nodeLowerX));
+		cb2FloatW overlapY = cb2AndW(cb2GreaterEqualW(nodeUpperY, segmentLowerY), cb2GreaterEqualW(segmentUpperY, nodeLowerY));
+
+		cb2FloatW cX = cb2MulW(half, cb2AddW(nodeLowerX, nodeUpperX));
+		cb2FloatW cY = cb2MulW(half, cb2AddW(nodeLowerY, nodeUpperY));
+		cb2FloatW hX = cb2MulW(half, cb2SubW(nodeUpperX, nodeLowerX));
+		cb2FloatW hY = cb2MulW(half, cb2SubW(nodeUpperY, nodeLowerY));
+		cb2FloatW d = cb2AddW(cb2MulW(vX, cb2SubW(p1X, cX)), cb2MulW(vY, cb2SubW(p1Y, cY)));
+		cb2FloatW absD = cb2MaxW(d, cb2SubW(zero, d));
+		cb2FloatW separation = cb2SubW(absD, cb2AddW(cb2MulW(absX, hX), cb2MulW(absY, hY)));
+		cb2FloatW crosses = cb2GreaterEqualW(zero, separation);
+
+		int hits = cb2MaskBitsW(cb2AndW(cb2AndW(overlapX, overlapY), crosses));
+
+		for (int i = 0; i < cb2_simdWidth; ++i)
+		{
+			if ((hits & (1 << i)) == 0 || (node->categoryBits[i] & maskBits) == 0)
+			{
+				continue;
+			}
+
+			if ((node->leafMask & (1 << i)) == 0)
+			{
+				stack.Push(node->children[i]);
+				continue;
+			}
+
+			cb2RayCastInput subInput;
+			subInput.p1 = input.p1;
+			subInput.p2 = input.p2;
+			subInput.maxFraction = maxFraction;
+
+			float value = callback->RayCastCallback(subInput, node->children[i]);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the ray cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				maxFraction = value;
+				t = p1 + maxFraction * (p2 - p1);
+				segmentLowerX = cb2SplatW(cb2Min(p1.x, t.x));
+				segmentLowerY = cb2SplatW(cb2Min(p1.y, t.y));
+				segmentUpperX = cb2SplatW(cb2Max(p1.x, t.x));
+				segmentUpperY = cb2SplatW(cb2Max(p1.y, t.y));
+			}
+		}
+	}
+}
+
+#endif
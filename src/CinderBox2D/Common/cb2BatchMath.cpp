@@ -0,0 +1,143 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Common/cb2BatchMath.h>
+#include <CinderBox2D/Common/cb2Simd.h>
+
+// The points are read as packed floats, two to a vector. A vector (x0, y0, x1, y1)
+// and its pair swapped (y0, x0, y1, x1) give both rotated coordinates with one
+// multiply each, so no deinterleaving is needed.
+
+void cb2MulBatch(const cb2Transform& xf, const ci::Vec2f* points, int count, ci::Vec2f* out)
+{
+	cb2Assert(sizeof(ci::Vec2f) == 2 * sizeof(float));
+
+	const float* in = &points[0].x;
+	float* o = &out[0].x;
+
+	cb2FloatW c = cb2SplatW(xf.q.c);
+	cb2FloatW s = cb2SetW(-xf.q.s, xf.q.s, -xf.q.s, xf.q.s);
+	cb2FloatW p = cb2SetW(xf.p.x, xf.p.y, xf.p.x, xf.p.y);
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		cb2FloatW v = cb2LoadW(in + 2 * i);
+		cb2FloatW w = cb2SwapPairsW(v);
+		cb2StoreW(o + 2 * i, cb2AddW(cb2AddW(cb2MulW(c, v), cb2MulW(s, w)), p));
+	}
+
+	for (; i < count; ++i)
+	{
+		out[i] = cb2Mul(xf, points[i]);
+	}
+}
+
+void cb2MulBatch(const cb2Transform* xfs, const ci::Vec2f* points, int count, ci::Vec2f* out)
+{
+	cb2Assert(sizeof(ci::Vec2f) == 2 * sizeof(float));
+
+	const float* in = &points[0].x;
+	float* o = &out[0].x;
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const cb2Transform& xf1 = xfs[i];
+		const cb2Transform& xf2 = xfs[i + 1];
+		cb2FloatW c = cb2SetW(xf1.q.c, xf1.q.c, xf2.q.c, xf2.q.c);
+		cb2FloatW s = cb2SetW(-xf1.q.s, xf1.q.s, -xf2.q.s, xf2.q.s);
+		cb2FloatW p = cb2SetW(xf1.p.x, xf1.p.y, xf2.p.x, xf2.p.y);
+
+		cb2FloatW v = cb2LoadW(in + 2 * i);
+		cb2FloatW w = cb2SwapPairsW(v);
+		cb2StoreW(o + 2 * i, cb2AddW(cb2AddW(cb2MulW(c, v), cb2MulW(s, w)), p));
+	}
+
+	for (; i < count; ++i)
+	{
+		out[i] = cb2Mul(xfs[i], points[i]);
+	}
+}
+
+void cb2MulTBatch(const cb2Transform& xf, const ci::Vec2f* points, int count, ci::Vec2f* out)
+{
+	cb2Assert(sizeof(ci::Vec2f) == 2 * sizeof(float));
+
+	const float* in = &points[0].x;
+	float* o = &out[0].x;
+
+	cb2FloatW c = cb2SplatW(xf.q.c);
+	cb2FloatW s = cb2SetW(xf.q.s, -xf.q.s, xf.q.s, -xf.q.s);
+	cb2FloatW p = cb2SetW(xf.p.x, xf.p.y, xf.p.x, xf.p.y);
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		cb2FloatW v = cb2SubW(cb2LoadW(in + 2 * i), p);
+		cb2FloatW w = cb2SwapPairsW(v);
+		cb2StoreW(o + 2 * i, cb2AddW(cb2MulW(c, v), cb2MulW(s, w)));
+	}
+
+	for (; i < count; ++i)
+	{
+		out[i] = cb2MulT(xf, points[i]);
+	}
+}
+
+void cb2BoundBatch(const cb2Transform& xf, const float* xs, const float* ys, int count,
+				   ci::Vec2f* lower, ci::Vec2f* upper)
+{
+	cb2Assert(count > 0);
+
+	cb2FloatW c = cb2SplatW(xf.q.c);
+	cb2FloatW s = cb2SplatW(xf.q.s);
+	cb2FloatW px = cb2SplatW(xf.p.x);
+	cb2FloatW py = cb2SplatW(xf.p.y);
+
+	cb2FloatW lowerX = cb2SplatW(cb2_maxFloat);
+	cb2FloatW lowerY = lowerX;
+	cb2FloatW upperX = cb2SplatW(-cb2_maxFloat);
+	cb2FloatW upperY = upperX;
+
+	for (int i = 0; i < count; i += cb2_simdWidth)
+	{
+		cb2FloatW x = cb2LoadW(xs + i);
+		cb2FloatW y = cb2LoadW(ys + i);
+		cb2FloatW wx = cb2AddW(cb2SubW(cb2MulW(c, x), cb2MulW(s, y)), px);
+		cb2FloatW wy = cb2AddW(cb2AddW(cb2MulW(s, x), cb2MulW(c, y)), py);
+		lowerX = cb2MinW(lowerX, wx);
+		lowerY = cb2MinW(lowerY, wy);
+		upperX = cb2MaxW(upperX, wx);
+		upperY = cb2MaxW(upperY, wy);
+	}
+
+	// Reduce to (x, y) pairs and then across the halves, which leaves the bound in the
+	// first two lanes.
+	cb2FloatW l = cb2MinW(cb2ZipLowW(lowerX, lowerY), cb2ZipHighW(lowerX, lowerY));
+	cb2FloatW u = cb2MaxW(cb2ZipLowW(upperX, upperY), cb2ZipHighW(upperX, upperY));
+	l = cb2MinW(l, cb2SwapHalvesW(l));
+	u = cb2MaxW(u, cb2SwapHalvesW(u));
+
+	float lanes[cb2_simdWidth];
+	cb2StoreW(lanes, l);
+	lower->set(lanes[0], lanes[1]);
+	cb2StoreW(lanes, u);
+	upper->set(lanes[0], lanes[1]);
+}
@@ -0,0 +1,45 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_BATCH_MATH_H
+#define CB2_BATCH_MATH_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+
+/// @file
+/// Transforms of many points at once, using the four wide helpers of cb2Simd.h. The
+/// results are bit identical to calling cb2Mul or cb2MulT on each point. The output
+/// may be the same array as the input.
+
+/// Transform points by one transform.
+void cb2MulBatch(const cb2Transform& xf, const ci::Vec2f* points, int count, ci::Vec2f* out);
+
+/// Transform each point by its own transform.
+void cb2MulBatch(const cb2Transform* xfs, const ci::Vec2f* points, int count, ci::Vec2f* out);
+
+/// Inverse transform points by one transform.
+void cb2MulTBatch(const cb2Transform& xf, const ci::Vec2f* points, int count, ci::Vec2f* out);
+
+/// Compute the bounds of points stored by coordinate after transforming them. The
+/// arrays are read in whole vectors, so they must be padded to a multiple of
+/// cb2_simdWidth with copies of any of the points, like the polygon lanes.
+void cb2BoundBatch(const cb2Transform& xf, const float* xs, const float* ys, int count,
+				   ci::Vec2f* lower, ci::Vec2f* upper);
+
+#endif
@@ -17,9 +17,12 @@
 */
 
 #include <CinderBox2D/Common/cb2BlockAllocator.h>
+#include <CinderBox2D/Common/cb2Math.h>
 #include <limits.h>
 #include <memory.h>
 #include <stddef.h>
+#include <algorithm>
+#include <mutex>
 
 int cb2BlockAllocator::s_blockSizes[cb2_blockSizes] = 
 {
@@ -41,6 +44,9 @@ int cb2BlockAllocator::s_blockSizes[cb2_blockSizes] =
 unsigned char cb2BlockAllocator::s_blockSizeLookup[cb2_maxBlockSize + 1];
 bool cb2BlockAllocator::s_blockSizeLookupInitialized;
 
+// Allocators may be created on separate threads, the first one fills the lookup.
+static std::once_flag cb2_blockSizeLookupOnce;
+
 struct cb2Chunk
 {
 	int blockSize;
@@ -52,46 +58,68 @@ struct cb2Block
 	cb2Block* next;
 };
 
-cb2BlockAllocator::cb2BlockAllocator()
+cb2BlockAllocator::cb2BlockAllocator(cb2AllocatorInterface* allocator)
 {
 	cb2Assert(cb2_blockSizes < UCHAR_MAX);
 
+	m_allocator = allocator;
+
 	m_chunkSpace = cb2_chunkArrayIncrement;
 	m_chunkCount = 0;
-	m_chunks = (cb2Chunk*)cb2Alloc(m_chunkSpace * sizeof(cb2Chunk));
+	m_chunks = (cb2Chunk*)cb2Alloc(m_allocator, m_chunkSpace * sizeof(cb2Chunk));
 	
 	memset(m_chunks, 0, m_chunkSpace * sizeof(cb2Chunk));
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+	m_spareChunks = NULL;
+	m_spareChunkCount = 0;
 
-	if (s_blockSizeLookupInitialized == false)
+	memset(m_chunkCounts, 0, sizeof(m_chunkCounts));
+	memset(m_liveBlockCounts, 0, sizeof(m_liveBlockCounts));
+	m_liveBlockCount = 0;
+	m_peakLiveBlockCount = 0;
+	m_liveBytes = 0;
+	m_peakLiveBytes = 0;
+	m_largeCount = 0;
+	m_largeBytes = 0;
+
+	std::call_once(cb2_blockSizeLookupOnce, InitializeBlockSizeLookup);
+}
+
+void cb2BlockAllocator::InitializeBlockSizeLookup()
+{
+	int j = 0;
+	for (int i = 1; i <= cb2_maxBlockSize; ++i)
 	{
-		int j = 0;
-		for (int i = 1; i <= cb2_maxBlockSize; ++i)
+		cb2Assert(j < cb2_blockSizes);
+		if (i <= s_blockSizes[j])
 		{
-			cb2Assert(j < cb2_blockSizes);
-			if (i <= s_blockSizes[j])
-			{
-				s_blockSizeLookup[i] = (unsigned char)j;
-			}
-			else
-			{
-				++j;
-				s_blockSizeLookup[i] = (unsigned char)j;
-			}
+			s_blockSizeLookup[i] = (unsigned char)j;
+		}
+		else
+		{
+			++j;
+			s_blockSizeLookup[i] = (unsigned char)j;
 		}
-
-		s_blockSizeLookupInitialized = true;
 	}
+
+	s_blockSizeLookupInitialized = true;
 }
 
 cb2BlockAllocator::~cb2BlockAllocator()
 {
 	for (int i = 0; i < m_chunkCount; ++i)
 	{
-		cb2Free(m_chunks[i].blocks);
+		cb2Free(m_allocator, m_chunks[i].blocks);
 	}
 
-	cb2Free(m_chunks);
+	while (m_spareChunks)
+	{
+		cb2Block* spare = m_spareChunks;
+		m_spareChunks = spare->next;
+		cb2Free(m_allocator, spare);
+	}
+
+	cb2Free(m_allocator, m_chunks);
 }
 
 void* cb2BlockAllocator::Allocate(int size)
@@ -103,12 +131,22 @@ void* cb2BlockAllocator::Allocate(int size)
 
 	if (size > cb2_maxBlockSize)
 	{
-		return cb2Alloc(size);
+		++m_largeCount;
+		m_largeBytes += size;
+		m_liveBytes += size;
+		m_peakLiveBytes = cb2Max(m_peakLiveBytes, m_liveBytes);
+		return cb2Alloc(m_allocator, size);
 	}
 
 	int index = s_blockSizeLookup[size];
 	cb2Assert(0 <= index && index < cb2_blockSizes);
 
+	++m_liveBlockCounts[index];
+	++m_liveBlockCount;
+	m_peakLiveBlockCount = cb2Max(m_peakLiveBlockCount, m_liveBlockCount);
+	m_liveBytes += s_blockSizes[index];
+	m_peakLiveBytes = cb2Max(m_peakLiveBytes, m_liveBytes);
+
 	if (m_freeLists[index])
 	{
 		cb2Block* block = m_freeLists[index];
@@ -119,16 +157,21 @@ void* cb2BlockAllocator::Allocate(int size)
 	{
 		if (m_chunkCount == m_chunkSpace)
 		{
-			cb2Chunk* oldChunks = m_chunks;
-			m_chunkSpace += cb2_chunkArrayIncrement;
-			m_chunks = (cb2Chunk*)cb2Alloc(m_chunkSpace * sizeof(cb2Chunk));
-			memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(cb2Chunk));
-			memset(m_chunks + m_chunkCount, 0, cb2_chunkArrayIncrement * sizeof(cb2Chunk));
-			cb2Free(oldChunks);
+			GrowChunkArray(m_chunkCount + 1);
 		}
 
 		cb2Chunk* chunk = m_chunks + m_chunkCount;
-		chunk->blocks = (cb2Block*)cb2Alloc(cb2_chunkSize);
+		if (m_spareChunks)
+		{
+			chunk->blocks = m_spareChunks;
+			m_spareChunks = m_spareChunks->next;
+			--m_spareChunkCount;
+		}
+		else
+		{
+			chunk->blocks = (cb2Block*)cb2Alloc(m_allocator, cb2_chunkSize);
+		}
+		++m_chunkCounts[index];
 #if defined(_DEBUG)
 		memset(chunk->blocks, 0xcd, cb2_chunkSize);
 #endif
@@ -163,13 +206,22 @@ void cb2BlockAllocator::Free(void* p, int size)
 
 	if (size > cb2_maxBlockSize)
 	{
-		cb2Free(p);
+		cb2Assert(m_largeCount > 0);
+		--m_largeCount;
+		m_largeBytes -= size;
+		m_liveBytes -= size;
+		cb2Free(m_allocator, p);
 		return;
 	}
 
 	int index = s_blockSizeLookup[size];
 	cb2Assert(0 <= index && index < cb2_blockSizes);
 
+	cb2Assert(m_liveBlockCounts[index] > 0);
+	--m_liveBlockCounts[index];
+	--m_liveBlockCount;
+	m_liveBytes -= s_blockSizes[index];
+
 #ifdef _DEBUG
 	// Verify the memory address and size is valid.
 	int blockSize = s_blockSizes[index];
@@ -201,15 +253,176 @@ void cb2BlockAllocator::Free(void* p, int size)
 	m_freeLists[index] = block;
 }
 
+void cb2BlockAllocator::GrowChunkArray(int chunkCount)
+{
+	cb2Chunk* oldChunks = m_chunks;
+	while (m_chunkSpace < chunkCount)
+	{
+		m_chunkSpace += cb2_chunkArrayIncrement;
+	}
+	m_chunks = (cb2Chunk*)cb2Alloc(m_allocator, m_chunkSpace * sizeof(cb2Chunk));
+	memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(cb2Chunk));
+	memset(m_chunks + m_chunkCount, 0, (m_chunkSpace - m_chunkCount) * sizeof(cb2Chunk));
+	cb2Free(m_allocator, oldChunks);
+}
+
+void cb2BlockAllocator::Reserve(int size)
+{
+	cb2Assert(size >= 0);
+
+	// Each size class that grows takes a whole chunk.
+	int spareCount = (size + cb2_chunkSize - 1) / cb2_chunkSize;
+	if (m_chunkCount + spareCount > m_chunkSpace)
+	{
+		GrowChunkArray(m_chunkCount + spareCount);
+	}
+
+	while (m_spareChunkCount < spareCount)
+	{
+		cb2Block* spare = (cb2Block*)cb2Alloc(m_allocator, cb2_chunkSize);
+		spare->next = m_spareChunks;
+		m_spareChunks = spare;
+		++m_spareChunkCount;
+	}
+}
+
 void cb2BlockAllocator::Clear()
 {
 	for (int i = 0; i < m_chunkCount; ++i)
 	{
-		cb2Free(m_chunks[i].blocks);
+		cb2Free(m_allocator, m_chunks[i].blocks);
 	}
 
 	m_chunkCount = 0;
 	memset(m_chunks, 0, m_chunkSpace * sizeof(cb2Chunk));
 
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+
+	// Large requests are not owned by the chunks and stay live.
+	memset(m_chunkCounts, 0, sizeof(m_chunkCounts));
+	memset(m_liveBlockCounts, 0, sizeof(m_liveBlockCounts));
+	m_liveBlockCount = 0;
+	m_liveBytes = m_largeBytes;
+}
+
+void cb2BlockAllocator::GetStats(cb2BlockAllocatorStats* stats) const
+{
+	stats->chunkCount = m_chunkCount;
+	stats->spareChunkCount = m_spareChunkCount;
+	stats->liveBlockCount = m_liveBlockCount;
+	stats->peakLiveBlockCount = m_peakLiveBlockCount;
+	stats->liveBytes = m_liveBytes;
+	stats->peakLiveBytes = m_peakLiveBytes;
+	stats->largeCount = m_largeCount;
+	stats->largeBytes = m_largeBytes;
+	for (int i = 0; i < cb2_blockSizes; ++i)
+	{
+		stats->blockSizes[i] = s_blockSizes[i];
+		stats->chunkCounts[i] = m_chunkCounts[i];
+		stats->liveBlockCounts[i] = m_liveBlockCounts[i];
+	}
+}
+
+static inline bool cb2ChunkLessThan(const cb2Chunk& chunk1, const cb2Chunk& chunk2)
+{
+	return chunk1.blocks < chunk2.blocks;
+}
+
+// Find the chunk holding a block, the chunks must be sorted by address.
+static int cb2FindChunk(const cb2Chunk* chunks, int count, const cb2Block* block)
+{
+	int low = 0;
+	int high = count - 1;
+	while (low < high)
+	{
+		int mid = (low + high + 1) / 2;
+		if (chunks[mid].blocks <= block)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+
+	cb2Assert((char*)chunks[low].blocks <= (char*)block && (char*)block < (char*)chunks[low].blocks + cb2_chunkSize);
+	return low;
+}
+
+int cb2BlockAllocator::Trim()
+{
+	if (m_chunkCount == 0)
+	{
+		return 0;
+	}
+
+	std::sort(m_chunks, m_chunks + m_chunkCount, cb2ChunkLessThan);
+
+	// Count the free blocks of each chunk.
+	int* freeCounts = (int*)cb2Alloc(m_allocator, m_chunkCount * sizeof(int));
+	memset(freeCounts, 0, m_chunkCount * sizeof(int));
+
+	for (int i = 0; i < cb2_blockSizes; ++i)
+	{
+		for (cb2Block* block = m_freeLists[i]; block; block = block->next)
+		{
+			++freeCounts[cb2FindChunk(m_chunks, m_chunkCount, block)];
+		}
+	}
+
+	// A chunk is released when every block in it is free. Its count becomes -1.
+	int releaseCount = 0;
+	for (int i = 0; i < m_chunkCount; ++i)
+	{
+		if (freeCounts[i] == cb2_chunkSize / m_chunks[i].blockSize)
+		{
+			freeCounts[i] = -1;
+			++releaseCount;
+		}
+	}
+
+	if (releaseCount == 0)
+	{
+		cb2Free(m_allocator, freeCounts);
+		return 0;
+	}
+
+	// Unlink the blocks of the released chunks, keeping the order of the rest.
+	for (int i = 0; i < cb2_blockSizes; ++i)
+	{
+		cb2Block** link = m_freeLists + i;
+		while (*link)
+		{
+			cb2Block* block = *link;
+			if (freeCounts[cb2FindChunk(m_chunks, m_chunkCount, block)] == -1)
+			{
+				*link = block->next;
+			}
+			else
+			{
+				link = &block->next;
+			}
+		}
+	}
+
+	int chunkCount = 0;
+	for (int i = 0; i < m_chunkCount; ++i)
+	{
+		if (freeCounts[i] == -1)
+		{
+			--m_chunkCounts[s_blockSizeLookup[m_chunks[i].blockSize]];
+			cb2Free(m_allocator, m_chunks[i].blocks);
+		}
+		else
+		{
+			m_chunks[chunkCount++] = m_chunks[i];
+		}
+	}
+
+	memset(m_chunks + chunkCount, 0, (m_chunkCount - chunkCount) * sizeof(cb2Chunk));
+	m_chunkCount = chunkCount;
+
+	cb2Free(m_allocator, freeCounts);
+	return releaseCount;
 }
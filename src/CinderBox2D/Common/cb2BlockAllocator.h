@@ -29,13 +29,31 @@ const int cb2_chunkArrayIncrement = 128;
 struct cb2Block;
 struct cb2Chunk;
 
+/// Memory counters of a cb2BlockAllocator. Requests above cb2_maxBlockSize
+/// are passed through to the backing allocator and counted separately.
+struct cb2BlockAllocatorStats
+{
+	int chunkCount;							///< chunks held, cb2_chunkSize bytes each
+	int spareChunkCount;					///< chunks reserved and not yet given a size class
+	int liveBlockCount;						///< blocks handed out and not freed
+	int peakLiveBlockCount;					///< the most blocks ever handed out at once
+	int liveBytes;							///< bytes handed out, including large requests
+	int peakLiveBytes;						///< the most bytes ever handed out at once
+	int largeCount;							///< live requests above cb2_maxBlockSize
+	int largeBytes;							///< bytes of the live large requests
+	int blockSizes[cb2_blockSizes];			///< the block size of each size class
+	int chunkCounts[cb2_blockSizes];		///< chunks held per size class
+	int liveBlockCounts[cb2_blockSizes];	///< blocks handed out per size class
+};
+
 /// This is a small object allocator used for allocating small
 /// objects that persist for more than one time step.
 /// See: http://www.codeproject.com/useritems/Small_Block_Allocator.asp
 class cb2BlockAllocator
 {
 public:
-	cb2BlockAllocator();
+	/// @param allocator backs the chunks and large requests, NULL for cb2Alloc.
+	cb2BlockAllocator(cb2AllocatorInterface* allocator = NULL);
 	~cb2BlockAllocator();
 
 	/// Allocate memory. This will use cb2Alloc if the size is larger than cb2_maxBlockSize.
@@ -46,14 +64,46 @@ public:
 
 	void Clear();
 
+	/// Hold enough spare chunks for size more bytes of blocks of any size class, so
+	/// that the next allocations need not grow the allocator. Allocate takes the
+	/// spares before it asks the backing allocator.
+	void Reserve(int size);
+
+	/// Get the memory counters.
+	void GetStats(cb2BlockAllocatorStats* stats) const;
+
+	/// Release the chunks whose blocks are all free back to the backing allocator.
+	/// This walks every free block, so don't call it every step.
+	/// @return the number of chunks released.
+	int Trim();
+
 private:
 
+	cb2AllocatorInterface* m_allocator;
+
 	cb2Chunk* m_chunks;
 	int m_chunkCount;
 	int m_chunkSpace;
 
 	cb2Block* m_freeLists[cb2_blockSizes];
 
+	// Chunk memory from Reserve, linked through its first block.
+	cb2Block* m_spareChunks;
+	int m_spareChunkCount;
+
+	int m_chunkCounts[cb2_blockSizes];
+	int m_liveBlockCounts[cb2_blockSizes];
+	int m_liveBlockCount;
+	int m_peakLiveBlockCount;
+	int m_liveBytes;
+	int m_peakLiveBytes;
+	int m_largeCount;
+	int m_largeBytes;
+
+	void GrowChunkArray(int chunkCount);
+
+	static void InitializeBlockSizeLookup();
+
 	static int s_blockSizes[cb2_blockSizes];
 	static unsigned char s_blockSizeLookup[cb2_maxBlockSize + 1];
 	static bool s_blockSizeLookupInitialized;
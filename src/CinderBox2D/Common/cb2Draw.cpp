@@ -42,3 +42,11 @@ void cb2Draw::ClearFlags(unsigned int flags)
 {
 	m_drawFlags &= ~flags;
 }
+
+void cb2Draw::DrawParticles(const ci::Vec2f* centers, float radius, int count, const cb2Color& color)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		DrawCircle(centers[i], radius, color);
+	}
+}
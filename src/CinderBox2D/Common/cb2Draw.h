@@ -79,6 +79,10 @@ public:
 	/// @param xf a transform.
 	virtual void DrawTransform(const cb2Transform& xf) = 0;
 
+	/// Draw particles of the same radius. The default draws a circle per particle,
+	/// override it to draw them in one batch.
+	virtual void DrawParticles(const ci::Vec2f* centers, float radius, int count, const cb2Color& color);
+
 protected:
 	unsigned int m_drawFlags;
 };
@@ -0,0 +1,209 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Common/cb2DrawBatch.h>
+#include <memory.h>
+
+cb2DrawBatch::cb2DrawBatch()
+{
+	memset(&m_triangles, 0, sizeof(Mesh));
+	memset(&m_lines, 0, sizeof(Mesh));
+	m_unitCircle = NULL;
+	m_circle = NULL;
+	m_circleSegments = 0;
+	SetCircleSegments(16);
+	m_axisScale = 0.4f;
+}
+
+cb2DrawBatch::~cb2DrawBatch()
+{
+	cb2Free(m_triangles.vertices);
+	cb2Free(m_triangles.indices);
+	cb2Free(m_lines.vertices);
+	cb2Free(m_lines.indices);
+	cb2Free(m_unitCircle);
+	cb2Free(m_circle);
+}
+
+void cb2DrawBatch::Clear()
+{
+	m_triangles.vertexCount = 0;
+	m_triangles.indexCount = 0;
+	m_lines.vertexCount = 0;
+	m_lines.indexCount = 0;
+}
+
+void cb2DrawBatch::SetCircleSegments(int count)
+{
+	cb2Assert(count >= 3);
+
+	cb2Free(m_unitCircle);
+	cb2Free(m_circle);
+	m_circleSegments = count;
+	m_unitCircle = (ci::Vec2f*)cb2Alloc(count * sizeof(ci::Vec2f));
+	m_circle = (ci::Vec2f*)cb2Alloc(count * sizeof(ci::Vec2f));
+
+	for (int i = 0; i < count; ++i)
+	{
+		float s, c;
+		cb2SinCos(2.0f * cb2_pi * i / count, &s, &c);
+		m_unitCircle[i].set(c, s);
+	}
+}
+
+void cb2DrawBatch::SetAxisScale(float scale)
+{
+	m_axisScale = scale;
+}
+
+void cb2DrawBatch::Reserve(Mesh* mesh, int vertexCount, int indexCount)
+{
+	if (mesh->vertexCount + vertexCount > mesh->vertexCapacity)
+	{
+		int capacity = cb2Max(2 * mesh->vertexCapacity, mesh->vertexCount + vertexCount);
+		capacity = cb2Max(capacity, 256);
+		cb2DrawVertex* old = mesh->vertices;
+		mesh->vertices = (cb2DrawVertex*)cb2Alloc(capacity * sizeof(cb2DrawVertex));
+		if (old)
+		{
+			memcpy(mesh->vertices, old, mesh->vertexCount * sizeof(cb2DrawVertex));
+			cb2Free(old);
+		}
+		mesh->vertexCapacity = capacity;
+	}
+
+	if (mesh->indexCount + indexCount > mesh->indexCapacity)
+	{
+		int capacity = cb2Max(2 * mesh->indexCapacity, mesh->indexCount + indexCount);
+		capacity = cb2Max(capacity, 256);
+		unsigned int* old = mesh->indices;
+		mesh->indices = (unsigned int*)cb2Alloc(capacity * sizeof(unsigned int));
+		if (old)
+		{
+			memcpy(mesh->indices, old, mesh->indexCount * sizeof(unsigned int));
+			cb2Free(old);
+		}
+		mesh->indexCapacity = capacity;
+	}
+}
+
+void cb2DrawBatch::AddVertex(Mesh* mesh, const ci::Vec2f& position, const cb2Color& color, float alpha)
+{
+	cb2Assert(mesh->vertexCount < mesh->vertexCapacity);
+	cb2DrawVertex* v = mesh->vertices + mesh->vertexCount;
+	v->position = position;
+	v->r = color.r;
+	v->g = color.g;
+	v->b = color.b;
+	v->a = alpha;
+	++mesh->vertexCount;
+}
+
+void cb2DrawBatch::AddLoop(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color)
+{
+	Reserve(&m_lines, vertexCount, 2 * vertexCount);
+
+	unsigned int base = m_lines.vertexCount;
+	unsigned int* indices = m_lines.indices + m_lines.indexCount;
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		AddVertex(&m_lines, vertices[i], color, 1.0f);
+		indices[2 * i] = base + i;
+		indices[2 * i + 1] = base + (i + 1 < vertexCount ? i + 1 : 0);
+	}
+	m_lines.indexCount += 2 * vertexCount;
+}
+
+void cb2DrawBatch::AddFan(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color)
+{
+	if (vertexCount < 3)
+	{
+		return;
+	}
+
+	Reserve(&m_triangles, vertexCount, 3 * (vertexCount - 2));
+
+	cb2Color fill(0.5f * color.r, 0.5f * color.g, 0.5f * color.b);
+	unsigned int base = m_triangles.vertexCount;
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		AddVertex(&m_triangles, vertices[i], fill, 0.5f);
+	}
+
+	unsigned int* indices = m_triangles.indices + m_triangles.indexCount;
+	for (int i = 1; i < vertexCount - 1; ++i)
+	{
+		indices[0] = base;
+		indices[1] = base + i;
+		indices[2] = base + i + 1;
+		indices += 3;
+	}
+	m_triangles.indexCount += 3 * (vertexCount - 2);
+}
+
+void cb2DrawBatch::MakeCircle(const ci::Vec2f& center, float radius)
+{
+	for (int i = 0; i < m_circleSegments; ++i)
+	{
+		m_circle[i] = center + radius * m_unitCircle[i];
+	}
+}
+
+void cb2DrawBatch::DrawPolygon(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color)
+{
+	AddLoop(vertices, vertexCount, color);
+}
+
+void cb2DrawBatch::DrawSolidPolygon(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color)
+{
+	AddFan(vertices, vertexCount, color);
+	AddLoop(vertices, vertexCount, color);
+}
+
+void cb2DrawBatch::DrawCircle(const ci::Vec2f& center, float radius, const cb2Color& color)
+{
+	MakeCircle(center, radius);
+	AddLoop(m_circle, m_circleSegments, color);
+}
+
+void cb2DrawBatch::DrawSolidCircle(const ci::Vec2f& center, float radius, const ci::Vec2f& axis, const cb2Color& color)
+{
+	MakeCircle(center, radius);
+	AddFan(m_circle, m_circleSegments, color);
+	AddLoop(m_circle, m_circleSegments, color);
+	DrawSegment(center, center + radius * axis, color);
+}
+
+void cb2DrawBatch::DrawSegment(const ci::Vec2f& p1, const ci::Vec2f& p2, const cb2Color& color)
+{
+	Reserve(&m_lines, 2, 2);
+
+	unsigned int base = m_lines.vertexCount;
+	AddVertex(&m_lines, p1, color, 1.0f);
+	AddVertex(&m_lines, p2, color, 1.0f);
+	m_lines.indices[m_lines.indexCount] = base;
+	m_lines.indices[m_lines.indexCount + 1] = base + 1;
+	m_lines.indexCount += 2;
+}
+
+void cb2DrawBatch::DrawTransform(const cb2Transform& xf)
+{
+	DrawSegment(xf.p, xf.p + m_axisScale * xf.q.GetXAxis(), cb2Color(1.0f, 0.0f, 0.0f));
+	DrawSegment(xf.p, xf.p + m_axisScale * xf.q.GetYAxis(), cb2Color(0.0f, 1.0f, 0.0f));
+}
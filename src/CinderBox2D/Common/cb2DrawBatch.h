@@ -0,0 +1,102 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_DRAW_BATCH_H
+#define CB2_DRAW_BATCH_H
+
+#include <CinderBox2D/Common/cb2Draw.h>
+
+/// A vertex of the batched debug draw output.
+struct cb2DrawVertex
+{
+	ci::Vec2f position;
+	float r, g, b, a;
+};
+
+/// A debug draw that collects the primitives of a frame into vertex and index arrays
+/// instead of drawing them, so a renderer can upload them to two meshes and draw the
+/// whole frame in two calls. Solid shapes go to the triangles, filled with half the
+/// color at half alpha, and their outlines and everything else go to the lines.
+/// Circles are tessellated into a fixed number of segments. Register it with
+/// cb2World::SetDebugDraw, call Clear and then cb2World::DrawDebugData each frame,
+/// and read the arrays. The arrays stay valid until the next call that adds to them.
+class cb2DrawBatch : public cb2Draw
+{
+public:
+	cb2DrawBatch();
+	~cb2DrawBatch();
+
+	/// Remove all primitives, keeping the memory.
+	void Clear();
+
+	/// Set the number of segments of a circle, at least 3. The default is 16.
+	void SetCircleSegments(int count);
+
+	/// Set the length of the axes drawn by DrawTransform. The default is 0.4.
+	void SetAxisScale(float scale);
+
+	/// The triangle list, three indices per triangle.
+	const cb2DrawVertex* GetTriangleVertices() const { return m_triangles.vertices; }
+	int GetTriangleVertexCount() const { return m_triangles.vertexCount; }
+	const unsigned int* GetTriangleIndices() const { return m_triangles.indices; }
+	int GetTriangleIndexCount() const { return m_triangles.indexCount; }
+
+	/// The line list, two indices per line.
+	const cb2DrawVertex* GetLineVertices() const { return m_lines.vertices; }
+	int GetLineVertexCount() const { return m_lines.vertexCount; }
+	const unsigned int* GetLineIndices() const { return m_lines.indices; }
+	int GetLineIndexCount() const { return m_lines.indexCount; }
+
+	void DrawPolygon(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color);
+	void DrawSolidPolygon(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color);
+	void DrawCircle(const ci::Vec2f& center, float radius, const cb2Color& color);
+	void DrawSolidCircle(const ci::Vec2f& center, float radius, const ci::Vec2f& axis, const cb2Color& color);
+	void DrawSegment(const ci::Vec2f& p1, const ci::Vec2f& p2, const cb2Color& color);
+	void DrawTransform(const cb2Transform& xf);
+
+private:
+
+	struct Mesh
+	{
+		cb2DrawVertex* vertices;
+		int vertexCount;
+		int vertexCapacity;
+		unsigned int* indices;
+		int indexCount;
+		int indexCapacity;
+	};
+
+	static void Reserve(Mesh* mesh, int vertexCount, int indexCount);
+	static void AddVertex(Mesh* mesh, const ci::Vec2f& position, const cb2Color& color, float alpha);
+
+	void AddLoop(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color);
+	void AddFan(const ci::Vec2f* vertices, int vertexCount, const cb2Color& color);
+	void MakeCircle(const ci::Vec2f& center, float radius);
+
+	Mesh m_triangles;
+	Mesh m_lines;
+
+	// The unit circle and the scratch points of the circle being drawn.
+	ci::Vec2f* m_unitCircle;
+	ci::Vec2f* m_circle;
+	int m_circleSegments;
+	float m_axisScale;
+};
+
+#endif
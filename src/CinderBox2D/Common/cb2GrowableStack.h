@@ -50,6 +50,7 @@ public:
 		{
 			T* old = m_stack;
 			m_capacity *= 2;
+			cb2AuditAllocation();
 			m_stack = (T*)cb2Alloc(m_capacity * sizeof(T));
 			memcpy(m_stack, old, m_count * sizeof(T));
 			if (old != m_array)
@@ -0,0 +1,198 @@
+/*
+* Copyright (c) 2006-2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Common/cb2HandleTable.h>
+#include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <memory.h>
+#include <algorithm>
+
+cb2HandleTable::cb2HandleTable(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
+	m_slots = NULL;
+	m_capacity = 0;
+	m_count = 0;
+	m_freeList = -1;
+}
+
+cb2HandleTable::~cb2HandleTable()
+{
+	cb2Free(m_allocator, m_slots);
+}
+
+// Grow the slot pool, adding the new slots to the front of the free list.
+void cb2HandleTable::Grow(int capacity)
+{
+	cb2Assert(capacity > m_capacity);
+
+	int oldCapacity = m_capacity;
+	cb2HandleSlot* oldSlots = m_slots;
+	m_capacity = capacity;
+	m_slots = (cb2HandleSlot*)cb2Alloc(m_allocator, m_capacity * sizeof(cb2HandleSlot));
+	if (oldSlots)
+	{
+		memcpy(m_slots, oldSlots, oldCapacity * sizeof(cb2HandleSlot));
+		cb2Free(m_allocator, oldSlots);
+	}
+
+	// Build a linked list for the free list. Generation zero is never handed
+	// out, so zeroed handles don't resolve.
+	for (int i = oldCapacity; i < m_capacity; ++i)
+	{
+		m_slots[i].object = NULL;
+		m_slots[i].generation = 1;
+		m_slots[i].next = i + 1;
+	}
+	m_slots[m_capacity - 1].next = m_freeList;
+	m_freeList = oldCapacity;
+}
+
+void cb2HandleTable::Reserve(int capacity)
+{
+	if (capacity > m_capacity)
+	{
+		Grow(capacity);
+	}
+}
+
+cb2Handle cb2HandleTable::Create(void* object)
+{
+	cb2Assert(object != NULL);
+
+	// Expand the slot pool as needed.
+	if (m_freeList == -1)
+	{
+		cb2Assert(m_count == m_capacity);
+		Grow(cb2Max(2 * m_capacity, 16));
+	}
+
+	// Peel a slot off the free list.
+	int index = m_freeList;
+	cb2HandleSlot* slot = m_slots + index;
+	m_freeList = slot->next;
+
+	slot->object = object;
+	slot->next = -1;
+	++m_count;
+
+	cb2Handle handle;
+	handle.index = index;
+	handle.generation = slot->generation;
+	return handle;
+}
+
+void cb2HandleTable::Destroy(cb2Handle handle)
+{
+	cb2Assert(Get(handle) != NULL);
+
+	cb2HandleSlot* slot = m_slots + handle.index;
+
+	// Bump the generation now so stale handles stop resolving even before the
+	// slot is reused.
+	++slot->generation;
+	if (slot->generation == 0)
+	{
+		slot->generation = 1;
+	}
+	slot->object = NULL;
+	slot->next = m_freeList;
+	m_freeList = handle.index;
+	--m_count;
+}
+
+void cb2HandleTable::Save(cb2Snapshot* snapshot) const
+{
+	snapshot->Write(m_capacity);
+	snapshot->Write(m_count);
+	snapshot->Write(m_freeList);
+	for (int i = 0; i < m_capacity; ++i)
+	{
+		snapshot->Write(m_slots[i].generation);
+		snapshot->Write(m_slots[i].next);
+	}
+}
+
+bool cb2HandleTable::Load(cb2Snapshot* snapshot)
+{
+	int capacity = snapshot->ReadCount(2 * sizeof(int));
+	int count = snapshot->Read<int>();
+	int freeList = snapshot->Read<int>();
+	if (snapshot->IsValid() == false || count < 0 || count > capacity || freeList < -1 || freeList >= capacity)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	cb2HandleSlot* slots = NULL;
+	if (capacity > 0)
+	{
+		slots = (cb2HandleSlot*)cb2Alloc(m_allocator, capacity * sizeof(cb2HandleSlot));
+	}
+
+	for (int i = 0; i < capacity; ++i)
+	{
+		slots[i].object = NULL;
+		slots[i].generation = snapshot->Read<unsigned int>();
+		slots[i].next = snapshot->Read<int>();
+		if (slots[i].next < -1 || slots[i].next >= capacity)
+		{
+			snapshot->Invalidate();
+		}
+	}
+
+	if (snapshot->IsValid() == false)
+	{
+		cb2Free(m_allocator, slots);
+		return false;
+	}
+
+	cb2Free(m_allocator, m_slots);
+	m_slots = slots;
+	m_capacity = capacity;
+	m_count = count;
+	m_freeList = freeList;
+	return true;
+}
+
+bool cb2HandleTable::Bind(cb2Handle handle, void* object)
+{
+	cb2Assert(object != NULL);
+	if (handle.index < 0 || handle.index >= m_capacity)
+	{
+		return false;
+	}
+
+	cb2HandleSlot* slot = m_slots + handle.index;
+	if (slot->generation != handle.generation || slot->next != -1 || slot->object != NULL)
+	{
+		return false;
+	}
+
+	slot->object = object;
+	return true;
+}
+
+void cb2HandleTable::Swap(cb2HandleTable* other)
+{
+	cb2Assert(m_allocator == other->m_allocator);
+	std::swap(m_slots, other->m_slots);
+	std::swap(m_capacity, other->m_capacity);
+	std::swap(m_count, other->m_count);
+	std::swap(m_freeList, other->m_freeList);
+}
@@ -0,0 +1,123 @@
+/*
+* Copyright (c) 2006-2009 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_HANDLE_TABLE_H
+#define CB2_HANDLE_TABLE_H
+
+#include <CinderBox2D/Common/cb2Settings.h>
+
+class cb2Snapshot;
+
+/// A generation checked reference to a body, fixture or joint of a world. Unlike
+/// a pointer, a handle of a destroyed object never resolves, even after its slot
+/// has been reused. Handles are plain values, so they can be sent over a network.
+struct cb2Handle
+{
+	int index;
+	unsigned int generation;
+
+	bool operator==(const cb2Handle& other) const
+	{
+		return index == other.index && generation == other.generation;
+	}
+
+	bool operator!=(const cb2Handle& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+/// The handle that never resolves.
+const cb2Handle cb2_nullHandle = { -1, 0 };
+
+/// Maps handles to objects in constant time. Slots are recycled through a free
+/// list and each reuse bumps the slot generation. This is an internal class.
+class cb2HandleTable
+{
+public:
+	/// @param allocator where the slots come from, NULL for cb2Alloc.
+	cb2HandleTable(cb2AllocatorInterface* allocator = NULL);
+	~cb2HandleTable();
+
+	/// Make a new handle referring to the object.
+	cb2Handle Create(void* object);
+
+	/// Release a handle. It stops resolving immediately.
+	void Destroy(cb2Handle handle);
+
+	/// Get the object of a handle, NULL if it was destroyed or never existed.
+	void* Get(cb2Handle handle) const;
+
+	/// Get the number of live handles.
+	int GetCount() const { return m_count; }
+
+	/// Get the number of slots, every handle index is below it.
+	int GetCapacity() const { return m_capacity; }
+
+	/// Grow the slot pool to hold at least this many handles.
+	void Reserve(int capacity);
+
+	/// Save the slots with their generations, but not the objects.
+	void Save(cb2Snapshot* snapshot) const;
+
+	/// Replace the slots by saved ones. The live handles resolve to NULL until
+	/// their objects are bound again. Returns false for a bad snapshot.
+	bool Load(cb2Snapshot* snapshot);
+
+	/// Give a loaded live handle its object. Returns false if the handle is not
+	/// live in the loaded slots or already has an object.
+	bool Bind(cb2Handle handle, void* object);
+
+	/// Exchange the slots with another table of the same allocator.
+	void Swap(cb2HandleTable* other);
+
+private:
+
+	void Grow(int capacity);
+
+	struct cb2HandleSlot
+	{
+		void* object;
+		unsigned int generation;
+		int next;
+	};
+
+	cb2AllocatorInterface* m_allocator;
+	cb2HandleSlot* m_slots;
+	int m_capacity;
+	int m_count;
+	int m_freeList;
+};
+
+inline void* cb2HandleTable::Get(cb2Handle handle) const
+{
+	if (handle.index < 0 || handle.index >= m_capacity)
+	{
+		return NULL;
+	}
+
+	const cb2HandleSlot* slot = m_slots + handle.index;
+	if (slot->generation != handle.generation)
+	{
+		return NULL;
+	}
+
+	return slot->object;
+}
+
+#endif
@@ -120,3 +120,98 @@ void getSymInverse33( const ci::Matrix33f& A, ci::Matrix33f* M )
 }
 
 }
+
+#if defined(CB2_DETERMINISTIC)
+
+// These follow the single precision Cephes routines. The angle is reduced to
+// [-pi/4, pi/4] by an integer multiple of pi/2 split into three parts, so the
+// reduction stays exact for the angles bodies reach in practice.
+void cb2SinCos(float angle, float* s, float* c)
+{
+	const float twoOverPi = 0.636619772367581343f;
+	const float dp1 = 1.5703125f;
+	const float dp2 = 4.837512969970703125e-4f;
+	const float dp3 = 7.54978995489188216e-8f;
+
+	float k = floorf(angle * twoOverPi + 0.5f);
+	float x = ((angle - k * dp1) - k * dp2) - k * dp3;
+	float z = x * x;
+
+	float sx = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+	float cx = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+
+	int quadrant = (int)k & 3;
+	switch (quadrant)
+	{
+	case 0:
+		*s = sx;
+		*c = cx;
+		break;
+
+	case 1:
+		*s = cx;
+		*c = -sx;
+		break;
+
+	case 2:
+		*s = -sx;
+		*c = -cx;
+		break;
+
+	default:
+		*s = -cx;
+		*c = sx;
+		break;
+	}
+}
+
+// Arc tangent of a non-negative value.
+static float cb2AtanPositive(float x)
+{
+	const float tan3PiOver8 = 2.414213562373095f;
+	const float tanPiOver8 = 0.4142135623730950f;
+
+	float offset = 0.0f;
+	if (x > tan3PiOver8)
+	{
+		offset = 0.5f * cb2_pi;
+		x = -1.0f / x;
+	}
+	else if (x > tanPiOver8)
+	{
+		offset = 0.25f * cb2_pi;
+		x = (x - 1.0f) / (x + 1.0f);
+	}
+
+	float z = x * x;
+	return offset + (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * x + x;
+}
+
+float cb2Atan2(float y, float x)
+{
+	if (x == 0.0f)
+	{
+		if (y > 0.0f)
+		{
+			return 0.5f * cb2_pi;
+		}
+
+		if (y < 0.0f)
+		{
+			return -0.5f * cb2_pi;
+		}
+
+		return 0.0f;
+	}
+
+	float a = cb2AtanPositive(cb2Abs(y / x));
+
+	if (x < 0.0f)
+	{
+		a = cb2_pi - a;
+	}
+
+	return y < 0.0f ? -a : a;
+}
+
+#endif
@@ -76,9 +76,69 @@ void getInverse22( const ci::Matrix33f& A, ci::Matrix33f* M);
 void getSymInverse33( const ci::Matrix33f& A, ci::Matrix33f* M );
 }
 
+#if defined(CB2_DETERMINISTIC)
+#if defined(__FAST_MATH__)
+#error CB2_DETERMINISTIC does not work with fast math.
+#endif
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#error CB2_DETERMINISTIC needs single precision float evaluation, build with SSE2.
+#endif
+#endif
+
+// IEEE 754 requires the square root to be correctly rounded, so this is portable.
 #define	cb2Sqrt(x)	sqrtf(x)
+
+#if defined(CB2_DETERMINISTIC)
+
+/// Compute the sine and cosine of an angle using only basic arithmetic,
+/// so the result does not depend on the C library.
+void cb2SinCos(float angle, float* s, float* c);
+
+/// Compute atan2 using only basic arithmetic.
+float cb2Atan2(float y, float x);
+
+#elif defined(CB2_FAST_TRIG)
+
+/// Compute the sine and cosine of an angle with an inline polynomial. The angle is
+/// reduced by a multiple of pi/2 in two parts, so the error stays within a few ulp
+/// up to about a thousand radians and grows slowly past that.
+inline void cb2SinCos(float angle, float* s, float* c)
+{
+	const float twoOverPi = 0.636619772367581343f;
+	const float dp1 = 1.5703125f;
+	const float dp2 = 4.83826794897e-4f;
+
+	float t = angle * twoOverPi;
+	int k = (int)(t + (t < 0.0f ? -0.5f : 0.5f));
+	float kf = (float)k;
+	float x = (angle - kf * dp1) - kf * dp2;
+	float z = x * x;
+
+	float sx = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+	float cx = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+
+	// Rotate the result by the quadrant with selects the compiler can keep branch free.
+	float rs = (k & 1) ? cx : sx;
+	float rc = (k & 1) ? -sx : cx;
+	float sign = (k & 2) ? -1.0f : 1.0f;
+	*s = sign * rs;
+	*c = sign * rc;
+}
+
 #define	cb2Atan2(y, x)	atan2f(y, x)
 
+#else
+
+inline void cb2SinCos(float angle, float* s, float* c)
+{
+	*s = sinf(angle);
+	*c = cosf(angle);
+}
+
+#define	cb2Atan2(y, x)	atan2f(y, x)
+
+#endif
+
 
 /// Rotation
 struct cb2Rot
@@ -88,17 +148,13 @@ struct cb2Rot
 	/// Initialize from an angle in radians
 	explicit cb2Rot(float angle)
 	{
-		/// TODO_ERIN optimize
-		s = sinf(angle);
-		c = cosf(angle);
+		cb2SinCos(angle, &s, &c);
 	}
 
 	/// set using an angle in radians.
 	void set(float angle)
 	{
-		/// TODO_ERIN optimize
-		s = sinf(angle);
-		c = cosf(angle);
+		cb2SinCos(angle, &s, &c);
 	}
 
 	/// set to the identity rotation
@@ -34,6 +34,34 @@ void cb2Free(void* mem)
 	free(mem);
 }
 
+// The audit of the step running on this thread, if any.
+static thread_local cb2AllocationAuditScope* cb2_auditScope = NULL;
+
+void cb2AuditAllocation()
+{
+	cb2AllocationAuditScope* scope = cb2_auditScope;
+	if (scope)
+	{
+		scope->count.fetch_add(1, std::memory_order_relaxed);
+
+		// A heap allocation during a step. Reserve the pools up front, see
+		// cb2World::SetAllocationAudit.
+		cb2Assert(scope->audit != cb2_auditAssert);
+	}
+}
+
+cb2AllocationAuditScope* cb2SetAllocationAuditScope(cb2AllocationAuditScope* scope)
+{
+	cb2AllocationAuditScope* previous = cb2_auditScope;
+	cb2_auditScope = scope;
+	return previous;
+}
+
+cb2AllocationAuditScope* cb2GetAllocationAuditScope()
+{
+	return cb2_auditScope;
+}
+
 // You can modify this to use your logging facility.
 void cb2Log(const char* string, ...)
 {
@@ -23,6 +23,7 @@
 #include <stddef.h>
 #include <assert.h>
 #include <float.h>
+#include <atomic>
 
 #define CB2_NOT_USED(x) ((void)(x))
 #define cb2Assert(A) assert(A)
@@ -41,9 +42,16 @@
 /// not change this value.
 #define cb2_maxManifoldPoints	2
 
-/// The maximum number of vertices on a convex polygon. You cannot increase
-/// this too much because cb2BlockAllocator has a maximum object size.
+/// The maximum number of vertices on a convex polygon. Define CB2_MAX_POLYGON_VERTICES
+/// in the build to allow smoother convex shapes. Every polygon stores this many
+/// vertices, so boxes grow with it, and polygons larger than the maximum object size
+/// of cb2BlockAllocator come from cb2Alloc. It must stay below 256, the contact
+/// features store vertex indices in a byte.
+#ifdef CB2_MAX_POLYGON_VERTICES
+#define cb2_maxPolygonVertices	CB2_MAX_POLYGON_VERTICES
+#else
 #define cb2_maxPolygonVertices	8
+#endif
 
 /// This is used to fatten AABBs in the dynamic tree. This allows proxies
 /// to move by a small amount without triggering a tree adjustment.
@@ -55,6 +63,19 @@
 /// This is a dimensionless multiplier.
 #define cb2_aabbMultiplier		2.0f
 
+/// The most of the current displacement the fat AABB of a fast proxy predicts,
+/// see cb2ComputeFatAABB. Set it to cb2_aabbMultiplier for fixed margins.
+/// This is a dimensionless multiplier.
+#define cb2_aabbMaxMultiplier	8.0f
+
+/// Moving proxies get this fraction of their smaller half extent as extra margin,
+/// up to four times cb2_aabbExtension, so big slow bodies leave their fat AABB
+/// less often. Set it to zero for fixed margins.
+#define cb2_aabbSizeExtension	0.1f
+
+/// The number of bins used by the binned SAH when the dynamic tree is built top-down.
+#define cb2_treeBinCount		16
+
 /// A small length used as a collision and constraint tolerance. Usually it is
 /// chosen to be numerically significant, but visually insignificant.
 #define cb2_linearSlop			0.005f
@@ -77,6 +98,13 @@
 /// Maximum number of contacts to be handled to solve a TOI impact.
 #define cb2_maxTOIContacts			32
 
+/// Speculative contacts also get points within this distance of meeting, which covers
+/// some of the velocity bodies pick up in the solve, see cb2World::SetSpeculativeContacts.
+#define cb2_speculativeDistance		(4.0f * cb2_linearSlop)
+
+/// The number of simulation detail levels, see cb2World::SetLodDef.
+#define cb2_maxLodLevels			4
+
 /// A velocity threshold for elastic collisions. Any collision with a relative linear
 /// velocity below this threshold will be treated as inelastic.
 #define cb2_velocityThreshold		1.0f
@@ -105,6 +133,51 @@
 #define cb2_baumgarte				0.2f
 #define cb2_toiBaugarte				0.75f
 
+/// The stiffness of contacts in the soft step solver, in Hertz. It is capped at a
+/// quarter of the substep rate so the springs stay stable.
+#define cb2_contactHertz			30.0f
+
+/// The damping ratio of contacts in the soft step solver. Contacts are heavily
+/// overdamped so stacks do not bounce.
+#define cb2_contactDampingRatio		10.0f
+
+/// The maximum speed at which the soft step solver pushes overlapping bodies apart.
+#define cb2_contactPushoutVelocity	3.0f
+
+/// Contact reduction merges the manifolds of a body pair whose normals are within
+/// this angle of each other, see cb2World::SetContactReduction.
+#define cb2_reductionAngularTolerance	(5.0f / 180.0f * cb2_pi)
+
+/// Define CB2_SIMD_SOLVER to solve contact velocity constraints four at a time
+/// using SSE2 or NEON. Contacts are reordered into batches that share no moving
+/// body, so the results differ from the default scalar solver.
+//#define CB2_SIMD_SOLVER
+
+/// Define CB2_DETERMINISTIC for results that are bit identical across compilers,
+/// standard libraries and CPUs, for example for lockstep networking. Sine, cosine
+/// and atan2 then use the portable versions in cb2Math.cpp. The library and the code
+/// that feeds it must be built without floating point contraction or fast math
+/// (-ffp-contract=off, /fp:precise) and with SSE2 on 32-bit x86. Worlds must use
+/// the same number of threads on every peer, see cb2_graphColoringThreshold.
+//#define CB2_DETERMINISTIC
+
+/// Define CB2_FAST_TRIG to compute the rotations of bodies with an inline polynomial
+/// instead of sinf and cosf, see cb2SinCos. It is about as accurate as the C library
+/// for the angles bodies reach, but results differ slightly from the default build.
+/// CB2_DETERMINISTIC takes precedence.
+//#define CB2_FAST_TRIG
+
+/// Define CB2_TRACE to report the phases of each step as zones to a cb2TraceListener,
+/// see cb2Trace.h. Without it the zones compile to nothing.
+//#define CB2_TRACE
+
+/// Islands with at least this many contacts and joints are split into graph colors
+/// and solved across the task scheduler threads, if there are any.
+#define cb2_graphColoringThreshold	256
+
+/// The number of graph colors. Constraints that find no free color are solved
+/// serially after all the colors.
+#define cb2_graphColorCount			32
 
 // Sleep
 
@@ -117,6 +190,24 @@
 /// A body cannot sleep if its angular velocity is above this tolerance.
 #define cb2_angularSleepTolerance	(2.0f / 180.0f * cb2_pi)
 
+/// With the energy sleep test single bodies may still move at up to this many times
+/// their sleep tolerances, see cb2SleepDef::energyTest.
+#define cb2_energySleepFactor		4.0f
+
+/// Adaptive velocity iterations stop once the velocity change still to come is
+/// estimated to be below these tolerances, well under the sleep tolerances.
+#define cb2_linearIterationTolerance	(0.1f * cb2_linearSleepTolerance)
+#define cb2_angularIterationTolerance	(0.1f * cb2_angularSleepTolerance)
+
+/// Adaptive velocity iterations never stop before this many iterations.
+#define cb2_minAdaptiveIterations	4
+
+/// The direct joint solver softens the joints whose effective mass has a smaller
+/// determinant than this times its squared trace, they repeat other joints. The
+/// softness is this fraction of the trace.
+#define cb2_articulationConditioning	1.0e-4f
+#define cb2_articulationSoftness		1.0e-2f
+
 // Memory Allocation
 
 /// Implement this function to use your own memory allocator.
@@ -125,6 +216,70 @@ void* cb2Alloc(int size);
 /// If you implement cb2Alloc, you should also implement this function.
 void cb2Free(void* mem);
 
+/// Implement this to route the memory of a world into your own heap instead of
+/// cb2Alloc. The interface must remain valid for the lifetime of the world. With a
+/// task scheduler it is called from the worker threads, so it must be thread safe.
+/// @see cb2World::cb2World
+class cb2AllocatorInterface
+{
+public:
+	virtual ~cb2AllocatorInterface() {}
+
+	/// Allocate size bytes, aligned for any type like malloc.
+	virtual void* Allocate(int size) = 0;
+
+	/// Free memory returned by Allocate.
+	virtual void Free(void* mem) = 0;
+};
+
+/// How a world watches the heap while it steps, see cb2World::SetAllocationAudit.
+enum cb2AllocationAudit
+{
+	cb2_auditOff,
+	cb2_auditCount,		///< count the heap allocations of each step, see cb2Profile
+	cb2_auditAssert		///< also assert on each heap allocation made during a step
+};
+
+/// The heap audit of one stepping world. Each thread counts its allocations against
+/// its own audit scope, threads without one are not audited.
+struct cb2AllocationAuditScope
+{
+	cb2AllocationAudit audit;
+	std::atomic<int> count;
+};
+
+/// Report a heap allocation to the audit scope of the calling thread. The library
+/// calls this for all of its heap allocations that can happen during a step.
+void cb2AuditAllocation();
+
+/// Make the heap allocations of the calling thread count against scope, NULL stops
+/// auditing the thread.
+/// @return the scope the thread had before.
+cb2AllocationAuditScope* cb2SetAllocationAuditScope(cb2AllocationAuditScope* scope);
+
+/// Get the audit scope of the calling thread.
+cb2AllocationAuditScope* cb2GetAllocationAuditScope();
+
+/// Allocate from an allocator interface, or with cb2Alloc if it is NULL.
+inline void* cb2Alloc(cb2AllocatorInterface* allocator, int size)
+{
+	cb2AuditAllocation();
+	return allocator ? allocator->Allocate(size) : cb2Alloc(size);
+}
+
+/// Free memory from cb2Alloc(allocator, size).
+inline void cb2Free(cb2AllocatorInterface* allocator, void* mem)
+{
+	if (allocator)
+	{
+		allocator->Free(mem);
+	}
+	else
+	{
+		cb2Free(mem);
+	}
+}
+
 /// Logging function.
 void cb2Log(const char* string, ...);
 
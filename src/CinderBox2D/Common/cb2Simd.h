@@ -0,0 +1,238 @@
+/*
+* Copyright (c) 2006-2011 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_SIMD_H
+#define CB2_SIMD_H
+
+#include <CinderBox2D/Common/cb2Settings.h>
+
+/// @file
+/// Four wide float helpers for the batched solver and collision paths. Uses SSE2 or NEON
+/// when available and falls back to plain arrays otherwise. Comparisons
+/// return lane masks that are meant for cb2SelectW, cb2AndW and cb2MaskBitsW only.
+/// cb2MaskBitsW packs a mask into an int with bit i set for lane i. cb2SetW builds a
+/// vector from four lanes, the first one goes to lane 0. cb2SwapPairsW swaps lanes 0 and 1
+/// and lanes 2 and 3, which turns two packed points (x, y) into (y, x). cb2SwapHalvesW swaps
+/// the lower and upper two lanes. cb2ZipLowW interleaves the lower two lanes of a and b
+/// as (a0, b0, a1, b1) and cb2ZipHighW the upper two.
+
+#define cb2_simdWidth 4
+
+/// The polygon vertex count rounded up to whole vectors.
+#define cb2_maxPolygonLanes (((cb2_maxPolygonVertices + cb2_simdWidth - 1) / cb2_simdWidth) * cb2_simdWidth)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+typedef __m128 cb2FloatW;
+
+inline cb2FloatW cb2LoadW(const float* p) { return _mm_loadu_ps(p); }
+inline void cb2StoreW(float* p, cb2FloatW a) { _mm_storeu_ps(p, a); }
+inline cb2FloatW cb2SplatW(float s) { return _mm_set1_ps(s); }
+inline cb2FloatW cb2ZeroW() { return _mm_setzero_ps(); }
+inline cb2FloatW cb2AddW(cb2FloatW a, cb2FloatW b) { return _mm_add_ps(a, b); }
+inline cb2FloatW cb2SubW(cb2FloatW a, cb2FloatW b) { return _mm_sub_ps(a, b); }
+inline cb2FloatW cb2MulW(cb2FloatW a, cb2FloatW b) { return _mm_mul_ps(a, b); }
+inline cb2FloatW cb2DivW(cb2FloatW a, cb2FloatW b) { return _mm_div_ps(a, b); }
+inline cb2FloatW cb2SqrtW(cb2FloatW a) { return _mm_sqrt_ps(a); }
+inline cb2FloatW cb2MinW(cb2FloatW a, cb2FloatW b) { return _mm_min_ps(a, b); }
+inline cb2FloatW cb2MaxW(cb2FloatW a, cb2FloatW b) { return _mm_max_ps(a, b); }
+inline cb2FloatW cb2GreaterEqualW(cb2FloatW a, cb2FloatW b) { return _mm_cmpge_ps(a, b); }
+inline cb2FloatW cb2AndW(cb2FloatW a, cb2FloatW b) { return _mm_and_ps(a, b); }
+inline cb2FloatW cb2SelectW(cb2FloatW mask, cb2FloatW a, cb2FloatW b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline int cb2MaskBitsW(cb2FloatW mask) { return _mm_movemask_ps(mask); }
+inline cb2FloatW cb2SetW(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline cb2FloatW cb2SwapPairsW(cb2FloatW a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)); }
+inline cb2FloatW cb2SwapHalvesW(cb2FloatW a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)); }
+inline cb2FloatW cb2ZipLowW(cb2FloatW a, cb2FloatW b) { return _mm_unpacklo_ps(a, b); }
+inline cb2FloatW cb2ZipHighW(cb2FloatW a, cb2FloatW b) { return _mm_unpackhi_ps(a, b); }
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+typedef float32x4_t cb2FloatW;
+
+inline cb2FloatW cb2LoadW(const float* p) { return vld1q_f32(p); }
+inline void cb2StoreW(float* p, cb2FloatW a) { vst1q_f32(p, a); }
+inline cb2FloatW cb2SplatW(float s) { return vdupq_n_f32(s); }
+inline cb2FloatW cb2ZeroW() { return vdupq_n_f32(0.0f); }
+inline cb2FloatW cb2AddW(cb2FloatW a, cb2FloatW b) { return vaddq_f32(a, b); }
+inline cb2FloatW cb2SubW(cb2FloatW a, cb2FloatW b) { return vsubq_f32(a, b); }
+inline cb2FloatW cb2MulW(cb2FloatW a, cb2FloatW b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__)
+inline cb2FloatW cb2DivW(cb2FloatW a, cb2FloatW b) { return vdivq_f32(a, b); }
+inline cb2FloatW cb2SqrtW(cb2FloatW a) { return vsqrtq_f32(a); }
+#else
+inline cb2FloatW cb2DivW(cb2FloatW a, cb2FloatW b)
+{
+	// Two Newton steps refine the reciprocal estimate to about full precision.
+	float32x4_t r = vrecpeq_f32(b);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	return vmulq_f32(a, r);
+}
+inline cb2FloatW cb2SqrtW(cb2FloatW a)
+{
+	float32x4_t r = vrsqrteq_f32(a);
+	r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r);
+	r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r);
+	uint32x4_t zero = vceqq_f32(a, vdupq_n_f32(0.0f));
+	return vbslq_f32(zero, a, vmulq_f32(a, r));
+}
+#endif
+inline cb2FloatW cb2MinW(cb2FloatW a, cb2FloatW b) { return vminq_f32(a, b); }
+inline cb2FloatW cb2MaxW(cb2FloatW a, cb2FloatW b) { return vmaxq_f32(a, b); }
+inline cb2FloatW cb2GreaterEqualW(cb2FloatW a, cb2FloatW b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline cb2FloatW cb2AndW(cb2FloatW a, cb2FloatW b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline cb2FloatW cb2SelectW(cb2FloatW mask, cb2FloatW a, cb2FloatW b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+inline int cb2MaskBitsW(cb2FloatW mask)
+{
+	uint32x4_t m = vreinterpretq_u32_f32(mask);
+	return (vgetq_lane_u32(m, 0) >> 31) | ((vgetq_lane_u32(m, 1) >> 31) << 1) | ((vgetq_lane_u32(m, 2) >> 31) << 2) | ((vgetq_lane_u32(m, 3) >> 31) << 3);
+}
+inline cb2FloatW cb2SetW(float a, float b, float c, float d)
+{
+	float lanes[cb2_simdWidth] = { a, b, c, d };
+	return vld1q_f32(lanes);
+}
+inline cb2FloatW cb2SwapPairsW(cb2FloatW a) { return vrev64q_f32(a); }
+inline cb2FloatW cb2SwapHalvesW(cb2FloatW a) { return vextq_f32(a, a, 2); }
+inline cb2FloatW cb2ZipLowW(cb2FloatW a, cb2FloatW b) { return vzipq_f32(a, b).val[0]; }
+inline cb2FloatW cb2ZipHighW(cb2FloatW a, cb2FloatW b) { return vzipq_f32(a, b).val[1]; }
+
+#else
+
+#include <math.h>
+
+struct cb2FloatW
+{
+	float x[cb2_simdWidth];
+};
+
+inline cb2FloatW cb2LoadW(const float* p) { cb2FloatW r; for (int i = 0; i < cb2_simdWidth; ++i) r.x[i] = p[i]; return r; }
+inline void cb2StoreW(float* p, cb2FloatW a) { for (int i = 0; i < cb2_simdWidth; ++i) p[i] = a.x[i]; }
+inline cb2FloatW cb2SplatW(float s) { cb2FloatW r; for (int i = 0; i < cb2_simdWidth; ++i) r.x[i] = s; return r; }
+inline cb2FloatW cb2ZeroW() { return cb2SplatW(0.0f); }
+inline cb2FloatW cb2AddW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] += b.x[i]; return a; }
+inline cb2FloatW cb2SubW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] -= b.x[i]; return a; }
+inline cb2FloatW cb2MulW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] *= b.x[i]; return a; }
+inline cb2FloatW cb2DivW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] /= b.x[i]; return a; }
+inline cb2FloatW cb2SqrtW(cb2FloatW a) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = sqrtf(a.x[i]); return a; }
+inline cb2FloatW cb2MinW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = a.x[i] < b.x[i] ? a.x[i] : b.x[i]; return a; }
+inline cb2FloatW cb2MaxW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = a.x[i] > b.x[i] ? a.x[i] : b.x[i]; return a; }
+inline cb2FloatW cb2GreaterEqualW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = a.x[i] >= b.x[i] ? 1.0f : 0.0f; return a; }
+inline cb2FloatW cb2AndW(cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = (a.x[i] != 0.0f && b.x[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+inline cb2FloatW cb2SelectW(cb2FloatW mask, cb2FloatW a, cb2FloatW b) { for (int i = 0; i < cb2_simdWidth; ++i) a.x[i] = mask.x[i] != 0.0f ? a.x[i] : b.x[i]; return a; }
+inline int cb2MaskBitsW(cb2FloatW mask) { int bits = 0; for (int i = 0; i < cb2_simdWidth; ++i) bits |= (mask.x[i] != 0.0f ? 1 : 0) << i; return bits; }
+inline cb2FloatW cb2SetW(float a, float b, float c, float d) { cb2FloatW r; r.x[0] = a; r.x[1] = b; r.x[2] = c; r.x[3] = d; return r; }
+inline cb2FloatW cb2SwapPairsW(cb2FloatW a) { cb2FloatW r; r.x[0] = a.x[1]; r.x[1] = a.x[0]; r.x[2] = a.x[3]; r.x[3] = a.x[2]; return r; }
+inline cb2FloatW cb2SwapHalvesW(cb2FloatW a) { cb2FloatW r; r.x[0] = a.x[2]; r.x[1] = a.x[3]; r.x[2] = a.x[0]; r.x[3] = a.x[1]; return r; }
+inline cb2FloatW cb2ZipLowW(cb2FloatW a, cb2FloatW b) { cb2FloatW r; r.x[0] = a.x[0]; r.x[1] = b.x[0]; r.x[2] = a.x[1]; r.x[3] = b.x[1]; return r; }
+inline cb2FloatW cb2ZipHighW(cb2FloatW a, cb2FloatW b) { cb2FloatW r; r.x[0] = a.x[2]; r.x[1] = b.x[2]; r.x[2] = a.x[3]; r.x[3] = b.x[3]; return r; }
+
+#endif
+
+
+/// The arc tangent of y / x in each lane, in [-pi, pi]. This uses the reduction and
+/// polynomial of the portable cb2Atan2, the error is below 1e-6 radians.
+inline cb2FloatW cb2Atan2W(cb2FloatW y, cb2FloatW x)
+{
+	const cb2FloatW zero = cb2ZeroW();
+	const cb2FloatW one = cb2SplatW(1.0f);
+	cb2FloatW ax = cb2MaxW(x, cb2SubW(zero, x));
+	cb2FloatW ay = cb2MaxW(y, cb2SubW(zero, y));
+
+	// t = min / max is in [0, 1], values above tan(pi / 8) are reduced around 1.
+	cb2FloatW large = cb2MaxW(ax, ay);
+	cb2FloatW t = cb2DivW(cb2MinW(ax, ay), cb2MaxW(large, cb2SplatW(FLT_MIN)));
+	cb2FloatW reduce = cb2GreaterEqualW(t, cb2SplatW(0.4142135623730950f));
+	t = cb2SelectW(reduce, cb2DivW(cb2SubW(t, one), cb2AddW(t, one)), t);
+	cb2FloatW offset = cb2SelectW(reduce, cb2SplatW(0.25f * cb2_pi), zero);
+
+	cb2FloatW z = cb2MulW(t, t);
+	cb2FloatW p = cb2SubW(cb2MulW(cb2SplatW(8.05374449538e-2f), z), cb2SplatW(1.38776856032e-1f));
+	p = cb2AddW(cb2MulW(p, z), cb2SplatW(1.99777106478e-1f));
+	p = cb2SubW(cb2MulW(p, z), cb2SplatW(3.33329491539e-1f));
+	cb2FloatW a = cb2AddW(offset, cb2AddW(cb2MulW(cb2MulW(p, z), t), t));
+
+	a = cb2SelectW(cb2GreaterEqualW(ax, ay), a, cb2SubW(cb2SplatW(0.5f * cb2_pi), a));
+	a = cb2SelectW(cb2GreaterEqualW(x, zero), a, cb2SubW(cb2SplatW(cb2_pi), a));
+	return cb2SelectW(cb2GreaterEqualW(y, zero), a, cb2SubW(zero, a));
+}
+
+/// Get the largest of the four lanes.
+inline float cb2MaxLaneW(cb2FloatW a)
+{
+	float lanes[cb2_simdWidth];
+	cb2StoreW(lanes, a);
+	float m = lanes[0];
+	for (int i = 1; i < cb2_simdWidth; ++i)
+	{
+		m = lanes[i] > m ? lanes[i] : m;
+	}
+	return m;
+}
+
+/// Get the smallest of the four lanes.
+inline float cb2MinLaneW(cb2FloatW a)
+{
+	float lanes[cb2_simdWidth];
+	cb2StoreW(lanes, a);
+	float m = lanes[0];
+	for (int i = 1; i < cb2_simdWidth; ++i)
+	{
+		m = lanes[i] < m ? lanes[i] : m;
+	}
+	return m;
+}
+
+/// Get the index of the first point with the largest dot product with (dx, dy), the
+/// same one a scalar search finds. The points are stored by coordinate and padded to
+/// whole vectors with copies of the first point.
+inline int cb2SupportW(const float* xs, const float* ys, int count, float dx, float dy)
+{
+	cb2FloatW x = cb2SplatW(dx);
+	cb2FloatW y = cb2SplatW(dy);
+
+	cb2FloatW values[cb2_maxPolygonLanes / cb2_simdWidth];
+	cb2FloatW best = cb2SplatW(-cb2_maxFloat);
+	int groupCount = (count + cb2_simdWidth - 1) / cb2_simdWidth;
+	for (int i = 0; i < groupCount; ++i)
+	{
+		values[i] = cb2AddW(cb2MulW(cb2LoadW(xs + cb2_simdWidth * i), x), cb2MulW(cb2LoadW(ys + cb2_simdWidth * i), y));
+		best = cb2MaxW(best, values[i]);
+	}
+
+	cb2FloatW m = cb2SplatW(cb2MaxLaneW(best));
+	for (int i = 0; i < groupCount; ++i)
+	{
+		int bits = cb2MaskBitsW(cb2GreaterEqualW(values[i], m));
+		if (bits)
+		{
+			int lane = (bits & 1) ? 0 : (bits & 2) ? 1 : (bits & 4) ? 2 : 3;
+			return cb2_simdWidth * i + lane;
+		}
+	}
+
+	// Only NaN gets here.
+	return 0;
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <CinderBox2D/Common/cb2Math.h>
+#include <memory.h>
+
+cb2Snapshot::cb2Snapshot(cb2AllocatorInterface* allocator)
+{
+	m_allocator = allocator;
+	m_data = NULL;
+	m_size = 0;
+	m_capacity = 0;
+	m_position = 0;
+	m_loading = false;
+	m_fixed = false;
+	m_valid = true;
+}
+
+cb2Snapshot::cb2Snapshot(const void* data, int size)
+{
+	cb2Assert(size >= 0);
+	m_allocator = NULL;
+	m_data = (unsigned char*)data;
+	m_size = size;
+	m_capacity = 0;
+	m_position = 0;
+	m_loading = true;
+	m_fixed = false;
+	m_valid = true;
+}
+
+cb2Snapshot::~cb2Snapshot()
+{
+	if (m_loading == false && m_fixed == false)
+	{
+		cb2Free(m_allocator, m_data);
+	}
+}
+
+void cb2Snapshot::Clear()
+{
+	cb2Assert(m_loading == false);
+	m_size = 0;
+	m_valid = true;
+}
+
+void cb2Snapshot::SetBuffer(void* buffer, int capacity)
+{
+	cb2Assert(m_loading == false && m_size == 0);
+	cb2Assert(capacity >= 0);
+	if (m_fixed == false)
+	{
+		cb2Free(m_allocator, m_data);
+	}
+
+	m_data = (unsigned char*)buffer;
+	m_capacity = capacity;
+	m_fixed = true;
+	m_valid = true;
+}
+
+void cb2Snapshot::Write(const void* data, int size)
+{
+	cb2Assert(m_loading == false);
+
+	// Empty arrays may pass NULL, which memcpy must not see.
+	if (size == 0)
+	{
+		return;
+	}
+
+	if (m_fixed && m_size + size > m_capacity)
+	{
+		m_valid = false;
+		m_size += size;
+		return;
+	}
+
+	if (m_size + size > m_capacity)
+	{
+		// Double the buffer so big worlds do not copy it over and over.
+		int capacity = cb2Max(2 * m_capacity, cb2Max(m_size + size, 1024));
+		unsigned char* buffer = (unsigned char*)cb2Alloc(m_allocator, capacity);
+		if (m_data)
+		{
+			memcpy(buffer, m_data, m_size);
+			cb2Free(m_allocator, m_data);
+		}
+		m_data = buffer;
+		m_capacity = capacity;
+	}
+
+	memcpy(m_data + m_size, data, size);
+	m_size += size;
+}
+
+void cb2Snapshot::Read(void* data, int size)
+{
+	cb2Assert(m_loading);
+	if (size == 0)
+	{
+		return;
+	}
+
+	if (m_valid == false || size > m_size - m_position)
+	{
+		m_valid = false;
+		memset(data, 0, size);
+		return;
+	}
+
+	memcpy(data, m_data + m_position, size);
+	m_position += size;
+}
+
+const void* cb2Snapshot::ReadInPlace(int size)
+{
+	cb2Assert(m_loading);
+	const unsigned char* data = m_data + m_position;
+	if (m_valid == false || size > m_size - m_position || ((size_t)data & 3) != 0)
+	{
+		m_valid = false;
+		return NULL;
+	}
+
+	m_position += size;
+	return data;
+}
+
+void cb2Snapshot::Align(int alignment)
+{
+	cb2Assert(alignment > 0);
+	if (m_loading)
+	{
+		int padding = (alignment - m_position % alignment) % alignment;
+		if (padding > m_size - m_position)
+		{
+			m_valid = false;
+			return;
+		}
+		m_position += padding;
+	}
+	else
+	{
+		static const unsigned char zeros[16] = { 0 };
+		cb2Assert(alignment <= 16);
+		Write(zeros, (alignment - m_size % alignment) % alignment);
+	}
+}
+
+bool cb2Snapshot::ReadBool()
+{
+	cb2Assert(sizeof(bool) == sizeof(unsigned char));
+	unsigned char value = Read<unsigned char>();
+	if (value > 1)
+	{
+		m_valid = false;
+		return false;
+	}
+	return value == 1;
+}
+
+int cb2Snapshot::ReadCount(int elementSize)
+{
+	int count = Read<int>();
+	if (count < 0 || count > (m_size - m_position) / cb2Max(elementSize, 1))
+	{
+		m_valid = false;
+		return 0;
+	}
+	return count;
+}
@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_SNAPSHOT_H
+#define CB2_SNAPSHOT_H
+
+#include <CinderBox2D/Common/cb2Settings.h>
+
+/// A binary image of a world, see cb2World::SaveSnapshot. While saving it is a
+/// growable buffer, while loading a view of the bytes of an earlier save. Values
+/// are stored as they are in memory, so a snapshot can only be loaded by a build
+/// with the same settings on a machine with the same byte order.
+class cb2Snapshot
+{
+public:
+	/// An empty snapshot to save into.
+	/// @param allocator where the buffer lives, NULL for cb2Alloc.
+	cb2Snapshot(cb2AllocatorInterface* allocator = NULL);
+
+	/// A snapshot to load from. The data is not copied and must remain in scope.
+	cb2Snapshot(const void* data, int size);
+
+	~cb2Snapshot();
+
+	/// Get the saved bytes.
+	const void* GetData() const { return m_data; }
+
+	/// Get the number of saved bytes.
+	int GetSize() const { return m_size; }
+
+	/// Get the number of bytes loaded so far.
+	int GetPosition() const { return m_position; }
+
+	/// Drop the saved bytes to save again, keeping the buffer.
+	void Clear();
+
+	/// Save into a buffer of the caller instead of a growable one, for states that are
+	/// saved every frame. Bytes past the capacity are counted but not written and make
+	/// the snapshot invalid, so GetSize then tells the capacity needed.
+	void SetBuffer(void* buffer, int capacity);
+
+	/// Is this a snapshot to load from?
+	bool IsLoading() const { return m_loading; }
+
+	/// Is the snapshot still good? Loading past the end or finding a value that is
+	/// out of range marks the snapshot invalid, after which loads return zeros.
+	bool IsValid() const { return m_valid; }
+
+	/// Mark the snapshot invalid, for loaders that find a bad value.
+	void Invalidate() { m_valid = false; }
+
+	/// Append bytes.
+	void Write(const void* data, int size);
+
+	/// Take the next bytes.
+	void Read(void* data, int size);
+
+	/// Take the next bytes where they are, for arrays that are used in place. Returns
+	/// NULL and marks the snapshot invalid past the end or for data that is not
+	/// aligned for floats and ints.
+	const void* ReadInPlace(int size);
+
+	/// Write zeros or skip bytes up to the next multiple of alignment, so an array that
+	/// follows can be read in place.
+	void Align(int alignment);
+
+	/// Write or read bytes, depending on the direction of the snapshot. This lets a
+	/// single function both save and load plain state.
+	void Transfer(void* data, int size)
+	{
+		if (m_loading)
+		{
+			Read(data, size);
+		}
+		else
+		{
+			Write(data, size);
+		}
+	}
+
+	/// Write or read a value of plain data.
+	template <typename T>
+	void Transfer(T& value)
+	{
+		Transfer(&value, sizeof(T));
+	}
+
+	/// Write or read a bool, see ReadBool.
+	void Transfer(bool& value)
+	{
+		if (m_loading)
+		{
+			value = ReadBool();
+		}
+		else
+		{
+			Write(value);
+		}
+	}
+
+	/// Write or read an enum, see ReadEnum.
+	template <typename T>
+	void TransferEnum(T& value, int count)
+	{
+		if (m_loading)
+		{
+			value = ReadEnum<T>(count);
+		}
+		else
+		{
+			Write(value);
+		}
+	}
+
+	/// Write a value of plain data.
+	template <typename T>
+	void Write(const T& value)
+	{
+		Write(&value, sizeof(T));
+	}
+
+	/// Read a value of plain data.
+	template <typename T>
+	T Read()
+	{
+		T value;
+		Read(&value, sizeof(T));
+		return value;
+	}
+
+	/// Read a bool. A byte other than 0 or 1 would be undefined as a bool, it marks the
+	/// snapshot invalid and reads false.
+	bool ReadBool();
+
+	/// Read an enum with values in [0, count). The value is read as an int and checked
+	/// before it becomes an enum, one out of range marks the snapshot invalid and reads
+	/// the first value.
+	template <typename T>
+	T ReadEnum(int count)
+	{
+		cb2Assert(sizeof(T) == sizeof(int));
+		int value = Read<int>();
+		if (value < 0 || value >= count)
+		{
+			m_valid = false;
+			value = 0;
+		}
+		return (T)value;
+	}
+
+	/// Read the count of an array that follows, each element taking at least
+	/// elementSize bytes. Counts the rest of the snapshot cannot hold invalidate it
+	/// and return zero, so corrupt data never makes a loader allocate too much.
+	int ReadCount(int elementSize);
+
+private:
+
+	cb2Snapshot(const cb2Snapshot&);
+	cb2Snapshot& operator=(const cb2Snapshot&);
+
+	cb2AllocatorInterface* m_allocator;
+	unsigned char* m_data;
+	int m_size;
+	int m_capacity;
+	int m_position;
+	bool m_loading;
+	bool m_fixed;
+	bool m_valid;
+};
+
+#endif
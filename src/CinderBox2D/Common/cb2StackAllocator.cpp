@@ -18,12 +18,23 @@
 
 #include <CinderBox2D/Common/cb2StackAllocator.h>
 #include <CinderBox2D/Common/cb2Math.h>
+#include <memory.h>
 
-cb2StackAllocator::cb2StackAllocator()
+cb2StackAllocator::cb2StackAllocator(int stackSize, cb2AllocatorInterface* allocator)
 {
+	cb2Assert(stackSize > 0);
+
+	m_allocator = allocator;
+
+	m_capacity = stackSize;
+	m_data = (char*)cb2Alloc(m_allocator, m_capacity);
 	m_index = 0;
 	m_allocation = 0;
 	m_maxAllocation = 0;
+	m_fallbackCount = 0;
+
+	m_entryCapacity = cb2_maxStackEntries;
+	m_entries = (cb2StackEntry*)cb2Alloc(m_allocator, m_entryCapacity * sizeof(cb2StackEntry));
 	m_entryCount = 0;
 }
 
@@ -31,18 +42,33 @@ cb2StackAllocator::~cb2StackAllocator()
 {
 	cb2Assert(m_index == 0);
 	cb2Assert(m_entryCount == 0);
+
+	cb2Free(m_allocator, m_entries);
+	cb2Free(m_allocator, m_data);
 }
 
 void* cb2StackAllocator::Allocate(int size)
 {
-	cb2Assert(m_entryCount < cb2_maxStackEntries);
+	if (m_entryCount == m_entryCapacity)
+	{
+		cb2StackEntry* oldEntries = m_entries;
+		m_entryCapacity *= 2;
+		m_entries = (cb2StackEntry*)cb2Alloc(m_allocator, m_entryCapacity * sizeof(cb2StackEntry));
+		memcpy(m_entries, oldEntries, m_entryCount * sizeof(cb2StackEntry));
+		cb2Free(m_allocator, oldEntries);
+	}
+
+	// Keep every allocation aligned like malloc, the solvers store pointers and
+	// SIMD lanes in these arrays.
+	size = (size + 15) & ~15;
 
 	cb2StackEntry* entry = m_entries + m_entryCount;
 	entry->size = size;
-	if (m_index + size > cb2_stackSize)
+	if (m_index + size > m_capacity)
 	{
-		entry->data = (char*)cb2Alloc(size);
+		entry->data = (char*)cb2Alloc(m_allocator, size);
 		entry->usedMalloc = true;
+		++m_fallbackCount;
 	}
 	else
 	{
@@ -65,7 +91,7 @@ void cb2StackAllocator::Free(void* p)
 	cb2Assert(p == entry->data);
 	if (entry->usedMalloc)
 	{
-		cb2Free(p);
+		cb2Free(m_allocator, p);
 	}
 	else
 	{
@@ -74,10 +100,40 @@ void cb2StackAllocator::Free(void* p)
 	m_allocation -= entry->size;
 	--m_entryCount;
 
+	// Nothing points into the stack now, grow it past the high-water mark. The
+	// headroom keeps a slowly growing scene from falling back every step.
+	if (m_entryCount == 0 && m_maxAllocation > m_capacity)
+	{
+		cb2Free(m_allocator, m_data);
+		m_capacity = m_maxAllocation + m_maxAllocation / 2;
+		m_data = (char*)cb2Alloc(m_allocator, m_capacity);
+	}
+
 	p = NULL;
 }
 
+void cb2StackAllocator::Reserve(int size)
+{
+	cb2Assert(m_entryCount == 0);
+	if (size > m_capacity)
+	{
+		cb2Free(m_allocator, m_data);
+		m_capacity = size;
+		m_data = (char*)cb2Alloc(m_allocator, m_capacity);
+	}
+}
+
 int cb2StackAllocator::GetMaxAllocation() const
 {
 	return m_maxAllocation;
 }
+
+int cb2StackAllocator::GetCapacity() const
+{
+	return m_capacity;
+}
+
+int cb2StackAllocator::GetFallbackCount() const
+{
+	return m_fallbackCount;
+}
@@ -21,8 +21,8 @@
 
 #include <CinderBox2D/Common/cb2Settings.h>
 
-const int cb2_stackSize = 100 * 1024;	// 100k
-const int cb2_maxStackEntries = 32;
+const int cb2_stackSize = 100 * 1024;	// 100k, the default
+const int cb2_maxStackEntries = 32;		// initial, grows as needed
 
 struct cb2StackEntry
 {
@@ -34,27 +34,44 @@ struct cb2StackEntry
 // This is a stack allocator used for fast per step allocations.
 // You must nest allocate/free pairs. The code will assert
 // if you try to interleave multiple allocate/free pairs.
+// Allocations that don't fit fall back to cb2Alloc. Once the stack is empty
+// again it grows past the high-water mark, so the next step fits.
 class cb2StackAllocator
 {
 public:
-	cb2StackAllocator();
+	/// @param allocator backs the stack and the fallbacks, NULL for cb2Alloc.
+	cb2StackAllocator(int stackSize = cb2_stackSize, cb2AllocatorInterface* allocator = NULL);
 	~cb2StackAllocator();
 
 	void* Allocate(int size);
 	void Free(void* p);
 
+	/// Grow the stack to at least size bytes. The stack must be empty.
+	void Reserve(int size);
+
 	int GetMaxAllocation() const;
 
+	/// Get the current size of the stack in bytes.
+	int GetCapacity() const;
+
+	/// Get the number of allocations that did not fit and used cb2Alloc.
+	int GetFallbackCount() const;
+
 private:
 
-	char m_data[cb2_stackSize];
+	cb2AllocatorInterface* m_allocator;
+
+	char* m_data;
+	int m_capacity;
 	int m_index;
 
 	int m_allocation;
 	int m_maxAllocation;
+	int m_fallbackCount;
 
-	cb2StackEntry m_entries[cb2_maxStackEntries];
+	cb2StackEntry* m_entries;
 	int m_entryCount;
+	int m_entryCapacity;
 };
 
 #endif
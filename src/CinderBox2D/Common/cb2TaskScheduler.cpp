@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+
+cb2AuditedTaskScheduler::cb2AuditedTaskScheduler()
+{
+	m_scheduler = NULL;
+	m_task = NULL;
+	m_context = NULL;
+	m_scope = NULL;
+}
+
+int cb2AuditedTaskScheduler::GetThreadCount() const
+{
+	return m_scheduler->GetThreadCount();
+}
+
+void* cb2AuditedTaskScheduler::EnqueueRange(cb2TaskFunction* task, void* context, int count, int rangeSize)
+{
+	cb2Assert(m_task == NULL);
+	m_task = task;
+	m_context = context;
+	m_scope = cb2GetAllocationAuditScope();
+	return m_scheduler->EnqueueRange(RunRange, this, count, rangeSize);
+}
+
+void cb2AuditedTaskScheduler::Wait(void* group)
+{
+	m_scheduler->Wait(group);
+	m_task = NULL;
+	m_context = NULL;
+	m_scope = NULL;
+}
+
+void cb2AuditedTaskScheduler::RunRange(void* context, int begin, int end, int threadIndex)
+{
+	cb2AuditedTaskScheduler* scheduler = (cb2AuditedTaskScheduler*)context;
+
+	// The thread may be helping another world between ranges, so the scope is restored.
+	cb2AllocationAuditScope* previous = cb2SetAllocationAuditScope(scheduler->m_scope);
+	scheduler->m_task(scheduler->m_context, begin, end, threadIndex);
+	cb2SetAllocationAuditScope(previous);
+}
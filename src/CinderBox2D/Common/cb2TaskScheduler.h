@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2006-2011 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_TASK_SCHEDULER_H
+#define CB2_TASK_SCHEDULER_H
+
+#include <CinderBox2D/Common/cb2Settings.h>
+
+/// A range task. Processes the items [begin, end) of a parallel loop.
+/// @param context the user pointer given to the loop.
+/// @param threadIndex in [0, cb2TaskScheduler::GetThreadCount()). No two ranges
+/// may run concurrently with the same thread index, the engine uses it to pick
+/// per thread scratch memory.
+typedef void cb2TaskFunction(void* context, int begin, int end, int threadIndex);
+
+/// Implement this to run the parallel phases of cb2World::Step on your own job
+/// system. The world only ever has one group in flight and always waits on it
+/// from the thread that called Step.
+/// @see cb2World::SetTaskScheduler
+class cb2TaskScheduler
+{
+public:
+	virtual ~cb2TaskScheduler() {}
+
+	/// Get the number of threads that may run ranges at the same time. Thread
+	/// indices passed to tasks must be smaller than this.
+	virtual int GetThreadCount() const = 0;
+
+	/// Enqueue the task over [0, count), split into ranges of roughly rangeSize items.
+	/// @return a group handle to pass to Wait.
+	virtual void* EnqueueRange(cb2TaskFunction* task, void* context, int count, int rangeSize) = 0;
+
+	/// Block until every range of the group has finished. The calling thread is
+	/// free to help with the work.
+	virtual void Wait(void* group) = 0;
+};
+
+/// Forwards to another scheduler and runs each range under the allocation audit
+/// scope of the thread that enqueued it. The world steps through one of these, so
+/// that the scheduler threads count their heap allocations against the stepping
+/// world. Only one group may be in flight.
+class cb2AuditedTaskScheduler : public cb2TaskScheduler
+{
+public:
+	cb2AuditedTaskScheduler();
+
+	/// Set the scheduler that runs the ranges.
+	void SetScheduler(cb2TaskScheduler* scheduler) { m_scheduler = scheduler; }
+	cb2TaskScheduler* GetScheduler() const { return m_scheduler; }
+
+	int GetThreadCount() const;
+	void* EnqueueRange(cb2TaskFunction* task, void* context, int count, int rangeSize);
+	void Wait(void* group);
+
+private:
+	static void RunRange(void* context, int begin, int end, int threadIndex);
+
+	cb2TaskScheduler* m_scheduler;
+	cb2TaskFunction* m_task;
+	void* m_context;
+	cb2AllocationAuditScope* m_scope;
+};
+
+#endif
@@ -0,0 +1,261 @@
+/*
+* Copyright (c) 2006-2011 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Common/cb2ThreadPool.h>
+#include <CinderBox2D/Common/cb2Math.h>
+#include <new>
+
+cb2ThreadPool::cb2ThreadPool(int threadCount)
+{
+	cb2Assert(threadCount >= 1);
+
+	m_threadCount = threadCount;
+	m_task = NULL;
+	m_context = NULL;
+	m_count = 0;
+	m_rangeSize = 1;
+	m_next = 0;
+	m_busyCount = 0;
+	m_generation = 0;
+	m_quit = false;
+
+	// Thread 0 is the caller, so only spawn the others.
+	m_threads = NULL;
+	if (m_threadCount > 1)
+	{
+		m_threads = (std::thread*)cb2Alloc((m_threadCount - 1) * sizeof(std::thread));
+		for (int i = 1; i < m_threadCount; ++i)
+		{
+			new (m_threads + i - 1) std::thread(WorkerMain, this, i);
+		}
+	}
+}
+
+cb2ThreadPool::~cb2ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (int i = 1; i < m_threadCount; ++i)
+	{
+		m_threads[i - 1].join();
+		m_threads[i - 1].~thread();
+	}
+
+	cb2Free(m_threads);
+}
+
+void* cb2ThreadPool::EnqueueRange(cb2TaskFunction* task, void* context, int count, int rangeSize)
+{
+	cb2Assert(m_task == NULL);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_context = context;
+		m_count = count;
+		m_rangeSize = cb2Max(rangeSize, 1);
+		m_next = 0;
+	}
+
+	// Not worth waking anybody up, Wait runs it inline.
+	if (m_threadCount == 1 || count <= m_rangeSize)
+	{
+		return this;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_busyCount = m_threadCount - 1;
+		++m_generation;
+	}
+	m_wakeCondition.notify_all();
+
+	return this;
+}
+
+void cb2ThreadPool::Wait(void* group)
+{
+	cb2Assert(group == this);
+	CB2_NOT_USED(group);
+
+	if (m_task == NULL)
+	{
+		return;
+	}
+
+	RunRanges(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_busyCount > 0)
+	{
+		m_doneCondition.wait(lock);
+	}
+
+	m_task = NULL;
+	m_context = NULL;
+}
+
+void cb2ThreadPool::RunRanges(int threadIndex)
+{
+	for (;;)
+	{
+		int begin = m_next.fetch_add(m_rangeSize);
+		if (begin >= m_count)
+		{
+			break;
+		}
+
+		int end = cb2Min(begin + m_rangeSize, m_count);
+		m_task(m_context, begin, end, threadIndex);
+	}
+}
+
+void cb2ThreadPool::WorkerMain(cb2ThreadPool* pool, int threadIndex)
+{
+	unsigned generation = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool->m_mutex);
+			while (pool->m_quit == false && pool->m_generation == generation)
+			{
+				pool->m_wakeCondition.wait(lock);
+			}
+
+			if (pool->m_quit)
+			{
+				return;
+			}
+
+			generation = pool->m_generation;
+		}
+
+		pool->RunRanges(threadIndex);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(pool->m_mutex);
+			last = --pool->m_busyCount == 0;
+		}
+
+		if (last)
+		{
+			pool->m_doneCondition.notify_one();
+		}
+	}
+}
+
+cb2BackgroundThread::cb2BackgroundThread()
+{
+	m_thread = NULL;
+	m_job = NULL;
+	m_context = NULL;
+	m_done = false;
+	m_quit = false;
+}
+
+cb2BackgroundThread::~cb2BackgroundThread()
+{
+	Wait();
+
+	if (m_thread)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wakeCondition.notify_one();
+
+		m_thread->join();
+		m_thread->~thread();
+		cb2Free(m_thread);
+	}
+}
+
+void cb2BackgroundThread::Run(cb2JobFunction* job, void* context)
+{
+	cb2Assert(m_job == NULL);
+
+	if (m_thread == NULL)
+	{
+		m_thread = (std::thread*)cb2Alloc(sizeof(std::thread));
+		new (m_thread) std::thread(ThreadMain, this);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = job;
+		m_context = context;
+		m_done = false;
+	}
+	m_wakeCondition.notify_one();
+}
+
+void cb2BackgroundThread::Wait()
+{
+	if (m_job == NULL)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_done == false)
+	{
+		m_doneCondition.wait(lock);
+	}
+
+	m_job = NULL;
+	m_context = NULL;
+}
+
+void cb2BackgroundThread::ThreadMain(cb2BackgroundThread* thread)
+{
+	for (;;)
+	{
+		cb2JobFunction* job;
+		void* context;
+		{
+			std::unique_lock<std::mutex> lock(thread->m_mutex);
+			while (thread->m_quit == false && (thread->m_job == NULL || thread->m_done))
+			{
+				thread->m_wakeCondition.wait(lock);
+			}
+
+			if (thread->m_quit)
+			{
+				return;
+			}
+
+			job = thread->m_job;
+			context = thread->m_context;
+		}
+
+		job(context);
+
+		{
+			std::lock_guard<std::mutex> lock(thread->m_mutex);
+			thread->m_done = true;
+		}
+		thread->m_doneCondition.notify_one();
+	}
+}
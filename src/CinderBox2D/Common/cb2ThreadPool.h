@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2006-2011 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_THREAD_POOL_H
+#define CB2_THREAD_POOL_H
+
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/// A plain mutex used to guard the few pieces of shared state touched by tasks.
+class cb2Mutex
+{
+public:
+	void Lock() { m_mutex.lock(); }
+	void Unlock() { m_mutex.unlock(); }
+
+private:
+	std::mutex m_mutex;
+};
+
+/// The built-in task scheduler, a small fixed size pool of worker threads.
+/// The thread calling Wait takes part in the work as thread 0, so a pool of
+/// one thread runs everything inline. Only one group may be in flight.
+class cb2ThreadPool : public cb2TaskScheduler
+{
+public:
+	/// @param threadCount the total number of threads, including the caller.
+	cb2ThreadPool(int threadCount);
+	~cb2ThreadPool();
+
+	/// @see cb2TaskScheduler::GetThreadCount
+	int GetThreadCount() const { return m_threadCount; }
+
+	/// @see cb2TaskScheduler::EnqueueRange
+	void* EnqueueRange(cb2TaskFunction* task, void* context, int count, int rangeSize);
+
+	/// @see cb2TaskScheduler::Wait
+	void Wait(void* group);
+
+private:
+
+	static void WorkerMain(cb2ThreadPool* pool, int threadIndex);
+	void RunRanges(int threadIndex);
+
+	std::thread* m_threads;
+	int m_threadCount;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+
+	cb2TaskFunction* m_task;
+	void* m_context;
+	int m_count;
+	int m_rangeSize;
+	std::atomic<int> m_next;
+
+	int m_busyCount;
+	unsigned m_generation;
+	bool m_quit;
+};
+
+/// A job for cb2BackgroundThread.
+typedef void cb2JobFunction(void* context);
+
+/// A thread that runs one job at a time while its owner goes on, used by
+/// cb2World::StepAsync. The thread is started on the first job.
+class cb2BackgroundThread
+{
+public:
+	cb2BackgroundThread();
+	~cb2BackgroundThread();
+
+	/// Start a job. The previous one must have been waited on.
+	void Run(cb2JobFunction* job, void* context);
+
+	/// Block until the job has finished. Returns immediately if there is none.
+	void Wait();
+
+	/// Is a job running or waiting to be waited on?
+	bool IsBusy() const { return m_job != NULL; }
+
+private:
+
+	static void ThreadMain(cb2BackgroundThread* thread);
+
+	std::thread* m_thread;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+
+	cb2JobFunction* m_job;
+	void* m_context;
+	bool m_done;
+	bool m_quit;
+};
+
+#endif
@@ -17,28 +17,34 @@
 */
 
 #include <CinderBox2D/Common/cb2Timer.h>
+#include <mutex>
 
 #if defined(_WIN32)
 
 double cb2Timer::s_invFrequency = 0.0f;
 
+// Timers are created by worlds stepping on separate threads.
+static std::once_flag cb2_frequencyOnce;
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
-cb2Timer::cb2Timer()
+void cb2Timer::InitializeFrequency()
 {
 	LARGE_INTEGER largeInteger;
-
-	if (s_invFrequency == 0.0f)
+	QueryPerformanceFrequency(&largeInteger);
+	s_invFrequency = double(largeInteger.QuadPart);
+	if (s_invFrequency > 0.0f)
 	{
-		QueryPerformanceFrequency(&largeInteger);
-		s_invFrequency = double(largeInteger.QuadPart);
-		if (s_invFrequency > 0.0f)
-		{
-			s_invFrequency = 1000.0f / s_invFrequency;
-		}
+		s_invFrequency = 1000.0f / s_invFrequency;
 	}
+}
 
+cb2Timer::cb2Timer()
+{
+	std::call_once(cb2_frequencyOnce, InitializeFrequency);
+
+	LARGE_INTEGER largeInteger;
 	QueryPerformanceCounter(&largeInteger);
 	m_start = double(largeInteger.QuadPart);
 }
@@ -80,7 +86,11 @@ float cb2Timer::GetMilliseconds() const
 {
     timeval t;
     gettimeofday(&t, 0);
-    return 1000.0f * (t.tv_sec - m_start_sec) + 0.001f * (t.tv_usec - m_start_usec);
+    // The microseconds go negative when they wrap to the next second, so take the
+    // differences signed.
+    long seconds = long(t.tv_sec) - long(m_start_sec);
+    long microseconds = long(t.tv_usec) - long(m_start_usec);
+    return 1000.0f * seconds + 0.001f * microseconds;
 }
 
 #else
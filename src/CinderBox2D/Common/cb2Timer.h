@@ -39,6 +39,8 @@ public:
 private:
 
 #if defined(_WIN32)
+	static void InitializeFrequency();
+
 	double m_start;
 	static double s_invFrequency;
 #elif defined(__linux__) || defined (__APPLE__)
@@ -0,0 +1,95 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_TRACE_H
+#define CB2_TRACE_H
+
+#include <CinderBox2D/Common/cb2Settings.h>
+
+/// Implement this class to see the phases of a step in an external profiler, for
+/// example as Tracy zones or as Chrome trace events. The zones only exist when the
+/// library is built with CB2_TRACE, see cb2Settings.h. Zones are begun and ended in
+/// nested order on each thread, the task scheduler threads included, so an
+/// implementation must be thread safe and keep a zone stack per thread.
+class cb2TraceListener
+{
+public:
+	virtual ~cb2TraceListener() {}
+
+	/// A zone begins on the calling thread.
+	/// @param name a string literal naming the phase.
+	/// @param count the amount of work in the zone, such as the bodies of an island.
+	virtual void BeginZone(const char* name, int count) = 0;
+
+	/// The last zone begun on the calling thread ends.
+	virtual void EndZone() = 0;
+};
+
+/// Set the listener that receives the zones of all worlds, NULL to stop tracing.
+/// Don't call this while a world is stepping.
+void cb2SetTraceListener(cb2TraceListener* listener);
+
+/// Get the current trace listener.
+cb2TraceListener* cb2GetTraceListener();
+
+#ifdef CB2_TRACE
+
+extern cb2TraceListener* cb2_traceListener;
+
+/// Begins a zone on construction and ends it when it goes out of scope.
+class cb2TraceZone
+{
+public:
+	cb2TraceZone(const char* name, int count)
+	{
+		m_listener = cb2_traceListener;
+		if (m_listener)
+		{
+			m_listener->BeginZone(name, count);
+		}
+	}
+
+	~cb2TraceZone()
+	{
+		if (m_listener)
+		{
+			m_listener->EndZone();
+		}
+	}
+
+private:
+	cb2TraceListener* m_listener;
+};
+
+#define CB2_TRACE_CONCAT2(a, b) a##b
+#define CB2_TRACE_CONCAT(a, b) CB2_TRACE_CONCAT2(a, b)
+
+/// Trace the rest of the enclosing scope as a zone.
+#define CB2_TRACE_ZONE(name) cb2TraceZone CB2_TRACE_CONCAT(cb2_traceZone, __LINE__)(name, 0)
+
+/// Trace the rest of the enclosing scope as a zone with an amount of work.
+#define CB2_TRACE_ZONE_COUNT(name, count) cb2TraceZone CB2_TRACE_CONCAT(cb2_traceZone, __LINE__)(name, count)
+
+#else
+
+#define CB2_TRACE_ZONE(name)
+#define CB2_TRACE_ZONE_COUNT(name, count)
+
+#endif
+
+#endif
@@ -24,6 +24,14 @@
 #include <CinderBox2D/Dynamics/Contacts/cb2EdgeAndPolygonContact.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2ChainAndCircleContact.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2ChainAndPolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2CapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2CapsuleAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2PolygonAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2EdgeAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2ChainAndCapsuleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndCircleContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndPolygonContact.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2HeightfieldAndCapsuleContact.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2ContactSolver.h>
 
 #include <CinderBox2D/Collision/cb2Collision.h>
@@ -31,48 +39,389 @@
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
 #include <CinderBox2D/Common/cb2BlockAllocator.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
 #include <CinderBox2D/Dynamics/cb2World.h>
+#include <mutex>
 
 cb2ContactRegister cb2Contact::s_registers[cb2Shape::e_typeCount][cb2Shape::e_typeCount];
 bool cb2Contact::s_initialized = false;
+const cb2Manifold cb2Contact::s_emptyManifold = cb2Manifold();
+
+// Worlds may be stepped on separate threads, the first contact fills the registers.
+static std::once_flag cb2_registersOnce;
+
+// A qualified call is bound at compile time, the generic contact takes the virtual one.
+template <typename T>
+inline void cb2Evaluate(cb2Contact* contact, cb2Manifold* manifold, const cb2Transform& xfA, const cb2Transform& xfB)
+{
+	static_cast<T*>(contact)->T::Evaluate(manifold, xfA, xfB);
+}
+
+template <>
+inline void cb2Evaluate<cb2Contact>(cb2Contact* contact, cb2Manifold* manifold, const cb2Transform& xfA, const cb2Transform& xfB)
+{
+	contact->Evaluate(manifold, xfA, xfB);
+}
+
+// Start the manifold from the old one. Returns true with the touching state if
+// it needs no narrow phase, for sensors and reused manifolds.
+inline bool cb2Contact::PrepareManifold(cb2Manifold* manifold, bool* touching)
+{
+	*manifold = *static_cast<const cb2Contact*>(this)->GetManifold();
+
+	bool sensorA = m_fixtureA->IsSensor();
+	bool sensorB = m_fixtureB->IsSensor();
+	bool sensor = sensorA || sensorB;
+
+	cb2Body* bodyA = m_fixtureA->GetBody();
+	cb2Body* bodyB = m_fixtureB->GetBody();
+	const cb2Transform& xfA = bodyA->GetTransform();
+	const cb2Transform& xfB = bodyB->GetTransform();
+
+	// Is this contact a sensor?
+	if (sensor)
+	{
+		// Sensors don't generate manifolds.
+		manifold->pointCount = 0;
+		m_flags &= ~e_poseFlag;
+
+		*touching = TestSensorOverlap(xfA, xfB);
+		return true;
+	}
+
+	m_flags &= ~e_sensorPoseFlag;
+
+	// An island that wakes up resumes with the manifolds and impulses it fell asleep
+	// with, unless its bodies were moved while it slept. Evaluating them again at the
+	// pose the last position iterations left behind may pick other features, which
+	// loses their impulses.
+	if (m_flags & e_sleepPoseFlag)
+	{
+		m_flags &= ~e_sleepPoseFlag;
+		cb2Transform relativeXf = cb2MulT(xfA, xfB);
+		if (relativeXf.p == m_relativeXf.p && relativeXf.q.s == m_relativeXf.q.s && relativeXf.q.c == m_relativeXf.q.c)
+		{
+			*touching = manifold->pointCount > 0;
+			return true;
+		}
+	}
+
+	// The manifold is in the local frames of the bodies. Keep it, impulses and
+	// feature ids included, while the bodies barely moved relative to each other.
+	const cb2ContactManager& contactManager = bodyA->m_world->m_contactManager;
+	if (contactManager.m_reuseLinearTolerance > 0.0f)
+	{
+		cb2Transform relativeXf = cb2MulT(xfA, xfB);
+		if (CanReuseManifold(relativeXf, contactManager.m_reuseLinearTolerance, contactManager.m_reuseAngularTolerance))
+		{
+			*touching = manifold->pointCount > 0;
+			return true;
+		}
+
+		// Only this contact is written, the parallel narrow phase visits it once.
+		m_relativeXf = relativeXf;
+		m_flags |= e_poseFlag;
+	}
+	else
+	{
+		m_flags &= ~e_poseFlag;
+	}
+
+	return false;
+}
+
+// Sensors only need the overlap. Shapes that were apart stay apart until the
+// relative motion since could have closed the distance between them, so the
+// distance is recomputed only then, or when they overlapped and moved at all.
+bool cb2Contact::TestSensorOverlap(const cb2Transform& xfA, const cb2Transform& xfB)
+{
+	cb2Transform relativeXf = cb2MulT(xfA, xfB);
+	if (m_flags & e_sensorPoseFlag)
+	{
+		// Bound the motion of the points of child B in the frame of body A.
+		ci::Vec2f dp = relativeXf.p - m_relativeXf.p;
+		float dc = relativeXf.q.c - m_relativeXf.q.c;
+		float ds = relativeXf.q.s - m_relativeXf.q.s;
+		float motion = dp.length() + cb2Sqrt(dc * dc + ds * ds) * m_sensorExtent;
+
+		if (motion == 0.0f)
+		{
+			return (m_flags & e_touchingFlag) == e_touchingFlag;
+		}
+
+		if (motion < m_sensorSeparation - 10.0f * cb2_epsilon)
+		{
+			return false;
+		}
+	}
+
+	cb2DistanceInput input;
+	input.proxyA.set(m_fixtureA->GetShape(), m_indexA);
+	input.proxyB.set(m_fixtureB->GetShape(), m_indexB);
+	input.transformA = xfA;
+	input.transformB = xfB;
+	input.useRadii = true;
+
+	cb2SimplexCache cache;
+	cache.count = 0;
+
+	cb2DistanceOutput output;
+	cb2Distance(&output, &cache, &input);
+
+	float extentSquared = 0.0f;
+	for (int i = 0; i < input.proxyB.m_count; ++i)
+	{
+		extentSquared = cb2Max(extentSquared, input.proxyB.m_vertices[i].lengthSquared());
+	}
+
+	// Only this contact is written, the parallel narrow phase visits it once.
+	m_relativeXf = relativeXf;
+	m_sensorSeparation = output.distance;
+	m_sensorExtent = cb2Sqrt(extentSquared) + input.proxyB.m_radius;
+	m_flags |= e_sensorPoseFlag;
+
+	return output.distance < 10.0f * cb2_epsilon;
+}
+
+// Finish a manifold from the narrow phase and return the touching state.
+inline bool cb2Contact::FinishManifold(cb2Manifold* manifold)
+{
+	float speculativeDt = m_fixtureA->m_body->m_world->m_contactManager.m_speculativeDt;
+	if (manifold->pointCount == 0 && speculativeDt > 0.0f)
+	{
+		AddSpeculativePoints(manifold, speculativeDt);
+	}
+
+	// Match old contact ids to new contact ids and copy the
+	// stored impulses to warm start the solver.
+	const cb2Manifold* oldManifold = static_cast<const cb2Contact*>(this)->GetManifold();
+	for (int i = 0; i < manifold->pointCount; ++i)
+	{
+		cb2ManifoldPoint* mp2 = manifold->points + i;
+		mp2->normalImpulse = 0.0f;
+		mp2->tangentImpulse = 0.0f;
+		cb2ContactID id2 = mp2->id;
+
+		for (int j = 0; j < oldManifold->pointCount; ++j)
+		{
+			const cb2ManifoldPoint* mp1 = oldManifold->points + j;
+
+			if (mp1->id.key == id2.key)
+			{
+				mp2->normalImpulse = mp1->normalImpulse;
+				mp2->tangentImpulse = mp1->tangentImpulse;
+				break;
+			}
+		}
+	}
+
+	return manifold->pointCount > 0;
+}
+
+// Shapes that are apart but may close the gap within the step get the manifold of
+// the pose where body B is moved up to body A along their closest points. It is in
+// the local frames of the bodies, so at the actual pose the points keep the gap as
+// their separation, which the solver lets them close and no more. This covers the
+// pairs continuous physics covers, the relative motion is taken as linear.
+void cb2Contact::AddSpeculativePoints(cb2Manifold* manifold, float dt)
+{
+	const cb2Body* bodyA = m_fixtureA->m_body;
+	const cb2Body* bodyB = m_fixtureB->m_body;
+	bool fastA = bodyA->IsBullet() || bodyA->m_type != cb2_dynamicBody;
+	bool fastB = bodyB->IsBullet() || bodyB->m_type != cb2_dynamicBody;
+	if ((fastA == false && fastB == false) || ((bodyA->m_flags | bodyB->m_flags) & cb2Body::e_discreteFlag))
+	{
+		return;
+	}
+
+	float speed = (bodyB->m_linearVelocity - bodyA->m_linearVelocity).length();
+	if (dt * speed <= cb2_linearSlop)
+	{
+		return;
+	}
+	float reach = dt * speed + cb2_speculativeDistance;
+
+	cb2DistanceInput input;
+	input.proxyA.set(m_fixtureA->m_shape, m_indexA);
+	input.proxyB.set(m_fixtureB->m_shape, m_indexB);
+	input.transformA = bodyA->m_xf;
+	input.transformB = bodyB->m_xf;
+	input.useRadii = false;
+
+	cb2SimplexCache cache;
+	cache.count = 0;
+	cb2DistanceOutput output;
+	cb2Distance(&output, &cache, &input);
+
+	// Overlapping cores are left to the manifold, which may have dropped the points
+	// on purpose, such as at the inner vertices of a chain.
+	float separation = output.distance - input.proxyA.m_radius - input.proxyB.m_radius;
+	if (output.distance < 10.0f * FLT_EPSILON || separation > reach)
+	{
+		return;
+	}
+
+	ci::Vec2f d = output.pointB - output.pointA;
+
+	// Closest points beside an edge would snag on the vertices between edges, keep
+	// the ones in front of its face.
+	cb2Shape::Type typeA = m_fixtureA->m_shape->m_type;
+	if (typeA == cb2Shape::e_edge || typeA == cb2Shape::e_chain || typeA == cb2Shape::e_heightfield)
+	{
+		ci::Vec2f edge = cb2Mul(input.transformA.q, input.proxyA.m_vertices[1] - input.proxyA.m_vertices[0]);
+		if (cb2Abs(cb2Cross(edge, d)) < 0.9f * edge.length() * output.distance)
+		{
+			return;
+		}
+	}
+
+	cb2Transform xfB = input.transformB;
+	xfB.p -= ((separation + cb2_linearSlop) / output.distance) * d;
+	Evaluate(manifold, input.transformA, xfB);
+}
+
+template <typename T>
+bool cb2Contact::ComputeManifold(cb2Manifold* manifold)
+{
+	bool touching;
+	if (PrepareManifold(manifold, &touching))
+	{
+		return touching;
+	}
+
+	cb2Evaluate<T>(this, manifold, m_fixtureA->m_body->m_xf, m_fixtureB->m_body->m_xf);
+	return FinishManifold(manifold);
+}
+
+template <typename T>
+void cb2Contact::ComputeManifolds(cb2ContactUpdate* updates, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		cb2ContactUpdate* update = updates + i;
+		if (update->overlap)
+		{
+			update->touching = update->contact->ComputeManifold<T>(&update->manifold);
+		}
+	}
+}
+
+// Gather the contacts that need the narrow phase and run them through a batch
+// collide function at once.
+void cb2Contact::ComputeManifoldBatch(cb2ContactUpdate* updates, int count, cb2CollideBatchFcn* collideFcn)
+{
+	const int batchCapacity = 64;
+	cb2CollidePair pairs[batchCapacity];
+	cb2ContactUpdate* batch[batchCapacity];
+
+	int i = 0;
+	while (i < count)
+	{
+		int batchCount = 0;
+		for (; i < count && batchCount < batchCapacity; ++i)
+		{
+			cb2ContactUpdate* update = updates + i;
+			if (update->overlap == false)
+			{
+				continue;
+			}
+
+			cb2Contact* c = update->contact;
+			if (c->PrepareManifold(&update->manifold, &update->touching))
+			{
+				continue;
+			}
+
+			cb2CollidePair* pair = pairs + batchCount;
+			pair->shapeA = c->m_fixtureA->m_shape;
+			pair->shapeB = c->m_fixtureB->m_shape;
+			pair->xfA = &c->m_fixtureA->m_body->m_xf;
+			pair->xfB = &c->m_fixtureB->m_body->m_xf;
+			pair->manifold = &update->manifold;
+			batch[batchCount] = update;
+			++batchCount;
+		}
+
+		collideFcn(pairs, batchCount);
+
+		for (int j = 0; j < batchCount; ++j)
+		{
+			batch[j]->touching = batch[j]->contact->FinishManifold(&batch[j]->manifold);
+		}
+	}
+}
+
+template <>
+void cb2Contact::ComputeManifolds<cb2CircleContact>(cb2ContactUpdate* updates, int count)
+{
+	ComputeManifoldBatch(updates, count, cb2CollideCircles);
+}
+
+template <>
+void cb2Contact::ComputeManifolds<cb2PolygonAndCircleContact>(cb2ContactUpdate* updates, int count)
+{
+	ComputeManifoldBatch(updates, count, cb2CollidePolygonsAndCircles);
+}
 
 void cb2Contact::InitializeRegisters()
 {
-	AddType(cb2CircleContact::Create, cb2CircleContact::Destroy, cb2Shape::e_circle, cb2Shape::e_circle);
-	AddType(cb2PolygonAndCircleContact::Create, cb2PolygonAndCircleContact::Destroy, cb2Shape::e_polygon, cb2Shape::e_circle);
-	AddType(cb2PolygonContact::Create, cb2PolygonContact::Destroy, cb2Shape::e_polygon, cb2Shape::e_polygon);
-	AddType(cb2EdgeAndCircleContact::Create, cb2EdgeAndCircleContact::Destroy, cb2Shape::e_edge, cb2Shape::e_circle);
-	AddType(cb2EdgeAndPolygonContact::Create, cb2EdgeAndPolygonContact::Destroy, cb2Shape::e_edge, cb2Shape::e_polygon);
-	AddType(cb2ChainAndCircleContact::Create, cb2ChainAndCircleContact::Destroy, cb2Shape::e_chain, cb2Shape::e_circle);
-	AddType(cb2ChainAndPolygonContact::Create, cb2ChainAndPolygonContact::Destroy, cb2Shape::e_chain, cb2Shape::e_polygon);
+	AddType(cb2CircleContact::Create, cb2CircleContact::Destroy, ComputeManifolds<cb2CircleContact>,
+			cb2Shape::e_circle, cb2Shape::e_circle);
+	AddType(cb2PolygonAndCircleContact::Create, cb2PolygonAndCircleContact::Destroy, ComputeManifolds<cb2PolygonAndCircleContact>,
+			cb2Shape::e_polygon, cb2Shape::e_circle);
+	AddType(cb2PolygonContact::Create, cb2PolygonContact::Destroy, ComputeManifolds<cb2PolygonContact>,
+			cb2Shape::e_polygon, cb2Shape::e_polygon);
+	AddType(cb2EdgeAndCircleContact::Create, cb2EdgeAndCircleContact::Destroy, ComputeManifolds<cb2EdgeAndCircleContact>,
+			cb2Shape::e_edge, cb2Shape::e_circle);
+	AddType(cb2EdgeAndPolygonContact::Create, cb2EdgeAndPolygonContact::Destroy, ComputeManifolds<cb2EdgeAndPolygonContact>,
+			cb2Shape::e_edge, cb2Shape::e_polygon);
+	AddType(cb2ChainAndCircleContact::Create, cb2ChainAndCircleContact::Destroy, ComputeManifolds<cb2ChainAndCircleContact>,
+			cb2Shape::e_chain, cb2Shape::e_circle);
+	AddType(cb2ChainAndPolygonContact::Create, cb2ChainAndPolygonContact::Destroy, ComputeManifolds<cb2ChainAndPolygonContact>,
+			cb2Shape::e_chain, cb2Shape::e_polygon);
+	AddType(cb2CapsuleContact::Create, cb2CapsuleContact::Destroy, ComputeManifolds<cb2CapsuleContact>,
+			cb2Shape::e_capsule, cb2Shape::e_capsule);
+	AddType(cb2CapsuleAndCircleContact::Create, cb2CapsuleAndCircleContact::Destroy, ComputeManifolds<cb2CapsuleAndCircleContact>,
+			cb2Shape::e_capsule, cb2Shape::e_circle);
+	AddType(cb2PolygonAndCapsuleContact::Create, cb2PolygonAndCapsuleContact::Destroy, ComputeManifolds<cb2PolygonAndCapsuleContact>,
+			cb2Shape::e_polygon, cb2Shape::e_capsule);
+	AddType(cb2EdgeAndCapsuleContact::Create, cb2EdgeAndCapsuleContact::Destroy, ComputeManifolds<cb2EdgeAndCapsuleContact>,
+			cb2Shape::e_edge, cb2Shape::e_capsule);
+	AddType(cb2ChainAndCapsuleContact::Create, cb2ChainAndCapsuleContact::Destroy, ComputeManifolds<cb2ChainAndCapsuleContact>,
+			cb2Shape::e_chain, cb2Shape::e_capsule);
+	AddType(cb2HeightfieldAndCircleContact::Create, cb2HeightfieldAndCircleContact::Destroy, ComputeManifolds<cb2HeightfieldAndCircleContact>,
+			cb2Shape::e_heightfield, cb2Shape::e_circle);
+	AddType(cb2HeightfieldAndPolygonContact::Create, cb2HeightfieldAndPolygonContact::Destroy, ComputeManifolds<cb2HeightfieldAndPolygonContact>,
+			cb2Shape::e_heightfield, cb2Shape::e_polygon);
+	AddType(cb2HeightfieldAndCapsuleContact::Create, cb2HeightfieldAndCapsuleContact::Destroy, ComputeManifolds<cb2HeightfieldAndCapsuleContact>,
+			cb2Shape::e_heightfield, cb2Shape::e_capsule);
+	s_initialized = true;
 }
 
 void cb2Contact::AddType(cb2ContactCreateFcn* createFcn, cb2ContactDestroyFcn* destoryFcn,
-						cb2Shape::Type type1, cb2Shape::Type type2)
+						cb2ContactManifoldFcn* manifoldFcn, cb2Shape::Type type1, cb2Shape::Type type2)
 {
 	cb2Assert(0 <= type1 && type1 < cb2Shape::e_typeCount);
 	cb2Assert(0 <= type2 && type2 < cb2Shape::e_typeCount);
 	
 	s_registers[type1][type2].createFcn = createFcn;
 	s_registers[type1][type2].destroyFcn = destoryFcn;
+	s_registers[type1][type2].manifoldFcn = manifoldFcn;
 	s_registers[type1][type2].primary = true;
 
 	if (type1 != type2)
 	{
 		s_registers[type2][type1].createFcn = createFcn;
 		s_registers[type2][type1].destroyFcn = destoryFcn;
+		s_registers[type2][type1].manifoldFcn = manifoldFcn;
 		s_registers[type2][type1].primary = false;
 	}
 }
 
 cb2Contact* cb2Contact::Create(cb2Fixture* fixtureA, int indexA, cb2Fixture* fixtureB, int indexB, cb2BlockAllocator* allocator)
 {
-	if (s_initialized == false)
-	{
-		InitializeRegisters();
-		s_initialized = true;
-	}
+	std::call_once(cb2_registersOnce, InitializeRegisters);
 
 	cb2Shape::Type type1 = fixtureA->GetType();
 	cb2Shape::Type type2 = fixtureB->GetType();
@@ -105,12 +454,18 @@ void cb2Contact::Destroy(cb2Contact* contact, cb2BlockAllocator* allocator)
 	cb2Fixture* fixtureA = contact->m_fixtureA;
 	cb2Fixture* fixtureB = contact->m_fixtureB;
 
-	if (contact->m_manifold.pointCount > 0 &&
-		fixtureA->IsSensor() == false &&
-		fixtureB->IsSensor() == false)
+	if (contact->m_manifold)
 	{
-		fixtureA->GetBody()->SetAwake(true);
-		fixtureB->GetBody()->SetAwake(true);
+		if (contact->m_manifold->pointCount > 0 &&
+			fixtureA->IsSensor() == false &&
+			fixtureB->IsSensor() == false)
+		{
+			fixtureA->GetBody()->SetAwake(true);
+			fixtureB->GetBody()->SetAwake(true);
+		}
+
+		allocator->Free(contact->m_manifold, sizeof(cb2Manifold));
+		contact->m_manifold = NULL;
 	}
 
 	cb2Shape::Type typeA = fixtureA->GetType();
@@ -133,7 +488,7 @@ cb2Contact::cb2Contact(cb2Fixture* fA, int indexA, cb2Fixture* fB, int indexB)
 	m_indexA = indexA;
 	m_indexB = indexB;
 
-	m_manifold.pointCount = 0;
+	m_manifold = NULL;
 
 	m_prev = NULL;
 	m_next = NULL;
@@ -148,94 +503,132 @@ cb2Contact::cb2Contact(cb2Fixture* fA, int indexA, cb2Fixture* fB, int indexB)
 	m_nodeB.next = NULL;
 	m_nodeB.other = NULL;
 
+	m_awakeIndex = -1;
+
+	m_island = NULL;
+	m_islandPrev = NULL;
+	m_islandNext = NULL;
+
 	m_toiCount = 0;
+	m_simplexCache.count = 0;
+
+	m_sensorSeparation = 0.0f;
+	m_sensorExtent = 0.0f;
 
 	m_friction = cb2MixFriction(m_fixtureA->m_friction, m_fixtureB->m_friction);
 	m_restitution = cb2MixRestitution(m_fixtureA->m_restitution, m_fixtureB->m_restitution);
 
-	m_tangentSpeed = 0.0f;
+	m_tangentSpeed = m_fixtureA->m_tangentSpeed + m_fixtureB->m_tangentSpeed;
+}
+
+void cb2Contact::FlagForFiltering()
+{
+	m_flags |= e_filterFlag;
+
+	// Filtering happens in cb2ContactManager::Collide, which only visits awake contacts.
+	m_fixtureA->m_body->m_world->m_contactManager.UpdateAwake(this);
 }
 
 // Update the contact manifold and touching status.
 // Note: do not assume the fixture AABBs are overlapping or are valid.
 void cb2Contact::Update(cb2ContactListener* listener)
 {
-	cb2Manifold oldManifold = m_manifold;
+	cb2Manifold manifold;
+	bool touching = ComputeManifold(&manifold);
+	Commit(manifold, touching, listener);
+}
+
+bool cb2Contact::ComputeManifold(cb2Manifold* manifold)
+{
+	return ComputeManifold<cb2Contact>(manifold);
+}
+
+bool cb2Contact::CanReuseManifold(const cb2Transform& relativeXf, float linearTolerance, float angularTolerance) const
+{
+	if ((m_flags & e_poseFlag) == 0)
+	{
+		return false;
+	}
+
+	// Both drifts are measured from the pose of the last evaluation, so slow
+	// creeping still updates the manifold eventually.
+	ci::Vec2f d = relativeXf.p - m_relativeXf.p;
+	if (cb2Abs(d.x) + cb2Abs(d.y) > linearTolerance)
+	{
+		return false;
+	}
+
+	float sinAngle = m_relativeXf.q.c * relativeXf.q.s - m_relativeXf.q.s * relativeXf.q.c;
+	float cosAngle = m_relativeXf.q.c * relativeXf.q.c + m_relativeXf.q.s * relativeXf.q.s;
+	return cosAngle > 0.0f && cb2Abs(sinAngle) <= angularTolerance;
+}
+
+void cb2Contact::Commit(const cb2Manifold& manifold, bool touching, cb2ContactListener* listener)
+{
+	cb2World* world = m_fixtureA->GetBody()->GetWorld();
+	cb2Manifold oldManifold = *static_cast<const cb2Contact*>(this)->GetManifold();
+	SetManifold(manifold, &world->m_blockAllocator);
 
 	// Re-enable this contact.
 	m_flags |= e_enabledFlag;
 
-	bool touching = false;
 	bool wasTouching = (m_flags & e_touchingFlag) == e_touchingFlag;
 
 	bool sensorA = m_fixtureA->IsSensor();
 	bool sensorB = m_fixtureB->IsSensor();
 	bool sensor = sensorA || sensorB;
 
-	cb2Body* bodyA = m_fixtureA->GetBody();
-	cb2Body* bodyB = m_fixtureB->GetBody();
-	const cb2Transform& xfA = bodyA->GetTransform();
-	const cb2Transform& xfB = bodyB->GetTransform();
-
-	// Is this contact a sensor?
-	if (sensor)
+	if (sensor == false && touching != wasTouching)
 	{
-		const cb2Shape* shapeA = m_fixtureA->GetShape();
-		const cb2Shape* shapeB = m_fixtureB->GetShape();
-		touching = cb2TestOverlap(shapeA, m_indexA, shapeB, m_indexB, xfA, xfB);
+		m_fixtureA->GetBody()->SetAwake(true);
+		m_fixtureB->GetBody()->SetAwake(true);
+	}
 
-		// Sensors don't generate manifolds.
-		m_manifold.pointCount = 0;
+	if (touching)
+	{
+		m_flags |= e_touchingFlag;
 	}
 	else
 	{
-		Evaluate(&m_manifold, xfA, xfB);
-		touching = m_manifold.pointCount > 0;
+		m_flags &= ~e_touchingFlag;
+	}
 
-		// Match old contact ids to new contact ids and copy the
-		// stored impulses to warm start the solver.
-		for (int i = 0; i < m_manifold.pointCount; ++i)
+	// Solid touching contacts hold their bodies' islands together.
+	bool solid = touching && sensor == false;
+	if (solid != (m_island != NULL))
+	{
+		if (solid)
 		{
-			cb2ManifoldPoint* mp2 = m_manifold.points + i;
-			mp2->normalImpulse = 0.0f;
-			mp2->tangentImpulse = 0.0f;
-			cb2ContactID id2 = mp2->id;
-
-			for (int j = 0; j < oldManifold.pointCount; ++j)
-			{
-				cb2ManifoldPoint* mp1 = oldManifold.points + j;
-
-				if (mp1->id.key == id2.key)
-				{
-					mp2->normalImpulse = mp1->normalImpulse;
-					mp2->tangentImpulse = mp1->tangentImpulse;
-					break;
-				}
-			}
+			world->LinkContact(this);
 		}
-
-		if (touching != wasTouching)
+		else
 		{
-			bodyA->SetAwake(true);
-			bodyB->SetAwake(true);
+			world->UnlinkContact(this);
 		}
 	}
 
-	if (touching)
+	bool notify = listener != NULL;
+	if (touching != wasTouching)
 	{
-		m_flags |= e_touchingFlag;
-	}
-	else
-	{
-		m_flags &= ~e_touchingFlag;
+		cb2ContactManager& contactManager = world->m_contactManager;
+		if (sensor && contactManager.m_batchSensorEvents)
+		{
+			contactManager.PushSensorEvent(this, touching);
+			notify = false;
+		}
+		else if (sensor == false && contactManager.m_batchContactEvents)
+		{
+			contactManager.PushContactEvent(this, touching);
+			notify = false;
+		}
 	}
 
-	if (wasTouching == false && touching == true && listener)
+	if (wasTouching == false && touching == true && notify)
 	{
 		listener->BeginContact(this);
 	}
 
-	if (wasTouching == true && touching == false && listener)
+	if (wasTouching == true && touching == false && notify)
 	{
 		listener->EndContact(this);
 	}
@@ -245,3 +638,33 @@ void cb2Contact::Update(cb2ContactListener* listener)
 		listener->PreSolve(this, &oldManifold);
 	}
 }
+
+cb2Manifold* cb2Contact::GetManifold()
+{
+	// Writes must not reach the shared empty manifold. The next update without points
+	// frees this one again.
+	if (m_manifold == NULL)
+	{
+		cb2World* world = m_fixtureA->GetBody()->GetWorld();
+		m_manifold = (cb2Manifold*)world->m_blockAllocator.Allocate(sizeof(cb2Manifold));
+		*m_manifold = s_emptyManifold;
+	}
+	return m_manifold;
+}
+
+void cb2Contact::SetManifold(const cb2Manifold& manifold, cb2BlockAllocator* allocator)
+{
+	if (manifold.pointCount > 0)
+	{
+		if (m_manifold == NULL)
+		{
+			m_manifold = (cb2Manifold*)allocator->Allocate(sizeof(cb2Manifold));
+		}
+		*m_manifold = manifold;
+	}
+	else if (m_manifold)
+	{
+		allocator->Free(m_manifold, sizeof(cb2Manifold));
+		m_manifold = NULL;
+	}
+}
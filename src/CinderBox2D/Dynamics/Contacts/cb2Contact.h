@@ -21,6 +21,7 @@
 
 #include <CinderBox2D/Common/cb2Math.h>
 #include <CinderBox2D/Collision/cb2Collision.h>
+#include <CinderBox2D/Collision/cb2Distance.h>
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
 
@@ -31,6 +32,8 @@ class cb2World;
 class cb2BlockAllocator;
 class cb2StackAllocator;
 class cb2ContactListener;
+struct cb2PersistentIsland;
+struct cb2ContactUpdate;
 
 /// Friction mixing law. The idea is to allow either fixture to drive the restitution to zero.
 /// For example, anything slides on ice.
@@ -50,11 +53,13 @@ typedef cb2Contact* cb2ContactCreateFcn(	cb2Fixture* fixtureA, int indexA,
 										cb2Fixture* fixtureB, int indexB,
 										cb2BlockAllocator* allocator);
 typedef void cb2ContactDestroyFcn(cb2Contact* contact, cb2BlockAllocator* allocator);
+typedef void cb2ContactManifoldFcn(cb2ContactUpdate* updates, int count);
 
 struct cb2ContactRegister
 {
 	cb2ContactCreateFcn* createFcn;
 	cb2ContactDestroyFcn* destroyFcn;
+	cb2ContactManifoldFcn* manifoldFcn;
 	bool primary;
 };
 
@@ -73,13 +78,15 @@ struct cb2ContactEdge
 
 /// The class manages contact between two shapes. A contact exists for each overlapping
 /// AABB in the broad-phase (except if filtered). Therefore a contact object may exist
-/// that has no contact points.
+/// that has no contact points. The manifold is only allocated while there are points,
+/// most contacts in a dense scene are between fat AABBs that do not touch.
 class cb2Contact
 {
 public:
 
 	/// Get the contact manifold. Do not modify the manifold unless you understand the
-	/// internals of Box2D.
+	/// internals of Box2D. A contact without points gets an empty manifold of its own
+	/// here, the const version reads a shared one instead.
 	cb2Manifold* GetManifold();
 	const cb2Manifold* GetManifold() const;
 
@@ -148,6 +155,7 @@ protected:
 	friend class cb2ContactManager;
 	friend class cb2World;
 	friend class cb2ContactSolver;
+	friend class cb2SoftContactSolver;
 	friend class cb2Body;
 	friend class cb2Fixture;
 
@@ -170,14 +178,26 @@ protected:
 		e_bulletHitFlag		= 0x0010,
 
 		// This contact has a valid TOI in m_toi
-		e_toiFlag			= 0x0020
+		e_toiFlag			= 0x0020,
+
+		// This contact is in the contact manager's awake array
+		e_awakeFlag			= 0x0040,
+
+		// The manifold was evaluated at the relative pose in m_relativeXf
+		e_poseFlag			= 0x0080,
+
+		// The sensor overlap was tested at the relative pose in m_relativeXf
+		e_sensorPoseFlag	= 0x0100,
+
+		// The island fell asleep at the relative pose in m_relativeXf
+		e_sleepPoseFlag		= 0x0200
 	};
 
 	/// Flag this contact for filtering. Filtering will occur the next time step.
 	void FlagForFiltering();
 
 	static void AddType(cb2ContactCreateFcn* createFcn, cb2ContactDestroyFcn* destroyFcn,
-						cb2Shape::Type typeA, cb2Shape::Type typeB);
+						cb2ContactManifoldFcn* manifoldFcn, cb2Shape::Type typeA, cb2Shape::Type typeB);
 	static void InitializeRegisters();
 	static cb2Contact* Create(cb2Fixture* fixtureA, int indexA, cb2Fixture* fixtureB, int indexB, cb2BlockAllocator* allocator);
 	static void Destroy(cb2Contact* contact, cb2Shape::Type typeA, cb2Shape::Type typeB, cb2BlockAllocator* allocator);
@@ -189,11 +209,45 @@ protected:
 
 	void Update(cb2ContactListener* listener);
 
+	// Update is split in two so the narrow phase can run in parallel.
+	// ComputeManifold returns the touching state and only writes the pose the
+	// manifold was evaluated at, Commit stores the result, wakes the bodies and
+	// calls the listener.
+	bool ComputeManifold(cb2Manifold* manifold);
+
+	// The same without the virtual Evaluate call, T is the class of this contact.
+	template <typename T>
+	bool ComputeManifold(cb2Manifold* manifold);
+
+	// Compute the manifolds of the overlapping updates, all contacts are of class T.
+	// The contact manager sorts the contacts by shape types to run these in batches.
+	template <typename T>
+	static void ComputeManifolds(cb2ContactUpdate* updates, int count);
+	static void ComputeManifoldBatch(cb2ContactUpdate* updates, int count, cb2CollideBatchFcn* collideFcn);
+
+	bool PrepareManifold(cb2Manifold* manifold, bool* touching);
+	bool TestSensorOverlap(const cb2Transform& xfA, const cb2Transform& xfB);
+	bool FinishManifold(cb2Manifold* manifold);
+	void AddSpeculativePoints(cb2Manifold* manifold, float dt);
+
+	// Can the manifold evaluated at m_relativeXf be kept for this relative pose?
+	bool CanReuseManifold(const cb2Transform& relativeXf, float linearTolerance, float angularTolerance) const;
+	void Commit(const cb2Manifold& manifold, bool touching, cb2ContactListener* listener);
+
+	// Store the manifold, allocating it when the first points appear and freeing it
+	// when the last ones go.
+	void SetManifold(const cb2Manifold& manifold, cb2BlockAllocator* allocator);
+
 	static cb2ContactRegister s_registers[cb2Shape::e_typeCount][cb2Shape::e_typeCount];
 	static bool s_initialized;
+	static const cb2Manifold s_emptyManifold;
 
 	unsigned int m_flags;
 
+	// Index in the contact manager's awake array. Contacts between sleeping bodies are
+	// dormant and only live in the world list.
+	int m_awakeIndex;
+
 	// World pool and list pointers.
 	cb2Contact* m_prev;
 	cb2Contact* m_next;
@@ -202,31 +256,43 @@ protected:
 	cb2ContactEdge m_nodeA;
 	cb2ContactEdge m_nodeB;
 
+	// Touching solid contacts belong to the persistent island of their bodies.
+	cb2PersistentIsland* m_island;
+	cb2Contact* m_islandPrev;
+	cb2Contact* m_islandNext;
+
 	cb2Fixture* m_fixtureA;
 	cb2Fixture* m_fixtureB;
 
 	int m_indexA;
 	int m_indexB;
 
-	cb2Manifold m_manifold;
+	// NULL while there are no points, unless the mutable GetManifold made one.
+	cb2Manifold* m_manifold;
+
+	// Pose of body B in the frame of body A when the manifold was evaluated.
+	cb2Transform m_relativeXf;
+
+	// Sensors: the distance between the shapes at m_relativeXf and how far the
+	// points of child B reach from the origin of body B.
+	float m_sensorSeparation;
+	float m_sensorExtent;
 
 	int m_toiCount;
 	float m_toi;
 
+	// Last simplex of the time of impact, warm starts the next one.
+	cb2SimplexCache m_simplexCache;
+
 	float m_friction;
 	float m_restitution;
 
 	float m_tangentSpeed;
 };
 
-inline cb2Manifold* cb2Contact::GetManifold()
-{
-	return &m_manifold;
-}
-
 inline const cb2Manifold* cb2Contact::GetManifold() const
 {
-	return &m_manifold;
+	return m_manifold ? m_manifold : &s_emptyManifold;
 }
 
 inline void cb2Contact::GetWorldManifold(cb2WorldManifold* worldManifold) const
@@ -236,7 +302,7 @@ inline void cb2Contact::GetWorldManifold(cb2WorldManifold* worldManifold) const
 	const cb2Shape* shapeA = m_fixtureA->GetShape();
 	const cb2Shape* shapeB = m_fixtureB->GetShape();
 
-	worldManifold->Initialize(&m_manifold, bodyA->GetTransform(), shapeA->m_radius, bodyB->GetTransform(), shapeB->m_radius);
+	worldManifold->Initialize(GetManifold(), bodyA->GetTransform(), shapeA->m_radius, bodyB->GetTransform(), shapeB->m_radius);
 }
 
 inline void cb2Contact::SetEnabled(bool flag)
@@ -301,11 +367,6 @@ inline int cb2Contact::GetChildIndexB() const
 	return m_indexB;
 }
 
-inline void cb2Contact::FlagForFiltering()
-{
-	m_flags |= e_filterFlag;
-}
-
 inline void cb2Contact::SetFriction(float friction)
 {
 	m_friction = friction;
@@ -23,39 +23,275 @@
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
 #include <CinderBox2D/Dynamics/cb2World.h>
 #include <CinderBox2D/Common/cb2StackAllocator.h>
+#include <CinderBox2D/Common/cb2Simd.h>
+
+#include <algorithm>
 
 #define CB2_DEBUG_SOLVER 0
 
-struct cb2ContactPositionConstraint
+// The contact position constraints, laid out like cb2ContactVelocityConstraints.
+struct cb2ContactPositionConstraints
 {
-	ci::Vec2f localPoints[cb2_maxManifoldPoints];
-	ci::Vec2f localNormal;
-	ci::Vec2f localPoint;
-	int indexA;
-	int indexB;
-	float invMassA, invMassB;
-	ci::Vec2f localCenterA, localCenterB;
-	float invIA, invIB;
-	cb2Manifold::Type type;
-	float radiusA, radiusB;
-	int pointCount;
+	float* localPointsX[cb2_maxManifoldPoints];
+	float* localPointsY[cb2_maxManifoldPoints];
+	float* localNormalX;
+	float* localNormalY;
+	float* localPointX;
+	float* localPointY;
+	int* indexA;
+	int* indexB;
+	float* invMassA;
+	float* invMassB;
+	float* localCenterAx;
+	float* localCenterAy;
+	float* localCenterBx;
+	float* localCenterBy;
+	float* invIA;
+	float* invIB;
+	int* type;
+	float* radiusA;
+	float* radiusB;
+	int* pointCount;
 };
 
+// Number of columns in each layout. Every column entry is four bytes.
+const int cb2_velocityColumnCount = 9 * cb2_maxManifoldPoints + 18;
+const int cb2_positionColumnCount = 2 * cb2_maxManifoldPoints + 18;
+
+// Hand out the next column of the constraint block.
+template <typename T>
+inline T* cb2NextColumn(char** cursor, int count)
+{
+	T* column = (T*)*cursor;
+	*cursor += count * sizeof(T);
+	return column;
+}
+
+#if defined(CB2_SIMD_SOLVER)
+// Assign the contacts to batches of cb2_simdWidth slots so that no two slots of
+// a batch touch the same dynamic body. Only the last few batches are searched
+// for a free slot, the rest keep the list order. Only the contacts listed in
+// indices get a slot, all of them without a list. Returns the number of slots.
+static int cb2BatchContacts(int* slots, cb2Contact** contacts, const int* indices, int count)
+{
+	const int k_openBatches = 8;
+
+	int batchCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		int contactIndex = indices ? indices[i] : i;
+		cb2Body* bodyA = contacts[contactIndex]->GetFixtureA()->GetBody();
+		cb2Body* bodyB = contacts[contactIndex]->GetFixtureB()->GetBody();
+		bool movingA = bodyA->GetType() == cb2_dynamicBody;
+		bool movingB = bodyB->GetType() == cb2_dynamicBody;
+
+		int slot = -1;
+		for (int b = cb2Max(batchCount - k_openBatches, 0); b < batchCount && slot == -1; ++b)
+		{
+			int* lanes = slots + cb2_simdWidth * b;
+			int lane = 0;
+			for (; lane < cb2_simdWidth && lanes[lane] != -1; ++lane)
+			{
+				cb2Contact* other = contacts[lanes[lane]];
+				cb2Body* otherA = other->GetFixtureA()->GetBody();
+				cb2Body* otherB = other->GetFixtureB()->GetBody();
+				if (movingA && (bodyA == otherA || bodyA == otherB))
+				{
+					break;
+				}
+
+				if (movingB && (bodyB == otherA || bodyB == otherB))
+				{
+					break;
+				}
+			}
+
+			if (lane < cb2_simdWidth && lanes[lane] == -1)
+			{
+				slot = cb2_simdWidth * b + lane;
+			}
+		}
+
+		if (slot == -1)
+		{
+			slot = cb2_simdWidth * batchCount++;
+			for (int lane = 0; lane < cb2_simdWidth; ++lane)
+			{
+				slots[slot + lane] = -1;
+			}
+		}
+
+		slots[slot] = contactIndex;
+	}
+
+	return cb2_simdWidth * batchCount;
+}
+#endif
+
+inline cb2Manifold* cb2ContactSolver::GetSolverManifold(int contactIndex) const
+{
+	return m_manifolds ? m_manifolds[contactIndex] : m_contacts[contactIndex]->GetManifold();
+}
+
+// Orders the contacts by body pair, ties keep the contact order. Each pair is
+// reduced on its own, so the order of the pairs does not matter.
+struct cb2ContactPairOrder
+{
+	bool operator()(int a, int b) const
+	{
+		const cb2Body* aA = contacts[a]->GetFixtureA()->GetBody();
+		const cb2Body* bA = contacts[b]->GetFixtureA()->GetBody();
+		if (aA != bA)
+		{
+			return aA < bA;
+		}
+
+		const cb2Body* aB = contacts[a]->GetFixtureB()->GetBody();
+		const cb2Body* bB = contacts[b]->GetFixtureB()->GetBody();
+		if (aB != bB)
+		{
+			return aB < bB;
+		}
+
+		return a < b;
+	}
+
+	cb2Contact** contacts;
+};
+
+// Contacts of one body pair may share a constraint if they see the same plane.
+static bool cb2CanMerge(const cb2Contact* leader, const cb2Contact* contact)
+{
+	const cb2Manifold* ml = leader->GetManifold();
+	const cb2Manifold* mc = contact->GetManifold();
+	if (ml->type == cb2Manifold::e_circles || mc->type != ml->type)
+	{
+		return false;
+	}
+
+	if (leader->GetFixtureA()->GetShape()->m_radius != contact->GetFixtureA()->GetShape()->m_radius ||
+		leader->GetFixtureB()->GetShape()->m_radius != contact->GetFixtureB()->GetShape()->m_radius)
+	{
+		return false;
+	}
+
+	if (leader->GetFriction() != contact->GetFriction() || leader->GetRestitution() != contact->GetRestitution() ||
+		leader->GetTangentSpeed() != contact->GetTangentSpeed())
+	{
+		return false;
+	}
+
+	// Both normals are in the frame of the same body.
+	return cb2Dot(ml->localNormal, mc->localNormal) >= cosf(cb2_reductionAngularTolerance);
+}
+
 cb2ContactSolver::cb2ContactSolver(cb2ContactSolverDef* def)
 {
 	m_step = def->step;
 	m_allocator = def->allocator;
 	m_count = def->count;
-	m_positionConstraints = (cb2ContactPositionConstraint*)m_allocator->Allocate(m_count * sizeof(cb2ContactPositionConstraint));
-	m_velocityConstraints = (cb2ContactVelocityConstraint*)m_allocator->Allocate(m_count * sizeof(cb2ContactVelocityConstraint));
 	m_positions = def->positions;
 	m_velocities = def->velocities;
 	m_contacts = def->contacts;
 
+	m_reductionBlock = NULL;
+	m_manifolds = NULL;
+	m_leaders = NULL;
+	m_sources = NULL;
+	m_leaderCount = m_count;
+	if (def->reduceContacts && m_count > 1)
+	{
+		ReduceContacts();
+	}
+
+	m_constraintCount = m_leaderCount;
+#if defined(CB2_SIMD_SOLVER)
+	// Worst case every contact starts a batch.
+	m_slotContacts = (int*)m_allocator->Allocate(cb2_simdWidth * m_leaderCount * sizeof(int));
+	m_constraintCount = cb2BatchContacts(m_slotContacts, m_contacts, m_leaders, m_leaderCount);
+#endif
+
+	// All the columns live in a single block.
+	int columnCount = cb2_velocityColumnCount + cb2_positionColumnCount;
+	int blockSize = sizeof(cb2ContactPositionConstraints) + m_constraintCount * columnCount * sizeof(float);
+	m_constraintBlock = m_allocator->Allocate(blockSize);
+	char* cursor = (char*)m_constraintBlock;
+
+#if defined(CB2_SIMD_SOLVER)
+	// Empty slots stay zero, which makes them solve to nothing.
+	memset(m_constraintBlock, 0, blockSize);
+#endif
+
+	m_positionConstraints = cb2NextColumn<cb2ContactPositionConstraints>(&cursor, 1);
+
+	cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+	for (int j = 0; j < cb2_maxManifoldPoints; ++j)
+	{
+		cb2VelocityConstraintPoints* vcp = vc->points + j;
+		vcp->rAx = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->rAy = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->rBx = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->rBy = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->normalImpulse = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->tangentImpulse = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->normalMass = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->tangentMass = cb2NextColumn<float>(&cursor, m_constraintCount);
+		vcp->velocityBias = cb2NextColumn<float>(&cursor, m_constraintCount);
+	}
+	vc->normalX = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->normalY = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->normalMass11 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->normalMass12 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->normalMass22 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->K11 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->K12 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->K22 = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->indexA = cb2NextColumn<int>(&cursor, m_constraintCount);
+	vc->indexB = cb2NextColumn<int>(&cursor, m_constraintCount);
+	vc->invMassA = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->invMassB = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->invIA = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->invIB = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->friction = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->restitution = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->tangentSpeed = cb2NextColumn<float>(&cursor, m_constraintCount);
+	vc->pointCount = cb2NextColumn<int>(&cursor, m_constraintCount);
+
+	cb2ContactPositionConstraints* pc = m_positionConstraints;
+	for (int j = 0; j < cb2_maxManifoldPoints; ++j)
+	{
+		pc->localPointsX[j] = cb2NextColumn<float>(&cursor, m_constraintCount);
+		pc->localPointsY[j] = cb2NextColumn<float>(&cursor, m_constraintCount);
+	}
+	pc->localNormalX = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localNormalY = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localPointX = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localPointY = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->indexA = cb2NextColumn<int>(&cursor, m_constraintCount);
+	pc->indexB = cb2NextColumn<int>(&cursor, m_constraintCount);
+	pc->invMassA = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->invMassB = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localCenterAx = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localCenterAy = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localCenterBx = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->localCenterBy = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->invIA = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->invIB = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->type = cb2NextColumn<int>(&cursor, m_constraintCount);
+	pc->radiusA = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->radiusB = cb2NextColumn<float>(&cursor, m_constraintCount);
+	pc->pointCount = cb2NextColumn<int>(&cursor, m_constraintCount);
+
 	// Initialize position independent portions of the constraints.
-	for (int i = 0; i < m_count; ++i)
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2Contact* contact = m_contacts[i];
+		int contactIndex = GetContactIndex(i);
+		if (contactIndex < 0)
+		{
+			continue;
+		}
+
+		cb2Contact* contact = m_contacts[contactIndex];
 
 		cb2Fixture* fixtureA = contact->m_fixtureA;
 		cb2Fixture* fixtureB = contact->m_fixtureB;
@@ -65,96 +301,303 @@ cb2ContactSolver::cb2ContactSolver(cb2ContactSolverDef* def)
 		float radiusB = shapeB->m_radius;
 		cb2Body* bodyA = fixtureA->GetBody();
 		cb2Body* bodyB = fixtureB->GetBody();
-		cb2Manifold* manifold = contact->GetManifold();
+		cb2Manifold* manifold = GetSolverManifold(contactIndex);
 
 		int pointCount = manifold->pointCount;
 		cb2Assert(pointCount > 0);
 
-		cb2ContactVelocityConstraint* vc = m_velocityConstraints + i;
-		vc->friction = contact->m_friction;
-		vc->restitution = contact->m_restitution;
-		vc->tangentSpeed = contact->m_tangentSpeed;
-		vc->indexA = bodyA->m_islandIndex;
-		vc->indexB = bodyB->m_islandIndex;
-		vc->invMassA = bodyA->m_invMass;
-		vc->invMassB = bodyB->m_invMass;
-		vc->invIA = bodyA->m_invI;
-		vc->invIB = bodyB->m_invI;
-		vc->contactIndex = i;
-		vc->pointCount = pointCount;
-		cb2::setZero(vc->K);
-		cb2::setZero(vc->normalMass);
-
-		cb2ContactPositionConstraint* pc = m_positionConstraints + i;
-		pc->indexA = bodyA->m_islandIndex;
-		pc->indexB = bodyB->m_islandIndex;
-		pc->invMassA = bodyA->m_invMass;
-		pc->invMassB = bodyB->m_invMass;
-		pc->localCenterA = bodyA->m_sweep.localCenter;
-		pc->localCenterB = bodyB->m_sweep.localCenter;
-		pc->invIA = bodyA->m_invI;
-		pc->invIB = bodyB->m_invI;
-		pc->localNormal = manifold->localNormal;
-		pc->localPoint = manifold->localPoint;
-		pc->pointCount = pointCount;
-		pc->radiusA = radiusA;
-		pc->radiusB = radiusB;
-		pc->type = manifold->type;
+		// Sleeping bodies of other islands hold still, see cb2SleepDef::wakeHopCount.
+		float mA = bodyA->IsAwake() ? bodyA->m_invMass : 0.0f;
+		float mB = bodyB->IsAwake() ? bodyB->m_invMass : 0.0f;
+		float iA = bodyA->IsAwake() ? bodyA->m_invI : 0.0f;
+		float iB = bodyB->IsAwake() ? bodyB->m_invI : 0.0f;
+
+		vc->friction[i] = contact->m_friction;
+		vc->restitution[i] = contact->m_restitution;
+		vc->tangentSpeed[i] = contact->m_tangentSpeed;
+		vc->indexA[i] = bodyA->m_islandIndex;
+		vc->indexB[i] = bodyB->m_islandIndex;
+		vc->invMassA[i] = mA;
+		vc->invMassB[i] = mB;
+		vc->invIA[i] = iA;
+		vc->invIB[i] = iB;
+		vc->pointCount[i] = pointCount;
+		vc->K11[i] = 0.0f;
+		vc->K12[i] = 0.0f;
+		vc->K22[i] = 0.0f;
+		vc->normalMass11[i] = 0.0f;
+		vc->normalMass12[i] = 0.0f;
+		vc->normalMass22[i] = 0.0f;
+
+		pc->indexA[i] = bodyA->m_islandIndex;
+		pc->indexB[i] = bodyB->m_islandIndex;
+		pc->invMassA[i] = mA;
+		pc->invMassB[i] = mB;
+		pc->localCenterAx[i] = bodyA->m_sweep.localCenter.x;
+		pc->localCenterAy[i] = bodyA->m_sweep.localCenter.y;
+		pc->localCenterBx[i] = bodyB->m_sweep.localCenter.x;
+		pc->localCenterBy[i] = bodyB->m_sweep.localCenter.y;
+		pc->invIA[i] = iA;
+		pc->invIB[i] = iB;
+		pc->localNormalX[i] = manifold->localNormal.x;
+		pc->localNormalY[i] = manifold->localNormal.y;
+		pc->localPointX[i] = manifold->localPoint.x;
+		pc->localPointY[i] = manifold->localPoint.y;
+		pc->pointCount[i] = pointCount;
+		pc->radiusA[i] = radiusA;
+		pc->radiusB[i] = radiusB;
+		pc->type[i] = manifold->type;
 
 		for (int j = 0; j < pointCount; ++j)
 		{
 			cb2ManifoldPoint* cp = manifold->points + j;
-			cb2VelocityConstraintPoint* vcp = vc->points + j;
+			cb2VelocityConstraintPoints* vcp = vc->points + j;
 	
 			if (m_step.warmStarting)
 			{
-				vcp->normalImpulse = m_step.dtRatio * cp->normalImpulse;
-				vcp->tangentImpulse = m_step.dtRatio * cp->tangentImpulse;
+				vcp->normalImpulse[i] = m_step.dtRatio * cp->normalImpulse;
+				vcp->tangentImpulse[i] = m_step.dtRatio * cp->tangentImpulse;
 			}
 			else
 			{
-				vcp->normalImpulse = 0.0f;
-				vcp->tangentImpulse = 0.0f;
+				vcp->normalImpulse[i] = 0.0f;
+				vcp->tangentImpulse[i] = 0.0f;
 			}
 
-			cb2::setZero(vcp->rA);
-			cb2::setZero(vcp->rB);
-			vcp->normalMass = 0.0f;
-			vcp->tangentMass = 0.0f;
-			vcp->velocityBias = 0.0f;
+			vcp->rAx[i] = 0.0f;
+			vcp->rAy[i] = 0.0f;
+			vcp->rBx[i] = 0.0f;
+			vcp->rBy[i] = 0.0f;
+			vcp->normalMass[i] = 0.0f;
+			vcp->tangentMass[i] = 0.0f;
+			vcp->velocityBias[i] = 0.0f;
 
-			pc->localPoints[j] = cp->localPoint;
+			pc->localPointsX[j][i] = cp->localPoint.x;
+			pc->localPointsY[j][i] = cp->localPoint.y;
 		}
 	}
 }
 
 cb2ContactSolver::~cb2ContactSolver()
 {
-	m_allocator->Free(m_velocityConstraints);
-	m_allocator->Free(m_positionConstraints);
+	m_allocator->Free(m_constraintBlock);
+#if defined(CB2_SIMD_SOLVER)
+	m_allocator->Free(m_slotContacts);
+#endif
+	if (m_reductionBlock)
+	{
+		m_allocator->Free(m_reductionBlock);
+	}
+}
+
+// Group the contacts of each body pair that see the same plane and give every
+// group a single constraint. Chains and compound bodies make one contact per
+// child they touch, a box on a chain often has three of them.
+void cb2ContactSolver::ReduceContacts()
+{
+	// Every merged manifold takes two contacts or more.
+	int count = m_count;
+	int mergedCapacity = count / 2;
+	int blockSize = count * sizeof(cb2Manifold*) + mergedCapacity * sizeof(cb2Manifold) +
+		count * (1 + cb2_maxManifoldPoints) * sizeof(int);
+	m_reductionBlock = m_allocator->Allocate(blockSize);
+	m_manifolds = (cb2Manifold**)m_reductionBlock;
+	cb2Manifold* merged = (cb2Manifold*)(m_manifolds + count);
+	m_leaders = (int*)(merged + mergedCapacity);
+	m_sources = m_leaders + count;
+
+	int* order = (int*)m_allocator->Allocate(3 * count * sizeof(int));
+	int* groupOf = order + count;
+	int* group = groupOf + count;
+	for (int i = 0; i < count; ++i)
+	{
+		order[i] = i;
+		groupOf[i] = i;
+	}
+
+	cb2ContactPairOrder pairOrder;
+	pairOrder.contacts = m_contacts;
+	std::sort(order, order + count, pairOrder);
+
+	for (int runStart = 0; runStart < count;)
+	{
+		// The run of contacts between the same two bodies.
+		int runEnd = runStart + 1;
+		cb2Body* bodyA = m_contacts[order[runStart]]->GetFixtureA()->GetBody();
+		cb2Body* bodyB = m_contacts[order[runStart]]->GetFixtureB()->GetBody();
+		while (runEnd < count && m_contacts[order[runEnd]]->GetFixtureA()->GetBody() == bodyA &&
+			m_contacts[order[runEnd]]->GetFixtureB()->GetBody() == bodyB)
+		{
+			++runEnd;
+		}
+
+		for (int i = runStart + 1; i < runEnd; ++i)
+		{
+			cb2Contact* contact = m_contacts[order[i]];
+			for (int j = runStart; j < i; ++j)
+			{
+				int leader = order[j];
+				if (groupOf[leader] == leader && cb2CanMerge(m_contacts[leader], contact))
+				{
+					groupOf[order[i]] = leader;
+					break;
+				}
+			}
+		}
+
+		for (int i = runStart; i < runEnd; ++i)
+		{
+			int leader = order[i];
+			if (groupOf[leader] != leader)
+			{
+				continue;
+			}
+
+			int groupCount = 0;
+			for (int j = i; j < runEnd; ++j)
+			{
+				if (groupOf[order[j]] == leader)
+				{
+					group[groupCount++] = order[j];
+				}
+			}
+
+			for (int j = 0; j < cb2_maxManifoldPoints; ++j)
+			{
+				m_sources[leader * cb2_maxManifoldPoints + j] = leader * cb2_maxManifoldPoints + j;
+			}
+
+			if (groupCount == 1)
+			{
+				m_manifolds[leader] = m_contacts[leader]->GetManifold();
+				continue;
+			}
+
+			cb2Assert(merged < (cb2Manifold*)m_leaders);
+			m_manifolds[leader] = merged;
+			MergeManifolds(leader, group, groupCount, merged++);
+		}
+
+		runStart = runEnd;
+	}
+
+	// The constraints keep the contact order.
+	m_leaderCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (groupOf[i] == i)
+		{
+			m_leaders[m_leaderCount++] = i;
+		}
+	}
+
+	m_allocator->Free(order);
+}
+
+// Merge the points of a group into the manifold of its leader. The two points
+// farthest apart along the leader plane stay, they span the support of a box
+// resting across several edges. The normals agree, so the separation is close to
+// linear along the plane and the deepest point is one of the two. The points are
+// moved along the leader normal so that they keep their own separation.
+void cb2ContactSolver::MergeManifolds(int leader, const int* group, int groupCount, cb2Manifold* merged)
+{
+	const cb2Manifold* leaderManifold = m_contacts[leader]->GetManifold();
+	*merged = *leaderManifold;
+
+	// The reference body carries the plane, the incident body the points.
+	cb2Contact* contact = m_contacts[leader];
+	cb2Body* bodyA = contact->GetFixtureA()->GetBody();
+	cb2Body* bodyB = contact->GetFixtureB()->GetBody();
+	bool faceA = leaderManifold->type == cb2Manifold::e_faceA;
+	cb2Body* reference = faceA ? bodyA : bodyB;
+	cb2Body* incident = faceA ? bodyB : bodyA;
+
+	const cb2Position& positionR = m_positions[reference->m_islandIndex];
+	const cb2Position& positionI = m_positions[incident->m_islandIndex];
+	cb2Transform xfR, xfI;
+	xfR.q.set(positionR.a);
+	xfI.q.set(positionI.a);
+	xfR.p = positionR.c - cb2Mul(xfR.q, reference->m_sweep.localCenter);
+	xfI.p = positionI.c - cb2Mul(xfI.q, incident->m_sweep.localCenter);
+
+	ci::Vec2f normal = cb2Mul(xfR.q, leaderManifold->localNormal);
+	ci::Vec2f planePoint = cb2Mul(xfR, leaderManifold->localPoint);
+	ci::Vec2f tangent = cb2Cross(normal, 1.0f);
+
+	// Find the two points farthest apart along the tangent.
+	int first = -1;
+	int last = -1;
+	float minDistance = cb2_maxFloat;
+	float maxDistance = -cb2_maxFloat;
+	for (int k = 0; k < groupCount; ++k)
+	{
+		const cb2Manifold* manifold = m_contacts[group[k]]->GetManifold();
+		for (int j = 0; j < manifold->pointCount; ++j)
+		{
+			ci::Vec2f point = cb2Mul(xfI, manifold->points[j].localPoint);
+			float distance = cb2Dot(point - planePoint, tangent);
+			if (distance < minDistance)
+			{
+				minDistance = distance;
+				first = group[k] * cb2_maxManifoldPoints + j;
+			}
+
+			if (distance > maxDistance)
+			{
+				maxDistance = distance;
+				last = group[k] * cb2_maxManifoldPoints + j;
+			}
+		}
+	}
+
+	m_sources[leader * cb2_maxManifoldPoints + 0] = first;
+	m_sources[leader * cb2_maxManifoldPoints + 1] = last;
+	merged->pointCount = maxDistance - minDistance > cb2_linearSlop ? 2 : 1;
+
+	for (int j = 0; j < merged->pointCount; ++j)
+	{
+		int source = m_sources[leader * cb2_maxManifoldPoints + j];
+		const cb2Manifold* manifold = m_contacts[source / cb2_maxManifoldPoints]->GetManifold();
+		const cb2ManifoldPoint* mp = manifold->points + source % cb2_maxManifoldPoints;
+
+		ci::Vec2f ownNormal = cb2Mul(xfR.q, manifold->localNormal);
+		ci::Vec2f ownPlanePoint = cb2Mul(xfR, manifold->localPoint);
+		ci::Vec2f point = cb2Mul(xfI, mp->localPoint);
+		float separation = cb2Dot(point - ownPlanePoint, ownNormal);
+		point += (separation - cb2Dot(point - planePoint, normal)) * normal;
+
+		merged->points[j] = *mp;
+		merged->points[j].localPoint = cb2MulT(xfI, point);
+	}
 }
 
 // Initialize position dependent portions of the velocity constraints.
 void cb2ContactSolver::InitializeVelocityConstraints()
 {
-	for (int i = 0; i < m_count; ++i)
+	cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+	const cb2ContactPositionConstraints* pc = m_positionConstraints;
+
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2ContactVelocityConstraint* vc = m_velocityConstraints + i;
-		cb2ContactPositionConstraint* pc = m_positionConstraints + i;
+		int contactIndex = GetContactIndex(i);
+		if (contactIndex < 0)
+		{
+			continue;
+		}
 
-		float radiusA = pc->radiusA;
-		float radiusB = pc->radiusB;
-		cb2Manifold* manifold = m_contacts[vc->contactIndex]->GetManifold();
+		float radiusA = pc->radiusA[i];
+		float radiusB = pc->radiusB[i];
+		cb2Manifold* manifold = GetSolverManifold(contactIndex);
 
-		int indexA = vc->indexA;
-		int indexB = vc->indexB;
+		int indexA = vc->indexA[i];
+		int indexB = vc->indexB[i];
 
-		float mA = vc->invMassA;
-		float mB = vc->invMassB;
-		float iA = vc->invIA;
-		float iB = vc->invIB;
-		ci::Vec2f localCenterA = pc->localCenterA;
-		ci::Vec2f localCenterB = pc->localCenterB;
+		float mA = vc->invMassA[i];
+		float mB = vc->invMassB[i];
+		float iA = vc->invIA[i];
+		float iB = vc->invIB[i];
+		ci::Vec2f localCenterA(pc->localCenterAx[i], pc->localCenterAy[i]);
+		ci::Vec2f localCenterB(pc->localCenterBx[i], pc->localCenterBy[i]);
 
 		ci::Vec2f cA = m_positions[indexA].c;
 		float aA = m_positions[indexA].a;
@@ -177,51 +620,63 @@ void cb2ContactSolver::InitializeVelocityConstraints()
 		cb2WorldManifold worldManifold;
 		worldManifold.Initialize(manifold, xfA, radiusA, xfB, radiusB);
 
-		vc->normal = worldManifold.normal;
+		ci::Vec2f normal = worldManifold.normal;
+		vc->normalX[i] = normal.x;
+		vc->normalY[i] = normal.y;
 
-		int pointCount = vc->pointCount;
+		int pointCount = vc->pointCount[i];
 		for (int j = 0; j < pointCount; ++j)
 		{
-			cb2VelocityConstraintPoint* vcp = vc->points + j;
+			cb2VelocityConstraintPoints* vcp = vc->points + j;
 
-			vcp->rA = worldManifold.points[j] - cA;
-			vcp->rB = worldManifold.points[j] - cB;
+			ci::Vec2f rA = worldManifold.points[j] - cA;
+			ci::Vec2f rB = worldManifold.points[j] - cB;
+			vcp->rAx[i] = rA.x;
+			vcp->rAy[i] = rA.y;
+			vcp->rBx[i] = rB.x;
+			vcp->rBy[i] = rB.y;
 
-			float rnA = cb2Cross(vcp->rA, vc->normal);
-			float rnB = cb2Cross(vcp->rB, vc->normal);
+			float rnA = cb2Cross(rA, normal);
+			float rnB = cb2Cross(rB, normal);
 
 			float kNormal = mA + mB + iA * rnA * rnA + iB * rnB * rnB;
 
-			vcp->normalMass = kNormal > 0.0f ? 1.0f / kNormal : 0.0f;
+			vcp->normalMass[i] = kNormal > 0.0f ? 1.0f / kNormal : 0.0f;
 
-			ci::Vec2f tangent = cb2Cross(vc->normal, 1.0f);
+			ci::Vec2f tangent = cb2Cross(normal, 1.0f);
 
-			float rtA = cb2Cross(vcp->rA, tangent);
-			float rtB = cb2Cross(vcp->rB, tangent);
+			float rtA = cb2Cross(rA, tangent);
+			float rtB = cb2Cross(rB, tangent);
 
 			float kTangent = mA + mB + iA * rtA * rtA + iB * rtB * rtB;
 
-			vcp->tangentMass = kTangent > 0.0f ? 1.0f /  kTangent : 0.0f;
+			vcp->tangentMass[i] = kTangent > 0.0f ? 1.0f /  kTangent : 0.0f;
 
 			// Setup a velocity bias for restitution.
-			vcp->velocityBias = 0.0f;
-			float vRel = cb2Dot(vc->normal, vB + cb2Cross(wB, vcp->rB) - vA - cb2Cross(wA, vcp->rA));
-			if (vRel < -cb2_velocityThreshold)
+			vcp->velocityBias[i] = 0.0f;
+			float vRel = cb2Dot(normal, vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA));
+			float separation = worldManifold.separations[j];
+			if (m_step.speculative && separation > 0.0f)
+			{
+				// Speculative points allow the approach that closes the gap.
+				vcp->velocityBias[i] = -separation * m_step.inv_dt;
+			}
+			else if (vRel < -m_step.tolerances.velocityThreshold)
 			{
-				vcp->velocityBias = -vc->restitution * vRel;
+				vcp->velocityBias[i] = -vc->restitution[i] * vRel;
 			}
 		}
 
 		// If we have two points, then prepare the block solver.
-		if (vc->pointCount == 2)
+		if (pointCount == 2)
 		{
-			cb2VelocityConstraintPoint* vcp1 = vc->points + 0;
-			cb2VelocityConstraintPoint* vcp2 = vc->points + 1;
+			const cb2VelocityConstraintPoints* vcp1 = vc->points + 0;
+			const cb2VelocityConstraintPoints* vcp2 = vc->points + 1;
 
-			float rn1A = cb2Cross(vcp1->rA, vc->normal);
-			float rn1B = cb2Cross(vcp1->rB, vc->normal);
-			float rn2A = cb2Cross(vcp2->rA, vc->normal);
-			float rn2B = cb2Cross(vcp2->rB, vc->normal);
+			float rn1A = cb2Cross(ci::Vec2f(vcp1->rAx[i], vcp1->rAy[i]), normal);
+			float rn1B = cb2Cross(ci::Vec2f(vcp1->rBx[i], vcp1->rBy[i]), normal);
+			float rn2A = cb2Cross(ci::Vec2f(vcp2->rAx[i], vcp2->rAy[i]), normal);
+			float rn2B = cb2Cross(ci::Vec2f(vcp2->rBx[i], vcp2->rBy[i]), normal);
 
 			float k11 = mA + mB + iA * rn1A * rn1A + iB * rn1B * rn1B;
 			float k22 = mA + mB + iA * rn2A * rn2A + iB * rn2B * rn2B;
@@ -232,15 +687,23 @@ void cb2ContactSolver::InitializeVelocityConstraints()
 			if (k11 * k11 < k_maxConditionNumber * (k11 * k22 - k12 * k12))
 			{
 				// K is safe to invert.
-				vc->K.set(k11, k12,
-				          k12, k22);
-				vc->normalMass = vc->K.inverted();
+				ci::Matrix22f K;
+				K.set(k11, k12,
+				      k12, k22);
+				ci::Matrix22f normalMass = K.inverted();
+
+				vc->K11[i] = k11;
+				vc->K12[i] = k12;
+				vc->K22[i] = k22;
+				vc->normalMass11[i] = normalMass.m00;
+				vc->normalMass12[i] = normalMass.m01;
+				vc->normalMass22[i] = normalMass.m11;
 			}
 			else
 			{
 				// The constraints are redundant, just use one.
 				// TODO_ERIN use deepest?
-				vc->pointCount = 1;
+				vc->pointCount[i] = 1;
 			}
 		}
 	}
@@ -248,34 +711,37 @@ void cb2ContactSolver::InitializeVelocityConstraints()
 
 void cb2ContactSolver::WarmStart()
 {
+	const cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+
 	// Warm start.
-	for (int i = 0; i < m_count; ++i)
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2ContactVelocityConstraint* vc = m_velocityConstraints + i;
-
-		int indexA = vc->indexA;
-		int indexB = vc->indexB;
-		float mA = vc->invMassA;
-		float iA = vc->invIA;
-		float mB = vc->invMassB;
-		float iB = vc->invIB;
-		int pointCount = vc->pointCount;
+		int indexA = vc->indexA[i];
+		int indexB = vc->indexB[i];
+		float mA = vc->invMassA[i];
+		float iA = vc->invIA[i];
+		float mB = vc->invMassB[i];
+		float iB = vc->invIB[i];
+		int pointCount = vc->pointCount[i];
 
 		ci::Vec2f vA = m_velocities[indexA].v;
 		float wA = m_velocities[indexA].w;
 		ci::Vec2f vB = m_velocities[indexB].v;
 		float wB = m_velocities[indexB].w;
 
-		ci::Vec2f normal = vc->normal;
+		ci::Vec2f normal(vc->normalX[i], vc->normalY[i]);
 		ci::Vec2f tangent = cb2Cross(normal, 1.0f);
 
 		for (int j = 0; j < pointCount; ++j)
 		{
-			cb2VelocityConstraintPoint* vcp = vc->points + j;
-			ci::Vec2f P = vcp->normalImpulse * normal + vcp->tangentImpulse * tangent;
-			wA -= iA * cb2Cross(vcp->rA, P);
+			const cb2VelocityConstraintPoints* vcp = vc->points + j;
+			ci::Vec2f rA(vcp->rAx[i], vcp->rAy[i]);
+			ci::Vec2f rB(vcp->rBx[i], vcp->rBy[i]);
+
+			ci::Vec2f P = vcp->normalImpulse[i] * normal + vcp->tangentImpulse[i] * tangent;
+			wA -= iA * cb2Cross(rA, P);
 			vA -= mA * P;
-			wB += iB * cb2Cross(vcp->rB, P);
+			wB += iB * cb2Cross(rB, P);
 			vB += mB * P;
 		}
 
@@ -286,311 +752,545 @@ void cb2ContactSolver::WarmStart()
 	}
 }
 
+#if defined(CB2_SIMD_SOLVER)
+
+// The wide solver handles one batch of cb2_simdWidth slots at a time. The slots
+// of a batch never share a dynamic body, so the velocities can be gathered up
+// front and scattered back at the end.
 void cb2ContactSolver::SolveVelocityConstraints()
 {
-	for (int i = 0; i < m_count; ++i)
-	{
-		cb2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+	cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+	cb2VelocityConstraintPoints* cp1 = vc->points + 0;
+	cb2VelocityConstraintPoints* cp2 = vc->points + 1;
 
-		int indexA = vc->indexA;
-		int indexB = vc->indexB;
-		float mA = vc->invMassA;
-		float iA = vc->invIA;
-		float mB = vc->invMassB;
-		float iB = vc->invIB;
-		int pointCount = vc->pointCount;
+	const cb2FloatW zero = cb2ZeroW();
+	const cb2FloatW two = cb2SplatW(2.0f);
 
-		ci::Vec2f vA = m_velocities[indexA].v;
-		float wA = m_velocities[indexA].w;
-		ci::Vec2f vB = m_velocities[indexB].v;
-		float wB = m_velocities[indexB].w;
-
-		ci::Vec2f normal = vc->normal;
-		ci::Vec2f tangent = cb2Cross(normal, 1.0f);
-		float friction = vc->friction;
-
-		cb2Assert(pointCount == 1 || pointCount == 2);
+	for (int i = 0; i < m_constraintCount; i += cb2_simdWidth)
+	{
+		const int* indexA = vc->indexA + i;
+		const int* indexB = vc->indexB + i;
+		const int* pointCount = vc->pointCount + i;
+
+		cb2FloatW vAx = cb2SetW(m_velocities[indexA[0]].v.x, m_velocities[indexA[1]].v.x, m_velocities[indexA[2]].v.x, m_velocities[indexA[3]].v.x);
+		cb2FloatW vAy = cb2SetW(m_velocities[indexA[0]].v.y, m_velocities[indexA[1]].v.y, m_velocities[indexA[2]].v.y, m_velocities[indexA[3]].v.y);
+		cb2FloatW wA = cb2SetW(m_velocities[indexA[0]].w, m_velocities[indexA[1]].w, m_velocities[indexA[2]].w, m_velocities[indexA[3]].w);
+		cb2FloatW vBx = cb2SetW(m_velocities[indexB[0]].v.x, m_velocities[indexB[1]].v.x, m_velocities[indexB[2]].v.x, m_velocities[indexB[3]].v.x);
+		cb2FloatW vBy = cb2SetW(m_velocities[indexB[0]].v.y, m_velocities[indexB[1]].v.y, m_velocities[indexB[2]].v.y, m_velocities[indexB[3]].v.y);
+		cb2FloatW wB = cb2SetW(m_velocities[indexB[0]].w, m_velocities[indexB[1]].w, m_velocities[indexB[2]].w, m_velocities[indexB[3]].w);
+
+		cb2FloatW mA = cb2LoadW(vc->invMassA + i);
+		cb2FloatW iA = cb2LoadW(vc->invIA + i);
+		cb2FloatW mB = cb2LoadW(vc->invMassB + i);
+		cb2FloatW iB = cb2LoadW(vc->invIB + i);
+
+		cb2FloatW normalX = cb2LoadW(vc->normalX + i);
+		cb2FloatW normalY = cb2LoadW(vc->normalY + i);
+		cb2FloatW tangentX = normalY;
+		cb2FloatW tangentY = cb2SubW(zero, normalX);
+		cb2FloatW friction = cb2LoadW(vc->friction + i);
+		cb2FloatW tangentSpeed = cb2LoadW(vc->tangentSpeed + i);
+
+		cb2FloatW twoPoint = cb2GreaterEqualW(cb2SetW((float)pointCount[0], (float)pointCount[1], (float)pointCount[2], (float)pointCount[3]), two);
+
+		cb2FloatW rA1x = cb2LoadW(cp1->rAx + i);
+		cb2FloatW rA1y = cb2LoadW(cp1->rAy + i);
+		cb2FloatW rB1x = cb2LoadW(cp1->rBx + i);
+		cb2FloatW rB1y = cb2LoadW(cp1->rBy + i);
+		cb2FloatW rA2x = cb2LoadW(cp2->rAx + i);
+		cb2FloatW rA2y = cb2LoadW(cp2->rAy + i);
+		cb2FloatW rB2x = cb2LoadW(cp2->rBx + i);
+		cb2FloatW rB2y = cb2LoadW(cp2->rBy + i);
 
 		// Solve tangent constraints first because non-penetration is more important
-		// than friction.
-		for (int j = 0; j < pointCount; ++j)
+		// than friction. The second point only exists in two point lanes.
+		for (int j = 0; j < cb2_maxManifoldPoints; ++j)
 		{
-			cb2VelocityConstraintPoint* vcp = vc->points + j;
+			cb2VelocityConstraintPoints* vcp = vc->points + j;
+			cb2FloatW rAx = j == 0 ? rA1x : rA2x;
+			cb2FloatW rAy = j == 0 ? rA1y : rA2y;
+			cb2FloatW rBx = j == 0 ? rB1x : rB2x;
+			cb2FloatW rBy = j == 0 ? rB1y : rB2y;
 
 			// Relative velocity at contact
-			ci::Vec2f dv = vB + cb2Cross(wB, vcp->rB) - vA - cb2Cross(wA, vcp->rA);
+			cb2FloatW dvx = cb2SubW(cb2SubW(vBx, cb2MulW(wB, rBy)), cb2SubW(vAx, cb2MulW(wA, rAy)));
+			cb2FloatW dvy = cb2SubW(cb2AddW(vBy, cb2MulW(wB, rBx)), cb2AddW(vAy, cb2MulW(wA, rAx)));
 
 			// Compute tangent force
-			float vt = cb2Dot(dv, tangent) - vc->tangentSpeed;
-			float lambda = vcp->tangentMass * (-vt);
+			cb2FloatW vt = cb2SubW(cb2AddW(cb2MulW(dvx, tangentX), cb2MulW(dvy, tangentY)), tangentSpeed);
+			cb2FloatW lambda = cb2MulW(cb2LoadW(vcp->tangentMass + i), cb2SubW(zero, vt));
 
 			// cb2Clamp the accumulated force
-			float maxFriction = friction * vcp->normalImpulse;
-			float newImpulse = cb2Clamp(vcp->tangentImpulse + lambda, -maxFriction, maxFriction);
-			lambda = newImpulse - vcp->tangentImpulse;
-			vcp->tangentImpulse = newImpulse;
+			cb2FloatW oldImpulse = cb2LoadW(vcp->tangentImpulse + i);
+			cb2FloatW maxFriction = cb2MulW(friction, cb2LoadW(vcp->normalImpulse + i));
+			cb2FloatW newImpulse = cb2MaxW(cb2SubW(zero, maxFriction), cb2MinW(cb2AddW(oldImpulse, lambda), maxFriction));
+			if (j > 0)
+			{
+				newImpulse = cb2SelectW(twoPoint, newImpulse, oldImpulse);
+			}
+			lambda = cb2SubW(newImpulse, oldImpulse);
+			cb2StoreW(vcp->tangentImpulse + i, newImpulse);
 
 			// Apply contact impulse
-			ci::Vec2f P = lambda * tangent;
+			cb2FloatW Px = cb2MulW(lambda, tangentX);
+			cb2FloatW Py = cb2MulW(lambda, tangentY);
 
-			vA -= mA * P;
-			wA -= iA * cb2Cross(vcp->rA, P);
+			vAx = cb2SubW(vAx, cb2MulW(mA, Px));
+			vAy = cb2SubW(vAy, cb2MulW(mA, Py));
+			wA = cb2SubW(wA, cb2MulW(iA, cb2SubW(cb2MulW(rAx, Py), cb2MulW(rAy, Px))));
 
-			vB += mB * P;
-			wB += iB * cb2Cross(vcp->rB, P);
+			vBx = cb2AddW(vBx, cb2MulW(mB, Px));
+			vBy = cb2AddW(vBy, cb2MulW(mB, Py));
+			wB = cb2AddW(wB, cb2MulW(iB, cb2SubW(cb2MulW(rBx, Py), cb2MulW(rBy, Px))));
 		}
 
-		// Solve normal constraints
-		if (vc->pointCount == 1)
+		// Solve normal constraints. Every lane works out both the single point impulse
+		// and the block solution and then picks the one matching its point count.
+		cb2FloatW a1 = cb2LoadW(cp1->normalImpulse + i);
+		cb2FloatW a2 = cb2LoadW(cp2->normalImpulse + i);
+
+		// Relative velocity at contact
+		cb2FloatW dv1x = cb2SubW(cb2SubW(vBx, cb2MulW(wB, rB1y)), cb2SubW(vAx, cb2MulW(wA, rA1y)));
+		cb2FloatW dv1y = cb2SubW(cb2AddW(vBy, cb2MulW(wB, rB1x)), cb2AddW(vAy, cb2MulW(wA, rA1x)));
+		cb2FloatW dv2x = cb2SubW(cb2SubW(vBx, cb2MulW(wB, rB2y)), cb2SubW(vAx, cb2MulW(wA, rA2y)));
+		cb2FloatW dv2y = cb2SubW(cb2AddW(vBy, cb2MulW(wB, rB2x)), cb2AddW(vAy, cb2MulW(wA, rA2x)));
+
+		// Compute normal velocity
+		cb2FloatW vn1 = cb2AddW(cb2MulW(dv1x, normalX), cb2MulW(dv1y, normalY));
+		cb2FloatW vn2 = cb2AddW(cb2MulW(dv2x, normalX), cb2MulW(dv2y, normalY));
+
+		cb2FloatW bias1 = cb2LoadW(cp1->velocityBias + i);
+		cb2FloatW bias2 = cb2LoadW(cp2->velocityBias + i);
+		cb2FloatW normalMass1 = cb2LoadW(cp1->normalMass + i);
+		cb2FloatW normalMass2 = cb2LoadW(cp2->normalMass + i);
+
+		// Single point, clamp the accumulated impulse.
+		cb2FloatW single = cb2MaxW(cb2SubW(a1, cb2MulW(normalMass1, cb2SubW(vn1, bias1))), zero);
+
+		// Block solver, see the scalar version below for the derivation. The cases are
+		// applied from last to first so the first valid one wins. Without a valid case
+		// the impulses are left alone.
+		cb2FloatW K11 = cb2LoadW(vc->K11 + i);
+		cb2FloatW K12 = cb2LoadW(vc->K12 + i);
+		cb2FloatW K22 = cb2LoadW(vc->K22 + i);
+
+		cb2FloatW bx = cb2SubW(cb2SubW(vn1, bias1), cb2AddW(cb2MulW(K11, a1), cb2MulW(K12, a2)));
+		cb2FloatW by = cb2SubW(cb2SubW(vn2, bias2), cb2AddW(cb2MulW(K12, a1), cb2MulW(K22, a2)));
+
+		cb2FloatW x1 = a1;
+		cb2FloatW x2 = a2;
+
+		// Case 4: x1 = 0 and x2 = 0
+		cb2FloatW valid = cb2AndW(cb2GreaterEqualW(bx, zero), cb2GreaterEqualW(by, zero));
+		x1 = cb2SelectW(valid, zero, x1);
+		x2 = cb2SelectW(valid, zero, x2);
+
+		// Case 3: vn2 = 0 and x1 = 0
+		cb2FloatW case3 = cb2SubW(zero, cb2MulW(normalMass2, by));
+		valid = cb2AndW(cb2GreaterEqualW(case3, zero), cb2GreaterEqualW(cb2AddW(cb2MulW(K12, case3), bx), zero));
+		x1 = cb2SelectW(valid, zero, x1);
+		x2 = cb2SelectW(valid, case3, x2);
+
+		// Case 2: vn1 = 0 and x2 = 0
+		cb2FloatW case2 = cb2SubW(zero, cb2MulW(normalMass1, bx));
+		valid = cb2AndW(cb2GreaterEqualW(case2, zero), cb2GreaterEqualW(cb2AddW(cb2MulW(K12, case2), by), zero));
+		x1 = cb2SelectW(valid, case2, x1);
+		x2 = cb2SelectW(valid, zero, x2);
+
+		// Case 1: vn = 0
+		cb2FloatW normalMass11 = cb2LoadW(vc->normalMass11 + i);
+		cb2FloatW normalMass12 = cb2LoadW(vc->normalMass12 + i);
+		cb2FloatW normalMass22 = cb2LoadW(vc->normalMass22 + i);
+		cb2FloatW case1x = cb2SubW(zero, cb2AddW(cb2MulW(normalMass11, bx), cb2MulW(normalMass12, by)));
+		cb2FloatW case1y = cb2SubW(zero, cb2AddW(cb2MulW(normalMass12, bx), cb2MulW(normalMass22, by)));
+		valid = cb2AndW(cb2GreaterEqualW(case1x, zero), cb2GreaterEqualW(case1y, zero));
+		x1 = cb2SelectW(valid, case1x, x1);
+		x2 = cb2SelectW(valid, case1y, x2);
+
+		x1 = cb2SelectW(twoPoint, x1, single);
+		x2 = cb2SelectW(twoPoint, x2, a2);
+
+		// Apply incremental impulse
+		cb2FloatW d1 = cb2SubW(x1, a1);
+		cb2FloatW d2 = cb2SubW(x2, a2);
+		cb2FloatW P1x = cb2MulW(d1, normalX);
+		cb2FloatW P1y = cb2MulW(d1, normalY);
+		cb2FloatW P2x = cb2MulW(d2, normalX);
+		cb2FloatW P2y = cb2MulW(d2, normalY);
+		cb2FloatW Px = cb2AddW(P1x, P2x);
+		cb2FloatW Py = cb2AddW(P1y, P2y);
+
+		vAx = cb2SubW(vAx, cb2MulW(mA, Px));
+		vAy = cb2SubW(vAy, cb2MulW(mA, Py));
+		wA = cb2SubW(wA, cb2MulW(iA, cb2AddW(cb2SubW(cb2MulW(rA1x, P1y), cb2MulW(rA1y, P1x)), cb2SubW(cb2MulW(rA2x, P2y), cb2MulW(rA2y, P2x)))));
+
+		vBx = cb2AddW(vBx, cb2MulW(mB, Px));
+		vBy = cb2AddW(vBy, cb2MulW(mB, Py));
+		wB = cb2AddW(wB, cb2MulW(iB, cb2AddW(cb2SubW(cb2MulW(rB1x, P1y), cb2MulW(rB1y, P1x)), cb2SubW(cb2MulW(rB2x, P2y), cb2MulW(rB2y, P2x)))));
+
+		// Accumulate
+		cb2StoreW(cp1->normalImpulse + i, x1);
+		cb2StoreW(cp2->normalImpulse + i, x2);
+
+		// Scatter the velocities. Static and kinematic bodies may appear in several
+		// lanes but the solver never changes them, so they are skipped. So are the
+		// empty slots, which have zero mass.
+		float lanes[6][cb2_simdWidth];
+		cb2StoreW(lanes[0], vAx);
+		cb2StoreW(lanes[1], vAy);
+		cb2StoreW(lanes[2], wA);
+		cb2StoreW(lanes[3], vBx);
+		cb2StoreW(lanes[4], vBy);
+		cb2StoreW(lanes[5], wB);
+
+		for (int lane = 0; lane < cb2_simdWidth; ++lane)
 		{
-			cb2VelocityConstraintPoint* vcp = vc->points + 0;
+			int slot = i + lane;
+			if (vc->invMassA[slot] > 0.0f || vc->invIA[slot] > 0.0f)
+			{
+				m_velocities[indexA[lane]].v.set(lanes[0][lane], lanes[1][lane]);
+				m_velocities[indexA[lane]].w = lanes[2][lane];
+			}
 
-			// Relative velocity at contact
-			ci::Vec2f dv = vB + cb2Cross(wB, vcp->rB) - vA - cb2Cross(wA, vcp->rA);
+			if (vc->invMassB[slot] > 0.0f || vc->invIB[slot] > 0.0f)
+			{
+				m_velocities[indexB[lane]].v.set(lanes[3][lane], lanes[4][lane]);
+				m_velocities[indexB[lane]].w = lanes[5][lane];
+			}
+		}
+	}
+}
 
-			// Compute normal impulse
-			float vn = cb2Dot(dv, normal);
-			float lambda = -vcp->normalMass * (vn - vcp->velocityBias);
+#else
 
-			// cb2Clamp the accumulated impulse
-			float newImpulse = cb2Max(vcp->normalImpulse + lambda, 0.0f);
-			lambda = newImpulse - vcp->normalImpulse;
-			vcp->normalImpulse = newImpulse;
+void cb2ContactSolver::SolveVelocityConstraints()
+{
+	for (int i = 0; i < m_constraintCount; ++i)
+	{
+		SolveVelocityConstraint(i);
+	}
+}
 
-			// Apply contact impulse
-			ci::Vec2f P = lambda * normal;
-			vA -= mA * P;
-			wA -= iA * cb2Cross(vcp->rA, P);
+#endif
 
-			vB += mB * P;
-			wB += iB * cb2Cross(vcp->rB, P);
-		}
-		else
-		{
-			// Block solver developed in collaboration with Dirk Gregorius (back in 01/07 on Box2D_Lite).
-			// Build the mini LCP for this contact patch
-			//
-			// vn = A * x + b, vn >= 0, , vn >= 0, x >= 0 and vn_i * x_i = 0 with i = 1..2
-			//
-			// A = J * W * JT and J = ( -n, -r1 x n, n, r2 x n )
-			// b = vn0 - velocityBias
-			//
-			// The system is solved using the "Total enumeration method" (s. Murty). The complementary constraint vn_i * x_i
-			// implies that we must have in any solution either vn_i = 0 or x_i = 0. So for the 2D contact problem the cases
-			// vn1 = 0 and vn2 = 0, x1 = 0 and x2 = 0, x1 = 0 and vn2 = 0, x2 = 0 and vn1 = 0 need to be tested. The first valid
-			// solution that satisfies the problem is chosen.
-			// 
-			// In order to account of the accumulated impulse 'a' (because of the iterative nature of the solver which only requires
-			// that the accumulated impulse is clamped and not the incremental impulse) we change the impulse variable (x_i).
-			//
-			// Substitute:
-			// 
-			// x = a + d
-			// 
-			// a := old total impulse
-			// x := new total impulse
-			// d := incremental impulse 
-			//
-			// For the current iteration we extend the formula for the incremental impulse
-			// to compute the new total impulse:
-			//
-			// vn = A * d + b
-			//    = A * (x - a) + b
-			//    = A * x + b - A * a
-			//    = A * x + b'
-			// b' = b - A * a;
+void cb2ContactSolver::SolveVelocityConstraint(int i)
+{
+	cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+
+	int indexA = vc->indexA[i];
+	int indexB = vc->indexB[i];
+	float mA = vc->invMassA[i];
+	float iA = vc->invIA[i];
+	float mB = vc->invMassB[i];
+	float iB = vc->invIB[i];
+	int pointCount = vc->pointCount[i];
+
+	ci::Vec2f vA = m_velocities[indexA].v;
+	float wA = m_velocities[indexA].w;
+	ci::Vec2f vB = m_velocities[indexB].v;
+	float wB = m_velocities[indexB].w;
+
+	ci::Vec2f normal(vc->normalX[i], vc->normalY[i]);
+	ci::Vec2f tangent = cb2Cross(normal, 1.0f);
+	float friction = vc->friction[i];
+
+	cb2Assert(pointCount == 1 || pointCount == 2);
+
+	// Solve tangent constraints first because non-penetration is more important
+	// than friction.
+	for (int j = 0; j < pointCount; ++j)
+	{
+		cb2VelocityConstraintPoints* vcp = vc->points + j;
+		ci::Vec2f rA(vcp->rAx[i], vcp->rAy[i]);
+		ci::Vec2f rB(vcp->rBx[i], vcp->rBy[i]);
 
-			cb2VelocityConstraintPoint* cp1 = vc->points + 0;
-			cb2VelocityConstraintPoint* cp2 = vc->points + 1;
+		// Relative velocity at contact
+		ci::Vec2f dv = vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA);
 
-			ci::Vec2f a(cp1->normalImpulse, cp2->normalImpulse);
-			cb2Assert(a.x >= 0.0f && a.y >= 0.0f);
+		// Compute tangent force
+		float vt = cb2Dot(dv, tangent) - vc->tangentSpeed[i];
+		float lambda = vcp->tangentMass[i] * (-vt);
 
-			// Relative velocity at contact
-			ci::Vec2f dv1 = vB + cb2Cross(wB, cp1->rB) - vA - cb2Cross(wA, cp1->rA);
-			ci::Vec2f dv2 = vB + cb2Cross(wB, cp2->rB) - vA - cb2Cross(wA, cp2->rA);
+		// cb2Clamp the accumulated force
+		float maxFriction = friction * vcp->normalImpulse[i];
+		float newImpulse = cb2Clamp(vcp->tangentImpulse[i] + lambda, -maxFriction, maxFriction);
+		lambda = newImpulse - vcp->tangentImpulse[i];
+		vcp->tangentImpulse[i] = newImpulse;
+
+		// Apply contact impulse
+		ci::Vec2f P = lambda * tangent;
+
+		vA -= mA * P;
+		wA -= iA * cb2Cross(rA, P);
+
+		vB += mB * P;
+		wB += iB * cb2Cross(rB, P);
+	}
 
-			// Compute normal velocity
-			float vn1 = cb2Dot(dv1, normal);
-			float vn2 = cb2Dot(dv2, normal);
+	// Solve normal constraints
+	if (pointCount == 1)
+	{
+		cb2VelocityConstraintPoints* vcp = vc->points + 0;
+		ci::Vec2f rA(vcp->rAx[i], vcp->rAy[i]);
+		ci::Vec2f rB(vcp->rBx[i], vcp->rBy[i]);
+
+		// Relative velocity at contact
+		ci::Vec2f dv = vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA);
+
+		// Compute normal impulse
+		float vn = cb2Dot(dv, normal);
+		float lambda = -vcp->normalMass[i] * (vn - vcp->velocityBias[i]);
 
-			ci::Vec2f b;
-			b.x = vn1 - cp1->velocityBias;
-			b.y = vn2 - cp2->velocityBias;
+		// cb2Clamp the accumulated impulse
+		float newImpulse = cb2Max(vcp->normalImpulse[i] + lambda, 0.0f);
+		lambda = newImpulse - vcp->normalImpulse[i];
+		vcp->normalImpulse[i] = newImpulse;
 
-			// Compute b'
-			b -= cb2Mul(vc->K, a);
+		// Apply contact impulse
+		ci::Vec2f P = lambda * normal;
+		vA -= mA * P;
+		wA -= iA * cb2Cross(rA, P);
 
-			const float k_errorTol = 1e-3f;
-			CB2_NOT_USED(k_errorTol);
+		vB += mB * P;
+		wB += iB * cb2Cross(rB, P);
+	}
+	else
+	{
+		// Block solver developed in collaboration with Dirk Gregorius (back in 01/07 on Box2D_Lite).
+		// Build the mini LCP for this contact patch
+		//
+		// vn = A * x + b, vn >= 0, , vn >= 0, x >= 0 and vn_i * x_i = 0 with i = 1..2
+		//
+		// A = J * W * JT and J = ( -n, -r1 x n, n, r2 x n )
+		// b = vn0 - velocityBias
+		//
+		// The system is solved using the "Total enumeration method" (s. Murty). The complementary constraint vn_i * x_i
+		// implies that we must have in any solution either vn_i = 0 or x_i = 0. So for the 2D contact problem the cases
+		// vn1 = 0 and vn2 = 0, x1 = 0 and x2 = 0, x1 = 0 and vn2 = 0, x2 = 0 and vn1 = 0 need to be tested. The first valid
+		// solution that satisfies the problem is chosen.
+		// 
+		// In order to account of the accumulated impulse 'a' (because of the iterative nature of the solver which only requires
+		// that the accumulated impulse is clamped and not the incremental impulse) we change the impulse variable (x_i).
+		//
+		// Substitute:
+		// 
+		// x = a + d
+		// 
+		// a := old total impulse
+		// x := new total impulse
+		// d := incremental impulse 
+		//
+		// For the current iteration we extend the formula for the incremental impulse
+		// to compute the new total impulse:
+		//
+		// vn = A * d + b
+		//    = A * (x - a) + b
+		//    = A * x + b - A * a
+		//    = A * x + b'
+		// b' = b - A * a;
+
+		cb2VelocityConstraintPoints* cp1 = vc->points + 0;
+		cb2VelocityConstraintPoints* cp2 = vc->points + 1;
+		ci::Vec2f rA1(cp1->rAx[i], cp1->rAy[i]);
+		ci::Vec2f rB1(cp1->rBx[i], cp1->rBy[i]);
+		ci::Vec2f rA2(cp2->rAx[i], cp2->rAy[i]);
+		ci::Vec2f rB2(cp2->rBx[i], cp2->rBy[i]);
+
+		ci::Vec2f a(cp1->normalImpulse[i], cp2->normalImpulse[i]);
+		cb2Assert(a.x >= 0.0f && a.y >= 0.0f);
+
+		// Relative velocity at contact
+		ci::Vec2f dv1 = vB + cb2Cross(wB, rB1) - vA - cb2Cross(wA, rA1);
+		ci::Vec2f dv2 = vB + cb2Cross(wB, rB2) - vA - cb2Cross(wA, rA2);
+
+		// Compute normal velocity
+		float vn1 = cb2Dot(dv1, normal);
+		float vn2 = cb2Dot(dv2, normal);
+
+		ci::Vec2f b;
+		b.x = vn1 - cp1->velocityBias[i];
+		b.y = vn2 - cp2->velocityBias[i];
+
+		// Compute b'
+		b -= ci::Vec2f(vc->K11[i] * a.x + vc->K12[i] * a.y, vc->K12[i] * a.x + vc->K22[i] * a.y);
+
+		const float k_errorTol = 1e-3f;
+		CB2_NOT_USED(k_errorTol);
+
+		for (;;)
+		{
+			//
+			// Case 1: vn = 0
+			//
+			// 0 = A * x + b'
+			//
+			// Solve for x:
+			//
+			// x = - inv(A) * b'
+			//
+			ci::Vec2f x = - ci::Vec2f(vc->normalMass11[i] * b.x + vc->normalMass12[i] * b.y, vc->normalMass12[i] * b.x + vc->normalMass22[i] * b.y);
 
-			for (;;)
+			if (x.x >= 0.0f && x.y >= 0.0f)
 			{
-				//
-				// Case 1: vn = 0
-				//
-				// 0 = A * x + b'
-				//
-				// Solve for x:
-				//
-				// x = - inv(A) * b'
-				//
-				ci::Vec2f x = - cb2Mul(vc->normalMass, b);
-
-				if (x.x >= 0.0f && x.y >= 0.0f)
-				{
-					// Get the incremental impulse
-					ci::Vec2f d = x - a;
+				// Get the incremental impulse
+				ci::Vec2f d = x - a;
 
-					// Apply incremental impulse
-					ci::Vec2f P1 = d.x * normal;
-					ci::Vec2f P2 = d.y * normal;
-					vA -= mA * (P1 + P2);
-					wA -= iA * (cb2Cross(cp1->rA, P1) + cb2Cross(cp2->rA, P2));
+				// Apply incremental impulse
+				ci::Vec2f P1 = d.x * normal;
+				ci::Vec2f P2 = d.y * normal;
+				vA -= mA * (P1 + P2);
+				wA -= iA * (cb2Cross(rA1, P1) + cb2Cross(rA2, P2));
 
-					vB += mB * (P1 + P2);
-					wB += iB * (cb2Cross(cp1->rB, P1) + cb2Cross(cp2->rB, P2));
+				vB += mB * (P1 + P2);
+				wB += iB * (cb2Cross(rB1, P1) + cb2Cross(rB2, P2));
 
-					// Accumulate
-					cp1->normalImpulse = x.x;
-					cp2->normalImpulse = x.y;
+				// Accumulate
+				cp1->normalImpulse[i] = x.x;
+				cp2->normalImpulse[i] = x.y;
 
 #if CB2_DEBUG_SOLVER == 1
-					// Postconditions
-					dv1 = vB + cb2Cross(wB, cp1->rB) - vA - cb2Cross(wA, cp1->rA);
-					dv2 = vB + cb2Cross(wB, cp2->rB) - vA - cb2Cross(wA, cp2->rA);
+				// Postconditions
+				dv1 = vB + cb2Cross(wB, rB1) - vA - cb2Cross(wA, rA1);
+				dv2 = vB + cb2Cross(wB, rB2) - vA - cb2Cross(wA, rA2);
 
-					// Compute normal velocity
-					vn1 = cb2Dot(dv1, normal);
-					vn2 = cb2Dot(dv2, normal);
+				// Compute normal velocity
+				vn1 = cb2Dot(dv1, normal);
+				vn2 = cb2Dot(dv2, normal);
 
-					cb2Assert(cb2Abs(vn1 - cp1->velocityBias) < k_errorTol);
-					cb2Assert(cb2Abs(vn2 - cp2->velocityBias) < k_errorTol);
+				cb2Assert(cb2Abs(vn1 - cp1->velocityBias[i]) < k_errorTol);
+				cb2Assert(cb2Abs(vn2 - cp2->velocityBias[i]) < k_errorTol);
 #endif
-					break;
-				}
+				break;
+			}
 
-				//
-				// Case 2: vn1 = 0 and x2 = 0
-				//
-				//   0 = a11 * x1 + a12 * 0 + b1' 
-				// vn2 = a21 * x1 + a22 * 0 + cb2'
-				//
-				x.x = - cp1->normalMass * b.x;
-				x.y = 0.0f;
-				vn1 = 0.0f;
-				vn2 = vc->K.m10 * x.x + b.y;
-
-				if (x.x >= 0.0f && vn2 >= 0.0f)
-				{
-					// Get the incremental impulse
-					ci::Vec2f d = x - a;
+			//
+			// Case 2: vn1 = 0 and x2 = 0
+			//
+			//   0 = a11 * x1 + a12 * 0 + b1' 
+			// vn2 = a21 * x1 + a22 * 0 + cb2'
+			//
+			x.x = - cp1->normalMass[i] * b.x;
+			x.y = 0.0f;
+			vn1 = 0.0f;
+			vn2 = vc->K12[i] * x.x + b.y;
 
-					// Apply incremental impulse
-					ci::Vec2f P1 = d.x * normal;
-					ci::Vec2f P2 = d.y * normal;
-					vA -= mA * (P1 + P2);
-					wA -= iA * (cb2Cross(cp1->rA, P1) + cb2Cross(cp2->rA, P2));
+			if (x.x >= 0.0f && vn2 >= 0.0f)
+			{
+				// Get the incremental impulse
+				ci::Vec2f d = x - a;
+
+				// Apply incremental impulse
+				ci::Vec2f P1 = d.x * normal;
+				ci::Vec2f P2 = d.y * normal;
+				vA -= mA * (P1 + P2);
+				wA -= iA * (cb2Cross(rA1, P1) + cb2Cross(rA2, P2));
 
-					vB += mB * (P1 + P2);
-					wB += iB * (cb2Cross(cp1->rB, P1) + cb2Cross(cp2->rB, P2));
+				vB += mB * (P1 + P2);
+				wB += iB * (cb2Cross(rB1, P1) + cb2Cross(rB2, P2));
 
-					// Accumulate
-					cp1->normalImpulse = x.x;
-					cp2->normalImpulse = x.y;
+				// Accumulate
+				cp1->normalImpulse[i] = x.x;
+				cp2->normalImpulse[i] = x.y;
 
 #if CB2_DEBUG_SOLVER == 1
-					// Postconditions
-					dv1 = vB + cb2Cross(wB, cp1->rB) - vA - cb2Cross(wA, cp1->rA);
+				// Postconditions
+				dv1 = vB + cb2Cross(wB, rB1) - vA - cb2Cross(wA, rA1);
 
-					// Compute normal velocity
-					vn1 = cb2Dot(dv1, normal);
+				// Compute normal velocity
+				vn1 = cb2Dot(dv1, normal);
 
-					cb2Assert(cb2Abs(vn1 - cp1->velocityBias) < k_errorTol);
+				cb2Assert(cb2Abs(vn1 - cp1->velocityBias[i]) < k_errorTol);
 #endif
-					break;
-				}
+				break;
+			}
 
 
-				//
-				// Case 3: vn2 = 0 and x1 = 0
-				//
-				// vn1 = a11 * 0 + a12 * x2 + b1' 
-				//   0 = a21 * 0 + a22 * x2 + cb2'
-				//
-				x.x = 0.0f;
-				x.y = - cp2->normalMass * b.y;
-				vn1 = vc->K.m01 * x.y + b.x;
-				vn2 = 0.0f;
+			//
+			// Case 3: vn2 = 0 and x1 = 0
+			//
+			// vn1 = a11 * 0 + a12 * x2 + b1' 
+			//   0 = a21 * 0 + a22 * x2 + cb2'
+			//
+			x.x = 0.0f;
+			x.y = - cp2->normalMass[i] * b.y;
+			vn1 = vc->K12[i] * x.y + b.x;
+			vn2 = 0.0f;
 
-				if (x.y >= 0.0f && vn1 >= 0.0f)
-				{
-					// Resubstitute for the incremental impulse
-					ci::Vec2f d = x - a;
+			if (x.y >= 0.0f && vn1 >= 0.0f)
+			{
+				// Resubstitute for the incremental impulse
+				ci::Vec2f d = x - a;
 
-					// Apply incremental impulse
-					ci::Vec2f P1 = d.x * normal;
-					ci::Vec2f P2 = d.y * normal;
-					vA -= mA * (P1 + P2);
-					wA -= iA * (cb2Cross(cp1->rA, P1) + cb2Cross(cp2->rA, P2));
+				// Apply incremental impulse
+				ci::Vec2f P1 = d.x * normal;
+				ci::Vec2f P2 = d.y * normal;
+				vA -= mA * (P1 + P2);
+				wA -= iA * (cb2Cross(rA1, P1) + cb2Cross(rA2, P2));
 
-					vB += mB * (P1 + P2);
-					wB += iB * (cb2Cross(cp1->rB, P1) + cb2Cross(cp2->rB, P2));
+				vB += mB * (P1 + P2);
+				wB += iB * (cb2Cross(rB1, P1) + cb2Cross(rB2, P2));
 
-					// Accumulate
-					cp1->normalImpulse = x.x;
-					cp2->normalImpulse = x.y;
+				// Accumulate
+				cp1->normalImpulse[i] = x.x;
+				cp2->normalImpulse[i] = x.y;
 
 #if CB2_DEBUG_SOLVER == 1
-					// Postconditions
-					dv2 = vB + cb2Cross(wB, cp2->rB) - vA - cb2Cross(wA, cp2->rA);
+				// Postconditions
+				dv2 = vB + cb2Cross(wB, rB2) - vA - cb2Cross(wA, rA2);
 
-					// Compute normal velocity
-					vn2 = cb2Dot(dv2, normal);
+				// Compute normal velocity
+				vn2 = cb2Dot(dv2, normal);
 
-					cb2Assert(cb2Abs(vn2 - cp2->velocityBias) < k_errorTol);
+				cb2Assert(cb2Abs(vn2 - cp2->velocityBias[i]) < k_errorTol);
 #endif
-					break;
-				}
-
-				//
-				// Case 4: x1 = 0 and x2 = 0
-				// 
-				// vn1 = b1
-				// vn2 = cb2;
-				x.x = 0.0f;
-				x.y = 0.0f;
-				vn1 = b.x;
-				vn2 = b.y;
-
-				if (vn1 >= 0.0f && vn2 >= 0.0f )
-				{
-					// Resubstitute for the incremental impulse
-					ci::Vec2f d = x - a;
+				break;
+			}
 
-					// Apply incremental impulse
-					ci::Vec2f P1 = d.x * normal;
-					ci::Vec2f P2 = d.y * normal;
-					vA -= mA * (P1 + P2);
-					wA -= iA * (cb2Cross(cp1->rA, P1) + cb2Cross(cp2->rA, P2));
+			//
+			// Case 4: x1 = 0 and x2 = 0
+			// 
+			// vn1 = b1
+			// vn2 = cb2;
+			x.x = 0.0f;
+			x.y = 0.0f;
+			vn1 = b.x;
+			vn2 = b.y;
+
+			if (vn1 >= 0.0f && vn2 >= 0.0f )
+			{
+				// Resubstitute for the incremental impulse
+				ci::Vec2f d = x - a;
 
-					vB += mB * (P1 + P2);
-					wB += iB * (cb2Cross(cp1->rB, P1) + cb2Cross(cp2->rB, P2));
+				// Apply incremental impulse
+				ci::Vec2f P1 = d.x * normal;
+				ci::Vec2f P2 = d.y * normal;
+				vA -= mA * (P1 + P2);
+				wA -= iA * (cb2Cross(rA1, P1) + cb2Cross(rA2, P2));
 
-					// Accumulate
-					cp1->normalImpulse = x.x;
-					cp2->normalImpulse = x.y;
+				vB += mB * (P1 + P2);
+				wB += iB * (cb2Cross(rB1, P1) + cb2Cross(rB2, P2));
 
-					break;
-				}
+				// Accumulate
+				cp1->normalImpulse[i] = x.x;
+				cp2->normalImpulse[i] = x.y;
 
-				// No solution, give up. This is hit sometimes, but it doesn't seem to matter.
 				break;
 			}
+
+			// No solution, give up. This is hit sometimes, but it doesn't seem to matter.
+			break;
 		}
+	}
 
+	// Static and kinematic bodies can be shared by constraints solved at the same time.
+	if (mA > 0.0f || iA > 0.0f)
+	{
 		m_velocities[indexA].v = vA;
 		m_velocities[indexA].w = wA;
+	}
+
+	if (mB > 0.0f || iB > 0.0f)
+	{
 		m_velocities[indexB].v = vB;
 		m_velocities[indexB].w = wB;
 	}
@@ -598,56 +1298,100 @@ void cb2ContactSolver::SolveVelocityConstraints()
 
 void cb2ContactSolver::StoreImpulses()
 {
-	for (int i = 0; i < m_count; ++i)
+	const cb2ContactVelocityConstraints* vc = &m_velocityConstraints;
+
+	if (m_sources)
+	{
+		// The points a merge dropped start over.
+		for (int i = 0; i < m_count; ++i)
+		{
+			cb2Manifold* manifold = m_contacts[i]->GetManifold();
+			for (int j = 0; j < manifold->pointCount; ++j)
+			{
+				manifold->points[j].normalImpulse = 0.0f;
+				manifold->points[j].tangentImpulse = 0.0f;
+			}
+		}
+
+		for (int i = 0; i < m_constraintCount; ++i)
+		{
+			int contactIndex = GetContactIndex(i);
+			if (contactIndex < 0)
+			{
+				continue;
+			}
+
+			for (int j = 0; j < vc->pointCount[i]; ++j)
+			{
+				int source = m_sources[contactIndex * cb2_maxManifoldPoints + j];
+				cb2Manifold* manifold = m_contacts[source / cb2_maxManifoldPoints]->GetManifold();
+				cb2ManifoldPoint* mp = manifold->points + source % cb2_maxManifoldPoints;
+				mp->normalImpulse = vc->points[j].normalImpulse[i];
+				mp->tangentImpulse = vc->points[j].tangentImpulse[i];
+			}
+		}
+
+		return;
+	}
+
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2ContactVelocityConstraint* vc = m_velocityConstraints + i;
-		cb2Manifold* manifold = m_contacts[vc->contactIndex]->GetManifold();
+		int contactIndex = GetContactIndex(i);
+		if (contactIndex < 0)
+		{
+			continue;
+		}
 
-		for (int j = 0; j < vc->pointCount; ++j)
+		cb2Manifold* manifold = m_contacts[contactIndex]->GetManifold();
+
+		for (int j = 0; j < vc->pointCount[i]; ++j)
 		{
-			manifold->points[j].normalImpulse = vc->points[j].normalImpulse;
-			manifold->points[j].tangentImpulse = vc->points[j].tangentImpulse;
+			manifold->points[j].normalImpulse = vc->points[j].normalImpulse[i];
+			manifold->points[j].tangentImpulse = vc->points[j].tangentImpulse[i];
 		}
 	}
 }
 
 struct cb2PositionSolverManifold
 {
-	void Initialize(cb2ContactPositionConstraint* pc, const cb2Transform& xfA, const cb2Transform& xfB, int index)
+	void Initialize(const cb2ContactPositionConstraints* pc, int i, const cb2Transform& xfA, const cb2Transform& xfB, int index)
 	{
-		cb2Assert(pc->pointCount > 0);
+		cb2Assert(pc->pointCount[i] > 0);
+
+		ci::Vec2f localNormal(pc->localNormalX[i], pc->localNormalY[i]);
+		ci::Vec2f localPoint(pc->localPointX[i], pc->localPointY[i]);
 
-		switch (pc->type)
+		switch (pc->type[i])
 		{
 		case cb2Manifold::e_circles:
 			{
-				ci::Vec2f pointA = cb2Mul(xfA, pc->localPoint);
-				ci::Vec2f pointB = cb2Mul(xfB, pc->localPoints[0]);
+				ci::Vec2f pointA = cb2Mul(xfA, localPoint);
+				ci::Vec2f pointB = cb2Mul(xfB, ci::Vec2f(pc->localPointsX[0][i], pc->localPointsY[0][i]));
 				normal = pointB - pointA;
 				normal.normalize();
 				point = 0.5f * (pointA + pointB);
-				separation = cb2Dot(pointB - pointA, normal) - pc->radiusA - pc->radiusB;
+				separation = cb2Dot(pointB - pointA, normal) - pc->radiusA[i] - pc->radiusB[i];
 			}
 			break;
 
 		case cb2Manifold::e_faceA:
 			{
-				normal = cb2Mul(xfA.q, pc->localNormal);
-				ci::Vec2f planePoint = cb2Mul(xfA, pc->localPoint);
+				normal = cb2Mul(xfA.q, localNormal);
+				ci::Vec2f planePoint = cb2Mul(xfA, localPoint);
 
-				ci::Vec2f clipPoint = cb2Mul(xfB, pc->localPoints[index]);
-				separation = cb2Dot(clipPoint - planePoint, normal) - pc->radiusA - pc->radiusB;
+				ci::Vec2f clipPoint = cb2Mul(xfB, ci::Vec2f(pc->localPointsX[index][i], pc->localPointsY[index][i]));
+				separation = cb2Dot(clipPoint - planePoint, normal) - pc->radiusA[i] - pc->radiusB[i];
 				point = clipPoint;
 			}
 			break;
 
 		case cb2Manifold::e_faceB:
 			{
-				normal = cb2Mul(xfB.q, pc->localNormal);
-				ci::Vec2f planePoint = cb2Mul(xfB, pc->localPoint);
+				normal = cb2Mul(xfB.q, localNormal);
+				ci::Vec2f planePoint = cb2Mul(xfB, localPoint);
 
-				ci::Vec2f clipPoint = cb2Mul(xfA, pc->localPoints[index]);
-				separation = cb2Dot(clipPoint - planePoint, normal) - pc->radiusA - pc->radiusB;
+				ci::Vec2f clipPoint = cb2Mul(xfA, ci::Vec2f(pc->localPointsX[index][i], pc->localPointsY[index][i]));
+				separation = cb2Dot(clipPoint - planePoint, normal) - pc->radiusA[i] - pc->radiusB[i];
 				point = clipPoint;
 
 				// Ensure normal points from A to B
@@ -667,109 +1411,123 @@ bool cb2ContactSolver::SolvePositionConstraints()
 {
 	float minSeparation = 0.0f;
 
-	for (int i = 0; i < m_count; ++i)
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2ContactPositionConstraint* pc = m_positionConstraints + i;
+		minSeparation = cb2Min(minSeparation, SolvePositionConstraint(i));
+	}
 
-		int indexA = pc->indexA;
-		int indexB = pc->indexB;
-		ci::Vec2f localCenterA = pc->localCenterA;
-		float mA = pc->invMassA;
-		float iA = pc->invIA;
-		ci::Vec2f localCenterB = pc->localCenterB;
-		float mB = pc->invMassB;
-		float iB = pc->invIB;
-		int pointCount = pc->pointCount;
+	// We can't expect minSpeparation >= -linearSlop because we don't
+	// push the separation above -linearSlop.
+	return minSeparation >= -3.0f * m_step.tolerances.linearSlop;
+}
 
-		ci::Vec2f cA = m_positions[indexA].c;
-		float aA = m_positions[indexA].a;
+float cb2ContactSolver::SolvePositionConstraint(int i)
+{
+	const cb2ContactPositionConstraints* pc = m_positionConstraints;
+	float minSeparation = 0.0f;
 
-		ci::Vec2f cB = m_positions[indexB].c;
-		float aB = m_positions[indexB].a;
+	int indexA = pc->indexA[i];
+	int indexB = pc->indexB[i];
+	ci::Vec2f localCenterA(pc->localCenterAx[i], pc->localCenterAy[i]);
+	float mA = pc->invMassA[i];
+	float iA = pc->invIA[i];
+	ci::Vec2f localCenterB(pc->localCenterBx[i], pc->localCenterBy[i]);
+	float mB = pc->invMassB[i];
+	float iB = pc->invIB[i];
+	int pointCount = pc->pointCount[i];
 
-		// Solve normal constraints
-		for (int j = 0; j < pointCount; ++j)
-		{
-			cb2Transform xfA, xfB;
-			xfA.q.set(aA);
-			xfB.q.set(aB);
-			xfA.p = cA - cb2Mul(xfA.q, localCenterA);
-			xfB.p = cB - cb2Mul(xfB.q, localCenterB);
+	ci::Vec2f cA = m_positions[indexA].c;
+	float aA = m_positions[indexA].a;
 
-			cb2PositionSolverManifold psm;
-			psm.Initialize(pc, xfA, xfB, j);
-			ci::Vec2f normal = psm.normal;
+	ci::Vec2f cB = m_positions[indexB].c;
+	float aB = m_positions[indexB].a;
 
-			ci::Vec2f point = psm.point;
-			float separation = psm.separation;
+	// Solve normal constraints
+	for (int j = 0; j < pointCount; ++j)
+	{
+		cb2Transform xfA, xfB;
+		xfA.q.set(aA);
+		xfB.q.set(aB);
+		xfA.p = cA - cb2Mul(xfA.q, localCenterA);
+		xfB.p = cB - cb2Mul(xfB.q, localCenterB);
 
-			ci::Vec2f rA = point - cA;
-			ci::Vec2f rB = point - cB;
+		cb2PositionSolverManifold psm;
+		psm.Initialize(pc, i, xfA, xfB, j);
+		ci::Vec2f normal = psm.normal;
 
-			// Track max constraint error.
-			minSeparation = cb2Min(minSeparation, separation);
+		ci::Vec2f point = psm.point;
+		float separation = psm.separation;
 
-			// Prevent large corrections and allow slop.
-			float C = cb2Clamp(cb2_baumgarte * (separation + cb2_linearSlop), -cb2_maxLinearCorrection, 0.0f);
+		ci::Vec2f rA = point - cA;
+		ci::Vec2f rB = point - cB;
 
-			// Compute the effective mass.
-			float rnA = cb2Cross(rA, normal);
-			float rnB = cb2Cross(rB, normal);
-			float K = mA + mB + iA * rnA * rnA + iB * rnB * rnB;
+		// Track max constraint error.
+		minSeparation = cb2Min(minSeparation, separation);
 
-			// Compute normal impulse
-			float impulse = K > 0.0f ? - C / K : 0.0f;
+		// Prevent large corrections and allow slop.
+		const cb2Tolerances& tolerances = m_step.tolerances;
+		float C = cb2Clamp(tolerances.baumgarte * (separation + tolerances.linearSlop), -tolerances.maxLinearCorrection, 0.0f);
 
-			ci::Vec2f P = impulse * normal;
+		// Compute the effective mass.
+		float rnA = cb2Cross(rA, normal);
+		float rnB = cb2Cross(rB, normal);
+		float K = mA + mB + iA * rnA * rnA + iB * rnB * rnB;
 
-			cA -= mA * P;
-			aA -= iA * cb2Cross(rA, P);
+		// Compute normal impulse
+		float impulse = K > 0.0f ? - C / K : 0.0f;
 
-			cB += mB * P;
-			aB += iB * cb2Cross(rB, P);
-		}
+		ci::Vec2f P = impulse * normal;
+
+		cA -= mA * P;
+		aA -= iA * cb2Cross(rA, P);
+
+		cB += mB * P;
+		aB += iB * cb2Cross(rB, P);
+	}
 
+	if (mA > 0.0f || iA > 0.0f)
+	{
 		m_positions[indexA].c = cA;
 		m_positions[indexA].a = aA;
+	}
 
+	if (mB > 0.0f || iB > 0.0f)
+	{
 		m_positions[indexB].c = cB;
 		m_positions[indexB].a = aB;
 	}
 
-	// We can't expect minSpeparation >= -cb2_linearSlop because we don't
-	// push the separation above -cb2_linearSlop.
-	return minSeparation >= -3.0f * cb2_linearSlop;
+	return minSeparation;
 }
 
 // Sequential position solver for position constraints.
 bool cb2ContactSolver::SolveTOIPositionConstraints(int toiIndexA, int toiIndexB)
 {
+	const cb2ContactPositionConstraints* pc = m_positionConstraints;
 	float minSeparation = 0.0f;
 
-	for (int i = 0; i < m_count; ++i)
+	for (int i = 0; i < m_constraintCount; ++i)
 	{
-		cb2ContactPositionConstraint* pc = m_positionConstraints + i;
-
-		int indexA = pc->indexA;
-		int indexB = pc->indexB;
-		ci::Vec2f localCenterA = pc->localCenterA;
-		ci::Vec2f localCenterB = pc->localCenterB;
-		int pointCount = pc->pointCount;
+		int indexA = pc->indexA[i];
+		int indexB = pc->indexB[i];
+		ci::Vec2f localCenterA(pc->localCenterAx[i], pc->localCenterAy[i]);
+		ci::Vec2f localCenterB(pc->localCenterBx[i], pc->localCenterBy[i]);
+		int pointCount = pc->pointCount[i];
 
 		float mA = 0.0f;
 		float iA = 0.0f;
 		if (indexA == toiIndexA || indexA == toiIndexB)
 		{
-			mA = pc->invMassA;
-			iA = pc->invIA;
+			mA = pc->invMassA[i];
+			iA = pc->invIA[i];
 		}
 
 		float mB = 0.0f;
 		float iB = 0.;
 		if (indexB == toiIndexA || indexB == toiIndexB)
 		{
-			mB = pc->invMassB;
-			iB = pc->invIB;
+			mB = pc->invMassB[i];
+			iB = pc->invIB[i];
 		}
 
 		ci::Vec2f cA = m_positions[indexA].c;
@@ -788,7 +1546,7 @@ bool cb2ContactSolver::SolveTOIPositionConstraints(int toiIndexA, int toiIndexB)
 			xfB.p = cB - cb2Mul(xfB.q, localCenterB);
 
 			cb2PositionSolverManifold psm;
-			psm.Initialize(pc, xfA, xfB, j);
+			psm.Initialize(pc, i, xfA, xfB, j);
 			ci::Vec2f normal = psm.normal;
 
 			ci::Vec2f point = psm.point;
@@ -801,7 +1559,8 @@ bool cb2ContactSolver::SolveTOIPositionConstraints(int toiIndexA, int toiIndexB)
 			minSeparation = cb2Min(minSeparation, separation);
 
 			// Prevent large corrections and allow slop.
-			float C = cb2Clamp(cb2_toiBaugarte * (separation + cb2_linearSlop), -cb2_maxLinearCorrection, 0.0f);
+			const cb2Tolerances& tolerances = m_step.tolerances;
+			float C = cb2Clamp(tolerances.toiBaumgarte * (separation + tolerances.linearSlop), -tolerances.maxLinearCorrection, 0.0f);
 
 			// Compute the effective mass.
 			float rnA = cb2Cross(rA, normal);
@@ -827,7 +1586,7 @@ bool cb2ContactSolver::SolveTOIPositionConstraints(int toiIndexA, int toiIndexB)
 		m_positions[indexB].a = aB;
 	}
 
-	// We can't expect minSpeparation >= -cb2_linearSlop because we don't
-	// push the separation above -cb2_linearSlop.
-	return minSeparation >= -1.5f * cb2_linearSlop;
+	// We can't expect minSpeparation >= -linearSlop because we don't
+	// push the separation above -linearSlop.
+	return minSeparation >= -1.5f * m_step.tolerances.linearSlop;
 }
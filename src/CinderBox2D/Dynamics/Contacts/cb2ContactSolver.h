@@ -26,34 +26,47 @@
 class cb2Contact;
 class cb2Body;
 class cb2StackAllocator;
-struct cb2ContactPositionConstraint;
+struct cb2ContactPositionConstraints;
 
-struct cb2VelocityConstraintPoint
+/// Per point columns of the contact velocity constraints.
+struct cb2VelocityConstraintPoints
 {
-	ci::Vec2f rA;
-	ci::Vec2f rB;
-	float normalImpulse;
-	float tangentImpulse;
-	float normalMass;
-	float tangentMass;
-	float velocityBias;
+	float* rAx;
+	float* rAy;
+	float* rBx;
+	float* rBy;
+	float* normalImpulse;
+	float* tangentImpulse;
+	float* normalMass;
+	float* tangentMass;
+	float* velocityBias;
 };
 
-struct cb2ContactVelocityConstraint
+/// The contact velocity constraints stored as a structure of arrays. Each
+/// column holds one entry per contact, so the solver iterations stream through
+/// memory instead of gathering from large per-contact structures. K and its
+/// inverse are symmetric, so only three entries are kept.
+struct cb2ContactVelocityConstraints
 {
-	cb2VelocityConstraintPoint points[cb2_maxManifoldPoints];
-	ci::Vec2f normal;
-	ci::Matrix22f normalMass;
-	ci::Matrix22f K;
-	int indexA;
-	int indexB;
-	float invMassA, invMassB;
-	float invIA, invIB;
-	float friction;
-	float restitution;
-	float tangentSpeed;
-	int pointCount;
-	int contactIndex;
+	cb2VelocityConstraintPoints points[cb2_maxManifoldPoints];
+	float* normalX;
+	float* normalY;
+	float* normalMass11;
+	float* normalMass12;
+	float* normalMass22;
+	float* K11;
+	float* K12;
+	float* K22;
+	int* indexA;
+	int* indexB;
+	float* invMassA;
+	float* invMassB;
+	float* invIA;
+	float* invIB;
+	float* friction;
+	float* restitution;
+	float* tangentSpeed;
+	int* pointCount;
 };
 
 struct cb2ContactSolverDef
@@ -64,6 +77,7 @@ struct cb2ContactSolverDef
 	cb2Position* positions;
 	cb2Velocity* velocities;
 	cb2StackAllocator* allocator;
+	bool reduceContacts;	// merge the manifolds of each body pair, see cb2World::SetContactReduction
 };
 
 class cb2ContactSolver
@@ -81,15 +95,57 @@ public:
 	bool SolvePositionConstraints();
 	bool SolveTOIPositionConstraints(int toiIndexA, int toiIndexB);
 
+	/// Solve a single constraint slot. Constraints that share no moving body may be
+	/// solved concurrently. Returns the smallest separation for the position solver.
+	void SolveVelocityConstraint(int slot);
+	float SolvePositionConstraint(int slot);
+
+	/// Get the contact solved by a constraint slot, -1 for an empty slot. With contact
+	/// reduction this is the first contact of the merged group.
+	int GetContactIndex(int slot) const;
+
 	cb2TimeStep m_step;
 	cb2Position* m_positions;
 	cb2Velocity* m_velocities;
 	cb2StackAllocator* m_allocator;
-	cb2ContactPositionConstraint* m_positionConstraints;
-	cb2ContactVelocityConstraint* m_velocityConstraints;
+	void* m_constraintBlock;
+	cb2ContactPositionConstraints* m_positionConstraints;
+	cb2ContactVelocityConstraints m_velocityConstraints;
 	cb2Contact** m_contacts;
 	int m_count;
+
+	// The number of constraint slots. This matches m_count except for the SIMD
+	// solver, which pads its batches with empty slots.
+	int m_constraintCount;
+#if defined(CB2_SIMD_SOLVER)
+	int* m_slotContacts;
+#endif
+
+	// Contact reduction, all NULL without it. The constraints solve m_leaders, whose
+	// manifolds are looked up by contact index, merged or not. m_sources holds the
+	// contact point each solved point came from, as contactIndex * cb2_maxManifoldPoints
+	// + point.
+	void* m_reductionBlock;
+	cb2Manifold** m_manifolds;
+	int* m_leaders;
+	int* m_sources;
+	int m_leaderCount;
+
+private:
+	void ReduceContacts();
+	void MergeManifolds(int leader, const int* group, int groupCount, cb2Manifold* merged);
+	cb2Manifold* GetSolverManifold(int contactIndex) const;
 };
 
+inline int cb2ContactSolver::GetContactIndex(int slot) const
+{
+	cb2Assert(0 <= slot && slot < m_constraintCount);
+#if defined(CB2_SIMD_SOLVER)
+	return m_slotContacts[slot];
+#else
+	return m_leaders ? m_leaders[slot] : slot;
+#endif
+}
+
 #endif
 
@@ -42,11 +42,13 @@ cb2PolygonContact::cb2PolygonContact(cb2Fixture* fixtureA, cb2Fixture* fixtureB)
 {
 	cb2Assert(m_fixtureA->GetType() == cb2Shape::e_polygon);
 	cb2Assert(m_fixtureB->GetType() == cb2Shape::e_polygon);
+	m_cache[0].gap = -1.0f;
+	m_cache[1].gap = -1.0f;
 }
 
 void cb2PolygonContact::Evaluate(cb2Manifold* manifold, const cb2Transform& xfA, const cb2Transform& xfB)
 {
 	cb2CollidePolygons(	manifold,
 						(cb2PolygonShape*)m_fixtureA->GetShape(), xfA,
-						(cb2PolygonShape*)m_fixtureB->GetShape(), xfB);
+						(cb2PolygonShape*)m_fixtureB->GetShape(), xfB, m_cache);
 }
@@ -34,6 +34,11 @@ public:
 	~cb2PolygonContact() {}
 
 	void Evaluate(cb2Manifold* manifold, const cb2Transform& xfA, const cb2Transform& xfB);
+
+private:
+
+	// The reference faces of the last evaluation, one per polygon.
+	cb2SeparationCache m_cache[2];
 };
 
 #endif
@@ -0,0 +1,455 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/Contacts/cb2SoftContactSolver.h>
+
+#include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Common/cb2StackAllocator.h>
+
+#include <memory.h>
+
+cb2SoftContactSolver::cb2SoftContactSolver(cb2SoftContactSolverDef* def)
+{
+	m_step = def->step;
+	m_allocator = def->allocator;
+	m_count = def->count;
+	m_positions = def->positions;
+	m_velocities = def->velocities;
+	m_contacts = def->contacts;
+	m_bodyCount = def->bodyCount;
+
+	cb2Assert(m_step.subStepCount > 0);
+	float h = m_step.dt / m_step.subStepCount;
+	m_inv_h = m_step.subStepCount * m_step.inv_dt;
+
+	// A damped spring per contact point. The stiffness is limited by the substep rate.
+	float hertz = cb2Min(cb2_contactHertz, 0.25f * m_inv_h);
+	float zeta = cb2_contactDampingRatio;
+	float omega = 2.0f * cb2_pi * hertz;
+	float a1 = 2.0f * zeta + h * omega;
+	float a2 = h * omega * a1;
+	float a3 = 1.0f / (1.0f + a2);
+	m_biasRate = omega / a1;
+	m_massScale = a2 * a3;
+	m_impulseScale = a3;
+
+	m_constraints = (cb2SoftContactConstraint*)m_allocator->Allocate(m_count * sizeof(cb2SoftContactConstraint));
+	m_startPositions = (cb2Position*)m_allocator->Allocate(m_bodyCount * sizeof(cb2Position));
+	m_deltaRotations = (cb2Rot*)m_allocator->Allocate(m_bodyCount * sizeof(cb2Rot));
+	memcpy(m_startPositions, m_positions, m_bodyCount * sizeof(cb2Position));
+
+	for (int i = 0; i < m_count; ++i)
+	{
+		cb2Contact* contact = m_contacts[i];
+		cb2SoftContactConstraint* constraint = m_constraints + i;
+
+		cb2Fixture* fixtureA = contact->m_fixtureA;
+		cb2Fixture* fixtureB = contact->m_fixtureB;
+		cb2Body* bodyA = fixtureA->GetBody();
+		cb2Body* bodyB = fixtureB->GetBody();
+		cb2Manifold* manifold = contact->GetManifold();
+		cb2Assert(manifold->pointCount > 0);
+
+		int indexA = bodyA->m_islandIndex;
+		int indexB = bodyB->m_islandIndex;
+		// Sleeping bodies of other islands hold still, see cb2SleepDef::wakeHopCount.
+		float mA = bodyA->IsAwake() ? bodyA->m_invMass : 0.0f;
+		float mB = bodyB->IsAwake() ? bodyB->m_invMass : 0.0f;
+		float iA = bodyA->IsAwake() ? bodyA->m_invI : 0.0f;
+		float iB = bodyB->IsAwake() ? bodyB->m_invI : 0.0f;
+
+		constraint->indexA = indexA;
+		constraint->indexB = indexB;
+		constraint->invMassA = mA;
+		constraint->invMassB = mB;
+		constraint->invIA = iA;
+		constraint->invIB = iB;
+		constraint->friction = contact->m_friction;
+		constraint->restitution = contact->m_restitution;
+		constraint->tangentSpeed = contact->m_tangentSpeed;
+		constraint->pointCount = manifold->pointCount;
+
+		ci::Vec2f cA = m_positions[indexA].c;
+		ci::Vec2f cB = m_positions[indexB].c;
+		ci::Vec2f vA = m_velocities[indexA].v;
+		float wA = m_velocities[indexA].w;
+		ci::Vec2f vB = m_velocities[indexB].v;
+		float wB = m_velocities[indexB].w;
+
+		cb2Transform xfA, xfB;
+		xfA.q.set(m_positions[indexA].a);
+		xfB.q.set(m_positions[indexB].a);
+		xfA.p = cA - cb2Mul(xfA.q, bodyA->m_sweep.localCenter);
+		xfB.p = cB - cb2Mul(xfB.q, bodyB->m_sweep.localCenter);
+
+		cb2WorldManifold worldManifold;
+		worldManifold.Initialize(manifold, xfA, fixtureA->GetShape()->m_radius, xfB, fixtureB->GetShape()->m_radius);
+
+		ci::Vec2f normal = worldManifold.normal;
+		ci::Vec2f tangent = cb2Cross(normal, 1.0f);
+		constraint->normal = normal;
+
+		for (int j = 0; j < constraint->pointCount; ++j)
+		{
+			const cb2ManifoldPoint* mp = manifold->points + j;
+			cb2SoftContactConstraintPoint* cp = constraint->points + j;
+
+			// The manifolds hold the impulses of a whole step, like for cb2ContactSolver,
+			// and the substeps share them out.
+			if (m_step.warmStarting)
+			{
+				float scale = m_step.dtRatio / m_step.subStepCount;
+				cp->normalImpulse = scale * mp->normalImpulse;
+				cp->tangentImpulse = scale * mp->tangentImpulse;
+			}
+			else
+			{
+				cp->normalImpulse = 0.0f;
+				cp->tangentImpulse = 0.0f;
+			}
+
+			cp->totalNormalImpulse = 0.0f;
+			cp->totalTangentImpulse = 0.0f;
+
+			ci::Vec2f rA = worldManifold.points[j] - cA;
+			ci::Vec2f rB = worldManifold.points[j] - cB;
+			cp->rA = rA;
+			cp->rB = rB;
+
+			// The separation follows from the motion of the anchors.
+			cp->adjustedSeparation = worldManifold.separations[j] - cb2Dot(rB - rA, normal);
+
+			float rnA = cb2Cross(rA, normal);
+			float rnB = cb2Cross(rB, normal);
+			float kNormal = mA + mB + iA * rnA * rnA + iB * rnB * rnB;
+			cp->normalMass = kNormal > 0.0f ? 1.0f / kNormal : 0.0f;
+
+			float rtA = cb2Cross(rA, tangent);
+			float rtB = cb2Cross(rB, tangent);
+			float kTangent = mA + mB + iA * rtA * rtA + iB * rtB * rtB;
+			cp->tangentMass = kTangent > 0.0f ? 1.0f / kTangent : 0.0f;
+
+			// Restitution uses the approach velocity from before the step.
+			cp->relativeVelocity = cb2Dot(normal, vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA));
+		}
+
+		// Two points are solved together like in cb2ContactSolver, unless they are redundant.
+		constraint->blockSolve = false;
+		if (constraint->pointCount == 2)
+		{
+			const cb2SoftContactConstraintPoint* cp1 = constraint->points + 0;
+			const cb2SoftContactConstraintPoint* cp2 = constraint->points + 1;
+
+			float rn1A = cb2Cross(cp1->rA, normal);
+			float rn1B = cb2Cross(cp1->rB, normal);
+			float rn2A = cb2Cross(cp2->rA, normal);
+			float rn2B = cb2Cross(cp2->rB, normal);
+
+			float k11 = mA + mB + iA * rn1A * rn1A + iB * rn1B * rn1B;
+			float k22 = mA + mB + iA * rn2A * rn2A + iB * rn2B * rn2B;
+			float k12 = mA + mB + iA * rn1A * rn2A + iB * rn1B * rn2B;
+
+			const float k_maxConditionNumber = 1000.0f;
+			if (k11 * k11 < k_maxConditionNumber * (k11 * k22 - k12 * k12))
+			{
+				constraint->K.set(k11, k12,
+								  k12, k22);
+				constraint->normalMass = constraint->K.inverted();
+				constraint->blockSolve = true;
+			}
+		}
+	}
+}
+
+cb2SoftContactSolver::~cb2SoftContactSolver()
+{
+	m_allocator->Free(m_deltaRotations);
+	m_allocator->Free(m_startPositions);
+	m_allocator->Free(m_constraints);
+}
+
+void cb2SoftContactSolver::WarmStart()
+{
+	for (int i = 0; i < m_count; ++i)
+	{
+		const cb2SoftContactConstraint* constraint = m_constraints + i;
+
+		int indexA = constraint->indexA;
+		int indexB = constraint->indexB;
+		float mA = constraint->invMassA;
+		float iA = constraint->invIA;
+		float mB = constraint->invMassB;
+		float iB = constraint->invIB;
+
+		ci::Vec2f vA = m_velocities[indexA].v;
+		float wA = m_velocities[indexA].w;
+		ci::Vec2f vB = m_velocities[indexB].v;
+		float wB = m_velocities[indexB].w;
+
+		ci::Vec2f normal = constraint->normal;
+		ci::Vec2f tangent = cb2Cross(normal, 1.0f);
+
+		for (int j = 0; j < constraint->pointCount; ++j)
+		{
+			const cb2SoftContactConstraintPoint* cp = constraint->points + j;
+
+			ci::Vec2f P = cp->normalImpulse * normal + cp->tangentImpulse * tangent;
+			wA -= iA * cb2Cross(cp->rA, P);
+			vA -= mA * P;
+			wB += iB * cb2Cross(cp->rB, P);
+			vB += mB * P;
+		}
+
+		m_velocities[indexA].v = vA;
+		m_velocities[indexA].w = wA;
+		m_velocities[indexB].v = vB;
+		m_velocities[indexB].w = wB;
+	}
+}
+
+void cb2SoftContactSolver::SolveVelocityConstraints(bool useBias)
+{
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		m_deltaRotations[i].set(m_positions[i].a - m_startPositions[i].a);
+	}
+
+	for (int i = 0; i < m_count; ++i)
+	{
+		cb2SoftContactConstraint* constraint = m_constraints + i;
+
+		int indexA = constraint->indexA;
+		int indexB = constraint->indexB;
+		float mA = constraint->invMassA;
+		float iA = constraint->invIA;
+		float mB = constraint->invMassB;
+		float iB = constraint->invIB;
+
+		ci::Vec2f vA = m_velocities[indexA].v;
+		float wA = m_velocities[indexA].w;
+		ci::Vec2f vB = m_velocities[indexB].v;
+		float wB = m_velocities[indexB].w;
+
+		ci::Vec2f dcA = m_positions[indexA].c - m_startPositions[indexA].c;
+		ci::Vec2f dcB = m_positions[indexB].c - m_startPositions[indexB].c;
+		const cb2Rot& qA = m_deltaRotations[indexA];
+		const cb2Rot& qB = m_deltaRotations[indexB];
+
+		ci::Vec2f normal = constraint->normal;
+		ci::Vec2f tangent = cb2Cross(normal, 1.0f);
+		int pointCount = constraint->pointCount;
+
+		// Non-penetration first, then friction with the updated normal impulses.
+		float bias[cb2_maxManifoldPoints] = { 0.0f };
+		float massScale[cb2_maxManifoldPoints] = { 0.0f };
+		float impulseScale[cb2_maxManifoldPoints] = { 0.0f };
+		for (int j = 0; j < pointCount; ++j)
+		{
+			const cb2SoftContactConstraintPoint* cp = constraint->points + j;
+
+			// Current separation
+			ci::Vec2f d = dcB - dcA + cb2Mul(qB, cp->rB) - cb2Mul(qA, cp->rA);
+			float s = cb2Dot(d, normal) + cp->adjustedSeparation;
+
+			bias[j] = 0.0f;
+			massScale[j] = 1.0f;
+			impulseScale[j] = 0.0f;
+			if (s > 0.0f)
+			{
+				// Speculative, only remove the approach velocity that would close the gap.
+				bias[j] = s * m_inv_h;
+			}
+			else if (useBias)
+			{
+				bias[j] = cb2Max(m_biasRate * s, -cb2_contactPushoutVelocity);
+				massScale[j] = m_massScale;
+				impulseScale[j] = m_impulseScale;
+			}
+		}
+
+		bool solved = false;
+		if (constraint->blockSolve && massScale[0] == massScale[1])
+		{
+			// Both points in one go, kept only if neither impulse turns negative.
+			cb2SoftContactConstraintPoint* cp1 = constraint->points + 0;
+			cb2SoftContactConstraintPoint* cp2 = constraint->points + 1;
+
+			ci::Vec2f a(cp1->normalImpulse, cp2->normalImpulse);
+			ci::Vec2f dv1 = vB + cb2Cross(wB, cp1->rB) - vA - cb2Cross(wA, cp1->rA);
+			ci::Vec2f dv2 = vB + cb2Cross(wB, cp2->rB) - vA - cb2Cross(wA, cp2->rA);
+			ci::Vec2f b(cb2Dot(dv1, normal) + bias[0], cb2Dot(dv2, normal) + bias[1]);
+
+			ci::Vec2f x = a - massScale[0] * cb2Mul(constraint->normalMass, b) - impulseScale[0] * a;
+			if (x.x >= 0.0f && x.y >= 0.0f)
+			{
+				ci::Vec2f d = x - a;
+				ci::Vec2f P1 = d.x * normal;
+				ci::Vec2f P2 = d.y * normal;
+				vA -= mA * (P1 + P2);
+				wA -= iA * (cb2Cross(cp1->rA, P1) + cb2Cross(cp2->rA, P2));
+
+				vB += mB * (P1 + P2);
+				wB += iB * (cb2Cross(cp1->rB, P1) + cb2Cross(cp2->rB, P2));
+
+				cp1->normalImpulse = x.x;
+				cp2->normalImpulse = x.y;
+				solved = true;
+			}
+		}
+
+		for (int j = 0; j < pointCount && solved == false; ++j)
+		{
+			cb2SoftContactConstraintPoint* cp = constraint->points + j;
+			ci::Vec2f rA = cp->rA;
+			ci::Vec2f rB = cp->rB;
+
+			ci::Vec2f dv = vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA);
+			float vn = cb2Dot(dv, normal);
+
+			float impulse = -cp->normalMass * massScale[j] * (vn + bias[j]) - impulseScale[j] * cp->normalImpulse;
+			float newImpulse = cb2Max(cp->normalImpulse + impulse, 0.0f);
+			impulse = newImpulse - cp->normalImpulse;
+			cp->normalImpulse = newImpulse;
+
+			ci::Vec2f P = impulse * normal;
+			vA -= mA * P;
+			wA -= iA * cb2Cross(rA, P);
+
+			vB += mB * P;
+			wB += iB * cb2Cross(rB, P);
+		}
+
+		for (int j = 0; j < pointCount; ++j)
+		{
+			cb2SoftContactConstraintPoint* cp = constraint->points + j;
+			ci::Vec2f rA = cp->rA;
+			ci::Vec2f rB = cp->rB;
+
+			ci::Vec2f dv = vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA);
+			float vt = cb2Dot(dv, tangent) - constraint->tangentSpeed;
+			float lambda = -cp->tangentMass * vt;
+
+			float maxFriction = constraint->friction * cp->normalImpulse;
+			float newImpulse = cb2Clamp(cp->tangentImpulse + lambda, -maxFriction, maxFriction);
+			lambda = newImpulse - cp->tangentImpulse;
+			cp->tangentImpulse = newImpulse;
+
+			ci::Vec2f P = lambda * tangent;
+			vA -= mA * P;
+			wA -= iA * cb2Cross(rA, P);
+
+			vB += mB * P;
+			wB += iB * cb2Cross(rB, P);
+		}
+
+		// The relax pass ends a substep, so its impulses count toward the step.
+		if (useBias == false)
+		{
+			for (int j = 0; j < pointCount; ++j)
+			{
+				cb2SoftContactConstraintPoint* cp = constraint->points + j;
+				cp->totalNormalImpulse += cp->normalImpulse;
+				cp->totalTangentImpulse += cp->tangentImpulse;
+			}
+		}
+
+		m_velocities[indexA].v = vA;
+		m_velocities[indexA].w = wA;
+		m_velocities[indexB].v = vB;
+		m_velocities[indexB].w = wB;
+	}
+}
+
+void cb2SoftContactSolver::ApplyRestitution()
+{
+	for (int i = 0; i < m_count; ++i)
+	{
+		cb2SoftContactConstraint* constraint = m_constraints + i;
+		if (constraint->restitution == 0.0f)
+		{
+			continue;
+		}
+
+		int indexA = constraint->indexA;
+		int indexB = constraint->indexB;
+		float mA = constraint->invMassA;
+		float iA = constraint->invIA;
+		float mB = constraint->invMassB;
+		float iB = constraint->invIB;
+
+		ci::Vec2f vA = m_velocities[indexA].v;
+		float wA = m_velocities[indexA].w;
+		ci::Vec2f vB = m_velocities[indexB].v;
+		float wB = m_velocities[indexB].w;
+
+		ci::Vec2f normal = constraint->normal;
+
+		for (int j = 0; j < constraint->pointCount; ++j)
+		{
+			cb2SoftContactConstraintPoint* cp = constraint->points + j;
+
+			// Only points that approached fast enough and carried a load bounce.
+			if (cp->relativeVelocity > -m_step.tolerances.velocityThreshold || cp->totalNormalImpulse == 0.0f)
+			{
+				continue;
+			}
+
+			ci::Vec2f rA = cp->rA;
+			ci::Vec2f rB = cp->rB;
+
+			ci::Vec2f dv = vB + cb2Cross(wB, rB) - vA - cb2Cross(wA, rA);
+			float vn = cb2Dot(dv, normal);
+
+			float impulse = -cp->normalMass * (vn + constraint->restitution * cp->relativeVelocity);
+			float newImpulse = cb2Max(cp->normalImpulse + impulse, 0.0f);
+			impulse = newImpulse - cp->normalImpulse;
+			cp->normalImpulse = newImpulse;
+			cp->totalNormalImpulse += impulse;
+
+			ci::Vec2f P = impulse * normal;
+			vA -= mA * P;
+			wA -= iA * cb2Cross(rA, P);
+
+			vB += mB * P;
+			wB += iB * cb2Cross(rB, P);
+		}
+
+		m_velocities[indexA].v = vA;
+		m_velocities[indexA].w = wA;
+		m_velocities[indexB].v = vB;
+		m_velocities[indexB].w = wB;
+	}
+}
+
+void cb2SoftContactSolver::StoreImpulses()
+{
+	for (int i = 0; i < m_count; ++i)
+	{
+		const cb2SoftContactConstraint* constraint = m_constraints + i;
+		cb2Manifold* manifold = m_contacts[i]->GetManifold();
+
+		for (int j = 0; j < constraint->pointCount; ++j)
+		{
+			manifold->points[j].normalImpulse = constraint->points[j].totalNormalImpulse;
+			manifold->points[j].tangentImpulse = constraint->points[j].totalTangentImpulse;
+		}
+	}
+}
@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_SOFT_CONTACT_SOLVER_H
+#define CB2_SOFT_CONTACT_SOLVER_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Collision/cb2Collision.h>
+#include <CinderBox2D/Dynamics/cb2TimeStep.h>
+
+class cb2Contact;
+class cb2StackAllocator;
+
+struct cb2SoftContactConstraintPoint
+{
+	ci::Vec2f rA;
+	ci::Vec2f rB;
+	float adjustedSeparation;
+	float relativeVelocity;
+	float normalImpulse;
+	float tangentImpulse;
+	float totalNormalImpulse;
+	float totalTangentImpulse;
+	float normalMass;
+	float tangentMass;
+};
+
+/// A contact constraint of the soft step solver. The anchors stay fixed for the
+/// whole step, the separation is tracked from the motion of the bodies.
+struct cb2SoftContactConstraint
+{
+	cb2SoftContactConstraintPoint points[cb2_maxManifoldPoints];
+	ci::Vec2f normal;
+	ci::Matrix22f K;
+	ci::Matrix22f normalMass;
+	int indexA;
+	int indexB;
+	float invMassA;
+	float invMassB;
+	float invIA;
+	float invIB;
+	float friction;
+	float restitution;
+	float tangentSpeed;
+	int pointCount;
+	bool blockSolve;
+};
+
+struct cb2SoftContactSolverDef
+{
+	cb2TimeStep step;
+	cb2Contact** contacts;
+	int count;
+	cb2Position* positions;
+	cb2Velocity* velocities;
+	int bodyCount;
+	cb2StackAllocator* allocator;
+};
+
+/// Solves contacts as soft constraints over several substeps, an alternative to
+/// the velocity iterations and position correction of cb2ContactSolver. Each
+/// substep warm starts, solves with a soft push-out bias, integrates positions and
+/// relaxes without the bias. Restitution is applied once at the end of the step.
+/// Two point manifolds use the block solver of cb2ContactSolver where they can,
+/// which keeps tall stacks from turning. The manifolds get the impulses summed
+/// over the substeps.
+class cb2SoftContactSolver
+{
+public:
+	cb2SoftContactSolver(cb2SoftContactSolverDef* def);
+	~cb2SoftContactSolver();
+
+	void WarmStart();
+
+	/// Solve every constraint once. The biased pass pushes overlapping bodies apart,
+	/// the relax pass removes the velocity it added and ends the substep.
+	void SolveVelocityConstraints(bool useBias);
+
+	void ApplyRestitution();
+	void StoreImpulses();
+
+	cb2TimeStep m_step;
+	cb2Position* m_positions;
+	cb2Velocity* m_velocities;
+	cb2StackAllocator* m_allocator;
+	cb2SoftContactConstraint* m_constraints;
+	cb2Contact** m_contacts;
+	int m_count;
+
+	// Body positions at the start of the step and the rotations since then.
+	cb2Position* m_startPositions;
+	cb2Rot* m_deltaRotations;
+	int m_bodyCount;
+
+	// The soft constraint coefficients for a substep.
+	float m_inv_h;
+	float m_biasRate;
+	float m_massScale;
+	float m_impulseScale;
+};
+
+#endif
@@ -0,0 +1,323 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/Controllers/cb2BuoyancyController.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Common/cb2StackAllocator.h>
+
+#include <memory.h>
+
+// The number of segments of each end cap of the polygon standing in for a capsule.
+#define cb2_capsuleCapSegments	6
+
+// The most vertices of a polygon or a capsule outline.
+#define cb2_maxSubmergedVertices	(cb2_maxPolygonVertices > 2 * cb2_capsuleCapSegments + 2 ? \
+									 cb2_maxPolygonVertices : 2 * cb2_capsuleCapSegments + 2)
+
+cb2BuoyancyController::cb2BuoyancyController(const cb2BuoyancyControllerDef* def)
+: cb2Controller(def)
+{
+	m_normal = def->normal;
+	m_offset = def->offset;
+	m_density = def->density;
+	m_velocity = def->velocity;
+	m_linearDrag = def->linearDrag;
+	m_angularDrag = def->angularDrag;
+	m_useDensity = def->useDensity;
+	m_useWorldGravity = def->useWorldGravity;
+	m_gravity = def->gravity;
+}
+
+// Clip a counter-clockwise polygon against the plane dot(normal, p) = offset and
+// return the area and centroid of the part below it.
+static float cb2ComputeSubmergedPolygon(const ci::Vec2f* vertices, int count, const ci::Vec2f& normal,
+										float offset, ci::Vec2f* centroid)
+{
+	const float k_inv3 = 1.0f / 3.0f;
+
+	// Find where the edges dive into and come out of the fluid.
+	float depths[cb2_maxSubmergedVertices];
+	cb2Assert(count <= cb2_maxSubmergedVertices);
+	int diveCount = 0;
+	int intoIndex = -1;
+	int outoIndex = -1;
+	bool lastSubmerged = false;
+	for (int i = 0; i < count; ++i)
+	{
+		depths[i] = cb2Dot(normal, vertices[i]) - offset;
+		bool isSubmerged = depths[i] < -cb2_epsilon;
+		if (i > 0 && isSubmerged != lastSubmerged)
+		{
+			if (isSubmerged)
+			{
+				intoIndex = i - 1;
+			}
+			else
+			{
+				outoIndex = i - 1;
+			}
+			++diveCount;
+		}
+		lastSubmerged = isSubmerged;
+	}
+
+	if (diveCount == 0)
+	{
+		if (lastSubmerged == false)
+		{
+			return 0.0f;
+		}
+
+		// Completely submerged, a triangle fan around the first vertex.
+		float area = 0.0f;
+		ci::Vec2f center(0.0f, 0.0f);
+		for (int i = 1; i + 1 < count; ++i)
+		{
+			float triangleArea = 0.5f * cb2Cross(vertices[i] - vertices[0], vertices[i + 1] - vertices[0]);
+			area += triangleArea;
+			center += (triangleArea * k_inv3) * (vertices[0] + vertices[i] + vertices[i + 1]);
+		}
+
+		cb2Assert(area > cb2_epsilon);
+		*centroid = center * (1.0f / area);
+		return area;
+	}
+
+	// The polygon crosses the surface twice, the wrap around edge may hold one crossing.
+	if (diveCount == 1)
+	{
+		if (intoIndex == -1)
+		{
+			intoIndex = count - 1;
+		}
+		else
+		{
+			outoIndex = count - 1;
+		}
+	}
+
+	int intoIndex2 = (intoIndex + 1) % count;
+	int outoIndex2 = (outoIndex + 1) % count;
+
+	float intoLambda = (0.0f - depths[intoIndex]) / (depths[intoIndex2] - depths[intoIndex]);
+	float outoLambda = (0.0f - depths[outoIndex]) / (depths[outoIndex2] - depths[outoIndex]);
+
+	ci::Vec2f intoVec = (1.0f - intoLambda) * vertices[intoIndex] + intoLambda * vertices[intoIndex2];
+	ci::Vec2f outoVec = (1.0f - outoLambda) * vertices[outoIndex] + outoLambda * vertices[outoIndex2];
+
+	// Fan out from the entry point over the submerged vertices to the exit point.
+	float area = 0.0f;
+	ci::Vec2f center(0.0f, 0.0f);
+	ci::Vec2f p2 = vertices[intoIndex2];
+	int i = intoIndex2;
+	while (i != outoIndex2)
+	{
+		i = (i + 1) % count;
+		ci::Vec2f p3 = i == outoIndex2 ? outoVec : vertices[i];
+
+		float triangleArea = 0.5f * cb2Cross(p2 - intoVec, p3 - intoVec);
+		area += triangleArea;
+		center += (triangleArea * k_inv3) * (intoVec + p2 + p3);
+
+		p2 = p3;
+	}
+
+	if (area <= cb2_epsilon)
+	{
+		return 0.0f;
+	}
+
+	*centroid = center * (1.0f / area);
+	return area;
+}
+
+float cb2BuoyancyController::ComputeSubmergedArea(const cb2Shape* shape, int childIndex, const ci::Vec2f& normal,
+												float offset, const cb2Transform& xf, ci::Vec2f* centroid)
+{
+	CB2_NOT_USED(childIndex);
+
+	switch (shape->GetType())
+	{
+	case cb2Shape::e_circle:
+		{
+			const cb2CircleShape* circle = (const cb2CircleShape*)shape;
+			ci::Vec2f p = cb2Mul(xf, circle->m_p);
+			float radius = circle->m_radius;
+
+			// The depth of the center below the surface.
+			float l = offset - cb2Dot(normal, p);
+			if (l <= -radius + cb2_epsilon)
+			{
+				return 0.0f;
+			}
+
+			if (l >= radius)
+			{
+				*centroid = p;
+				return cb2_pi * radius * radius;
+			}
+
+			// The circular segment below the surface.
+			float r2 = radius * radius;
+			float l2 = l * l;
+			float h = cb2Sqrt(r2 - l2);
+			float area = r2 * (cb2Atan2(l, h) + 0.5f * cb2_pi) + l * h;
+			float com = -2.0f / 3.0f * (r2 - l2) * h / area;
+			*centroid = p + com * normal;
+			return area;
+		}
+
+	case cb2Shape::e_polygon:
+		{
+			const cb2PolygonShape* polygon = (const cb2PolygonShape*)shape;
+			ci::Vec2f normalL = cb2MulT(xf.q, normal);
+			float offsetL = offset - cb2Dot(normal, xf.p);
+
+			ci::Vec2f centroidL;
+			float area = cb2ComputeSubmergedPolygon(polygon->m_vertices, polygon->m_count, normalL, offsetL, &centroidL);
+			if (area > 0.0f)
+			{
+				*centroid = cb2Mul(xf, centroidL);
+			}
+			return area;
+		}
+
+	case cb2Shape::e_capsule:
+		{
+			// Each cap is a half polygon whose radius is scaled so it has the area of
+			// the half circle, which keeps the whole capsule's displacement exact.
+			const cb2CapsuleShape* capsule = (const cb2CapsuleShape*)shape;
+			const int n = cb2_capsuleCapSegments;
+			float step = cb2_pi / n;
+			float sinStep, cosStep;
+			cb2SinCos(step, &sinStep, &cosStep);
+			float radius = capsule->m_radius * cb2Sqrt(step / sinStep);
+
+			ci::Vec2f axis = capsule->m_vertex2 - capsule->m_vertex1;
+			float angle = cb2Atan2(axis.y, axis.x) - 0.5f * cb2_pi;
+
+			ci::Vec2f vertices[2 * cb2_capsuleCapSegments + 2];
+			for (int i = 0; i <= n; ++i)
+			{
+				float s, c;
+				cb2SinCos(angle + i * step, &s, &c);
+				vertices[i] = capsule->m_vertex2 + radius * ci::Vec2f(c, s);
+				vertices[n + 1 + i] = capsule->m_vertex1 - radius * ci::Vec2f(c, s);
+			}
+
+			ci::Vec2f normalL = cb2MulT(xf.q, normal);
+			float offsetL = offset - cb2Dot(normal, xf.p);
+
+			ci::Vec2f centroidL;
+			float area = cb2ComputeSubmergedPolygon(vertices, 2 * n + 2, normalL, offsetL, &centroidL);
+			if (area > 0.0f)
+			{
+				*centroid = cb2Mul(xf, centroidL);
+			}
+			return area;
+		}
+
+	default:
+		return 0.0f;
+	}
+}
+
+void cb2BuoyancyController::Apply(cb2ControllerBatch* batch)
+{
+	int bodyCount = batch->bodyCount;
+	if (bodyCount == 0)
+	{
+		return;
+	}
+
+	// The submerged area, its centroid and the submerged mass with its center, summed
+	// over the fixtures of each body.
+	cb2StackAllocator* allocator = batch->allocator;
+	float* sums = (float*)allocator->Allocate(6 * bodyCount * sizeof(float));
+	memset(sums, 0, 6 * bodyCount * sizeof(float));
+
+	for (int i = 0; i < batch->fixtureCount; ++i)
+	{
+		const cb2Fixture* fixture = batch->fixtures[i];
+		const cb2Shape* shape = fixture->GetShape();
+		const cb2Transform& xf = fixture->GetBody()->GetTransform();
+		float shapeDensity = m_useDensity ? fixture->GetDensity() : 1.0f;
+
+		float* sum = sums + 6 * batch->fixtureBodies[i];
+		int childCount = shape->GetChildCount();
+		for (int child = 0; child < childCount; ++child)
+		{
+			ci::Vec2f centroid;
+			float area = ComputeSubmergedArea(shape, child, m_normal, m_offset, xf, &centroid);
+			if (area <= 0.0f)
+			{
+				continue;
+			}
+
+			float mass = area * shapeDensity;
+			sum[0] += area;
+			sum[1] += area * centroid.x;
+			sum[2] += area * centroid.y;
+			sum[3] += mass;
+			sum[4] += mass * centroid.x;
+			sum[5] += mass * centroid.y;
+		}
+	}
+
+	ci::Vec2f gravity = m_useWorldGravity ? batch->gravity : m_gravity;
+
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		const float* sum = sums + 6 * i;
+		float area = sum[0];
+		if (area < cb2_epsilon || sum[3] < cb2_epsilon)
+		{
+			continue;
+		}
+
+		float cx = batch->centerX[i];
+		float cy = batch->centerY[i];
+		float w = batch->angularVelocity[i];
+
+		// Buoyancy pushes on the center of the displaced mass.
+		float massX = sum[4] / sum[3] - cx;
+		float massY = sum[5] / sum[3] - cy;
+		float buoyancyX = -m_density * sum[3] * gravity.x;
+		float buoyancyY = -m_density * sum[3] * gravity.y;
+
+		// Drag pulls the center of the submerged area along with the fluid.
+		float areaX = sum[1] / area - cx;
+		float areaY = sum[2] / area - cy;
+		float dragX = -m_linearDrag * area * (batch->velocityX[i] - w * areaY - m_velocity.x);
+		float dragY = -m_linearDrag * area * (batch->velocityY[i] + w * areaX - m_velocity.y);
+
+		batch->forceX[i] += buoyancyX + dragX;
+		batch->forceY[i] += buoyancyY + dragY;
+		batch->torque[i] += massX * buoyancyY - massY * buoyancyX + areaX * dragY - areaY * dragX;
+
+		if (batch->mass[i] > 0.0f)
+		{
+			batch->torque[i] -= batch->inertia[i] / batch->mass[i] * area * w * m_angularDrag;
+		}
+	}
+
+	allocator->Free(sums);
+}
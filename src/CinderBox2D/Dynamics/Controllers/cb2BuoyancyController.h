@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_BUOYANCY_CONTROLLER_H
+#define CB2_BUOYANCY_CONTROLLER_H
+
+#include <CinderBox2D/Dynamics/Controllers/cb2Controller.h>
+
+class cb2Shape;
+
+/// Buoyancy controller definition. The fluid fills the half plane
+/// dot(normal, p) < offset.
+struct cb2BuoyancyControllerDef : public cb2ControllerDef
+{
+	cb2BuoyancyControllerDef()
+	{
+		type = e_buoyancyController;
+		normal.set(0.0f, 1.0f);
+		offset = 0.0f;
+		density = 0.0f;
+		velocity.set(0.0f, 0.0f);
+		linearDrag = 0.0f;
+		angularDrag = 0.0f;
+		useDensity = false;
+		useWorldGravity = true;
+		gravity.set(0.0f, 0.0f);
+	}
+
+	/// The outer surface normal of the fluid, pointing up out of it.
+	ci::Vec2f normal;
+
+	/// The height of the surface along the normal.
+	float offset;
+
+	/// The fluid density in kg/m^2.
+	float density;
+
+	/// The fluid velocity, for drag and currents.
+	ci::Vec2f velocity;
+
+	/// Linear drag coefficient, per unit submerged area.
+	float linearDrag;
+
+	/// Angular drag coefficient, per unit submerged area.
+	float angularDrag;
+
+	/// Push on the center of the submerged mass rather than of the submerged area,
+	/// using the fixture densities. This makes denser parts sink lower.
+	bool useDensity;
+
+	/// Use the gravity of the world, otherwise the gravity below.
+	bool useWorldGravity;
+	ci::Vec2f gravity;
+};
+
+/// Pushes bodies out of a fluid by the weight of the fluid their fixtures displace,
+/// and drags them along with the fluid. Circles and polygons are exact, capsules are
+/// approximated by a polygon of the same area. Edges, chains and heightfields float.
+class cb2BuoyancyController : public cb2Controller
+{
+public:
+
+	/// Set the surface of the fluid.
+	void SetSurface(const ci::Vec2f& normal, float offset);
+	const ci::Vec2f& GetNormal() const { return m_normal; }
+	float GetOffset() const { return m_offset; }
+
+	/// Set the fluid density.
+	void SetDensity(float density) { m_density = density; }
+	float GetDensity() const { return m_density; }
+
+	/// Set the fluid velocity.
+	void SetVelocity(const ci::Vec2f& velocity) { m_velocity = velocity; }
+	const ci::Vec2f& GetVelocity() const { return m_velocity; }
+
+	/// Set the drag coefficients.
+	void SetLinearDrag(float drag) { m_linearDrag = drag; }
+	float GetLinearDrag() const { return m_linearDrag; }
+	void SetAngularDrag(float drag) { m_angularDrag = drag; }
+	float GetAngularDrag() const { return m_angularDrag; }
+
+	/// Compute the area of a shape child below the surface and its centroid.
+	/// @return the submerged area.
+	static float ComputeSubmergedArea(const cb2Shape* shape, int childIndex, const ci::Vec2f& normal,
+									float offset, const cb2Transform& xf, ci::Vec2f* centroid);
+
+protected:
+
+	friend class cb2Controller;
+
+	cb2BuoyancyController(const cb2BuoyancyControllerDef* def);
+
+	void Apply(cb2ControllerBatch* batch);
+
+	ci::Vec2f m_normal;
+	float m_offset;
+	float m_density;
+	ci::Vec2f m_velocity;
+	float m_linearDrag;
+	float m_angularDrag;
+	bool m_useDensity;
+	bool m_useWorldGravity;
+	ci::Vec2f m_gravity;
+};
+
+inline void cb2BuoyancyController::SetSurface(const ci::Vec2f& normal, float offset)
+{
+	m_normal = normal;
+	m_offset = offset;
+}
+
+#endif
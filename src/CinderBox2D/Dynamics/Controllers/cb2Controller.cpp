@@ -0,0 +1,94 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/Controllers/cb2Controller.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2BuoyancyController.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2WindController.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2RadialGravityController.h>
+#include <CinderBox2D/Common/cb2BlockAllocator.h>
+
+#include <new>
+
+cb2Controller* cb2Controller::Create(const cb2ControllerDef* def, cb2BlockAllocator* allocator)
+{
+	cb2Controller* controller = NULL;
+
+	switch (def->type)
+	{
+	case e_buoyancyController:
+		{
+			void* mem = allocator->Allocate(sizeof(cb2BuoyancyController));
+			controller = new (mem) cb2BuoyancyController(static_cast<const cb2BuoyancyControllerDef*>(def));
+		}
+		break;
+
+	case e_windController:
+		{
+			void* mem = allocator->Allocate(sizeof(cb2WindController));
+			controller = new (mem) cb2WindController(static_cast<const cb2WindControllerDef*>(def));
+		}
+		break;
+
+	case e_radialGravityController:
+		{
+			void* mem = allocator->Allocate(sizeof(cb2RadialGravityController));
+			controller = new (mem) cb2RadialGravityController(static_cast<const cb2RadialGravityControllerDef*>(def));
+		}
+		break;
+
+	default:
+		cb2Assert(false);
+		break;
+	}
+
+	return controller;
+}
+
+void cb2Controller::Destroy(cb2Controller* controller, cb2BlockAllocator* allocator)
+{
+	controller->~cb2Controller();
+	switch (controller->m_type)
+	{
+	case e_buoyancyController:
+		allocator->Free(controller, sizeof(cb2BuoyancyController));
+		break;
+
+	case e_windController:
+		allocator->Free(controller, sizeof(cb2WindController));
+		break;
+
+	case e_radialGravityController:
+		allocator->Free(controller, sizeof(cb2RadialGravityController));
+		break;
+
+	default:
+		cb2Assert(false);
+		break;
+	}
+}
+
+cb2Controller::cb2Controller(const cb2ControllerDef* def)
+{
+	m_type = def->type;
+	m_prev = NULL;
+	m_next = NULL;
+	m_useRegion = def->useRegion;
+	m_region = def->region;
+	m_maskBits = def->maskBits;
+	m_userData = def->userData;
+}
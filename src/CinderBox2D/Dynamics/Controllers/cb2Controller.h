@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_CONTROLLER_H
+#define CB2_CONTROLLER_H
+
+#include <CinderBox2D/Collision/cb2Collision.h>
+
+class cb2Body;
+class cb2Fixture;
+class cb2Controller;
+class cb2World;
+class cb2BlockAllocator;
+class cb2StackAllocator;
+
+enum cb2ControllerType
+{
+	e_unknownController,
+	e_buoyancyController,
+	e_windController,
+	e_radialGravityController
+};
+
+/// The awake dynamic bodies a controller acts on in a step, gathered by the world.
+/// The body state is kept as separate arrays of floats so force fields can be
+/// evaluated in tight loops. Controllers add to the force and torque arrays, which
+/// the world then adds to the bodies without waking them.
+struct cb2ControllerBatch
+{
+	int bodyCount;
+	cb2Body** bodies;
+
+	/// The center of mass, velocity, mass and rotational inertia about the center of
+	/// mass of each body.
+	float* centerX;
+	float* centerY;
+	float* velocityX;
+	float* velocityY;
+	float* angularVelocity;
+	float* mass;
+	float* inertia;
+
+	/// The accumulated forces and torques, zero before the first controller.
+	float* forceX;
+	float* forceY;
+	float* torque;
+
+	/// The fixtures in the region of the controller that pass its mask, with the
+	/// index of their body in the arrays above.
+	int fixtureCount;
+	cb2Fixture** fixtures;
+	int* fixtureBodies;
+
+	ci::Vec2f gravity;
+	float dt;
+
+	/// Scratch memory for the controllers, free it in reverse order.
+	cb2StackAllocator* allocator;
+};
+
+/// Controller definitions are used to construct controllers.
+struct cb2ControllerDef
+{
+	cb2ControllerDef()
+	{
+		type = e_unknownController;
+		userData = NULL;
+		useRegion = false;
+		maskBits = 0xFFFF;
+	}
+
+	/// The controller type is set automatically for concrete controller types.
+	cb2ControllerType type;
+
+	/// Use this to attach application specific data to your controllers.
+	void* userData;
+
+	/// Only act on fixtures whose fat AABB overlaps the region, found with a
+	/// broad-phase query. Otherwise the controller acts on all awake bodies.
+	bool useRegion;
+	cb2AABB region;
+
+	/// Only act on fixtures whose category bits overlap these bits.
+	unsigned short maskBits;
+};
+
+/// A controller applies a force field, like buoyancy or wind, to the awake dynamic
+/// bodies in a region. Controllers run in cb2World::Step before the bodies are
+/// integrated, their forces are cleared with the other forces after the step.
+/// Controllers never wake bodies.
+class cb2Controller
+{
+public:
+
+	/// Get the type of the concrete controller.
+	cb2ControllerType GetType() const;
+
+	/// Get the next controller in the world controller list.
+	cb2Controller* GetNext();
+	const cb2Controller* GetNext() const;
+
+	/// Get the user data pointer.
+	void* GetUserData() const;
+
+	/// Set the user data pointer.
+	void SetUserData(void* data);
+
+	/// Limit the controller to the fixtures overlapping a region.
+	void SetRegion(const cb2AABB& region);
+
+	/// Act on all awake bodies again.
+	void ClearRegion();
+
+	/// Get the region, valid if HasRegion.
+	const cb2AABB& GetRegion() const;
+	bool HasRegion() const;
+
+	/// Set the bits the fixture categories are masked with.
+	void SetMaskBits(unsigned short maskBits);
+	unsigned short GetMaskBits() const;
+
+protected:
+	friend class cb2World;
+
+	static cb2Controller* Create(const cb2ControllerDef* def, cb2BlockAllocator* allocator);
+	static void Destroy(cb2Controller* controller, cb2BlockAllocator* allocator);
+
+	cb2Controller(const cb2ControllerDef* def);
+	virtual ~cb2Controller() {}
+
+	/// Add the forces of the field to the batch.
+	virtual void Apply(cb2ControllerBatch* batch) = 0;
+
+	cb2ControllerType m_type;
+	cb2Controller* m_prev;
+	cb2Controller* m_next;
+
+	bool m_useRegion;
+	cb2AABB m_region;
+	unsigned short m_maskBits;
+
+	void* m_userData;
+};
+
+inline cb2ControllerType cb2Controller::GetType() const
+{
+	return m_type;
+}
+
+inline cb2Controller* cb2Controller::GetNext()
+{
+	return m_next;
+}
+
+inline const cb2Controller* cb2Controller::GetNext() const
+{
+	return m_next;
+}
+
+inline void* cb2Controller::GetUserData() const
+{
+	return m_userData;
+}
+
+inline void cb2Controller::SetUserData(void* data)
+{
+	m_userData = data;
+}
+
+inline void cb2Controller::SetRegion(const cb2AABB& region)
+{
+	m_region = region;
+	m_useRegion = true;
+}
+
+inline void cb2Controller::ClearRegion()
+{
+	m_useRegion = false;
+}
+
+inline const cb2AABB& cb2Controller::GetRegion() const
+{
+	return m_region;
+}
+
+inline bool cb2Controller::HasRegion() const
+{
+	return m_useRegion;
+}
+
+inline void cb2Controller::SetMaskBits(unsigned short maskBits)
+{
+	m_maskBits = maskBits;
+}
+
+inline unsigned short cb2Controller::GetMaskBits() const
+{
+	return m_maskBits;
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/Controllers/cb2RadialGravityController.h>
+
+cb2RadialGravityController::cb2RadialGravityController(const cb2RadialGravityControllerDef* def)
+: cb2Controller(def)
+{
+	m_center = def->center;
+	m_strength = def->strength;
+	m_minRadius = def->minRadius;
+}
+
+void cb2RadialGravityController::Apply(cb2ControllerBatch* batch)
+{
+	float cx = m_center.x;
+	float cy = m_center.y;
+	float strength = m_strength;
+	float minRadiusSqr = cb2Max(m_minRadius * m_minRadius, cb2_epsilon);
+
+	const float* centerX = batch->centerX;
+	const float* centerY = batch->centerY;
+	const float* mass = batch->mass;
+	float* forceX = batch->forceX;
+	float* forceY = batch->forceY;
+
+	// Clamping the squared distance gives strength * d / minRadius^3 inside the
+	// minimum radius, which falls off linearly to the center.
+	int count = batch->bodyCount;
+	for (int i = 0; i < count; ++i)
+	{
+		float dx = cx - centerX[i];
+		float dy = cy - centerY[i];
+		float distanceSqr = cb2Max(dx * dx + dy * dy, minRadiusSqr);
+		float k = strength * mass[i] / (distanceSqr * cb2Sqrt(distanceSqr));
+		forceX[i] += k * dx;
+		forceY[i] += k * dy;
+	}
+}
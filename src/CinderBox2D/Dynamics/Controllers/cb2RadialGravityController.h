@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_RADIAL_GRAVITY_CONTROLLER_H
+#define CB2_RADIAL_GRAVITY_CONTROLLER_H
+
+#include <CinderBox2D/Dynamics/Controllers/cb2Controller.h>
+
+/// Radial gravity controller definition.
+struct cb2RadialGravityControllerDef : public cb2ControllerDef
+{
+	cb2RadialGravityControllerDef()
+	{
+		type = e_radialGravityController;
+		center.set(0.0f, 0.0f);
+		strength = 0.0f;
+		minRadius = 1.0f;
+	}
+
+	/// The attracting point in world coordinates.
+	ci::Vec2f center;
+
+	/// The gravitational parameter in m^3/s^2, the acceleration at one meter.
+	/// Negative values repel.
+	float strength;
+
+	/// Inside this radius the acceleration falls off linearly to zero at the
+	/// center, like inside a uniform planet.
+	float minRadius;
+};
+
+/// Accelerates bodies towards a point with the inverse square of their distance,
+/// for planets and vortices.
+class cb2RadialGravityController : public cb2Controller
+{
+public:
+
+	/// Set the attracting point.
+	void SetCenter(const ci::Vec2f& center) { m_center = center; }
+	const ci::Vec2f& GetCenter() const { return m_center; }
+
+	/// Set the gravitational parameter.
+	void SetStrength(float strength) { m_strength = strength; }
+	float GetStrength() const { return m_strength; }
+
+	/// Set the radius inside which the acceleration falls off.
+	void SetMinRadius(float radius) { m_minRadius = radius; }
+	float GetMinRadius() const { return m_minRadius; }
+
+protected:
+
+	friend class cb2Controller;
+
+	cb2RadialGravityController(const cb2RadialGravityControllerDef* def);
+
+	void Apply(cb2ControllerBatch* batch);
+
+	ci::Vec2f m_center;
+	float m_strength;
+	float m_minRadius;
+};
+
+#endif
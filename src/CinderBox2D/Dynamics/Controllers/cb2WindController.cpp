@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/Controllers/cb2WindController.h>
+
+cb2WindController::cb2WindController(const cb2WindControllerDef* def)
+: cb2Controller(def)
+{
+	m_velocity = def->velocity;
+	m_drag = def->drag;
+}
+
+void cb2WindController::Apply(cb2ControllerBatch* batch)
+{
+	float windX = m_velocity.x;
+	float windY = m_velocity.y;
+	float drag = m_drag;
+
+	const float* velocityX = batch->velocityX;
+	const float* velocityY = batch->velocityY;
+	const float* mass = batch->mass;
+	float* forceX = batch->forceX;
+	float* forceY = batch->forceY;
+
+	int count = batch->bodyCount;
+	for (int i = 0; i < count; ++i)
+	{
+		float k = drag * mass[i];
+		forceX[i] += k * (windX - velocityX[i]);
+		forceY[i] += k * (windY - velocityY[i]);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_WIND_CONTROLLER_H
+#define CB2_WIND_CONTROLLER_H
+
+#include <CinderBox2D/Dynamics/Controllers/cb2Controller.h>
+
+/// Wind controller definition.
+struct cb2WindControllerDef : public cb2ControllerDef
+{
+	cb2WindControllerDef()
+	{
+		type = e_windController;
+		velocity.set(0.0f, 0.0f);
+		drag = 1.0f;
+	}
+
+	/// The velocity of the air in meters per second.
+	ci::Vec2f velocity;
+
+	/// How fast bodies take on the velocity of the air, in 1/s. The force is the
+	/// mass times the drag times the velocity relative to the air, so all bodies
+	/// drift alike. Keep it well below the step rate.
+	float drag;
+};
+
+/// Pulls the velocity of bodies towards the velocity of the air, for wind or
+/// currents. With a zero velocity it is a regional linear damping.
+class cb2WindController : public cb2Controller
+{
+public:
+
+	/// Set the velocity of the air.
+	void SetVelocity(const ci::Vec2f& velocity) { m_velocity = velocity; }
+	const ci::Vec2f& GetVelocity() const { return m_velocity; }
+
+	/// Set the drag rate.
+	void SetDrag(float drag) { m_drag = drag; }
+	float GetDrag() const { return m_drag; }
+
+protected:
+
+	friend class cb2Controller;
+
+	cb2WindController(const cb2WindControllerDef* def);
+
+	void Apply(cb2ControllerBatch* batch);
+
+	ci::Vec2f m_velocity;
+	float m_drag;
+};
+
+#endif
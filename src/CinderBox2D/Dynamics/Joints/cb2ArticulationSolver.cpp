@@ -0,0 +1,366 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/Joints/cb2ArticulationSolver.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RevoluteJoint.h>
+#include <CinderBox2D/Common/cb2StackAllocator.h>
+
+// The rows of the jacobian of a point constraint on one body, the velocity of the
+// anchor is sign * (v + w x r).
+static inline void cb2PointJacobian(ci::Vec3f* jacobian, float sign, const ci::Vec2f& r)
+{
+	jacobian[0] = ci::Vec3f(sign, 0.0f, -sign * r.y);
+	jacobian[1] = ci::Vec3f(0.0f, sign, sign * r.x);
+}
+
+// The jacobian times a symmetric 3 by 3 matrix given by rows.
+static inline void cb2MulJacobian(ci::Vec3f* out, const ci::Vec3f* jacobian, const ci::Vec3f* m)
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		out[i] = jacobian[i].x * m[0] + jacobian[i].y * m[1] + jacobian[i].z * m[2];
+	}
+}
+
+static inline ci::Vec2f cb2MulJacobian(const ci::Vec3f* jacobian, const ci::Vec3f& v)
+{
+	return ci::Vec2f(cb2Dot(jacobian[0], v), cb2Dot(jacobian[1], v));
+}
+
+cb2ArticulationSolver::cb2ArticulationSolver(cb2RevoluteConstraint* constraints, int count, int bodyCount,
+											cb2StackAllocator* allocator)
+{
+	m_allocator = allocator;
+	m_constraints = constraints;
+	m_bodyCount = bodyCount;
+	m_bodies = (cb2ArticulationBody*)m_allocator->Allocate(bodyCount * sizeof(cb2ArticulationBody));
+	m_order = (int*)m_allocator->Allocate(bodyCount * sizeof(int));
+	m_rows = (cb2ArticulationRow*)m_allocator->Allocate(count * sizeof(cb2ArticulationRow));
+	m_orderCount = 0;
+	m_rowCount = 0;
+
+	// The joints between two moving bodies that join two trees, and the joints
+	// holding one moving body to one that does not move.
+	int* sets = (int*)m_allocator->Allocate(bodyCount * sizeof(int));
+	int* rowStarts = (int*)m_allocator->Allocate((bodyCount + 1) * sizeof(int));
+	int* links = (int*)m_allocator->Allocate(2 * count * sizeof(int));
+	int* parentRows = (int*)m_allocator->Allocate(bodyCount * sizeof(int));
+	bool* accepted = (bool*)m_allocator->Allocate(count * sizeof(bool));
+
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		sets[i] = i;
+		rowStarts[i] = 0;
+		parentRows[i] = -2;
+	}
+	rowStarts[bodyCount] = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		const cb2RevoluteConstraint* c = constraints + i;
+		bool movesA = c->invMassA > 0.0f || c->invIA > 0.0f;
+		bool movesB = c->invMassB > 0.0f || c->invIB > 0.0f;
+		accepted[i] = false;
+
+		if (movesA && movesB)
+		{
+			int rootA = c->indexA;
+			while (sets[rootA] != rootA)
+			{
+				sets[rootA] = sets[sets[rootA]];
+				rootA = sets[rootA];
+			}
+
+			int rootB = c->indexB;
+			while (sets[rootB] != rootB)
+			{
+				sets[rootB] = sets[sets[rootB]];
+				rootB = sets[rootB];
+			}
+
+			if (rootA == rootB)
+			{
+				// A loop, this joint only iterates.
+				continue;
+			}
+
+			sets[rootA] = rootB;
+			++rowStarts[c->indexA + 1];
+			++rowStarts[c->indexB + 1];
+			accepted[i] = true;
+		}
+		else if (movesA || movesB)
+		{
+			++rowStarts[(movesA ? c->indexA : c->indexB) + 1];
+			accepted[i] = true;
+		}
+
+		if (accepted[i])
+		{
+			int index = movesA ? c->indexA : c->indexB;
+			m_bodies[index].invMass = movesA ? c->invMassA : c->invMassB;
+			m_bodies[index].invI = movesA ? c->invIA : c->invIB;
+			if (movesA && movesB)
+			{
+				m_bodies[c->indexB].invMass = c->invMassB;
+				m_bodies[c->indexB].invI = c->invIB;
+			}
+		}
+	}
+
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		rowStarts[i + 1] += rowStarts[i];
+	}
+
+	// The joints of each moving body, rowStarts ends up shifted by one body.
+	for (int i = 0; i < count; ++i)
+	{
+		if (accepted[i] == false)
+		{
+			continue;
+		}
+
+		const cb2RevoluteConstraint* c = constraints + i;
+		if (c->invMassA > 0.0f || c->invIA > 0.0f)
+		{
+			links[rowStarts[c->indexA]++] = i;
+		}
+		if (c->invMassB > 0.0f || c->invIB > 0.0f)
+		{
+			links[rowStarts[c->indexB]++] = i;
+		}
+	}
+
+	// Walk each tree from any of its bodies. A body owns the rows to its children
+	// and to the bodies that do not move, one after the other.
+	for (int root = 0; root < bodyCount; ++root)
+	{
+		int rootStart = root > 0 ? rowStarts[root - 1] : 0;
+		if (parentRows[root] != -2 || rootStart == rowStarts[root])
+		{
+			continue;
+		}
+
+		parentRows[root] = -1;
+		int head = m_orderCount;
+		m_order[m_orderCount++] = root;
+
+		while (head < m_orderCount)
+		{
+			int index = m_order[head++];
+			cb2ArticulationBody* body = m_bodies + index;
+			body->rowStart = m_rowCount;
+
+			int start = index > 0 ? rowStarts[index - 1] : 0;
+			for (int j = start; j < rowStarts[index]; ++j)
+			{
+				int constraintIndex = links[j];
+				if (constraintIndex == parentRows[index])
+				{
+					continue;
+				}
+
+				const cb2RevoluteConstraint* c = constraints + constraintIndex;
+				cb2ArticulationRow* row = m_rows + m_rowCount++;
+				row->constraint = constraintIndex;
+				row->owner = index;
+				row->ownerIsA = c->indexA == index;
+				row->other = row->ownerIsA ? c->indexB : c->indexA;
+				row->otherMoves = row->ownerIsA ? (c->invMassB > 0.0f || c->invIB > 0.0f) :
+												(c->invMassA > 0.0f || c->invIA > 0.0f);
+
+				if (row->otherMoves)
+				{
+					cb2Assert(parentRows[row->other] == -2);
+					parentRows[row->other] = constraintIndex;
+					m_order[m_orderCount++] = row->other;
+				}
+			}
+
+			body->rowCount = m_rowCount - body->rowStart;
+		}
+	}
+
+	m_allocator->Free(accepted);
+	m_allocator->Free(parentRows);
+	m_allocator->Free(links);
+	m_allocator->Free(rowStarts);
+	m_allocator->Free(sets);
+}
+
+cb2ArticulationSolver::~cb2ArticulationSolver()
+{
+	m_allocator->Free(m_rows);
+	m_allocator->Free(m_order);
+	m_allocator->Free(m_bodies);
+}
+
+void cb2ArticulationSolver::SetJacobian(cb2ArticulationRow* row, const ci::Vec2f& rA, const ci::Vec2f& rB)
+{
+	if (row->ownerIsA)
+	{
+		cb2PointJacobian(row->jacobian, -1.0f, rA);
+		cb2PointJacobian(row->otherJacobian, 1.0f, rB);
+	}
+	else
+	{
+		cb2PointJacobian(row->jacobian, 1.0f, rB);
+		cb2PointJacobian(row->otherJacobian, -1.0f, rA);
+	}
+}
+
+// Fold the rows into their owners, leaves first, then hand the impulses down from
+// the roots. A row sees the owner as it is with the rows folded before it, the
+// impulses of the later rows and of the parent reach it through jw.
+void cb2ArticulationSolver::Solve()
+{
+	for (int k = m_orderCount - 1; k >= 0; --k)
+	{
+		cb2ArticulationBody* body = m_bodies + m_order[k];
+		body->response[0] = ci::Vec3f(body->invMass, 0.0f, 0.0f);
+		body->response[1] = ci::Vec3f(0.0f, body->invMass, 0.0f);
+		body->response[2] = ci::Vec3f(0.0f, 0.0f, body->invI);
+		body->impulse = ci::Vec3f(0.0f, 0.0f, 0.0f);
+
+		for (int j = 0; j < body->rowCount; ++j)
+		{
+			cb2ArticulationRow* row = m_rows + body->rowStart + j;
+
+			ci::Vec2f rhs = cb2MulJacobian(row->jacobian, body->velocity) + row->bias;
+			float k00 = 0.0f, k01 = 0.0f, k11 = 0.0f;
+			if (row->otherMoves)
+			{
+				const cb2ArticulationBody* other = m_bodies + row->other;
+				ci::Vec3f otherJw[2];
+				cb2MulJacobian(otherJw, row->otherJacobian, other->response);
+				k00 = cb2Dot(otherJw[0], row->otherJacobian[0]);
+				k01 = cb2Dot(otherJw[0], row->otherJacobian[1]);
+				k11 = cb2Dot(otherJw[1], row->otherJacobian[1]);
+				rhs += cb2MulJacobian(row->otherJacobian, other->velocity);
+			}
+
+			ci::Vec3f* jw = row->jw;
+			cb2MulJacobian(jw, row->jacobian, body->response);
+			k00 += cb2Dot(jw[0], row->jacobian[0]);
+			k01 += cb2Dot(jw[0], row->jacobian[1]);
+			k11 += cb2Dot(jw[1], row->jacobian[1]);
+
+			// Rows that repeat others, like two pins on one body, are softened.
+			float trace = k00 + k11;
+			float det = k00 * k11 - k01 * k01;
+			if (det <= cb2_articulationConditioning * trace * trace)
+			{
+				float softness = cb2_articulationSoftness * trace;
+				k00 += softness;
+				k11 += softness;
+				det = k00 * k11 - k01 * k01;
+			}
+
+			if (det > 0.0f)
+			{
+				det = 1.0f / det;
+			}
+			row->invK[0] = det * k11;
+			row->invK[1] = -det * k01;
+			row->invK[2] = det * k00;
+
+			row->freeImpulse.x = -(row->invK[0] * rhs.x + row->invK[1] * rhs.y);
+			row->freeImpulse.y = -(row->invK[1] * rhs.x + row->invK[2] * rhs.y);
+			body->velocity += row->freeImpulse.x * jw[0] + row->freeImpulse.y * jw[1];
+
+			// response -= jw^T * invK * jw
+			ci::Vec3f t0 = row->invK[0] * jw[0] + row->invK[1] * jw[1];
+			ci::Vec3f t1 = row->invK[1] * jw[0] + row->invK[2] * jw[1];
+			body->response[0] -= jw[0].x * t0 + jw[1].x * t1;
+			body->response[1] -= jw[0].y * t0 + jw[1].y * t1;
+			body->response[2] -= jw[0].z * t0 + jw[1].z * t1;
+		}
+	}
+
+	for (int k = 0; k < m_orderCount; ++k)
+	{
+		cb2ArticulationBody* body = m_bodies + m_order[k];
+		ci::Vec3f impulse = body->impulse;
+		body->velocity.x += cb2Dot(body->response[0], impulse);
+		body->velocity.y += cb2Dot(body->response[1], impulse);
+		body->velocity.z += cb2Dot(body->response[2], impulse);
+
+		for (int j = body->rowCount - 1; j >= 0; --j)
+		{
+			cb2ArticulationRow* row = m_rows + body->rowStart + j;
+			ci::Vec2f outside = cb2MulJacobian(row->jw, impulse);
+			row->impulse.x = row->freeImpulse.x - (row->invK[0] * outside.x + row->invK[1] * outside.y);
+			row->impulse.y = row->freeImpulse.y - (row->invK[1] * outside.x + row->invK[2] * outside.y);
+			impulse += row->impulse.x * row->jacobian[0] + row->impulse.y * row->jacobian[1];
+
+			if (row->otherMoves)
+			{
+				m_bodies[row->other].impulse = row->impulse.x * row->otherJacobian[0] + row->impulse.y * row->otherJacobian[1];
+			}
+		}
+	}
+}
+
+void cb2ArticulationSolver::SolveVelocityConstraints(const cb2SolverData& data)
+{
+	if (m_rowCount == 0)
+	{
+		return;
+	}
+
+	for (int k = 0; k < m_orderCount; ++k)
+	{
+		int index = m_order[k];
+		const cb2Velocity& v = data.velocities[index];
+		m_bodies[index].velocity = ci::Vec3f(v.v.x, v.v.y, v.w);
+	}
+
+	for (int i = 0; i < m_rowCount; ++i)
+	{
+		cb2ArticulationRow* row = m_rows + i;
+		const cb2RevoluteConstraint* c = m_constraints + row->constraint;
+		SetJacobian(row, c->rA, c->rB);
+
+		row->bias = ci::Vec2f(0.0f, 0.0f);
+		if (row->otherMoves == false)
+		{
+			const cb2Velocity& v = data.velocities[row->other];
+			row->bias = cb2MulJacobian(row->otherJacobian, ci::Vec3f(v.v.x, v.v.y, v.w));
+		}
+	}
+
+	Solve();
+
+	for (int k = 0; k < m_orderCount; ++k)
+	{
+		int index = m_order[k];
+		const ci::Vec3f& v = m_bodies[index].velocity;
+		data.velocities[index].v = ci::Vec2f(v.x, v.y);
+		data.velocities[index].w = v.z;
+	}
+
+	for (int i = 0; i < m_rowCount; ++i)
+	{
+		const cb2ArticulationRow* row = m_rows + i;
+		cb2RevoluteConstraint* c = m_constraints + row->constraint;
+		c->impulse.x += row->impulse.x;
+		c->impulse.y += row->impulse.y;
+	}
+}
@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_ARTICULATION_SOLVER_H
+#define CB2_ARTICULATION_SOLVER_H
+
+#include <CinderBox2D/Dynamics/cb2TimeStep.h>
+
+class cb2StackAllocator;
+struct cb2RevoluteConstraint;
+
+/// A body of an articulation, with the response of its subtree folded in.
+struct cb2ArticulationBody
+{
+	ci::Vec3f response[3];	// articulated inverse mass, symmetric, by rows
+	ci::Vec3f velocity;		// velocity with the subtree's rows satisfied
+	ci::Vec3f impulse;		// from the row to the parent, found on the way down
+	float invMass;
+	float invI;
+	int rowStart;
+	int rowCount;
+};
+
+/// The point constraint of a revolute joint, folded into the owner body. The
+/// other body is a child of the owner, or one that does not move.
+struct cb2ArticulationRow
+{
+	int constraint;
+	int owner;
+	int other;
+	bool otherMoves;
+	bool ownerIsA;
+	ci::Vec3f jacobian[2];		// of the owner
+	ci::Vec3f otherJacobian[2];
+	ci::Vec3f jw[2];			// jacobian times the owner's inverse mass before the fold
+	float invK[3];				// the inverse effective mass, 00 01 11
+	ci::Vec2f freeImpulse;		// the impulse without outside impulses on the owner
+	ci::Vec2f impulse;
+	ci::Vec2f bias;
+};
+
+/// Solves the point constraints of the revolute joints of an island exactly, in
+/// linear time. The joints whose moving bodies form a forest are taken, a joint
+/// that would close a loop stays with the iterative solver alone. Each tree is
+/// solved by folding the response of every subtree into its root body, leaves
+/// first, and handing the impulses back down (articulated inverse mass in
+/// maximal coordinates). This is a sparse LDLt of the joint graph without fill.
+/// Limits, motors and the other joints still come from the iterations, the
+/// direct pass follows them so that chains and ragdolls do not stretch however
+/// few iterations the world runs. Position errors stay with the iterations: the
+/// mass weighted projection of a whole tree turns light links far, beyond what
+/// the linearization holds.
+class cb2ArticulationSolver
+{
+public:
+	cb2ArticulationSolver(cb2RevoluteConstraint* constraints, int count, int bodyCount, cb2StackAllocator* allocator);
+	~cb2ArticulationSolver();
+
+	/// Remove the point velocity errors of the joints. The impulses are added to
+	/// the accumulated joint impulses.
+	void SolveVelocityConstraints(const cb2SolverData& data);
+
+	/// The number of joints solved directly.
+	int GetRowCount() const { return m_rowCount; }
+
+private:
+
+	void SetJacobian(cb2ArticulationRow* row, const ci::Vec2f& rA, const ci::Vec2f& rB);
+	void Solve();
+
+	cb2StackAllocator* m_allocator;
+	cb2RevoluteConstraint* m_constraints;
+
+	cb2ArticulationBody* m_bodies;
+	int m_bodyCount;
+
+	// Parents come before their children.
+	int* m_order;
+	int m_orderCount;
+
+	cb2ArticulationRow* m_rows;
+	int m_rowCount;
+};
+
+#endif
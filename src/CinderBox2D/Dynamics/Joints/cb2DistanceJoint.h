@@ -104,12 +104,15 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 	cb2DistanceJoint(const cb2DistanceJointDef* data);
 
 	void InitVelocityConstraints(const cb2SolverData& data);
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	float m_frequencyHz;
 	float m_dampingRatio;
 	float m_bias;
@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2FrictionJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Point-to-point constraint
 // Cdot = v2 - v1
@@ -243,9 +244,21 @@ void cb2FrictionJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.localAnchorA.set(%.15lef, %.15lef);\n", m_localAnchorA.x, m_localAnchorA.y);
 	cb2Log("  jd.localAnchorB.set(%.15lef, %.15lef);\n", m_localAnchorB.x, m_localAnchorB.y);
 	cb2Log("  jd.maxForce = %.15lef;\n", m_maxForce);
 	cb2Log("  jd.maxTorque = %.15lef;\n", m_maxTorque);
 	cb2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void cb2FrictionJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_localAnchorA);
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_linearImpulse);
+	snapshot->Transfer(m_angularImpulse);
+	snapshot->Transfer(m_maxForce);
+	snapshot->Transfer(m_maxTorque);
+}
@@ -83,6 +83,7 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 
 	cb2FrictionJoint(const cb2FrictionJointDef* def);
 
@@ -90,6 +91,8 @@ protected:
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	ci::Vec2f m_localAnchorA;
 	ci::Vec2f m_localAnchorB;
 
@@ -21,6 +21,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2PrismaticJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Gear Joint:
 // C0 = (coordinate1 + ratio * coordinate2)_initial
@@ -410,8 +411,25 @@ void cb2GearJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.joint1 = joints[%d];\n", index1);
 	cb2Log("  jd.joint2 = joints[%d];\n", index2);
 	cb2Log("  jd.ratio = %.15lef;\n", m_ratio);
 	cb2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void cb2GearJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_localAnchorA);
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_localAnchorC);
+	snapshot->Transfer(m_localAnchorD);
+	snapshot->Transfer(m_localAxisC);
+	snapshot->Transfer(m_localAxisD);
+	snapshot->Transfer(m_referenceAngleA);
+	snapshot->Transfer(m_referenceAngleB);
+	snapshot->Transfer(m_constant);
+	snapshot->Transfer(m_ratio);
+	snapshot->Transfer(m_impulse);
+}
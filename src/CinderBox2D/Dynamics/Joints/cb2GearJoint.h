@@ -78,12 +78,15 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 	cb2GearJoint(const cb2GearJointDef* data);
 
 	void InitVelocityConstraints(const cb2SolverData& data);
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	cb2Joint* m_joint1;
 	cb2Joint* m_joint2;
 
@@ -189,10 +189,16 @@ cb2Joint::cb2Joint(const cb2JointDef* def)
 	m_next = NULL;
 	m_bodyA = def->bodyA;
 	m_bodyB = def->bodyB;
+	m_island = NULL;
+	m_islandPrev = NULL;
+	m_islandNext = NULL;
 	m_index = 0;
 	m_collideConnected = def->collideConnected;
+	m_breakForce = def->breakForce;
+	m_breakTorque = def->breakTorque;
 	m_islandFlag = false;
 	m_userData = def->userData;
+	m_handle = cb2_nullHandle;
 
 	m_edgeA.joint = NULL;
 	m_edgeA.other = NULL;
@@ -20,11 +20,14 @@
 #define CB2_JOINT_H
 
 #include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
 
 class cb2Body;
 class cb2Joint;
 struct cb2SolverData;
+struct cb2PersistentIsland;
 class cb2BlockAllocator;
+class cb2Snapshot;
 
 enum cb2JointType
 {
@@ -80,6 +83,8 @@ struct cb2JointDef
 		bodyA = NULL;
 		bodyB = NULL;
 		collideConnected = false;
+		breakForce = cb2_maxFloat;
+		breakTorque = cb2_maxFloat;
 	}
 
 	/// The joint type is set automatically for concrete joint types.
@@ -96,6 +101,15 @@ struct cb2JointDef
 
 	/// set this flag to true if the attached bodies should collide.
 	bool collideConnected;
+
+	/// The joint breaks when its reaction force exceeds this, in Newtons. The solver
+	/// checks after the velocity iterations and the step destroys broken joints,
+	/// calling cb2DestructionListener::SayGoodbye and reporting them with
+	/// cb2World::GetJointBreakEvents. Joints used by a gear joint must not break.
+	float breakForce;
+
+	/// The joint breaks when its reaction torque exceeds this, in N*m.
+	float breakTorque;
 };
 
 /// The base joint class. Joints are used to constraint two bodies together in
@@ -135,9 +149,21 @@ public:
 	/// set the user data pointer.
 	void SetUserData(void* data);
 
+	/// Get the handle of this joint, it resolves through cb2World::GetJoint
+	/// until the joint is destroyed.
+	cb2Handle GetHandle() const;
+
 	/// Short-cut function to determine if either body is inactive.
 	bool IsActive() const;
 
+	/// Get or set the reaction force above which the joint breaks.
+	float GetBreakForce() const;
+	void SetBreakForce(float force);
+
+	/// Get or set the reaction torque above which the joint breaks.
+	float GetBreakTorque() const;
+	void SetBreakTorque(float torque);
+
 	/// Get collide connected.
 	/// Note: modifying the collide connect flag won't work correctly because
 	/// the flag is only checked when fixture AABBs begin to overlap.
@@ -154,6 +180,7 @@ protected:
 	friend class cb2Body;
 	friend class cb2Island;
 	friend class cb2GearJoint;
+	friend class cb2JointSolver;
 
 	static cb2Joint* Create(const cb2JointDef* def, cb2BlockAllocator* allocator);
 	static void Destroy(cb2Joint* joint, cb2BlockAllocator* allocator);
@@ -167,6 +194,10 @@ protected:
 	// This returns true if the position errors are within tolerance.
 	virtual bool SolvePositionConstraints(const cb2SolverData& data) = 0;
 
+	// Save or load the state of the joint type, see cb2World::SaveSnapshot. The world
+	// handles the bodies and the members of cb2JointDef.
+	virtual void TransferState(cb2Snapshot* snapshot) = 0;
+
 	cb2JointType m_type;
 	cb2Joint* m_prev;
 	cb2Joint* m_next;
@@ -175,11 +206,21 @@ protected:
 	cb2Body* m_bodyA;
 	cb2Body* m_bodyB;
 
+	// Joints between active bodies belong to the persistent island of their bodies.
+	cb2PersistentIsland* m_island;
+	cb2Joint* m_islandPrev;
+	cb2Joint* m_islandNext;
+
 	int m_index;
 
 	bool m_islandFlag;
 	bool m_collideConnected;
 
+	float m_breakForce;
+	float m_breakTorque;
+
+	cb2Handle m_handle;
+
 	void* m_userData;
 };
 
@@ -218,6 +259,31 @@ inline void cb2Joint::SetUserData(void* data)
 	m_userData = data;
 }
 
+inline cb2Handle cb2Joint::GetHandle() const
+{
+	return m_handle;
+}
+
+inline float cb2Joint::GetBreakForce() const
+{
+	return m_breakForce;
+}
+
+inline void cb2Joint::SetBreakForce(float force)
+{
+	m_breakForce = force;
+}
+
+inline float cb2Joint::GetBreakTorque() const
+{
+	return m_breakTorque;
+}
+
+inline void cb2Joint::SetBreakTorque(float torque)
+{
+	m_breakTorque = torque;
+}
+
 inline bool cb2Joint::GetCollideConnected() const
 {
 	return m_collideConnected;
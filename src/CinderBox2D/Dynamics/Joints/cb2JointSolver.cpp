@@ -0,0 +1,264 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/Joints/cb2JointSolver.h>
+#include <CinderBox2D/Dynamics/Joints/cb2ArticulationSolver.h>
+#include <CinderBox2D/Dynamics/Joints/cb2DistanceJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2FrictionJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2GearJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MotorJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MouseJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PrismaticJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PulleyJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RevoluteJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RopeJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WeldJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WheelJoint.h>
+#include <CinderBox2D/Common/cb2StackAllocator.h>
+
+#include <memory.h>
+#include <new>
+
+// The qualified calls bind to the concrete type, so the loops skip the vtable.
+template <typename T>
+bool cb2JointSolver::SolveJoints(cb2Joint** joints, int count, Pass pass, const cb2SolverData& data)
+{
+	bool solved = true;
+	for (int i = 0; i < count; ++i)
+	{
+		T* joint = (T*)joints[i];
+		switch (pass)
+		{
+		case e_initPass:
+			joint->T::InitVelocityConstraints(data);
+			break;
+
+		case e_velocityPass:
+			joint->T::SolveVelocityConstraints(data);
+			break;
+
+		case e_positionPass:
+			{
+				bool jointOkay = joint->T::SolvePositionConstraints(data);
+				solved = solved && jointOkay;
+			}
+			break;
+		}
+	}
+
+	return solved;
+}
+
+bool cb2JointSolver::SolveJoints(cb2JointType type, cb2Joint** joints, int count, Pass pass, const cb2SolverData& data)
+{
+	switch (type)
+	{
+	case e_revoluteJoint:
+		return SolveJoints<cb2RevoluteJoint>(joints, count, pass, data);
+
+	case e_prismaticJoint:
+		return SolveJoints<cb2PrismaticJoint>(joints, count, pass, data);
+
+	case e_distanceJoint:
+		return SolveJoints<cb2DistanceJoint>(joints, count, pass, data);
+
+	case e_pulleyJoint:
+		return SolveJoints<cb2PulleyJoint>(joints, count, pass, data);
+
+	case e_mouseJoint:
+		return SolveJoints<cb2MouseJoint>(joints, count, pass, data);
+
+	case e_gearJoint:
+		return SolveJoints<cb2GearJoint>(joints, count, pass, data);
+
+	case e_wheelJoint:
+		return SolveJoints<cb2WheelJoint>(joints, count, pass, data);
+
+	case e_weldJoint:
+		return SolveJoints<cb2WeldJoint>(joints, count, pass, data);
+
+	case e_frictionJoint:
+		return SolveJoints<cb2FrictionJoint>(joints, count, pass, data);
+
+	case e_ropeJoint:
+		return SolveJoints<cb2RopeJoint>(joints, count, pass, data);
+
+	case e_motorJoint:
+		return SolveJoints<cb2MotorJoint>(joints, count, pass, data);
+
+	default:
+		cb2Assert(false);
+		return true;
+	}
+}
+
+cb2JointSolver::cb2JointSolver(cb2JointSolverDef* def)
+{
+	m_allocator = def->allocator;
+	m_joints = def->joints;
+	m_count = def->count;
+	m_bodyCount = def->bodyCount;
+	m_directJoints = def->directJoints;
+	m_articulationSolver = NULL;
+
+	// Counting sort by type, stable so each type keeps the island order.
+	const int typeCount = e_motorJoint + 1;
+	memset(m_typeStarts, 0, sizeof(m_typeStarts));
+	for (int i = 0; i < m_count; ++i)
+	{
+		cb2Assert(0 <= m_joints[i]->m_type && m_joints[i]->m_type < typeCount);
+		++m_typeStarts[m_joints[i]->m_type + 1];
+	}
+
+	for (int t = 0; t < typeCount; ++t)
+	{
+		m_typeStarts[t + 1] += m_typeStarts[t];
+	}
+
+	cb2Joint** sorted = (cb2Joint**)m_allocator->Allocate(m_count * sizeof(cb2Joint*));
+	int offsets[e_motorJoint + 1];
+	memcpy(offsets, m_typeStarts, sizeof(offsets));
+	for (int i = 0; i < m_count; ++i)
+	{
+		sorted[offsets[m_joints[i]->m_type]++] = m_joints[i];
+	}
+
+	memcpy(m_joints, sorted, m_count * sizeof(cb2Joint*));
+	m_allocator->Free(sorted);
+
+	int revoluteCount = m_typeStarts[e_revoluteJoint + 1] - m_typeStarts[e_revoluteJoint];
+	m_revoluteConstraints = (cb2RevoluteConstraint*)m_allocator->Allocate(revoluteCount * sizeof(cb2RevoluteConstraint));
+}
+
+cb2JointSolver::~cb2JointSolver()
+{
+	if (m_articulationSolver)
+	{
+		m_articulationSolver->~cb2ArticulationSolver();
+		m_allocator->Free(m_articulationSolver);
+	}
+
+	m_allocator->Free(m_revoluteConstraints);
+}
+
+void cb2JointSolver::InitVelocityConstraints(const cb2SolverData& data)
+{
+	for (int t = e_revoluteJoint; t <= e_motorJoint; ++t)
+	{
+		int count = m_typeStarts[t + 1] - m_typeStarts[t];
+		if (count > 0)
+		{
+			SolveJoints(cb2JointType(t), m_joints + m_typeStarts[t], count, e_initPass, data);
+		}
+	}
+
+	int revoluteStart = m_typeStarts[e_revoluteJoint];
+	int revoluteCount = m_typeStarts[e_revoluteJoint + 1] - revoluteStart;
+	for (int i = 0; i < revoluteCount; ++i)
+	{
+		cb2RevoluteJoint* joint = (cb2RevoluteJoint*)m_joints[revoluteStart + i];
+		joint->GetConstraint(m_revoluteConstraints + i);
+	}
+
+	// A single joint is solved exactly by its own pass.
+	if (m_directJoints && m_articulationSolver == NULL && revoluteCount > 1)
+	{
+		void* mem = m_allocator->Allocate(sizeof(cb2ArticulationSolver));
+		m_articulationSolver = new (mem) cb2ArticulationSolver(m_revoluteConstraints, revoluteCount, m_bodyCount, m_allocator);
+	}
+}
+
+void cb2JointSolver::SolveVelocityConstraints(const cb2SolverData& data)
+{
+	int revoluteCount = m_typeStarts[e_revoluteJoint + 1] - m_typeStarts[e_revoluteJoint];
+	cb2RevoluteJoint::SolveVelocityConstraints(m_revoluteConstraints, revoluteCount, data);
+
+	for (int t = e_revoluteJoint + 1; t <= e_motorJoint; ++t)
+	{
+		int count = m_typeStarts[t + 1] - m_typeStarts[t];
+		if (count > 0)
+		{
+			SolveJoints(cb2JointType(t), m_joints + m_typeStarts[t], count, e_velocityPass, data);
+		}
+	}
+
+	SolveArticulationVelocities(data);
+}
+
+void cb2JointSolver::StoreImpulses()
+{
+	int revoluteCount = m_typeStarts[e_revoluteJoint + 1] - m_typeStarts[e_revoluteJoint];
+	for (int i = 0; i < revoluteCount; ++i)
+	{
+		cb2RevoluteConstraint* constraint = m_revoluteConstraints + i;
+		constraint->joint->StoreImpulses(constraint);
+	}
+}
+
+bool cb2JointSolver::SolvePositionConstraints(const cb2SolverData& data)
+{
+	int revoluteCount = m_typeStarts[e_revoluteJoint + 1] - m_typeStarts[e_revoluteJoint];
+	bool solved = cb2RevoluteJoint::SolvePositionConstraints(m_revoluteConstraints, revoluteCount, data);
+
+	for (int t = e_revoluteJoint + 1; t <= e_motorJoint; ++t)
+	{
+		int count = m_typeStarts[t + 1] - m_typeStarts[t];
+		if (count > 0)
+		{
+			bool jointsOkay = SolveJoints(cb2JointType(t), m_joints + m_typeStarts[t], count, e_positionPass, data);
+			solved = solved && jointsOkay;
+		}
+	}
+
+	return solved;
+}
+
+void cb2JointSolver::SolveVelocityConstraint(int index, const cb2SolverData& data)
+{
+	cb2Joint* joint = m_joints[index];
+	if (joint->m_type == e_revoluteJoint)
+	{
+		int i = index - m_typeStarts[e_revoluteJoint];
+		cb2RevoluteJoint::SolveVelocityConstraints(m_revoluteConstraints + i, 1, data);
+	}
+	else
+	{
+		SolveJoints(joint->m_type, m_joints + index, 1, e_velocityPass, data);
+	}
+}
+
+bool cb2JointSolver::SolvePositionConstraint(int index, const cb2SolverData& data)
+{
+	cb2Joint* joint = m_joints[index];
+	if (joint->m_type == e_revoluteJoint)
+	{
+		int i = index - m_typeStarts[e_revoluteJoint];
+		return cb2RevoluteJoint::SolvePositionConstraints(m_revoluteConstraints + i, 1, data);
+	}
+
+	return SolveJoints(joint->m_type, m_joints + index, 1, e_positionPass, data);
+}
+
+void cb2JointSolver::SolveArticulationVelocities(const cb2SolverData& data)
+{
+	if (m_articulationSolver)
+	{
+		m_articulationSolver->SolveVelocityConstraints(data);
+	}
+}
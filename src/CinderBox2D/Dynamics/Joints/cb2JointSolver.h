@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_JOINT_SOLVER_H
+#define CB2_JOINT_SOLVER_H
+
+#include <CinderBox2D/Dynamics/Joints/cb2Joint.h>
+
+class cb2StackAllocator;
+class cb2ArticulationSolver;
+struct cb2RevoluteConstraint;
+
+struct cb2JointSolverDef
+{
+	cb2Joint** joints;
+	int count;
+	int bodyCount;
+	bool directJoints;
+	cb2StackAllocator* allocator;
+};
+
+/// Solves the joints of an island grouped by type. The joint array is sorted by
+/// type in place, keeping the island order within a type, and each type runs its
+/// own loop without virtual calls. Revolute joints iterate over packed copies of
+/// their solver data. With directJoints their point constraints are also solved
+/// exactly after each pass, see cb2ArticulationSolver.
+class cb2JointSolver
+{
+public:
+	cb2JointSolver(cb2JointSolverDef* def);
+	~cb2JointSolver();
+
+	void InitVelocityConstraints(const cb2SolverData& data);
+	void SolveVelocityConstraints(const cb2SolverData& data);
+	void StoreImpulses();
+
+	bool SolvePositionConstraints(const cb2SolverData& data);
+
+	/// Solve a single joint, by its index in the sorted joint array. Joints that
+	/// share no moving body may be solved concurrently.
+	void SolveVelocityConstraint(int index, const cb2SolverData& data);
+	bool SolvePositionConstraint(int index, const cb2SolverData& data);
+
+	/// Run the direct pass over the revolute joints, if there is one. The passes
+	/// above include it, this is for callers solving joint by joint.
+	void SolveArticulationVelocities(const cb2SolverData& data);
+
+	cb2StackAllocator* m_allocator;
+	cb2Joint** m_joints;
+	int m_count;
+
+	// The joints of type t span [m_typeStarts[t], m_typeStarts[t + 1]).
+	int m_typeStarts[e_motorJoint + 2];
+
+	cb2RevoluteConstraint* m_revoluteConstraints;
+
+	// Built by the first InitVelocityConstraints, the joint graph is fixed for the step.
+	cb2ArticulationSolver* m_articulationSolver;
+	int m_bodyCount;
+	bool m_directJoints;
+
+private:
+
+	enum Pass
+	{
+		e_initPass,
+		e_velocityPass,
+		e_positionPass
+	};
+
+	template <typename T>
+	static bool SolveJoints(cb2Joint** joints, int count, Pass pass, const cb2SolverData& data);
+	static bool SolveJoints(cb2JointType type, cb2Joint** joints, int count, Pass pass, const cb2SolverData& data);
+};
+
+#endif
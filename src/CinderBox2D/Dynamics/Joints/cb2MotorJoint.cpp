@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2MotorJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Point-to-point constraint
 // Cdot = v2 - v1
@@ -294,6 +295,8 @@ void cb2MotorJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.linearOffset.Set(%.15lef, %.15lef);\n", m_linearOffset.x, m_linearOffset.y);
 	cb2Log("  jd.angularOffset = %.15lef;\n", m_angularOffset);
 	cb2Log("  jd.maxForce = %.15lef;\n", m_maxForce);
@@ -301,3 +304,14 @@ void cb2MotorJoint::Dump()
 	cb2Log("  jd.correctionFactor = %.15lef;\n", m_correctionFactor);
 	cb2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void cb2MotorJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_linearOffset);
+	snapshot->Transfer(m_angularOffset);
+	snapshot->Transfer(m_linearImpulse);
+	snapshot->Transfer(m_angularImpulse);
+	snapshot->Transfer(m_maxForce);
+	snapshot->Transfer(m_maxTorque);
+	snapshot->Transfer(m_correctionFactor);
+}
@@ -96,6 +96,7 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 
 	cb2MotorJoint(const cb2MotorJointDef* def);
 
@@ -103,6 +104,8 @@ protected:
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	// Solver shared
 	ci::Vec2f m_linearOffset;
 	float m_angularOffset;
@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2MouseJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // p = attached point, m = mouse point
 // C = p - m
@@ -220,3 +221,15 @@ void cb2MouseJoint::ShiftOrigin(const ci::Vec2f& newOrigin)
 {
 	m_targetA -= newOrigin;
 }
+
+void cb2MouseJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_targetA);
+	snapshot->Transfer(m_frequencyHz);
+	snapshot->Transfer(m_dampingRatio);
+	snapshot->Transfer(m_beta);
+	snapshot->Transfer(m_impulse);
+	snapshot->Transfer(m_maxForce);
+	snapshot->Transfer(m_gamma);
+}
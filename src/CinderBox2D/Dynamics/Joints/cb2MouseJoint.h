@@ -97,6 +97,7 @@ public:
 
 protected:
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 
 	cb2MouseJoint(const cb2MouseJointDef* def);
 
@@ -104,6 +105,8 @@ protected:
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	ci::Vec2f m_localAnchorB;
 	ci::Vec2f m_targetA;
 	float m_frequencyHz;
@@ -150,12 +150,15 @@ public:
 protected:
 	friend class cb2Joint;
 	friend class cb2GearJoint;
+	friend class cb2JointSolver;
 	cb2PrismaticJoint(const cb2PrismaticJointDef* def);
 
 	void InitVelocityConstraints(const cb2SolverData& data);
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	// Solver shared
 	ci::Vec2f m_localAnchorA;
 	ci::Vec2f m_localAnchorB;
@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2PulleyJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Pulley:
 // length1 = norm(p1 - s1)
@@ -331,6 +332,8 @@ void cb2PulleyJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.groundAnchorA.set(%.15lef, %.15lef);\n", m_groundAnchorA.x, m_groundAnchorA.y);
 	cb2Log("  jd.groundAnchorB.set(%.15lef, %.15lef);\n", m_groundAnchorB.x, m_groundAnchorB.y);
 	cb2Log("  jd.localAnchorA.set(%.15lef, %.15lef);\n", m_localAnchorA.x, m_localAnchorA.y);
@@ -346,3 +349,16 @@ void cb2PulleyJoint::ShiftOrigin(const ci::Vec2f& newOrigin)
 	m_groundAnchorA -= newOrigin;
 	m_groundAnchorB -= newOrigin;
 }
+
+void cb2PulleyJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_groundAnchorA);
+	snapshot->Transfer(m_groundAnchorB);
+	snapshot->Transfer(m_lengthA);
+	snapshot->Transfer(m_lengthB);
+	snapshot->Transfer(m_localAnchorA);
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_constant);
+	snapshot->Transfer(m_ratio);
+	snapshot->Transfer(m_impulse);
+}
@@ -115,12 +115,15 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 	cb2PulleyJoint(const cb2PulleyJointDef* data);
 
 	void InitVelocityConstraints(const cb2SolverData& data);
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	ci::Vec2f m_groundAnchorA;
 	ci::Vec2f m_groundAnchorB;
 	float m_lengthA;
@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2RevoluteJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Point-to-point constraint
 // C = p2 - p1
@@ -183,196 +184,257 @@ void cb2RevoluteJoint::InitVelocityConstraints(const cb2SolverData& data)
 
 void cb2RevoluteJoint::SolveVelocityConstraints(const cb2SolverData& data)
 {
-	ci::Vec2f vA = data.velocities[m_indexA].v;
-	float wA = data.velocities[m_indexA].w;
-	ci::Vec2f vB = data.velocities[m_indexB].v;
-	float wB = data.velocities[m_indexB].w;
+	cb2RevoluteConstraint constraint;
+	GetConstraint(&constraint);
+	SolveVelocityConstraints(&constraint, 1, data);
+	StoreImpulses(&constraint);
+}
 
-	float mA = m_invMassA, mB = m_invMassB;
-	float iA = m_invIA, iB = m_invIB;
+bool cb2RevoluteJoint::SolvePositionConstraints(const cb2SolverData& data)
+{
+	cb2RevoluteConstraint constraint;
+	GetConstraint(&constraint);
+	return SolvePositionConstraints(&constraint, 1, data);
+}
 
-	bool fixedRotation = (iA + iB == 0.0f);
+void cb2RevoluteJoint::GetConstraint(cb2RevoluteConstraint* constraint)
+{
+	constraint->joint = this;
+	constraint->indexA = m_indexA;
+	constraint->indexB = m_indexB;
+	constraint->rA = m_rA;
+	constraint->rB = m_rB;
+	constraint->localAnchorA = m_localAnchorA - m_localCenterA;
+	constraint->localAnchorB = m_localAnchorB - m_localCenterB;
+	constraint->invMassA = m_invMassA;
+	constraint->invMassB = m_invMassB;
+	constraint->invIA = m_invIA;
+	constraint->invIB = m_invIB;
+	constraint->mass = m_mass;
+	constraint->motorMass = m_motorMass;
+	constraint->impulse = m_impulse;
+	constraint->motorImpulse = m_motorImpulse;
+	constraint->motorSpeed = m_motorSpeed;
+	constraint->maxMotorTorque = m_maxMotorTorque;
+	constraint->referenceAngle = m_referenceAngle;
+	constraint->lowerAngle = m_lowerAngle;
+	constraint->upperAngle = m_upperAngle;
+	constraint->limitState = m_limitState;
+	constraint->enableMotor = m_enableMotor;
+	constraint->enableLimit = m_enableLimit;
+}
 
-	// Solve motor constraint.
-	if (m_enableMotor && m_limitState != e_equalLimits && fixedRotation == false)
-	{
-		float Cdot = wB - wA - m_motorSpeed;
-		float impulse = -m_motorMass * Cdot;
-		float oldImpulse = m_motorImpulse;
-		float maxImpulse = data.step.dt * m_maxMotorTorque;
-		m_motorImpulse = cb2Clamp(m_motorImpulse + impulse, -maxImpulse, maxImpulse);
-		impulse = m_motorImpulse - oldImpulse;
-
-		wA -= iA * impulse;
-		wB += iB * impulse;
-	}
+void cb2RevoluteJoint::StoreImpulses(const cb2RevoluteConstraint* constraint)
+{
+	m_impulse = constraint->impulse;
+	m_motorImpulse = constraint->motorImpulse;
+}
 
-	// Solve limit constraint.
-	if (m_enableLimit && m_limitState != e_inactiveLimit && fixedRotation == false)
+void cb2RevoluteJoint::SolveVelocityConstraints(cb2RevoluteConstraint* constraints, int count, const cb2SolverData& data)
+{
+	for (int i = 0; i < count; ++i)
 	{
-		ci::Vec2f Cdot1 = vB + cb2Cross(wB, m_rB) - vA - cb2Cross(wA, m_rA);
-		float Cdot2 = wB - wA;
-		ci::Vec3f Cdot(Cdot1.x, Cdot1.y, Cdot2);
+		cb2RevoluteConstraint* c = constraints + i;
+
+		ci::Vec2f vA = data.velocities[c->indexA].v;
+		float wA = data.velocities[c->indexA].w;
+		ci::Vec2f vB = data.velocities[c->indexB].v;
+		float wB = data.velocities[c->indexB].w;
 
-		ci::Vec3f impulse = -cb2::solve(m_mass, Cdot);
+		float mA = c->invMassA, mB = c->invMassB;
+		float iA = c->invIA, iB = c->invIB;
 
-		if (m_limitState == e_equalLimits)
+		bool fixedRotation = (iA + iB == 0.0f);
+
+		// Solve motor constraint.
+		if (c->enableMotor && c->limitState != e_equalLimits && fixedRotation == false)
 		{
-			m_impulse += impulse;
+			float Cdot = wB - wA - c->motorSpeed;
+			float impulse = -c->motorMass * Cdot;
+			float oldImpulse = c->motorImpulse;
+			float maxImpulse = data.step.dt * c->maxMotorTorque;
+			c->motorImpulse = cb2Clamp(c->motorImpulse + impulse, -maxImpulse, maxImpulse);
+			impulse = c->motorImpulse - oldImpulse;
+
+			wA -= iA * impulse;
+			wB += iB * impulse;
 		}
-		else if (m_limitState == e_atLowerLimit)
+
+		// Solve limit constraint.
+		if (c->enableLimit && c->limitState != e_inactiveLimit && fixedRotation == false)
 		{
-			float newImpulse = m_impulse.z + impulse.z;
-			if (newImpulse < 0.0f)
-			{
-				ci::Vec2f rhs = -Cdot1 + m_impulse.z * ci::Vec2f(m_mass.m20, m_mass.m21);
-				ci::Vec2f reduced = cb2::solve22(m_mass, rhs);
-				impulse.x = reduced.x;
-				impulse.y = reduced.y;
-				impulse.z = -m_impulse.z;
-				m_impulse.x += reduced.x;
-				m_impulse.y += reduced.y;
-				m_impulse.z = 0.0f;
-			}
-			else
+			ci::Vec2f Cdot1 = vB + cb2Cross(wB, c->rB) - vA - cb2Cross(wA, c->rA);
+			float Cdot2 = wB - wA;
+			ci::Vec3f Cdot(Cdot1.x, Cdot1.y, Cdot2);
+
+			ci::Vec3f impulse = -cb2::solve(c->mass, Cdot);
+
+			if (c->limitState == e_equalLimits)
 			{
-				m_impulse += impulse;
+				c->impulse += impulse;
 			}
-		}
-		else if (m_limitState == e_atUpperLimit)
-		{
-			float newImpulse = m_impulse.z + impulse.z;
-			if (newImpulse > 0.0f)
+			else if (c->limitState == e_atLowerLimit)
 			{
-				ci::Vec2f rhs = -Cdot1 + m_impulse.z * ci::Vec2f(m_mass.m20, m_mass.m21);
-				ci::Vec2f reduced = cb2::solve22(m_mass, rhs);
-				impulse.x = reduced.x;
-				impulse.y = reduced.y;
-				impulse.z = -m_impulse.z;
-				m_impulse.x += reduced.x;
-				m_impulse.y += reduced.y;
-				m_impulse.z = 0.0f;
+				float newImpulse = c->impulse.z + impulse.z;
+				if (newImpulse < 0.0f)
+				{
+					ci::Vec2f rhs = -Cdot1 + c->impulse.z * ci::Vec2f(c->mass.m20, c->mass.m21);
+					ci::Vec2f reduced = cb2::solve22(c->mass, rhs);
+					impulse.x = reduced.x;
+					impulse.y = reduced.y;
+					impulse.z = -c->impulse.z;
+					c->impulse.x += reduced.x;
+					c->impulse.y += reduced.y;
+					c->impulse.z = 0.0f;
+				}
+				else
+				{
+					c->impulse += impulse;
+				}
 			}
-			else
+			else if (c->limitState == e_atUpperLimit)
 			{
-				m_impulse += impulse;
+				float newImpulse = c->impulse.z + impulse.z;
+				if (newImpulse > 0.0f)
+				{
+					ci::Vec2f rhs = -Cdot1 + c->impulse.z * ci::Vec2f(c->mass.m20, c->mass.m21);
+					ci::Vec2f reduced = cb2::solve22(c->mass, rhs);
+					impulse.x = reduced.x;
+					impulse.y = reduced.y;
+					impulse.z = -c->impulse.z;
+					c->impulse.x += reduced.x;
+					c->impulse.y += reduced.y;
+					c->impulse.z = 0.0f;
+				}
+				else
+				{
+					c->impulse += impulse;
+				}
 			}
-		}
 
-		ci::Vec2f P(impulse.x, impulse.y);
+			ci::Vec2f P(impulse.x, impulse.y);
 
-		vA -= mA * P;
-		wA -= iA * (cb2Cross(m_rA, P) + impulse.z);
+			vA -= mA * P;
+			wA -= iA * (cb2Cross(c->rA, P) + impulse.z);
 
-		vB += mB * P;
-		wB += iB * (cb2Cross(m_rB, P) + impulse.z);
-	}
-	else
-	{
-		// Solve point-to-point constraint
-		ci::Vec2f Cdot = vB + cb2Cross(wB, m_rB) - vA - cb2Cross(wA, m_rA);
-		ci::Vec2f impulse = cb2::solve22(m_mass, -Cdot);
+			vB += mB * P;
+			wB += iB * (cb2Cross(c->rB, P) + impulse.z);
+		}
+		else
+		{
+			// Solve point-to-point constraint
+			ci::Vec2f Cdot = vB + cb2Cross(wB, c->rB) - vA - cb2Cross(wA, c->rA);
+			ci::Vec2f impulse = cb2::solve22(c->mass, -Cdot);
 
-		m_impulse.x += impulse.x;
-		m_impulse.y += impulse.y;
+			c->impulse.x += impulse.x;
+			c->impulse.y += impulse.y;
 
-		vA -= mA * impulse;
-		wA -= iA * cb2Cross(m_rA, impulse);
+			vA -= mA * impulse;
+			wA -= iA * cb2Cross(c->rA, impulse);
 
-		vB += mB * impulse;
-		wB += iB * cb2Cross(m_rB, impulse);
-	}
+			vB += mB * impulse;
+			wB += iB * cb2Cross(c->rB, impulse);
+		}
 
-	data.velocities[m_indexA].v = vA;
-	data.velocities[m_indexA].w = wA;
-	data.velocities[m_indexB].v = vB;
-	data.velocities[m_indexB].w = wB;
+		data.velocities[c->indexA].v = vA;
+		data.velocities[c->indexA].w = wA;
+		data.velocities[c->indexB].v = vB;
+		data.velocities[c->indexB].w = wB;
+	}
 }
 
-bool cb2RevoluteJoint::SolvePositionConstraints(const cb2SolverData& data)
+bool cb2RevoluteJoint::SolvePositionConstraints(const cb2RevoluteConstraint* constraints, int count, const cb2SolverData& data)
 {
-	ci::Vec2f cA = data.positions[m_indexA].c;
-	float aA = data.positions[m_indexA].a;
-	ci::Vec2f cB = data.positions[m_indexB].c;
-	float aB = data.positions[m_indexB].a;
+	bool solved = true;
+	for (int i = 0; i < count; ++i)
+	{
+		const cb2RevoluteConstraint* c = constraints + i;
 
-	cb2Rot qA(aA), qB(aB);
+		ci::Vec2f cA = data.positions[c->indexA].c;
+		float aA = data.positions[c->indexA].a;
+		ci::Vec2f cB = data.positions[c->indexB].c;
+		float aB = data.positions[c->indexB].a;
 
-	float angularError = 0.0f;
-	float positionError = 0.0f;
+		cb2Rot qA(aA), qB(aB);
 
-	bool fixedRotation = (m_invIA + m_invIB == 0.0f);
+		float angularError = 0.0f;
+		float positionError = 0.0f;
 
-	// Solve angular limit constraint.
-	if (m_enableLimit && m_limitState != e_inactiveLimit && fixedRotation == false)
-	{
-		float angle = aB - aA - m_referenceAngle;
-		float limitImpulse = 0.0f;
+		bool fixedRotation = (c->invIA + c->invIB == 0.0f);
 
-		if (m_limitState == e_equalLimits)
-		{
-			// Prevent large angular corrections
-			float C = cb2Clamp(angle - m_lowerAngle, -cb2_maxAngularCorrection, cb2_maxAngularCorrection);
-			limitImpulse = -m_motorMass * C;
-			angularError = cb2Abs(C);
-		}
-		else if (m_limitState == e_atLowerLimit)
+		// Solve angular limit constraint.
+		if (c->enableLimit && c->limitState != e_inactiveLimit && fixedRotation == false)
 		{
-			float C = angle - m_lowerAngle;
-			angularError = -C;
+			float angle = aB - aA - c->referenceAngle;
+			float limitImpulse = 0.0f;
 
-			// Prevent large angular corrections and allow some slop.
-			C = cb2Clamp(C + cb2_angularSlop, -cb2_maxAngularCorrection, 0.0f);
-			limitImpulse = -m_motorMass * C;
-		}
-		else if (m_limitState == e_atUpperLimit)
-		{
-			float C = angle - m_upperAngle;
-			angularError = C;
+			if (c->limitState == e_equalLimits)
+			{
+				// Prevent large angular corrections
+				float C = cb2Clamp(angle - c->lowerAngle, -cb2_maxAngularCorrection, cb2_maxAngularCorrection);
+				limitImpulse = -c->motorMass * C;
+				angularError = cb2Abs(C);
+			}
+			else if (c->limitState == e_atLowerLimit)
+			{
+				float C = angle - c->lowerAngle;
+				angularError = -C;
+
+				// Prevent large angular corrections and allow some slop.
+				C = cb2Clamp(C + cb2_angularSlop, -cb2_maxAngularCorrection, 0.0f);
+				limitImpulse = -c->motorMass * C;
+			}
+			else if (c->limitState == e_atUpperLimit)
+			{
+				float C = angle - c->upperAngle;
+				angularError = C;
+
+				// Prevent large angular corrections and allow some slop.
+				C = cb2Clamp(C - cb2_angularSlop, 0.0f, cb2_maxAngularCorrection);
+				limitImpulse = -c->motorMass * C;
+			}
 
-			// Prevent large angular corrections and allow some slop.
-			C = cb2Clamp(C - cb2_angularSlop, 0.0f, cb2_maxAngularCorrection);
-			limitImpulse = -m_motorMass * C;
+			aA -= c->invIA * limitImpulse;
+			aB += c->invIB * limitImpulse;
 		}
 
-		aA -= m_invIA * limitImpulse;
-		aB += m_invIB * limitImpulse;
-	}
+		// Solve point-to-point constraint.
+		{
+			qA.set(aA);
+			qB.set(aB);
+			ci::Vec2f rA = cb2Mul(qA, c->localAnchorA);
+			ci::Vec2f rB = cb2Mul(qB, c->localAnchorB);
 
-	// Solve point-to-point constraint.
-	{
-		qA.set(aA);
-		qB.set(aB);
-		ci::Vec2f rA = cb2Mul(qA, m_localAnchorA - m_localCenterA);
-		ci::Vec2f rB = cb2Mul(qB, m_localAnchorB - m_localCenterB);
+			ci::Vec2f C = cB + rB - cA - rA;
+			positionError = C.length();
 
-		ci::Vec2f C = cB + rB - cA - rA;
-		positionError = C.length();
+			float mA = c->invMassA, mB = c->invMassB;
+			float iA = c->invIA, iB = c->invIB;
 
-		float mA = m_invMassA, mB = m_invMassB;
-		float iA = m_invIA, iB = m_invIB;
+			ci::Matrix22f K;
+			K.m00 = mA + mB + iA * rA.y * rA.y + iB * rB.y * rB.y;
+			K.m01 = -iA * rA.x * rA.y - iB * rB.x * rB.y;
+			K.m10 = K.m01;
+			K.m11 = mA + mB + iA * rA.x * rA.x + iB * rB.x * rB.x;
 
-		ci::Matrix22f K;
-		K.m00 = mA + mB + iA * rA.y * rA.y + iB * rB.y * rB.y;
-		K.m01 = -iA * rA.x * rA.y - iB * rB.x * rB.y;
-		K.m10 = K.m01;
-		K.m11 = mA + mB + iA * rA.x * rA.x + iB * rB.x * rB.x;
+			ci::Vec2f impulse = -cb2::solve(K, C);
 
-		ci::Vec2f impulse = -cb2::solve(K, C);
+			cA -= mA * impulse;
+			aA -= iA * cb2Cross(rA, impulse);
+
+			cB += mB * impulse;
+			aB += iB * cb2Cross(rB, impulse);
+		}
 
-		cA -= mA * impulse;
-		aA -= iA * cb2Cross(rA, impulse);
+		data.positions[c->indexA].c = cA;
+		data.positions[c->indexA].a = aA;
+		data.positions[c->indexB].c = cB;
+		data.positions[c->indexB].a = aB;
 
-		cB += mB * impulse;
-		aB += iB * cb2Cross(rB, impulse);
+		solved = solved && positionError <= cb2_linearSlop && angularError <= cb2_angularSlop;
 	}
 
-	data.positions[m_indexA].c = cA;
-	data.positions[m_indexA].a = aA;
-	data.positions[m_indexB].c = cB;
-	data.positions[m_indexB].a = aB;
-	
-	return positionError <= cb2_linearSlop && angularError <= cb2_angularSlop;
+	return solved;
 }
 
 ci::Vec2f cb2RevoluteJoint::GetAnchorA() const
@@ -490,6 +552,8 @@ void cb2RevoluteJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.localAnchorA.set(%.15lef, %.15lef);\n", m_localAnchorA.x, m_localAnchorA.y);
 	cb2Log("  jd.localAnchorB.set(%.15lef, %.15lef);\n", m_localAnchorB.x, m_localAnchorB.y);
 	cb2Log("  jd.referenceAngle = %.15lef;\n", m_referenceAngle);
@@ -501,3 +565,19 @@ void cb2RevoluteJoint::Dump()
 	cb2Log("  jd.maxMotorTorque = %.15lef;\n", m_maxMotorTorque);
 	cb2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void cb2RevoluteJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_localAnchorA);
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_impulse);
+	snapshot->Transfer(m_motorImpulse);
+	snapshot->Transfer(m_enableMotor);
+	snapshot->Transfer(m_maxMotorTorque);
+	snapshot->Transfer(m_motorSpeed);
+	snapshot->Transfer(m_enableLimit);
+	snapshot->Transfer(m_referenceAngle);
+	snapshot->Transfer(m_lowerAngle);
+	snapshot->Transfer(m_upperAngle);
+	snapshot->TransferEnum(m_limitState, e_equalLimits + 1);
+}
@@ -81,6 +81,37 @@ struct cb2RevoluteJointDef : public cb2JointDef
 	float maxMotorTorque;
 };
 
+class cb2RevoluteJoint;
+
+/// The solver data of a revolute joint, packed so the joint solver can run its
+/// iterations over a contiguous array instead of the joints themselves.
+struct cb2RevoluteConstraint
+{
+	cb2RevoluteJoint* joint;
+	int indexA;
+	int indexB;
+	ci::Vec2f rA;
+	ci::Vec2f rB;
+	ci::Vec2f localAnchorA;		// relative to the center of mass
+	ci::Vec2f localAnchorB;
+	float invMassA;
+	float invMassB;
+	float invIA;
+	float invIB;
+	ci::Matrix33f mass;
+	float motorMass;
+	ci::Vec3f impulse;
+	float motorImpulse;
+	float motorSpeed;
+	float maxMotorTorque;
+	float referenceAngle;
+	float lowerAngle;
+	float upperAngle;
+	cb2LimitState limitState;
+	bool enableMotor;
+	bool enableLimit;
+};
+
 /// A revolute joint constrains two bodies to share a common point while they
 /// are free to rotate about the point. The relative rotation about the shared
 /// point is the joint angle. You can limit the relative rotation with
@@ -158,6 +189,7 @@ protected:
 	
 	friend class cb2Joint;
 	friend class cb2GearJoint;
+	friend class cb2JointSolver;
 
 	cb2RevoluteJoint(const cb2RevoluteJointDef* def);
 
@@ -165,6 +197,15 @@ protected:
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
+	// The solver iterations run on packed copies of the solver data, the virtual
+	// functions above solve a single copy.
+	void GetConstraint(cb2RevoluteConstraint* constraint);
+	void StoreImpulses(const cb2RevoluteConstraint* constraint);
+	static void SolveVelocityConstraints(cb2RevoluteConstraint* constraints, int count, const cb2SolverData& data);
+	static bool SolvePositionConstraints(const cb2RevoluteConstraint* constraints, int count, const cb2SolverData& data);
+
 	// Solver shared
 	ci::Vec2f m_localAnchorA;
 	ci::Vec2f m_localAnchorB;
@@ -91,6 +91,7 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 
 	cb2WeldJoint(const cb2WeldJointDef* def);
 
@@ -98,6 +99,8 @@ protected:
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	float m_frequencyHz;
 	float m_dampingRatio;
 	float m_bias;
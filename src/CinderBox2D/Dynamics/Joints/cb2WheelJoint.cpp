@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/Joints/cb2WheelJoint.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
 
 // Linear constraint (point-to-line)
 // d = pB - pA = xB + rB - xA - rA
@@ -407,6 +408,8 @@ void cb2WheelJoint::Dump()
 	cb2Log("  jd.bodyA = bodies[%d];\n", indexA);
 	cb2Log("  jd.bodyB = bodies[%d];\n", indexB);
 	cb2Log("  jd.collideConnected = bool(%d);\n", m_collideConnected);
+	cb2Log("  jd.breakForce = %.15lef;\n", m_breakForce);
+	cb2Log("  jd.breakTorque = %.15lef;\n", m_breakTorque);
 	cb2Log("  jd.localAnchorA.set(%.15lef, %.15lef);\n", m_localAnchorA.x, m_localAnchorA.y);
 	cb2Log("  jd.localAnchorB.set(%.15lef, %.15lef);\n", m_localAnchorB.x, m_localAnchorB.y);
 	cb2Log("  jd.localAxisA.set(%.15lef, %.15lef);\n", m_localXAxisA.x, m_localXAxisA.y);
@@ -417,3 +420,19 @@ void cb2WheelJoint::Dump()
 	cb2Log("  jd.dampingRatio = %.15lef;\n", m_dampingRatio);
 	cb2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void cb2WheelJoint::TransferState(cb2Snapshot* snapshot)
+{
+	snapshot->Transfer(m_frequencyHz);
+	snapshot->Transfer(m_dampingRatio);
+	snapshot->Transfer(m_localAnchorA);
+	snapshot->Transfer(m_localAnchorB);
+	snapshot->Transfer(m_localXAxisA);
+	snapshot->Transfer(m_localYAxisA);
+	snapshot->Transfer(m_impulse);
+	snapshot->Transfer(m_motorImpulse);
+	snapshot->Transfer(m_springImpulse);
+	snapshot->Transfer(m_maxMotorTorque);
+	snapshot->Transfer(m_motorSpeed);
+	snapshot->Transfer(m_enableMotor);
+}
@@ -133,12 +133,15 @@ public:
 protected:
 
 	friend class cb2Joint;
+	friend class cb2JointSolver;
 	cb2WheelJoint(const cb2WheelJointDef* def);
 
 	void InitVelocityConstraints(const cb2SolverData& data);
 	void SolveVelocityConstraints(const cb2SolverData& data);
 	bool SolvePositionConstraints(const cb2SolverData& data);
 
+	void TransferState(cb2Snapshot* snapshot);
+
 	float m_frequencyHz;
 	float m_dampingRatio;
 
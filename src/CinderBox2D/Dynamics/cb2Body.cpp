@@ -19,6 +19,7 @@
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
 #include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
 #include <CinderBox2D/Dynamics/Joints/cb2Joint.h>
 
@@ -55,6 +56,11 @@ cb2Body::cb2Body(const cb2BodyDef* bd, cb2World* world)
 	}
 
 	m_world = world;
+	m_handle = cb2_nullHandle;
+
+	m_island = NULL;
+	m_islandPrev = NULL;
+	m_islandNext = NULL;
 
 	m_xf.p = bd->position;
 	m_xf.q.set(bd->angle);
@@ -76,11 +82,15 @@ cb2Body::cb2Body(const cb2BodyDef* bd, cb2World* world)
 	m_linearDamping = bd->linearDamping;
 	m_angularDamping = bd->angularDamping;
 	m_gravityScale = bd->gravityScale;
+	m_sleepScale = bd->sleepScale;
 
 	m_torque = 0.0f;
 
 	m_sleepTime = 0.0f;
 
+	// A new body counts as moved.
+	m_moveStamp = world->m_stepIndex;
+
 	m_type = bd->type;
 
 	if (m_type == cb2_dynamicBody)
@@ -98,9 +108,13 @@ cb2Body::cb2Body(const cb2BodyDef* bd, cb2World* world)
 	m_invI = 0.0f;
 
 	m_userData = bd->userData;
+	m_region = bd->region;
 
 	m_fixtureList = NULL;
 	m_fixtureCount = 0;
+
+	// The world creates the aggregate, see cb2World::CreateBody.
+	m_aggregate = NULL;
 }
 
 cb2Body::~cb2Body()
@@ -108,6 +122,19 @@ cb2Body::~cb2Body()
 	// shapes and joints are destroyed in cb2World::Destroy
 }
 
+void cb2Body::SynchronizeAwake()
+{
+	if (m_flags & e_awakeFlag)
+	{
+		m_world->WakeIsland(m_island, this);
+	}
+
+	for (cb2ContactEdge* ce = m_contactList; ce; ce = ce->next)
+	{
+		m_world->m_contactManager.UpdateAwake(ce->contact);
+	}
+}
+
 void cb2Body::SetType(cb2BodyType type)
 {
 	cb2Assert(m_world->IsLocked() == false);
@@ -121,6 +148,14 @@ void cb2Body::SetType(cb2BodyType type)
 		return;
 	}
 
+	++m_world->m_topologyStamp;
+
+	// Static proxies live in a tree of their own.
+	bool moveProxies = (m_type == cb2_staticBody) != (type == cb2_staticBody);
+
+	// Static bodies don't belong to islands, their joints move to the other body's island.
+	m_world->RemoveFromIsland(this);
+
 	m_type = type;
 
 	ResetMassData();
@@ -149,10 +184,39 @@ void cb2Body::SetType(cb2BodyType type)
 	}
 	m_contactList = NULL;
 
+	m_world->AddToIsland(this);
+
 	// Touch the proxies so that new contacts will be created (when appropriate)
 	cb2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	if (m_aggregate)
+	{
+		// The aggregate proxy only changes trees once all fixtures are out of it.
+		if (moveProxies && m_aggregate->m_proxyCount > 0)
+		{
+			for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
+			{
+				f->DestroyProxies(broadPhase);
+			}
+			for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
+			{
+				f->CreateProxies(broadPhase, m_xf);
+			}
+		}
+
+		m_aggregate->Touch(broadPhase);
+		return;
+	}
+
 	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
+		if (moveProxies && f->m_proxyCount > 0)
+		{
+			// New proxies get paired like touched ones.
+			f->DestroyProxies(broadPhase);
+			f->CreateProxies(broadPhase, m_xf);
+			continue;
+		}
+
 		int proxyCount = f->m_proxyCount;
 		for (int i = 0; i < proxyCount; ++i)
 		{
@@ -169,11 +233,7 @@ cb2Fixture* cb2Body::CreateFixture(const cb2FixtureDef* def)
 		return NULL;
 	}
 
-	cb2BlockAllocator* allocator = &m_world->m_blockAllocator;
-
-	void* memory = allocator->Allocate(sizeof(cb2Fixture));
-	cb2Fixture* fixture = new (memory) cb2Fixture;
-	fixture->Create(allocator, this, def);
+	cb2Fixture* fixture = AddFixture(def);
 
 	if (m_flags & e_activeFlag)
 	{
@@ -181,16 +241,10 @@ cb2Fixture* cb2Body::CreateFixture(const cb2FixtureDef* def)
 		fixture->CreateProxies(broadPhase, m_xf);
 	}
 
-	fixture->m_next = m_fixtureList;
-	m_fixtureList = fixture;
-	++m_fixtureCount;
-
-	fixture->m_body = this;
-
 	// Adjust mass properties if needed.
 	if (fixture->m_density > 0.0f)
 	{
-		ResetMassData();
+		SetMassDirty();
 	}
 
 	// Let the world know we have a new fixture. This will cause new contacts
@@ -200,6 +254,26 @@ cb2Fixture* cb2Body::CreateFixture(const cb2FixtureDef* def)
 	return fixture;
 }
 
+// Create a fixture and link it to the body, without proxies or mass update.
+cb2Fixture* cb2Body::AddFixture(const cb2FixtureDef* def)
+{
+	cb2BlockAllocator* allocator = &m_world->m_blockAllocator;
+
+	void* memory = allocator->Allocate(sizeof(cb2Fixture));
+	cb2Fixture* fixture = new (memory) cb2Fixture;
+	fixture->Create(allocator, this, def);
+	fixture->m_handle = m_world->m_fixtureHandles.Create(fixture);
+	++m_world->m_topologyStamp;
+
+	fixture->m_next = m_fixtureList;
+	m_fixtureList = fixture;
+	++m_fixtureCount;
+
+	fixture->m_body = this;
+
+	return fixture;
+}
+
 cb2Fixture* cb2Body::CreateFixture(const cb2Shape* shape, float density)
 {
 	cb2FixtureDef def;
@@ -218,6 +292,7 @@ void cb2Body::DestroyFixture(cb2Fixture* fixture)
 	}
 
 	cb2Assert(fixture->m_body == this);
+	++m_world->m_topologyStamp;
 
 	// Remove the fixture from this body's singly linked list.
 	cb2Assert(m_fixtureCount > 0);
@@ -264,6 +339,7 @@ void cb2Body::DestroyFixture(cb2Fixture* fixture)
 		fixture->DestroyProxies(broadPhase);
 	}
 
+	m_world->m_fixtureHandles.Destroy(fixture->m_handle);
 	fixture->Destroy(allocator);
 	fixture->m_body = NULL;
 	fixture->m_next = NULL;
@@ -273,11 +349,19 @@ void cb2Body::DestroyFixture(cb2Fixture* fixture)
 	--m_fixtureCount;
 
 	// Reset the mass data.
-	ResetMassData();
+	SetMassDirty();
+}
+
+void cb2Body::SetMassDirty()
+{
+	m_flags |= e_massDirtyFlag;
+	m_world->m_flags |= cb2World::e_massDirty;
 }
 
 void cb2Body::ResetMassData()
 {
+	m_flags &= ~e_massDirtyFlag;
+
 	// Compute mass data from shapes. Each shape has its own density.
 	m_mass = 0.0f;
 	m_invMass = 0.0f;
@@ -361,6 +445,8 @@ void cb2Body::SetMassData(const cb2MassData* massData)
 		return;
 	}
 
+	m_flags &= ~e_massDirtyFlag;
+
 	m_invMass = 0.0f;
 	m_I = 0.0f;
 	m_invI = 0.0f;
@@ -420,6 +506,12 @@ void cb2Body::SetTransform(const ci::Vec2f& position, float angle)
 		return;
 	}
 
+	Teleport(position, angle);
+	MoveFixtureProxies(ci::Vec2f(0.0f, 0.0f));
+}
+
+void cb2Body::Teleport(const ci::Vec2f& position, float angle)
+{
 	m_xf.q.set(angle);
 	m_xf.p = position;
 
@@ -429,10 +521,11 @@ void cb2Body::SetTransform(const ci::Vec2f& position, float angle)
 	m_sweep.c0 = m_sweep.c;
 	m_sweep.a0 = angle;
 
-	cb2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	m_moveStamp = m_world->m_stepIndex;
+
 	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
-		f->Synchronize(broadPhase, m_xf, m_xf);
+		f->ComputeSweptAABBs(m_xf, m_xf);
 	}
 }
 
@@ -448,23 +541,61 @@ void cb2Body::SetPosition(ci::Vec2f& position)
 	m_sweep.c  = cb2Mul(m_xf, m_sweep.localCenter);
 	m_sweep.c0 = m_sweep.c;
 
-	cb2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
 	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
-		f->Synchronize(broadPhase, m_xf, m_xf);
+		f->ComputeSweptAABBs(m_xf, m_xf);
 	}
+	MoveFixtureProxies(ci::Vec2f(0.0f, 0.0f));
 }
 
 void cb2Body::SynchronizeFixtures()
+{
+	MoveFixtureProxies(ComputeFixtureAABBs());
+}
+
+ci::Vec2f cb2Body::ComputeFixtureAABBs()
 {
 	cb2Transform xf1;
 	xf1.q.set(m_sweep.a0);
 	xf1.p = m_sweep.c0 - cb2Mul(xf1.q, m_sweep.localCenter);
 
+	// Speculative contacts must exist before the shapes meet, so the AABBs sweep
+	// ahead over the next step instead.
+	float speculativeDt = m_world->m_contactManager.m_speculativeDt;
+	if (speculativeDt > 0.0f && m_type != cb2_staticBody)
+	{
+		cb2Transform xf2;
+		xf2.q.set(m_sweep.a + speculativeDt * m_angularVelocity);
+		xf2.p = m_sweep.c + speculativeDt * m_linearVelocity - cb2Mul(xf2.q, m_sweep.localCenter);
+
+		for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
+		{
+			f->ComputeSweptAABBs(m_xf, xf2);
+		}
+
+		return xf2.p - m_xf.p;
+	}
+
+	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
+	{
+		f->ComputeSweptAABBs(xf1, m_xf);
+	}
+
+	return m_xf.p - xf1.p;
+}
+
+void cb2Body::MoveFixtureProxies(const ci::Vec2f& displacement)
+{
 	cb2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	if (m_aggregate)
+	{
+		m_aggregate->MoveProxies(broadPhase, displacement);
+		return;
+	}
+
 	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
-		f->Synchronize(broadPhase, xf1, m_xf);
+		f->MoveProxies(broadPhase, displacement);
 	}
 }
 
@@ -477,6 +608,8 @@ void cb2Body::SetActive(bool flag)
 		return;
 	}
 
+	++m_world->m_topologyStamp;
+
 	if (flag)
 	{
 		m_flags |= e_activeFlag;
@@ -488,10 +621,14 @@ void cb2Body::SetActive(bool flag)
 			f->CreateProxies(broadPhase, m_xf);
 		}
 
+		m_world->AddToIsland(this);
+
 		// Contacts are created the next time step.
 	}
 	else
 	{
+		m_world->RemoveFromIsland(this);
+
 		m_flags &= ~e_activeFlag;
 
 		// Destroy all proxies.
@@ -554,6 +691,7 @@ void cb2Body::Dump()
 	cb2Log("  bd.bullet = bool(%d);\n", m_flags & e_bulletFlag);
 	cb2Log("  bd.active = bool(%d);\n", m_flags & e_activeFlag);
 	cb2Log("  bd.gravityScale = %.15lef;\n", m_gravityScale);
+	cb2Log("  bd.sleepScale = %.15lef;\n", m_sleepScale);
 	cb2Log("  bodies[%d] = m_world->CreateBody(&bd);\n", m_islandIndex);
 	cb2Log("\n");
 	for (cb2Fixture* f = m_fixtureList; f; f = f->m_next)
@@ -20,6 +20,7 @@
 #define CB2_BODY_H
 
 #include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
 #include <memory>
 
@@ -27,6 +28,8 @@ class cb2Fixture;
 class cb2Joint;
 class cb2Contact;
 class cb2Controller;
+class cb2BodyAggregate;
+struct cb2PersistentIsland;
 class cb2World;
 struct cb2FixtureDef;
 struct cb2JointEdge;
@@ -67,6 +70,9 @@ struct cb2BodyDef
 		type = cb2_staticBody;
 		active = true;
 		gravityScale = 1.0f;
+		sleepScale = 1.0f;
+		region = 0;
+		aggregate = false;
 	}
 
 	/// The body type: static, kinematic, or dynamic.
@@ -120,6 +126,21 @@ struct cb2BodyDef
 
 	/// Scale the gravity applied to this body.
 	float gravityScale;
+
+	/// Scale the sleep tolerances of the world for this body, see cb2SleepDef. Larger
+	/// values let restless bodies such as ragdoll limbs sleep sooner.
+	float sleepScale;
+
+	/// The streaming region of the body. Regions are activated, deactivated and
+	/// destroyed as a unit, see cb2World::SetRegionActive.
+	int region;
+
+	/// Keep the fixtures of this body out of the broad-phase. The body gets a single
+	/// broad-phase proxy and the fixtures are kept in a small tree of the body, which
+	/// pairs and queries only reach once they reach the body. This pays off for
+	/// bodies with many fixtures, such as vehicles and buildings, which otherwise
+	/// move that many proxies.
+	bool aggregate;
 };
 
 /// A rigid body. These are created via cb2World::CreateBody.
@@ -130,6 +151,8 @@ public:
 	/// to set some fixture parameters, like friction. Otherwise you can create the
 	/// fixture directly from a shape.
 	/// If the density is non-zero, this function automatically updates the mass of the body.
+	/// The update is deferred until the next time step or the next use of the mass, so
+	/// adding many fixtures costs one mass computation.
 	/// Contacts are not created until the next time step.
 	/// @param def the fixture definition.
 	/// @warning This function is locked during callbacks.
@@ -147,7 +170,7 @@ public:
 	/// Destroy a fixture. This removes the fixture from the broad-phase and
 	/// destroys all contacts associated with this fixture. This will
 	/// automatically adjust the mass of the body if the body is dynamic and the
-	/// fixture has positive density.
+	/// fixture has positive density. Like CreateFixture the adjustment is deferred.
 	/// All fixtures attached to a body are implicitly destroyed when the body is destroyed.
 	/// @param fixture the fixture to be removed.
 	/// @warning This function is locked during callbacks.
@@ -253,7 +276,8 @@ public:
 
 	/// This resets the mass properties to the sum of the mass properties of the fixtures.
 	/// This normally does not need to be called unless you called SetMassData to override
-	/// the mass and you later want to reset the mass.
+	/// the mass and you later want to reset the mass. It also flushes a mass update
+	/// deferred by CreateFixture or DestroyFixture.
 	void ResetMassData();
 
 	/// Get the world coordinates of a point given the local coordinates.
@@ -304,6 +328,10 @@ public:
 	/// set the gravity scale of the body.
 	void SetGravityScale(float scale);
 
+	/// Get/set the scale of the world sleep tolerances for this body.
+	float GetSleepScale() const { return m_sleepScale; }
+	void SetSleepScale(float scale) { cb2Assert(scale >= 0.0f); m_sleepScale = scale; }
+
 	/// set the type of this body. This may alter the mass and velocity.
 	void SetType(cb2BodyType type);
 
@@ -350,6 +378,9 @@ public:
 	/// Get the active state of the body.
 	bool IsActive() const;
 
+	/// Are the fixtures of this body kept in a tree of their own, see cb2BodyDef::aggregate?
+	bool IsAggregate() const;
+
 	/// Set this body to have fixed rotation. This causes the mass
 	/// to be reset.
 	void SetFixedRotation(bool flag);
@@ -381,6 +412,16 @@ public:
 	/// Set the user data. Use this to store your application specific data.
 	void SetUserData(void* data);
 
+	/// Get the streaming region that was provided in the body definition.
+	int GetRegion() const;
+
+	/// Move the body to another streaming region.
+	void SetRegion(int region);
+
+	/// Get the handle of this body, it resolves through cb2World::GetBody
+	/// until the body is destroyed.
+	cb2Handle GetHandle() const;
+
 	/// Get the parent world of this body.
 	cb2World* GetWorld();
 	const cb2World* GetWorld() const;
@@ -393,7 +434,10 @@ private:
 	friend class cb2World;
 	friend class cb2Island;
 	friend class cb2ContactManager;
+	friend class cb2Fixture;
+	friend class cb2BodyAggregate;
 	friend class cb2ContactSolver;
+	friend class cb2SoftContactSolver;
 	friend class cb2Contact;
 	
 	friend class cb2DistanceJoint;
@@ -417,25 +461,50 @@ private:
 		e_bulletFlag		= 0x0008,
 		e_fixedRotationFlag	= 0x0010,
 		e_activeFlag		= 0x0020,
-		e_toiFlag			= 0x0040
+		e_toiFlag			= 0x0040,
+		e_massDirtyFlag		= 0x0080,
+		e_discreteFlag		= 0x0100
 	};
 
 	cb2Body(const cb2BodyDef* bd, cb2World* world);
 	~cb2Body();
 
+	cb2Fixture* AddFixture(const cb2FixtureDef* def);
+
+	// Fixtures were added or removed, the mass is recomputed by the next time step
+	// or by the first use of it.
+	void SetMassDirty();
+
+	// Recompute the mass if it is dirty. The mass data is derived from the fixtures,
+	// so the const accessors may update it.
+	void UpdateMassData() const;
+
 	void SynchronizeFixtures();
 	void SynchronizeTransform();
 
+	// The two halves of SynchronizeFixtures. The first computes the swept AABBs of
+	// the fixtures and returns the displacement the second passes to the broad-phase.
+	ci::Vec2f ComputeFixtureAABBs();
+	void MoveFixtureProxies(const ci::Vec2f& displacement);
+
+	// The first half of SetTransform, without the broad-phase.
+	void Teleport(const ci::Vec2f& position, float angle);
+
 	// This is used to prevent connected bodies from colliding.
 	// It may lie, depending on the collideConnected flag.
 	bool ShouldCollide(const cb2Body* other) const;
 
 	void Advance(float t);
 
-	cb2BodyType m_type;
+	// Called when a body in a persistent island falls asleep or wakes up. Keeps the
+	// island and the awake contact array in step with the awake flag.
+	void SynchronizeAwake();
 
+	// Hot state. Everything the island integrator, the contact solver and the
+	// sleep test touch each step is packed here, at the front of the body, so a
+	// body costs two cache lines in the solver. Keep cold data below.
+	cb2BodyType m_type;
 	unsigned short m_flags;
-
 	int m_islandIndex;
 
 	cb2Transform m_xf;		// the body origin transform
@@ -447,30 +516,55 @@ private:
 	ci::Vec2f m_force;
 	float m_torque;
 
+	float m_invMass;
+	float m_invI;		// inverse rotational inertia about the center of mass
+
+	float m_linearDamping;
+	float m_angularDamping;
+	float m_gravityScale;
+	float m_sleepScale;
+
+	float m_sleepTime;
+
+	// The world step index of the step that last moved the body, see
+	// cb2World::ExportTransforms.
+	unsigned int m_moveStamp;
+
+	// The persistent island, NULL for static and inactive bodies.
+	cb2PersistentIsland* m_island;
+	cb2Body* m_islandPrev;
+	cb2Body* m_islandNext;
+
+	// Cold state, only read when the body or its fixtures change.
 	cb2World* m_world;
+	cb2Handle m_handle;
 	cb2Body* m_prev;
 	cb2Body* m_next;
 
 	cb2Fixture* m_fixtureList;
 	int m_fixtureCount;
 
+	// The tree of the fixture proxies of an aggregate body, NULL otherwise.
+	cb2BodyAggregate* m_aggregate;
+
 	cb2JointEdge* m_jointList;
 	cb2ContactEdge* m_contactList;
 
-	float m_mass, m_invMass;
+	float m_mass;
 
 	// Rotational inertia about the center of mass.
-	float m_I, m_invI;
-
-	float m_linearDamping;
-	float m_angularDamping;
-	float m_gravityScale;
-
-	float m_sleepTime;
+	float m_I;
 
 	void* m_userData;
+
+	int m_region;
 };
 
+inline cb2Handle cb2Body::GetHandle() const
+{
+	return m_handle;
+}
+
 inline cb2BodyType cb2Body::GetType() const
 {
 	return m_type;
@@ -493,11 +587,13 @@ inline float cb2Body::GetAngle() const
 
 inline const ci::Vec2f& cb2Body::GetWorldCenter() const
 {
+	UpdateMassData();
 	return m_sweep.c;
 }
 
 inline const ci::Vec2f& cb2Body::GetLocalCenter() const
 {
+	UpdateMassData();
 	return m_sweep.localCenter;
 }
 
@@ -543,16 +639,19 @@ inline float cb2Body::GetAngularVelocity() const
 
 inline float cb2Body::GetMass() const
 {
+	UpdateMassData();
 	return m_mass;
 }
 
 inline float cb2Body::GetInertia() const
 {
+	UpdateMassData();
 	return m_I + m_mass * cb2Dot(m_sweep.localCenter, m_sweep.localCenter);
 }
 
 inline void cb2Body::GetMassData(cb2MassData* data) const
 {
+	UpdateMassData();
 	data->mass = m_mass;
 	data->I = m_I + m_mass * cb2Dot(m_sweep.localCenter, m_sweep.localCenter);
 	data->center = m_sweep.localCenter;
@@ -580,6 +679,7 @@ inline ci::Vec2f cb2Body::GetLocalVector(const ci::Vec2f& worldVector) const
 
 inline ci::Vec2f cb2Body::GetLinearVelocityFromWorldPoint(const ci::Vec2f& worldPoint) const
 {
+	UpdateMassData();
 	return m_linearVelocity + cb2Cross(m_angularVelocity, worldPoint - m_sweep.c);
 }
 
@@ -635,6 +735,11 @@ inline bool cb2Body::IsBullet() const
 	return (m_flags & e_bulletFlag) == e_bulletFlag;
 }
 
+inline bool cb2Body::IsAggregate() const
+{
+	return m_aggregate != NULL;
+}
+
 inline void cb2Body::SetAwake(bool flag)
 {
 	if (flag)
@@ -643,16 +748,27 @@ inline void cb2Body::SetAwake(bool flag)
 		{
 			m_flags |= e_awakeFlag;
 			m_sleepTime = 0.0f;
+
+			if (m_island)
+			{
+				SynchronizeAwake();
+			}
 		}
 	}
 	else
 	{
+		bool wasAwake = (m_flags & e_awakeFlag) == e_awakeFlag;
 		m_flags &= ~e_awakeFlag;
 		m_sleepTime = 0.0f;
 		cb2::setZero(m_linearVelocity);
 		m_angularVelocity = 0.0f;
 		cb2::setZero(m_force);
 		m_torque = 0.0f;
+
+		if (wasAwake && m_island)
+		{
+			SynchronizeAwake();
+		}
 	}
 }
 
@@ -739,6 +855,16 @@ inline void* cb2Body::GetUserData() const
 	return m_userData;
 }
 
+inline int cb2Body::GetRegion() const
+{
+	return m_region;
+}
+
+inline void cb2Body::SetRegion(int region)
+{
+	m_region = region;
+}
+
 inline void cb2Body::ApplyForce(const ci::Vec2f& force, const ci::Vec2f& point, bool wake)
 {
 	if (m_type != cb2_dynamicBody)
@@ -754,6 +880,7 @@ inline void cb2Body::ApplyForce(const ci::Vec2f& force, const ci::Vec2f& point,
 	// Don't accumulate a force if the body is sleeping.
 	if (m_flags & e_awakeFlag)
 	{
+	UpdateMassData();
 	m_force += force;
 	m_torque += cb2Cross(point - m_sweep.c, force);
   }
@@ -812,6 +939,7 @@ inline void cb2Body::ApplyLinearImpulse(const ci::Vec2f& impulse, const ci::Vec2
 	// Don't accumulate velocity if the body is sleeping
 	if (m_flags & e_awakeFlag)
 	{
+    UpdateMassData();
     m_linearVelocity += m_invMass * impulse;
     m_angularVelocity += m_invI * cb2Cross(point - m_sweep.c, impulse);
   }
@@ -832,10 +960,19 @@ inline void cb2Body::ApplyAngularImpulse(float impulse, bool wake)
 	// Don't accumulate velocity if the body is sleeping
 	if (m_flags & e_awakeFlag)
 	{
+    UpdateMassData();
     m_angularVelocity += m_invI * impulse;
   }
 }
 
+inline void cb2Body::UpdateMassData() const
+{
+	if (m_flags & e_massDirtyFlag)
+	{
+		const_cast<cb2Body*>(this)->ResetMassData();
+	}
+}
+
 inline void cb2Body::SynchronizeTransform()
 {
 	m_xf.q.set(m_sweep.a);
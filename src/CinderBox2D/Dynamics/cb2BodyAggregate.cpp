@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+
+cb2BodyAggregate::cb2BodyAggregate(cb2Body* body, cb2AllocatorInterface* allocator)
+	: m_tree(allocator)
+{
+	m_proxy.aabb.lowerBound.set(0.0f, 0.0f);
+	m_proxy.aabb.upperBound.set(0.0f, 0.0f);
+	m_proxy.fixture = NULL;
+	m_proxy.childIndex = 0;
+	m_proxy.proxyId = cb2BroadPhase::e_nullProxy;
+	m_body = body;
+	m_proxyCount = 0;
+}
+
+void cb2BodyAggregate::CreateProxies(cb2BroadPhase* broadPhase, cb2Fixture* fixture, const cb2Transform& xf)
+{
+	cb2Assert(fixture->m_proxyCount == 0);
+
+	// Same as cb2Fixture::CreateProxies, in the tree of the body.
+	fixture->m_proxyCount = fixture->ComputeProxyCount();
+	for (int i = 0; i < fixture->m_proxyCount; ++i)
+	{
+		cb2FixtureProxy* proxy = fixture->m_proxies + i;
+		proxy->childIndex = fixture->m_sharedProxy ? (int)cb2Shape::e_allChildren : i;
+		fixture->m_shape->ComputeAABB(&proxy->aabb, xf, proxy->childIndex);
+		proxy->proxyId = m_tree.CreateProxy(proxy->aabb, proxy);
+		proxy->fixture = fixture;
+	}
+	m_proxyCount += fixture->m_proxyCount;
+
+	m_proxy.aabb = m_tree.GetRootAABB();
+	if (m_proxy.proxyId == cb2BroadPhase::e_nullProxy)
+	{
+		m_proxy.proxyId = broadPhase->CreateProxy(m_proxy.aabb, &m_proxy, m_body->m_type == cb2_staticBody);
+	}
+	else
+	{
+		// The new proxies are paired like touched ones.
+		broadPhase->MoveProxy(m_proxy.proxyId, m_proxy.aabb, ci::Vec2f(0.0f, 0.0f));
+		broadPhase->TouchProxy(m_proxy.proxyId);
+	}
+
+	SetProxyFilters(broadPhase, fixture);
+}
+
+void cb2BodyAggregate::DestroyProxies(cb2BroadPhase* broadPhase, cb2Fixture* fixture)
+{
+	if (fixture->m_proxyCount == 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < fixture->m_proxyCount; ++i)
+	{
+		cb2FixtureProxy* proxy = fixture->m_proxies + i;
+		m_tree.DestroyProxy(proxy->proxyId);
+		proxy->proxyId = cb2BroadPhase::e_nullProxy;
+	}
+	m_proxyCount -= fixture->m_proxyCount;
+	fixture->m_proxyCount = 0;
+
+	if (m_proxyCount == 0)
+	{
+		broadPhase->DestroyProxy(m_proxy.proxyId);
+		m_proxy.proxyId = cb2BroadPhase::e_nullProxy;
+		return;
+	}
+
+	// The aggregate proxy keeps its fat AABB and the filters of the other fixtures.
+	SetProxyFilters(broadPhase, NULL);
+}
+
+void cb2BodyAggregate::MoveProxies(cb2BroadPhase* broadPhase, const ci::Vec2f& displacement)
+{
+	if (m_proxy.proxyId == cb2BroadPhase::e_nullProxy)
+	{
+		return;
+	}
+
+	bool moved = false;
+	for (cb2Fixture* f = m_body->m_fixtureList; f; f = f->m_next)
+	{
+		for (int i = 0; i < f->m_proxyCount; ++i)
+		{
+			cb2FixtureProxy* proxy = f->m_proxies + i;
+			moved |= m_tree.MoveProxy(proxy->proxyId, proxy->aabb, displacement);
+		}
+	}
+
+	if (moved == false)
+	{
+		return;
+	}
+
+	// A proxy that left its fat AABB may overlap proxies the aggregate proxy was
+	// already paired with, so the pairs are found again even if it stays put.
+	m_proxy.aabb = m_tree.GetRootAABB();
+	if (broadPhase->GetFatAABB(m_proxy.proxyId).Contains(m_proxy.aabb))
+	{
+		broadPhase->TouchProxy(m_proxy.proxyId);
+	}
+	else
+	{
+		broadPhase->MoveProxy(m_proxy.proxyId, m_proxy.aabb, displacement);
+	}
+}
+
+void cb2BodyAggregate::SetProxyFilters(cb2BroadPhase* broadPhase, const cb2Fixture* fixture)
+{
+	if (fixture)
+	{
+		unsigned short maskBits = fixture->m_filter.groupIndex > 0 ? 0xFFFF : fixture->m_filter.maskBits;
+		for (int i = 0; i < fixture->m_proxyCount; ++i)
+		{
+			m_tree.SetProxyFilter(fixture->m_proxies[i].proxyId, fixture->m_filter.categoryBits, maskBits);
+		}
+	}
+
+	if (m_proxy.proxyId == cb2BroadPhase::e_nullProxy)
+	{
+		return;
+	}
+
+	unsigned short categoryBits = 0;
+	unsigned short maskBits = 0;
+	for (const cb2Fixture* f = m_body->m_fixtureList; f; f = f->m_next)
+	{
+		if (f->m_proxyCount > 0)
+		{
+			categoryBits |= f->m_filter.categoryBits;
+			maskBits |= f->m_filter.groupIndex > 0 ? 0xFFFF : f->m_filter.maskBits;
+		}
+	}
+	broadPhase->SetProxyFilter(m_proxy.proxyId, categoryBits, maskBits);
+}
+
+void cb2BodyAggregate::Touch(cb2BroadPhase* broadPhase)
+{
+	if (m_proxy.proxyId != cb2BroadPhase::e_nullProxy)
+	{
+		broadPhase->TouchProxy(m_proxy.proxyId);
+	}
+}
+
+void cb2BodyAggregate::ShiftOrigin(const ci::Vec2f& newOrigin)
+{
+	m_tree.ShiftOrigin(newOrigin);
+	m_proxy.aabb.lowerBound -= newOrigin;
+	m_proxy.aabb.upperBound -= newOrigin;
+}
+
+void cb2BodyAggregate::Save(cb2Snapshot* snapshot) const
+{
+	snapshot->Write(m_proxy.proxyId);
+	m_tree.Save(snapshot);
+}
+
+bool cb2BodyAggregate::Load(cb2Snapshot* snapshot)
+{
+	int proxyId = snapshot->Read<int>();
+	if (snapshot->IsValid() == false || m_tree.Load(snapshot) == false)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	int proxyCount = 0;
+	for (cb2Fixture* f = m_body->m_fixtureList; f; f = f->m_next)
+	{
+		for (int i = 0; i < f->m_proxyCount; ++i)
+		{
+			cb2FixtureProxy* proxy = f->m_proxies + i;
+			if (m_tree.IsProxy(proxy->proxyId) == false || m_tree.GetUserData(proxy->proxyId) != NULL)
+			{
+				snapshot->Invalidate();
+				return false;
+			}
+
+			m_tree.SetUserData(proxy->proxyId, proxy);
+			++proxyCount;
+		}
+	}
+
+	// Each proxy of the tree is one of a fixture, and the aggregate proxy exists exactly
+	// while the tree has proxies.
+	if (proxyCount != m_tree.GetProxyCount() || (proxyCount > 0) != (proxyId != cb2BroadPhase::e_nullProxy))
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	m_proxy.proxyId = proxyId;
+	m_proxyCount = proxyCount;
+	if (proxyCount > 0)
+	{
+		m_proxy.aabb = m_tree.GetRootAABB();
+	}
+	return true;
+}
@@ -0,0 +1,284 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_BODY_AGGREGATE_H
+#define CB2_BODY_AGGREGATE_H
+
+#include <CinderBox2D/Collision/cb2BroadPhase.h>
+#include <CinderBox2D/Collision/cb2DynamicTree.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+
+class cb2Body;
+class cb2Snapshot;
+
+/// Hands the fixture proxies under a traversal of an aggregate tree to a callback.
+template <typename T>
+struct cb2AggregateCallback
+{
+	bool QueryCallback(int nodeId)
+	{
+		proceed = callback->QueryProxy((const cb2FixtureProxy*)tree->GetUserData(nodeId));
+		return proceed;
+	}
+
+	float RayCastCallback(const cb2RayCastInput& input, int nodeId)
+	{
+		float value = callback->RayCastProxy(input, (const cb2FixtureProxy*)tree->GetUserData(nodeId));
+		if (value == 0.0f)
+		{
+			proceed = false;
+		}
+		else if (value > 0.0f)
+		{
+			maxFraction = value;
+		}
+		return value;
+	}
+
+	// The tree starts the sweep at a fraction of one, the broad-phase may be further on.
+	float ShapeCastCallback(float fraction, int nodeId)
+	{
+		float value = callback->ShapeCastProxy(cb2Min(fraction, maxFraction), (const cb2FixtureProxy*)tree->GetUserData(nodeId));
+		if (value == 0.0f)
+		{
+			proceed = false;
+		}
+		else if (value > 0.0f)
+		{
+			maxFraction = value;
+		}
+		return value;
+	}
+
+	const cb2DynamicTree* tree;
+	T* callback;
+	bool proceed;
+	float maxFraction;
+};
+
+/// The fixture proxies of an aggregate body, see cb2BodyDef::aggregate. They live
+/// in a small tree of the body rather than in the broad-phase, which only holds the
+/// aggregate proxy covering all of them. The aggregate proxy has no fixture: the
+/// pairs and queries that reach it go on into the tree. The tree is in world space
+/// like the broad-phase, and a fixture proxy leaving its fat AABB moves in it and
+/// touches the aggregate proxy, so its new pairs are found. A moving aggregate body
+/// thus moves one broad-phase proxy instead of one per fixture child.
+class cb2BodyAggregate
+{
+public:
+	cb2BodyAggregate(cb2Body* body, cb2AllocatorInterface* allocator);
+
+	/// Get the aggregate of an aggregate proxy, the proxy without a fixture.
+	static const cb2BodyAggregate* FromProxy(const cb2FixtureProxy* proxy);
+
+	/// Put the proxies of a fixture into the tree. The aggregate proxy is created
+	/// with the first of them and touched for the others.
+	void CreateProxies(cb2BroadPhase* broadPhase, cb2Fixture* fixture, const cb2Transform& xf);
+
+	/// Take the proxies of a fixture out of the tree. The aggregate proxy is destroyed
+	/// with the last of them.
+	void DestroyProxies(cb2BroadPhase* broadPhase, cb2Fixture* fixture);
+
+	/// Move the proxies of all fixtures to their swept AABBs, then the aggregate proxy.
+	void MoveProxies(cb2BroadPhase* broadPhase, const ci::Vec2f& displacement);
+
+	/// Set the filters of the proxies of a fixture. The aggregate proxy gets the union
+	/// of the filters of all fixtures.
+	void SetProxyFilters(cb2BroadPhase* broadPhase, const cb2Fixture* fixture);
+
+	/// Find the pairs again on the next UpdatePairs.
+	void Touch(cb2BroadPhase* broadPhase);
+
+	/// Shift the tree with the broad-phase.
+	void ShiftOrigin(const ci::Vec2f& newOrigin);
+
+	/// Save the aggregate proxy id and the tree, without the user data.
+	void Save(cb2Snapshot* snapshot) const;
+
+	/// Load what Save wrote and give the loaded proxies their user data again, the
+	/// fixture proxies of the body must be loaded. Returns false for a bad snapshot.
+	bool Load(cb2Snapshot* snapshot);
+
+	/// Query the tree, see cb2QueryFixtureProxies. Returns false if the callback ended the query.
+	template <typename T>
+	bool Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const;
+
+	/// Ray-cast the tree. Returns 0 if the callback ended the cast and the current
+	/// maximum fraction otherwise.
+	template <typename T>
+	float RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const;
+
+	/// Sweep an AABB against the tree. Returns 0 if the callback ended the cast and
+	/// the current maximum fraction otherwise.
+	template <typename T>
+	float ShapeCast(T* callback, float maxFraction, const cb2AABB& aabb, const ci::Vec2f& translation) const;
+
+	// The aggregate proxy in the broad-phase, first so that FromProxy can find the
+	// aggregate. Its AABB is the root of the tree.
+	cb2FixtureProxy m_proxy;
+
+	cb2Body* m_body;
+	cb2DynamicTree m_tree;
+
+	// The fixture proxies in the tree.
+	int m_proxyCount;
+};
+
+/// Passes the fixture proxies found by a broad-phase traversal to QueryProxy,
+/// RayCastProxy or ShapeCastProxy of a callback, with the fixture proxies of an
+/// aggregate proxy in place of it.
+template <typename T>
+struct cb2FixtureProxyCallback
+{
+	bool QueryCallback(int proxyId)
+	{
+		const cb2FixtureProxy* proxy = (const cb2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		if (proxy->fixture)
+		{
+			return callback->QueryProxy(proxy);
+		}
+		return cb2BodyAggregate::FromProxy(proxy)->Query(callback, aabb, maskBits);
+	}
+
+	float RayCastCallback(const cb2RayCastInput& input, int proxyId)
+	{
+		const cb2FixtureProxy* proxy = (const cb2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		if (proxy->fixture)
+		{
+			return callback->RayCastProxy(input, proxy);
+		}
+		return cb2BodyAggregate::FromProxy(proxy)->RayCast(callback, input, maskBits);
+	}
+
+	float ShapeCastCallback(float maxFraction, int proxyId)
+	{
+		const cb2FixtureProxy* proxy = (const cb2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		if (proxy->fixture)
+		{
+			return callback->ShapeCastProxy(maxFraction, proxy);
+		}
+		return cb2BodyAggregate::FromProxy(proxy)->ShapeCast(callback, maxFraction, aabb, translation);
+	}
+
+	const cb2BroadPhase* broadPhase;
+	T* callback;
+	cb2AABB aabb;
+	ci::Vec2f translation;
+	unsigned short maskBits;
+};
+
+/// Query the broad-phase for the fixture proxies whose fat AABBs overlap an AABB,
+/// see cb2BroadPhase::Query. The callback implements bool QueryProxy(const cb2FixtureProxy*).
+template <typename T>
+inline void cb2QueryFixtureProxies(const cb2BroadPhase* broadPhase, T* callback, const cb2AABB& aabb,
+								   unsigned short maskBits = 0xFFFF)
+{
+	cb2FixtureProxyCallback<T> proxyCallback;
+	proxyCallback.broadPhase = broadPhase;
+	proxyCallback.callback = callback;
+	proxyCallback.aabb = aabb;
+	proxyCallback.maskBits = maskBits;
+	broadPhase->Query(&proxyCallback, aabb, maskBits);
+}
+
+/// Like cb2QueryFixtureProxies for the proxies that are not static, see
+/// cb2BroadPhase::QueryMovingProxies.
+template <typename T>
+inline void cb2QueryMovingFixtureProxies(const cb2BroadPhase* broadPhase, T* callback, const cb2AABB& aabb,
+										 unsigned short maskBits)
+{
+	cb2FixtureProxyCallback<T> proxyCallback;
+	proxyCallback.broadPhase = broadPhase;
+	proxyCallback.callback = callback;
+	proxyCallback.aabb = aabb;
+	proxyCallback.maskBits = maskBits;
+	broadPhase->QueryMovingProxies(&proxyCallback, aabb, maskBits);
+}
+
+/// Ray-cast the fixture proxies, see cb2BroadPhase::RayCast. The callback implements
+/// float RayCastProxy(const cb2RayCastInput&, const cb2FixtureProxy*).
+template <typename T>
+inline void cb2RayCastFixtureProxies(const cb2BroadPhase* broadPhase, T* callback, const cb2RayCastInput& input,
+									 unsigned short maskBits = 0xFFFF)
+{
+	cb2FixtureProxyCallback<T> proxyCallback;
+	proxyCallback.broadPhase = broadPhase;
+	proxyCallback.callback = callback;
+	proxyCallback.maskBits = maskBits;
+	broadPhase->RayCast(&proxyCallback, input, maskBits);
+}
+
+/// Sweep an AABB against the fixture proxies, see cb2BroadPhase::ShapeCast. The
+/// callback implements float ShapeCastProxy(float, const cb2FixtureProxy*).
+template <typename T>
+inline void cb2ShapeCastFixtureProxies(const cb2BroadPhase* broadPhase, T* callback, const cb2AABB& aabb,
+									   const ci::Vec2f& translation)
+{
+	cb2FixtureProxyCallback<T> proxyCallback;
+	proxyCallback.broadPhase = broadPhase;
+	proxyCallback.callback = callback;
+	proxyCallback.aabb = aabb;
+	proxyCallback.translation = translation;
+	proxyCallback.maskBits = 0xFFFF;
+	broadPhase->ShapeCast(&proxyCallback, aabb, translation);
+}
+
+inline const cb2BodyAggregate* cb2BodyAggregate::FromProxy(const cb2FixtureProxy* proxy)
+{
+	cb2Assert(proxy->fixture == NULL);
+	return (const cb2BodyAggregate*)proxy;
+}
+
+template <typename T>
+inline bool cb2BodyAggregate::Query(T* callback, const cb2AABB& aabb, unsigned short maskBits) const
+{
+	cb2AggregateCallback<T> treeCallback;
+	treeCallback.tree = &m_tree;
+	treeCallback.callback = callback;
+	treeCallback.proceed = true;
+	m_tree.Query(&treeCallback, aabb, maskBits);
+	return treeCallback.proceed;
+}
+
+template <typename T>
+inline float cb2BodyAggregate::RayCast(T* callback, const cb2RayCastInput& input, unsigned short maskBits) const
+{
+	cb2AggregateCallback<T> treeCallback;
+	treeCallback.tree = &m_tree;
+	treeCallback.callback = callback;
+	treeCallback.proceed = true;
+	treeCallback.maxFraction = input.maxFraction;
+	m_tree.RayCast(&treeCallback, input, maskBits);
+	return treeCallback.proceed ? treeCallback.maxFraction : 0.0f;
+}
+
+template <typename T>
+inline float cb2BodyAggregate::ShapeCast(T* callback, float maxFraction, const cb2AABB& aabb,
+										 const ci::Vec2f& translation) const
+{
+	cb2AggregateCallback<T> treeCallback;
+	treeCallback.tree = &m_tree;
+	treeCallback.callback = callback;
+	treeCallback.proceed = true;
+	treeCallback.maxFraction = maxFraction;
+	m_tree.ShapeCast(&treeCallback, aabb, translation);
+	return treeCallback.proceed ? treeCallback.maxFraction : 0.0f;
+}
+
+#endif
@@ -0,0 +1,345 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/cb2CharacterController.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Collision/cb2Collision.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+
+// The most surfaces a character is pushed out of per iteration.
+static const int cb2_maxCharacterPlanes = 8;
+
+cb2CharacterController::cb2CharacterController()
+{
+	cb2CharacterDef def;
+	Initialize(&def);
+}
+
+void cb2CharacterController::Initialize(const cb2CharacterDef* def)
+{
+	cb2Assert(def->shape == NULL || def->shape->GetChildCount() == 1);
+	cb2Assert(cb2::isValid(def->up) && cb2Abs(def->up.length() - 1.0f) < 10.0f * cb2_epsilon);
+	cb2Assert(def->stepHeight >= 0.0f && def->skinWidth > 0.0f && def->maxIterations > 0);
+
+	m_shape = def->shape;
+	m_position = def->position;
+	m_up = def->up;
+
+	float s, c;
+	cb2SinCos(def->maxSlopeAngle, &s, &c);
+	m_minSlopeCosine = c;
+
+	m_stepHeight = def->stepHeight;
+	m_skinWidth = def->skinWidth;
+	m_maxIterations = def->maxIterations;
+	m_maskBits = def->maskBits;
+
+	m_groundFixture = NULL;
+	cb2::setZero(m_groundNormal);
+
+	m_userData = def->userData;
+}
+
+bool cb2CharacterController::IsWalkable(const ci::Vec2f& normal) const
+{
+	return cb2Dot(normal, m_up) >= m_minSlopeCosine;
+}
+
+// A rounded shape resting on the edge of a ledge gets the normal of the corner, so the
+// face under the corner is ray-cast for its normal.
+bool cb2CharacterController::IsGround(const cb2World* world, const cb2RayCastHit& hit, ci::Vec2f* normal) const
+{
+	if (IsWalkable(hit.normal))
+	{
+		*normal = hit.normal;
+		return true;
+	}
+
+	ci::Vec2f inward = cb2Dot(hit.normal, m_up) * m_up - hit.normal;
+	float length = inward.length();
+	if (length < cb2_epsilon || cb2Dot(hit.normal, m_up) <= 0.0f)
+	{
+		return false;
+	}
+
+	float reach = m_skinWidth + cb2_polygonRadius;
+	ci::Vec2f point = hit.point + (reach / length) * inward;
+
+	cb2RayCastInput input;
+	input.p1 = point + reach * m_up;
+	input.p2 = point - reach * m_up;
+	input.maxFraction = 1.0f;
+
+	cb2RayCastHit face;
+	world->RayCastBatch(&input, &face, 1, m_maskBits);
+	if (face.fixture == NULL || IsWalkable(face.normal) == false)
+	{
+		return false;
+	}
+
+	*normal = face.normal;
+	return true;
+}
+
+bool cb2CharacterController::Cast(const cb2World* world, const ci::Vec2f& position, const ci::Vec2f& translation,
+								cb2RayCastHit* hit) const
+{
+	if (translation.lengthSquared() < cb2_epsilon * cb2_epsilon)
+	{
+		return false;
+	}
+
+	cb2Transform xf;
+	xf.set(position, 0.0f);
+	return world->ShapeCast(m_shape, xf, translation, hit, m_maskBits);
+}
+
+// Shape casts ignore the surfaces they start in, so the character is pushed out of
+// them first. Each surface is pushed out of in turn, counting the earlier pushes.
+void cb2CharacterController::Depenetrate(const cb2World* world)
+{
+	cb2ContactPlane planes[cb2_maxCharacterPlanes];
+
+	for (int i = 0; i < m_maxIterations; ++i)
+	{
+		cb2Transform xf;
+		xf.set(m_position, 0.0f);
+		int count = world->CollideShape(m_shape, xf, 0.0f, planes, cb2_maxCharacterPlanes, m_maskBits);
+		count = cb2Min(count, cb2_maxCharacterPlanes);
+		if (count == 0)
+		{
+			return;
+		}
+
+		ci::Vec2f push = ci::Vec2f::zero();
+		for (int j = 0; j < count; ++j)
+		{
+			float separation = planes[j].separation + cb2Dot(push, planes[j].normal);
+			if (separation < 0.0f)
+			{
+				push += (m_skinWidth - separation) * planes[j].normal;
+			}
+		}
+
+		if (push.lengthSquared() < cb2_epsilon * cb2_epsilon)
+		{
+			return;
+		}
+
+		m_position += push;
+	}
+}
+
+// Shape casts stop with the surfaces overlapping by the polygon skin. Backing off by
+// this gap along the hit normal leaves the character one skin width away.
+void cb2CharacterController::Slide(const cb2World* world, const ci::Vec2f& translation, bool walking)
+{
+	float gap = m_skinWidth + cb2_polygonRadius;
+	ci::Vec2f remaining = translation;
+	ci::Vec2f previousNormal = ci::Vec2f::zero();
+
+	for (int i = 0; i < m_maxIterations; ++i)
+	{
+		float length = remaining.length();
+		if (length < cb2_epsilon)
+		{
+			return;
+		}
+
+		// The cast reaches one gap further, so a move that ends closer than the skin
+		// width to a surface stops at the skin width too.
+		ci::Vec2f direction = (1.0f / length) * remaining;
+		cb2RayCastHit hit;
+		if (Cast(world, m_position, (length + gap) * direction, &hit) == false)
+		{
+			m_position += remaining;
+			return;
+		}
+
+		float contact = hit.fraction * (length + gap);
+
+		// Climb the ledge if it is low enough. The step starts from before the hit so
+		// backing off the ledge does not eat into the move.
+		ci::Vec2f normal = hit.normal;
+		bool walkable = IsWalkable(normal);
+		if (walking && walkable == false && m_groundFixture != NULL && m_stepHeight > 0.0f &&
+			Step(world, remaining))
+		{
+			return;
+		}
+
+		m_position += contact * direction + gap * normal;
+		remaining = cb2Max(length - contact, 0.0f) * direction;
+
+		if (walking && walkable == false)
+		{
+			// The steep surface is a wall, so walking never climbs it.
+			normal -= cb2Dot(normal, m_up) * m_up;
+			float length = normal.length();
+			if (length < cb2_epsilon)
+			{
+				return;
+			}
+			normal *= 1.0f / length;
+		}
+		else if (walking == false && walkable && cb2Dot(remaining, m_up) < 0.0f)
+		{
+			// Landed, the character does not slide down walkable slopes.
+			return;
+		}
+
+		float approach = cb2Dot(remaining, normal);
+		if (approach < 0.0f)
+		{
+			remaining -= approach * normal;
+		}
+
+		// Two surfaces facing each other form a corner the move cannot leave.
+		if (cb2Dot(remaining, previousNormal) < 0.0f)
+		{
+			return;
+		}
+
+		previousNormal = normal;
+	}
+}
+
+// Rise by up to the step height, move forward and drop back down. The step is only
+// taken if the character lands on a walkable surface further along.
+bool cb2CharacterController::Step(const cb2World* world, const ci::Vec2f& translation)
+{
+	float gap = m_skinWidth + cb2_polygonRadius;
+	cb2RayCastHit hit;
+
+	float height = m_stepHeight;
+	if (Cast(world, m_position, height * m_up, &hit))
+	{
+		height = hit.fraction * height - gap;
+	}
+
+	if (height <= m_skinWidth)
+	{
+		return false;
+	}
+
+	ci::Vec2f position = m_position + height * m_up;
+	if (Cast(world, position, translation, &hit))
+	{
+		position += hit.fraction * translation + gap * hit.normal;
+	}
+	else
+	{
+		position += translation;
+	}
+
+	ci::Vec2f drop = -(height + gap + m_skinWidth) * m_up;
+	ci::Vec2f normal;
+	if (Cast(world, position, drop, &hit) == false || IsGround(world, hit, &normal) == false)
+	{
+		return false;
+	}
+
+	// Back off straight up, along the normal of a corner the character would slide back.
+	position += hit.fraction * drop + gap * m_up;
+	if (cb2Dot(position - m_position, translation) < cb2_epsilon)
+	{
+		return false;
+	}
+
+	m_position = position;
+	return true;
+}
+
+void cb2CharacterController::FindGround(const cb2World* world)
+{
+	m_groundFixture = NULL;
+	cb2::setZero(m_groundNormal);
+
+	cb2RayCastHit hit;
+	ci::Vec2f probe = -(2.0f * m_skinWidth + cb2_polygonRadius) * m_up;
+	if (Cast(world, m_position, probe, &hit) && IsGround(world, hit, &m_groundNormal))
+	{
+		m_groundFixture = hit.fixture;
+	}
+}
+
+void cb2CharacterController::Move(const cb2World* world, const ci::Vec2f& translation)
+{
+	cb2Assert(m_shape != NULL);
+	cb2Assert(world->IsLocked() == false);
+
+	Depenetrate(world);
+
+	bool wasGrounded = m_groundFixture != NULL;
+	float rise = cb2Dot(translation, m_up);
+	Slide(world, translation - rise * m_up, true);
+	Slide(world, rise * m_up, false);
+	FindGround(world);
+
+	// Keep a walking character on the ground down slopes and steps instead of
+	// letting it leave the ground for a few steps.
+	if (m_groundFixture == NULL && wasGrounded && rise <= 0.0f && m_stepHeight > 0.0f)
+	{
+		cb2RayCastHit hit;
+		ci::Vec2f drop = -m_stepHeight * m_up;
+		if (Cast(world, m_position, drop, &hit) && IsGround(world, hit, &m_groundNormal))
+		{
+			m_position += hit.fraction * drop + (m_skinWidth + cb2_polygonRadius) * hit.normal;
+			m_groundFixture = hit.fixture;
+		}
+	}
+}
+
+struct cb2CharacterMoveContext
+{
+	const cb2World* world;
+	cb2CharacterController* characters;
+	const ci::Vec2f* translations;
+};
+
+void cb2CharacterController::MoveTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+
+	cb2CharacterMoveContext* batch = (cb2CharacterMoveContext*)context;
+	for (int i = begin; i < end; ++i)
+	{
+		batch->characters[i].Move(batch->world, batch->translations[i]);
+	}
+}
+
+void cb2CharacterController::MoveBatch(const cb2World* world, cb2CharacterController* characters,
+									const ci::Vec2f* translations, int count, cb2TaskScheduler* scheduler)
+{
+	cb2CharacterMoveContext context;
+	context.world = world;
+	context.characters = characters;
+	context.translations = translations;
+
+	// A move is a handful of shape casts, hand them out in ranges.
+	if (scheduler && count > 32)
+	{
+		void* group = scheduler->EnqueueRange(MoveTask, &context, count, 16);
+		scheduler->Wait(group);
+	}
+	else
+	{
+		MoveTask(&context, 0, count, 0);
+	}
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_CHARACTER_CONTROLLER_H
+#define CB2_CHARACTER_CONTROLLER_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+
+class cb2Fixture;
+class cb2Shape;
+class cb2TaskScheduler;
+class cb2World;
+struct cb2RayCastHit;
+
+/// A character definition holds the data needed to initialize a character controller.
+struct cb2CharacterDef
+{
+	/// The constructor sets the default character definition values.
+	cb2CharacterDef()
+	{
+		shape = NULL;
+		cb2::setZero(position);
+		up.set(0.0f, 1.0f);
+		maxSlopeAngle = 0.25f * cb2_pi;
+		stepHeight = 0.25f;
+		skinWidth = 2.0f * cb2_linearSlop;
+		maxIterations = 4;
+		maskBits = 0xFFFF;
+		userData = NULL;
+	}
+
+	/// The shape of the character, usually a capsule. It must have a single child and
+	/// stay in scope while the character is in use. Characters may share a shape.
+	const cb2Shape* shape;
+
+	/// The position of the shape's origin in world coordinates.
+	ci::Vec2f position;
+
+	/// The unit up direction, usually against gravity.
+	ci::Vec2f up;
+
+	/// Surfaces steeper than this angle from the up direction, in radians, are walls.
+	float maxSlopeAngle;
+
+	/// The tallest ledge the character climbs while walking, in meters.
+	float stepHeight;
+
+	/// The gap kept between the character and the surfaces it touches, in meters.
+	float skinWidth;
+
+	/// The most surfaces a move slides along before it stops.
+	int maxIterations;
+
+	/// Only fixtures with a category bit in this mask block the character. Leave
+	/// the sensors out with it.
+	unsigned short maskBits;
+
+	/// Use this to store application specific character data.
+	void* userData;
+};
+
+/// A kinematic character that moves through a world with shape casts. It slides along
+/// the surfaces it hits, climbs ledges up to its step height, and does not climb slopes
+/// steeper than its slope limit. The character has no body, so it costs no contacts
+/// or solver time, and moving it only reads the world. Characters are plain objects
+/// that can be kept in an array.
+class cb2CharacterController
+{
+public:
+	cb2CharacterController();
+
+	/// Initialize the character from a definition. No reference to the definition is retained.
+	void Initialize(const cb2CharacterDef* def);
+
+	/// Move the character by a translation, for example its velocity times the time step.
+	/// The part along the up direction is moved after the rest, so a falling character
+	/// lands on the ground instead of sliding down walkable slopes.
+	/// @warning Don't call this during Step.
+	void Move(const cb2World* world, const ci::Vec2f& translation);
+
+	/// Move many characters. The world is only read, so with a scheduler the characters
+	/// are moved on its threads.
+	/// @param translations the translation of each character.
+	static void MoveBatch(const cb2World* world, cb2CharacterController* characters,
+						const ci::Vec2f* translations, int count, cb2TaskScheduler* scheduler = NULL);
+
+	/// Get the position of the character shape's origin.
+	const ci::Vec2f& GetPosition() const { return m_position; }
+
+	/// Teleport the character. It is pushed out of the world on the next move.
+	void SetPosition(const ci::Vec2f& position) { m_position = position; }
+
+	/// Is the character standing on a walkable surface after the last move?
+	bool IsGrounded() const { return m_groundFixture != NULL; }
+
+	/// Get the surface the character stands on, NULL when it is in the air.
+	const cb2Fixture* GetGroundFixture() const { return m_groundFixture; }
+
+	/// Get the normal of the surface the character stands on.
+	const ci::Vec2f& GetGroundNormal() const { return m_groundNormal; }
+
+	/// Get the user data pointer that was provided in the character definition.
+	void* GetUserData() const { return m_userData; }
+
+	/// Set the user data.
+	void SetUserData(void* data) { m_userData = data; }
+
+private:
+
+	static void MoveTask(void* context, int begin, int end, int threadIndex);
+
+	bool IsWalkable(const ci::Vec2f& normal) const;
+	bool IsGround(const cb2World* world, const cb2RayCastHit& hit, ci::Vec2f* normal) const;
+	void Depenetrate(const cb2World* world);
+	void Slide(const cb2World* world, const ci::Vec2f& translation, bool walking);
+	bool Step(const cb2World* world, const ci::Vec2f& translation);
+	bool Cast(const cb2World* world, const ci::Vec2f& position, const ci::Vec2f& translation,
+			cb2RayCastHit* hit) const;
+	void FindGround(const cb2World* world);
+
+	const cb2Shape* m_shape;
+	ci::Vec2f m_position;
+	ci::Vec2f m_up;
+	float m_minSlopeCosine;
+	float m_stepHeight;
+	float m_skinWidth;
+	int m_maxIterations;
+	unsigned short m_maskBits;
+
+	const cb2Fixture* m_groundFixture;
+	ci::Vec2f m_groundNormal;
+
+	void* m_userData;
+};
+
+#endif
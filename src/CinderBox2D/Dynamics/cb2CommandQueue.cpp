@@ -0,0 +1,394 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/cb2CommandQueue.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/Joints/cb2DistanceJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2FrictionJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2GearJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MotorJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MouseJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PrismaticJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PulleyJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RevoluteJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RopeJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WeldJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WheelJoint.h>
+#include <new>
+
+enum cb2CommandType
+{
+	e_createBodyCommand,
+	e_destroyBodyCommand,
+	e_createJointCommand,
+	e_destroyJointCommand,
+	e_setTransformCommand,
+	e_setVelocityCommand,
+	e_applyForceCommand,
+	e_applyLinearImpulseCommand,
+	e_applyAngularImpulseCommand,
+	e_setTypeCommand,
+	e_setAwakeCommand,
+	e_setActiveCommand,
+	e_setUserDataCommand
+};
+
+// A queued command. The defs of creates follow it in the same allocation.
+struct cb2Command
+{
+	cb2Command* next;
+	int type;
+	cb2Handle handle;
+	ci::Vec2f vector1;
+	ci::Vec2f vector2;
+	float scalar;
+	int count;
+	bool flag;
+	void* pointer;
+};
+
+static const int cb2_commandPayloadOffset = (sizeof(cb2Command) + 15) & ~15;
+
+static inline void* cb2GetPayload(cb2Command* command)
+{
+	return (char*)command + cb2_commandPayloadOffset;
+}
+
+// Joint defs are copied by their full type.
+template <typename T>
+static inline int cb2CopyJointDef(void* mem, const cb2JointDef* def)
+{
+	if (mem)
+	{
+		new (mem) T(*(const T*)def);
+	}
+	return sizeof(T);
+}
+
+static int cb2CopyJointDef(void* mem, const cb2JointDef* def)
+{
+	switch (def->type)
+	{
+	case e_revoluteJoint:
+		return cb2CopyJointDef<cb2RevoluteJointDef>(mem, def);
+	case e_prismaticJoint:
+		return cb2CopyJointDef<cb2PrismaticJointDef>(mem, def);
+	case e_distanceJoint:
+		return cb2CopyJointDef<cb2DistanceJointDef>(mem, def);
+	case e_pulleyJoint:
+		return cb2CopyJointDef<cb2PulleyJointDef>(mem, def);
+	case e_mouseJoint:
+		return cb2CopyJointDef<cb2MouseJointDef>(mem, def);
+	case e_gearJoint:
+		return cb2CopyJointDef<cb2GearJointDef>(mem, def);
+	case e_wheelJoint:
+		return cb2CopyJointDef<cb2WheelJointDef>(mem, def);
+	case e_weldJoint:
+		return cb2CopyJointDef<cb2WeldJointDef>(mem, def);
+	case e_frictionJoint:
+		return cb2CopyJointDef<cb2FrictionJointDef>(mem, def);
+	case e_ropeJoint:
+		return cb2CopyJointDef<cb2RopeJointDef>(mem, def);
+	case e_motorJoint:
+		return cb2CopyJointDef<cb2MotorJointDef>(mem, def);
+	default:
+		cb2Assert(false);
+		return cb2CopyJointDef<cb2JointDef>(mem, def);
+	}
+}
+
+cb2CommandQueue::cb2CommandQueue()
+: m_head(NULL)
+{
+	m_allocator = NULL;
+}
+
+cb2CommandQueue::~cb2CommandQueue()
+{
+	// Commands left over are dropped.
+	cb2Command* command = m_head.exchange(NULL, std::memory_order_acquire);
+	while (command)
+	{
+		cb2Command* next = command->next;
+		cb2Free(m_allocator, command);
+		command = next;
+	}
+}
+
+cb2Command* cb2CommandQueue::Allocate(int type, int size)
+{
+	cb2Command* command = (cb2Command*)cb2Alloc(m_allocator, cb2_commandPayloadOffset + size);
+	new (command) cb2Command;
+	command->next = NULL;
+	command->type = type;
+	command->handle = cb2_nullHandle;
+	command->scalar = 0.0f;
+	command->count = 0;
+	command->flag = false;
+	command->pointer = NULL;
+	return command;
+}
+
+void cb2CommandQueue::Push(cb2Command* command)
+{
+	// Producers only ever push and Flush takes the whole list at once, so a plain
+	// compare and swap stack has no ABA problem.
+	cb2Command* head = m_head.load(std::memory_order_relaxed);
+	do
+	{
+		command->next = head;
+	}
+	while (m_head.compare_exchange_weak(head, command, std::memory_order_release, std::memory_order_relaxed) == false);
+}
+
+cb2Command* cb2CommandQueue::BodyCommand(int type, cb2Handle body)
+{
+	cb2Command* command = Allocate(type, 0);
+	command->handle = body;
+	return command;
+}
+
+void cb2CommandQueue::CreateBody(const cb2BodyDef* def, const cb2FixtureDef* fixtureDefs, int fixtureCount, cb2Body** body)
+{
+	cb2Assert(fixtureCount >= 0);
+	cb2Command* command = Allocate(e_createBodyCommand, sizeof(cb2BodyDef) + fixtureCount * sizeof(cb2FixtureDef));
+	command->count = fixtureCount;
+	command->pointer = body;
+
+	void* payload = cb2GetPayload(command);
+	new (payload) cb2BodyDef(*def);
+	cb2FixtureDef* fixtures = (cb2FixtureDef*)((char*)payload + sizeof(cb2BodyDef));
+	for (int i = 0; i < fixtureCount; ++i)
+	{
+		new (fixtures + i) cb2FixtureDef(fixtureDefs[i]);
+	}
+	Push(command);
+}
+
+void cb2CommandQueue::DestroyBody(cb2Handle body)
+{
+	Push(BodyCommand(e_destroyBodyCommand, body));
+}
+
+void cb2CommandQueue::CreateJoint(const cb2JointDef* def, cb2Joint** joint)
+{
+	cb2Command* command = Allocate(e_createJointCommand, cb2CopyJointDef(NULL, def));
+	command->pointer = joint;
+	cb2CopyJointDef(cb2GetPayload(command), def);
+	Push(command);
+}
+
+void cb2CommandQueue::DestroyJoint(cb2Handle joint)
+{
+	Push(BodyCommand(e_destroyJointCommand, joint));
+}
+
+void cb2CommandQueue::SetTransform(cb2Handle body, const ci::Vec2f& position, float angle)
+{
+	cb2Command* command = BodyCommand(e_setTransformCommand, body);
+	command->vector1 = position;
+	command->scalar = angle;
+	Push(command);
+}
+
+void cb2CommandQueue::SetVelocity(cb2Handle body, const ci::Vec2f& linearVelocity, float angularVelocity)
+{
+	cb2Command* command = BodyCommand(e_setVelocityCommand, body);
+	command->vector1 = linearVelocity;
+	command->scalar = angularVelocity;
+	Push(command);
+}
+
+void cb2CommandQueue::ApplyForce(cb2Handle body, const ci::Vec2f& force, const ci::Vec2f& point, bool wake)
+{
+	cb2Command* command = BodyCommand(e_applyForceCommand, body);
+	command->vector1 = force;
+	command->vector2 = point;
+	command->flag = wake;
+	Push(command);
+}
+
+void cb2CommandQueue::ApplyLinearImpulse(cb2Handle body, const ci::Vec2f& impulse, const ci::Vec2f& point, bool wake)
+{
+	cb2Command* command = BodyCommand(e_applyLinearImpulseCommand, body);
+	command->vector1 = impulse;
+	command->vector2 = point;
+	command->flag = wake;
+	Push(command);
+}
+
+void cb2CommandQueue::ApplyAngularImpulse(cb2Handle body, float impulse, bool wake)
+{
+	cb2Command* command = BodyCommand(e_applyAngularImpulseCommand, body);
+	command->scalar = impulse;
+	command->flag = wake;
+	Push(command);
+}
+
+void cb2CommandQueue::SetType(cb2Handle body, cb2BodyType type)
+{
+	cb2Command* command = BodyCommand(e_setTypeCommand, body);
+	command->count = type;
+	Push(command);
+}
+
+void cb2CommandQueue::SetAwake(cb2Handle body, bool flag)
+{
+	cb2Command* command = BodyCommand(e_setAwakeCommand, body);
+	command->flag = flag;
+	Push(command);
+}
+
+void cb2CommandQueue::SetActive(cb2Handle body, bool flag)
+{
+	cb2Command* command = BodyCommand(e_setActiveCommand, body);
+	command->flag = flag;
+	Push(command);
+}
+
+void cb2CommandQueue::SetUserData(cb2Handle body, void* data)
+{
+	cb2Command* command = BodyCommand(e_setUserDataCommand, body);
+	command->pointer = data;
+	Push(command);
+}
+
+// Apply a command to a body that still exists.
+static void cb2ApplyBodyCommand(cb2Body* body, const cb2Command* command)
+{
+	switch (command->type)
+	{
+	case e_setTransformCommand:
+		body->SetTransform(command->vector1, command->scalar);
+		break;
+
+	case e_setVelocityCommand:
+		body->SetLinearVelocity(command->vector1);
+		body->SetAngularVelocity(command->scalar);
+		break;
+
+	case e_applyForceCommand:
+		body->ApplyForce(command->vector1, command->vector2, command->flag);
+		break;
+
+	case e_applyLinearImpulseCommand:
+		body->ApplyLinearImpulse(command->vector1, command->vector2, command->flag);
+		break;
+
+	case e_applyAngularImpulseCommand:
+		body->ApplyAngularImpulse(command->scalar, command->flag);
+		break;
+
+	case e_setTypeCommand:
+		body->SetType((cb2BodyType)command->count);
+		break;
+
+	case e_setAwakeCommand:
+		body->SetAwake(command->flag);
+		break;
+
+	case e_setActiveCommand:
+		body->SetActive(command->flag);
+		break;
+
+	case e_setUserDataCommand:
+		body->SetUserData(command->pointer);
+		break;
+
+	default:
+		cb2Assert(false);
+		break;
+	}
+}
+
+int cb2CommandQueue::Flush(cb2World* world)
+{
+	cb2Assert(world->IsLocked() == false);
+
+	cb2Command* list = m_head.exchange(NULL, std::memory_order_acquire);
+	if (list == NULL)
+	{
+		return 0;
+	}
+
+	// The stack holds the newest command first.
+	cb2Command* command = NULL;
+	while (list)
+	{
+		cb2Command* next = list->next;
+		list->next = command;
+		command = list;
+		list = next;
+	}
+
+	int count = 0;
+	while (command)
+	{
+		cb2Command* next = command->next;
+		++count;
+
+		if (command->type == e_createBodyCommand)
+		{
+			const cb2BodyDef* def = (const cb2BodyDef*)cb2GetPayload(command);
+			const cb2FixtureDef* fixtures = (const cb2FixtureDef*)(def + 1);
+			cb2Body* body = world->CreateBody(def);
+			for (int i = 0; i < command->count; ++i)
+			{
+				body->CreateFixture(fixtures + i);
+			}
+			if (command->pointer)
+			{
+				*(cb2Body**)command->pointer = body;
+			}
+		}
+		else if (command->type == e_createJointCommand)
+		{
+			cb2Joint* joint = world->CreateJoint((const cb2JointDef*)cb2GetPayload(command));
+			if (command->pointer)
+			{
+				*(cb2Joint**)command->pointer = joint;
+			}
+		}
+		else if (command->type == e_destroyJointCommand)
+		{
+			cb2Joint* joint = world->GetJoint(command->handle);
+			if (joint)
+			{
+				world->DestroyJoint(joint);
+			}
+		}
+		else
+		{
+			cb2Body* body = world->GetBody(command->handle);
+			if (body && command->type == e_destroyBodyCommand)
+			{
+				world->DestroyBody(body);
+			}
+			else if (body)
+			{
+				cb2ApplyBodyCommand(body, command);
+			}
+		}
+
+		cb2Free(m_allocator, command);
+		command = next;
+	}
+
+	return count;
+}
@@ -0,0 +1,114 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_COMMAND_QUEUE_H
+#define CB2_COMMAND_QUEUE_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+
+#include <atomic>
+
+class cb2Joint;
+class cb2World;
+struct cb2FixtureDef;
+struct cb2JointDef;
+struct cb2Command;
+
+/// Changes to a world that any thread may queue at any time, even during Step or
+/// from inside callbacks. Each call copies its arguments into a command and pushes it
+/// without locking, the world applies the commands in the order they were queued at
+/// the start of its next step, see cb2World::GetCommandQueue. Bodies and joints are
+/// referred to by handle, commands on objects that are gone by then are dropped.
+/// Commands are allocated from the world's allocator interface, which must then be
+/// thread safe. A command is allocated when it is pushed, so the allocation audit of
+/// cb2World::SetAllocationAudit counts it against the pushing thread: pushes from a
+/// game thread are not counted, pushes from the callbacks of an audited step are.
+class cb2CommandQueue
+{
+public:
+	/// Queue cb2World::CreateBody followed by CreateFixture for each fixture def. The
+	/// shapes of the fixture defs are not copied and must stay in scope until the
+	/// command is applied, shared shapes suit this well (see cb2World::CreateSharedShape).
+	/// @param body optional, receives the body when the command is applied.
+	void CreateBody(const cb2BodyDef* def, const cb2FixtureDef* fixtureDefs, int fixtureCount, cb2Body** body = NULL);
+
+	/// Queue cb2World::DestroyBody.
+	void DestroyBody(cb2Handle body);
+
+	/// Queue cb2World::CreateJoint. The bodies of the def must exist when the command
+	/// is applied.
+	/// @param joint optional, receives the joint when the command is applied.
+	void CreateJoint(const cb2JointDef* def, cb2Joint** joint = NULL);
+
+	/// Queue cb2World::DestroyJoint.
+	void DestroyJoint(cb2Handle joint);
+
+	/// Queue cb2Body::SetTransform.
+	void SetTransform(cb2Handle body, const ci::Vec2f& position, float angle);
+
+	/// Queue cb2Body::SetLinearVelocity and cb2Body::SetAngularVelocity.
+	void SetVelocity(cb2Handle body, const ci::Vec2f& linearVelocity, float angularVelocity);
+
+	/// Queue cb2Body::ApplyForce, it acts on the next step.
+	void ApplyForce(cb2Handle body, const ci::Vec2f& force, const ci::Vec2f& point, bool wake);
+
+	/// Queue cb2Body::ApplyLinearImpulse.
+	void ApplyLinearImpulse(cb2Handle body, const ci::Vec2f& impulse, const ci::Vec2f& point, bool wake);
+
+	/// Queue cb2Body::ApplyAngularImpulse.
+	void ApplyAngularImpulse(cb2Handle body, float impulse, bool wake);
+
+	/// Queue cb2Body::SetType.
+	void SetType(cb2Handle body, cb2BodyType type);
+
+	/// Queue cb2Body::SetAwake.
+	void SetAwake(cb2Handle body, bool flag);
+
+	/// Queue cb2Body::SetActive.
+	void SetActive(cb2Handle body, bool flag);
+
+	/// Queue cb2Body::SetUserData.
+	void SetUserData(cb2Handle body, void* data);
+
+	/// Is there any command to apply? This is only a hint while other threads queue.
+	bool IsEmpty() const { return m_head.load(std::memory_order_relaxed) == NULL; }
+
+private:
+
+	friend class cb2World;
+
+	cb2CommandQueue();
+	~cb2CommandQueue();
+
+	cb2CommandQueue(const cb2CommandQueue&);
+	cb2CommandQueue& operator=(const cb2CommandQueue&);
+
+	cb2Command* Allocate(int type, int size);
+	void Push(cb2Command* command);
+	cb2Command* BodyCommand(int type, cb2Handle body);
+
+	// Apply and free the commands queued so far, returns how many there were.
+	int Flush(cb2World* world);
+
+	cb2AllocatorInterface* m_allocator;
+	std::atomic<cb2Command*> m_head;
+};
+
+#endif
@@ -18,20 +18,358 @@
 
 #include <CinderBox2D/Dynamics/cb2ContactManager.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
 #include <CinderBox2D/Dynamics/cb2WorldCallbacks.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
+#include <CinderBox2D/Common/cb2StackAllocator.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Common/cb2Trace.h>
+#include <memory.h>
 
 cb2ContactFilter cb2_defaultFilter;
 cb2ContactListener cb2_defaultListener;
 
-cb2ContactManager::cb2ContactManager()
+cb2ContactManager::cb2ContactManager(cb2AllocatorInterface* allocator)
+	: m_broadPhase(allocator)
 {
 	m_contactList = NULL;
 	m_contactCount = 0;
+	m_awakeContactCapacity = 16;
+	m_awakeContactCount = 0;
+	m_backingAllocator = allocator;
+	m_awakeContacts = (cb2AwakeContact*)cb2Alloc(m_backingAllocator, m_awakeContactCapacity * sizeof(cb2AwakeContact));
 	m_contactFilter = &cb2_defaultFilter;
 	m_contactListener = &cb2_defaultListener;
 	m_allocator = NULL;
+	m_stackAllocator = NULL;
+	m_taskScheduler = NULL;
+	m_reuseLinearTolerance = 0.0f;
+	m_speculativeDt = 0.0f;
+	m_reuseAngularTolerance = 0.0f;
+	m_batchSensorEvents = false;
+	m_sensorEvents = NULL;
+	m_sensorEventCount = 0;
+	m_sensorEventCapacity = 0;
+	m_reportedSensorEventCount = 0;
+	m_batchContactEvents = false;
+	m_hitEventThreshold = 1.0f;
+	m_beginEvents = NULL;
+	m_beginEventCount = 0;
+	m_beginEventCapacity = 0;
+	m_endEvents = NULL;
+	m_endEventCount = 0;
+	m_endEventCapacity = 0;
+	m_reportedEndEventCount = 0;
+	m_hitEvents = NULL;
+	m_hitContacts = NULL;
+	m_hitEventCount = 0;
+	m_hitEventCapacity = 0;
+
+	m_pairCount = 0;
+	m_createdContactCount = 0;
+	m_destroyedContactCount = 0;
+	m_touchingContactCount = 0;
+	m_pairCapacity = 16;
+	m_pairs = (cb2Contact**)cb2Alloc(m_backingAllocator, m_pairCapacity * sizeof(cb2Contact*));
+	memset(m_pairs, 0, m_pairCapacity * sizeof(cb2Contact*));
+}
+
+cb2ContactManager::~cb2ContactManager()
+{
+	cb2Free(m_backingAllocator, m_pairs);
+	cb2Free(m_backingAllocator, m_sensorEvents);
+	cb2Free(m_backingAllocator, m_beginEvents);
+	cb2Free(m_backingAllocator, m_endEvents);
+	cb2Free(m_backingAllocator, m_hitEvents);
+	cb2Free(m_backingAllocator, m_hitContacts);
+	cb2Free(m_backingAllocator, m_awakeContacts);
+}
+
+// Double the capacity of an event array that is full.
+template <typename T>
+static T* cb2GrowEvents(cb2AllocatorInterface* allocator, T* events, int count, int capacity)
+{
+	T* newEvents = (T*)cb2Alloc(allocator, capacity * sizeof(T));
+	if (events)
+	{
+		memcpy(newEvents, events, count * sizeof(T));
+		cb2Free(allocator, events);
+	}
+	return newEvents;
+}
+
+void cb2ContactManager::PushSensorEvent(const cb2Contact* c, bool begin)
+{
+	if (m_sensorEventCount == m_sensorEventCapacity)
+	{
+		m_sensorEventCapacity = cb2Max(2 * m_sensorEventCapacity, 16);
+		m_sensorEvents = cb2GrowEvents(m_backingAllocator, m_sensorEvents, m_sensorEventCount, m_sensorEventCapacity);
+	}
+
+	const cb2Fixture* fixtureA = c->GetFixtureA();
+	const cb2Fixture* fixtureB = c->GetFixtureB();
+	bool sensorIsA = fixtureA->IsSensor();
+
+	cb2SensorEvent* event = m_sensorEvents + m_sensorEventCount;
+	event->sensor = sensorIsA ? fixtureA->GetHandle() : fixtureB->GetHandle();
+	event->visitor = sensorIsA ? fixtureB->GetHandle() : fixtureA->GetHandle();
+	event->sensorChildIndex = sensorIsA ? c->GetChildIndexA() : c->GetChildIndexB();
+	event->visitorChildIndex = sensorIsA ? c->GetChildIndexB() : c->GetChildIndexA();
+	event->begin = begin;
+	++m_sensorEventCount;
+}
+
+void cb2ContactManager::ClearReportedSensorEvents()
+{
+	// Events of fixtures destroyed between steps are reported by the next step.
+	int count = m_sensorEventCount - m_reportedSensorEventCount;
+	if (count > 0 && m_reportedSensorEventCount > 0)
+	{
+		memmove(m_sensorEvents, m_sensorEvents + m_reportedSensorEventCount, count * sizeof(cb2SensorEvent));
+	}
+
+	m_sensorEventCount = count;
+	m_reportedSensorEventCount = 0;
+}
+
+void cb2ContactManager::PushContactEvent(cb2Contact* c, bool begin)
+{
+	cb2Fixture* fixtureA = c->GetFixtureA();
+	cb2Fixture* fixtureB = c->GetFixtureB();
+	bool events = fixtureA->m_enableContactEvents || fixtureB->m_enableContactEvents;
+	bool hits = fixtureA->m_enableHitEvents || fixtureB->m_enableHitEvents;
+
+	if (begin == false)
+	{
+		if (events == false)
+		{
+			return;
+		}
+
+		if (m_endEventCount == m_endEventCapacity)
+		{
+			m_endEventCapacity = cb2Max(2 * m_endEventCapacity, 16);
+			m_endEvents = cb2GrowEvents(m_backingAllocator, m_endEvents, m_endEventCount, m_endEventCapacity);
+		}
+
+		cb2ContactEndEvent* event = m_endEvents + m_endEventCount;
+		event->fixtureA = fixtureA->GetHandle();
+		event->fixtureB = fixtureB->GetHandle();
+		event->childIndexA = c->GetChildIndexA();
+		event->childIndexB = c->GetChildIndexB();
+		++m_endEventCount;
+		return;
+	}
+
+	if (events == false && hits == false)
+	{
+		return;
+	}
+
+	cb2WorldManifold worldManifold;
+	c->GetWorldManifold(&worldManifold);
+
+	int pointCount = static_cast<const cb2Contact*>(c)->GetManifold()->pointCount;
+	ci::Vec2f point(0.0f, 0.0f);
+	for (int i = 0; i < pointCount; ++i)
+	{
+		point += worldManifold.points[i];
+	}
+	if (pointCount > 0)
+	{
+		point *= 1.0f / pointCount;
+	}
+
+	ci::Vec2f vA = fixtureA->GetBody()->GetLinearVelocityFromWorldPoint(point);
+	ci::Vec2f vB = fixtureB->GetBody()->GetLinearVelocityFromWorldPoint(point);
+	float approachSpeed = -cb2Dot(vB - vA, worldManifold.normal);
+
+	if (events)
+	{
+		if (m_beginEventCount == m_beginEventCapacity)
+		{
+			m_beginEventCapacity = cb2Max(2 * m_beginEventCapacity, 16);
+			m_beginEvents = cb2GrowEvents(m_backingAllocator, m_beginEvents, m_beginEventCount, m_beginEventCapacity);
+		}
+
+		cb2ContactBeginEvent* event = m_beginEvents + m_beginEventCount;
+		event->fixtureA = fixtureA->GetHandle();
+		event->fixtureB = fixtureB->GetHandle();
+		event->childIndexA = c->GetChildIndexA();
+		event->childIndexB = c->GetChildIndexB();
+		event->point = point;
+		event->normal = worldManifold.normal;
+		event->approachSpeed = approachSpeed;
+		++m_beginEventCount;
+	}
+
+	if (hits && approachSpeed > m_hitEventThreshold)
+	{
+		if (m_hitEventCount == m_hitEventCapacity)
+		{
+			m_hitEventCapacity = cb2Max(2 * m_hitEventCapacity, 16);
+			m_hitEvents = cb2GrowEvents(m_backingAllocator, m_hitEvents, m_hitEventCount, m_hitEventCapacity);
+			m_hitContacts = cb2GrowEvents(m_backingAllocator, m_hitContacts, m_hitEventCount, m_hitEventCapacity);
+		}
+
+		cb2ContactHitEvent* event = m_hitEvents + m_hitEventCount;
+		event->fixtureA = fixtureA->GetHandle();
+		event->fixtureB = fixtureB->GetHandle();
+		event->point = point;
+		event->normal = worldManifold.normal;
+		event->approachSpeed = approachSpeed;
+		event->normalImpulse = 0.0f;
+		m_hitContacts[m_hitEventCount] = c;
+		++m_hitEventCount;
+	}
+}
+
+void cb2ContactManager::ClearReportedContactEvents()
+{
+	m_beginEventCount = 0;
+	m_hitEventCount = 0;
+
+	// As with sensor events, contacts destroyed between steps end with the next step.
+	int count = m_endEventCount - m_reportedEndEventCount;
+	if (count > 0 && m_reportedEndEventCount > 0)
+	{
+		memmove(m_endEvents, m_endEvents + m_reportedEndEventCount, count * sizeof(cb2ContactEndEvent));
+	}
+
+	m_endEventCount = count;
+	m_reportedEndEventCount = 0;
+}
+
+void cb2ContactManager::FinishHitEvents()
+{
+	// Contacts are only destroyed by Collide, before they can begin touching, so
+	// the contacts of the hits are still alive at the end of the step.
+	for (int i = 0; i < m_hitEventCount; ++i)
+	{
+		const cb2Manifold* manifold = static_cast<const cb2Contact*>(m_hitContacts[i])->GetManifold();
+		float impulse = 0.0f;
+		for (int j = 0; j < manifold->pointCount; ++j)
+		{
+			impulse += manifold->points[j].normalImpulse;
+		}
+		m_hitEvents[i].normalImpulse = impulse;
+	}
+
+	m_reportedEndEventCount = m_endEventCount;
+}
+
+// The pair is ordered so both orders of the children hash the same.
+static inline unsigned int cb2HashPair(const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB)
+{
+	if (fixtureB < fixtureA || (fixtureB == fixtureA && indexB < indexA))
+	{
+		const cb2Fixture* fixture = fixtureA;
+		fixtureA = fixtureB;
+		fixtureB = fixture;
+		int index = indexA;
+		indexA = indexB;
+		indexB = index;
+	}
+
+	size_t a = (size_t)fixtureA ^ ((size_t)indexA * 2654435761u);
+	size_t b = (size_t)fixtureB ^ ((size_t)indexB * 2246822519u);
+	size_t hash = a * 73856093u ^ (b >> 4) * 19349663u ^ (a >> 20);
+	hash ^= hash >> 15;
+	hash *= 2246822519u;
+	return (unsigned int)(hash ^ (hash >> 13));
+}
+
+static inline bool cb2IsPair(const cb2Contact* c, const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB)
+{
+	if (c->GetFixtureA() == fixtureA && c->GetFixtureB() == fixtureB)
+	{
+		return c->GetChildIndexA() == indexA && c->GetChildIndexB() == indexB;
+	}
+
+	if (c->GetFixtureA() == fixtureB && c->GetFixtureB() == fixtureA)
+	{
+		return c->GetChildIndexA() == indexB && c->GetChildIndexB() == indexA;
+	}
+
+	return false;
+}
+
+// The slot holding the pair, or the empty slot ending its probe sequence.
+int cb2ContactManager::GetPairSlot(const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB) const
+{
+	int mask = m_pairCapacity - 1;
+	int slot = (int)(cb2HashPair(fixtureA, indexA, fixtureB, indexB) & (unsigned int)mask);
+	while (m_pairs[slot] && cb2IsPair(m_pairs[slot], fixtureA, indexA, fixtureB, indexB) == false)
+	{
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+cb2Contact* cb2ContactManager::FindContact(const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB) const
+{
+	return m_pairs[GetPairSlot(fixtureA, indexA, fixtureB, indexB)];
+}
+
+void cb2ContactManager::InsertPair(cb2Contact* c)
+{
+	// Keep the table at most half full.
+	if (2 * (m_contactCount + 1) > m_pairCapacity)
+	{
+		GrowPairs(2 * m_pairCapacity);
+	}
+
+	int slot = GetPairSlot(c->GetFixtureA(), c->GetChildIndexA(), c->GetFixtureB(), c->GetChildIndexB());
+	cb2Assert(m_pairs[slot] == NULL);
+	m_pairs[slot] = c;
+}
+
+void cb2ContactManager::GrowPairs(int capacity)
+{
+	cb2Contact** oldPairs = m_pairs;
+	int oldCapacity = m_pairCapacity;
+	m_pairCapacity = capacity;
+	m_pairs = (cb2Contact**)cb2Alloc(m_backingAllocator, m_pairCapacity * sizeof(cb2Contact*));
+	memset(m_pairs, 0, m_pairCapacity * sizeof(cb2Contact*));
+	for (int i = 0; i < oldCapacity; ++i)
+	{
+		cb2Contact* old = oldPairs[i];
+		if (old)
+		{
+			m_pairs[GetPairSlot(old->GetFixtureA(), old->GetChildIndexA(), old->GetFixtureB(), old->GetChildIndexB())] = old;
+		}
+	}
+	cb2Free(m_backingAllocator, oldPairs);
+}
+
+void cb2ContactManager::RemovePair(cb2Contact* c)
+{
+	int mask = m_pairCapacity - 1;
+	int slot = GetPairSlot(c->GetFixtureA(), c->GetChildIndexA(), c->GetFixtureB(), c->GetChildIndexB());
+	cb2Assert(m_pairs[slot] == c);
+
+	// Shift back the entries that probed past the freed slot.
+	int next = slot;
+	for (;;)
+	{
+		next = (next + 1) & mask;
+		cb2Contact* other = m_pairs[next];
+		if (other == NULL)
+		{
+			break;
+		}
+
+		int home = (int)(cb2HashPair(other->GetFixtureA(), other->GetChildIndexA(), other->GetFixtureB(), other->GetChildIndexB()) & (unsigned int)mask);
+		if (((next - home) & mask) >= ((next - slot) & mask))
+		{
+			m_pairs[slot] = other;
+			slot = next;
+		}
+	}
+
+	m_pairs[slot] = NULL;
 }
 
 void cb2ContactManager::Destroy(cb2Contact* c)
@@ -41,9 +379,31 @@ void cb2ContactManager::Destroy(cb2Contact* c)
 	cb2Body* bodyA = fixtureA->GetBody();
 	cb2Body* bodyB = fixtureB->GetBody();
 
-	if (m_contactListener && c->IsTouching())
+	if (c->IsTouching())
 	{
-		m_contactListener->EndContact(c);
+		bool sensor = fixtureA->IsSensor() || fixtureB->IsSensor();
+		if (sensor && m_batchSensorEvents)
+		{
+			PushSensorEvent(c, false);
+		}
+		else if (sensor == false && m_batchContactEvents)
+		{
+			PushContactEvent(c, false);
+		}
+		else if (m_contactListener)
+		{
+			m_contactListener->EndContact(c);
+		}
+	}
+
+	if (c->m_island)
+	{
+		bodyA->GetWorld()->UnlinkContact(c);
+	}
+
+	if (c->m_flags & cb2Contact::e_awakeFlag)
+	{
+		RemoveAwake(c);
 	}
 
 	// Remove from the world.
@@ -94,45 +454,244 @@ void cb2ContactManager::Destroy(cb2Contact* c)
 		bodyB->m_contactList = c->m_nodeB.next;
 	}
 
+	RemovePair(c);
+
 	// Call the factory.
 	cb2Contact::Destroy(c, m_allocator);
 	--m_contactCount;
+	++m_destroyedContactCount;
 }
 
 // This is the top level collision call for the time step. Here
 // all the narrow phase collision is processed for the world
 // contact list.
+void cb2ContactManager::UpdateAwake(cb2Contact* c)
+{
+	cb2Body* bodyA = c->m_fixtureA->m_body;
+	cb2Body* bodyB = c->m_fixtureB->m_body;
+	bool activeA = bodyA->IsAwake() && bodyA->m_type != cb2_staticBody;
+	bool activeB = bodyB->IsAwake() && bodyB->m_type != cb2_staticBody;
+	bool awake = activeA || activeB || (c->m_flags & cb2Contact::e_filterFlag) != 0;
+
+	if (awake == ((c->m_flags & cb2Contact::e_awakeFlag) != 0))
+	{
+		return;
+	}
+
+	if (awake == false)
+	{
+		RemoveAwake(c);
+		return;
+	}
+
+	// Dormant contacts are skipped by SolveTOI, so their cached TOI is stale.
+	c->m_flags &= ~(cb2Contact::e_toiFlag | cb2Contact::e_islandFlag);
+	c->m_toiCount = 0;
+	c->m_toi = 1.0f;
+
+	AppendAwake(c);
+}
+
+void cb2ContactManager::GrowAwake(int capacity)
+{
+	cb2AwakeContact* oldContacts = m_awakeContacts;
+	m_awakeContactCapacity = capacity;
+	m_awakeContacts = (cb2AwakeContact*)cb2Alloc(m_backingAllocator, m_awakeContactCapacity * sizeof(cb2AwakeContact));
+	memcpy(m_awakeContacts, oldContacts, m_awakeContactCount * sizeof(cb2AwakeContact));
+	cb2Free(m_backingAllocator, oldContacts);
+}
+
+void cb2ContactManager::Reserve(int contactCount)
+{
+	if (contactCount > m_awakeContactCapacity)
+	{
+		GrowAwake(contactCount);
+	}
+
+	// The slots are masked, the capacity stays a power of two.
+	int pairCapacity = m_pairCapacity;
+	while (pairCapacity < 2 * contactCount)
+	{
+		pairCapacity *= 2;
+	}
+
+	if (pairCapacity > m_pairCapacity)
+	{
+		GrowPairs(pairCapacity);
+	}
+}
+
+void cb2ContactManager::AppendAwake(cb2Contact* c)
+{
+	if (m_awakeContactCount == m_awakeContactCapacity)
+	{
+		GrowAwake(2 * m_awakeContactCapacity);
+	}
+
+	cb2Shape::Type typeA = c->m_fixtureA->GetType();
+	cb2Shape::Type typeB = c->m_fixtureB->GetType();
+
+	// Append, behind any walk of the awake array that is in progress.
+	c->m_flags |= cb2Contact::e_awakeFlag;
+	c->m_awakeIndex = m_awakeContactCount;
+	cb2AwakeContact* entry = m_awakeContacts + m_awakeContactCount++;
+	entry->contact = c;
+	entry->bodyA = c->m_fixtureA->m_body;
+	entry->bodyB = c->m_fixtureB->m_body;
+	entry->manifoldFcn = cb2Contact::s_registers[typeA][typeB].manifoldFcn;
+	entry->typePair = typeA * cb2Shape::e_typeCount + typeB;
+}
+
+void cb2ContactManager::RemoveAwake(cb2Contact* c)
+{
+	cb2Assert(c->m_flags & cb2Contact::e_awakeFlag);
+	cb2Assert(m_awakeContacts[c->m_awakeIndex].contact == c);
+
+	// Swap remove.
+	const cb2AwakeContact& last = m_awakeContacts[--m_awakeContactCount];
+	last.contact->m_awakeIndex = c->m_awakeIndex;
+	m_awakeContacts[c->m_awakeIndex] = last;
+
+	c->m_flags &= ~cb2Contact::e_awakeFlag;
+	c->m_awakeIndex = -1;
+}
+
+struct cb2CollideContext
+{
+	cb2ContactUpdate* updates;
+	const cb2BroadPhase* broadPhase;
+};
+
+void cb2ContactManager::CollideTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	CB2_TRACE_ZONE_COUNT("CollideTask", end - begin);
+	cb2CollideContext* collideContext = (cb2CollideContext*)context;
+
+	for (int i = begin; i < end; ++i)
+	{
+		cb2ContactUpdate* update = collideContext->updates + i;
+		cb2Body* bodyA = update->bodyA;
+		cb2Body* bodyB = update->bodyB;
+
+		bool activeA = bodyA->IsAwake() && bodyA->m_type != cb2_staticBody;
+		bool activeB = bodyB->IsAwake() && bodyB->m_type != cb2_staticBody;
+		if (activeA == false && activeB == false)
+		{
+			continue;
+		}
+
+		update->tested = true;
+		update->overlap = TestOverlap(collideContext->broadPhase, update->contact);
+	}
+
+	// The updates are sorted by contact class, so each run goes through one
+	// collide function without virtual calls.
+	int i = begin;
+	while (i < end)
+	{
+		cb2ContactUpdate* update = collideContext->updates + i;
+		int j = i + 1;
+		while (j < end && collideContext->updates[j].manifoldFcn == update->manifoldFcn)
+		{
+			++j;
+		}
+
+		update->manifoldFcn(update, j - i);
+		i = j;
+	}
+}
+
+// Update awake contacts. The manifolds are computed first, on the task scheduler
+// if there is one, with the contacts sorted by shape types. The filtering,
+// destruction and listener callbacks then follow on this thread in the order of a
+// backwards walk over the awake array. Contacts that were woken up by that pass
+// were not computed ahead of time and are handled inline. Walking backwards keeps
+// the swap removes behind the walk, and contacts woken up during the walk are
+// appended and wait for the next step.
 void cb2ContactManager::Collide()
 {
-	// Update awake contacts.
-	cb2Contact* c = m_contactList;
-	while (c)
-	{
-		cb2Fixture* fixtureA = c->GetFixtureA();
-		cb2Fixture* fixtureB = c->GetFixtureB();
-		int indexA = c->GetChildIndexA();
-		int indexB = c->GetChildIndexB();
-		cb2Body* bodyA = fixtureA->GetBody();
-		cb2Body* bodyB = fixtureB->GetBody();
-		 
+	CB2_TRACE_ZONE_COUNT("Collide", m_awakeContactCount);
+
+	int count = m_awakeContactCount;
+	cb2ContactUpdate* updates = (cb2ContactUpdate*)m_stackAllocator->Allocate(count * sizeof(cb2ContactUpdate));
+	int* slots = (int*)m_stackAllocator->Allocate(count * sizeof(int));
+
+	// Counting sort by shape types.
+	const int typePairCount = cb2Shape::e_typeCount * cb2Shape::e_typeCount;
+	int offsets[typePairCount];
+	for (int k = 0; k < typePairCount; ++k)
+	{
+		offsets[k] = 0;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int typePair = m_awakeContacts[count - 1 - i].typePair;
+		slots[i] = typePair;
+		++offsets[typePair];
+	}
+
+	int offset = 0;
+	for (int k = 0; k < typePairCount; ++k)
+	{
+		int typeCount = offsets[k];
+		offsets[k] = offset;
+		offset += typeCount;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		const cb2AwakeContact* entry = m_awakeContacts + count - 1 - i;
+		int typePair = slots[i];
+		int slot = offsets[typePair]++;
+		slots[i] = slot;
+
+		cb2ContactUpdate* update = updates + slot;
+		update->contact = entry->contact;
+		update->bodyA = entry->bodyA;
+		update->bodyB = entry->bodyB;
+		update->manifoldFcn = entry->manifoldFcn;
+		update->touching = false;
+		update->tested = false;
+		update->overlap = false;
+	}
+
+	cb2CollideContext context;
+	context.updates = updates;
+	context.broadPhase = &m_broadPhase;
+
+	if (m_taskScheduler)
+	{
+		void* group = m_taskScheduler->EnqueueRange(CollideTask, &context, count, 64);
+		m_taskScheduler->Wait(group);
+	}
+	else
+	{
+		CollideTask(&context, 0, count, 0);
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		cb2ContactUpdate* update = updates + slots[i];
+		cb2Contact* c = update->contact;
+		cb2Body* bodyA = update->bodyA;
+		cb2Body* bodyB = update->bodyB;
+
 		// Is this contact flagged for filtering?
 		if (c->m_flags & cb2Contact::e_filterFlag)
 		{
 			// Should these bodies collide?
 			if (bodyB->ShouldCollide(bodyA) == false)
 			{
-				cb2Contact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
 				continue;
 			}
 
 			// Check user filtering.
-			if (m_contactFilter && m_contactFilter->ShouldCollide(fixtureA, fixtureB) == false)
+			if (m_contactFilter && m_contactFilter->ShouldCollide(c->GetFixtureA(), c->GetFixtureB()) == false)
 			{
-				cb2Contact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
 				continue;
 			}
 
@@ -146,27 +705,36 @@ void cb2ContactManager::Collide()
 		// At least one body must be awake and it must be dynamic or kinematic.
 		if (activeA == false && activeB == false)
 		{
-			c = c->GetNext();
+			RemoveAwake(c);
 			continue;
 		}
 
-		int proxyIdA = fixtureA->m_proxies[indexA].proxyId;
-		int proxyIdB = fixtureB->m_proxies[indexB].proxyId;
-		bool overlap = m_broadPhase.TestOverlap(proxyIdA, proxyIdB);
+		if (update->tested == false)
+		{
+			update->overlap = TestOverlap(&m_broadPhase, c);
+			if (update->overlap)
+			{
+				update->touching = c->ComputeManifold(&update->manifold);
+			}
+		}
 
 		// Here we destroy contacts that cease to overlap in the broad-phase.
-		if (overlap == false)
+		if (update->overlap == false)
 		{
-			cb2Contact* cNuke = c;
-			c = cNuke->GetNext();
-			Destroy(cNuke);
+			Destroy(c);
 			continue;
 		}
 
 		// The contact persists.
-		c->Update(m_contactListener);
-		c = c->GetNext();
+		c->Commit(update->manifold, update->touching, m_contactListener);
+		if (c->m_flags & cb2Contact::e_touchingFlag)
+		{
+			++m_touchingContactCount;
+		}
 	}
+
+	m_stackAllocator->Free(slots);
+	m_stackAllocator->Free(updates);
 }
 
 void cb2ContactManager::FindNewContacts()
@@ -174,11 +742,168 @@ void cb2ContactManager::FindNewContacts()
 	m_broadPhase.UpdatePairs(this);
 }
 
+bool cb2ContactManager::TestOverlap(const cb2BroadPhase* broadPhase, const cb2Contact* c)
+{
+	const cb2Fixture* fixtureA = c->GetFixtureA();
+	const cb2Fixture* fixtureB = c->GetFixtureB();
+	if (fixtureA->m_sharedProxy == false && fixtureB->m_sharedProxy == false &&
+		fixtureA->m_body->m_aggregate == NULL && fixtureB->m_body->m_aggregate == NULL)
+	{
+		int proxyIdA = fixtureA->m_proxies[c->GetChildIndexA()].proxyId;
+		int proxyIdB = fixtureB->m_proxies[c->GetChildIndexB()].proxyId;
+		return broadPhase->TestOverlap(proxyIdA, proxyIdB);
+	}
+
+	// The children of a shared proxy have no proxy of their own, and those of an
+	// aggregate body are not in the broad-phase.
+	cb2AABB aabbA, aabbB;
+	fixtureA->GetChildFatAABB(&aabbA, broadPhase, c->GetChildIndexA());
+	fixtureB->GetChildFatAABB(&aabbB, broadPhase, c->GetChildIndexB());
+	return cb2TestOverlap(aabbA, aabbB);
+}
+
+// Adds the pairs of single edges for cb2ContactManager::AddEdgePairs.
+struct cb2EdgePairQuery
+{
+	bool QueryEdge(int index)
+	{
+		cb2FixtureProxy edgeProxy = *sharedProxy;
+		edgeProxy.childIndex = index;
+		if (sharedIsA)
+		{
+			contactManager->AddPair(&edgeProxy, otherProxy);
+		}
+		else
+		{
+			contactManager->AddPair(otherProxy, &edgeProxy);
+		}
+		return true;
+	}
+
+	cb2ContactManager* contactManager;
+	const cb2FixtureProxy* sharedProxy;
+	cb2FixtureProxy* otherProxy;
+	bool sharedIsA;
+};
+
+// The broad-phase only knows the whole chain or heightfield. Its edges under the
+// fat AABB of the other proxy are found by the shape, and since that AABB contains
+// the other fixture until it moves out, which reports the pair again, no edge is
+// missed.
+void cb2ContactManager::AddEdgePairs(cb2FixtureProxy* sharedProxy, cb2FixtureProxy* otherProxy, bool sharedIsA)
+{
+	// Shapes made of edges do not collide with each other.
+	if (otherProxy->childIndex == cb2Shape::e_allChildren)
+	{
+		return;
+	}
+
+	cb2Body* sharedBody = sharedProxy->fixture->GetBody();
+	if (sharedBody == otherProxy->fixture->GetBody())
+	{
+		return;
+	}
+
+	cb2EdgePairQuery query;
+	query.contactManager = this;
+	query.sharedProxy = sharedProxy;
+	query.otherProxy = otherProxy;
+	query.sharedIsA = sharedIsA;
+	const cb2Fixture* otherFixture = otherProxy->fixture;
+	int otherIndex = (int)(otherProxy - otherFixture->m_proxies);
+	sharedProxy->fixture->QueryChildren(&query, otherFixture->GetProxyFatAABB(&m_broadPhase, otherIndex));
+}
+
+// Adds the pairs of the fixture proxies of an aggregate for cb2ContactManager::AddAggregatePairs.
+struct cb2AggregatePairQuery
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		cb2FixtureProxy* aggregateProxy = (cb2FixtureProxy*)proxy;
+		if (aggregateIsA)
+		{
+			contactManager->AddPair(aggregateProxy, otherProxy);
+		}
+		else
+		{
+			contactManager->AddPair(otherProxy, aggregateProxy);
+		}
+		return true;
+	}
+
+	cb2ContactManager* contactManager;
+	cb2FixtureProxy* otherProxy;
+	bool aggregateIsA;
+};
+
+// Like the edges of a shared proxy, the fixture proxies of an aggregate under the
+// fat AABB of the other proxy are found in the tree of the aggregate. Two aggregates
+// pair the proxies of one under the root of the other with the first.
+void cb2ContactManager::AddAggregatePairs(cb2FixtureProxy* aggregateProxy, cb2FixtureProxy* otherProxy, bool aggregateIsA)
+{
+	const cb2BodyAggregate* aggregate = cb2BodyAggregate::FromProxy(aggregateProxy);
+	if (otherProxy->fixture == NULL)
+	{
+		const cb2BodyAggregate* otherAggregate = cb2BodyAggregate::FromProxy(otherProxy);
+		if (otherAggregate->m_body == aggregate->m_body)
+		{
+			return;
+		}
+
+		cb2AggregatePairQuery query;
+		query.contactManager = this;
+		query.otherProxy = aggregateProxy;
+		query.aggregateIsA = aggregateIsA == false;
+		otherAggregate->Query(&query, aggregate->m_tree.GetRootAABB(), 0xFFFF);
+		return;
+	}
+
+	if (otherProxy->fixture->GetBody() == aggregate->m_body)
+	{
+		return;
+	}
+
+	const cb2Fixture* otherFixture = otherProxy->fixture;
+	int otherIndex = (int)(otherProxy - otherFixture->m_proxies);
+
+	cb2AggregatePairQuery query;
+	query.contactManager = this;
+	query.otherProxy = otherProxy;
+	query.aggregateIsA = aggregateIsA;
+	aggregate->Query(&query, otherFixture->GetProxyFatAABB(&m_broadPhase, otherIndex), 0xFFFF);
+}
+
 void cb2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 {
 	cb2FixtureProxy* proxyA = (cb2FixtureProxy*)proxyUserDataA;
 	cb2FixtureProxy* proxyB = (cb2FixtureProxy*)proxyUserDataB;
 
+	if (proxyA->fixture == NULL)
+	{
+		AddAggregatePairs(proxyA, proxyB, true);
+		return;
+	}
+
+	if (proxyB->fixture == NULL)
+	{
+		AddAggregatePairs(proxyB, proxyA, false);
+		return;
+	}
+
+	if (proxyA->childIndex == cb2Shape::e_allChildren)
+	{
+		AddEdgePairs(proxyA, proxyB, true);
+		return;
+	}
+
+	if (proxyB->childIndex == cb2Shape::e_allChildren)
+	{
+		AddEdgePairs(proxyB, proxyA, false);
+		return;
+	}
+
+	++m_pairCount;
+
 	cb2Fixture* fixtureA = proxyA->fixture;
 	cb2Fixture* fixtureB = proxyB->fixture;
 
@@ -194,33 +919,10 @@ void cb2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 		return;
 	}
 
-	// TODO_ERIN use a hash table to remove a potential bottleneck when both
-	// bodies have a lot of contacts.
 	// Does a contact already exist?
-	cb2ContactEdge* edge = bodyB->GetContactList();
-	while (edge)
+	if (FindContact(fixtureA, indexA, fixtureB, indexB))
 	{
-		if (edge->other == bodyA)
-		{
-			cb2Fixture* fA = edge->contact->GetFixtureA();
-			cb2Fixture* fB = edge->contact->GetFixtureB();
-			int iA = edge->contact->GetChildIndexA();
-			int iB = edge->contact->GetChildIndexB();
-
-			if (fA == fixtureA && fB == fixtureB && iA == indexA && iB == indexB)
-			{
-				// A contact already exists.
-				return;
-			}
-
-			if (fA == fixtureB && fB == fixtureA && iA == indexB && iB == indexA)
-			{
-				// A contact already exists.
-				return;
-			}
-		}
-
-		edge = edge->next;
+		return;
 	}
 
 	// Does a joint override collision? Is at least one body dynamic?
@@ -250,6 +952,24 @@ void cb2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 	bodyA = fixtureA->GetBody();
 	bodyB = fixtureB->GetBody();
 
+	InsertContact(c);
+	++m_createdContactCount;
+
+	// Wake up the bodies
+	if (fixtureA->IsSensor() == false && fixtureB->IsSensor() == false)
+	{
+   	bodyA->SetAwake(true);
+   	bodyB->SetAwake(true);
+	}
+
+	UpdateAwake(c);
+}
+
+void cb2ContactManager::AttachContact(cb2Contact* c)
+{
+	cb2Body* bodyA = c->m_fixtureA->m_body;
+	cb2Body* bodyB = c->m_fixtureB->m_body;
+
 	// Insert into the world.
 	c->m_prev = NULL;
 	c->m_next = m_contactList;
@@ -284,13 +1004,29 @@ void cb2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 		bodyB->m_contactList->prev = &c->m_nodeB;
 	}
 	bodyB->m_contactList = &c->m_nodeB;
+}
 
-	// Wake up the bodies
-	if (fixtureA->IsSensor() == false && fixtureB->IsSensor() == false)
+void cb2ContactManager::InsertContact(cb2Contact* c)
+{
+	AttachContact(c);
+	InsertPair(c);
+	++m_contactCount;
+}
+
+void cb2ContactManager::RelinkContacts(cb2Contact** contacts, int count)
+{
+	cb2Assert(count == m_contactCount);
+
+	// Bodies without contacts have empty lists already.
+	for (int i = 0; i < count; ++i)
 	{
-   	bodyA->SetAwake(true);
-   	bodyB->SetAwake(true);
+		contacts[i]->m_fixtureA->m_body->m_contactList = NULL;
+		contacts[i]->m_fixtureB->m_body->m_contactList = NULL;
 	}
 
-	++m_contactCount;
+	m_contactList = NULL;
+	for (int i = count - 1; i >= 0; --i)
+	{
+		AttachContact(contacts[i]);
+	}
 }
@@ -21,32 +21,181 @@
 
 #include <CinderBox2D/Collision/cb2BroadPhase.h>
 
+class cb2Body;
 class cb2Contact;
 class cb2ContactFilter;
 class cb2ContactListener;
 class cb2BlockAllocator;
+class cb2StackAllocator;
+class cb2TaskScheduler;
+class cb2Fixture;
+struct cb2FixtureProxy;
+struct cb2SensorEvent;
+struct cb2ContactBeginEvent;
+struct cb2ContactEndEvent;
+struct cb2ContactHitEvent;
+
+extern cb2ContactFilter cb2_defaultFilter;
+
+// Per contact scratch for the narrow phase.
+struct cb2ContactUpdate
+{
+	cb2Contact* contact;
+	cb2Body* bodyA;
+	cb2Body* bodyB;
+	void (*manifoldFcn)(cb2ContactUpdate* updates, int count);	// from cb2ContactRegister
+	cb2Manifold manifold;
+	bool touching;
+	bool tested;
+	bool overlap;
+};
+
+// An entry of the awake array. It holds what the walks over the awake contacts read
+// before they decide to skip one, so skipping does not load the contact or its
+// fixtures. None of it changes while the contact lives.
+struct cb2AwakeContact
+{
+	cb2Contact* contact;
+	cb2Body* bodyA;
+	cb2Body* bodyB;
+	void (*manifoldFcn)(cb2ContactUpdate* updates, int count);	// from cb2ContactRegister
+	int typePair;	// shape type of A times cb2Shape::e_typeCount plus that of B
+};
 
 // Delegate of cb2World.
 class cb2ContactManager
 {
 public:
-	cb2ContactManager();
+	cb2ContactManager(cb2AllocatorInterface* allocator = NULL);
+	~cb2ContactManager();
 
 	// Broad-phase callback.
 	void AddPair(void* proxyUserDataA, void* proxyUserDataB);
 
+	// Link a new contact into the world and body lists and the pair set, without
+	// waking anything. cb2World::LoadSnapshot uses this directly.
+	void InsertContact(cb2Contact* c);
+
+	// Rebuild the world and body contact lists in the order of the array, which holds
+	// every contact. cb2World::RestoreState uses this to restore the saved order.
+	void RelinkContacts(cb2Contact** contacts, int count);
+
+	// Pair the edges of a shared proxy that are under the other proxy.
+	void AddEdgePairs(cb2FixtureProxy* sharedProxy, cb2FixtureProxy* otherProxy, bool sharedIsA);
+
+	// Pair the fixture proxies of an aggregate proxy that are under the other proxy.
+	void AddAggregatePairs(cb2FixtureProxy* aggregateProxy, cb2FixtureProxy* otherProxy, bool aggregateIsA);
+
+	// Test the fat AABBs of the children of a contact.
+	static bool TestOverlap(const cb2BroadPhase* broadPhase, const cb2Contact* c);
+
 	void FindNewContacts();
 
 	void Destroy(cb2Contact* c);
 
+	// Move a contact in or out of the awake array. A contact is awake if one of its
+	// bodies is awake and not static, or if it still needs filtering. Contacts are
+	// appended and swap removed, so walks must handle removal at the cursor.
+	void UpdateAwake(cb2Contact* c);
+	void RemoveAwake(cb2Contact* c);
+
+	// Append a contact to the awake array as it is.
+	void AppendAwake(cb2Contact* c);
+
+	// Grow the awake array and the pair set for this many contacts, see
+	// cb2World::ReserveContacts.
+	void Reserve(int contactCount);
+
 	void Collide();
-            
+	static void CollideTask(void* context, int begin, int end, int threadIndex);
+
+	// Record that a sensor contact began or ceased to touch.
+	void PushSensorEvent(const cb2Contact* c, bool begin);
+
+	// Drop the sensor events that were there when the last step returned.
+	void ClearReportedSensorEvents();
+
+	// Record that a contact without sensors began or ceased to touch.
+	void PushContactEvent(cb2Contact* c, bool begin);
+
+	// Drop the begin and hit events of the last step and the end events it reported.
+	void ClearReportedContactEvents();
+
+	// Fill in the impulses of the hit events once the step is solved.
+	void FinishHitEvents();
+
+	// Find the contact between two fixture children in either order, or NULL.
+	cb2Contact* FindContact(const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB) const;
+
 	cb2BroadPhase m_broadPhase;
 	cb2Contact* m_contactList;
 	int m_contactCount;
+	// The awake contacts are walked through this array. The contacts stay in the block
+	// allocator: their types differ in size, and bodies, islands, listeners and users
+	// hold on to their pointers. The entries pack their bodies and collide function.
+	cb2AwakeContact* m_awakeContacts;
+	int m_awakeContactCount;
+	int m_awakeContactCapacity;
 	cb2ContactFilter* m_contactFilter;
 	cb2ContactListener* m_contactListener;
 	cb2BlockAllocator* m_allocator;
+	cb2StackAllocator* m_stackAllocator;
+	cb2TaskScheduler* m_taskScheduler;
+	cb2AllocatorInterface* m_backingAllocator;
+
+	// Contacts keep their manifold while the relative pose drifts less than this.
+	float m_reuseLinearTolerance;
+	float m_reuseAngularTolerance;
+
+	// The time step contacts look ahead for speculative points, 0 when they are off.
+	float m_speculativeDt;
+
+	// Sensor contacts record their touching changes here instead of calling the
+	// listener. The first m_reportedSensorEventCount were reported by the last step.
+	bool m_batchSensorEvents;
+	cb2SensorEvent* m_sensorEvents;
+	int m_sensorEventCount;
+	int m_sensorEventCapacity;
+	int m_reportedSensorEventCount;
+
+	// Contacts without sensors record their touching changes here instead of calling
+	// the listener. Begin and hit events only happen during a step, end events also
+	// when a contact is destroyed between steps. m_hitContacts parallels m_hitEvents.
+	bool m_batchContactEvents;
+	float m_hitEventThreshold;
+	cb2ContactBeginEvent* m_beginEvents;
+	int m_beginEventCount;
+	int m_beginEventCapacity;
+	cb2ContactEndEvent* m_endEvents;
+	int m_endEventCount;
+	int m_endEventCapacity;
+	int m_reportedEndEventCount;
+	cb2ContactHitEvent* m_hitEvents;
+	cb2Contact** m_hitContacts;
+	int m_hitEventCount;
+	int m_hitEventCapacity;
+
+	// Counters for cb2Profile, the world resets them when a step begins.
+	int m_pairCount;
+	int m_createdContactCount;
+	int m_destroyedContactCount;
+	int m_touchingContactCount;
+
+private:
+
+	// Push a contact on the front of the world list and the lists of its bodies.
+	void AttachContact(cb2Contact* c);
+
+	// Open addressing set of all contacts keyed on their fixture children, so finding
+	// an existing pair does not walk the contact list of a body touching thousands.
+	void InsertPair(cb2Contact* c);
+	void RemovePair(cb2Contact* c);
+	int GetPairSlot(const cb2Fixture* fixtureA, int indexA, const cb2Fixture* fixtureB, int indexB) const;
+	void GrowPairs(int capacity);
+	void GrowAwake(int capacity);
+
+	cb2Contact** m_pairs;
+	int m_pairCapacity;
 };
 
 #endif
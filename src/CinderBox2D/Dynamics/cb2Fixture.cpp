@@ -19,10 +19,13 @@
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
 #include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
 #include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
 #include <CinderBox2D/Collision/cb2BroadPhase.h>
 #include <CinderBox2D/Collision/cb2Collision.h>
 #include <CinderBox2D/Common/cb2BlockAllocator.h>
@@ -34,8 +37,10 @@ cb2Fixture::cb2Fixture()
 	m_next = NULL;
 	m_proxies = NULL;
 	m_proxyCount = 0;
+	m_sharedProxy = false;
 	m_shape = NULL;
 	m_density = 0.0f;
+	m_handle = cb2_nullHandle;
 }
 
 void cb2Fixture::Create(cb2BlockAllocator* allocator, cb2Body* body, const cb2FixtureDef* def)
@@ -43,6 +48,7 @@ void cb2Fixture::Create(cb2BlockAllocator* allocator, cb2Body* body, const cb2Fi
 	m_userData = def->userData;
 	m_friction = def->friction;
 	m_restitution = def->restitution;
+	m_tangentSpeed = def->tangentSpeed;
 
 	m_body = body;
 	m_next = NULL;
@@ -50,13 +56,30 @@ void cb2Fixture::Create(cb2BlockAllocator* allocator, cb2Body* body, const cb2Fi
 	m_filter = def->filter;
 
 	m_isSensor = def->isSensor;
+	m_enableContactEvents = def->enableContactEvents;
+	m_enableHitEvents = def->enableHitEvents;
 
-	m_shape = def->shape->Clone(allocator);
+	if (def->shape->m_shareCount != 0)
+	{
+		// Shared shapes are only changed through the fixtures holding them. The
+		// shapes of a static layer are not counted, other worlds hold them too.
+		m_shape = const_cast<cb2Shape*>(def->shape);
+		if (m_shape->m_shareCount > 0)
+		{
+			++m_shape->m_shareCount;
+		}
+	}
+	else
+	{
+		m_shape = def->shape->Clone(allocator);
+	}
+	m_sharedProxy = m_shape->m_type == cb2Shape::e_heightfield ||
+		(m_shape->m_type == cb2Shape::e_chain && ((cb2ChainShape*)m_shape)->m_edgeTree != NULL);
 
 	// Reserve proxy space
-	int childCount = m_shape->GetChildCount();
-	m_proxies = (cb2FixtureProxy*)allocator->Allocate(childCount * sizeof(cb2FixtureProxy));
-	for (int i = 0; i < childCount; ++i)
+	int proxyCount = ComputeProxyCount();
+	m_proxies = (cb2FixtureProxy*)allocator->Allocate(proxyCount * sizeof(cb2FixtureProxy));
+	for (int i = 0; i < proxyCount; ++i)
 	{
 		m_proxies[i].fixture = NULL;
 		m_proxies[i].proxyId = cb2BroadPhase::e_nullProxy;
@@ -72,16 +95,35 @@ void cb2Fixture::Destroy(cb2BlockAllocator* allocator)
 	cb2Assert(m_proxyCount == 0);
 
 	// Free the proxy array.
-	int childCount = m_shape->GetChildCount();
-	allocator->Free(m_proxies, childCount * sizeof(cb2FixtureProxy));
+	int proxyCount = ComputeProxyCount();
+	allocator->Free(m_proxies, proxyCount * sizeof(cb2FixtureProxy));
 	m_proxies = NULL;
 
-	// Free the child shape.
-	switch (m_shape->m_type)
+	// Free the child shape, the world keeps it while views may still query it.
+	m_body->m_world->ReleaseShape(m_shape);
+	m_shape = NULL;
+}
+
+void cb2Fixture::ReleaseShape(cb2BlockAllocator* allocator, cb2Shape* shape)
+{
+	if (DropShapeReference(shape))
+	{
+		FreeShape(allocator, shape);
+	}
+}
+
+bool cb2Fixture::DropShapeReference(cb2Shape* shape)
+{
+	return shape->m_shareCount == 0 || (shape->m_shareCount > 0 && --shape->m_shareCount == 0);
+}
+
+void cb2Fixture::FreeShape(cb2BlockAllocator* allocator, cb2Shape* shape)
+{
+	switch (shape->m_type)
 	{
 	case cb2Shape::e_circle:
 		{
-			cb2CircleShape* s = (cb2CircleShape*)m_shape;
+			cb2CircleShape* s = (cb2CircleShape*)shape;
 			s->~cb2CircleShape();
 			allocator->Free(s, sizeof(cb2CircleShape));
 		}
@@ -89,7 +131,7 @@ void cb2Fixture::Destroy(cb2BlockAllocator* allocator)
 
 	case cb2Shape::e_edge:
 		{
-			cb2EdgeShape* s = (cb2EdgeShape*)m_shape;
+			cb2EdgeShape* s = (cb2EdgeShape*)shape;
 			s->~cb2EdgeShape();
 			allocator->Free(s, sizeof(cb2EdgeShape));
 		}
@@ -97,7 +139,7 @@ void cb2Fixture::Destroy(cb2BlockAllocator* allocator)
 
 	case cb2Shape::e_polygon:
 		{
-			cb2PolygonShape* s = (cb2PolygonShape*)m_shape;
+			cb2PolygonShape* s = (cb2PolygonShape*)shape;
 			s->~cb2PolygonShape();
 			allocator->Free(s, sizeof(cb2PolygonShape));
 		}
@@ -105,39 +147,97 @@ void cb2Fixture::Destroy(cb2BlockAllocator* allocator)
 
 	case cb2Shape::e_chain:
 		{
-			cb2ChainShape* s = (cb2ChainShape*)m_shape;
+			cb2ChainShape* s = (cb2ChainShape*)shape;
 			s->~cb2ChainShape();
 			allocator->Free(s, sizeof(cb2ChainShape));
 		}
 		break;
 
+	case cb2Shape::e_capsule:
+		{
+			cb2CapsuleShape* s = (cb2CapsuleShape*)shape;
+			s->~cb2CapsuleShape();
+			allocator->Free(s, sizeof(cb2CapsuleShape));
+		}
+		break;
+
+	case cb2Shape::e_heightfield:
+		{
+			cb2HeightfieldShape* s = (cb2HeightfieldShape*)shape;
+			s->~cb2HeightfieldShape();
+			allocator->Free(s, sizeof(cb2HeightfieldShape));
+		}
+		break;
+
 	default:
 		cb2Assert(false);
 		break;
 	}
 
-	m_shape = NULL;
+}
+
+cb2Shape* cb2Fixture::UnshareShape()
+{
+	if (m_shape->m_shareCount != 0)
+	{
+		cb2World* world = m_body->GetWorld();
+		cb2Shape* shape = m_shape->Clone(&world->m_blockAllocator);
+		world->ReleaseShape(m_shape);
+		m_shape = shape;
+	}
+
+	return m_shape;
 }
 
 void cb2Fixture::CreateProxies(cb2BroadPhase* broadPhase, const cb2Transform& xf)
 {
 	cb2Assert(m_proxyCount == 0);
 
+	if (m_body->m_aggregate)
+	{
+		m_body->m_aggregate->CreateProxies(broadPhase, this, xf);
+		return;
+	}
+
 	// Create proxies in the broad-phase.
-	m_proxyCount = m_shape->GetChildCount();
+	m_proxyCount = ComputeProxyCount();
+	bool isStatic = m_body->GetType() == cb2_staticBody;
 
 	for (int i = 0; i < m_proxyCount; ++i)
 	{
 		cb2FixtureProxy* proxy = m_proxies + i;
-		m_shape->ComputeAABB(&proxy->aabb, xf, i);
-		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy);
+		proxy->childIndex = m_sharedProxy ? (int)cb2Shape::e_allChildren : i;
+		m_shape->ComputeAABB(&proxy->aabb, xf, proxy->childIndex);
+		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy, isStatic);
 		proxy->fixture = this;
-		proxy->childIndex = i;
+	}
+
+	SetProxyFilters(broadPhase);
+}
+
+void cb2Fixture::SetProxyFilters(cb2BroadPhase* broadPhase)
+{
+	if (m_body->m_aggregate)
+	{
+		m_body->m_aggregate->SetProxyFilters(broadPhase, this);
+		return;
+	}
+
+	unsigned short maskBits = m_filter.groupIndex > 0 ? 0xFFFF : m_filter.maskBits;
+	for (int i = 0; i < m_proxyCount; ++i)
+	{
+		broadPhase->SetProxyFilter(m_proxies[i].proxyId, m_filter.categoryBits, maskBits);
 	}
 }
 
 void cb2Fixture::DestroyProxies(cb2BroadPhase* broadPhase)
 {
+	if (m_body->m_aggregate)
+	{
+		m_body->m_aggregate->DestroyProxies(broadPhase, this);
+		return;
+	}
+
 	// Destroy proxies in the broad-phase.
 	for (int i = 0; i < m_proxyCount; ++i)
 	{
@@ -151,11 +251,12 @@ void cb2Fixture::DestroyProxies(cb2BroadPhase* broadPhase)
 
 void cb2Fixture::Synchronize(cb2BroadPhase* broadPhase, const cb2Transform& transform1, const cb2Transform& transform2)
 {
-	if (m_proxyCount == 0)
-	{	
-		return;
-	}
+	ComputeSweptAABBs(transform1, transform2);
+	MoveProxies(broadPhase, transform2.p - transform1.p);
+}
 
+void cb2Fixture::ComputeSweptAABBs(const cb2Transform& transform1, const cb2Transform& transform2)
+{
 	for (int i = 0; i < m_proxyCount; ++i)
 	{
 		cb2FixtureProxy* proxy = m_proxies + i;
@@ -166,9 +267,17 @@ void cb2Fixture::Synchronize(cb2BroadPhase* broadPhase, const cb2Transform& tran
 		m_shape->ComputeAABB(&aabb2, transform2, proxy->childIndex);
 	
 		proxy->aabb.Combine(aabb1, aabb2);
+	}
+}
 
-		ci::Vec2f displacement = transform2.p - transform1.p;
+void cb2Fixture::MoveProxies(cb2BroadPhase* broadPhase, const ci::Vec2f& displacement)
+{
+	// The proxies of an aggregate body are moved together, see cb2Body::MoveFixtureProxies.
+	cb2Assert(m_body->m_aggregate == NULL);
 
+	for (int i = 0; i < m_proxyCount; ++i)
+	{
+		cb2FixtureProxy* proxy = m_proxies + i;
 		broadPhase->MoveProxy(proxy->proxyId, proxy->aabb, displacement);
 	}
 }
@@ -176,6 +285,10 @@ void cb2Fixture::Synchronize(cb2BroadPhase* broadPhase, const cb2Transform& tran
 void cb2Fixture::SetFilterData(const cb2Filter& filter)
 {
 	m_filter = filter;
+	if (m_body)
+	{
+		++m_body->GetWorld()->m_topologyStamp;
+	}
 
 	Refilter();
 }
@@ -211,18 +324,64 @@ void cb2Fixture::Refilter()
 
 	// Touch each proxy so that new pairs may be created
 	cb2BroadPhase* broadPhase = &world->m_contactManager.m_broadPhase;
+	SetProxyFilters(broadPhase);
+	if (m_body->m_aggregate)
+	{
+		m_body->m_aggregate->Touch(broadPhase);
+		return;
+	}
+
 	for (int i = 0; i < m_proxyCount; ++i)
 	{
 		broadPhase->TouchProxy(m_proxies[i].proxyId);
 	}
 }
 
+int cb2Fixture::GetReinsertCount(int childIndex) const
+{
+	int proxyIndex = GetProxyIndex(childIndex);
+	cb2Assert(0 <= proxyIndex && proxyIndex < m_proxyCount);
+	if (m_body->m_aggregate)
+	{
+		return m_body->m_aggregate->m_tree.GetReinsertCount(m_proxies[proxyIndex].proxyId);
+	}
+
+	const cb2BroadPhase* broadPhase = &m_body->GetWorld()->m_contactManager.m_broadPhase;
+	return broadPhase->GetProxyReinsertCount(m_proxies[proxyIndex].proxyId);
+}
+
+const cb2AABB& cb2Fixture::GetProxyFatAABB(const cb2BroadPhase* broadPhase, int proxyIndex) const
+{
+	cb2Assert(0 <= proxyIndex && proxyIndex < m_proxyCount);
+	if (m_body->m_aggregate)
+	{
+		return m_body->m_aggregate->m_tree.GetFatAABB(m_proxies[proxyIndex].proxyId);
+	}
+
+	return broadPhase->GetFatAABB(m_proxies[proxyIndex].proxyId);
+}
+
+void cb2Fixture::GetChildFatAABB(cb2AABB* aabb, const cb2BroadPhase* broadPhase, int childIndex) const
+{
+	if (m_sharedProxy == false)
+	{
+		*aabb = GetProxyFatAABB(broadPhase, childIndex);
+		return;
+	}
+
+	m_shape->ComputeAABB(aabb, m_body->GetTransform(), childIndex);
+	ci::Vec2f r(cb2_aabbExtension, cb2_aabbExtension);
+	aabb->lowerBound -= r;
+	aabb->upperBound += r;
+}
+
 void cb2Fixture::SetSensor(bool sensor)
 {
 	if (sensor != m_isSensor)
 	{
 		m_body->SetAwake(true);
 		m_isSensor = sensor;
+		++m_body->GetWorld()->m_topologyStamp;
 	}
 }
 
@@ -233,6 +392,9 @@ void cb2Fixture::Dump(int bodyIndex)
 	cb2Log("    fd.restitution = %.15lef;\n", m_restitution);
 	cb2Log("    fd.density = %.15lef;\n", m_density);
 	cb2Log("    fd.isSensor = bool(%d);\n", m_isSensor);
+	cb2Log("    fd.tangentSpeed = %.15lef;\n", m_tangentSpeed);
+	cb2Log("    fd.enableContactEvents = bool(%d);\n", m_enableContactEvents);
+	cb2Log("    fd.enableHitEvents = bool(%d);\n", m_enableHitEvents);
 	cb2Log("    fd.filter.categoryBits = unsigned short(%d);\n", m_filter.categoryBits);
 	cb2Log("    fd.filter.maskBits = unsigned short(%d);\n", m_filter.maskBits);
 	cb2Log("    fd.filter.groupIndex = short(%d);\n", m_filter.groupIndex);
@@ -292,6 +454,41 @@ void cb2Fixture::Dump(int bodyIndex)
 		}
 		break;
 
+	case cb2Shape::e_capsule:
+		{
+			cb2CapsuleShape* s = (cb2CapsuleShape*)m_shape;
+			cb2Log("    cb2CapsuleShape shape;\n");
+			cb2Log("    shape.m_radius = %.15lef;\n", s->m_radius);
+			cb2Log("    shape.m_vertex1.set(%.15lef, %.15lef);\n", s->m_vertex1.x, s->m_vertex1.y);
+			cb2Log("    shape.m_vertex2.set(%.15lef, %.15lef);\n", s->m_vertex2.x, s->m_vertex2.y);
+		}
+		break;
+
+	case cb2Shape::e_heightfield:
+		{
+			cb2HeightfieldShape* s = (cb2HeightfieldShape*)m_shape;
+			cb2Log("    cb2HeightfieldShape shape;\n");
+			cb2Log("    float hs[%d];\n", s->m_count);
+			for (int i = 0; i < s->m_count; ++i)
+			{
+				cb2Log("    hs[%d] = %.15lef;\n", i, s->m_heights[i]);
+			}
+			if (s->m_holes)
+			{
+				cb2Log("    bool holes[%d];\n", s->m_count - 1);
+				for (int i = 0; i < s->m_count - 1; ++i)
+				{
+					cb2Log("    holes[%d] = bool(%d);\n", i, s->m_holes[i]);
+				}
+				cb2Log("    shape.Create(hs, %d, %.15lef, holes);\n", s->m_count, s->m_spacing);
+			}
+			else
+			{
+				cb2Log("    shape.Create(hs, %d, %.15lef);\n", s->m_count, s->m_spacing);
+			}
+		}
+		break;
+
 	default:
 		return;
 	}
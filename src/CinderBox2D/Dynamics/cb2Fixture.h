@@ -22,6 +22,8 @@
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Collision/cb2Collision.h>
 #include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
 
 class cb2BlockAllocator;
 class cb2Body;
@@ -64,10 +66,14 @@ struct cb2FixtureDef
 		restitution = 0.0f;
 		density = 0.0f;
 		isSensor = false;
+		tangentSpeed = 0.0f;
+		enableContactEvents = true;
+		enableHitEvents = false;
 	}
 
 	/// The shape, this must be set. The shape will be cloned, so you
-	/// can create the shape on the stack.
+	/// can create the shape on the stack. A shape made by cb2World::CreateSharedShape
+	/// is shared instead of cloned.
 	const cb2Shape* shape;
 
 	/// Use this to store application specific fixture data.
@@ -86,6 +92,21 @@ struct cb2FixtureDef
 	/// response.
 	bool isSensor;
 
+	/// The speed of the surface along its tangent, clockwise around the fixture, in
+	/// meters per second. Contacts take the sum of the speeds of their fixtures, so
+	/// conveyor belts do not need cb2ContactListener::PreSolve.
+	float tangentSpeed;
+
+	/// Report begin and end events of contacts with this fixture when the world
+	/// batches contact events. Events are reported if either fixture enables them.
+	/// @see cb2World::SetContactEventBatching
+	bool enableContactEvents;
+
+	/// Report hit events of contacts with this fixture when the world batches
+	/// contact events. Hits are reported if either fixture enables them.
+	/// @see cb2World::SetHitEventThreshold
+	bool enableHitEvents;
+
 	/// Contact filtering data.
 	cb2Filter filter;
 };
@@ -113,10 +134,16 @@ public:
 
 	/// Get the child shape. You can modify the child shape, however you should not change the
 	/// number of vertices because this will crash some collision caching mechanisms.
-	/// Manipulating the shape may lead to non-physical behavior.
+	/// Manipulating the shape may lead to non-physical behavior. A shared shape must not
+	/// be modified, call UnshareShape first.
 	cb2Shape* GetShape();
 	const cb2Shape* GetShape() const;
 
+	/// Give this fixture its own copy of its shape if the shape is shared with other
+	/// fixtures, so that it can be modified.
+	/// @return the shape of this fixture.
+	cb2Shape* UnshareShape();
+
 	/// Set if this fixture is a sensor.
 	void SetSensor(bool sensor);
 
@@ -152,6 +179,10 @@ public:
 	/// Set the user data. Use this to store your application specific data.
 	void SetUserData(void* data);
 
+	/// Get the handle of this fixture, it resolves through cb2World::GetFixture
+	/// until the fixture is destroyed.
+	cb2Handle GetHandle() const;
+
 	/// Test a point for containment in this fixture.
 	/// @param p a point in world coordinates.
 	bool TestPoint(const ci::Vec2f& p) const;
@@ -187,11 +218,37 @@ public:
 	/// existing contacts.
 	void SetRestitution(float restitution);
 
+	/// Get the tangent speed of the surface.
+	float GetTangentSpeed() const;
+
+	/// Set the tangent speed of the surface. This will _not_ change the tangent speed
+	/// of existing contacts.
+	void SetTangentSpeed(float speed);
+
+	/// Enable or disable batched begin and end events of contacts with this fixture.
+	void SetContactEventsEnabled(bool flag);
+	bool AreContactEventsEnabled() const;
+
+	/// Enable or disable batched hit events of contacts with this fixture.
+	void SetHitEventsEnabled(bool flag);
+	bool AreHitEventsEnabled() const;
+
 	/// Get the fixture's AABB. This AABB may be enlarge and/or stale.
 	/// If you need a more accurate AABB, compute it using the shape and
-	/// the body transform.
+	/// the body transform. The edges of a chain with an edge tree and the
+	/// cells of a heightfield share the AABB of the whole shape.
 	const cb2AABB& GetAABB(int childIndex) const;
 
+	/// Find the children of a chain with an edge tree or of a heightfield that
+	/// overlap an AABB in world coordinates. The callback gets
+	/// bool QueryEdge(int index) for each child and returns false to stop.
+	template <typename T>
+	void QueryChildren(T* callback, const cb2AABB& aabb) const;
+
+	/// Get how often the broad-phase proxy of a child left its fat AABB.
+	/// This restarts when the body is activated or changes to or from static.
+	int GetReinsertCount(int childIndex) const;
+
 	/// Dump this fixture to the log file.
 	void Dump(int bodyIndex);
 
@@ -201,6 +258,8 @@ protected:
 	friend class cb2World;
 	friend class cb2Contact;
 	friend class cb2ContactManager;
+	friend class cb2WorldView;
+	friend class cb2BodyAggregate;
 
 	cb2Fixture();
 
@@ -209,12 +268,45 @@ protected:
 	void Create(cb2BlockAllocator* allocator, cb2Body* body, const cb2FixtureDef* def);
 	void Destroy(cb2BlockAllocator* allocator);
 
+	// Drop a reference to a shape, a shape that is not shared or whose last
+	// reference this is gets freed.
+	static void ReleaseShape(cb2BlockAllocator* allocator, cb2Shape* shape);
+
+	// Drop a reference to a shape, true if the shape must be freed now.
+	static bool DropShapeReference(cb2Shape* shape);
+
+	// Free a shape made by Clone.
+	static void FreeShape(cb2BlockAllocator* allocator, cb2Shape* shape);
+
 	// These support body activation/deactivation.
 	void CreateProxies(cb2BroadPhase* broadPhase, const cb2Transform& xf);
 	void DestroyProxies(cb2BroadPhase* broadPhase);
 
+	// Give the proxies the filter the broad-phase prunes pairs with. Positive groups
+	// collide whatever the masks say, so they are not pruned.
+	void SetProxyFilters(cb2BroadPhase* broadPhase);
+
 	void Synchronize(cb2BroadPhase* broadPhase, const cb2Transform& xf1, const cb2Transform& xf2);
 
+	// The two halves of Synchronize. Computing the AABBs only touches the fixture,
+	// so it may run in parallel for different bodies.
+	void ComputeSweptAABBs(const cb2Transform& xf1, const cb2Transform& xf2);
+	void MoveProxies(cb2BroadPhase* broadPhase, const ci::Vec2f& displacement);
+
+	// The number of broad-phase proxies, one per child unless they share one.
+	int ComputeProxyCount() const;
+
+	// Get the proxy holding a child.
+	int GetProxyIndex(int childIndex) const;
+
+	// Get the fat AABB of a proxy, from the broad-phase or from the tree of an
+	// aggregate body.
+	const cb2AABB& GetProxyFatAABB(const cb2BroadPhase* broadPhase, int proxyIndex) const;
+
+	// Get the fat AABB of a child. Children sharing a proxy get their own AABB
+	// fattened like that of a proxy.
+	void GetChildFatAABB(cb2AABB* aabb, const cb2BroadPhase* broadPhase, int childIndex) const;
+
 	float m_density;
 
 	cb2Fixture* m_next;
@@ -224,13 +316,22 @@ protected:
 
 	float m_friction;
 	float m_restitution;
+	float m_tangentSpeed;
 
 	cb2FixtureProxy* m_proxies;
 	int m_proxyCount;
 
+	// A chain with an edge tree and a heightfield have a single proxy for all
+	// children, with the child index cb2Shape::e_allChildren.
+	bool m_sharedProxy;
+
 	cb2Filter m_filter;
 
 	bool m_isSensor;
+	bool m_enableContactEvents;
+	bool m_enableHitEvents;
+
+	cb2Handle m_handle;
 
 	void* m_userData;
 };
@@ -270,6 +371,11 @@ inline void cb2Fixture::SetUserData(void* data)
 	m_userData = data;
 }
 
+inline cb2Handle cb2Fixture::GetHandle() const
+{
+	return m_handle;
+}
+
 inline cb2Body* cb2Fixture::GetBody()
 {
 	return m_body;
@@ -321,6 +427,36 @@ inline void cb2Fixture::SetRestitution(float restitution)
 	m_restitution = restitution;
 }
 
+inline float cb2Fixture::GetTangentSpeed() const
+{
+	return m_tangentSpeed;
+}
+
+inline void cb2Fixture::SetTangentSpeed(float speed)
+{
+	m_tangentSpeed = speed;
+}
+
+inline void cb2Fixture::SetContactEventsEnabled(bool flag)
+{
+	m_enableContactEvents = flag;
+}
+
+inline bool cb2Fixture::AreContactEventsEnabled() const
+{
+	return m_enableContactEvents;
+}
+
+inline void cb2Fixture::SetHitEventsEnabled(bool flag)
+{
+	m_enableHitEvents = flag;
+}
+
+inline bool cb2Fixture::AreHitEventsEnabled() const
+{
+	return m_enableHitEvents;
+}
+
 inline bool cb2Fixture::TestPoint(const ci::Vec2f& p) const
 {
 	return m_shape->TestPoint(m_body->GetTransform(), p);
@@ -336,10 +472,35 @@ inline void cb2Fixture::GetMassData(cb2MassData* massData) const
 	m_shape->ComputeMass(massData, m_density);
 }
 
+inline int cb2Fixture::ComputeProxyCount() const
+{
+	return m_sharedProxy ? 1 : m_shape->GetChildCount();
+}
+
+inline int cb2Fixture::GetProxyIndex(int childIndex) const
+{
+	return m_sharedProxy ? 0 : childIndex;
+}
+
+template <typename T>
+inline void cb2Fixture::QueryChildren(T* callback, const cb2AABB& aabb) const
+{
+	cb2Assert(m_sharedProxy);
+	if (m_shape->m_type == cb2Shape::e_heightfield)
+	{
+		((const cb2HeightfieldShape*)m_shape)->QueryEdges(callback, aabb, m_body->GetTransform());
+	}
+	else
+	{
+		((const cb2ChainShape*)m_shape)->QueryEdges(callback, aabb, m_body->GetTransform());
+	}
+}
+
 inline const cb2AABB& cb2Fixture::GetAABB(int childIndex) const
 {
-	cb2Assert(0 <= childIndex && childIndex < m_proxyCount);
-	return m_proxies[childIndex].aabb;
+	int proxyIndex = GetProxyIndex(childIndex);
+	cb2Assert(0 <= proxyIndex && proxyIndex < m_proxyCount);
+	return m_proxies[proxyIndex].aabb;
 }
 
 #endif
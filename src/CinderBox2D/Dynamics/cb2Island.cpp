@@ -24,8 +24,15 @@
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2ContactSolver.h>
 #include <CinderBox2D/Dynamics/Joints/cb2Joint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2JointSolver.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2SoftContactSolver.h>
 #include <CinderBox2D/Common/cb2StackAllocator.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Common/cb2ThreadPool.h>
 #include <CinderBox2D/Common/cb2Timer.h>
+#include <CinderBox2D/Common/cb2Trace.h>
+
+#include <memory.h>
 
 /*
 Position Correction Notes
@@ -162,6 +169,10 @@ cb2Island::cb2Island(
 	m_allocator = allocator;
 	m_listener = listener;
 
+	m_sharedLock = NULL;
+	m_readyToSleep = false;
+	m_taskScheduler = NULL;
+
 	m_bodies = (cb2Body**)m_allocator->Allocate(bodyCapacity * sizeof(cb2Body*));
 	m_contacts = (cb2Contact**)m_allocator->Allocate(contactCapacity	 * sizeof(cb2Contact*));
 	m_joints = (cb2Joint**)m_allocator->Allocate(jointCapacity * sizeof(cb2Joint*));
@@ -180,50 +191,238 @@ cb2Island::~cb2Island()
 	m_allocator->Free(m_bodies);
 }
 
-void cb2Island::Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity, bool allowSleep)
+// Static bodies and the sleeping bodies of other islands hold still, see
+// cb2SleepDef::wakeHopCount.
+static inline bool cb2IsFixed(const cb2Body* b)
 {
-	cb2Timer timer;
+	return b->GetType() == cb2_staticBody || b->IsAwake() == false;
+}
+
+void cb2Island::Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity, const cb2SleepDef* sleepDef)
+{
+	CB2_TRACE_ZONE_COUNT("SolveIsland", m_bodyCount);
 
 	float h = step.dt;
+	m_readyToSleep = false;
 
-	// Integrate velocities and apply damping. Initialize the body state.
+	// Initialize the body state.
 	for (int i = 0; i < m_bodyCount; ++i)
 	{
 		cb2Body* b = m_bodies[i];
 
-		ci::Vec2f c = b->m_sweep.c;
-		float a = b->m_sweep.a;
-		ci::Vec2f v = b->m_linearVelocity;
-		float w = b->m_angularVelocity;
+		// Store positions for continuous collision. Fixed bodies never move.
+		if (cb2IsFixed(b) == false)
+		{
+			b->m_sweep.c0 = b->m_sweep.c;
+			b->m_sweep.a0 = b->m_sweep.a;
+		}
 
-		// Store positions for continuous collision.
-		b->m_sweep.c0 = b->m_sweep.c;
-		b->m_sweep.a0 = b->m_sweep.a;
+		m_positions[i].c = b->m_sweep.c;
+		m_positions[i].a = b->m_sweep.a;
+		m_velocities[i].v = b->m_linearVelocity;
+		m_velocities[i].w = b->m_angularVelocity;
+	}
 
-		if (b->m_type == cb2_dynamicBody)
+	bool positionSolved;
+	if (step.subStepCount > 0)
+	{
+		positionSolved = SolveSubSteps(profile, step, gravity);
+	}
+	else
+	{
+		IntegrateVelocities(h, gravity);
+		positionSolved = SolveIterations(profile, step);
+	}
+
+	if (sleepDef)
+	{
+		float minSleepTime = cb2_maxFloat;
+
+		const float linTolSqr = sleepDef->linearTolerance * sleepDef->linearTolerance;
+		const float angTolSqr = sleepDef->angularTolerance * sleepDef->angularTolerance;
+		const float factorSqr = cb2_energySleepFactor * cb2_energySleepFactor;
+
+		// With the energy test the island weighs its kinetic energy against the energy
+		// with every body at its tolerances, twice both to save the halves.
+		bool energyTest = sleepDef->energyTest;
+		float energy = 0.0f;
+		float energyTolerance = 0.0f;
+
+		// An island squeezed between sleeping bodies that hold still may never get
+		// its overlap below the slop, it sleeps once it is still.
+		bool fixedNeighbours = false;
+
+		for (int i = 0; i < m_bodyCount; ++i)
 		{
-			// Integrate velocities.
-			v += h * (b->m_gravityScale * gravity + b->m_invMass * b->m_force);
-			w += h * b->m_invI * b->m_torque;
+			cb2Body* b = m_bodies[i];
+			if (cb2IsFixed(b))
+			{
+				fixedNeighbours = fixedNeighbours || b->GetType() != cb2_staticBody;
+				continue;
+			}
+
+			float scaleSqr = b->m_sleepScale * b->m_sleepScale;
+			float linearTolerance = scaleSqr * linTolSqr;
+			float angularTolerance = scaleSqr * angTolSqr;
+			float v2 = cb2Dot(b->m_linearVelocity, b->m_linearVelocity);
+			float w2 = b->m_angularVelocity * b->m_angularVelocity;
+			if (energyTest && b->m_type == cb2_dynamicBody)
+			{
+				energy += b->m_mass * v2 + b->m_I * w2;
+				energyTolerance += b->m_mass * linearTolerance + b->m_I * angularTolerance;
+				linearTolerance *= factorSqr;
+				angularTolerance *= factorSqr;
+			}
+
+			if ((b->m_flags & cb2Body::e_autoSleepFlag) == 0 ||
+				w2 > angularTolerance ||
+				v2 > linearTolerance)
+			{
+				b->m_sleepTime = 0.0f;
+				minSleepTime = 0.0f;
+			}
+			else
+			{
+				b->m_sleepTime += h;
+				minSleepTime = cb2Min(minSleepTime, b->m_sleepTime);
+			}
+		}
 
-			// Apply damping.
-			// ODE: dv/dt + c * v = 0
-			// Solution: v(t) = v0 * exp(-c * t)
-			// Time step: v(t + dt) = v0 * exp(-c * (t + dt)) = v0 * exp(-c * t) * exp(-c * dt) = v * exp(-c * dt)
-			// v2 = exp(-c * dt) * v1
-			// Pade approximation:
-			// v2 = v1 * 1 / (1 + c * dt)
-			v *= 1.0f / (1.0f + h * b->m_linearDamping);
-			w *= 1.0f / (1.0f + h * b->m_angularDamping);
+		if (energyTest && energy > energyTolerance)
+		{
+			for (int i = 0; i < m_bodyCount; ++i)
+			{
+				m_bodies[i]->m_sleepTime = 0.0f;
+			}
+			minSleepTime = 0.0f;
 		}
 
+		if (minSleepTime >= sleepDef->timeToSleep && (positionSolved || fixedNeighbours))
+		{
+			m_readyToSleep = true;
+			if (m_sharedLock)
+			{
+				return;
+			}
+
+			for (int i = 0; i < m_bodyCount; ++i)
+			{
+				cb2Body* b = m_bodies[i];
+				b->SetAwake(false);
+			}
+		}
+	}
+}
+
+void cb2Island::IntegrateVelocities(float h, const ci::Vec2f& gravity)
+{
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		cb2Body* b = m_bodies[i];
+		if (b->m_type != cb2_dynamicBody || cb2IsFixed(b))
+		{
+			continue;
+		}
+
+		ci::Vec2f v = m_velocities[i].v;
+		float w = m_velocities[i].w;
+
+		// Integrate velocities.
+		v += h * (b->m_gravityScale * gravity + b->m_invMass * b->m_force);
+		w += h * b->m_invI * b->m_torque;
+
+		// Apply damping.
+		// ODE: dv/dt + c * v = 0
+		// Solution: v(t) = v0 * exp(-c * t)
+		// Time step: v(t + dt) = v0 * exp(-c * (t + dt)) = v0 * exp(-c * t) * exp(-c * dt) = v * exp(-c * dt)
+		// v2 = exp(-c * dt) * v1
+		// Pade approximation:
+		// v2 = v1 * 1 / (1 + c * dt)
+		v *= 1.0f / (1.0f + h * b->m_linearDamping);
+		w *= 1.0f / (1.0f + h * b->m_angularDamping);
+
+		m_velocities[i].v = v;
+		m_velocities[i].w = w;
+	}
+}
+
+void cb2Island::IntegratePositions(float h)
+{
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		ci::Vec2f c = m_positions[i].c;
+		float a = m_positions[i].a;
+		ci::Vec2f v = m_velocities[i].v;
+		float w = m_velocities[i].w;
+
+		// Check for large velocities
+		ci::Vec2f translation = h * v;
+		if (cb2Dot(translation, translation) > cb2_maxTranslationSquared)
+		{
+			float ratio = cb2_maxTranslation / translation.length();
+			v *= ratio;
+		}
+
+		float rotation = h * w;
+		if (rotation * rotation > cb2_maxRotationSquared)
+		{
+			float ratio = cb2_maxRotation / cb2Abs(rotation);
+			w *= ratio;
+		}
+
+		// Integrate
+		c += h * v;
+		a += h * w;
+
 		m_positions[i].c = c;
 		m_positions[i].a = a;
 		m_velocities[i].v = v;
 		m_velocities[i].w = w;
 	}
+}
 
-	timer.Reset();
+// The largest velocity change of a body caused by the last iteration, relative
+// to the iteration tolerances.
+float cb2Island::ComputeVelocityChange(const cb2Velocity* previousVelocities) const
+{
+	const float linScale = 1.0f / cb2_linearIterationTolerance;
+	const float angScale = 1.0f / cb2_angularIterationTolerance;
+
+	float maxChangeSqr = 0.0f;
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		ci::Vec2f dv = m_velocities[i].v - previousVelocities[i].v;
+		float dw = m_velocities[i].w - previousVelocities[i].w;
+		float changeSqr = cb2Max(linScale * linScale * cb2Dot(dv, dv), angScale * angScale * dw * dw);
+		maxChangeSqr = cb2Max(maxChangeSqr, changeSqr);
+	}
+
+	return cb2Sqrt(maxChangeSqr);
+}
+
+void cb2Island::SynchronizeBodies(unsigned int stepIndex)
+{
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		cb2Body* body = m_bodies[i];
+		if (cb2IsFixed(body))
+		{
+			continue;
+		}
+
+		body->m_sweep.c = m_positions[i].c;
+		body->m_sweep.a = m_positions[i].a;
+		body->m_linearVelocity = m_velocities[i].v;
+		body->m_angularVelocity = m_velocities[i].w;
+		body->m_moveStamp = stepIndex;
+		body->SynchronizeTransform();
+	}
+}
+
+// Velocity iterations followed by nonlinear Gauss-Seidel position correction.
+bool cb2Island::SolveIterations(cb2Profile* profile, const cb2TimeStep& step)
+{
+	cb2Timer timer;
 
 	// Solver data
 	cb2SolverData solverData;
@@ -239,6 +438,17 @@ void cb2Island::Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Ve
 	contactSolverDef.positions = m_positions;
 	contactSolverDef.velocities = m_velocities;
 	contactSolverDef.allocator = m_allocator;
+	contactSolverDef.reduceContacts = step.reduceContacts;
+
+	// The constraints pick up their body indices below.
+	if (m_sharedLock)
+	{
+		m_sharedLock->Lock();
+		for (int i = 0; i < m_bodyCount; ++i)
+		{
+			m_bodies[i]->m_islandIndex = i;
+		}
+	}
 
 	cb2ContactSolver contactSolver(&contactSolverDef);
 	contactSolver.InitializeVelocityConstraints();
@@ -247,77 +457,117 @@ void cb2Island::Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Ve
 	{
 		contactSolver.WarmStart();
 	}
-	
-	for (int i = 0; i < m_jointCount; ++i)
+
+	// This sorts m_joints by type, the coloring below indexes the sorted array.
+	cb2JointSolverDef jointSolverDef;
+	jointSolverDef.joints = m_joints;
+	jointSolverDef.count = m_jointCount;
+	jointSolverDef.bodyCount = m_bodyCount;
+	jointSolverDef.directJoints = step.directJoints;
+	jointSolverDef.allocator = m_allocator;
+
+	cb2JointSolver jointSolver(&jointSolverDef);
+	jointSolver.InitVelocityConstraints(solverData);
+
+	if (m_sharedLock)
+	{
+		m_sharedLock->Unlock();
+	}
+
+	// Large islands are split into graph colors if there are threads to share them.
+	int* colorIds = NULL;
+	int colorStarts[cb2_graphColorCount + 2];
+	bool colored = m_taskScheduler && m_taskScheduler->GetThreadCount() > 1 &&
+					m_contactCount + m_jointCount >= cb2_graphColoringThreshold;
+	if (colored)
 	{
-		m_joints[i]->InitVelocityConstraints(solverData);
+		colorIds = (int*)m_allocator->Allocate((m_jointCount + contactSolver.m_constraintCount) * sizeof(int));
+		ColorConstraints(&contactSolver, colorIds, colorStarts);
 	}
 
 	profile->solveInit = timer.GetMilliseconds();
 
+	// Adaptive iterations stop once the velocities settle. Each sweep carries an
+	// impulse one constraint further, so small islands are capped by their size.
+	int velocityIterations = step.velocityIterations;
+	cb2Velocity* previousVelocities = NULL;
+	float previousChange = 0.0f;
+	if (step.adaptiveIterations)
+	{
+		velocityIterations = cb2Min(velocityIterations, m_contactCount + m_jointCount + 1);
+		previousVelocities = (cb2Velocity*)m_allocator->Allocate(m_bodyCount * sizeof(cb2Velocity));
+	}
+
 	// Solve velocity constraints
 	timer.Reset();
-	for (int i = 0; i < step.velocityIterations; ++i)
+	for (int i = 0; i < velocityIterations; ++i)
 	{
-		for (int j = 0; j < m_jointCount; ++j)
+		if (previousVelocities)
 		{
-			m_joints[j]->SolveVelocityConstraints(solverData);
+			memcpy(previousVelocities, m_velocities, m_bodyCount * sizeof(cb2Velocity));
 		}
 
-		contactSolver.SolveVelocityConstraints();
-	}
-
-	// Store impulses for warm starting
-	contactSolver.StoreImpulses();
-	profile->solveVelocity = timer.GetMilliseconds();
-
-	// Integrate positions
-	for (int i = 0; i < m_bodyCount; ++i)
-	{
-		ci::Vec2f c = m_positions[i].c;
-		float a = m_positions[i].a;
-		ci::Vec2f v = m_velocities[i].v;
-		float w = m_velocities[i].w;
-
-		// Check for large velocities
-		ci::Vec2f translation = h * v;
-		if (cb2Dot(translation, translation) > cb2_maxTranslationSquared)
+		if (colored)
 		{
-			float ratio = cb2_maxTranslation / translation.length();
-			v *= ratio;
+			SolveColoredVelocity(&jointSolver, &contactSolver, &solverData, colorIds, colorStarts);
 		}
-
-		float rotation = h * w;
-		if (rotation * rotation > cb2_maxRotationSquared)
+		else
 		{
-			float ratio = cb2_maxRotation / cb2Abs(rotation);
-			w *= ratio;
+			jointSolver.SolveVelocityConstraints(solverData);
+			contactSolver.SolveVelocityConstraints();
 		}
 
-		// Integrate
-		c += h * v;
-		a += h * w;
+		// Gauss-Seidel converges linearly, so with the rate r of the last two changes
+		// the change d still to come is about d * r / (1 - r). The first iterations
+		// converge much faster than the tail, so their rate is not trusted.
+		if (previousVelocities)
+		{
+			float change = ComputeVelocityChange(previousVelocities);
+			float rate = change / cb2Max(previousChange, cb2_epsilon);
+			if (i + 1 >= cb2_minAdaptiveIterations && rate < 1.0f && change * rate <= 1.0f - rate)
+			{
+				break;
+			}
 
-		m_positions[i].c = c;
-		m_positions[i].a = a;
-		m_velocities[i].v = v;
-		m_velocities[i].w = w;
+			previousChange = change;
+		}
 	}
 
+	if (previousVelocities)
+	{
+		m_allocator->Free(previousVelocities);
+	}
+
+	// Store impulses for warm starting
+	jointSolver.StoreImpulses();
+	contactSolver.StoreImpulses();
+	profile->solveVelocity = timer.GetMilliseconds();
+
+	FindBrokenJoints(step.inv_dt);
+
+	// Integrate positions
+	IntegratePositions(step.dt);
+
 	// Solve position constraints
 	timer.Reset();
 	bool positionSolved = false;
 	for (int i = 0; i < step.positionIterations; ++i)
 	{
-		bool contactsOkay = contactSolver.SolvePositionConstraints();
-
-		bool jointsOkay = true;
-		for (int i = 0; i < m_jointCount; ++i)
+		if (colored)
 		{
-			bool jointOkay = m_joints[i]->SolvePositionConstraints(solverData);
-			jointsOkay = jointsOkay && jointOkay;
+			if (SolveColoredPosition(&jointSolver, &contactSolver, &solverData, colorIds, colorStarts))
+			{
+				positionSolved = true;
+				break;
+			}
+
+			continue;
 		}
 
+		bool contactsOkay = contactSolver.SolvePositionConstraints();
+
+		bool jointsOkay = jointSolver.SolvePositionConstraints(solverData);
+
 		if (contactsOkay && jointsOkay)
 		{
 			// Exit early if the position errors are small.
@@ -326,63 +576,424 @@ void cb2Island::Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Ve
 		}
 	}
 
-	// Copy state buffers back to the bodies
-	for (int i = 0; i < m_bodyCount; ++i)
+	if (colored)
 	{
-		cb2Body* body = m_bodies[i];
-		body->m_sweep.c = m_positions[i].c;
-		body->m_sweep.a = m_positions[i].a;
-		body->m_linearVelocity = m_velocities[i].v;
-		body->m_angularVelocity = m_velocities[i].w;
-		body->SynchronizeTransform();
+		m_allocator->Free(colorIds);
 	}
 
+	// Copy state buffers back to the bodies
+	SynchronizeBodies(step.stepIndex);
+
 	profile->solvePosition = timer.GetMilliseconds();
 
-	Report(contactSolver.m_velocityConstraints);
+	Report(&contactSolver);
 
-	if (allowSleep)
-	{
-		float minSleepTime = cb2_maxFloat;
+	return positionSolved;
+}
+
+// Soft step: every substep integrates, solves the contacts with a soft push-out
+// bias and relaxes them afterwards. Joints keep their rigid solver, initialized
+// per substep and corrected by one position pass per substep.
+bool cb2Island::SolveSubSteps(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity)
+{
+	cb2Timer timer;
 
-		const float linTolSqr = cb2_linearSleepTolerance * cb2_linearSleepTolerance;
-		const float angTolSqr = cb2_angularSleepTolerance * cb2_angularSleepTolerance;
+	int subStepCount = step.subStepCount;
+	float h = step.dt / subStepCount;
 
+	cb2SolverData solverData;
+	solverData.step = step;
+	solverData.step.dt = h;
+	solverData.step.inv_dt = subStepCount * step.inv_dt;
+	solverData.positions = m_positions;
+	solverData.velocities = m_velocities;
+
+	cb2SoftContactSolverDef contactSolverDef;
+	contactSolverDef.step = step;
+	contactSolverDef.contacts = m_contacts;
+	contactSolverDef.count = m_contactCount;
+	contactSolverDef.positions = m_positions;
+	contactSolverDef.velocities = m_velocities;
+	contactSolverDef.bodyCount = m_bodyCount;
+	contactSolverDef.allocator = m_allocator;
+
+	cb2JointSolverDef jointSolverDef;
+	jointSolverDef.joints = m_joints;
+	jointSolverDef.count = m_jointCount;
+	jointSolverDef.bodyCount = m_bodyCount;
+	jointSolverDef.directJoints = step.directJoints;
+	jointSolverDef.allocator = m_allocator;
+
+	// The constraints pick up their body indices below.
+	if (m_sharedLock)
+	{
+		m_sharedLock->Lock();
 		for (int i = 0; i < m_bodyCount; ++i)
 		{
-			cb2Body* b = m_bodies[i];
-			if (b->GetType() == cb2_staticBody)
+			m_bodies[i]->m_islandIndex = i;
+		}
+	}
+
+	cb2SoftContactSolver contactSolver(&contactSolverDef);
+	cb2JointSolver jointSolver(&jointSolverDef);
+
+	if (m_sharedLock)
+	{
+		m_sharedLock->Unlock();
+	}
+
+	profile->solveInit = timer.GetMilliseconds();
+
+	timer.Reset();
+	bool jointsOkay = true;
+	for (int i = 0; i < subStepCount; ++i)
+	{
+		IntegrateVelocities(h, gravity);
+
+		// The joints warm start in their initialization. Only the first substep
+		// follows a change of the time step.
+		solverData.step.dtRatio = i == 0 ? step.dtRatio : 1.0f;
+		if (m_jointCount > 0)
+		{
+			if (m_sharedLock)
 			{
-				continue;
+				m_sharedLock->Lock();
+				for (int j = 0; j < m_bodyCount; ++j)
+				{
+					m_bodies[j]->m_islandIndex = j;
+				}
 			}
 
-			if ((b->m_flags & cb2Body::e_autoSleepFlag) == 0 ||
-				b->m_angularVelocity * b->m_angularVelocity > angTolSqr ||
-				cb2Dot(b->m_linearVelocity, b->m_linearVelocity) > linTolSqr)
+			jointSolver.InitVelocityConstraints(solverData);
+
+			if (m_sharedLock)
 			{
-				b->m_sleepTime = 0.0f;
-				minSleepTime = 0.0f;
+				m_sharedLock->Unlock();
 			}
-			else
+		}
+
+		if (step.warmStarting)
+		{
+			contactSolver.WarmStart();
+		}
+
+		jointSolver.SolveVelocityConstraints(solverData);
+		contactSolver.SolveVelocityConstraints(true);
+
+		IntegratePositions(h);
+		jointsOkay = jointSolver.SolvePositionConstraints(solverData);
+
+		jointSolver.SolveVelocityConstraints(solverData);
+		contactSolver.SolveVelocityConstraints(false);
+
+		jointSolver.StoreImpulses();
+	}
+
+	contactSolver.ApplyRestitution();
+	contactSolver.StoreImpulses();
+	profile->solveVelocity = timer.GetMilliseconds();
+	profile->solvePosition = 0.0f;
+
+	// The joint impulses are those of the last substep.
+	FindBrokenJoints(solverData.step.inv_dt);
+
+	SynchronizeBodies(step.stepIndex);
+
+	Report(&contactSolver);
+
+	return jointsOkay;
+}
+
+void cb2Island::FindBrokenJoints(float inv_dt)
+{
+	for (int i = 0; i < m_jointCount; ++i)
+	{
+		cb2Joint* joint = m_joints[i];
+		if (joint->m_breakForce == cb2_maxFloat && joint->m_breakTorque == cb2_maxFloat)
+		{
+			continue;
+		}
+
+		ci::Vec2f force = joint->GetReactionForce(inv_dt);
+		float torque = joint->GetReactionTorque(inv_dt);
+		if (force.lengthSquared() <= joint->m_breakForce * joint->m_breakForce &&
+			cb2Abs(torque) <= joint->m_breakTorque)
+		{
+			continue;
+		}
+
+		if (m_sharedLock)
+		{
+			m_sharedLock->Lock();
+		}
+
+		joint->m_bodyA->m_world->PushJointBreak(joint, force, torque);
+
+		if (m_sharedLock)
+		{
+			m_sharedLock->Unlock();
+		}
+	}
+}
+
+// Constraint ids below m_jointCount are joints, the rest are contact solver slots.
+struct cb2ColoredSolveContext
+{
+	cb2JointSolver* jointSolver;
+	int jointCount;
+	cb2ContactSolver* contactSolver;
+	cb2SolverData* solverData;
+	const int* ids;
+
+	// Position results, one per thread.
+	float* minSeparations;
+	bool* jointsOkay;
+};
+
+// Greedy coloring in solver order, joints first, so each color keeps the relative
+// order of its constraints. A constraint takes the first color in which nobody else
+// reads or writes the bodies it writes, and nobody writes the bodies it reads.
+// Contacts only read static and kinematic bodies while joints write all of theirs.
+// Gear joints touch four bodies and go straight to the overflow color, which is
+// solved last on the calling thread like any constraint that finds no free color.
+// The ids are bucketed by color, color c spans [colorStarts[c], colorStarts[c + 1]).
+void cb2Island::ColorConstraints(const cb2ContactSolver* contactSolver, int* ids, int* colorStarts)
+{
+	cb2Assert(cb2_graphColorCount <= 32);
+	const int overflowColor = cb2_graphColorCount;
+	const cb2ContactVelocityConstraints* vc = &contactSolver->m_velocityConstraints;
+	int constraintCount = m_jointCount + contactSolver->m_constraintCount;
+
+	unsigned* writeMasks = (unsigned*)m_allocator->Allocate(2 * m_bodyCount * sizeof(unsigned));
+	unsigned* readMasks = writeMasks + m_bodyCount;
+	memset(writeMasks, 0, 2 * m_bodyCount * sizeof(unsigned));
+
+	int* colors = (int*)m_allocator->Allocate(constraintCount * sizeof(int));
+	memset(colorStarts, 0, (cb2_graphColorCount + 2) * sizeof(int));
+
+	for (int i = 0; i < constraintCount; ++i)
+	{
+		int indexA, indexB;
+		bool writeA, writeB;
+		if (i < m_jointCount)
+		{
+			cb2Joint* joint = m_joints[i];
+			if (joint->m_type == e_gearJoint)
 			{
-				b->m_sleepTime += h;
-				minSleepTime = cb2Min(minSleepTime, b->m_sleepTime);
+				colors[i] = overflowColor;
+				++colorStarts[overflowColor + 1];
+				continue;
 			}
-		}
 
-		if (minSleepTime >= cb2_timeToSleep && positionSolved)
+			indexA = joint->m_bodyA->m_islandIndex;
+			indexB = joint->m_bodyB->m_islandIndex;
+			writeA = true;
+			writeB = true;
+		}
+		else
 		{
-			for (int i = 0; i < m_bodyCount; ++i)
+			int slot = i - m_jointCount;
+			if (contactSolver->GetContactIndex(slot) < 0)
 			{
-				cb2Body* b = m_bodies[i];
-				b->SetAwake(false);
+				// Empty SIMD slot.
+				colors[i] = -1;
+				continue;
 			}
+
+			indexA = vc->indexA[slot];
+			indexB = vc->indexB[slot];
+			writeA = m_bodies[indexA]->m_type == cb2_dynamicBody && cb2IsFixed(m_bodies[indexA]) == false;
+			writeB = m_bodies[indexB]->m_type == cb2_dynamicBody && cb2IsFixed(m_bodies[indexB]) == false;
 		}
+
+		unsigned used = writeMasks[indexA] | writeMasks[indexB];
+		if (writeA)
+		{
+			used |= readMasks[indexA];
+		}
+
+		if (writeB)
+		{
+			used |= readMasks[indexB];
+		}
+
+		int color = 0;
+		while (color < cb2_graphColorCount && (used & (1u << color)))
+		{
+			++color;
+		}
+
+		if (color < cb2_graphColorCount)
+		{
+			unsigned bit = 1u << color;
+			(writeA ? writeMasks : readMasks)[indexA] |= bit;
+			(writeB ? writeMasks : readMasks)[indexB] |= bit;
+		}
+
+		colors[i] = color;
+		++colorStarts[color + 1];
+	}
+
+	for (int c = 0; c <= overflowColor; ++c)
+	{
+		colorStarts[c + 1] += colorStarts[c];
+	}
+
+	// Bucket the ids, colorStarts temporarily holds the write positions.
+	for (int i = 0; i < constraintCount; ++i)
+	{
+		if (colors[i] >= 0)
+		{
+			ids[colorStarts[colors[i]]++] = i;
+		}
+	}
+
+	for (int c = overflowColor; c > 0; --c)
+	{
+		colorStarts[c] = colorStarts[c - 1];
+	}
+	colorStarts[0] = 0;
+
+	m_allocator->Free(colors);
+	m_allocator->Free(writeMasks);
+}
+
+void cb2Island::SolveVelocityTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	CB2_TRACE_ZONE_COUNT("SolveVelocityColor", end - begin);
+	cb2ColoredSolveContext* solveContext = (cb2ColoredSolveContext*)context;
+
+	for (int i = begin; i < end; ++i)
+	{
+		int id = solveContext->ids[i];
+		if (id < solveContext->jointCount)
+		{
+			solveContext->jointSolver->SolveVelocityConstraint(id, *solveContext->solverData);
+		}
+		else
+		{
+			solveContext->contactSolver->SolveVelocityConstraint(id - solveContext->jointCount);
+		}
+	}
+}
+
+void cb2Island::SolvePositionTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_TRACE_ZONE_COUNT("SolvePositionColor", end - begin);
+
+	cb2ColoredSolveContext* solveContext = (cb2ColoredSolveContext*)context;
+	float minSeparation = solveContext->minSeparations[threadIndex];
+	bool jointsOkay = solveContext->jointsOkay[threadIndex];
+
+	for (int i = begin; i < end; ++i)
+	{
+		int id = solveContext->ids[i];
+		if (id < solveContext->jointCount)
+		{
+			bool jointOkay = solveContext->jointSolver->SolvePositionConstraint(id, *solveContext->solverData);
+			jointsOkay = jointsOkay && jointOkay;
+		}
+		else
+		{
+			float separation = solveContext->contactSolver->SolvePositionConstraint(id - solveContext->jointCount);
+			minSeparation = cb2Min(minSeparation, separation);
+		}
+	}
+
+	solveContext->minSeparations[threadIndex] = minSeparation;
+	solveContext->jointsOkay[threadIndex] = jointsOkay;
+}
+
+// The colors are solved one after the other, the constraints of one color in parallel.
+void cb2Island::SolveColoredVelocity(cb2JointSolver* jointSolver, cb2ContactSolver* contactSolver, cb2SolverData* solverData,
+									const int* ids, const int* colorStarts)
+{
+	const int k_rangeSize = 32;
+
+	cb2ColoredSolveContext context;
+	context.jointSolver = jointSolver;
+	context.jointCount = m_jointCount;
+	context.contactSolver = contactSolver;
+	context.solverData = solverData;
+	context.minSeparations = NULL;
+	context.jointsOkay = NULL;
+
+	for (int c = 0; c < cb2_graphColorCount; ++c)
+	{
+		int count = colorStarts[c + 1] - colorStarts[c];
+		if (count == 0)
+		{
+			continue;
+		}
+
+		context.ids = ids + colorStarts[c];
+		void* group = m_taskScheduler->EnqueueRange(SolveVelocityTask, &context, count, k_rangeSize);
+		m_taskScheduler->Wait(group);
+	}
+
+	int overflowColor = cb2_graphColorCount;
+	context.ids = ids + colorStarts[overflowColor];
+	SolveVelocityTask(&context, 0, colorStarts[overflowColor + 1] - colorStarts[overflowColor], 0);
+
+	jointSolver->SolveArticulationVelocities(*solverData);
+}
+
+bool cb2Island::SolveColoredPosition(cb2JointSolver* jointSolver, cb2ContactSolver* contactSolver, cb2SolverData* solverData,
+									const int* ids, const int* colorStarts)
+{
+	const int k_rangeSize = 32;
+	int threadCount = m_taskScheduler->GetThreadCount();
+
+	cb2ColoredSolveContext context;
+	context.jointSolver = jointSolver;
+	context.jointCount = m_jointCount;
+	context.contactSolver = contactSolver;
+	context.solverData = solverData;
+	context.minSeparations = (float*)m_allocator->Allocate(threadCount * sizeof(float));
+	context.jointsOkay = (bool*)m_allocator->Allocate(threadCount * sizeof(bool));
+	for (int i = 0; i < threadCount; ++i)
+	{
+		context.minSeparations[i] = 0.0f;
+		context.jointsOkay[i] = true;
+	}
+
+	for (int c = 0; c < cb2_graphColorCount; ++c)
+	{
+		int count = colorStarts[c + 1] - colorStarts[c];
+		if (count == 0)
+		{
+			continue;
+		}
+
+		context.ids = ids + colorStarts[c];
+		void* group = m_taskScheduler->EnqueueRange(SolvePositionTask, &context, count, k_rangeSize);
+		m_taskScheduler->Wait(group);
+	}
+
+	int overflowColor = cb2_graphColorCount;
+	context.ids = ids + colorStarts[overflowColor];
+	SolvePositionTask(&context, 0, colorStarts[overflowColor + 1] - colorStarts[overflowColor], 0);
+
+	float minSeparation = 0.0f;
+	bool jointsOkay = true;
+	for (int i = 0; i < threadCount; ++i)
+	{
+		minSeparation = cb2Min(minSeparation, context.minSeparations[i]);
+		jointsOkay = jointsOkay && context.jointsOkay[i];
 	}
+
+	m_allocator->Free(context.jointsOkay);
+	m_allocator->Free(context.minSeparations);
+
+	// Same tolerance as cb2ContactSolver::SolvePositionConstraints.
+	return minSeparation >= -3.0f * contactSolver->m_step.tolerances.linearSlop && jointsOkay;
 }
 
 void cb2Island::SolveTOI(const cb2TimeStep& subStep, int toiIndexA, int toiIndexB)
 {
+	CB2_TRACE_ZONE_COUNT("SolveTOIIsland", m_bodyCount);
+
 	cb2Assert(toiIndexA < m_bodyCount);
 	cb2Assert(toiIndexB < m_bodyCount);
 
@@ -403,6 +1014,7 @@ void cb2Island::SolveTOI(const cb2TimeStep& subStep, int toiIndexA, int toiIndex
 	contactSolverDef.step = subStep;
 	contactSolverDef.positions = m_positions;
 	contactSolverDef.velocities = m_velocities;
+	contactSolverDef.reduceContacts = false;
 	cb2ContactSolver contactSolver(&contactSolverDef);
 
 	// Solve position constraints.
@@ -508,32 +1120,88 @@ void cb2Island::SolveTOI(const cb2TimeStep& subStep, int toiIndexA, int toiIndex
 		body->m_linearVelocity = v;
 		body->m_angularVelocity = w;
 		body->SynchronizeTransform();
+		if (body->m_type != cb2_staticBody)
+		{
+			body->m_moveStamp = subStep.stepIndex;
+		}
 	}
 
-	Report(contactSolver.m_velocityConstraints);
+	Report(&contactSolver);
 }
 
-void cb2Island::Report(const cb2ContactVelocityConstraint* constraints)
+void cb2Island::Report(const cb2ContactSolver* solver)
 {
 	if (m_listener == NULL)
 	{
 		return;
 	}
 
-	for (int i = 0; i < m_contactCount; ++i)
+	if (solver->m_sources)
 	{
-		cb2Contact* c = m_contacts[i];
+		// Merged constraints do not map onto one contact, report what each contact
+		// stored, which is what it warm starts with.
+		for (int i = 0; i < m_contactCount; ++i)
+		{
+			cb2Contact* c = m_contacts[i];
+			const cb2Manifold* manifold = c->GetManifold();
+
+			cb2ContactImpulse impulse;
+			impulse.count = manifold->pointCount;
+			for (int j = 0; j < impulse.count; ++j)
+			{
+				impulse.normalImpulses[j] = manifold->points[j].normalImpulse;
+				impulse.tangentImpulses[j] = manifold->points[j].tangentImpulse;
+			}
+
+			m_listener->PostSolve(c, &impulse);
+		}
+
+		return;
+	}
+
+	const cb2ContactVelocityConstraints* vc = &solver->m_velocityConstraints;
+	for (int i = 0; i < solver->m_constraintCount; ++i)
+	{
+		int contactIndex = solver->GetContactIndex(i);
+		if (contactIndex < 0)
+		{
+			continue;
+		}
+
+		cb2Contact* c = m_contacts[contactIndex];
 
-		const cb2ContactVelocityConstraint* vc = constraints + i;
-		
 		cb2ContactImpulse impulse;
-		impulse.count = vc->pointCount;
-		for (int j = 0; j < vc->pointCount; ++j)
+		impulse.count = vc->pointCount[i];
+		for (int j = 0; j < impulse.count; ++j)
 		{
-			impulse.normalImpulses[j] = vc->points[j].normalImpulse;
-			impulse.tangentImpulses[j] = vc->points[j].tangentImpulse;
+			impulse.normalImpulses[j] = vc->points[j].normalImpulse[i];
+			impulse.tangentImpulses[j] = vc->points[j].tangentImpulse[i];
 		}
 
 		m_listener->PostSolve(c, &impulse);
 	}
 }
+
+void cb2Island::Report(const cb2SoftContactSolver* solver)
+{
+	if (m_listener == NULL)
+	{
+		return;
+	}
+
+	// The impulses add up over the substeps.
+	for (int i = 0; i < solver->m_count; ++i)
+	{
+		const cb2SoftContactConstraint* constraint = solver->m_constraints + i;
+
+		cb2ContactImpulse impulse;
+		impulse.count = constraint->pointCount;
+		for (int j = 0; j < impulse.count; ++j)
+		{
+			impulse.normalImpulses[j] = constraint->points[j].totalNormalImpulse;
+			impulse.tangentImpulses[j] = constraint->points[j].totalTangentImpulse;
+		}
+
+		m_listener->PostSolve(m_contacts[i], &impulse);
+	}
+}
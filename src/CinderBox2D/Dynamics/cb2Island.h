@@ -25,10 +25,47 @@
 
 class cb2Contact;
 class cb2Joint;
+class cb2JointSolver;
 class cb2StackAllocator;
 class cb2ContactListener;
-struct cb2ContactVelocityConstraint;
+class cb2Mutex;
+class cb2ContactSolver;
+class cb2SoftContactSolver;
+class cb2TaskScheduler;
+struct cb2SolverData;
 struct cb2Profile;
+struct cb2SleepDef;
+
+/// An island that lives across time steps. Islands are merged when a contact starts
+/// touching or a joint is created, and split lazily: removing a contact or joint only
+/// bumps constraintRemoveCount and the island is split when it falls asleep. Static
+/// bodies never join an island. With cb2SleepDef::wakeHopCount an island may also
+/// hold contacts to bodies of sleeping islands, while those bodies hold still. This
+/// is an internal structure.
+struct cb2PersistentIsland
+{
+	cb2PersistentIsland* prev;
+	cb2PersistentIsland* next;
+
+	cb2Body* bodyList;
+	cb2Contact* contactList;
+	cb2Joint* jointList;
+
+	int bodyCount;
+	int contactCount;
+	int jointCount;
+
+	int constraintRemoveCount;
+	bool awake;
+	bool readyToSleep;
+
+	// The simulation detail level. The island waited lodStepCount steps since it was
+	// last solved with a time step of lodDt. Skipped islands sit out the step.
+	int lodLevel;
+	int lodStepCount;
+	float lodDt;
+	bool lodSkipped;
+};
 
 /// This is an internal class.
 class cb2Island
@@ -45,7 +82,8 @@ public:
 		m_jointCount = 0;
 	}
 
-	void Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity, bool allowSleep);
+	/// Solve the island, sleepDef is NULL if sleep is disabled.
+	void Solve(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity, const cb2SleepDef* sleepDef);
 
 	void SolveTOI(const cb2TimeStep& subStep, int toiIndexA, int toiIndexB);
 
@@ -69,11 +107,24 @@ public:
 		m_joints[m_jointCount++] = joint;
 	}
 
-	void Report(const cb2ContactVelocityConstraint* constraints);
+	void Report(const cb2ContactSolver* solver);
+	void Report(const cb2SoftContactSolver* solver);
 
 	cb2StackAllocator* m_allocator;
 	cb2ContactListener* m_listener;
 
+	// Set when this island is solved concurrently with others. Static bodies are
+	// shared between islands, so their island index is claimed under this lock
+	// and putting the island to sleep is left to the caller.
+	cb2Mutex* m_sharedLock;
+
+	// Set by Solve when the island fell asleep, or should have in shared mode.
+	bool m_readyToSleep;
+
+	// Set when this island has the task scheduler to itself. Large islands then solve
+	// their constraints color by color across the scheduler threads.
+	cb2TaskScheduler* m_taskScheduler;
+
 	cb2Body** m_bodies;
 	cb2Contact** m_contacts;
 	cb2Joint** m_joints;
@@ -88,6 +139,28 @@ public:
 	int m_bodyCapacity;
 	int m_contactCapacity;
 	int m_jointCapacity;
+
+private:
+
+	void IntegrateVelocities(float h, const ci::Vec2f& gravity);
+	void IntegratePositions(float h);
+	void SynchronizeBodies(unsigned int stepIndex);
+	float ComputeVelocityChange(const cb2Velocity* previousVelocities) const;
+
+	// Hand the joints whose reaction exceeds their break limits to the world.
+	void FindBrokenJoints(float inv_dt);
+
+	bool SolveIterations(cb2Profile* profile, const cb2TimeStep& step);
+	bool SolveSubSteps(cb2Profile* profile, const cb2TimeStep& step, const ci::Vec2f& gravity);
+
+	void ColorConstraints(const cb2ContactSolver* contactSolver, int* ids, int* colorStarts);
+	void SolveColoredVelocity(cb2JointSolver* jointSolver, cb2ContactSolver* contactSolver, cb2SolverData* solverData,
+							const int* ids, const int* colorStarts);
+	bool SolveColoredPosition(cb2JointSolver* jointSolver, cb2ContactSolver* contactSolver, cb2SolverData* solverData,
+							const int* ids, const int* colorStarts);
+
+	static void SolveVelocityTask(void* context, int begin, int end, int threadIndex);
+	static void SolvePositionTask(void* context, int begin, int end, int threadIndex);
 };
 
 #endif
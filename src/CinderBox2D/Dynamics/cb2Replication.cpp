@@ -0,0 +1,600 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/cb2Replication.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <string.h>
+#include <math.h>
+
+// Entry flags. An entry is new when the reader has no state of the same generation
+// for its index, its components are then sent in full. Otherwise the components
+// flagged are sent as deltas and the rest keep their baseline values.
+enum
+{
+	e_replicaRemoved			= 0x01,
+	e_replicaNew				= 0x02,
+	e_replicaPosition			= 0x04,
+	e_replicaAngle				= 0x08,
+	e_replicaLinearVelocity		= 0x10,
+	e_replicaAngularVelocity	= 0x20,
+	e_replicaAwake				= 0x40,
+	e_replicaComponents			= 0x3C
+};
+
+// Index, flags, generation and six components.
+static const int cb2_maxReplicaEntrySize = 8 * 5 + 1;
+
+static inline int cb2Quantize(float value, float scale)
+{
+	// Clamped so that the difference of two values fits an int.
+	float limit = 1073741823.0f;
+	return (int)floorf(cb2Clamp(value * scale, -limit, limit) + 0.5f);
+}
+
+static inline unsigned char* cb2WriteVarint(unsigned char* out, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (unsigned char)value;
+	return out;
+}
+
+static inline unsigned char* cb2WriteDelta(unsigned char* out, int value, int base)
+{
+	// Zigzag coding keeps small negative deltas short.
+	int delta = (int)((unsigned int)value - (unsigned int)base);
+	return cb2WriteVarint(out, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+}
+
+static inline bool cb2ReadVarint(const unsigned char** in, const unsigned char* end, unsigned int* value)
+{
+	unsigned int result = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		if (*in == end)
+		{
+			return false;
+		}
+
+		unsigned char byte = *(*in)++;
+		result |= (unsigned int)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline bool cb2ReadDelta(const unsigned char** in, const unsigned char* end, int base, int* value)
+{
+	unsigned int zigzag;
+	if (cb2ReadVarint(in, end, &zigzag) == false)
+	{
+		return false;
+	}
+
+	unsigned int delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+	*value = (int)((unsigned int)base + delta);
+	return true;
+}
+
+static inline bool cb2Exceeds(int a, int b, int threshold)
+{
+	return cb2Abs(a - b) > threshold;
+}
+
+cb2ReplicationHistory::cb2ReplicationHistory(int historyCount, cb2AllocatorInterface* allocator)
+{
+	cb2Assert(historyCount > 0);
+	m_allocator = allocator;
+	m_historyCount = historyCount;
+	m_capacity = 0;
+	m_states = NULL;
+	m_sequences = (int*)cb2Alloc(m_allocator, m_historyCount * sizeof(int));
+	memset(m_sequences, 0, m_historyCount * sizeof(int));
+	Grow(16);
+}
+
+cb2ReplicationHistory::~cb2ReplicationHistory()
+{
+	cb2Free(m_allocator, m_states);
+	cb2Free(m_allocator, m_sequences);
+}
+
+cb2ReplicaState* cb2ReplicationHistory::Find(int sequence)
+{
+	int slot = sequence % m_historyCount;
+	if (sequence <= 0 || m_sequences[slot] != sequence)
+	{
+		return NULL;
+	}
+	return m_states + slot * m_capacity;
+}
+
+const cb2ReplicaState* cb2ReplicationHistory::Find(int sequence) const
+{
+	return const_cast<cb2ReplicationHistory*>(this)->Find(sequence);
+}
+
+cb2ReplicaState* cb2ReplicationHistory::Push(int sequence)
+{
+	cb2Assert(sequence > 0);
+	int slot = sequence % m_historyCount;
+	m_sequences[slot] = sequence;
+	return m_states + slot * m_capacity;
+}
+
+void cb2ReplicationHistory::Grow(int capacity)
+{
+	if (capacity <= m_capacity)
+	{
+		return;
+	}
+
+	int newCapacity = cb2Max(capacity, 2 * m_capacity);
+	int viewCount = m_historyCount + 1;
+	cb2ReplicaState* states = (cb2ReplicaState*)cb2Alloc(m_allocator, viewCount * newCapacity * sizeof(cb2ReplicaState));
+	memset(states, 0, viewCount * newCapacity * sizeof(cb2ReplicaState));
+	if (m_states)
+	{
+		for (int i = 0; i < viewCount; ++i)
+		{
+			memcpy(states + i * newCapacity, m_states + i * m_capacity, m_capacity * sizeof(cb2ReplicaState));
+		}
+		cb2Free(m_allocator, m_states);
+	}
+
+	m_states = states;
+	m_capacity = newCapacity;
+}
+
+void cb2ReplicationHistory::Clear()
+{
+	memset(m_sequences, 0, m_historyCount * sizeof(int));
+	memset(m_states, 0, (m_historyCount + 1) * m_capacity * sizeof(cb2ReplicaState));
+}
+
+cb2ReplicationWriter::cb2ReplicationWriter(const cb2ReplicationDef* def, cb2AllocatorInterface* allocator)
+: m_def(*def), m_history(def->historyCount, allocator)
+{
+	cb2Assert(def->positionPrecision > 0.0f && def->anglePrecision > 0.0f && def->velocityPrecision > 0.0f);
+	m_sequence = 0;
+	m_acknowledged = 0;
+}
+
+int cb2ReplicationWriter::Write(const cb2World* world, cb2Snapshot* packet)
+{
+	++m_sequence;
+
+	// This packet takes the slot of the one historyCount before it.
+	if (m_sequence - m_acknowledged >= m_history.GetHistoryCount())
+	{
+		m_acknowledged = 0;
+	}
+
+	// Quantize the bodies into the spare view. This grows the views, so the ring
+	// views are looked up after.
+	float positionScale = 1.0f / m_def.positionPrecision;
+	float angleScale = 1.0f / m_def.anglePrecision;
+	float velocityScale = 1.0f / m_def.velocityPrecision;
+	int capacity = m_history.GetCapacity();
+	memset(m_history.GetSpare(), 0, capacity * sizeof(cb2ReplicaState));
+	for (const cb2Body* b = world->GetBodyList(); b; b = b->GetNext())
+	{
+		if (b->GetType() == cb2_staticBody && m_def.replicateStatic == false)
+		{
+			continue;
+		}
+
+		cb2Handle handle = b->GetHandle();
+		cb2Assert(handle.index < m_def.maxBodyCount);
+		if (handle.index >= capacity)
+		{
+			m_history.Grow(handle.index + 1);
+			capacity = m_history.GetCapacity();
+		}
+
+		cb2ReplicaState* state = m_history.GetSpare() + handle.index;
+		const ci::Vec2f& position = b->GetPosition();
+		ci::Vec2f velocity = b->GetLinearVelocity();
+		state->position[0] = cb2Quantize(position.x, positionScale);
+		state->position[1] = cb2Quantize(position.y, positionScale);
+		state->angle = cb2Quantize(b->GetAngle(), angleScale);
+		state->linearVelocity[0] = cb2Quantize(velocity.x, velocityScale);
+		state->linearVelocity[1] = cb2Quantize(velocity.y, velocityScale);
+		state->angularVelocity = cb2Quantize(b->GetAngularVelocity(), velocityScale);
+		state->generation = handle.generation;
+		state->flags = cb2ReplicaState::e_presentFlag;
+		if (b->IsAwake())
+		{
+			state->flags |= cb2ReplicaState::e_awakeFlag;
+		}
+	}
+
+	const cb2ReplicaState* current = m_history.GetSpare();
+	const cb2ReplicaState* baseline = m_history.Find(m_acknowledged);
+	cb2ReplicaState* view = m_history.Push(m_sequence);
+	cb2Assert(baseline == NULL || baseline != view);
+
+	unsigned char buffer[cb2_maxReplicaEntrySize];
+	unsigned char* out = cb2WriteVarint(buffer, (unsigned int)m_sequence);
+	out = cb2WriteVarint(out, (unsigned int)(baseline ? m_acknowledged : 0));
+	packet->Write(buffer, (int)(out - buffer));
+
+	int positionThreshold = (int)(m_def.positionThreshold * positionScale);
+	int angleThreshold = (int)(m_def.angleThreshold * angleScale);
+	int velocityThreshold = (int)(m_def.velocityThreshold * velocityScale);
+	cb2ReplicaState zero;
+	memset(&zero, 0, sizeof(zero));
+
+	int previous = -1;
+	for (int i = 0; i < capacity; ++i)
+	{
+		const cb2ReplicaState* cur = current + i;
+		const cb2ReplicaState* base = baseline ? baseline + i : &zero;
+		cb2ReplicaState* next = view + i;
+		bool present = (cur->flags & cb2ReplicaState::e_presentFlag) != 0;
+		bool basePresent = (base->flags & cb2ReplicaState::e_presentFlag) != 0;
+
+		unsigned int flags = 0;
+		if (present == false)
+		{
+			memset(next, 0, sizeof(cb2ReplicaState));
+			if (basePresent == false)
+			{
+				continue;
+			}
+			flags = e_replicaRemoved;
+		}
+		else if (basePresent == false || base->generation != cur->generation)
+		{
+			*next = *cur;
+			flags = e_replicaNew | e_replicaComponents;
+			base = &zero;
+		}
+		else
+		{
+			*next = *base;
+			if (cb2Exceeds(cur->position[0], base->position[0], positionThreshold) ||
+				cb2Exceeds(cur->position[1], base->position[1], positionThreshold))
+			{
+				flags |= e_replicaPosition;
+				next->position[0] = cur->position[0];
+				next->position[1] = cur->position[1];
+			}
+			if (cb2Exceeds(cur->angle, base->angle, angleThreshold))
+			{
+				flags |= e_replicaAngle;
+				next->angle = cur->angle;
+			}
+			if (cb2Exceeds(cur->linearVelocity[0], base->linearVelocity[0], velocityThreshold) ||
+				cb2Exceeds(cur->linearVelocity[1], base->linearVelocity[1], velocityThreshold))
+			{
+				flags |= e_replicaLinearVelocity;
+				next->linearVelocity[0] = cur->linearVelocity[0];
+				next->linearVelocity[1] = cur->linearVelocity[1];
+			}
+			if (cb2Exceeds(cur->angularVelocity, base->angularVelocity, velocityThreshold))
+			{
+				flags |= e_replicaAngularVelocity;
+				next->angularVelocity = cur->angularVelocity;
+			}
+
+			next->flags = cur->flags;
+			if (flags == 0 && next->flags == base->flags)
+			{
+				continue;
+			}
+		}
+
+		if (next->flags & cb2ReplicaState::e_awakeFlag)
+		{
+			flags |= e_replicaAwake;
+		}
+
+		out = cb2WriteVarint(buffer, (unsigned int)(i - previous));
+		*out++ = (unsigned char)flags;
+		previous = i;
+		if (flags & e_replicaNew)
+		{
+			out = cb2WriteVarint(out, next->generation);
+		}
+		if (flags & e_replicaPosition)
+		{
+			out = cb2WriteDelta(out, next->position[0], base->position[0]);
+			out = cb2WriteDelta(out, next->position[1], base->position[1]);
+		}
+		if (flags & e_replicaAngle)
+		{
+			out = cb2WriteDelta(out, next->angle, base->angle);
+		}
+		if (flags & e_replicaLinearVelocity)
+		{
+			out = cb2WriteDelta(out, next->linearVelocity[0], base->linearVelocity[0]);
+			out = cb2WriteDelta(out, next->linearVelocity[1], base->linearVelocity[1]);
+		}
+		if (flags & e_replicaAngularVelocity)
+		{
+			out = cb2WriteDelta(out, next->angularVelocity, base->angularVelocity);
+		}
+		packet->Write(buffer, (int)(out - buffer));
+	}
+
+	// An index step of zero ends the packet.
+	packet->Write((unsigned char)0);
+
+	return m_sequence;
+}
+
+void cb2ReplicationWriter::Acknowledge(int sequence)
+{
+	if (sequence > m_acknowledged && sequence <= m_sequence && m_history.Find(sequence))
+	{
+		m_acknowledged = sequence;
+	}
+}
+
+void cb2ReplicationWriter::Reset()
+{
+	m_acknowledged = 0;
+}
+
+cb2ReplicationReader::cb2ReplicationReader(const cb2ReplicationDef* def, cb2AllocatorInterface* allocator)
+: m_def(*def), m_history(def->historyCount, allocator)
+{
+	m_sequence = 0;
+}
+
+// Walk the entries of a packet. Without a view this only checks them and finds the
+// highest index, so that the views can grow before they are written. Baseline
+// states at or past the capacity are empty.
+static bool cb2ReadReplicaEntries(const unsigned char* in, const unsigned char* end, const cb2ReplicaState* baseline,
+								int capacity, cb2ReplicaState* view, int maxBodyCount, int* maxIndex)
+{
+	cb2ReplicaState zero;
+	memset(&zero, 0, sizeof(zero));
+
+	int index = -1;
+	for (;;)
+	{
+		unsigned int step;
+		if (cb2ReadVarint(&in, end, &step) == false)
+		{
+			return false;
+		}
+
+		if (step == 0)
+		{
+			return in == end;
+		}
+
+		if (step > (unsigned int)(maxBodyCount - 1 - index) || in == end)
+		{
+			return false;
+		}
+
+		index += (int)step;
+		*maxIndex = index;
+		unsigned int flags = *in++;
+
+		const cb2ReplicaState* base = baseline && index < capacity ? baseline + index : &zero;
+		cb2ReplicaState scratch;
+		cb2ReplicaState* next = view ? view + index : &scratch;
+
+		if (flags & e_replicaRemoved)
+		{
+			if (flags != e_replicaRemoved)
+			{
+				return false;
+			}
+			memset(next, 0, sizeof(cb2ReplicaState));
+			continue;
+		}
+
+		if (flags & e_replicaNew)
+		{
+			if ((flags & e_replicaComponents) != e_replicaComponents)
+			{
+				return false;
+			}
+
+			base = &zero;
+			*next = zero;
+			if (cb2ReadVarint(&in, end, &next->generation) == false)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			if ((base->flags & cb2ReplicaState::e_presentFlag) == 0)
+			{
+				return false;
+			}
+			*next = *base;
+		}
+
+		bool ok = true;
+		if (flags & e_replicaPosition)
+		{
+			ok = ok && cb2ReadDelta(&in, end, base->position[0], &next->position[0]);
+			ok = ok && cb2ReadDelta(&in, end, base->position[1], &next->position[1]);
+		}
+		if (flags & e_replicaAngle)
+		{
+			ok = ok && cb2ReadDelta(&in, end, base->angle, &next->angle);
+		}
+		if (flags & e_replicaLinearVelocity)
+		{
+			ok = ok && cb2ReadDelta(&in, end, base->linearVelocity[0], &next->linearVelocity[0]);
+			ok = ok && cb2ReadDelta(&in, end, base->linearVelocity[1], &next->linearVelocity[1]);
+		}
+		if (flags & e_replicaAngularVelocity)
+		{
+			ok = ok && cb2ReadDelta(&in, end, base->angularVelocity, &next->angularVelocity);
+		}
+		if (ok == false)
+		{
+			return false;
+		}
+
+		next->flags = cb2ReplicaState::e_presentFlag;
+		if (flags & e_replicaAwake)
+		{
+			next->flags |= cb2ReplicaState::e_awakeFlag;
+		}
+	}
+}
+
+int cb2ReplicationReader::Read(const void* data, int size)
+{
+	const unsigned char* in = (const unsigned char*)data;
+	const unsigned char* end = in + size;
+
+	unsigned int sequence, baselineSequence;
+	if (cb2ReadVarint(&in, end, &sequence) == false || cb2ReadVarint(&in, end, &baselineSequence) == false)
+	{
+		return -1;
+	}
+
+	if (sequence > 0x7FFFFFFF || (int)sequence <= m_sequence || baselineSequence >= sequence ||
+		(baselineSequence != 0 && (int)(sequence - baselineSequence) >= m_history.GetHistoryCount()))
+	{
+		return -1;
+	}
+
+	if (baselineSequence != 0 && m_history.Find((int)baselineSequence) == NULL)
+	{
+		return -1;
+	}
+
+	int maxIndex = -1;
+	const cb2ReplicaState* baseline = m_history.Find((int)baselineSequence);
+	if (cb2ReadReplicaEntries(in, end, baseline, m_history.GetCapacity(), NULL, m_def.maxBodyCount, &maxIndex) == false)
+	{
+		return -1;
+	}
+
+	// Growing moves the views.
+	m_history.Grow(maxIndex + 1);
+	baseline = m_history.Find((int)baselineSequence);
+	cb2ReplicaState* view = m_history.Push((int)sequence);
+	int capacity = m_history.GetCapacity();
+	if (baseline)
+	{
+		memcpy(view, baseline, capacity * sizeof(cb2ReplicaState));
+	}
+	else
+	{
+		memset(view, 0, capacity * sizeof(cb2ReplicaState));
+	}
+
+	cb2ReadReplicaEntries(in, end, baseline, capacity, view, m_def.maxBodyCount, &maxIndex);
+
+	m_sequence = (int)sequence;
+	return m_sequence;
+}
+
+void cb2ReplicationReader::Decode(const cb2ReplicaState* state, int index, cb2ReplicatedBody* body) const
+{
+	body->handle.index = index;
+	body->handle.generation = state->generation;
+	body->position.set(state->position[0] * m_def.positionPrecision, state->position[1] * m_def.positionPrecision);
+	body->angle = state->angle * m_def.anglePrecision;
+	body->linearVelocity.set(state->linearVelocity[0] * m_def.velocityPrecision,
+							state->linearVelocity[1] * m_def.velocityPrecision);
+	body->angularVelocity = state->angularVelocity * m_def.velocityPrecision;
+	body->awake = (state->flags & cb2ReplicaState::e_awakeFlag) != 0;
+}
+
+void cb2ReplicationReader::Apply(cb2World* world)
+{
+	const cb2ReplicaState* newest = m_history.Find(m_sequence);
+	if (newest == NULL)
+	{
+		return;
+	}
+
+	// The spare view holds the states applied last.
+	cb2ReplicaState* applied = m_history.GetSpare();
+	int capacity = m_history.GetCapacity();
+	for (int i = 0; i < capacity; ++i)
+	{
+		if (memcmp(newest + i, applied + i, sizeof(cb2ReplicaState)) == 0)
+		{
+			continue;
+		}
+
+		applied[i] = newest[i];
+		if ((newest[i].flags & cb2ReplicaState::e_presentFlag) == 0)
+		{
+			continue;
+		}
+
+		cb2ReplicatedBody state;
+		Decode(newest + i, i, &state);
+		cb2Body* b = world->GetBody(state.handle);
+		if (b == NULL)
+		{
+			continue;
+		}
+
+		b->SetTransform(state.position, state.angle);
+		if (state.awake)
+		{
+			b->SetAwake(true);
+			b->SetLinearVelocity(state.linearVelocity);
+			b->SetAngularVelocity(state.angularVelocity);
+		}
+		else
+		{
+			b->SetAwake(false);
+		}
+	}
+}
+
+bool cb2ReplicationReader::GetBody(cb2Handle handle, cb2ReplicatedBody* body) const
+{
+	const cb2ReplicaState* newest = m_history.Find(m_sequence);
+	if (newest == NULL || handle.index < 0 || handle.index >= m_history.GetCapacity())
+	{
+		return false;
+	}
+
+	const cb2ReplicaState* state = newest + handle.index;
+	if ((state->flags & cb2ReplicaState::e_presentFlag) == 0 || state->generation != handle.generation)
+	{
+		return false;
+	}
+
+	Decode(state, handle.index, body);
+	return true;
+}
+
+void cb2ReplicationReader::Reset()
+{
+	m_history.Clear();
+	m_sequence = 0;
+}
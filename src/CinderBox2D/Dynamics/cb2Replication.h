@@ -0,0 +1,222 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_REPLICATION_H
+#define CB2_REPLICATION_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
+
+class cb2Snapshot;
+class cb2World;
+
+/// A replication definition holds the quantization and the thresholds of a body
+/// state stream. The writer and the reader of a stream must use the same one.
+struct cb2ReplicationDef
+{
+	/// The constructor sets the default replication definition values.
+	cb2ReplicationDef()
+	{
+		positionPrecision = 1.0f / 1024.0f;
+		anglePrecision = 1.0f / 4096.0f;
+		velocityPrecision = 1.0f / 256.0f;
+		positionThreshold = 0.0f;
+		angleThreshold = 0.0f;
+		velocityThreshold = 0.0f;
+		historyCount = 32;
+		maxBodyCount = 65536;
+		replicateStatic = false;
+	}
+
+	/// The quantization step of positions, in meters.
+	float positionPrecision;
+
+	/// The quantization step of angles, in radians.
+	float anglePrecision;
+
+	/// The quantization step of linear and angular velocities.
+	float velocityPrecision;
+
+	/// A body is only sent when its position moved further than this since the last
+	/// acknowledged packet, or another part of its state changed. Zero sends every
+	/// change of a quantization step.
+	float positionThreshold;
+
+	/// Same as positionThreshold for the angle.
+	float angleThreshold;
+
+	/// Same as positionThreshold for the linear and angular velocities.
+	float velocityThreshold;
+
+	/// The number of packets kept as baselines. Acknowledgements that arrive later
+	/// than this many packets are useless, the writer then sends full states.
+	int historyCount;
+
+	/// Bodies must have handle indices below this, see cb2Body::GetHandle. The reader
+	/// drops packets with higher indices, so corrupt data never makes it allocate
+	/// too much. The history takes 32 bytes per body per packet.
+	int maxBodyCount;
+
+	/// Send static bodies too. They only change when moved with cb2Body::SetTransform.
+	bool replicateStatic;
+};
+
+/// The state of a replicated body, after quantization.
+struct cb2ReplicatedBody
+{
+	cb2Handle handle;
+	ci::Vec2f position;
+	float angle;
+	ci::Vec2f linearVelocity;
+	float angularVelocity;
+	bool awake;
+};
+
+/// A quantized body state. This is an internal struct.
+struct cb2ReplicaState
+{
+	enum
+	{
+		e_presentFlag	= 0x0001,
+		e_awakeFlag		= 0x0002
+	};
+
+	int position[2];
+	int angle;
+	int linearVelocity[2];
+	int angularVelocity;
+	unsigned int generation;
+	unsigned int flags;
+};
+
+/// A ring of the quantized body states of the last packets, each view indexed by
+/// body handle index, plus one spare view. This is an internal class.
+class cb2ReplicationHistory
+{
+public:
+	cb2ReplicationHistory(int historyCount, cb2AllocatorInterface* allocator);
+	~cb2ReplicationHistory();
+
+	/// Get the view of a packet, NULL if it is no longer in the ring.
+	cb2ReplicaState* Find(int sequence);
+	const cb2ReplicaState* Find(int sequence) const;
+
+	/// Get the view for a new packet, it drops the oldest one.
+	cb2ReplicaState* Push(int sequence);
+
+	/// Get the spare view.
+	cb2ReplicaState* GetSpare() { return m_states + m_historyCount * m_capacity; }
+	const cb2ReplicaState* GetSpare() const { return m_states + m_historyCount * m_capacity; }
+
+	/// Make room for the given number of handle indices in every view.
+	void Grow(int capacity);
+
+	/// Drop all views.
+	void Clear();
+
+	int GetHistoryCount() const { return m_historyCount; }
+	int GetCapacity() const { return m_capacity; }
+
+private:
+
+	cb2ReplicationHistory(const cb2ReplicationHistory&);
+	cb2ReplicationHistory& operator=(const cb2ReplicationHistory&);
+
+	cb2AllocatorInterface* m_allocator;
+	cb2ReplicaState* m_states;
+	int* m_sequences;
+	int m_historyCount;
+	int m_capacity;
+};
+
+/// Writes the body states of a world as a stream of packets for one client. Each
+/// packet holds the quantized states of the bodies that differ from the last packet
+/// the client acknowledged, as variable length deltas, so bodies at rest cost nothing.
+/// Packets may be lost or arrive out of order, the next one is still based on a
+/// packet the client has.
+class cb2ReplicationWriter
+{
+public:
+	/// @param def the quantization, no reference to it is retained.
+	/// @param allocator where the history lives, NULL for cb2Alloc.
+	cb2ReplicationWriter(const cb2ReplicationDef* def, cb2AllocatorInterface* allocator = NULL);
+
+	/// Append a packet with the bodies of the world that changed since the last
+	/// acknowledged packet. Bodies that were destroyed since are sent as removed.
+	/// @param packet the packet to append to, use cb2Snapshot::SetBuffer to bound its size.
+	/// @return the sequence number of the packet.
+	/// @warning Don't call this during Step.
+	int Write(const cb2World* world, cb2Snapshot* packet);
+
+	/// The client has read the packet with this sequence number. Older or unknown
+	/// sequence numbers are ignored.
+	void Acknowledge(int sequence);
+
+	/// Forget all acknowledgements, the next packet holds full states.
+	void Reset();
+
+	/// Get the sequence number of the last acknowledged packet, 0 for none.
+	int GetAcknowledgedSequence() const { return m_acknowledged; }
+
+private:
+
+	cb2ReplicationDef m_def;
+	cb2ReplicationHistory m_history;
+	int m_sequence;
+	int m_acknowledged;
+};
+
+/// Reads the packets of a cb2ReplicationWriter on the client.
+class cb2ReplicationReader
+{
+public:
+	/// @param def the quantization of the writer, no reference to it is retained.
+	/// @param allocator where the history lives, NULL for cb2Alloc.
+	cb2ReplicationReader(const cb2ReplicationDef* def, cb2AllocatorInterface* allocator = NULL);
+
+	/// Read a packet. Packets older than the newest one read, based on a packet
+	/// that is no longer in the history, or corrupt, are dropped.
+	/// @return the sequence number to acknowledge to the writer, -1 if the packet was dropped.
+	int Read(const void* data, int size);
+
+	/// Move the bodies of a world to the newest states read. Only bodies whose state
+	/// changed since the last call are touched. Bodies are matched by handle, so the
+	/// world should be loaded from a snapshot of the server world.
+	/// @warning Don't call this during Step.
+	void Apply(cb2World* world);
+
+	/// Get the newest state of a body.
+	/// @return false if the body is not replicated.
+	bool GetBody(cb2Handle handle, cb2ReplicatedBody* body) const;
+
+	/// Get the sequence number of the newest packet read, 0 for none.
+	int GetSequence() const { return m_sequence; }
+
+	/// Drop all states, for example to join a new server.
+	void Reset();
+
+private:
+
+	void Decode(const cb2ReplicaState* state, int index, cb2ReplicatedBody* body) const;
+
+	cb2ReplicationDef m_def;
+	cb2ReplicationHistory m_history;
+	int m_sequence;
+};
+
+#endif
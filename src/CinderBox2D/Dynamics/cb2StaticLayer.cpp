@@ -0,0 +1,63 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/cb2StaticLayer.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+
+cb2StaticLayer::cb2StaticLayer(cb2AllocatorInterface* allocator)
+	: m_world(ci::Vec2f(0.0f, 0.0f), 1024, allocator)
+{
+}
+
+cb2StaticLayer::~cb2StaticLayer()
+{
+	// The shapes are counted again so that the world frees them.
+	for (cb2Body* b = m_world.GetBodyList(); b; b = b->GetNext())
+	{
+		for (cb2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+		{
+			f->GetShape()->m_shareCount = 0;
+		}
+	}
+}
+
+bool cb2StaticLayer::Load(const void* data, int size)
+{
+	cb2Assert(m_world.GetBodyCount() == 0);
+	if (m_world.GetBodyCount() > 0 || m_world.LoadLevel(data, size) == false)
+	{
+		return false;
+	}
+
+	// The fixtures of the worlds holding the layer share its shapes without a count.
+	for (cb2Body* b = m_world.GetBodyList(); b; b = b->GetNext())
+	{
+		for (cb2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+		{
+			f->GetShape()->m_shareCount = -1;
+		}
+	}
+	return true;
+}
+
+int cb2StaticLayer::GetProxyCount() const
+{
+	return m_world.m_contactManager.m_broadPhase.GetStaticProxyCount();
+}
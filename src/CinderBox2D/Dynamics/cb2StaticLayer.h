@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_STATIC_LAYER_H
+#define CB2_STATIC_LAYER_H
+
+#include <CinderBox2D/Dynamics/cb2World.h>
+
+/// Static geometry that many worlds share, such as the arena of the matches a server
+/// runs side by side. The layer holds the static bodies of a level saved by
+/// cb2World::SaveLevel with their shapes and the static broad-phase tree. Worlds take
+/// it with cb2World::LoadLevel and only make light bodies and fixtures of their own,
+/// which hold the shapes of the layer and find their proxies in its tree. The layer
+/// does not change once loaded, so worlds on different threads may share it.
+class cb2StaticLayer
+{
+public:
+	/// @param allocator where the layer lives, NULL for cb2Alloc.
+	cb2StaticLayer(cb2AllocatorInterface* allocator = NULL);
+
+	/// The worlds holding the layer must be destroyed first.
+	~cb2StaticLayer();
+
+	/// Load a level saved by cb2World::SaveLevel. Chain vertices are used in place,
+	/// so the data must remain valid while the layer exists. Only an empty layer
+	/// loads. Returns false for a bad level, the layer stays empty then.
+	bool Load(const void* data, int size);
+
+	/// Get the number of static bodies in the layer.
+	int GetBodyCount() const { return m_world.GetBodyCount(); }
+
+	/// Get the number of broad-phase proxies in the layer.
+	int GetProxyCount() const;
+
+private:
+
+	friend class cb2World;
+
+	// The level is loaded into a world of its own that is never stepped, so it gets
+	// a small stack.
+	cb2World m_world;
+};
+
+#endif
@@ -21,7 +21,16 @@
 
 #include <CinderBox2D/Common/cb2Math.h>
 
-/// Profiling data. Times are in milliseconds.
+/// The stages a time budgeted step went through, see cb2StepBudget.
+enum cb2Degradation
+{
+	cb2_degradeIterations	= 0x0001,	///< islands solved with the budget iteration counts
+	cb2_degradeContinuous	= 0x0002,	///< continuous collision left to bullets
+	cb2_degradeWake			= 0x0004	///< sleeping islands woken only near the bodies that hit them
+};
+
+/// Profiling data of the last step. Times are in milliseconds, the island solve times
+/// are summed over the islands. The counters count what happened during the step.
 struct cb2Profile
 {
 	float step;
@@ -30,8 +39,79 @@ struct cb2Profile
 	float solveInit;
 	float solveVelocity;
 	float solvePosition;
-	float broadphase;
+	float broadphase;			///< synchronizeFixtures plus the pair update after the solve
+	float synchronizeFixtures;	///< moving the proxies of the solved bodies
+	float updatePairs;			///< finding new contacts in the broad-phase
 	float solveTOI;
+	float solveParticles;		///< the particle systems, see cb2World::CreateParticleSystem
+
+	int awakeBodyCount;			///< the bodies in the solved islands
+	int islandCount;			///< the islands solved
+	int lodSkipCount;			///< the awake islands that sat out the step, see cb2World::SetLodListener
+	int largestIsland;			///< the bodies in the largest island solved
+	int contactsCreated;
+	int contactsDestroyed;
+	int touchingContactCount;	///< the awake contacts touching after the narrow phase
+	int pairCount;				///< the broad-phase pairs tested for a new contact
+	int proxyReinsertCount;		///< the proxies that left their fat AABB
+	int toiEventCount;			///< the time of impact events solved
+	int toiIterations;			///< the root finder iterations of the time of impact queries
+	int stackFallbackCount;		///< the stack allocations that did not fit and used the heap
+	int heapAllocationCount;	///< the heap allocations of the step, with an allocation audit
+	int degradation;			///< the cb2Degradation flags of the stages a budgeted step reached
+	int degradedIslandCount;	///< the islands solved with the budget iteration counts
+	int deferredWakeCount;		///< the sleeping islands woken only in part to save time
+};
+
+/// The contact tolerances of a world, see cb2World::SetTolerances. They default to the
+/// build settings, the presets trade accuracy for cost. Joints and the collision
+/// routines keep the build settings.
+struct cb2Tolerances
+{
+	cb2Tolerances()
+	{
+		linearSlop = cb2_linearSlop;
+		velocityThreshold = cb2_velocityThreshold;
+		maxLinearCorrection = cb2_maxLinearCorrection;
+		baumgarte = cb2_baumgarte;
+		toiBaumgarte = cb2_toiBaugarte;
+	}
+
+	/// Looser contacts for cheap steps, for example on phones. Stacks rest deeper, stop
+	/// the position iterations sooner and bounce less.
+	static cb2Tolerances LowCost()
+	{
+		cb2Tolerances tolerances;
+		tolerances.linearSlop = 2.0f * cb2_linearSlop;
+		tolerances.velocityThreshold = 2.0f * cb2_velocityThreshold;
+		return tolerances;
+	}
+
+	/// Tighter contacts for accurate steps, for example on a server. Shapes rest closer
+	/// to touching and bounce at lower speeds, which takes more position iterations.
+	static cb2Tolerances HighAccuracy()
+	{
+		cb2Tolerances tolerances;
+		tolerances.linearSlop = 0.5f * cb2_linearSlop;
+		tolerances.velocityThreshold = 0.5f * cb2_velocityThreshold;
+		tolerances.maxLinearCorrection = 0.5f * cb2_maxLinearCorrection;
+		return tolerances;
+	}
+
+	/// The overlap contacts are allowed to rest at, in meters. Keep it at most
+	/// cb2_polygonRadius, the skin polygons keep around them.
+	float linearSlop;
+
+	/// Contacts approaching slower than this do not bounce, in meters per second.
+	float velocityThreshold;
+
+	/// The largest position correction of a contact per iteration, in meters.
+	float maxLinearCorrection;
+
+	/// The fraction of the overlap the position iterations remove per iteration, in the
+	/// step and in the time of impact sub-steps.
+	float baumgarte;
+	float toiBaumgarte;
 };
 
 /// This is an internal structure.
@@ -42,7 +122,14 @@ struct cb2TimeStep
 	float dtRatio;	// dt * inv_dt0
 	int velocityIterations;
 	int positionIterations;
+	int subStepCount;	// soft step substeps, 0 to use the position iterations
+	bool adaptiveIterations;	// stop the velocity iterations once they converge
+	bool directJoints;	// solve the revolute joint trees directly, see cb2ArticulationSolver
+	bool reduceContacts;	// merge the manifolds of each body pair, see cb2World::SetContactReduction
+	unsigned int stepIndex;	// the world step count, solved bodies take it as their move stamp
 	bool warmStarting;
+	bool speculative;	// contacts may hold points that are apart, see cb2World::SetSpeculativeContacts
+	cb2Tolerances tolerances;
 };
 
 /// This is an internal structure.
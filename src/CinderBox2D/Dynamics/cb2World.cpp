@@ -19,38 +19,86 @@
 #include <CinderBox2D/Dynamics/cb2World.h>
 #include <CinderBox2D/Dynamics/cb2Body.h>
 #include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
 #include <CinderBox2D/Dynamics/cb2Island.h>
+#include <CinderBox2D/Dynamics/cb2WorldView.h>
 #include <CinderBox2D/Dynamics/Joints/cb2PulleyJoint.h>
+#include <CinderBox2D/Dynamics/Controllers/cb2Controller.h>
+#include <CinderBox2D/Particle/cb2ParticleSystem.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
 #include <CinderBox2D/Dynamics/Contacts/cb2ContactSolver.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2PolygonContact.h>
 #include <CinderBox2D/Collision/cb2Collision.h>
+#include <CinderBox2D/Collision/cb2Distance.h>
 #include <CinderBox2D/Collision/cb2BroadPhase.h>
 #include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
 #include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
 #include <CinderBox2D/Collision/cb2TimeOfImpact.h>
+#include <CinderBox2D/Common/cb2BatchMath.h>
 #include <CinderBox2D/Common/cb2Draw.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Common/cb2ThreadPool.h>
 #include <CinderBox2D/Common/cb2Timer.h>
+#include <CinderBox2D/Common/cb2Trace.h>
 #include <new>
-
-cb2World::cb2World(const ci::Vec2f& gravity)
+#include <algorithm>
+
+cb2World::cb2World(const ci::Vec2f& gravity, int stackSize, cb2AllocatorInterface* allocator)
+	: m_allocator(allocator),
+	m_blockAllocator(allocator),
+	m_stackAllocator(stackSize, allocator),
+	m_contactManager(allocator),
+	m_bodyHandles(allocator),
+	m_fixtureHandles(allocator),
+	m_jointHandles(allocator)
 {
 	m_destructionListener = NULL;
 	g_debugDraw = NULL;
 
 	m_bodyList = NULL;
 	m_jointList = NULL;
+	m_controllerList = NULL;
+	m_particleSystemList = NULL;
+
+	m_awakeIslandList = NULL;
+	m_sleepingIslandList = NULL;
 
 	m_bodyCount = 0;
 	m_jointCount = 0;
+	m_controllerCount = 0;
+	m_particleSystemCount = 0;
 
 	m_warmStarting = true;
 	m_continuousPhysics = true;
+	m_speculativeContacts = false;
 	m_subStepping = false;
 
+	m_softStepCount = 0;
+	m_adaptiveIterations = false;
+	m_directJoints = false;
+	m_contactReduction = false;
+	m_allocationAudit = cb2_auditOff;
+	m_allocationAuditScope.audit = cb2_auditOff;
+	m_allocationAuditScope.count.store(0, std::memory_order_relaxed);
+
+	m_lodListener = NULL;
+	for (int i = 1; i < cb2_maxLodLevels; ++i)
+	{
+		m_lodDefs[i].stepInterval = 1 << i;
+		m_lodDefs[i].continuous = i < 2;
+	}
+
+	m_stepIndex = 0;
+	m_topologyStamp = 0;
+
 	m_stepComplete = true;
 
+	m_treeRebalanceBudget = 0;
+
 	m_allowSleep = true;
 	m_gravity = gravity;
 
@@ -59,12 +107,79 @@ cb2World::cb2World(const ci::Vec2f& gravity)
 	m_inv_dt0 = 0.0f;
 
 	m_contactManager.m_allocator = &m_blockAllocator;
+	m_contactManager.m_stackAllocator = &m_stackAllocator;
+
+	m_taskScheduler = NULL;
+	m_threadPool = NULL;
+
+	m_stepThread = NULL;
+	m_commandQueue.m_allocator = m_allocator;
+	m_views = NULL;
+	m_viewCount = 0;
+	m_publishedView = NULL;
+	m_pendingView = NULL;
+	m_viewEnabled = false;
+	m_retiredShapes = NULL;
+	m_retiredShapeCount = 0;
+	m_retiredShapeCapacity = 0;
+	m_viewStamp = 0;
+	m_asyncTimeStep = 0.0f;
+	m_asyncVelocityIterations = 0;
+	m_asyncPositionIterations = 0;
+	m_stepInFlight = false;
+	m_threadStacks = NULL;
+	m_threadStackCount = 0;
+	m_stackSize = stackSize;
+
+	m_trimThreshold = 0.0f;
+	m_trimLiveBytes = -1;
+
+	m_fixedTimeStep = 1.0f / 60.0f;
+	m_fixedVelocityIterations = 8;
+	m_fixedPositionIterations = 3;
+	m_maxFixedSteps = 4;
+	m_accumulator = 0.0f;
+
+	m_bodyTransforms = NULL;
+	m_bodyTransformCount = 0;
+
+	m_sharedShapes = NULL;
+	m_sharedShapeCount = 0;
+	m_sharedShapeCapacity = 0;
+
+	m_toiEvents = NULL;
+	m_toiEventCount = 0;
+	m_toiEventCapacity = 0;
+
+	m_jointBreakEvents = NULL;
+	m_jointBreakEventCount = 0;
+	m_jointBreakEventCapacity = 0;
 
 	memset(&m_profile, 0, sizeof(cb2Profile));
 }
 
 cb2World::~cb2World()
 {
+	WaitStep();
+	if (m_stepThread)
+	{
+		m_stepThread->~cb2BackgroundThread();
+		cb2Free(m_allocator, m_stepThread);
+	}
+	SetViewEnabled(false);
+	cb2Assert(m_retiredShapeCount == 0);
+	cb2Free(m_allocator, m_retiredShapes);
+
+	// Particle systems allocate using cb2Alloc.
+	cb2ParticleSystem* ps = m_particleSystemList;
+	while (ps)
+	{
+		cb2ParticleSystem* psNext = ps->m_next;
+		ps->~cb2ParticleSystem();
+		m_blockAllocator.Free(ps, sizeof(cb2ParticleSystem));
+		ps = psNext;
+	}
+
 	// Some shapes allocate using cb2Alloc.
 	cb2Body* b = m_bodyList;
 	while (b)
@@ -80,8 +195,26 @@ cb2World::~cb2World()
 			f = fNext;
 		}
 
+		// The tree of an aggregate uses cb2Alloc too.
+		if (b->m_aggregate)
+		{
+			b->m_aggregate->~cb2BodyAggregate();
+		}
+
 		b = bNext;
 	}
+
+	for (int i = 0; i < m_sharedShapeCount; ++i)
+	{
+		cb2Fixture::ReleaseShape(&m_blockAllocator, m_sharedShapes[i]);
+	}
+	cb2Free(m_allocator, m_sharedShapes);
+
+	SetTaskScheduler(NULL);
+
+	cb2Free(m_allocator, m_toiEvents);
+	cb2Free(m_allocator, m_jointBreakEvents);
+	cb2Free(m_allocator, m_bodyTransforms);
 }
 
 void cb2World::SetDestructionListener(cb2DestructionListener* listener)
@@ -92,6 +225,9 @@ void cb2World::SetDestructionListener(cb2DestructionListener* listener)
 void cb2World::SetContactFilter(cb2ContactFilter* filter)
 {
 	m_contactManager.m_contactFilter = filter;
+
+	// Other filters may let pairs through that the masks reject.
+	m_contactManager.m_broadPhase.SetCategoryPruning(filter == &cb2_defaultFilter);
 }
 
 void cb2World::SetContactListener(cb2ContactListener* listener)
@@ -104,6 +240,98 @@ void cb2World::SetDebugDraw(cb2Draw* debugDraw)
 	g_debugDraw = debugDraw;
 }
 
+void cb2World::SetTaskScheduler(cb2TaskScheduler* scheduler)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	if (scheduler == m_taskScheduler)
+	{
+		return;
+	}
+
+	for (int i = 0; i < m_threadStackCount; ++i)
+	{
+		m_threadStacks[i].~cb2StackAllocator();
+	}
+	cb2Free(m_allocator, m_threadStacks);
+	m_threadStacks = NULL;
+	m_threadStackCount = 0;
+
+	if (m_threadPool)
+	{
+		m_threadPool->~cb2ThreadPool();
+		cb2Free(m_allocator, m_threadPool);
+		m_threadPool = NULL;
+	}
+
+	m_taskScheduler = scheduler;
+	m_stepScheduler.SetScheduler(scheduler);
+	m_contactManager.m_taskScheduler = scheduler ? &m_stepScheduler : NULL;
+	m_contactManager.m_broadPhase.SetTaskScheduler(scheduler ? &m_stepScheduler : NULL);
+
+	if (m_taskScheduler)
+	{
+		m_threadStackCount = m_taskScheduler->GetThreadCount();
+		cb2Assert(m_threadStackCount >= 1);
+		m_threadStacks = (cb2StackAllocator*)cb2Alloc(m_allocator, m_threadStackCount * sizeof(cb2StackAllocator));
+		for (int i = 0; i < m_threadStackCount; ++i)
+		{
+			new (m_threadStacks + i) cb2StackAllocator(m_stackSize, m_allocator);
+		}
+	}
+}
+
+void cb2World::SetThreadCount(int count)
+{
+	cb2Assert(count >= 1);
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	if (count <= 1)
+	{
+		SetTaskScheduler(NULL);
+		return;
+	}
+
+	if (m_threadPool && m_threadPool->GetThreadCount() == count)
+	{
+		return;
+	}
+
+	void* mem = cb2Alloc(m_allocator, sizeof(cb2ThreadPool));
+	cb2ThreadPool* pool = new (mem) cb2ThreadPool(count);
+	SetTaskScheduler(pool);
+	m_threadPool = pool;
+}
+
+int cb2World::GetThreadCount() const
+{
+	return m_taskScheduler ? m_taskScheduler->GetThreadCount() : 1;
+}
+
+void cb2World::GetBlockAllocatorStats(cb2BlockAllocatorStats* stats) const
+{
+	// The per thread allocators are merged at the end of each step.
+	m_blockAllocator.GetStats(stats);
+}
+
+int cb2World::GetStackFallbackCount() const
+{
+	int count = m_stackAllocator.GetFallbackCount();
+	for (int i = 0; i < m_threadStackCount; ++i)
+	{
+		count += m_threadStacks[i].GetFallbackCount();
+	}
+	return count;
+}
+
 cb2Body* cb2World::CreateBody(const cb2BodyDef* def)
 {
 	cb2Assert(IsLocked() == false);
@@ -114,6 +342,14 @@ cb2Body* cb2World::CreateBody(const cb2BodyDef* def)
 
 	void* mem = m_blockAllocator.Allocate(sizeof(cb2Body));
 	cb2Body* b = new (mem) cb2Body(def, this);
+	b->m_handle = m_bodyHandles.Create(b);
+
+	if (def->aggregate)
+	{
+		void* aggregateMem = m_blockAllocator.Allocate(sizeof(cb2BodyAggregate));
+		b->m_aggregate = new (aggregateMem) cb2BodyAggregate(b, m_allocator);
+	}
+	++m_topologyStamp;
 
 	// Add to world doubly linked list.
 	b->m_prev = NULL;
@@ -125,6 +361,16 @@ cb2Body* cb2World::CreateBody(const cb2BodyDef* def)
 	m_bodyList = b;
 	++m_bodyCount;
 
+	AddToIsland(b);
+
+	if (m_bodyTransforms)
+	{
+		GrowBodyTransforms();
+		cb2BodyTransforms* transforms = m_bodyTransforms + b->m_handle.index;
+		transforms->previous = b->m_xf;
+		transforms->current = b->m_xf;
+	}
+
 	return b;
 }
 
@@ -137,6 +383,275 @@ void cb2World::DestroyBody(cb2Body* b)
 		return;
 	}
 
+	DetachBody(b);
+	FreeBody(b);
+}
+
+void cb2World::DestroyBodies(cb2Body** bodies, int count)
+{
+	cb2Assert(m_bodyCount >= count);
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		DetachBody(bodies[i]);
+	}
+
+	DestroyBodyProxies(bodies, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		FreeBody(bodies[i]);
+	}
+}
+
+void cb2World::DeactivateBodies(cb2Body** bodies, int count)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	++m_topologyStamp;
+
+	// Same order as cb2Body::SetActive(false).
+	for (int i = 0; i < count; ++i)
+	{
+		cb2Body* b = bodies[i];
+		cb2Assert(b->IsActive());
+		RemoveFromIsland(b);
+		b->m_flags &= ~cb2Body::e_activeFlag;
+	}
+
+	DestroyBodyProxies(bodies, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		cb2Body* b = bodies[i];
+		cb2ContactEdge* ce = b->m_contactList;
+		while (ce)
+		{
+			cb2ContactEdge* ce0 = ce;
+			ce = ce->next;
+			m_contactManager.Destroy(ce0->contact);
+		}
+		b->m_contactList = NULL;
+	}
+}
+
+struct cb2TeleportContext
+{
+	cb2Body** bodies;
+	const cb2Transform* transforms;
+};
+
+void cb2World::TeleportTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	CB2_TRACE_ZONE_COUNT("TeleportTask", end - begin);
+
+	cb2TeleportContext* teleportContext = (cb2TeleportContext*)context;
+	for (int i = begin; i < end; ++i)
+	{
+		const cb2Transform& xf = teleportContext->transforms[i];
+		teleportContext->bodies[i]->Teleport(xf.p, xf.q.GetAngle());
+	}
+}
+
+void cb2World::SetTransforms(cb2Body** bodies, const cb2Transform* transforms, int count)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	cb2TeleportContext context;
+	context.bodies = bodies;
+	context.transforms = transforms;
+	if (m_taskScheduler && count > 64)
+	{
+		void* group = m_stepScheduler.EnqueueRange(TeleportTask, &context, count, 32);
+		m_stepScheduler.Wait(group);
+	}
+	else
+	{
+		TeleportTask(&context, 0, count, 0);
+	}
+
+	// Aggregate bodies move their own proxies.
+	int proxyCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (bodies[i]->m_aggregate)
+		{
+			bodies[i]->MoveFixtureProxies(ci::Vec2f(0.0f, 0.0f));
+			continue;
+		}
+
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			proxyCount += f->m_proxyCount;
+		}
+	}
+
+	int* proxyIds = (int*)cb2Alloc(m_allocator, cb2Max(proxyCount, 1) * sizeof(int));
+	cb2AABB* aabbs = (cb2AABB*)cb2Alloc(m_allocator, cb2Max(proxyCount, 1) * sizeof(cb2AABB));
+
+	int proxyIndex = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (bodies[i]->m_aggregate)
+		{
+			continue;
+		}
+
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			for (int j = 0; j < f->m_proxyCount; ++j)
+			{
+				proxyIds[proxyIndex] = f->m_proxies[j].proxyId;
+				aabbs[proxyIndex] = f->m_proxies[j].aabb;
+				++proxyIndex;
+			}
+		}
+	}
+
+	m_contactManager.m_broadPhase.MoveProxies(proxyIds, aabbs, proxyCount);
+
+	cb2Free(m_allocator, aabbs);
+	cb2Free(m_allocator, proxyIds);
+
+	// Find the contacts at the new places before the next step collides.
+	m_flags |= e_newFixture;
+}
+
+int cb2World::GetRegionBodies(int region, cb2Body** bodies, int capacity) const
+{
+	int count = 0;
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_region == region)
+		{
+			if (count < capacity)
+			{
+				bodies[count] = b;
+			}
+			++count;
+		}
+	}
+
+	return count;
+}
+
+void cb2World::SetRegionActive(int region, bool flag)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	int count = 0;
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_region == region && b->IsActive() != flag)
+		{
+			++count;
+		}
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, count * sizeof(cb2Body*));
+	count = 0;
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_region == region && b->IsActive() != flag)
+		{
+			bodies[count++] = b;
+		}
+	}
+
+	if (flag)
+	{
+		ActivateBodies(bodies, count);
+	}
+	else
+	{
+		DeactivateBodies(bodies, count);
+	}
+
+	cb2Free(m_allocator, bodies);
+}
+
+void cb2World::DestroyRegion(int region)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	int count = GetRegionBodies(region, NULL, 0);
+	if (count == 0)
+	{
+		return;
+	}
+
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, count * sizeof(cb2Body*));
+	GetRegionBodies(region, bodies, count);
+	DestroyBodies(bodies, count);
+	cb2Free(m_allocator, bodies);
+}
+
+// Destroy the broad-phase proxies of the fixtures of many bodies in one batch.
+void cb2World::DestroyBodyProxies(cb2Body** bodies, int count)
+{
+	// Aggregate bodies destroy their own proxies.
+	int proxyCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			if (bodies[i]->m_aggregate)
+			{
+				f->DestroyProxies(&m_contactManager.m_broadPhase);
+			}
+			proxyCount += f->m_proxyCount;
+		}
+	}
+
+	int* proxyIds = (int*)cb2Alloc(m_allocator, cb2Max(proxyCount, 1) * sizeof(int));
+	int proxyIndex = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			for (int j = 0; j < f->m_proxyCount; ++j)
+			{
+				proxyIds[proxyIndex++] = f->m_proxies[j].proxyId;
+				f->m_proxies[j].proxyId = cb2BroadPhase::e_nullProxy;
+			}
+			f->m_proxyCount = 0;
+		}
+	}
+
+	m_contactManager.m_broadPhase.DestroyProxies(proxyIds, proxyCount);
+	cb2Free(m_allocator, proxyIds);
+}
+
+// Destroy the joints and contacts of a body and take it out of its island.
+void cb2World::DetachBody(cb2Body* b)
+{
 	// Delete the attached joints.
 	cb2JointEdge* je = b->m_jointList;
 	while (je)
@@ -165,6 +680,14 @@ void cb2World::DestroyBody(cb2Body* b)
 	}
 	b->m_contactList = NULL;
 
+	RemoveFromIsland(b);
+}
+
+// Destroy the fixtures of a detached body and free it.
+void cb2World::FreeBody(cb2Body* b)
+{
+	++m_topologyStamp;
+
 	// Delete the attached fixtures. This destroys broad-phase proxies.
 	cb2Fixture* f = b->m_fixtureList;
 	while (f)
@@ -178,6 +701,7 @@ void cb2World::DestroyBody(cb2Body* b)
 		}
 
 		f0->DestroyProxies(&m_contactManager.m_broadPhase);
+		m_fixtureHandles.Destroy(f0->m_handle);
 		f0->Destroy(&m_blockAllocator);
 		f0->~cb2Fixture();
 		m_blockAllocator.Free(f0, sizeof(cb2Fixture));
@@ -188,6 +712,13 @@ void cb2World::DestroyBody(cb2Body* b)
 	b->m_fixtureList = NULL;
 	b->m_fixtureCount = 0;
 
+	if (b->m_aggregate)
+	{
+		b->m_aggregate->~cb2BodyAggregate();
+		m_blockAllocator.Free(b->m_aggregate, sizeof(cb2BodyAggregate));
+		b->m_aggregate = NULL;
+	}
+
 	// Remove world body list.
 	if (b->m_prev)
 	{
@@ -204,28 +735,249 @@ void cb2World::DestroyBody(cb2Body* b)
 		m_bodyList = b->m_next;
 	}
 
+	m_bodyHandles.Destroy(b->m_handle);
+
 	--m_bodyCount;
 	b->~cb2Body();
 	m_blockAllocator.Free(b, sizeof(cb2Body));
 }
 
-cb2Joint* cb2World::CreateJoint(const cb2JointDef* def)
+void cb2World::ActivateBodies(cb2Body** bodies, int count)
 {
 	cb2Assert(IsLocked() == false);
 	if (IsLocked())
 	{
-		return NULL;
+		return;
 	}
 
-	cb2Joint* j = cb2Joint::Create(def, &m_blockAllocator);
+	++m_topologyStamp;
 
-	// Connect to the world list.
-	j->m_prev = NULL;
-	j->m_next = m_jointList;
-	if (m_jointList)
+	// Aggregate bodies create their own proxies.
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	int proxyCount = 0;
+	for (int i = 0; i < count; ++i)
 	{
-		m_jointList->m_prev = j;
-	}
+		cb2Body* b = bodies[i];
+		cb2Assert(b->IsActive() == false);
+		if (b->m_aggregate)
+		{
+			b->m_flags |= cb2Body::e_activeFlag;
+			for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+			{
+				f->CreateProxies(broadPhase, b->m_xf);
+			}
+			continue;
+		}
+
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			proxyCount += f->ComputeProxyCount();
+		}
+	}
+
+	cb2AABB* aabbs = (cb2AABB*)cb2Alloc(m_allocator, proxyCount * sizeof(cb2AABB));
+	void** userData = (void**)cb2Alloc(m_allocator, proxyCount * sizeof(void*));
+	int* proxyIds = (int*)cb2Alloc(m_allocator, proxyCount * sizeof(int));
+
+	// Same as cb2Fixture::CreateProxies, minus the broad-phase insertion. Static
+	// proxies come first, they go into a tree of their own.
+	int proxyIndex = 0;
+	int staticProxyCount = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		bool isStatic = pass == 0;
+		for (int i = 0; i < count; ++i)
+		{
+			cb2Body* b = bodies[i];
+			if ((b->m_type == cb2_staticBody) != isStatic || b->m_aggregate)
+			{
+				continue;
+			}
+
+			b->m_flags |= cb2Body::e_activeFlag;
+
+			for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+			{
+				cb2Assert(f->m_proxyCount == 0);
+				f->m_proxyCount = f->ComputeProxyCount();
+
+				for (int j = 0; j < f->m_proxyCount; ++j)
+				{
+					cb2FixtureProxy* proxy = f->m_proxies + j;
+					proxy->childIndex = f->m_sharedProxy ? (int)cb2Shape::e_allChildren : j;
+					f->m_shape->ComputeAABB(&proxy->aabb, b->m_xf, proxy->childIndex);
+					proxy->fixture = f;
+
+					aabbs[proxyIndex] = proxy->aabb;
+					userData[proxyIndex] = proxy;
+					++proxyIndex;
+				}
+			}
+		}
+
+		if (isStatic)
+		{
+			staticProxyCount = proxyIndex;
+		}
+	}
+
+	broadPhase->CreateProxies(staticProxyCount, aabbs, userData, proxyIds, true);
+	broadPhase->CreateProxies(proxyCount - staticProxyCount, aabbs + staticProxyCount,
+		userData + staticProxyCount, proxyIds + staticProxyCount, false);
+
+	for (int i = 0; i < proxyCount; ++i)
+	{
+		((cb2FixtureProxy*)userData[i])->proxyId = proxyIds[i];
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (bodies[i]->m_aggregate)
+		{
+			continue;
+		}
+
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			f->SetProxyFilters(broadPhase);
+		}
+	}
+
+	cb2Free(m_allocator, proxyIds);
+	cb2Free(m_allocator, userData);
+	cb2Free(m_allocator, aabbs);
+
+	for (int i = 0; i < count; ++i)
+	{
+		AddToIsland(bodies[i]);
+	}
+
+	// Contacts are created the next time step.
+}
+
+void cb2World::CreateBodies(const cb2BodyDef* bodyDefs, int count, const cb2FixtureDef* fixtureDefs,
+							const int* fixtureCounts, cb2Body** bodies)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	// The bodies are created inactive so that the fixtures make no proxies.
+	int activeCount = 0;
+	const cb2FixtureDef* fixtureDef = fixtureDefs;
+	for (int i = 0; i < count; ++i)
+	{
+		cb2BodyDef def = bodyDefs[i];
+		def.active = false;
+		cb2Body* b = CreateBody(&def);
+
+		int fixtureCount = fixtureCounts ? fixtureCounts[i] : 1;
+		for (int j = 0; j < fixtureCount; ++j)
+		{
+			b->AddFixture(fixtureDef++);
+		}
+		b->ResetMassData();
+
+		if (bodyDefs[i].active)
+		{
+			++activeCount;
+		}
+
+		bodies[i] = b;
+	}
+
+	m_flags |= e_newFixture;
+
+	if (activeCount == count)
+	{
+		ActivateBodies(bodies, count);
+		return;
+	}
+
+	cb2Body** activeBodies = (cb2Body**)cb2Alloc(m_allocator, activeCount * sizeof(cb2Body*));
+	activeCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (bodyDefs[i].active)
+		{
+			activeBodies[activeCount++] = bodies[i];
+		}
+	}
+
+	ActivateBodies(activeBodies, activeCount);
+	cb2Free(m_allocator, activeBodies);
+}
+
+const cb2Shape* cb2World::CreateSharedShape(const cb2Shape* shape)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return NULL;
+	}
+
+	if (m_sharedShapeCount == m_sharedShapeCapacity)
+	{
+		cb2Shape** oldShapes = m_sharedShapes;
+		m_sharedShapeCapacity = cb2Max(2 * m_sharedShapeCapacity, 16);
+		m_sharedShapes = (cb2Shape**)cb2Alloc(m_allocator, m_sharedShapeCapacity * sizeof(cb2Shape*));
+		if (oldShapes)
+		{
+			memcpy(m_sharedShapes, oldShapes, m_sharedShapeCount * sizeof(cb2Shape*));
+			cb2Free(m_allocator, oldShapes);
+		}
+	}
+
+	// The world holds the first reference.
+	cb2Shape* clone = shape->Clone(&m_blockAllocator);
+	clone->m_shareCount = 1;
+	m_sharedShapes[m_sharedShapeCount++] = clone;
+	return clone;
+}
+
+void cb2World::DestroySharedShape(const cb2Shape* shape)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	for (int i = 0; i < m_sharedShapeCount; ++i)
+	{
+		if (m_sharedShapes[i] == shape)
+		{
+			ReleaseShape(m_sharedShapes[i]);
+			m_sharedShapes[i] = m_sharedShapes[--m_sharedShapeCount];
+			return;
+		}
+	}
+
+	// The shape was not made by this world or was already released.
+	cb2Assert(false);
+}
+
+cb2Joint* cb2World::CreateJoint(const cb2JointDef* def)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return NULL;
+	}
+
+	cb2Joint* j = cb2Joint::Create(def, &m_blockAllocator);
+	j->m_handle = m_jointHandles.Create(j);
+	++m_topologyStamp;
+
+	// Connect to the world list.
+	j->m_prev = NULL;
+	j->m_next = m_jointList;
+	if (m_jointList)
+	{
+		m_jointList->m_prev = j;
+	}
 	m_jointList = j;
 	++m_jointCount;
 
@@ -264,7 +1016,9 @@ cb2Joint* cb2World::CreateJoint(const cb2JointDef* def)
 		}
 	}
 
-	// Note: creating a joint doesn't wake the bodies.
+	// Note: creating a joint doesn't wake the bodies. It does merge their islands,
+	// which wakes both if either is awake, just like the island search used to.
+	LinkJoint(j);
 
 	return j;
 }
@@ -277,8 +1031,12 @@ void cb2World::DestroyJoint(cb2Joint* j)
 		return;
 	}
 
+	++m_topologyStamp;
+
 	bool collideConnected = j->m_collideConnected;
 
+	UnlinkJoint(j);
+
 	// Remove from the doubly linked list.
 	if (j->m_prev)
 	{
@@ -341,6 +1099,7 @@ void cb2World::DestroyJoint(cb2Joint* j)
 	j->m_edgeB.prev = NULL;
 	j->m_edgeB.next = NULL;
 
+	m_jointHandles.Destroy(j->m_handle);
 	cb2Joint::Destroy(j, &m_blockAllocator);
 
 	cb2Assert(m_jointCount > 0);
@@ -364,6 +1123,112 @@ void cb2World::DestroyJoint(cb2Joint* j)
 	}
 }
 
+cb2Controller* cb2World::CreateController(const cb2ControllerDef* def)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return NULL;
+	}
+
+	cb2Controller* c = cb2Controller::Create(def, &m_blockAllocator);
+
+	// Add to the world controller list.
+	c->m_prev = NULL;
+	c->m_next = m_controllerList;
+	if (m_controllerList)
+	{
+		m_controllerList->m_prev = c;
+	}
+	m_controllerList = c;
+	++m_controllerCount;
+
+	return c;
+}
+
+void cb2World::DestroyController(cb2Controller* c)
+{
+	cb2Assert(m_controllerCount > 0);
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	// Remove from the world controller list.
+	if (c->m_prev)
+	{
+		c->m_prev->m_next = c->m_next;
+	}
+
+	if (c->m_next)
+	{
+		c->m_next->m_prev = c->m_prev;
+	}
+
+	if (c == m_controllerList)
+	{
+		m_controllerList = c->m_next;
+	}
+
+	cb2Controller::Destroy(c, &m_blockAllocator);
+	--m_controllerCount;
+}
+
+cb2ParticleSystem* cb2World::CreateParticleSystem(const cb2ParticleSystemDef* def)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return NULL;
+	}
+
+	void* mem = m_blockAllocator.Allocate(sizeof(cb2ParticleSystem));
+	cb2ParticleSystem* ps = new (mem) cb2ParticleSystem(def, this);
+
+	// Add to the world particle system list.
+	ps->m_prev = NULL;
+	ps->m_next = m_particleSystemList;
+	if (m_particleSystemList)
+	{
+		m_particleSystemList->m_prev = ps;
+	}
+	m_particleSystemList = ps;
+	++m_particleSystemCount;
+
+	return ps;
+}
+
+void cb2World::DestroyParticleSystem(cb2ParticleSystem* ps)
+{
+	cb2Assert(m_particleSystemCount > 0);
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	// Remove from the world particle system list.
+	if (ps->m_prev)
+	{
+		ps->m_prev->m_next = ps->m_next;
+	}
+
+	if (ps->m_next)
+	{
+		ps->m_next->m_prev = ps->m_prev;
+	}
+
+	if (ps == m_particleSystemList)
+	{
+		m_particleSystemList = ps->m_next;
+	}
+
+	ps->~cb2ParticleSystem();
+	m_blockAllocator.Free(ps, sizeof(cb2ParticleSystem));
+	--m_particleSystemCount;
+}
+
 //
 void cb2World::SetAllowSleeping(bool flag)
 {
@@ -382,650 +1247,3685 @@ void cb2World::SetAllowSleeping(bool flag)
 	}
 }
 
-// Find islands, integrate and solve constraints, solve position constraints
-void cb2World::Solve(const cb2TimeStep& step)
+void cb2World::SetSoftStepCount(int count)
 {
-	m_profile.solveInit = 0.0f;
-	m_profile.solveVelocity = 0.0f;
-	m_profile.solvePosition = 0.0f;
+	cb2Assert(count >= 0);
+	m_softStepCount = cb2Max(count, 0);
+}
 
-	// Size the island for the worst case.
-	cb2Island island(m_bodyCount,
-					m_contactManager.m_contactCount,
-					m_jointCount,
-					&m_stackAllocator,
-					m_contactManager.m_contactListener);
+void cb2World::SetLodDef(int level, const cb2LodDef& def)
+{
+	cb2Assert(0 <= level && level < cb2_maxLodLevels);
+	cb2Assert(def.stepInterval >= 1);
+	m_lodDefs[level] = def;
+}
 
-	// Clear all the island flags.
-	for (cb2Body* b = m_bodyList; b; b = b->m_next)
-	{
-		b->m_flags &= ~cb2Body::e_islandFlag;
-	}
-	for (cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+const cb2LodDef& cb2World::GetLodDef(int level) const
+{
+	cb2Assert(0 <= level && level < cb2_maxLodLevels);
+	return m_lodDefs[level];
+}
+
+void cb2World::SetQueryTreeEnabled(bool flag)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
 	{
-		c->m_flags &= ~cb2Contact::e_islandFlag;
+		return;
 	}
-	for (cb2Joint* j = m_jointList; j; j = j->m_next)
+
+	m_contactManager.m_broadPhase.SetQueryTreeEnabled(flag);
+}
+
+bool cb2World::GetQueryTreeEnabled() const
+{
+	return m_contactManager.m_broadPhase.GetQueryTreeEnabled();
+}
+
+void cb2World::SetGridCellSize(float cellSize)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
 	{
-		j->m_islandFlag = false;
+		return;
 	}
 
-	// Build and simulate all awake islands.
-	int stackSize = m_bodyCount;
-	cb2Body** stack = (cb2Body**)m_stackAllocator.Allocate(stackSize * sizeof(cb2Body*));
-	for (cb2Body* seed = m_bodyList; seed; seed = seed->m_next)
+	++m_topologyStamp;
+
+	// Only moving proxies change their index. The contacts only refer to fixtures,
+	// the new proxies find them again like touched ones do.
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
 	{
-		if (seed->m_flags & cb2Body::e_islandFlag)
+		if (b->m_type == cb2_staticBody)
 		{
 			continue;
 		}
 
-		if (seed->IsAwake() == false || seed->IsActive() == false)
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
 		{
-			continue;
+			f->DestroyProxies(broadPhase);
 		}
+	}
 
-		// The seed can be dynamic or kinematic.
-		if (seed->GetType() == cb2_staticBody)
+	broadPhase->SetGridCellSize(cellSize);
+
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_type == cb2_staticBody || b->IsActive() == false)
 		{
 			continue;
 		}
 
-		// Reset island and stack.
-		island.Clear();
-		int stackCount = 0;
-		stack[stackCount++] = seed;
-		seed->m_flags |= cb2Body::e_islandFlag;
-
-		// Perform a depth first search (DFS) on the constraint graph.
-		while (stackCount > 0)
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
 		{
-			// Grab the next body off the stack and add it to the island.
-			cb2Body* b = stack[--stackCount];
-			cb2Assert(b->IsActive() == true);
-			island.Add(b);
-
-			// Make sure the body is awake.
-			b->SetAwake(true);
+			f->CreateProxies(broadPhase, b->m_xf);
+		}
+	}
+}
 
-			// To keep islands as small as possible, we don't
-			// propagate islands across static bodies.
-			if (b->GetType() == cb2_staticBody)
-			{
-				continue;
-			}
+float cb2World::GetGridCellSize() const
+{
+	return m_contactManager.m_broadPhase.GetGridCellSize();
+}
 
-			// Search all contacts connected to this body.
-			for (cb2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
-			{
-				cb2Contact* contact = ce->contact;
+void cb2World::SetManifoldReuseTolerance(float linearTolerance, float angularTolerance)
+{
+	cb2Assert(linearTolerance >= 0.0f && angularTolerance >= 0.0f);
+	m_contactManager.m_reuseLinearTolerance = linearTolerance;
+	m_contactManager.m_reuseAngularTolerance = angularTolerance;
+}
 
-				// Has this contact already been added to an island?
-				if (contact->m_flags & cb2Contact::e_islandFlag)
-				{
-					continue;
-				}
+float cb2World::GetManifoldReuseLinearTolerance() const
+{
+	return m_contactManager.m_reuseLinearTolerance;
+}
 
-				// Is this contact solid and touching?
-				if (contact->IsEnabled() == false ||
-					contact->IsTouching() == false)
-				{
-					continue;
-				}
+float cb2World::GetManifoldReuseAngularTolerance() const
+{
+	return m_contactManager.m_reuseAngularTolerance;
+}
 
-				// Skip sensors.
-				bool sensorA = contact->m_fixtureA->m_isSensor;
-				bool sensorB = contact->m_fixtureB->m_isSensor;
-				if (sensorA || sensorB)
-				{
-					continue;
-				}
+void cb2World::SetSensorEventBatching(bool flag)
+{
+	cb2Assert(IsLocked() == false);
+	m_contactManager.m_batchSensorEvents = flag;
+}
 
-				island.Add(contact);
-				contact->m_flags |= cb2Contact::e_islandFlag;
+bool cb2World::GetSensorEventBatching() const
+{
+	return m_contactManager.m_batchSensorEvents;
+}
 
-				cb2Body* other = ce->other;
+const cb2SensorEvent* cb2World::GetSensorEvents(int* count) const
+{
+	*count = m_contactManager.m_sensorEventCount;
+	return m_contactManager.m_sensorEvents;
+}
 
-				// Was the other body already added to this island?
-				if (other->m_flags & cb2Body::e_islandFlag)
-				{
-					continue;
-				}
+void cb2World::SetContactEventBatching(bool flag)
+{
+	cb2Assert(IsLocked() == false);
+	m_contactManager.m_batchContactEvents = flag;
+}
 
-				cb2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= cb2Body::e_islandFlag;
-			}
+bool cb2World::GetContactEventBatching() const
+{
+	return m_contactManager.m_batchContactEvents;
+}
 
-			// Search all joints connect to this body.
-			for (cb2JointEdge* je = b->m_jointList; je; je = je->next)
-			{
-				if (je->joint->m_islandFlag == true)
-				{
-					continue;
-				}
+const cb2ContactBeginEvent* cb2World::GetContactBeginEvents(int* count) const
+{
+	*count = m_contactManager.m_beginEventCount;
+	return m_contactManager.m_beginEvents;
+}
 
-				cb2Body* other = je->other;
+const cb2ContactEndEvent* cb2World::GetContactEndEvents(int* count) const
+{
+	*count = m_contactManager.m_endEventCount;
+	return m_contactManager.m_endEvents;
+}
 
-				// Don't simulate joints connected to inactive bodies.
-				if (other->IsActive() == false)
-				{
-					continue;
-				}
+const cb2ContactHitEvent* cb2World::GetContactHitEvents(int* count) const
+{
+	*count = m_contactManager.m_hitEventCount;
+	return m_contactManager.m_hitEvents;
+}
 
-				island.Add(je->joint);
-				je->joint->m_islandFlag = true;
+void cb2World::SetHitEventThreshold(float speed)
+{
+	m_contactManager.m_hitEventThreshold = speed;
+}
 
-				if (other->m_flags & cb2Body::e_islandFlag)
-				{
-					continue;
-				}
+float cb2World::GetHitEventThreshold() const
+{
+	return m_contactManager.m_hitEventThreshold;
+}
 
-				cb2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= cb2Body::e_islandFlag;
-			}
+const cb2JointBreakEvent* cb2World::GetJointBreakEvents(int* count) const
+{
+	*count = m_jointBreakEventCount;
+	return m_jointBreakEvents;
+}
+
+void cb2World::PushJointBreak(cb2Joint* joint, const ci::Vec2f& force, float torque)
+{
+	if (m_jointBreakEventCount == m_jointBreakEventCapacity)
+	{
+		cb2JointBreakEvent* oldEvents = m_jointBreakEvents;
+		m_jointBreakEventCapacity = cb2Max(2 * m_jointBreakEventCapacity, 16);
+		m_jointBreakEvents = (cb2JointBreakEvent*)cb2Alloc(m_allocator, m_jointBreakEventCapacity * sizeof(cb2JointBreakEvent));
+		if (oldEvents)
+		{
+			memcpy(m_jointBreakEvents, oldEvents, m_jointBreakEventCount * sizeof(cb2JointBreakEvent));
+			cb2Free(m_allocator, oldEvents);
 		}
+	}
 
-		cb2Profile profile;
-		island.Solve(&profile, step, m_gravity, m_allowSleep);
-		m_profile.solveInit += profile.solveInit;
-		m_profile.solveVelocity += profile.solveVelocity;
-		m_profile.solvePosition += profile.solvePosition;
+	cb2JointBreakEvent* event = m_jointBreakEvents + m_jointBreakEventCount;
+	event->joint = joint->m_handle;
+	event->bodyA = joint->m_bodyA->m_handle;
+	event->bodyB = joint->m_bodyB->m_handle;
+	event->userData = joint->m_userData;
+	event->force = force;
+	event->torque = torque;
+	++m_jointBreakEventCount;
+}
 
-		// Post solve cleanup.
-		for (int i = 0; i < island.m_bodyCount; ++i)
+static bool cb2CompareJointBreaks(const cb2JointBreakEvent& a, const cb2JointBreakEvent& b)
+{
+	return a.joint.index < b.joint.index;
+}
+
+void cb2World::DestroyBrokenJoints()
+{
+	// Islands solved in parallel push their breaks in any order. Destroying the joints
+	// in handle order keeps the island lists the same for any number of threads.
+	std::sort(m_jointBreakEvents, m_jointBreakEvents + m_jointBreakEventCount, cb2CompareJointBreaks);
+
+	for (int i = 0; i < m_jointBreakEventCount; ++i)
+	{
+		cb2Joint* joint = GetJoint(m_jointBreakEvents[i].joint);
+		if (m_destructionListener)
 		{
-			// Allow static bodies to participate in other islands.
-			cb2Body* b = island.m_bodies[i];
-			if (b->GetType() == cb2_staticBody)
-			{
-				b->m_flags &= ~cb2Body::e_islandFlag;
-			}
+			m_destructionListener->SayGoodbye(joint);
 		}
+
+		DestroyJoint(joint);
 	}
+}
 
-	m_stackAllocator.Free(stack);
+// Intrusive island list helpers shared by bodies, contacts and joints.
+template <typename T>
+void cb2World::LinkToIsland(T** list, T* item)
+{
+	item->m_islandPrev = NULL;
+	item->m_islandNext = *list;
+	if (*list)
+	{
+		(*list)->m_islandPrev = item;
+	}
+	*list = item;
+}
 
+template <typename T>
+void cb2World::UnlinkFromIsland(T** list, T* item)
+{
+	if (item->m_islandPrev)
 	{
-		cb2Timer timer;
-		// Synchronize fixtures, check for out of range bodies.
-		for (cb2Body* b = m_bodyList; b; b = b->GetNext())
-		{
-			// If a body was not in an island then it did not move.
-			if ((b->m_flags & cb2Body::e_islandFlag) == 0)
-			{
-				continue;
-			}
+		item->m_islandPrev->m_islandNext = item->m_islandNext;
+	}
 
-			if (b->GetType() == cb2_staticBody)
-			{
-				continue;
-			}
+	if (item->m_islandNext)
+	{
+		item->m_islandNext->m_islandPrev = item->m_islandPrev;
+	}
+
+	if (item == *list)
+	{
+		*list = item->m_islandNext;
+	}
+
+	item->m_island = NULL;
+	item->m_islandPrev = NULL;
+	item->m_islandNext = NULL;
+}
+
+// Move all of other in front of list and retag it.
+template <typename T>
+void cb2World::SpliceIsland(T** list, T* other, cb2PersistentIsland* island)
+{
+	if (other == NULL)
+	{
+		return;
+	}
 
-			// Update fixtures (for broad-phase).
-			b->SynchronizeFixtures();
+	T* tail = other;
+	for (;;)
+	{
+		tail->m_island = island;
+		if (tail->m_islandNext == NULL)
+		{
+			break;
 		}
+		tail = tail->m_islandNext;
+	}
 
-		// Look for new contacts.
-		m_contactManager.FindNewContacts();
-		m_profile.broadphase = timer.GetMilliseconds();
+	tail->m_islandNext = *list;
+	if (*list)
+	{
+		(*list)->m_islandPrev = tail;
 	}
+	*list = other;
 }
 
-// Find TOI contacts and solve them.
-void cb2World::SolveTOI(const cb2TimeStep& step)
+inline void cb2LinkIsland(cb2PersistentIsland** list, cb2PersistentIsland* island)
 {
-	cb2Island island(2 * cb2_maxTOIContacts, cb2_maxTOIContacts, 0, &m_stackAllocator, m_contactManager.m_contactListener);
+	island->prev = NULL;
+	island->next = *list;
+	if (*list)
+	{
+		(*list)->prev = island;
+	}
+	*list = island;
+}
 
-	if (m_stepComplete)
+inline void cb2UnlinkIsland(cb2PersistentIsland** list, cb2PersistentIsland* island)
+{
+	if (island->prev)
 	{
-		for (cb2Body* b = m_bodyList; b; b = b->m_next)
+		island->prev->next = island->next;
+	}
+
+	if (island->next)
+	{
+		island->next->prev = island->prev;
+	}
+
+	if (island == *list)
+	{
+		*list = island->next;
+	}
+
+	island->prev = NULL;
+	island->next = NULL;
+}
+
+cb2PersistentIsland* cb2World::CreateIsland(bool awake)
+{
+	void* mem = m_blockAllocator.Allocate(sizeof(cb2PersistentIsland));
+	cb2PersistentIsland* island = (cb2PersistentIsland*)mem;
+	island->bodyList = NULL;
+	island->contactList = NULL;
+	island->jointList = NULL;
+	island->bodyCount = 0;
+	island->contactCount = 0;
+	island->jointCount = 0;
+	island->constraintRemoveCount = 0;
+	island->awake = awake;
+	island->readyToSleep = false;
+	island->lodLevel = 0;
+	island->lodStepCount = 0;
+	island->lodDt = 0.0f;
+	island->lodSkipped = false;
+
+	cb2LinkIsland(awake ? &m_awakeIslandList : &m_sleepingIslandList, island);
+	return island;
+}
+
+void cb2World::DestroyIsland(cb2PersistentIsland* island)
+{
+	cb2UnlinkIsland(island->awake ? &m_awakeIslandList : &m_sleepingIslandList, island);
+	m_blockAllocator.Free(island, sizeof(cb2PersistentIsland));
+}
+
+// Give a body its own island and link its joints and touching contacts. This also
+// relinks the constraints of a body that just became static.
+void cb2World::AddToIsland(cb2Body* body)
+{
+	cb2Assert(body->m_island == NULL);
+
+	if (body->m_type != cb2_staticBody && body->IsActive())
+	{
+		cb2PersistentIsland* island = CreateIsland(body->IsAwake());
+		LinkToIsland(&island->bodyList, body);
+		body->m_island = island;
+		island->bodyCount = 1;
+	}
+
+	for (cb2JointEdge* je = body->m_jointList; je; je = je->next)
+	{
+		if (je->joint->m_island == NULL)
 		{
-			b->m_flags &= ~cb2Body::e_islandFlag;
-			b->m_sweep.alpha0 = 0.0f;
+			LinkJoint(je->joint);
 		}
+	}
 
-		for (cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	{
+		cb2Contact* contact = ce->contact;
+		if (contact->m_island == NULL && contact->IsTouching() &&
+			contact->m_fixtureA->m_isSensor == false && contact->m_fixtureB->m_isSensor == false)
 		{
-			// Invalidate TOI
-			c->m_flags &= ~(cb2Contact::e_toiFlag | cb2Contact::e_islandFlag);
-			c->m_toiCount = 0;
-			c->m_toi = 1.0f;
+			LinkContact(contact);
 		}
 	}
+}
 
-	// Find TOI events and solve them.
-	for (;;)
+void cb2World::RemoveFromIsland(cb2Body* body)
+{
+	for (cb2JointEdge* je = body->m_jointList; je; je = je->next)
 	{
-		// Find the first TOI.
-		cb2Contact* minContact = NULL;
-		float minAlpha = 1.0f;
+		if (je->joint->m_island)
+		{
+			UnlinkJoint(je->joint);
+		}
+	}
 
-		for (cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	{
+		if (ce->contact->m_island)
 		{
-			// Is this contact disabled?
-			if (c->IsEnabled() == false)
-			{
-				continue;
-			}
+			UnlinkContact(ce->contact);
+		}
+	}
 
-			// Prevent excessive sub-stepping.
-			if (c->m_toiCount > cb2_maxSubSteps)
-			{
-				continue;
-			}
+	cb2PersistentIsland* island = body->m_island;
+	if (island == NULL)
+	{
+		return;
+	}
 
-			float alpha = 1.0f;
-			if (c->m_flags & cb2Contact::e_toiFlag)
-			{
-				// This contact has a valid cached TOI.
-				alpha = c->m_toi;
-			}
-			else
-			{
-				cb2Fixture* fA = c->GetFixtureA();
-				cb2Fixture* fB = c->GetFixtureB();
+	UnlinkFromIsland(&island->bodyList, body);
+	--island->bodyCount;
 
-				// Is there a sensor?
-				if (fA->IsSensor() || fB->IsSensor())
-				{
-					continue;
-				}
+	if (island->bodyCount == 0)
+	{
+		cb2Assert(island->contactCount == 0 && island->jointCount == 0);
+		DestroyIsland(island);
+	}
+	else
+	{
+		++island->constraintRemoveCount;
+	}
+}
 
-				cb2Body* bA = fA->GetBody();
-				cb2Body* bB = fB->GetBody();
+void cb2World::LinkContact(cb2Contact* contact)
+{
+	cb2Assert(contact->m_island == NULL);
+	cb2Body* bodyA = contact->m_fixtureA->m_body;
+	cb2Body* bodyB = contact->m_fixtureB->m_body;
 
-				cb2BodyType typeA = bA->m_type;
-				cb2BodyType typeB = bB->m_type;
-				cb2Assert(typeA == cb2_dynamicBody || typeB == cb2_dynamicBody);
+	cb2PersistentIsland* island = MergeIslands(bodyA->m_island, bodyB->m_island);
+	if (island == NULL)
+	{
+		return;
+	}
 
-				bool activeA = bA->IsAwake() && typeA != cb2_staticBody;
-				bool activeB = bB->IsAwake() && typeB != cb2_staticBody;
+	LinkToIsland(&island->contactList, contact);
+	contact->m_island = island;
+	++island->contactCount;
+}
 
-				// Is at least one body active (awake and dynamic or kinematic)?
-				if (activeA == false && activeB == false)
-				{
-					continue;
-				}
+void cb2World::UnlinkContact(cb2Contact* contact)
+{
+	cb2PersistentIsland* island = contact->m_island;
+	cb2Assert(island != NULL);
 
-				bool collideA = bA->IsBullet() || typeA != cb2_dynamicBody;
-				bool collideB = bB->IsBullet() || typeB != cb2_dynamicBody;
+	UnlinkFromIsland(&island->contactList, contact);
+	--island->contactCount;
+	++island->constraintRemoveCount;
+}
 
-				// Are these two non-bullet dynamic bodies?
-				if (collideA == false && collideB == false)
-				{
-					continue;
-				}
+void cb2World::LinkJoint(cb2Joint* joint)
+{
+	cb2Assert(joint->m_island == NULL);
+	cb2Body* bodyA = joint->m_bodyA;
+	cb2Body* bodyB = joint->m_bodyB;
 
-				// Compute the TOI for this contact.
-				// Put the sweeps onto the same time interval.
-				float alpha0 = bA->m_sweep.alpha0;
+	// Don't simulate joints connected to inactive bodies.
+	if (bodyA->IsActive() == false || bodyB->IsActive() == false)
+	{
+		return;
+	}
 
-				if (bA->m_sweep.alpha0 < bB->m_sweep.alpha0)
-				{
-					alpha0 = bB->m_sweep.alpha0;
-					bA->m_sweep.Advance(alpha0);
-				}
-				else if (bB->m_sweep.alpha0 < bA->m_sweep.alpha0)
-				{
-					alpha0 = bA->m_sweep.alpha0;
-					bB->m_sweep.Advance(alpha0);
-				}
+	cb2PersistentIsland* island = MergeIslands(bodyA->m_island, bodyB->m_island);
+	if (island == NULL)
+	{
+		return;
+	}
 
-				cb2Assert(alpha0 < 1.0f);
+	LinkToIsland(&island->jointList, joint);
+	joint->m_island = island;
+	++island->jointCount;
+}
 
-				int indexA = c->GetChildIndexA();
-				int indexB = c->GetChildIndexB();
+void cb2World::UnlinkJoint(cb2Joint* joint)
+{
+	cb2PersistentIsland* island = joint->m_island;
+	if (island == NULL)
+	{
+		return;
+	}
 
-				// Compute the time of impact in interval [0, minTOI]
-				cb2TOIInput input;
-				input.proxyA.set(fA->GetShape(), indexA);
-				input.proxyB.set(fB->GetShape(), indexB);
-				input.sweepA = bA->m_sweep;
-				input.sweepB = bB->m_sweep;
-				input.tMax = 1.0f;
+	UnlinkFromIsland(&island->jointList, joint);
+	--island->jointCount;
+	++island->constraintRemoveCount;
+}
 
-				cb2TOIOutput output;
-				cb2TimeOfImpact(&output, &input);
+// The smaller island moves into the larger one. The result is awake if either was.
+cb2PersistentIsland* cb2World::MergeIslands(cb2PersistentIsland* islandA, cb2PersistentIsland* islandB)
+{
+	if (islandA == NULL)
+	{
+		return islandB;
+	}
 
-				// Beta is the fraction of the remaining portion of the .
-				float beta = output.t;
-				if (output.state == cb2TOIOutput::e_touching)
-				{
-					alpha = cb2Min(alpha0 + (1.0f - alpha0) * beta, 1.0f);
-				}
-				else
-				{
-					alpha = 1.0f;
-				}
+	if (islandB == NULL || islandA == islandB)
+	{
+		return islandA;
+	}
 
-				c->m_toi = alpha;
-				c->m_flags |= cb2Contact::e_toiFlag;
-			}
+	cb2PersistentIsland* big = islandA;
+	cb2PersistentIsland* small = islandB;
+	if (big->bodyCount < small->bodyCount)
+	{
+		big = islandB;
+		small = islandA;
+	}
 
-			if (alpha < minAlpha)
-			{
-				// This is the minimum TOI found so far.
-				minContact = c;
-				minAlpha = alpha;
-			}
-		}
+	// The bodies of small stay in a row at the front of big.
+	cb2Body* smallBodies = small->bodyList;
+	int smallBodyCount = small->bodyCount;
 
-		if (minContact == NULL || 1.0f - 10.0f * cb2_epsilon < minAlpha)
-		{
-			// No more TOI events. Done!
-			m_stepComplete = true;
-			break;
-		}
+	SpliceIsland(&big->bodyList, small->bodyList, big);
+	SpliceIsland(&big->contactList, small->contactList, big);
+	SpliceIsland(&big->jointList, small->jointList, big);
+	big->bodyCount += small->bodyCount;
+	big->contactCount += small->contactCount;
+	big->jointCount += small->jointCount;
+	big->constraintRemoveCount += small->constraintRemoveCount;
 
-		// Advance the bodies to the TOI.
-		cb2Fixture* fA = minContact->GetFixtureA();
-		cb2Fixture* fB = minContact->GetFixtureB();
-		cb2Body* bA = fA->GetBody();
-		cb2Body* bB = fB->GetBody();
+	bool awake = small->awake;
+	DestroyIsland(small);
 
-		cb2Sweep backup1 = bA->m_sweep;
-		cb2Sweep backup2 = bB->m_sweep;
+	if (awake)
+	{
+		WakeIsland(big, NULL);
+	}
+	else if (big->awake)
+	{
+		// The sleeping bodies wake with the next step, the contacts other sleeping
+		// islands hold to them have to be solved by then.
+		big = AdoptContacts(big, smallBodies, smallBodyCount);
+	}
 
-		bA->Advance(minAlpha);
-		bB->Advance(minAlpha);
+	return big;
+}
 
-		// The TOI contact likely has some new contact points.
-		minContact->Update(m_contactManager.m_contactListener);
-		minContact->m_flags &= ~cb2Contact::e_toiFlag;
-		++minContact->m_toiCount;
+// Rebuild an island from its connected components with a depth first search. The
+// new islands take over the awake state.
+void cb2World::SplitIsland(cb2PersistentIsland* island)
+{
+	int bodyCount = island->bodyCount;
+	bool awake = island->awake;
+	int lodLevel = island->lodLevel;
+	int lodStepCount = island->lodStepCount;
+	float lodDt = island->lodDt;
 
-		// Is the contact solid?
-		if (minContact->IsEnabled() == false || minContact->IsTouching() == false)
+	cb2Body** bodies = (cb2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(cb2Body*));
+	cb2Body** stack = (cb2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(cb2Body*));
+
+	int index = 0;
+	for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+	{
+		b->m_flags &= ~cb2Body::e_islandFlag;
+		bodies[index++] = b;
+	}
+
+	for (cb2Contact* c = island->contactList; c; c = c->m_islandNext)
+	{
+		c->m_flags &= ~cb2Contact::e_islandFlag;
+	}
+
+	for (cb2Joint* j = island->jointList; j; j = j->m_islandNext)
+	{
+		j->m_islandFlag = false;
+	}
+
+	// Everything linked to the old island is still tagged with it, which is all the
+	// search needs to know. Contacts to the bodies of other islands stay with the
+	// part of the body in this one, see cb2SleepDef::wakeHopCount. A part may reuse
+	// the memory of the old island, but what joined a part is flagged.
+	DestroyIsland(island);
+
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		cb2Body* seed = bodies[i];
+		if (seed->m_flags & cb2Body::e_islandFlag)
 		{
-			// Restore the sweeps.
-			minContact->SetEnabled(false);
-			bA->m_sweep = backup1;
-			bB->m_sweep = backup2;
-			bA->SynchronizeTransform();
-			bB->SynchronizeTransform();
 			continue;
 		}
 
-		bA->SetAwake(true);
-		bB->SetAwake(true);
-
-		// Build the island
-		island.Clear();
-		island.Add(bA);
-		island.Add(bB);
-		island.Add(minContact);
+		cb2PersistentIsland* part = CreateIsland(awake);
+		part->lodLevel = lodLevel;
+		part->lodStepCount = lodStepCount;
+		part->lodDt = lodDt;
 
-		bA->m_flags |= cb2Body::e_islandFlag;
-		bB->m_flags |= cb2Body::e_islandFlag;
-		minContact->m_flags |= cb2Contact::e_islandFlag;
+		int stackCount = 0;
+		stack[stackCount++] = seed;
+		seed->m_flags |= cb2Body::e_islandFlag;
 
-		// Get contacts on bodyA and bodyB.
-		cb2Body* bodies[2] = {bA, bB};
-		for (int i = 0; i < 2; ++i)
+		while (stackCount > 0)
 		{
-			cb2Body* body = bodies[i];
-			if (body->m_type == cb2_dynamicBody)
+			cb2Body* b = stack[--stackCount];
+			LinkToIsland(&part->bodyList, b);
+			b->m_island = part;
+			++part->bodyCount;
+
+			for (cb2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
 			{
-				for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+				cb2Contact* contact = ce->contact;
+				if (contact->m_island != island || (contact->m_flags & cb2Contact::e_islandFlag))
 				{
-					if (island.m_bodyCount == island.m_bodyCapacity)
-					{
-						break;
-					}
+					continue;
+				}
 
-					if (island.m_contactCount == island.m_contactCapacity)
-					{
-						break;
-					}
+				contact->m_flags |= cb2Contact::e_islandFlag;
+				LinkToIsland(&part->contactList, contact);
+				contact->m_island = part;
+				++part->contactCount;
 
-					cb2Contact* contact = ce->contact;
+				// Static bodies don't join islands.
+				cb2Body* other = ce->other;
+				if (other->m_island != island || (other->m_flags & cb2Body::e_islandFlag))
+				{
+					continue;
+				}
 
-					// Has this contact already been added to the island?
-					if (contact->m_flags & cb2Contact::e_islandFlag)
-					{
-						continue;
-					}
+				cb2Assert(stackCount < bodyCount);
+				stack[stackCount++] = other;
+				other->m_flags |= cb2Body::e_islandFlag;
+			}
 
-					// Only add static, kinematic, or bullet bodies.
-					cb2Body* other = ce->other;
-					if (other->m_type == cb2_dynamicBody &&
-						body->IsBullet() == false && other->IsBullet() == false)
-					{
-						continue;
-					}
+			for (cb2JointEdge* je = b->m_jointList; je; je = je->next)
+			{
+				cb2Joint* joint = je->joint;
+				if (joint->m_island != island || joint->m_islandFlag)
+				{
+					continue;
+				}
 
-					// Skip sensors.
-					bool sensorA = contact->m_fixtureA->m_isSensor;
-					bool sensorB = contact->m_fixtureB->m_isSensor;
-					if (sensorA || sensorB)
-					{
-						continue;
-					}
+				joint->m_islandFlag = true;
+				LinkToIsland(&part->jointList, joint);
+				joint->m_island = part;
+				++part->jointCount;
 
-					// Tentatively advance the body to the TOI.
-					cb2Sweep backup = other->m_sweep;
-					if ((other->m_flags & cb2Body::e_islandFlag) == 0)
-					{
-						other->Advance(minAlpha);
-					}
+				cb2Body* other = je->other;
+				if (other->m_island != island || (other->m_flags & cb2Body::e_islandFlag))
+				{
+					continue;
+				}
 
-					// Update the contact points
-					contact->Update(m_contactManager.m_contactListener);
+				cb2Assert(stackCount < bodyCount);
+				stack[stackCount++] = other;
+				other->m_flags |= cb2Body::e_islandFlag;
+			}
+		}
+	}
 
-					// Was the contact disabled by the user?
-					if (contact->IsEnabled() == false)
-					{
-						other->m_sweep = backup;
-						other->SynchronizeTransform();
-						continue;
-					}
+	// Leave the flags clear for the next search.
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		cb2Body* b = bodies[i];
+		b->m_flags &= ~cb2Body::e_islandFlag;
 
-					// Are there contact points?
-					if (contact->IsTouching() == false)
-					{
-						other->m_sweep = backup;
-						other->SynchronizeTransform();
-						continue;
-					}
+		for (cb2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+		{
+			ce->contact->m_flags &= ~cb2Contact::e_islandFlag;
+		}
 
-					// Add the contact to the island
-					contact->m_flags |= cb2Contact::e_islandFlag;
-					island.Add(contact);
+		for (cb2JointEdge* je = b->m_jointList; je; je = je->next)
+		{
+			je->joint->m_islandFlag = false;
+		}
+	}
 
-					// Has the other body already been added to the island?
-					if (other->m_flags & cb2Body::e_islandFlag)
-					{
-						continue;
-					}
-					
-					// Add the other body to the island.
-					other->m_flags |= cb2Body::e_islandFlag;
+	m_stackAllocator.Free(stack);
+	m_stackAllocator.Free(bodies);
+}
 
-					if (other->m_type != cb2_staticBody)
-					{
-						other->SetAwake(true);
-					}
+// Wake an island for the seed body, NULL if no body in particular woke it.
+void cb2World::WakeIsland(cb2PersistentIsland* island, cb2Body* seed)
+{
+	if (island->awake)
+	{
+		return;
+	}
 
-					island.Add(other);
+	if (seed && m_sleepDef.wakeHopCount > 0)
+	{
+		WakeRegion(island, seed, m_sleepDef.wakeHopCount);
+		return;
+	}
+
+	// Past its stage the budget wakes only the part near the seed, the wake spreads
+	// over the rest of the island in the next steps.
+	if (seed && m_allowSleep && (m_flags & e_locked) && (UpdateDegradation() & cb2_degradeWake))
+	{
+		WakeRegion(island, seed, m_stepBudget.wakeHopCount);
+		m_flags |= e_spreadWake;
+		++m_profile.deferredWakeCount;
+		return;
+	}
+
+	cb2UnlinkIsland(&m_sleepingIslandList, island);
+	island->awake = true;
+	cb2LinkIsland(&m_awakeIslandList, island);
+
+	// Time spent asleep is not caught up.
+	island->lodStepCount = 0;
+	island->lodDt = 0.0f;
+
+	for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+	{
+		b->SetAwake(true);
+	}
+
+	AdoptContacts(island, island->bodyList, island->bodyCount);
+}
+
+// Wake the bodies within hopCount contacts of the seed. They move
+// to an island of their own, joints take their bodies along without a hop. The
+// rest of the island sleeps on and holds still for the woken part.
+void cb2World::WakeRegion(cb2PersistentIsland* island, cb2Body* seed, int hopCount)
+{
+	cb2Assert(seed->m_island == island);
+	int bodyCount = island->bodyCount;
+
+	cb2Body** queue = (cb2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(cb2Body*));
+	int* hops = (int*)m_stackAllocator.Allocate(bodyCount * sizeof(int));
+
+	cb2PersistentIsland* region = CreateIsland(true);
+	region->lodLevel = island->lodLevel;
+
+	// A body joins the region when it is reached, which also marks it as reached.
+	UnlinkFromIsland(&island->bodyList, seed);
+	LinkToIsland(&region->bodyList, seed);
+	seed->m_island = region;
+
+	int queueCount = 0;
+	queue[queueCount] = seed;
+	hops[queueCount++] = 0;
+
+	for (int i = 0; i < queueCount; ++i)
+	{
+		cb2Body* b = queue[i];
+		int hop = hops[i];
+
+		for (cb2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+		{
+			cb2Contact* contact = ce->contact;
+			if (contact->m_island != island)
+			{
+				continue;
+			}
+
+			// The contacts to the bodies left behind come along.
+			UnlinkFromIsland(&island->contactList, contact);
+			LinkToIsland(&region->contactList, contact);
+			contact->m_island = region;
+			--island->contactCount;
+			++region->contactCount;
+
+			cb2Body* other = ce->other;
+			if (other->m_island == island && hop < hopCount)
+			{
+				cb2Assert(queueCount < bodyCount);
+				UnlinkFromIsland(&island->bodyList, other);
+				LinkToIsland(&region->bodyList, other);
+				other->m_island = region;
+				queue[queueCount] = other;
+				hops[queueCount++] = hop + 1;
+			}
+		}
+
+		for (cb2JointEdge* je = b->m_jointList; je; je = je->next)
+		{
+			cb2Joint* joint = je->joint;
+			if (joint->m_island != island)
+			{
+				continue;
+			}
+
+			UnlinkFromIsland(&island->jointList, joint);
+			LinkToIsland(&region->jointList, joint);
+			joint->m_island = region;
+			--island->jointCount;
+			++region->jointCount;
+
+			cb2Body* other = je->other;
+			if (other->m_island == island)
+			{
+				cb2Assert(queueCount < bodyCount);
+				UnlinkFromIsland(&island->bodyList, other);
+				LinkToIsland(&region->bodyList, other);
+				other->m_island = region;
+				queue[queueCount] = other;
+				hops[queueCount++] = hop;
+			}
+		}
+	}
+
+	m_stackAllocator.Free(hops);
+	m_stackAllocator.Free(queue);
+
+	region->bodyCount = queueCount;
+	island->bodyCount -= queueCount;
+	if (island->bodyCount == 0)
+	{
+		cb2Assert(island->contactCount == 0 && island->jointCount == 0);
+		DestroyIsland(island);
+	}
+	else
+	{
+		// What is left may have fallen apart.
+		++island->constraintRemoveCount;
+	}
+
+	for (cb2Body* b = region->bodyList; b; b = b->m_islandNext)
+	{
+		b->SetAwake(true);
+	}
+
+	AdoptContacts(region, region->bodyList, region->bodyCount);
+}
+
+// An island that woke up takes over the contacts that sleeping islands hold to its
+// bodies, from the given body on, and merges with the awake islands that hold any.
+// Returns the island the bodies end up in.
+cb2PersistentIsland* cb2World::AdoptContacts(cb2PersistentIsland* island, cb2Body* bodies, int count)
+{
+	for (;;)
+	{
+		cb2PersistentIsland* awakeOwner = NULL;
+		cb2Body* b = bodies;
+		for (int i = 0; i < count; ++i, b = b->m_islandNext)
+		{
+			for (cb2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+			{
+				cb2Contact* contact = ce->contact;
+				cb2PersistentIsland* owner = contact->m_island;
+				if (owner == NULL || owner == island)
+				{
+					continue;
+				}
+
+				if (owner->awake)
+				{
+					awakeOwner = owner;
+					continue;
 				}
+
+				UnlinkFromIsland(&owner->contactList, contact);
+				--owner->contactCount;
+				LinkToIsland(&island->contactList, contact);
+				contact->m_island = island;
+				++island->contactCount;
 			}
 		}
 
-		cb2TimeStep subStep;
-		subStep.dt = (1.0f - minAlpha) * step.dt;
-		subStep.inv_dt = 1.0f / subStep.dt;
-		subStep.dtRatio = 1.0f;
-		subStep.positionIterations = 20;
-		subStep.velocityIterations = step.velocityIterations;
-		subStep.warmStarting = false;
-		island.SolveTOI(subStep, bA->m_islandIndex, bB->m_islandIndex);
+		if (awakeOwner == NULL)
+		{
+			return island;
+		}
 
-		// Reset island flags and synchronize broad-phase proxies.
-		for (int i = 0; i < island.m_bodyCount; ++i)
+		// The bodies stay in a row, whichever island is the larger.
+		island = MergeIslands(awakeOwner, island);
+	}
+}
+
+// Wake the sleeping bodies that awake bodies still move against, a further
+// cb2SleepDef::wakeHopCount contacts each step.
+void cb2World::SpreadWake()
+{
+	const float linTolSqr = m_sleepDef.linearTolerance * m_sleepDef.linearTolerance;
+	const float angTolSqr = m_sleepDef.angularTolerance * m_sleepDef.angularTolerance;
+
+	// Waking changes the island lists, the bodies are collected first.
+	cb2Body** sleepers = (cb2Body**)m_stackAllocator.Allocate(m_contactManager.m_contactCount * sizeof(cb2Body*));
+	int sleeperCount = 0;
+
+	for (cb2PersistentIsland* island = m_awakeIslandList; island; island = island->next)
+	{
+		for (cb2Contact* contact = island->contactList; contact; contact = contact->m_islandNext)
 		{
-			cb2Body* body = island.m_bodies[i];
-			body->m_flags &= ~cb2Body::e_islandFlag;
+			cb2Body* mover = contact->m_fixtureA->m_body;
+			cb2Body* sleeper = contact->m_fixtureB->m_body;
+			if (mover->m_island != island)
+			{
+				cb2Swap(mover, sleeper);
+			}
+
+			// Static bodies and the bodies of this island don't wake.
+			if (sleeper->m_island == NULL || sleeper->m_island == island)
+			{
+				continue;
+			}
+
+			float scaleSqr = mover->m_sleepScale * mover->m_sleepScale;
+			float v2 = cb2Dot(mover->m_linearVelocity, mover->m_linearVelocity);
+			float w2 = mover->m_angularVelocity * mover->m_angularVelocity;
+			if (v2 > scaleSqr * linTolSqr || w2 > scaleSqr * angTolSqr)
+			{
+				sleepers[sleeperCount++] = sleeper;
+			}
+		}
+	}
+
+	for (int i = 0; i < sleeperCount; ++i)
+	{
+		sleepers[i]->SetAwake(true);
+	}
+
+	m_stackAllocator.Free(sleepers);
+}
+
+void cb2World::SleepIsland(cb2PersistentIsland* island)
+{
+	if (island->awake == false)
+	{
+		return;
+	}
+
+	cb2UnlinkIsland(&m_awakeIslandList, island);
+	island->awake = false;
+	island->readyToSleep = false;
+	cb2LinkIsland(&m_sleepingIslandList, island);
+
+	for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+	{
+		b->SetAwake(false);
+	}
+
+	// Remember where the contacts fell asleep, see cb2Contact::PrepareManifold.
+	for (cb2Contact* c = island->contactList; c; c = c->m_islandNext)
+	{
+		c->m_relativeXf = cb2MulT(c->m_fixtureA->m_body->m_xf, c->m_fixtureB->m_body->m_xf);
+		c->m_flags &= ~cb2Contact::e_poseFlag;
+		c->m_flags |= cb2Contact::e_sleepPoseFlag;
+	}
+}
+
+// A contiguous slice of the island arrays gathered by cb2World::Solve.
+struct cb2IslandRange
+{
+	cb2PersistentIsland* island;
+
+	int bodyStart;
+	int bodyCount;
+	int contactStart;
+	int contactCount;
+	int jointStart;
+	int jointCount;
+
+	cb2TimeStep step;
+	cb2Profile profile;
+	bool readyToSleep;
+
+	// Large islands are left out of the task and graph colored afterwards.
+	bool colored;
+};
+
+struct cb2FixtureSyncContext
+{
+	cb2Body** bodies;
+	ci::Vec2f* displacements;
+};
+
+struct cb2IslandSolveContext
+{
+	ci::Vec2f gravity;
+	const cb2SleepDef* sleepDef;
+
+	cb2Body** bodies;
+	cb2Contact** contacts;
+	cb2Joint** joints;
+	cb2IslandRange* ranges;
+
+	cb2StackAllocator* threadStacks;
+	int threadStackCount;
+	cb2Mutex lock;
+};
+
+struct cb2ControllerQueryWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		world->AddControllerProxy(proxy, controller, batch);
+		return true;
+	}
+
+	cb2World* world;
+	const cb2Controller* controller;
+	cb2ControllerBatch* batch;
+};
+
+void cb2World::AddControllerProxy(const cb2FixtureProxy* proxy, const cb2Controller* controller, cb2ControllerBatch* batch)
+{
+	const cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	cb2Fixture* fixture = proxy->fixture;
+
+	// A fixture with several proxies is added for the first one in the region.
+	for (int i = 0; fixture->m_proxies + i != proxy; ++i)
+	{
+		if (cb2TestOverlap(fixture->GetProxyFatAABB(broadPhase, i), controller->m_region))
+		{
+			return;
+		}
+	}
+
+	AddControllerFixture(fixture, controller, batch);
+}
+
+// A body's island index is its slot in the batch. It is only valid if the slot holds
+// the body, so the indices need no reset, and the island solve assigns them again.
+void cb2World::AddControllerFixture(cb2Fixture* fixture, const cb2Controller* controller, cb2ControllerBatch* batch)
+{
+	cb2Body* body = fixture->m_body;
+	if (body->m_type != cb2_dynamicBody || body->IsAwake() == false ||
+		(fixture->m_filter.categoryBits & controller->m_maskBits) == 0)
+	{
+		return;
+	}
+
+	int index = body->m_islandIndex;
+	if (index < 0 || index >= batch->bodyCount || batch->bodies[index] != body)
+	{
+		index = batch->bodyCount++;
+		batch->bodies[index] = body;
+		body->m_islandIndex = index;
+	}
+
+	batch->fixtures[batch->fixtureCount] = fixture;
+	batch->fixtureBodies[batch->fixtureCount] = index;
+	++batch->fixtureCount;
+}
+
+void cb2World::GatherControllerBatch(const cb2Controller* controller, cb2ControllerBatch* batch)
+{
+	batch->bodyCount = 0;
+	batch->fixtureCount = 0;
+
+	if (controller->m_useRegion)
+	{
+		cb2ControllerQueryWrapper wrapper;
+		wrapper.world = this;
+		wrapper.controller = controller;
+		wrapper.batch = batch;
+		cb2QueryMovingFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, controller->m_region, controller->m_maskBits);
+	}
+	else
+	{
+		for (cb2PersistentIsland* island = m_awakeIslandList; island; island = island->next)
+		{
+			for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+			{
+				for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+				{
+					AddControllerFixture(f, controller, batch);
+				}
+			}
+		}
+	}
+
+	// Load the body state into the arrays the force fields are evaluated on.
+	for (int i = 0; i < batch->bodyCount; ++i)
+	{
+		const cb2Body* b = batch->bodies[i];
+		batch->centerX[i] = b->m_sweep.c.x;
+		batch->centerY[i] = b->m_sweep.c.y;
+		batch->velocityX[i] = b->m_linearVelocity.x;
+		batch->velocityY[i] = b->m_linearVelocity.y;
+		batch->angularVelocity[i] = b->m_angularVelocity;
+		batch->mass[i] = b->m_mass;
+		batch->inertia[i] = b->m_I;
+		batch->forceX[i] = 0.0f;
+		batch->forceY[i] = 0.0f;
+		batch->torque[i] = 0.0f;
+	}
+}
+
+void cb2World::ApplyControllers(const cb2TimeStep& step)
+{
+	if (m_controllerList == NULL)
+	{
+		return;
+	}
+
+	CB2_TRACE_ZONE_COUNT("ApplyControllers", m_controllerCount);
+
+	// Every fixture of an active body has a proxy, so the proxy count bounds both
+	// the fixtures and the bodies of a batch.
+	int capacity = cb2Max(m_contactManager.m_broadPhase.GetProxyCount(), 1);
+	int bodyCapacity = cb2Max(cb2Min(capacity, m_bodyCount), 1);
+
+	cb2ControllerBatch batch;
+	batch.gravity = m_gravity;
+	batch.dt = step.dt;
+	batch.allocator = &m_stackAllocator;
+	batch.bodies = (cb2Body**)m_stackAllocator.Allocate(bodyCapacity * sizeof(cb2Body*));
+	batch.fixtures = (cb2Fixture**)m_stackAllocator.Allocate(capacity * sizeof(cb2Fixture*));
+	batch.fixtureBodies = (int*)m_stackAllocator.Allocate(capacity * sizeof(int));
+
+	const int stateCount = 10;
+	float* state = (float*)m_stackAllocator.Allocate(stateCount * bodyCapacity * sizeof(float));
+	batch.centerX = state;
+	batch.centerY = state + bodyCapacity;
+	batch.velocityX = state + 2 * bodyCapacity;
+	batch.velocityY = state + 3 * bodyCapacity;
+	batch.angularVelocity = state + 4 * bodyCapacity;
+	batch.mass = state + 5 * bodyCapacity;
+	batch.inertia = state + 6 * bodyCapacity;
+	batch.forceX = state + 7 * bodyCapacity;
+	batch.forceY = state + 8 * bodyCapacity;
+	batch.torque = state + 9 * bodyCapacity;
+
+	for (cb2Controller* c = m_controllerList; c; c = c->m_next)
+	{
+		GatherControllerBatch(c, &batch);
+		if (batch.bodyCount == 0)
+		{
+			continue;
+		}
+
+		c->Apply(&batch);
+
+		// The bodies are awake already, so the forces are added without ApplyForce.
+		for (int i = 0; i < batch.bodyCount; ++i)
+		{
+			cb2Body* b = batch.bodies[i];
+			b->m_force.x += batch.forceX[i];
+			b->m_force.y += batch.forceY[i];
+			b->m_torque += batch.torque[i];
+		}
+	}
+
+	m_stackAllocator.Free(state);
+	m_stackAllocator.Free(batch.fixtureBodies);
+	m_stackAllocator.Free(batch.fixtures);
+	m_stackAllocator.Free(batch.bodies);
+}
+
+// Integrate and solve the awake islands, solve position constraints
+// Find the detail level of an awake island and whether it is solved this step.
+// Islands that sat out steps are solved with the time step they skipped, the time
+// step ratio then follows their own last solve.
+bool cb2World::UpdateLod(cb2PersistentIsland* island, const cb2TimeStep& step, cb2TimeStep* islandStep)
+{
+	int level = 0;
+	if (m_lodListener)
+	{
+		level = cb2_maxLodLevels - 1;
+		for (cb2Body* b = island->bodyList; b && level > 0; b = b->m_islandNext)
+		{
+			int bodyLevel = m_lodListener->GetLodLevel(b);
+			cb2Assert(0 <= bodyLevel && bodyLevel < cb2_maxLodLevels);
+			level = cb2Min(level, bodyLevel);
+		}
+	}
+
+	const cb2LodDef& def = m_lodDefs[level];
+	island->lodLevel = level;
+	island->lodSkipped = ++island->lodStepCount < def.stepInterval;
+	if (island->lodSkipped)
+	{
+		// The bodies hold still, so the TOI sweeps don't take them back.
+		for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+		{
+			b->m_sweep.c0 = b->m_sweep.c;
+			b->m_sweep.a0 = b->m_sweep.a;
+		}
+		return false;
+	}
+
+	if (island->lodStepCount > 1 || island->lodDt > 0.0f)
+	{
+		islandStep->dt = step.dt * island->lodStepCount;
+		islandStep->inv_dt = 1.0f / islandStep->dt;
+		islandStep->dtRatio = island->lodDt > 0.0f ? islandStep->dt / island->lodDt : step.dtRatio * island->lodStepCount;
+	}
+	island->lodDt = island->lodStepCount > 1 ? islandStep->dt : 0.0f;
+	island->lodStepCount = 0;
+
+	if (def.velocityIterations > 0)
+	{
+		islandStep->velocityIterations = def.velocityIterations;
+	}
+	if (def.positionIterations > 0)
+	{
+		islandStep->positionIterations = def.positionIterations;
+	}
+	return true;
+}
+
+// Mark the stages of the step budget the step has reached and return them.
+int cb2World::UpdateDegradation()
+{
+	if (m_stepBudget.milliseconds > 0.0f)
+	{
+		float fraction = m_stepTimer.GetMilliseconds() / m_stepBudget.milliseconds;
+		if (fraction >= m_stepBudget.iterationFraction)
+		{
+			m_profile.degradation |= cb2_degradeIterations;
+		}
+		if (fraction >= m_stepBudget.continuousFraction)
+		{
+			m_profile.degradation |= cb2_degradeContinuous;
+		}
+		if (fraction >= m_stepBudget.wakeFraction)
+		{
+			m_profile.degradation |= cb2_degradeWake;
+		}
+	}
+	return m_profile.degradation;
+}
+
+void cb2World::Solve(const cb2TimeStep& step)
+{
+	CB2_TRACE_ZONE("Solve");
+
+	m_profile.solveInit = 0.0f;
+	m_profile.solveVelocity = 0.0f;
+	m_profile.solvePosition = 0.0f;
+
+	// A wake the budget cut short spreads on as well.
+	if (m_allowSleep && (m_sleepDef.wakeHopCount > 0 || (m_flags & e_spreadWake)))
+	{
+		m_flags &= ~e_spreadWake;
+		SpreadWake();
+	}
+
+	// Size the island for the worst case.
+	cb2Island island(m_bodyCount,
+					m_contactManager.m_contactCount,
+					m_jointCount,
+					&m_stackAllocator,
+					m_contactManager.m_contactListener);
+
+	// With a task scheduler the islands are gathered first and solved together.
+	// Static bodies may appear in many islands, hence the larger body array.
+	cb2Body** islandBodies = NULL;
+	cb2Contact** islandContacts = NULL;
+	cb2Joint** islandJoints = NULL;
+	cb2IslandRange* islandRanges = NULL;
+	int islandCount = 0;
+	int islandBodyCount = 0;
+	int islandContactCount = 0;
+	int islandJointCount = 0;
+	if (m_taskScheduler)
+	{
+		int contactCount = m_contactManager.m_contactCount;
+		islandBodies = (cb2Body**)m_stackAllocator.Allocate((m_bodyCount + contactCount + m_jointCount) * sizeof(cb2Body*));
+		islandContacts = (cb2Contact**)m_stackAllocator.Allocate(contactCount * sizeof(cb2Contact*));
+		islandJoints = (cb2Joint**)m_stackAllocator.Allocate(m_jointCount * sizeof(cb2Joint*));
+		islandRanges = (cb2IslandRange*)m_stackAllocator.Allocate(m_bodyCount * sizeof(cb2IslandRange));
+	}
+
+	cb2PersistentIsland* persistent = m_awakeIslandList;
+	while (persistent)
+	{
+		cb2PersistentIsland* next = persistent->next;
+
+		// Bodies put to sleep by the user take the island with them once all are asleep.
+		bool awake = false;
+		for (cb2Body* b = persistent->bodyList; b && awake == false; b = b->m_islandNext)
+		{
+			awake = b->IsAwake();
+		}
+
+		if (awake == false)
+		{
+			SleepIsland(persistent);
+			persistent = next;
+			continue;
+		}
+
+		persistent->readyToSleep = false;
+
+		// Islands at a reduced detail level sit out most steps and then catch up.
+		cb2TimeStep islandStep = step;
+		if (UpdateLod(persistent, step, &islandStep) == false)
+		{
+			++m_profile.lodSkipCount;
+			persistent = next;
+			continue;
+		}
+
+		// Past its stage the budget caps the iterations of the islands still to come.
+		if (UpdateDegradation() & cb2_degradeIterations)
+		{
+			islandStep.velocityIterations = cb2Min(islandStep.velocityIterations, m_stepBudget.velocityIterations);
+			islandStep.positionIterations = cb2Min(islandStep.positionIterations, m_stepBudget.positionIterations);
+			if (islandStep.subStepCount > 0)
+			{
+				islandStep.subStepCount = cb2Min(islandStep.subStepCount, m_stepBudget.velocityIterations);
+			}
+			++m_profile.degradedIslandCount;
+		}
+
+		++m_profile.islandCount;
+		m_profile.awakeBodyCount += persistent->bodyCount;
+		m_profile.largestIsland = cb2Max(m_profile.largestIsland, persistent->bodyCount);
+
+		// Gather the island. Static bodies are added once for each island they touch,
+		// like the sleeping bodies of other islands, which stay asleep and hold still.
+		island.Clear();
+
+		unsigned short discreteFlag = m_lodDefs[persistent->lodLevel].continuous ? 0 : cb2Body::e_discreteFlag;
+		for (cb2Body* b = persistent->bodyList; b; b = b->m_islandNext)
+		{
+			cb2Assert(b->IsActive() == true);
+			island.Add(b);
+
+			// Make sure the body is awake.
+			b->SetAwake(true);
+			b->m_flags = (b->m_flags & ~cb2Body::e_discreteFlag) | discreteFlag;
+		}
+
+		for (cb2Contact* contact = persistent->contactList; contact; contact = contact->m_islandNext)
+		{
+			// The island only holds solid touching contacts, but the user can disable
+			// a contact for this step.
+			if (contact->IsEnabled() == false)
+			{
+				continue;
+			}
+
+			island.Add(contact);
+
+			cb2Body* bodies[2] = { contact->m_fixtureA->m_body, contact->m_fixtureB->m_body };
+			for (int i = 0; i < 2; ++i)
+			{
+				cb2Body* b = bodies[i];
+				if (b->m_island != persistent && (b->m_flags & cb2Body::e_islandFlag) == 0)
+				{
+					b->m_flags |= cb2Body::e_islandFlag;
+					island.Add(b);
+					if (b->m_type == cb2_staticBody)
+					{
+						b->SetAwake(true);
+					}
+				}
+			}
+		}
+
+		for (cb2Joint* joint = persistent->jointList; joint; joint = joint->m_islandNext)
+		{
+			island.Add(joint);
+
+			cb2Body* bodies[2] = { joint->m_bodyA, joint->m_bodyB };
+			for (int i = 0; i < 2; ++i)
+			{
+				cb2Body* b = bodies[i];
+				if (b->m_type == cb2_staticBody && (b->m_flags & cb2Body::e_islandFlag) == 0)
+				{
+					b->m_flags |= cb2Body::e_islandFlag;
+					island.Add(b);
+					b->SetAwake(true);
+				}
+			}
+		}
+
+		if (m_taskScheduler)
+		{
+			cb2IslandRange* range = islandRanges + islandCount++;
+			range->island = persistent;
+			range->step = islandStep;
+			range->bodyStart = islandBodyCount;
+			range->bodyCount = island.m_bodyCount;
+			range->contactStart = islandContactCount;
+			range->contactCount = island.m_contactCount;
+			range->jointStart = islandJointCount;
+			range->jointCount = island.m_jointCount;
+
+			memcpy(islandBodies + islandBodyCount, island.m_bodies, island.m_bodyCount * sizeof(cb2Body*));
+			memcpy(islandContacts + islandContactCount, island.m_contacts, island.m_contactCount * sizeof(cb2Contact*));
+			memcpy(islandJoints + islandJointCount, island.m_joints, island.m_jointCount * sizeof(cb2Joint*));
+			islandBodyCount += island.m_bodyCount;
+			islandContactCount += island.m_contactCount;
+			islandJointCount += island.m_jointCount;
+		}
+		else
+		{
+			cb2Profile profile;
+			island.Solve(&profile, islandStep, m_gravity, m_allowSleep ? &m_sleepDef : NULL);
+			persistent->readyToSleep = island.m_readyToSleep;
+			m_profile.solveInit += profile.solveInit;
+			m_profile.solveVelocity += profile.solveVelocity;
+			m_profile.solvePosition += profile.solvePosition;
+		}
+
+		// Post solve cleanup.
+		for (int i = 0; i < island.m_bodyCount; ++i)
+		{
+			// Allow static bodies to participate in other islands.
+			cb2Body* b = island.m_bodies[i];
+			if (b->m_island != persistent)
+			{
+				b->m_flags &= ~cb2Body::e_islandFlag;
+			}
+		}
+
+		persistent = next;
+	}
+
+	if (m_taskScheduler)
+	{
+		SolveIslands(islandBodies, islandContacts, islandJoints, islandRanges, islandCount);
+
+		m_stackAllocator.Free(islandRanges);
+		m_stackAllocator.Free(islandJoints);
+		m_stackAllocator.Free(islandContacts);
+		m_stackAllocator.Free(islandBodies);
+	}
+
+	{
+		CB2_TRACE_ZONE("Broadphase");
+		cb2Timer timer;
+
+		// With a task scheduler the swept AABBs are computed in parallel first, the
+		// broad-phase is then updated serially below.
+		cb2FixtureSyncContext syncContext;
+		syncContext.bodies = NULL;
+		syncContext.displacements = NULL;
+		int syncCount = 0;
+		if (m_taskScheduler)
+		{
+			for (persistent = m_awakeIslandList; persistent; persistent = persistent->next)
+			{
+				syncCount += persistent->lodSkipped ? 0 : persistent->bodyCount;
+			}
+		}
+
+		if (syncCount > 64)
+		{
+			syncContext.bodies = (cb2Body**)m_stackAllocator.Allocate(syncCount * sizeof(cb2Body*));
+			syncContext.displacements = (ci::Vec2f*)m_stackAllocator.Allocate(syncCount * sizeof(ci::Vec2f));
+
+			int bodyIndex = 0;
+			for (persistent = m_awakeIslandList; persistent; persistent = persistent->next)
+			{
+				if (persistent->lodSkipped)
+				{
+					continue;
+				}
+
+				for (cb2Body* b = persistent->bodyList; b; b = b->m_islandNext)
+				{
+					syncContext.bodies[bodyIndex++] = b;
+				}
+			}
+			cb2Assert(bodyIndex == syncCount);
+
+			void* group = m_stepScheduler.EnqueueRange(ComputeFixtureAABBsTask, &syncContext, syncCount, 32);
+			m_stepScheduler.Wait(group);
+		}
+
+		// Synchronize fixtures of the bodies that were solved and put islands to sleep.
+		// An island that lost constraints may have fallen apart. If one of its bodies
+		// could sleep on its own the island is split so the pieces can sleep separately.
+		// Only the sleepiest such island is split each step.
+		cb2PersistentIsland* splitIsland = NULL;
+		float splitSleepTime = m_sleepDef.timeToSleep;
+
+		int bodyIndex = 0;
+		persistent = m_awakeIslandList;
+		while (persistent)
+		{
+			cb2PersistentIsland* next = persistent->next;
+			if (persistent->lodSkipped)
+			{
+				persistent = next;
+				continue;
+			}
+
+			float maxSleepTime = 0.0f;
+			for (cb2Body* b = persistent->bodyList; b; b = b->m_islandNext)
+			{
+				// Update fixtures (for broad-phase).
+				if (syncContext.bodies)
+				{
+					cb2Assert(syncContext.bodies[bodyIndex] == b);
+					b->MoveFixtureProxies(syncContext.displacements[bodyIndex++]);
+				}
+				else
+				{
+					b->SynchronizeFixtures();
+				}
+				maxSleepTime = cb2Max(maxSleepTime, b->m_sleepTime);
+			}
+
+			if (persistent->readyToSleep)
+			{
+				// The bodies are already asleep, the pieces are found right away so they
+				// wake up separately.
+				SleepIsland(persistent);
+				if (persistent->constraintRemoveCount > 0)
+				{
+					SplitIsland(persistent);
+				}
+			}
+			else if (persistent->constraintRemoveCount > 0 && maxSleepTime >= splitSleepTime)
+			{
+				splitIsland = persistent;
+				splitSleepTime = maxSleepTime;
+			}
+
+			persistent = next;
+		}
+
+		if (syncContext.bodies)
+		{
+			m_stackAllocator.Free(syncContext.displacements);
+			m_stackAllocator.Free(syncContext.bodies);
+		}
+
+		if (splitIsland)
+		{
+			SplitIsland(splitIsland);
+		}
+
+		m_profile.synchronizeFixtures = timer.GetMilliseconds();
+
+		// Look for new contacts.
+		cb2Timer pairTimer;
+		m_contactManager.FindNewContacts();
+		m_profile.updatePairs += pairTimer.GetMilliseconds();
+		m_profile.broadphase = timer.GetMilliseconds();
+	}
+}
+
+static void cb2SolveIslandRange(cb2IslandSolveContext* solveContext, cb2IslandRange* range,
+								cb2StackAllocator* allocator, cb2TaskScheduler* taskScheduler)
+{
+	// No listener, contacts are reported on the calling thread afterwards.
+	cb2Island island(range->bodyCount, range->contactCount, range->jointCount, allocator, NULL);
+	island.m_sharedLock = &solveContext->lock;
+	island.m_taskScheduler = taskScheduler;
+
+	// Don't use cb2Island::Add, the island indices are claimed under the lock.
+	memcpy(island.m_bodies, solveContext->bodies + range->bodyStart, range->bodyCount * sizeof(cb2Body*));
+	memcpy(island.m_contacts, solveContext->contacts + range->contactStart, range->contactCount * sizeof(cb2Contact*));
+	memcpy(island.m_joints, solveContext->joints + range->jointStart, range->jointCount * sizeof(cb2Joint*));
+	island.m_bodyCount = range->bodyCount;
+	island.m_contactCount = range->contactCount;
+	island.m_jointCount = range->jointCount;
+
+	island.Solve(&range->profile, range->step, solveContext->gravity, solveContext->sleepDef);
+	range->readyToSleep = island.m_readyToSleep;
+}
+
+static void cb2SolveIslandTask(void* context, int begin, int end, int threadIndex)
+{
+	cb2IslandSolveContext* solveContext = (cb2IslandSolveContext*)context;
+	cb2Assert(0 <= threadIndex && threadIndex < solveContext->threadStackCount);
+	cb2StackAllocator* allocator = solveContext->threadStacks + threadIndex;
+
+	for (int i = begin; i < end; ++i)
+	{
+		cb2IslandRange* range = solveContext->ranges + i;
+		if (range->colored == false)
+		{
+			cb2SolveIslandRange(solveContext, range, allocator, NULL);
+		}
+	}
+}
+
+// Solve the gathered islands on the task scheduler, then report contacts and
+// apply sleep in island order, just like the serial path.
+void cb2World::SolveIslands(cb2Body** bodies, cb2Contact** contacts, cb2Joint** joints,
+							cb2IslandRange* ranges, int islandCount)
+{
+	cb2IslandSolveContext context;
+	context.gravity = m_gravity;
+	context.sleepDef = m_allowSleep ? &m_sleepDef : NULL;
+	context.bodies = bodies;
+	context.contacts = contacts;
+	context.joints = joints;
+	context.ranges = ranges;
+	context.threadStacks = m_threadStacks;
+	context.threadStackCount = m_threadStackCount;
+
+	for (int i = 0; i < islandCount; ++i)
+	{
+		cb2IslandRange* range = ranges + i;
+		range->colored = m_threadStackCount > 1 && range->contactCount + range->jointCount >= cb2_graphColoringThreshold;
+	}
+
+	void* group = m_stepScheduler.EnqueueRange(cb2SolveIslandTask, &context, islandCount, 1);
+	m_stepScheduler.Wait(group);
+
+	// The large islands get the scheduler to themselves, one after the other.
+	for (int i = 0; i < islandCount; ++i)
+	{
+		if (ranges[i].colored)
+		{
+			cb2SolveIslandRange(&context, ranges + i, m_threadStacks, &m_stepScheduler);
+		}
+	}
+
+	cb2ContactListener* listener = m_contactManager.m_contactListener;
+	for (int i = 0; i < islandCount; ++i)
+	{
+		const cb2IslandRange* range = ranges + i;
+		m_profile.solveInit += range->profile.solveInit;
+		m_profile.solveVelocity += range->profile.solveVelocity;
+		m_profile.solvePosition += range->profile.solvePosition;
+
+		// The solver stored the impulses in the manifolds.
+		if (listener)
+		{
+			for (int j = 0; j < range->contactCount; ++j)
+			{
+				cb2Contact* c = contacts[range->contactStart + j];
+				const cb2Manifold* manifold = c->GetManifold();
+
+				cb2ContactImpulse impulse;
+				impulse.count = manifold->pointCount;
+				for (int k = 0; k < manifold->pointCount; ++k)
+				{
+					impulse.normalImpulses[k] = manifold->points[k].normalImpulse;
+					impulse.tangentImpulses[k] = manifold->points[k].tangentImpulse;
+				}
+
+				listener->PostSolve(c, &impulse);
+			}
+		}
+
+		range->island->readyToSleep = range->readyToSleep;
+		for (int j = 0; j < range->bodyCount; ++j)
+		{
+			cb2Body* b = bodies[range->bodyStart + j];
+			if (range->readyToSleep)
+			{
+				b->SetAwake(false);
+			}
+			else if (b->GetType() == cb2_staticBody)
+			{
+				// A static body takes the state of the last island it was in.
+				b->SetAwake(true);
+			}
+		}
+	}
+}
+
+// A pending TOI event. The TOI count of the contact is recorded so that the
+// event goes stale once the contact has been handled. Events at the same alpha
+// are ordered by the broad-phase proxies and children of the contact, so the
+// order of ties does not depend on how the standard library builds its heaps.
+struct cb2TOIEvent
+{
+	float alpha;
+	int proxyIdA;
+	int proxyIdB;
+	cb2Contact* contact;
+	int toiCount;
+};
+
+// Heap order, the earliest event is on top.
+static inline bool cb2TOIEventLater(const cb2TOIEvent& a, const cb2TOIEvent& b)
+{
+	if (a.alpha != b.alpha)
+	{
+		return a.alpha > b.alpha;
+	}
+
+	if (a.proxyIdA != b.proxyIdA)
+	{
+		return a.proxyIdA > b.proxyIdA;
+	}
+
+	if (a.proxyIdB != b.proxyIdB)
+	{
+		return a.proxyIdB > b.proxyIdB;
+	}
+
+	// The edges of a chain with an edge tree or a heightfield share a proxy.
+	if (a.contact->GetChildIndexA() != b.contact->GetChildIndexA())
+	{
+		return a.contact->GetChildIndexA() > b.contact->GetChildIndexA();
+	}
+
+	return a.contact->GetChildIndexB() > b.contact->GetChildIndexB();
+}
+
+bool cb2World::IsBulletContact(cb2Contact* c)
+{
+	return c->m_fixtureA->m_body->IsBullet() || c->m_fixtureB->m_body->IsBullet();
+}
+
+bool cb2World::IsTOICandidate(cb2Contact* c)
+{
+	// Is this contact disabled?
+	if (c->IsEnabled() == false)
+	{
+		return false;
+	}
+
+	// Prevent excessive sub-stepping.
+	if (c->m_toiCount > cb2_maxSubSteps)
+	{
+		return false;
+	}
+
+	cb2Fixture* fA = c->GetFixtureA();
+	cb2Fixture* fB = c->GetFixtureB();
+
+	// Is there a sensor?
+	if (fA->IsSensor() || fB->IsSensor())
+	{
+		return false;
+	}
+
+	return IsTOIBodyPair(fA->GetBody(), fB->GetBody());
+}
+
+// The part of IsTOICandidate that only looks at the bodies. The walks over the awake
+// array test it first, with the bodies of the array entries, so most contacts are
+// rejected without loading them.
+bool cb2World::IsTOIBodyPair(const cb2Body* bA, const cb2Body* bB)
+{
+	cb2BodyType typeA = bA->m_type;
+	cb2BodyType typeB = bB->m_type;
+	cb2Assert(typeA == cb2_dynamicBody || typeB == cb2_dynamicBody);
+
+	// Bodies at a detail level without continuous collision count as inactive.
+	bool activeA = bA->IsAwake() && typeA != cb2_staticBody && (bA->m_flags & cb2Body::e_discreteFlag) == 0;
+	bool activeB = bB->IsAwake() && typeB != cb2_staticBody && (bB->m_flags & cb2Body::e_discreteFlag) == 0;
+
+	// Is at least one body active (awake and dynamic or kinematic)?
+	if (activeA == false && activeB == false)
+	{
+		return false;
+	}
+
+	bool collideA = bA->IsBullet() || typeA != cb2_dynamicBody;
+	bool collideB = bB->IsBullet() || typeB != cb2_dynamicBody;
+
+	// Are these two non-bullet dynamic bodies?
+	if (collideA == false && collideB == false)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// Compute the TOI of a candidate contact and cache it. This only writes to the
+// contact, so the initial pass can run on the task scheduler. Returns the root
+// finder iterations for the profile.
+int cb2World::ComputeTOI(cb2Contact* c)
+{
+	cb2Fixture* fA = c->GetFixtureA();
+	cb2Fixture* fB = c->GetFixtureB();
+	cb2Body* bA = fA->GetBody();
+	cb2Body* bB = fB->GetBody();
+
+	// Put the sweeps onto the same time interval. The bodies are shared with
+	// other contacts, so advance copies.
+	cb2Sweep sweepA = bA->m_sweep;
+	cb2Sweep sweepB = bB->m_sweep;
+	float alpha0 = sweepA.alpha0;
+
+	if (sweepA.alpha0 < sweepB.alpha0)
+	{
+		alpha0 = sweepB.alpha0;
+		sweepA.Advance(alpha0);
+	}
+	else if (sweepB.alpha0 < sweepA.alpha0)
+	{
+		alpha0 = sweepA.alpha0;
+		sweepB.Advance(alpha0);
+	}
+
+	cb2Assert(alpha0 < 1.0f);
+
+	int indexA = c->GetChildIndexA();
+	int indexB = c->GetChildIndexB();
+
+	// Compute the time of impact in interval [0, minTOI]
+	cb2TOIInput input;
+	input.proxyA.set(fA->GetShape(), indexA);
+	input.proxyB.set(fB->GetShape(), indexB);
+	input.sweepA = sweepA;
+	input.sweepB = sweepB;
+	input.tMax = 1.0f;
+
+	// The contact keeps the simplex, neighboring steps tend to end on the same features.
+	cb2TOIOutput output;
+	cb2TimeOfImpact(&output, &input, &c->m_simplexCache);
+
+	// Beta is the fraction of the remaining portion of the .
+	float beta = output.t;
+	float alpha;
+	if (output.state == cb2TOIOutput::e_touching)
+	{
+		alpha = cb2Min(alpha0 + (1.0f - alpha0) * beta, 1.0f);
+	}
+	else
+	{
+		alpha = 1.0f;
+	}
+
+	c->m_toi = alpha;
+	c->m_flags |= cb2Contact::e_toiFlag;
+	return output.iterations;
+}
+
+struct cb2TOIContext
+{
+	cb2Contact** contacts;
+	cb2Mutex lock;
+	int iterations;
+};
+
+void cb2World::ComputeTOITask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+
+	CB2_TRACE_ZONE_COUNT("ComputeTOITask", end - begin);
+
+	cb2TOIContext* toiContext = (cb2TOIContext*)context;
+	int iterations = 0;
+	for (int i = begin; i < end; ++i)
+	{
+		iterations += ComputeTOI(toiContext->contacts[i]);
+	}
+
+	toiContext->lock.Lock();
+	toiContext->iterations += iterations;
+	toiContext->lock.Unlock();
+}
+
+void cb2World::ComputeFixtureAABBsTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	CB2_TRACE_ZONE_COUNT("ComputeFixtureAABBsTask", end - begin);
+
+	cb2FixtureSyncContext* syncContext = (cb2FixtureSyncContext*)context;
+	for (int i = begin; i < end; ++i)
+	{
+		syncContext->displacements[i] = syncContext->bodies[i]->ComputeFixtureAABBs();
+	}
+}
+
+void cb2World::GrowTOIEvents(int capacity)
+{
+	cb2TOIEvent* oldEvents = m_toiEvents;
+	m_toiEventCapacity = capacity;
+	m_toiEvents = (cb2TOIEvent*)cb2Alloc(m_allocator, m_toiEventCapacity * sizeof(cb2TOIEvent));
+	if (oldEvents)
+	{
+		memcpy(m_toiEvents, oldEvents, m_toiEventCount * sizeof(cb2TOIEvent));
+		cb2Free(m_allocator, oldEvents);
+	}
+}
+
+void cb2World::PushTOIEvent(cb2Contact* contact)
+{
+	cb2Assert(contact->m_flags & cb2Contact::e_toiFlag);
+
+	if (contact->m_toi >= 1.0f)
+	{
+		return;
+	}
+
+	if (m_toiEventCount == m_toiEventCapacity)
+	{
+		GrowTOIEvents(cb2Max(2 * m_toiEventCapacity, 64));
+	}
+
+	cb2TOIEvent* event = m_toiEvents + m_toiEventCount;
+	event->alpha = contact->m_toi;
+	event->proxyIdA = contact->m_fixtureA->m_proxies[contact->m_fixtureA->GetProxyIndex(contact->m_indexA)].proxyId;
+	event->proxyIdB = contact->m_fixtureB->m_proxies[contact->m_fixtureB->GetProxyIndex(contact->m_indexB)].proxyId;
+	event->contact = contact;
+	event->toiCount = contact->m_toiCount;
+	++m_toiEventCount;
+	std::push_heap(m_toiEvents, m_toiEvents + m_toiEventCount, cb2TOIEventLater);
+}
+
+// Find TOI contacts and solve them.
+void cb2World::SolveTOI(const cb2TimeStep& step)
+{
+	CB2_TRACE_ZONE("SolveTOI");
+
+	cb2Island island(2 * cb2_maxTOIContacts, cb2_maxTOIContacts, 0, &m_stackAllocator, m_contactManager.m_contactListener);
+
+	// Compute the TOIs of all candidates up front, in parallel when there are
+	// enough of them. Cached TOIs are left over from the previous sub-step.
+	m_toiEventCount = 0;
+	{
+		cb2Contact** candidates = (cb2Contact**)m_stackAllocator.Allocate(m_contactManager.m_awakeContactCount * sizeof(cb2Contact*));
+		int candidateCount = 0;
+
+		bool bulletsOnly = (UpdateDegradation() & cb2_degradeContinuous) != 0;
+		for (int i = 0; i < m_contactManager.m_awakeContactCount; ++i)
+		{
+			const cb2AwakeContact* entry = m_contactManager.m_awakeContacts + i;
+			if (IsTOIBodyPair(entry->bodyA, entry->bodyB) == false ||
+				(bulletsOnly && entry->bodyA->IsBullet() == false && entry->bodyB->IsBullet() == false))
+			{
+				continue;
+			}
+
+			cb2Contact* c = entry->contact;
+			if (IsTOICandidate(c) == false)
+			{
+				continue;
+			}
+
+			if (c->m_flags & cb2Contact::e_toiFlag)
+			{
+				PushTOIEvent(c);
+			}
+			else
+			{
+				candidates[candidateCount++] = c;
+			}
+		}
+
+		cb2TOIContext context;
+		context.contacts = candidates;
+		context.iterations = 0;
+		if (m_taskScheduler && candidateCount > 64)
+		{
+			void* group = m_stepScheduler.EnqueueRange(ComputeTOITask, &context, candidateCount, 16);
+			m_stepScheduler.Wait(group);
+		}
+		else
+		{
+			ComputeTOITask(&context, 0, candidateCount, 0);
+		}
+		m_profile.toiIterations += context.iterations;
+
+		for (int i = 0; i < candidateCount; ++i)
+		{
+			PushTOIEvent(candidates[i]);
+		}
+
+		m_stackAllocator.Free(candidates);
+	}
+
+	// Contacts that wake up or get created while events are solved are appended
+	// to the awake array, everything before this was seen.
+	int scannedCount = m_contactManager.m_awakeContactCount;
+
+	// Find TOI events and solve them.
+	for (;;)
+	{
+		int awakeCount = m_contactManager.m_awakeContactCount;
+		for (int i = cb2Min(scannedCount, awakeCount); i < awakeCount; ++i)
+		{
+			const cb2AwakeContact* entry = m_contactManager.m_awakeContacts + i;
+			if (IsTOIBodyPair(entry->bodyA, entry->bodyB) == false)
+			{
+				continue;
+			}
+
+			cb2Contact* c = entry->contact;
+			if ((c->m_flags & cb2Contact::e_toiFlag) == 0 && IsTOICandidate(c))
+			{
+				m_profile.toiIterations += ComputeTOI(c);
+				PushTOIEvent(c);
+			}
+		}
+		scannedCount = awakeCount;
+
+		// Find the first TOI, dropping the events that went stale.
+		cb2Contact* minContact = NULL;
+		float minAlpha = 1.0f;
+
+		while (m_toiEventCount > 0)
+		{
+			std::pop_heap(m_toiEvents, m_toiEvents + m_toiEventCount, cb2TOIEventLater);
+			--m_toiEventCount;
+
+			cb2TOIEvent event = m_toiEvents[m_toiEventCount];
+			cb2Contact* c = event.contact;
+			if ((c->m_flags & cb2Contact::e_toiFlag) == 0 || c->m_toi != event.alpha || c->m_toiCount != event.toiCount)
+			{
+				continue;
+			}
+
+			// Is this contact disabled?
+			if (c->IsEnabled() == false)
+			{
+				continue;
+			}
+
+			// Past its stage the budget leaves the rest to the bullets.
+			if ((UpdateDegradation() & cb2_degradeContinuous) && IsBulletContact(c) == false)
+			{
+				continue;
+			}
+
+			minContact = c;
+			minAlpha = event.alpha;
+			break;
+		}
+
+		if (minContact == NULL || 1.0f - 10.0f * cb2_epsilon < minAlpha)
+		{
+			// No more TOI events. Done!
+			m_stepComplete = true;
+			ResetTOI();
+			break;
+		}
+
+		// Advance the bodies to the TOI.
+		cb2Fixture* fA = minContact->GetFixtureA();
+		cb2Fixture* fB = minContact->GetFixtureB();
+		cb2Body* bA = fA->GetBody();
+		cb2Body* bB = fB->GetBody();
+
+		cb2Sweep backup1 = bA->m_sweep;
+		cb2Sweep backup2 = bB->m_sweep;
+
+		bA->Advance(minAlpha);
+		bB->Advance(minAlpha);
+
+		// The TOI contact likely has some new contact points.
+		minContact->Update(m_contactManager.m_contactListener);
+		minContact->m_flags &= ~cb2Contact::e_toiFlag;
+		++minContact->m_toiCount;
+
+		// Is the contact solid?
+		if (minContact->IsEnabled() == false || minContact->IsTouching() == false)
+		{
+			// Restore the sweeps.
+			minContact->SetEnabled(false);
+			bA->m_sweep = backup1;
+			bB->m_sweep = backup2;
+			bA->SynchronizeTransform();
+			bB->SynchronizeTransform();
+			continue;
+		}
+
+		bA->SetAwake(true);
+		bB->SetAwake(true);
+		++m_profile.toiEventCount;
+
+		// Build the island
+		island.Clear();
+		island.Add(bA);
+		island.Add(bB);
+		island.Add(minContact);
+
+		bA->m_flags |= cb2Body::e_islandFlag;
+		bB->m_flags |= cb2Body::e_islandFlag;
+		minContact->m_flags |= cb2Contact::e_islandFlag;
+
+		// Get contacts on bodyA and bodyB.
+		cb2Body* bodies[2] = {bA, bB};
+		for (int i = 0; i < 2; ++i)
+		{
+			cb2Body* body = bodies[i];
+			if (body->m_type == cb2_dynamicBody)
+			{
+				for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+				{
+					if (island.m_bodyCount == island.m_bodyCapacity)
+					{
+						break;
+					}
+
+					if (island.m_contactCount == island.m_contactCapacity)
+					{
+						break;
+					}
+
+					cb2Contact* contact = ce->contact;
+
+					// Has this contact already been added to the island?
+					if (contact->m_flags & cb2Contact::e_islandFlag)
+					{
+						continue;
+					}
+
+					// Only add static, kinematic, or bullet bodies.
+					cb2Body* other = ce->other;
+					if (other->m_type == cb2_dynamicBody &&
+						body->IsBullet() == false && other->IsBullet() == false)
+					{
+						continue;
+					}
+
+					// Skip sensors.
+					bool sensorA = contact->m_fixtureA->m_isSensor;
+					bool sensorB = contact->m_fixtureB->m_isSensor;
+					if (sensorA || sensorB)
+					{
+						continue;
+					}
+
+					// Tentatively advance the body to the TOI.
+					cb2Sweep backup = other->m_sweep;
+					if ((other->m_flags & cb2Body::e_islandFlag) == 0)
+					{
+						other->Advance(minAlpha);
+					}
+
+					// Update the contact points
+					contact->Update(m_contactManager.m_contactListener);
+
+					// Was the contact disabled by the user?
+					if (contact->IsEnabled() == false)
+					{
+						other->m_sweep = backup;
+						other->SynchronizeTransform();
+						continue;
+					}
+
+					// Are there contact points?
+					if (contact->IsTouching() == false)
+					{
+						other->m_sweep = backup;
+						other->SynchronizeTransform();
+						continue;
+					}
+
+					// Add the contact to the island
+					contact->m_flags |= cb2Contact::e_islandFlag;
+					island.Add(contact);
+
+					// Has the other body already been added to the island?
+					if (other->m_flags & cb2Body::e_islandFlag)
+					{
+						continue;
+					}
+					
+					// Add the other body to the island.
+					other->m_flags |= cb2Body::e_islandFlag;
+
+					if (other->m_type != cb2_staticBody)
+					{
+						other->SetAwake(true);
+					}
+
+					island.Add(other);
+				}
+			}
+		}
+
+		cb2TimeStep subStep;
+		subStep.dt = (1.0f - minAlpha) * step.dt;
+		subStep.inv_dt = 1.0f / subStep.dt;
+		subStep.dtRatio = 1.0f;
+		subStep.positionIterations = 20;
+		subStep.velocityIterations = step.velocityIterations;
+		subStep.subStepCount = 0;
+		subStep.adaptiveIterations = false;
+		subStep.directJoints = false;
+		subStep.reduceContacts = false;
+		subStep.stepIndex = step.stepIndex;
+		subStep.warmStarting = false;
+		subStep.speculative = false;
+		subStep.tolerances = step.tolerances;
+		island.SolveTOI(subStep, bA->m_islandIndex, bB->m_islandIndex);
+
+		// Reset island flags and synchronize broad-phase proxies.
+		for (int i = 0; i < island.m_bodyCount; ++i)
+		{
+			cb2Body* body = island.m_bodies[i];
+			body->m_flags &= ~cb2Body::e_islandFlag;
+
+			if (body->m_type != cb2_dynamicBody)
+			{
+				continue;
+			}
+
+			body->SynchronizeFixtures();
+
+			// Invalidate all contact TOIs on this displaced body.
+			for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+			{
+				ce->contact->m_flags &= ~(cb2Contact::e_toiFlag | cb2Contact::e_islandFlag);
+			}
+		}
+
+		// Commit fixture proxy movements to the broad-phase so that new contacts are created.
+		// Also, some contacts can be destroyed.
+		m_contactManager.FindNewContacts();
+
+		// Only the contacts on the displaced bodies need a new TOI.
+		for (int i = 0; i < island.m_bodyCount; ++i)
+		{
+			cb2Body* body = island.m_bodies[i];
+			if (body->m_type != cb2_dynamicBody)
+			{
+				continue;
+			}
+
+			for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+			{
+				cb2Contact* contact = ce->contact;
+				if ((contact->m_flags & cb2Contact::e_toiFlag) == 0 && IsTOICandidate(contact))
+				{
+					m_profile.toiIterations += ComputeTOI(contact);
+					PushTOIEvent(contact);
+				}
+			}
+		}
+
+		if (m_subStepping)
+		{
+			m_stepComplete = false;
+			break;
+		}
+	}
+}
+
+// Invalidate the TOI state for the next step. Only awake contacts and their bodies
+// are touched by SolveTOI, and contacts that wake up later are reset in
+// cb2ContactManager::UpdateAwake, so sleeping islands are skipped.
+void cb2World::ResetTOI()
+{
+	for (int i = 0; i < m_contactManager.m_awakeContactCount; ++i)
+	{
+		const cb2AwakeContact* entry = m_contactManager.m_awakeContacts + i;
+		entry->bodyA->m_sweep.alpha0 = 0.0f;
+		entry->bodyB->m_sweep.alpha0 = 0.0f;
+
+		// Invalidate TOI
+		cb2Contact* c = entry->contact;
+		c->m_flags &= ~(cb2Contact::e_toiFlag | cb2Contact::e_islandFlag);
+		c->m_toiCount = 0;
+		c->m_toi = 1.0f;
+	}
+}
+
+void cb2World::Step(float dt, int velocityIterations, int positionIterations, const cb2StepBudget& budget)
+{
+	cb2Assert(budget.milliseconds >= 0.0f);
+	cb2Assert(budget.velocityIterations > 0 && budget.positionIterations >= 0 && budget.wakeHopCount > 0);
+	m_stepBudget = budget;
+	Step(dt, velocityIterations, positionIterations);
+	m_stepBudget = cb2StepBudget();
+}
+
+void cb2World::Step(float dt, int velocityIterations, int positionIterations)
+{
+	CB2_TRACE_ZONE_COUNT("Step", m_bodyCount);
+	m_stepTimer.Reset();
+
+	m_contactManager.ClearReportedSensorEvents();
+	m_contactManager.ClearReportedContactEvents();
+	m_jointBreakEventCount = 0;
+
+	// Commands come first so that the events they raise are reported with this step.
+	m_commandQueue.Flush(this);
+
+	// The commands may create, the step itself should not allocate. Without an
+	// audit the step still leaves the scope, it must not count against another.
+	m_allocationAuditScope.audit = m_allocationAudit;
+	m_allocationAuditScope.count.store(0, std::memory_order_relaxed);
+	cb2AllocationAuditScope* previousAuditScope =
+		cb2SetAllocationAuditScope(m_allocationAudit != cb2_auditOff ? &m_allocationAuditScope : NULL);
+
+	// The cumulative counters are profiled as the change over the step.
+	int reinsertCount = m_contactManager.m_broadPhase.GetReinsertCount();
+	int fallbackCount = GetStackFallbackCount();
+	m_contactManager.m_pairCount = 0;
+	m_contactManager.m_createdContactCount = 0;
+	m_contactManager.m_destroyedContactCount = 0;
+	m_contactManager.m_touchingContactCount = 0;
+	m_profile.synchronizeFixtures = 0.0f;
+	m_profile.updatePairs = 0.0f;
+	m_profile.awakeBodyCount = 0;
+	m_profile.islandCount = 0;
+	m_profile.lodSkipCount = 0;
+	m_profile.largestIsland = 0;
+	m_profile.toiEventCount = 0;
+	m_profile.toiIterations = 0;
+	m_profile.solveParticles = 0.0f;
+	m_profile.degradation = 0;
+	m_profile.degradedIslandCount = 0;
+	m_profile.deferredWakeCount = 0;
+
+	// Recompute the mass of the bodies whose fixtures changed.
+	if (m_flags & e_massDirty)
+	{
+		for (cb2Body* b = m_bodyList; b; b = b->m_next)
+		{
+			b->UpdateMassData();
+		}
+		m_flags &= ~e_massDirty;
+	}
+
+	// Speculative contacts look ahead over the step, see cb2Body::ComputeFixtureAABBs.
+	bool speculative = m_continuousPhysics && m_speculativeContacts;
+	m_contactManager.m_speculativeDt = speculative ? dt : 0.0f;
+
+	// If new fixtures were added, we need to find the new contacts.
+	if (m_flags & e_newFixture)
+	{
+		cb2Timer timer;
+		if (speculative)
+		{
+			// New fixtures only cover their current pose.
+			for (cb2Body* b = m_bodyList; b; b = b->m_next)
+			{
+				if (b->m_type != cb2_staticBody && b->IsAwake() && b->IsActive())
+				{
+					b->SynchronizeFixtures();
+				}
+			}
+		}
+		m_contactManager.FindNewContacts();
+		m_flags &= ~e_newFixture;
+		m_profile.updatePairs = timer.GetMilliseconds();
+	}
+
+	m_flags |= e_locked;
+
+	cb2TimeStep step;
+	step.dt = dt;
+	step.velocityIterations	= velocityIterations;
+	step.positionIterations = positionIterations;
+	step.subStepCount = m_softStepCount;
+	step.adaptiveIterations = m_adaptiveIterations;
+	step.directJoints = m_directJoints;
+	step.reduceContacts = m_contactReduction;
+	step.stepIndex = ++m_stepIndex;
+	if (dt > 0.0f)
+	{
+		step.inv_dt = 1.0f / dt;
+	}
+	else
+	{
+		step.inv_dt = 0.0f;
+	}
+
+	step.dtRatio = m_inv_dt0 * dt;
+
+	step.warmStarting = m_warmStarting;
+	step.speculative = speculative;
+	step.tolerances = m_tolerances;
+	
+	// Update contacts. This is where some contacts are destroyed.
+	{
+		cb2Timer timer;
+		m_contactManager.Collide();
+		m_profile.collide = timer.GetMilliseconds();
+	}
+
+	// Integrate velocities, solve velocity constraints, and integrate positions.
+	if (m_stepComplete && step.dt > 0.0f)
+	{
+		cb2Timer timer;
+		ApplyControllers(step);
+		Solve(step);
+		m_profile.solve = timer.GetMilliseconds();
+	}
+
+	// The particles collide with the fixtures where the solver left them.
+	if (m_particleSystemList && m_stepComplete && step.dt > 0.0f)
+	{
+		CB2_TRACE_ZONE_COUNT("SolveParticles", m_particleSystemCount);
+		cb2Timer timer;
+		for (cb2ParticleSystem* ps = m_particleSystemList; ps; ps = ps->m_next)
+		{
+			ps->Solve(step);
+		}
+		m_profile.solveParticles = timer.GetMilliseconds();
+	}
+
+	// Handle TOI events.
+	if (m_continuousPhysics && speculative == false && step.dt > 0.0f)
+	{
+		cb2Timer timer;
+		SolveTOI(step);
+		m_profile.solveTOI = timer.GetMilliseconds();
+	}
+
+	if (step.dt > 0.0f)
+	{
+		m_inv_dt0 = step.inv_dt;
+	}
+
+	if (m_flags & e_clearForces)
+	{
+		ClearForces();
+	}
+
+	TrimBlockAllocator();
+
+	if (m_treeRebalanceBudget > 0)
+	{
+		m_contactManager.m_broadPhase.RebalanceTree(m_treeRebalanceBudget);
+	}
+
+	m_contactManager.m_broadPhase.UpdateQueryTree();
+	m_contactManager.m_reportedSensorEventCount = m_contactManager.m_sensorEventCount;
+	m_contactManager.FinishHitEvents();
+
+	m_flags &= ~e_locked;
+
+	DestroyBrokenJoints();
+
+	m_profile.contactsCreated = m_contactManager.m_createdContactCount;
+	m_profile.contactsDestroyed = m_contactManager.m_destroyedContactCount;
+	m_profile.touchingContactCount = m_contactManager.m_touchingContactCount;
+	m_profile.pairCount = m_contactManager.m_pairCount;
+	m_profile.proxyReinsertCount = m_contactManager.m_broadPhase.GetReinsertCount() - reinsertCount;
+	m_profile.stackFallbackCount = GetStackFallbackCount() - fallbackCount;
+
+	m_profile.step = m_stepTimer.GetMilliseconds();
+
+	if (m_viewEnabled)
+	{
+		cb2WorldView* view = BuildView();
+		if (m_stepInFlight)
+		{
+			m_pendingView = view;
+		}
+		else
+		{
+			m_publishedView.store(view, std::memory_order_release);
+		}
+	}
+
+	cb2SetAllocationAuditScope(previousAuditScope);
+	m_profile.heapAllocationCount = m_allocationAuditScope.count.load(std::memory_order_relaxed);
+}
+
+int cb2World::FlushCommands()
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return 0;
+	}
+
+	return m_commandQueue.Flush(this);
+}
+
+void cb2World::StepAsync(float dt, int velocityIterations, int positionIterations)
+{
+	cb2Assert(m_stepInFlight == false);
+	cb2Assert(IsLocked() == false);
+	if (m_stepInFlight || IsLocked())
+	{
+		return;
+	}
+
+	if (m_viewEnabled == false)
+	{
+		SetViewEnabled(true);
+	}
+
+	if (m_stepThread == NULL)
+	{
+		void* mem = cb2Alloc(m_allocator, sizeof(cb2BackgroundThread));
+		m_stepThread = new (mem) cb2BackgroundThread;
+	}
+
+	m_asyncTimeStep = dt;
+	m_asyncVelocityIterations = velocityIterations;
+	m_asyncPositionIterations = positionIterations;
+	m_stepInFlight = true;
+	m_stepThread->Run(StepAsyncJob, this);
+}
+
+void cb2World::StepAsyncJob(void* context)
+{
+	cb2World* world = (cb2World*)context;
+	world->Step(world->m_asyncTimeStep, world->m_asyncVelocityIterations, world->m_asyncPositionIterations);
+}
+
+void cb2World::WaitStep()
+{
+	if (m_stepInFlight == false)
+	{
+		return;
+	}
+
+	m_stepThread->Wait();
+	m_stepInFlight = false;
+	if (m_pendingView)
+	{
+		m_publishedView.store(m_pendingView, std::memory_order_release);
+		m_pendingView = NULL;
+	}
+}
+
+void cb2World::SetViewEnabled(bool flag)
+{
+	cb2Assert(m_stepInFlight == false);
+	if (flag == m_viewEnabled)
+	{
+		return;
+	}
+
+	m_viewEnabled = flag;
+	if (flag)
+	{
+		m_publishedView.store(BuildView(), std::memory_order_release);
+	}
+	else
+	{
+		m_publishedView.store(NULL, std::memory_order_release);
+		for (int i = 0; i < m_viewCount; ++i)
+		{
+			cb2Assert(m_views[i]->m_readerCount.load() == 0);
+			m_views[i]->~cb2WorldView();
+			cb2Free(m_allocator, m_views[i]);
+		}
+		cb2Free(m_allocator, m_views);
+		m_views = NULL;
+		m_viewCount = 0;
+		FreeRetiredShapes();
+	}
+}
+
+cb2WorldView* cb2World::BuildView()
+{
+	FreeRetiredShapes();
+
+	const cb2WorldView* published = m_publishedView.load(std::memory_order_relaxed);
+	cb2WorldView* view = NULL;
+	for (int i = 0; i < m_viewCount; ++i)
+	{
+		if (m_views[i] != published && m_views[i]->m_readerCount.load() == 0)
+		{
+			view = m_views[i];
+			break;
+		}
+	}
+
+	if (view == NULL)
+	{
+		cb2WorldView** views = (cb2WorldView**)cb2Alloc(m_allocator, (m_viewCount + 1) * sizeof(cb2WorldView*));
+		if (m_views)
+		{
+			memcpy(views, m_views, m_viewCount * sizeof(cb2WorldView*));
+			cb2Free(m_allocator, m_views);
+		}
+		m_views = views;
+
+		void* mem = cb2Alloc(m_allocator, sizeof(cb2WorldView));
+		view = new (mem) cb2WorldView(m_allocator);
+		m_views[m_viewCount++] = view;
+	}
+
+	view->Build(this);
+	view->m_stamp = ++m_viewStamp;
+	return view;
+}
+
+struct cb2RetiredShape
+{
+	cb2Shape* shape;
+	unsigned int viewStamp;
+};
+
+void cb2World::ReleaseShape(cb2Shape* shape)
+{
+	if (cb2Fixture::DropShapeReference(shape) == false)
+	{
+		return;
+	}
+
+	if (m_viewCount == 0)
+	{
+		cb2Fixture::FreeShape(&m_blockAllocator, shape);
+		return;
+	}
+
+	if (m_retiredShapeCount == m_retiredShapeCapacity)
+	{
+		cb2RetiredShape* oldShapes = m_retiredShapes;
+		m_retiredShapeCapacity = cb2Max(2 * m_retiredShapeCapacity, 16);
+		m_retiredShapes = (cb2RetiredShape*)cb2Alloc(m_allocator, m_retiredShapeCapacity * sizeof(cb2RetiredShape));
+		if (oldShapes)
+		{
+			memcpy(m_retiredShapes, oldShapes, m_retiredShapeCount * sizeof(cb2RetiredShape));
+			cb2Free(m_allocator, oldShapes);
+		}
+	}
+
+	cb2RetiredShape* retired = m_retiredShapes + m_retiredShapeCount++;
+	retired->shape = shape;
+	retired->viewStamp = m_viewStamp;
+}
+
+// Free the retired shapes that no view in use can reach. A reader that acquires an
+// unpublished view gives it up again before it looks at it, see AcquireView.
+void cb2World::FreeRetiredShapes()
+{
+	if (m_retiredShapeCount == 0)
+	{
+		return;
+	}
+
+	const cb2WorldView* published = m_publishedView.load(std::memory_order_relaxed);
+	bool inUse = false;
+	unsigned int oldest = 0;
+	for (int i = 0; i < m_viewCount; ++i)
+	{
+		const cb2WorldView* view = m_views[i];
+		if (view != published && view->m_readerCount.load() == 0)
+		{
+			continue;
+		}
+
+		if (inUse == false || view->m_stamp < oldest)
+		{
+			oldest = view->m_stamp;
+		}
+		inUse = true;
+	}
+
+	int count = 0;
+	for (int i = 0; i < m_retiredShapeCount; ++i)
+	{
+		cb2RetiredShape* retired = m_retiredShapes + i;
+		if (inUse && retired->viewStamp >= oldest)
+		{
+			m_retiredShapes[count++] = *retired;
+			continue;
+		}
+
+		cb2Fixture::FreeShape(&m_blockAllocator, retired->shape);
+	}
+	m_retiredShapeCount = count;
+}
+
+const cb2WorldView* cb2World::AcquireView() const
+{
+	for (;;)
+	{
+		cb2WorldView* view = m_publishedView.load();
+		if (view == NULL)
+		{
+			return NULL;
+		}
+
+		// BuildView skips views with readers, but it may have picked this one after
+		// it was unpublished and before the count went up. It is only safe if it is
+		// still (or again) the published one.
+		++view->m_readerCount;
+		if (m_publishedView.load() == view)
+		{
+			return view;
+		}
+		--view->m_readerCount;
+	}
+}
+
+void cb2World::ReleaseView(const cb2WorldView* view) const
+{
+	cb2Assert(view->m_readerCount.load() > 0);
+	--view->m_readerCount;
+}
+
+// FNV-1a over the bits of each value.
+static inline unsigned int cb2HashBytes(unsigned int hash, const void* data, int size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (int i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+unsigned int cb2World::GetStateChecksum() const
+{
+	unsigned int hash = 2166136261u;
+	hash = cb2HashBytes(hash, &m_bodyCount, sizeof(m_bodyCount));
+
+	for (const cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		int awake = b->IsAwake() ? 1 : 0;
+		hash = cb2HashBytes(hash, &b->m_sweep.c, sizeof(b->m_sweep.c));
+		hash = cb2HashBytes(hash, &b->m_sweep.a, sizeof(b->m_sweep.a));
+		hash = cb2HashBytes(hash, &b->m_xf, sizeof(b->m_xf));
+		hash = cb2HashBytes(hash, &b->m_linearVelocity, sizeof(b->m_linearVelocity));
+		hash = cb2HashBytes(hash, &b->m_angularVelocity, sizeof(b->m_angularVelocity));
+		hash = cb2HashBytes(hash, &awake, sizeof(awake));
+	}
+
+	return hash;
+}
+
+void cb2World::SetFixedTimeStep(float timeStep, int velocityIterations, int positionIterations, int maxSteps)
+{
+	cb2Assert(timeStep > 0.0f && maxSteps > 0);
+	m_fixedTimeStep = timeStep;
+	m_fixedVelocityIterations = velocityIterations;
+	m_fixedPositionIterations = positionIterations;
+	m_maxFixedSteps = maxSteps;
+	m_accumulator = cb2Min(m_accumulator, timeStep);
+}
+
+int cb2World::Advance(float elapsed)
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(elapsed >= 0.0f);
+
+	m_accumulator += elapsed;
+	float stepCount = floorf(m_accumulator / m_fixedTimeStep);
+	int steps = stepCount < float(m_maxFixedSteps) ? int(stepCount) : m_maxFixedSteps;
+
+	for (int i = 0; i < steps; ++i)
+	{
+		// Only the last step is interpolated over.
+		if (i == steps - 1)
+		{
+			StoreBodyTransforms(true);
+		}
+
+		Step(m_fixedTimeStep, m_fixedVelocityIterations, m_fixedPositionIterations);
+	}
+
+	if (steps > 0)
+	{
+		StoreBodyTransforms(false);
+	}
+
+	// Drop the steps that are still due, keeping the fraction of a step.
+	m_accumulator -= stepCount * m_fixedTimeStep;
+	m_accumulator = cb2Clamp(m_accumulator, 0.0f, m_fixedTimeStep);
+
+	return steps;
+}
+
+// Grow m_bodyTransforms to the body handle capacity, new entries are stale.
+void cb2World::GrowBodyTransforms()
+{
+	int capacity = m_bodyHandles.GetCapacity();
+	if (m_bodyTransformCount == capacity)
+	{
+		return;
+	}
+
+	cb2BodyTransforms* oldTransforms = m_bodyTransforms;
+	m_bodyTransforms = (cb2BodyTransforms*)cb2Alloc(m_allocator, capacity * sizeof(cb2BodyTransforms));
+	if (oldTransforms)
+	{
+		memcpy(m_bodyTransforms, oldTransforms, m_bodyTransformCount * sizeof(cb2BodyTransforms));
+		cb2Free(m_allocator, oldTransforms);
+	}
+	m_bodyTransformCount = capacity;
+}
+
+// Copy the transforms of all bodies into one side of m_bodyTransforms.
+void cb2World::StoreBodyTransforms(bool previous)
+{
+	GrowBodyTransforms();
+
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		cb2BodyTransforms* transforms = m_bodyTransforms + b->m_handle.index;
+		if (previous)
+		{
+			transforms->previous = b->m_xf;
+		}
+		else
+		{
+			transforms->current = b->m_xf;
+		}
+	}
+}
+
+int cb2World::ExportTransforms(void* buffer, int stride, cb2TransformFormat format, int* handleIndices, int capacity,
+								bool movedOnly) const
+{
+	int floatCount = 3;
+	if (format == e_transformAffine2x3)
+	{
+		floatCount = 6;
+	}
+	else if (format == e_transformMatrix4x4)
+	{
+		floatCount = 16;
+	}
+
+	if (stride == 0)
+	{
+		stride = floatCount * sizeof(float);
+	}
+	cb2Assert(stride >= int(floatCount * sizeof(float)));
+
+	int count = 0;
+	char* out = (char*)buffer;
+	for (const cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (movedOnly && b->m_moveStamp != m_stepIndex)
+		{
+			continue;
+		}
+
+		if (count < capacity)
+		{
+			const cb2Transform& xf = b->m_xf;
+			float* m = (float*)out;
+			switch (format)
+			{
+			case e_transformPositionAngle:
+				m[0] = xf.p.x;
+				m[1] = xf.p.y;
+				m[2] = b->m_sweep.a;
+				break;
+
+			case e_transformAffine2x3:
+				m[0] = xf.q.c;
+				m[1] = xf.q.s;
+				m[2] = -xf.q.s;
+				m[3] = xf.q.c;
+				m[4] = xf.p.x;
+				m[5] = xf.p.y;
+				break;
+
+			case e_transformMatrix4x4:
+				memset(m, 0, 16 * sizeof(float));
+				m[0] = xf.q.c;
+				m[1] = xf.q.s;
+				m[4] = -xf.q.s;
+				m[5] = xf.q.c;
+				m[10] = 1.0f;
+				m[12] = xf.p.x;
+				m[13] = xf.p.y;
+				m[15] = 1.0f;
+				break;
+			}
+
+			if (handleIndices)
+			{
+				handleIndices[count] = b->m_handle.index;
+			}
+
+			out += stride;
+		}
+
+		++count;
+	}
+
+	return count;
+}
+
+struct cb2StepWorldsContext
+{
+	cb2World** worlds;
+	float timeStep;
+	int velocityIterations;
+	int positionIterations;
+};
+
+void cb2World::StepWorldsTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+
+	cb2StepWorldsContext* stepContext = (cb2StepWorldsContext*)context;
+	for (int i = begin; i < end; ++i)
+	{
+		stepContext->worlds[i]->Step(stepContext->timeStep, stepContext->velocityIterations, stepContext->positionIterations);
+	}
+}
+
+void cb2World::StepWorlds(cb2World** worlds, int count, float timeStep, int velocityIterations, int positionIterations,
+						cb2TaskScheduler* scheduler)
+{
+	cb2StepWorldsContext context;
+	context.worlds = worlds;
+	context.timeStep = timeStep;
+	context.velocityIterations = velocityIterations;
+	context.positionIterations = positionIterations;
+
+	if (scheduler == NULL)
+	{
+		StepWorldsTask(&context, 0, count, 0);
+		return;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		cb2Assert(worlds[i]->IsLocked() == false);
+		cb2Assert(worlds[i]->m_taskScheduler != scheduler);
+	}
+
+	// Worlds are big units of work, hand them out one at a time.
+	void* group = scheduler->EnqueueRange(StepWorldsTask, &context, count, 1);
+	scheduler->Wait(group);
+}
+
+void cb2World::SetTrimThreshold(float threshold)
+{
+	cb2Assert(0.0f <= threshold && threshold <= 1.0f);
+	m_trimThreshold = threshold;
+	m_trimLiveBytes = -1;
+}
+
+void cb2World::TrimBlockAllocator()
+{
+	if (m_trimThreshold <= 0.0f)
+	{
+		return;
+	}
+
+	cb2BlockAllocatorStats stats;
+	m_blockAllocator.GetStats(&stats);
+
+	int liveBytes = stats.liveBytes - stats.largeBytes;
+	float capacity = float(stats.chunkCount) * float(cb2_chunkSize);
+	if (liveBytes >= m_trimThreshold * capacity)
+	{
+		m_trimLiveBytes = -1;
+		return;
+	}
+
+	// Fragmented chunks can keep the use low after a trim. Only try again
+	// once more memory has been freed.
+	if (m_trimLiveBytes >= 0 && liveBytes >= m_trimLiveBytes)
+	{
+		return;
+	}
+
+	m_blockAllocator.Trim();
+	m_trimLiveBytes = liveBytes;
+}
+
+void cb2World::ClearForces()
+{
+	// Sleeping bodies never hold a force, SetAwake(false) clears it and ApplyForce
+	// ignores them.
+	for (cb2PersistentIsland* island = m_awakeIslandList; island; island = island->next)
+	{
+		for (cb2Body* body = island->bodyList; body; body = body->m_islandNext)
+		{
+			cb2::setZero(body->m_force);
+			body->m_torque = 0.0f;
+		}
+	}
+}
+
+struct cb2WorldQueryWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		if (filter && filter->ShouldQuery(proxy->fixture) == false)
+		{
+			return true;
+		}
+		return callback->ReportFixture(proxy->fixture);
+	}
+
+	cb2QueryCallback* callback;
+	const cb2QueryFilter* filter;
+};
+
+void cb2World::QueryAABB(cb2QueryCallback* callback, const cb2AABB& aabb) const
+{
+	cb2WorldQueryWrapper wrapper;
+	wrapper.callback = callback;
+	wrapper.filter = NULL;
+	cb2QueryFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb);
+}
+
+void cb2World::QueryAABB(cb2QueryCallback* callback, const cb2AABB& aabb, const cb2QueryFilter& filter) const
+{
+	cb2WorldQueryWrapper wrapper;
+	wrapper.callback = callback;
+	wrapper.filter = &filter;
+	cb2QueryFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb, filter.maskBits);
+}
+
+// Collects the fixtures of one query of a batch.
+struct cb2BatchQueryWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		if ((proxy->fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		if (cb2TestOverlap(proxy->aabb, aabb) == false)
+		{
+			return true;
+		}
+
+		if (count < capacity)
+		{
+			fixtures[count] = proxy->fixture;
+		}
+		++count;
+
+		return true;
+	}
+
+	cb2AABB aabb;
+	cb2Fixture** fixtures;
+	int count;
+	int capacity;
+	unsigned short maskBits;
+};
+
+struct cb2QueryAABBBatchContext
+{
+	const cb2BroadPhase* broadPhase;
+	const cb2AABB* aabbs;
+	cb2Fixture** fixtures;
+	int* fixtureCounts;
+	int capacity;
+	unsigned short maskBits;
+};
+
+void cb2World::QueryAABBBatchTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+
+	cb2QueryAABBBatchContext* batch = (cb2QueryAABBBatchContext*)context;
+
+	cb2BatchQueryWrapper wrapper;
+	wrapper.capacity = batch->capacity;
+	wrapper.maskBits = batch->maskBits;
+
+	for (int i = begin; i < end; ++i)
+	{
+		wrapper.aabb = batch->aabbs[i];
+		wrapper.fixtures = batch->fixtures + i * batch->capacity;
+		wrapper.count = 0;
+		cb2QueryFixtureProxies(batch->broadPhase, &wrapper, wrapper.aabb, wrapper.maskBits);
+		batch->fixtureCounts[i] = wrapper.count;
+	}
+}
+
+void cb2World::QueryAABBBatch(const cb2AABB* aabbs, int count, cb2Fixture** fixtures, int* fixtureCounts, int capacity,
+							unsigned short maskBits, cb2TaskScheduler* scheduler) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(capacity >= 0);
+
+	cb2QueryAABBBatchContext context;
+	context.broadPhase = &m_contactManager.m_broadPhase;
+	context.aabbs = aabbs;
+	context.fixtures = fixtures;
+	context.fixtureCounts = fixtureCounts;
+	context.capacity = capacity;
+	context.maskBits = maskBits;
+
+	if (scheduler && count > 64)
+	{
+		void* group = scheduler->EnqueueRange(QueryAABBBatchTask, &context, count, 32);
+		scheduler->Wait(group);
+	}
+	else
+	{
+		QueryAABBBatchTask(&context, 0, count, 0);
+	}
+}
+
+// Tests the edges of a shared proxy against a child of a query shape.
+struct cb2EdgeOverlapQuery
+{
+	bool QueryEdge(int index)
+	{
+		overlap = cb2TestOverlap(edges, index, shape, childIndex, edgesTransform, transform);
+		return overlap == false;
+	}
+
+	const cb2Shape* edges;
+	cb2Transform edgesTransform;
+	const cb2Shape* shape;
+	int childIndex;
+	cb2Transform transform;
+	bool overlap;
+};
+
+// Collects the fixtures overlapping a shape, testing each child of the query shape
+// whose box touches the candidate.
+struct cb2OverlapShapeWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		const cb2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		const cb2Transform& xf = fixture->GetBody()->GetTransform();
+		int childCount = shape->GetChildCount();
+		for (int i = 0; i < childCount; ++i)
+		{
+			cb2AABB aabb;
+			shape->ComputeAABB(&aabb, transform, i);
+			if (cb2TestOverlap(proxy->aabb, aabb) == false)
+			{
+				continue;
+			}
+
+			bool overlap;
+			if (proxy->childIndex == cb2Shape::e_allChildren)
+			{
+				cb2EdgeOverlapQuery query;
+				query.edges = fixture->GetShape();
+				query.edgesTransform = xf;
+				query.shape = shape;
+				query.childIndex = i;
+				query.transform = transform;
+				query.overlap = false;
+				fixture->QueryChildren(&query, aabb);
+				overlap = query.overlap;
+			}
+			else
+			{
+				overlap = cb2TestOverlap(fixture->GetShape(), proxy->childIndex, shape, i, xf, transform);
+			}
+
+			if (overlap)
+			{
+				if (count < capacity)
+				{
+					fixtures[count] = proxy->fixture;
+				}
+				++count;
+				break;
+			}
+		}
+
+		return true;
+	}
+
+	const cb2Shape* shape;
+	cb2Transform transform;
+	cb2Fixture** fixtures;
+	int count;
+	int capacity;
+	unsigned short maskBits;
+};
+
+int cb2World::OverlapShape(const cb2Shape* shape, const cb2Transform& transform, cb2Fixture** fixtures, int capacity,
+							unsigned short maskBits) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(capacity >= 0);
+
+	cb2AABB aabb;
+	shape->ComputeAABB(&aabb, transform, 0);
+	int childCount = shape->GetChildCount();
+	for (int i = 1; i < childCount; ++i)
+	{
+		cb2AABB childAABB;
+		shape->ComputeAABB(&childAABB, transform, i);
+		aabb.Combine(childAABB);
+	}
+
+	cb2OverlapShapeWrapper wrapper;
+	wrapper.shape = shape;
+	wrapper.transform = transform;
+	wrapper.fixtures = fixtures;
+	wrapper.count = 0;
+	wrapper.capacity = capacity;
+	wrapper.maskBits = maskBits;
+	cb2QueryFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb, maskBits);
+	return wrapper.count;
+}
+
+struct cb2CollideShapeWrapper;
+
+// Measures the edges of a shared proxy that are within the margin box.
+struct cb2EdgeCollideQuery
+{
+	bool QueryEdge(int index);
+
+	cb2CollideShapeWrapper* wrapper;
+	cb2Fixture* fixture;
+};
+
+// Collects the surfaces of the fixture children near a convex shape.
+struct cb2CollideShapeWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		cb2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		input.transformA = fixture->GetBody()->GetTransform();
+
+		if (proxy->childIndex == cb2Shape::e_allChildren)
+		{
+			cb2EdgeCollideQuery query;
+			query.wrapper = this;
+			query.fixture = fixture;
+			fixture->QueryChildren(&query, aabb);
+		}
+		else
+		{
+			CollideChild(fixture, proxy->childIndex);
+		}
+
+		return true;
+	}
+
+	void CollideChild(cb2Fixture* fixture, int childIndex)
+	{
+		input.proxyA.set(fixture->GetShape(), childIndex);
+
+		cb2SimplexCache cache;
+		cache.count = 0;
+		cb2DistanceOutput output;
+		cb2Distance(&output, &cache, &input);
+
+		float radiusA = input.proxyA.m_radius;
+		float separation = output.distance - radiusA - input.proxyB.m_radius;
+		if (separation > margin || output.distance < cb2_epsilon)
+		{
+			return;
+		}
+
+		if (count < capacity)
+		{
+			cb2ContactPlane* plane = planes + count;
+			plane->fixture = fixture;
+			plane->normal = (1.0f / output.distance) * (output.pointB - output.pointA);
+			plane->point = output.pointA + radiusA * plane->normal;
+			plane->separation = separation;
+		}
+		++count;
+	}
+
+	cb2DistanceInput input;
+	cb2AABB aabb;
+	float margin;
+	cb2ContactPlane* planes;
+	int count;
+	int capacity;
+	unsigned short maskBits;
+};
+
+inline bool cb2EdgeCollideQuery::QueryEdge(int index)
+{
+	wrapper->CollideChild(fixture, index);
+	return true;
+}
+
+int cb2World::CollideShape(const cb2Shape* shape, const cb2Transform& transform, float margin,
+							cb2ContactPlane* planes, int capacity, unsigned short maskBits) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(shape->GetChildCount() == 1);
+	cb2Assert(margin >= 0.0f && capacity >= 0);
+
+	cb2CollideShapeWrapper wrapper;
+	wrapper.input.proxyB.set(shape, 0);
+	wrapper.input.transformB = transform;
+	wrapper.input.useRadii = false;
+	wrapper.margin = margin;
+	wrapper.planes = planes;
+	wrapper.count = 0;
+	wrapper.capacity = capacity;
+	wrapper.maskBits = maskBits;
+
+	shape->ComputeAABB(&wrapper.aabb, transform, 0);
+	ci::Vec2f extension(margin, margin);
+	wrapper.aabb.lowerBound -= extension;
+	wrapper.aabb.upperBound += extension;
+
+	cb2QueryFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, wrapper.aabb, maskBits);
+	return wrapper.count;
+}
+
+// Collects the fixtures containing a point.
+struct cb2QueryPointWrapper
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		const cb2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		if (fixture->TestPoint(point))
+		{
+			if (count < capacity)
+			{
+				fixtures[count] = proxy->fixture;
+			}
+			++count;
+		}
+
+		return true;
+	}
+
+	ci::Vec2f point;
+	cb2Fixture** fixtures;
+	int count;
+	int capacity;
+	unsigned short maskBits;
+};
+
+int cb2World::QueryPoint(const ci::Vec2f& point, cb2Fixture** fixtures, int capacity, unsigned short maskBits) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(capacity >= 0);
+
+	cb2AABB aabb;
+	aabb.lowerBound = point;
+	aabb.upperBound = point;
+
+	cb2QueryPointWrapper wrapper;
+	wrapper.point = point;
+	wrapper.fixtures = fixtures;
+	wrapper.count = 0;
+	wrapper.capacity = capacity;
+	wrapper.maskBits = maskBits;
+	cb2QueryFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb, maskBits);
+	return wrapper.count;
+}
+
+struct cb2WorldRayCastWrapper
+{
+	float RayCastProxy(const cb2RayCastInput& input, const cb2FixtureProxy* proxy)
+	{
+		cb2Fixture* fixture = proxy->fixture;
+		if (filter && filter->ShouldQuery(fixture) == false)
+		{
+			return input.maxFraction;
+		}
+
+		int index = proxy->childIndex;
+		cb2RayCastOutput output;
+		bool hit = fixture->RayCast(&output, input, index);
+
+		if (hit)
+		{
+			float fraction = output.fraction;
+			ci::Vec2f point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+			return callback->ReportFixture(fixture, point, output.normal, fraction);
+		}
+
+		return input.maxFraction;
+	}
+
+	cb2RayCastCallback* callback;
+	const cb2QueryFilter* filter;
+};
 
-			if (body->m_type != cb2_dynamicBody)
-			{
-				continue;
-			}
+void cb2World::RayCast(cb2RayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2) const
+{
+	cb2WorldRayCastWrapper wrapper;
+	wrapper.callback = callback;
+	wrapper.filter = NULL;
+	cb2RayCastInput input;
+	input.maxFraction = 1.0f;
+	input.p1 = point1;
+	input.p2 = point2;
+	cb2RayCastFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, input);
+}
 
-			body->SynchronizeFixtures();
+void cb2World::RayCast(cb2RayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2,
+					const cb2QueryFilter& filter) const
+{
+	cb2WorldRayCastWrapper wrapper;
+	wrapper.callback = callback;
+	wrapper.filter = &filter;
+	cb2RayCastInput input;
+	input.maxFraction = 1.0f;
+	input.p1 = point1;
+	input.p2 = point2;
+	cb2RayCastFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, input, filter.maskBits);
+}
 
-			// Invalidate all contact TOIs on this displaced body.
-			for (cb2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
-			{
-				ce->contact->m_flags &= ~(cb2Contact::e_toiFlag | cb2Contact::e_islandFlag);
-			}
+// Keeps the closest hit, the tree then clips the ray to it.
+struct cb2ClosestRayCastWrapper
+{
+	float RayCastProxy(const cb2RayCastInput& input, const cb2FixtureProxy* proxy)
+	{
+		cb2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return input.maxFraction;
 		}
 
-		// Commit fixture proxy movements to the broad-phase so that new contacts are created.
-		// Also, some contacts can be destroyed.
-		m_contactManager.FindNewContacts();
-
-		if (m_subStepping)
+		cb2RayCastOutput output;
+		bool hit = fixture->RayCast(&output, input, proxy->childIndex);
+		if (hit == false)
 		{
-			m_stepComplete = false;
-			break;
+			return input.maxFraction;
 		}
+
+		float fraction = output.fraction;
+		result->fixture = fixture;
+		result->point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+		result->normal = output.normal;
+		result->fraction = fraction;
+		return fraction;
 	}
-}
 
-void cb2World::Step(float dt, int velocityIterations, int positionIterations)
+	cb2RayCastHit* result;
+	unsigned short maskBits;
+};
+
+struct cb2RayCastBatchContext
+{
+	const cb2BroadPhase* broadPhase;
+	const cb2RayCastInput* inputs;
+	cb2RayCastHit* hits;
+	unsigned short maskBits;
+};
+
+void cb2World::RayCastBatchTask(void* context, int begin, int end, int threadIndex)
 {
-	cb2Timer stepTimer;
+	CB2_NOT_USED(threadIndex);
 
-	// If new fixtures were added, we need to find the new contacts.
-	if (m_flags & e_newFixture)
+	cb2RayCastBatchContext* batch = (cb2RayCastBatchContext*)context;
+
+	cb2ClosestRayCastWrapper wrapper;
+	wrapper.maskBits = batch->maskBits;
+
+	for (int i = begin; i < end; ++i)
 	{
-		m_contactManager.FindNewContacts();
-		m_flags &= ~e_newFixture;
+		const cb2RayCastInput& input = batch->inputs[i];
+		cb2RayCastHit* hit = batch->hits + i;
+		hit->fixture = NULL;
+		hit->point = input.p1 + input.maxFraction * (input.p2 - input.p1);
+		hit->normal = ci::Vec2f::zero();
+		hit->fraction = input.maxFraction;
+
+		wrapper.result = hit;
+		cb2RayCastFixtureProxies(batch->broadPhase, &wrapper, input, wrapper.maskBits);
 	}
+}
 
-	m_flags |= e_locked;
+void cb2World::RayCastBatch(const cb2RayCastInput* inputs, cb2RayCastHit* hits, int count,
+							unsigned short maskBits, cb2TaskScheduler* scheduler) const
+{
+	cb2Assert(IsLocked() == false);
 
-	cb2TimeStep step;
-	step.dt = dt;
-	step.velocityIterations	= velocityIterations;
-	step.positionIterations = positionIterations;
-	if (dt > 0.0f)
+	cb2RayCastBatchContext context;
+	context.broadPhase = &m_contactManager.m_broadPhase;
+	context.inputs = inputs;
+	context.hits = hits;
+	context.maskBits = maskBits;
+
+	// Rays are cheap, hand them out in ranges.
+	if (scheduler && count > 64)
 	{
-		step.inv_dt = 1.0f / dt;
+		void* group = scheduler->EnqueueRange(RayCastBatchTask, &context, count, 32);
+		scheduler->Wait(group);
 	}
 	else
 	{
-		step.inv_dt = 0.0f;
+		RayCastBatchTask(&context, 0, count, 0);
 	}
+}
 
-	step.dtRatio = m_inv_dt0 * dt;
+struct cb2ShapeCastWrapper;
 
-	step.warmStarting = m_warmStarting;
-	
-	// Update contacts. This is where some contacts are destroyed.
-	{
-		cb2Timer timer;
-		m_contactManager.Collide();
-		m_profile.collide = timer.GetMilliseconds();
-	}
+// Casts against the edges of a shared proxy that are under the sweep.
+struct cb2EdgeShapeCastQuery
+{
+	bool QueryEdge(int index);
 
-	// Integrate velocities, solve velocity constraints, and integrate positions.
-	if (m_stepComplete && step.dt > 0.0f)
-	{
-		cb2Timer timer;
-		Solve(step);
-		m_profile.solve = timer.GetMilliseconds();
-	}
+	cb2ShapeCastWrapper* wrapper;
+	cb2Fixture* fixture;
+	float maxFraction;
+};
 
-	// Handle TOI events.
-	if (m_continuousPhysics && step.dt > 0.0f)
+// Runs the exact shape cast per candidate and keeps the earliest hit over all
+// children of the cast shape.
+struct cb2ShapeCastWrapper
+{
+	float ShapeCastProxy(float maxFraction, const cb2FixtureProxy* proxy)
 	{
-		cb2Timer timer;
-		SolveTOI(step);
-		m_profile.solveTOI = timer.GetMilliseconds();
-	}
+		cb2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return maxFraction;
+		}
 
-	if (step.dt > 0.0f)
-	{
-		m_inv_dt0 = step.inv_dt;
+		if (proxy->childIndex == cb2Shape::e_allChildren)
+		{
+			cb2EdgeShapeCastQuery query;
+			query.wrapper = this;
+			query.fixture = fixture;
+			query.maxFraction = maxFraction;
+			fixture->QueryChildren(&query, sweptAABB);
+			return query.maxFraction;
+		}
+
+		return CastChild(fixture, proxy->childIndex, maxFraction);
 	}
 
-	if (m_flags & e_clearForces)
+	float CastChild(cb2Fixture* fixture, int childIndex, float maxFraction)
 	{
-		ClearForces();
+		input.proxyA.set(fixture->GetShape(), childIndex);
+		input.transformA = fixture->GetBody()->GetTransform();
+
+		cb2ShapeCastOutput output;
+		bool hit = cb2ShapeCast(&output, &input);
+		if (hit == false || output.lambda >= result->fraction)
+		{
+			return maxFraction;
+		}
+
+		result->fixture = fixture;
+		result->point = output.point;
+		result->normal = output.normal;
+		result->fraction = output.lambda;
+		return output.lambda;
 	}
 
-	m_flags &= ~e_locked;
+	cb2ShapeCastInput input;
+	cb2AABB sweptAABB;
+	cb2RayCastHit* result;
+	unsigned short maskBits;
+};
 
-	m_profile.step = stepTimer.GetMilliseconds();
+inline bool cb2EdgeShapeCastQuery::QueryEdge(int index)
+{
+	maxFraction = wrapper->CastChild(fixture, index, maxFraction);
+	return true;
 }
 
-void cb2World::ClearForces()
+bool cb2World::ShapeCast(const cb2Shape* shape, const cb2Transform& transform, const ci::Vec2f& translation,
+						cb2RayCastHit* hit, unsigned short maskBits) const
 {
-	for (cb2Body* body = m_bodyList; body; body = body->GetNext())
+	cb2Assert(IsLocked() == false);
+
+	hit->fixture = NULL;
+	hit->point = transform.p + translation;
+	hit->normal = ci::Vec2f::zero();
+	hit->fraction = 1.0f;
+
+	cb2ShapeCastWrapper wrapper;
+	wrapper.input.transformB = transform;
+	wrapper.input.translationB = translation;
+	wrapper.result = hit;
+	wrapper.maskBits = maskBits;
+
+	int childCount = shape->GetChildCount();
+	for (int i = 0; i < childCount; ++i)
 	{
-		cb2::setZero(body->m_force);
-		body->m_torque = 0.0f;
+		cb2AABB aabb;
+		shape->ComputeAABB(&aabb, transform, i);
+		wrapper.input.proxyB.set(shape, i);
+		wrapper.sweptAABB.lowerBound = cb2Min(aabb.lowerBound, aabb.lowerBound + translation);
+		wrapper.sweptAABB.upperBound = cb2Max(aabb.upperBound, aabb.upperBound + translation);
+		cb2ShapeCastFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb, translation);
 	}
+
+	return hit->fixture != NULL;
 }
 
-struct cb2WorldQueryWrapper
+// Gathers the bodies in range of a radial impulse with the closest point of each.
+struct cb2RadialImpulseWrapper
 {
-	bool QueryCallback(int proxyId)
+	bool QueryProxy(const cb2FixtureProxy* proxy)
 	{
-		cb2FixtureProxy* proxy = (cb2FixtureProxy*)broadPhase->GetUserData(proxyId);
-		return callback->ReportFixture(proxy->fixture);
+		world->AddRadialImpulseProxy(proxy, this);
+		return true;
 	}
 
-	const cb2BroadPhase* broadPhase;
-	cb2QueryCallback* callback;
+	cb2World* world;
+	cb2DistanceInput input;
+	float radius;
+	unsigned short maskBits;
+
+	cb2Body** bodies;
+	ci::Vec2f* points;
+	float* distances;
+	int bodyCount;
 };
 
-void cb2World::QueryAABB(cb2QueryCallback* callback, const cb2AABB& aabb) const
+// As for the controllers, a body's island index is its slot while it holds the body.
+void cb2World::AddRadialImpulseProxy(const cb2FixtureProxy* proxy, cb2RadialImpulseWrapper* wrapper)
 {
-	cb2WorldQueryWrapper wrapper;
-	wrapper.broadPhase = &m_contactManager.m_broadPhase;
-	wrapper.callback = callback;
-	m_contactManager.m_broadPhase.Query(&wrapper, aabb);
+	cb2Fixture* fixture = proxy->fixture;
+	cb2Body* body = fixture->m_body;
+	if (body->m_type != cb2_dynamicBody || fixture->m_isSensor ||
+		(fixture->m_filter.categoryBits & wrapper->maskBits) == 0)
+	{
+		return;
+	}
+
+	wrapper->input.proxyA.set(fixture->m_shape, proxy->childIndex);
+	wrapper->input.transformA = body->m_xf;
+
+	cb2SimplexCache cache;
+	cache.count = 0;
+	cb2DistanceOutput output;
+	cb2Distance(&output, &cache, &wrapper->input);
+	if (output.distance > wrapper->radius)
+	{
+		return;
+	}
+
+	int index = body->m_islandIndex;
+	if (index < 0 || index >= wrapper->bodyCount || wrapper->bodies[index] != body)
+	{
+		index = wrapper->bodyCount++;
+		wrapper->bodies[index] = body;
+		wrapper->distances[index] = cb2_maxFloat;
+		body->m_islandIndex = index;
+	}
+
+	if (output.distance < wrapper->distances[index])
+	{
+		wrapper->points[index] = output.pointA;
+		wrapper->distances[index] = output.distance;
+	}
 }
 
-struct cb2WorldRayCastWrapper
+int cb2World::ApplyRadialImpulse(const ci::Vec2f& center, float radius, float magnitude,
+								cb2Falloff falloff, unsigned short maskBits, unsigned short occluderMaskBits)
 {
-	float RayCastCallback(const cb2RayCastInput& input, int proxyId)
+	cb2Assert(IsLocked() == false);
+	cb2Assert(radius > 0.0f);
+	if (IsLocked())
 	{
-		void* userData = broadPhase->GetUserData(proxyId);
-		cb2FixtureProxy* proxy = (cb2FixtureProxy*)userData;
-		cb2Fixture* fixture = proxy->fixture;
-		int index = proxy->childIndex;
-		cb2RayCastOutput output;
-		bool hit = fixture->RayCast(&output, input, index);
+		return 0;
+	}
 
-		if (hit)
+	// Each body found has a proxy of its own, so the proxy count bounds them.
+	int capacity = cb2Max(cb2Min(m_contactManager.m_broadPhase.GetProxyCount(), m_bodyCount), 1);
+
+	cb2RadialImpulseWrapper wrapper;
+	wrapper.world = this;
+	wrapper.input.proxyB.m_buffer[0] = center;
+	wrapper.input.proxyB.m_vertices = wrapper.input.proxyB.m_buffer;
+	wrapper.input.proxyB.m_count = 1;
+	wrapper.input.proxyB.m_radius = 0.0f;
+	wrapper.input.transformB.SetIdentity();
+	wrapper.input.useRadii = true;
+	wrapper.radius = radius;
+	wrapper.maskBits = maskBits;
+	wrapper.bodies = (cb2Body**)m_stackAllocator.Allocate(capacity * sizeof(cb2Body*));
+	wrapper.points = (ci::Vec2f*)m_stackAllocator.Allocate(capacity * sizeof(ci::Vec2f));
+	wrapper.distances = (float*)m_stackAllocator.Allocate(capacity * sizeof(float));
+	wrapper.bodyCount = 0;
+
+	// Static fixtures are never pushed, so only the moving proxies are queried.
+	cb2AABB aabb;
+	aabb.lowerBound.set(center.x - radius, center.y - radius);
+	aabb.upperBound.set(center.x + radius, center.y + radius);
+	cb2QueryMovingFixtureProxies(&m_contactManager.m_broadPhase, &wrapper, aabb, maskBits);
+
+	cb2ClosestRayCastWrapper occluder;
+	occluder.maskBits = occluderMaskBits;
+
+	int count = 0;
+	for (int i = 0; i < wrapper.bodyCount; ++i)
+	{
+		cb2Body* b = wrapper.bodies[i];
+		ci::Vec2f point = wrapper.points[i];
+
+		// The center may be inside the fixture, then the body is pushed from its center of mass.
+		ci::Vec2f direction = point - center;
+		if (direction.lengthSquared() < cb2_epsilon * cb2_epsilon)
 		{
-			float fraction = output.fraction;
-			ci::Vec2f point = (1.0f - fraction) * input.p1 + fraction * input.p2;
-			return callback->ReportFixture(fixture, point, output.normal, fraction);
+			point = b->m_sweep.c;
+			direction = point - center;
 		}
 
-		return input.maxFraction;
+		float length = direction.length();
+		if (length < cb2_epsilon)
+		{
+			continue;
+		}
+
+		if (occluderMaskBits != 0)
+		{
+			cb2RayCastHit hit;
+			hit.fixture = NULL;
+			occluder.result = &hit;
+
+			cb2RayCastInput input;
+			input.p1 = center;
+			input.p2 = point;
+			input.maxFraction = 1.0f;
+			cb2RayCastFixtureProxies(&m_contactManager.m_broadPhase, &occluder, input, occluder.maskBits);
+			if (hit.fixture != NULL && hit.fixture->m_body != b)
+			{
+				continue;
+			}
+		}
+
+		float scale = 1.0f;
+		float t = cb2Max(1.0f - wrapper.distances[i] / radius, 0.0f);
+		if (falloff == cb2_linearFalloff)
+		{
+			scale = t;
+		}
+		else if (falloff == cb2_quadraticFalloff)
+		{
+			scale = t * t;
+		}
+
+		if (scale <= 0.0f)
+		{
+			continue;
+		}
+
+		b->ApplyLinearImpulse((magnitude * scale / length) * direction, point, true);
+		++count;
 	}
 
-	const cb2BroadPhase* broadPhase;
-	cb2RayCastCallback* callback;
-};
+	m_stackAllocator.Free(wrapper.distances);
+	m_stackAllocator.Free(wrapper.points);
+	m_stackAllocator.Free(wrapper.bodies);
 
-void cb2World::RayCast(cb2RayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2) const
-{
-	cb2WorldRayCastWrapper wrapper;
-	wrapper.broadPhase = &m_contactManager.m_broadPhase;
-	wrapper.callback = callback;
-	cb2RayCastInput input;
-	input.maxFraction = 1.0f;
-	input.p1 = point1;
-	input.p2 = point2;
-	m_contactManager.m_broadPhase.RayCast(&wrapper, input);
+	return count;
 }
 
 void cb2World::DrawShape(cb2Fixture* fixture, const cb2Transform& xf, const cb2Color& color)
@@ -1076,13 +4976,48 @@ void cb2World::DrawShape(cb2Fixture* fixture, const cb2Transform& xf, const cb2C
 			int vertexCount = poly->m_count;
 			cb2Assert(vertexCount <= cb2_maxPolygonVertices);
 			ci::Vec2f vertices[cb2_maxPolygonVertices];
+			cb2MulBatch(xf, poly->m_vertices, vertexCount, vertices);
+
+			g_debugDraw->DrawSolidPolygon(vertices, vertexCount, color);
+		}
+		break;
+
+	case cb2Shape::e_capsule:
+		{
+			cb2CapsuleShape* capsule = (cb2CapsuleShape*)fixture->GetShape();
+			ci::Vec2f v1 = cb2Mul(xf, capsule->m_vertex1);
+			ci::Vec2f v2 = cb2Mul(xf, capsule->m_vertex2);
+			float radius = capsule->m_radius;
+
+			ci::Vec2f axis = v2 - v1;
+			axis.normalize();
+			ci::Vec2f offset = radius * cb2Cross(1.0f, axis);
+
+			g_debugDraw->DrawSolidCircle(v1, radius, -axis, color);
+			g_debugDraw->DrawSolidCircle(v2, radius, axis, color);
+			g_debugDraw->DrawSegment(v1 + offset, v2 + offset, color);
+			g_debugDraw->DrawSegment(v1 - offset, v2 - offset, color);
+		}
+		break;
 
-			for (int i = 0; i < vertexCount; ++i)
+	case cb2Shape::e_heightfield:
+		{
+			cb2HeightfieldShape* heightfield = (cb2HeightfieldShape*)fixture->GetShape();
+			int cellCount = heightfield->m_count - 1;
+			float spacing = heightfield->m_spacing;
+			const float* heights = heightfield->m_heights;
+
+			for (int i = 0; i < cellCount; ++i)
 			{
-				vertices[i] = cb2Mul(xf, poly->m_vertices[i]);
-			}
+				if (heightfield->IsHole(i))
+				{
+					continue;
+				}
 
-			g_debugDraw->DrawSolidPolygon(vertices, vertexCount, color);
+				ci::Vec2f v1 = cb2Mul(xf, ci::Vec2f(i * spacing, heights[i]));
+				ci::Vec2f v2 = cb2Mul(xf, ci::Vec2f((i + 1) * spacing, heights[i + 1]));
+				g_debugDraw->DrawSegment(v1, v2, color);
+			}
 		}
 		break;
             
@@ -1170,6 +5105,11 @@ void cb2World::DrawDebugData()
 				}
 			}
 		}
+
+		for (cb2ParticleSystem* ps = m_particleSystemList; ps; ps = ps->GetNext())
+		{
+			ps->Draw(g_debugDraw);
+		}
 	}
 
 	if (flags & cb2Draw::e_jointBit)
@@ -1211,8 +5151,7 @@ void cb2World::DrawDebugData()
 			{
 				for (int i = 0; i < f->m_proxyCount; ++i)
 				{
-					cb2FixtureProxy* proxy = f->m_proxies + i;
-					cb2AABB aabb = bp->GetFatAABB(proxy->proxyId);
+					cb2AABB aabb = f->GetProxyFatAABB(bp, i);
 					ci::Vec2f vs[4];
 					vs[0].set(aabb.lowerBound.x, aabb.lowerBound.y);
 					vs[1].set(aabb.upperBound.x, aabb.lowerBound.y);
@@ -1241,6 +5180,76 @@ int cb2World::GetProxyCount() const
 	return m_contactManager.m_broadPhase.GetProxyCount();
 }
 
+void cb2World::ReserveBodies(int bodyCount, int jointCount)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	m_bodyHandles.Reserve(bodyCount);
+	m_jointHandles.Reserve(jointCount);
+}
+
+void cb2World::ReserveProxies(int movingCount, int staticCount)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	m_fixtureHandles.Reserve(movingCount + staticCount);
+	m_contactManager.m_broadPhase.Reserve(movingCount, staticCount);
+}
+
+void cb2World::ReserveContacts(int contactCount)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	m_contactManager.Reserve(contactCount);
+
+	// A pair of moving proxies is found from both of them.
+	m_contactManager.m_broadPhase.ReservePairs(2 * contactCount);
+
+	// Each contact holds at most one time of impact event.
+	if (contactCount > m_toiEventCapacity)
+	{
+		GrowTOIEvents(contactCount);
+	}
+
+	// Polygon contacts are the largest, touching ones hold a manifold.
+	int newCount = cb2Max(contactCount - m_contactManager.m_contactCount, 0);
+	m_blockAllocator.Reserve(newCount * (int)(sizeof(cb2PolygonContact) + sizeof(cb2Manifold)));
+}
+
+void cb2World::ReserveStack(int stackSize)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	// Threads started later get stacks of this size.
+	m_stackSize = cb2Max(m_stackSize, stackSize);
+	m_stackAllocator.Reserve(stackSize);
+	for (int i = 0; i < m_threadStackCount; ++i)
+	{
+		m_threadStacks[i].Reserve(stackSize);
+	}
+}
+
+int cb2World::GetProxyReinsertCount() const
+{
+	return m_contactManager.m_broadPhase.GetReinsertCount();
+}
+
 int cb2World::GetTreeHeight() const
 {
 	return m_contactManager.m_broadPhase.GetTreeHeight();
@@ -1269,6 +5278,11 @@ void cb2World::ShiftOrigin(const ci::Vec2f& newOrigin)
 		b->m_xf.p -= newOrigin;
 		b->m_sweep.c0 -= newOrigin;
 		b->m_sweep.c -= newOrigin;
+
+		if (b->m_aggregate)
+		{
+			b->m_aggregate->ShiftOrigin(newOrigin);
+		}
 	}
 
 	for (cb2Joint* j = m_jointList; j; j = j->m_next)
@@ -1276,6 +5290,11 @@ void cb2World::ShiftOrigin(const ci::Vec2f& newOrigin)
 		j->ShiftOrigin(newOrigin);
 	}
 
+	for (cb2ParticleSystem* ps = m_particleSystemList; ps; ps = ps->m_next)
+	{
+		ps->ShiftOrigin(newOrigin);
+	}
+
 	m_contactManager.m_broadPhase.ShiftOrigin(newOrigin);
 }
 
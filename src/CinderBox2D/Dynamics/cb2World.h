@@ -21,29 +21,119 @@
 
 #include <CinderBox2D/Common/cb2Math.h>
 #include <CinderBox2D/Common/cb2BlockAllocator.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
 #include <CinderBox2D/Common/cb2StackAllocator.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Common/cb2Timer.h>
+#include <CinderBox2D/Dynamics/cb2CommandQueue.h>
 #include <CinderBox2D/Dynamics/cb2ContactManager.h>
 #include <CinderBox2D/Dynamics/cb2WorldCallbacks.h>
 #include <CinderBox2D/Dynamics/cb2TimeStep.h>
 
 struct cb2AABB;
+struct cb2RayCastInput;
 struct cb2BodyDef;
+struct cb2FixtureDef;
 struct cb2Color;
 struct cb2JointDef;
+struct cb2IslandRange;
+struct cb2PersistentIsland;
+struct cb2RetiredShape;
+struct cb2TOIEvent;
+struct cb2ControllerDef;
+struct cb2ParticleSystemDef;
+struct cb2ControllerBatch;
+struct cb2FixtureProxy;
+struct cb2RadialImpulseWrapper;
+struct cb2SnapshotIndex;
+struct cb2SnapshotLoad;
 class cb2Body;
+class cb2ChainShape;
+class cb2Controller;
 class cb2Draw;
 class cb2Fixture;
 class cb2Joint;
+class cb2ParticleSystem;
+class cb2Shape;
+class cb2Snapshot;
+class cb2StaticLayer;
+class cb2TaskScheduler;
+class cb2ThreadPool;
+class cb2BackgroundThread;
+class cb2WorldView;
+
+/// The closest hit of a ray or a shape cast, see cb2World::RayCastBatch and cb2World::ShapeCast.
+struct cb2RayCastHit
+{
+	cb2Fixture* fixture;	///< the fixture hit, NULL if the ray hit nothing
+	ci::Vec2f point;		///< the hit point in world coordinates
+	ci::Vec2f normal;		///< the surface normal at the hit point
+	float fraction;			///< the hit fraction along the ray or translation, maxFraction if nothing was hit
+};
+
+/// A fixture surface near a shape, see cb2World::CollideShape.
+struct cb2ContactPlane
+{
+	cb2Fixture* fixture;	///< the fixture touched
+	ci::Vec2f point;		///< the closest point on the fixture surface
+	ci::Vec2f normal;		///< points from the fixture towards the shape
+	float separation;		///< the gap between the surfaces, negative when they overlap
+};
+
+/// How the impulse of cb2World::ApplyRadialImpulse falls off with the distance d
+/// of a body from the center, out to the radius r.
+enum cb2Falloff
+{
+	cb2_constantFalloff,	///< the full impulse up to r
+	cb2_linearFalloff,		///< scaled by 1 - d / r
+	cb2_quadraticFalloff	///< scaled by (1 - d / r)^2
+};
+
+/// The transforms of a body before and after the last step taken by cb2World::Advance.
+struct cb2BodyTransforms
+{
+	/// Blend the two transforms for rendering between the steps.
+	/// @param alpha 0 gives previous and 1 gives current, see cb2World::GetInterpolationAlpha.
+	cb2Transform Interpolate(float alpha) const
+	{
+		cb2Transform xf;
+		xf.p = previous.p + alpha * (current.p - previous.p);
+		float s = previous.q.s + alpha * (current.q.s - previous.q.s);
+		float c = previous.q.c + alpha * (current.q.c - previous.q.c);
+		float invLength = 1.0f / cb2Sqrt(s * s + c * c);
+		xf.q.s = invLength * s;
+		xf.q.c = invLength * c;
+		return xf;
+	}
+
+	cb2Transform previous;
+	cb2Transform current;
+};
+
+/// Layouts of the body transforms written by cb2World::ExportTransforms. All are floats.
+enum cb2TransformFormat
+{
+	e_transformPositionAngle,	///< x, y, angle
+	e_transformAffine2x3,		///< column major 2x3 matrix: c, s, -s, c, x, y
+	e_transformMatrix4x4		///< column major 4x4 matrix in the z = 0 plane, for 3D instancing
+};
 
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
 /// management facilities.
+/// Separate worlds share no mutable state and may be used on separate threads
+/// at the same time, see StepWorlds. A single world must only be used by one
+/// thread at a time.
 class cb2World
 {
 public:
 	/// Construct a world object.
 	/// @param gravity the world gravity vector.
-	cb2World(const ci::Vec2f& gravity);
+	/// @param stackSize the initial size in bytes of the per step scratch memory, one
+	/// stack per thread. It grows past the largest step seen so far.
+	/// @param allocator where the memory of the world comes from, NULL for cb2Alloc.
+	/// Shapes passed in by the user still use cb2Alloc for their own buffers.
+	cb2World(const ci::Vec2f& gravity, int stackSize = cb2_stackSize, cb2AllocatorInterface* allocator = NULL);
 
 	/// Destruct the world. All physics entities are destroyed and all heap memory is released.
 	~cb2World();
@@ -54,7 +144,8 @@ public:
 
 	/// Register a contact filter to provide specific control over collision.
 	/// Otherwise the default filter is used (cb2_defaultFilter). The listener is
-	/// owned by you and must remain in scope. 
+	/// owned by you and must remain in scope. The broad-phase only prunes pairs by
+	/// category and mask bits with the default filter.
 	void SetContactFilter(cb2ContactFilter* filter);
 
 	/// Register a contact event listener. The listener is owned by you and must
@@ -77,6 +168,79 @@ public:
 	/// @warning This function is locked during callbacks.
 	void DestroyBody(cb2Body* body);
 
+	/// Activate many inactive bodies at once. This does the same as calling
+	/// cb2Body::SetActive(true) on each body, except that the broad-phase proxies
+	/// of all their fixtures are built in one batch. Use this when loading a level:
+	/// create the bodies with cb2BodyDef::active set to false, then activate them.
+	/// @warning This function is locked during callbacks.
+	void ActivateBodies(cb2Body** bodies, int count);
+
+	/// Create many bodies with their fixtures at once. This does the same as calling
+	/// CreateBody and then CreateFixture for each fixture, except that the mass of each
+	/// body is computed once and the broad-phase proxies of all the active bodies are
+	/// built in one batch, like ActivateBodies.
+	/// @param bodyDefs the body definitions.
+	/// @param count the number of bodies.
+	/// @param fixtureDefs the fixtures of all the bodies, those of body i follow those of body i - 1.
+	/// @param fixtureCounts the number of fixtures of each body, NULL for one fixture each.
+	/// @param bodies receives the new bodies.
+	/// @warning This function is locked during callbacks.
+	void CreateBodies(const cb2BodyDef* bodyDefs, int count, const cb2FixtureDef* fixtureDefs,
+					const int* fixtureCounts, cb2Body** bodies);
+
+	/// Destroy many bodies at once. This does the same as calling DestroyBody on each,
+	/// except that the broad-phase proxies of all their fixtures are destroyed in one batch.
+	/// @warning This function is locked during callbacks.
+	void DestroyBodies(cb2Body** bodies, int count);
+
+	/// Deactivate many active bodies at once. This does the same as calling
+	/// cb2Body::SetActive(false) on each body, except that the broad-phase proxies
+	/// of all their fixtures are destroyed in one batch.
+	/// @warning This function is locked during callbacks.
+	void DeactivateBodies(cb2Body** bodies, int count);
+
+	/// Teleport many bodies at once, for respawns and level resets. This does the
+	/// same as calling cb2Body::SetTransform on each body, except that the transforms
+	/// and the fixture AABBs are computed on the task scheduler and the broad-phase
+	/// takes all the proxies in one batch, see cb2BroadPhase::MoveProxies. The new
+	/// contacts are found at the start of the next step.
+	/// @param bodies the bodies.
+	/// @param transforms the new transform of the origin of each body.
+	/// @param count the number of bodies.
+	/// @warning This function is locked during callbacks.
+	void SetTransforms(cb2Body** bodies, const cb2Transform* transforms, int count);
+
+	/// Get the bodies of a streaming region, see cb2BodyDef::region. This walks the
+	/// body list, so keep only the regions around the player in the world.
+	/// @param region the region.
+	/// @param bodies receives up to capacity bodies, may be NULL.
+	/// @param capacity the size of the bodies array.
+	/// @return the number of bodies in the region, which may exceed capacity.
+	int GetRegionBodies(int region, cb2Body** bodies, int capacity) const;
+
+	/// Activate or deactivate all the bodies of a region with ActivateBodies or
+	/// DeactivateBodies. An inactive region keeps its memory but costs nothing
+	/// in the time step. To load a region, create its bodies with CreateBodies.
+	/// @warning This function is locked during callbacks.
+	void SetRegionActive(int region, bool flag);
+
+	/// Destroy all the bodies of a region with DestroyBodies.
+	/// @warning This function is locked during callbacks.
+	void DestroyRegion(int region);
+
+	/// Make a shape that many fixtures can share instead of each holding a clone.
+	/// Pass it as cb2FixtureDef::shape. Shared shapes must not be modified, see
+	/// cb2Fixture::UnshareShape.
+	/// @param shape the shape to be cloned.
+	/// @return the shared shape, owned by the world.
+	/// @warning This function is locked during callbacks.
+	const cb2Shape* CreateSharedShape(const cb2Shape* shape);
+
+	/// Release a shared shape. Fixtures holding it keep it until they are destroyed.
+	/// Shared shapes left over are released when the world is destroyed.
+	/// @warning This function is locked during callbacks.
+	void DestroySharedShape(const cb2Shape* shape);
+
 	/// Create a joint to constrain bodies together. No reference to the definition
 	/// is retained. This may cause the connected bodies to cease colliding.
 	/// @warning This function is locked during callbacks.
@@ -86,15 +250,133 @@ public:
 	/// @warning This function is locked during callbacks.
 	void DestroyJoint(cb2Joint* joint);
 
+	/// Create a controller that applies a force field to the bodies in a region
+	/// each step. No reference to the definition is retained.
+	/// @warning This function is locked during callbacks.
+	cb2Controller* CreateController(const cb2ControllerDef* def);
+
+	/// Destroy a controller.
+	/// @warning This function is locked during callbacks.
+	void DestroyController(cb2Controller* controller);
+
+	/// Create a particle system for liquids and granular materials. The particles
+	/// collide with the fixtures but do not push them. No reference to the definition
+	/// is retained.
+	/// @warning This function is locked during callbacks.
+	cb2ParticleSystem* CreateParticleSystem(const cb2ParticleSystemDef* def);
+
+	/// Destroy a particle system and its particles.
+	/// @warning This function is locked during callbacks.
+	void DestroyParticleSystem(cb2ParticleSystem* system);
+
 	/// Take a time step. This performs collision detection, integration,
 	/// and constraint solution.
 	/// @param timeStep the amount of time to simulate, this should not vary.
 	/// @param velocityIterations for the velocity constraint solver.
 	/// @param positionIterations for the position constraint solver.
+	/// @see SetSoftStepCount
 	void Step(	float timeStep,
 				int velocityIterations,
 				int positionIterations);
 
+	/// Take a time step that cuts its work in stages once it has used parts of the
+	/// budget, see cb2StepBudget. The stages reached are in GetProfile.
+	void Step(	float timeStep,
+				int velocityIterations,
+				int positionIterations,
+				const cb2StepBudget& budget);
+
+	/// Start a time step on a background thread and return at once. Until WaitStep
+	/// the world must not be touched, other threads read the previous step from
+	/// GetView instead, which this enables. Listener callbacks are made from the
+	/// background thread.
+	/// @see Step
+	void StepAsync(	float timeStep,
+					int velocityIterations,
+					int positionIterations);
+
+	/// Finish the step started by StepAsync and make GetView show its result. Nothing
+	/// may read the old view while this runs. Returns at once without a step in flight.
+	void WaitStep();
+
+	/// Is a step started by StepAsync in flight?
+	bool IsStepping() const { return m_stepInFlight; }
+
+	/// Keep an immutable copy of the world as of the end of the last step, built at the
+	/// end of each step and then published, by WaitStep with StepAsync. A new copy
+	/// never reuses the memory of the published one or of one that is acquired.
+	/// @warning Views must not be acquired when this is turned off.
+	void SetViewEnabled(bool flag);
+	bool GetViewEnabled() const { return m_viewEnabled; }
+
+	/// Get the published copy of the world, NULL unless SetViewEnabled or StepAsync
+	/// were called. It stays valid until the next step is published, so only the
+	/// thread that steps the world may use it, other threads use AcquireView.
+	const cb2WorldView* GetView() const { return m_publishedView.load(std::memory_order_acquire); }
+
+	/// Get the published copy of the world from any thread, even while a step runs on
+	/// another one. The copy stays valid until it is released, steps published in the
+	/// meantime go to other copies. Compare cb2WorldView::GetStepIndex to find newer ones.
+	/// @return NULL if the view is not enabled.
+	const cb2WorldView* AcquireView() const;
+
+	/// Release a copy of the world returned by AcquireView.
+	void ReleaseView(const cb2WorldView* view) const;
+
+	/// Get the queue of changes that any thread may make at any time, they are applied
+	/// at the start of the next step.
+	cb2CommandQueue* GetCommandQueue() { return &m_commandQueue; }
+
+	/// Apply the queued changes now instead of at the start of the next step.
+	/// @return the number of commands applied.
+	/// @warning This function is locked during callbacks.
+	int FlushCommands();
+
+	/// Advance the world by real elapsed time in fixed steps, see SetFixedTimeStep.
+	/// The time left over is carried to the next call. When more steps are due than
+	/// the step limit allows, the backlog is dropped so that a slow frame does not
+	/// make the next one slower. Afterwards GetBodyTransforms holds the transforms
+	/// of every body before and after the last step taken.
+	/// @param elapsed the real time since the last call, in seconds.
+	/// @return the number of steps taken, possibly zero.
+	int Advance(float elapsed);
+
+	/// Set the fixed step used by Advance. The default is 1/60 s, 8 velocity and
+	/// 3 position iterations, and at most 4 steps per call.
+	/// @param timeStep the step, this should not vary.
+	/// @param velocityIterations for the velocity constraint solver.
+	/// @param positionIterations for the position constraint solver.
+	/// @param maxSteps the limit of steps one call to Advance may take.
+	void SetFixedTimeStep(float timeStep, int velocityIterations, int positionIterations, int maxSteps);
+	float GetFixedTimeStep() const { return m_fixedTimeStep; }
+
+	/// Get how far the time carried over by Advance is into the next step, from 0
+	/// to 1. Render bodies at cb2BodyTransforms::Interpolate with this value.
+	float GetInterpolationAlpha() const { return m_accumulator / m_fixedTimeStep; }
+
+	/// Get the body transforms written by Advance, indexed by the index of the body
+	/// handle (see cb2Body::GetHandle). Slots of destroyed bodies hold stale values.
+	/// Bodies created since the last step start with both transforms at their
+	/// initial transform. This is NULL until Advance first takes a step.
+	const cb2BodyTransforms* GetBodyTransforms() const { return m_bodyTransforms; }
+
+	/// Get the number of entries of GetBodyTransforms.
+	int GetBodyTransformCount() const { return m_bodyTransformCount; }
+
+	/// Take a time step in many independent worlds at once, one world per task.
+	/// Listener callbacks of each world are made from the thread stepping it.
+	/// @param worlds the worlds to step, each may appear only once.
+	/// @param count the number of worlds.
+	/// @param scheduler runs the worlds, NULL steps them one after the other on the
+	/// calling thread. The worlds must not use this scheduler themselves, a world
+	/// with its own scheduler (see SetTaskScheduler) keeps using it while stepping.
+	/// @see Step
+	static void StepWorlds(	cb2World** worlds, int count,
+							float timeStep,
+							int velocityIterations,
+							int positionIterations,
+							cb2TaskScheduler* scheduler);
+
 	/// Manually clear the force buffer on all bodies. By default, forces are cleared automatically
 	/// after each call to Step. The default behavior is modified by calling SetAutoClearForces.
 	/// The purpose of this function is to support sub-stepping. Sub-stepping is often used to maintain
@@ -113,6 +395,73 @@ public:
 	/// @param aabb the query box.
 	void QueryAABB(cb2QueryCallback* callback, const cb2AABB& aabb) const;
 
+	/// Query the world for the fixtures that potentially overlap the provided AABB
+	/// and pass a filter. Filtered fixtures never reach the callback.
+	/// @param callback a user implemented callback class.
+	/// @param aabb the query box.
+	/// @param filter which fixtures to report.
+	void QueryAABB(cb2QueryCallback* callback, const cb2AABB& aabb, const cb2QueryFilter& filter) const;
+
+	/// Query the world for the fixtures overlapping each of many AABBs. Unlike
+	/// QueryAABB this tests the fixture AABBs rather than the fattened proxies,
+	/// and it makes no virtual calls. A fixture is reported once per overlapping
+	/// child, chain shapes may appear more than once.
+	/// @param aabbs the query boxes.
+	/// @param count the number of query boxes.
+	/// @param fixtures receives the fixtures of query i at fixtures[i * capacity].
+	/// @param fixtureCounts receives the number of fixtures found per query. This
+	/// may exceed capacity, only the first capacity fixtures are stored.
+	/// @param capacity the room for fixtures of each query.
+	/// @param maskBits only fixtures with a category bit in this mask are found.
+	/// @param scheduler spreads large batches over its threads. With NULL the
+	/// queries run on the calling thread, several threads may then query at once.
+	/// @warning Don't call this during Step.
+	void QueryAABBBatch(const cb2AABB* aabbs, int count, cb2Fixture** fixtures, int* fixtureCounts, int capacity,
+						unsigned short maskBits = 0xFFFF, cb2TaskScheduler* scheduler = NULL) const;
+
+	/// Find the fixtures that overlap a shape. Candidates from the broad-phase are
+	/// tested with cb2TestOverlap, without any virtual callback. A fixture is reported
+	/// once per overlapping child, chain shapes may appear more than once.
+	/// @param shape the query shape, any child of it may overlap.
+	/// @param transform the query shape's transform.
+	/// @param fixtures receives the overlapping fixtures.
+	/// @param capacity the room in fixtures.
+	/// @param maskBits only fixtures with a category bit in this mask are found.
+	/// @return the number of overlapping fixtures. This may exceed capacity, only the
+	/// first capacity fixtures are stored.
+	/// @warning Don't call this during Step.
+	int OverlapShape(const cb2Shape* shape, const cb2Transform& transform, cb2Fixture** fixtures, int capacity,
+					unsigned short maskBits = 0xFFFF) const;
+
+	/// Find the fixture surfaces within a margin of a convex shape, with the closest
+	/// point and normal of each from cb2Distance. This is the overlap query used to push
+	/// a character out of the world, see cb2CharacterController. A fixture is reported
+	/// once per child in range. Children whose cores overlap the shape's core have no
+	/// normal and are left out.
+	/// @param shape the query shape, it must have a single child.
+	/// @param transform the query shape's transform.
+	/// @param margin surfaces further than this from the shape are not reported.
+	/// @param planes receives the surfaces.
+	/// @param capacity the room in planes.
+	/// @param maskBits only fixtures with a category bit in this mask are found.
+	/// @return the number of surfaces found. This may exceed capacity, only the
+	/// first capacity planes are stored.
+	/// @warning Don't call this during Step.
+	int CollideShape(const cb2Shape* shape, const cb2Transform& transform, float margin,
+					cb2ContactPlane* planes, int capacity, unsigned short maskBits = 0xFFFF) const;
+
+	/// Find the fixtures that contain a point, using cb2Fixture::TestPoint on the
+	/// broad-phase candidates. Edge and chain fixtures contain no points.
+	/// @param point the query point in world coordinates.
+	/// @param fixtures receives the fixtures containing the point.
+	/// @param capacity the room in fixtures.
+	/// @param maskBits only fixtures with a category bit in this mask are found.
+	/// @return the number of fixtures found. This may exceed capacity, only the
+	/// first capacity fixtures are stored.
+	/// @warning Don't call this during Step.
+	int QueryPoint(const ci::Vec2f& point, cb2Fixture** fixtures, int capacity,
+					unsigned short maskBits = 0xFFFF) const;
+
 	/// Ray-cast the world for all fixtures in the path of the ray. Your callback
 	/// controls whether you get the closest point, any point, or n-points.
 	/// The ray-cast ignores shapes that contain the starting point.
@@ -121,6 +470,79 @@ public:
 	/// @param point2 the ray ending point
 	void RayCast(cb2RayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2) const;
 
+	/// Ray-cast the world for the fixtures in the path of the ray that pass a filter.
+	/// Filtered fixtures are not ray-cast and never reach the callback, so they
+	/// neither clip nor end the ray.
+	/// @param callback a user implemented callback class.
+	/// @param point1 the ray starting point
+	/// @param point2 the ray ending point
+	/// @param filter which fixtures to report.
+	void RayCast(cb2RayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2,
+				const cb2QueryFilter& filter) const;
+
+	/// Ray-cast many rays and keep the closest hit of each. This makes no virtual
+	/// calls besides the shape ray-casts. Like RayCast it ignores shapes that
+	/// contain the starting point.
+	/// @param inputs the rays, each from p1 towards p2 up to maxFraction.
+	/// @param hits receives the closest hit of each ray.
+	/// @param count the number of rays.
+	/// @param maskBits only fixtures with a category bit in this mask are hit.
+	/// @param scheduler spreads large batches over its threads. With NULL the
+	/// rays are cast on the calling thread, several threads may then cast at once.
+	/// @warning Don't call this during Step.
+	void RayCastBatch(const cb2RayCastInput* inputs, cb2RayCastHit* hits, int count,
+					unsigned short maskBits = 0xFFFF, cb2TaskScheduler* scheduler = NULL) const;
+
+	/// Sweep a shape along a translation and find the first fixture it hits. The
+	/// broad-phase is traversed with the swept AABB and each candidate is tested
+	/// with cb2ShapeCast. Fixtures that initially overlap the shape are ignored,
+	/// as are the radii of the shapes beyond the polygon skin.
+	/// @param shape the shape to cast, all its children are swept.
+	/// @param transform the shape's starting transform.
+	/// @param translation the sweep, it must not be zero.
+	/// @param hit receives the first hit. The point lies on the fixture hit and the
+	/// normal points from that fixture towards the cast shape.
+	/// @param maskBits only fixtures with a category bit in this mask are hit.
+	/// @return true if anything was hit.
+	/// @warning Don't call this during Step.
+	bool ShapeCast(const cb2Shape* shape, const cb2Transform& transform, const ci::Vec2f& translation,
+				cb2RayCastHit* hit, unsigned short maskBits = 0xFFFF) const;
+
+	/// Push the dynamic bodies near a point away from it, for example for an explosion.
+	/// Each body gets one impulse at the point of its fixtures closest to the center,
+	/// however many of its fixtures are in range. Sleeping bodies are woken.
+	/// @param center the center in world coordinates.
+	/// @param radius bodies further than this from the center are not affected.
+	/// @param magnitude the impulse at the center in N-seconds.
+	/// @param falloff how the impulse drops with the distance from the center.
+	/// @param maskBits only fixtures with a category bit in this mask are pushed.
+	/// @param occluderMaskBits if not zero, a body is skipped when the ray from the
+	/// center to it first hits a fixture of another body with a category bit in this
+	/// mask. This costs a ray-cast per body.
+	/// @return the number of bodies pushed.
+	/// @warning This function is locked during callbacks.
+	int ApplyRadialImpulse(const ci::Vec2f& center, float radius, float magnitude,
+						cb2Falloff falloff = cb2_linearFalloff, unsigned short maskBits = 0xFFFF,
+						unsigned short occluderMaskBits = 0);
+
+	/// Write the transforms of the bodies into a buffer laid out for rendering, for
+	/// example a GPU instance buffer. The bodies are written in body list order. For
+	/// a view without any copy see GetBodyTransforms.
+	/// @param buffer receives the transform of body i at buffer + i * stride bytes.
+	/// @param stride the bytes between two transforms, 0 to pack them.
+	/// @param format the layout of each transform.
+	/// @param handleIndices optional, receives the handle index of body i (see
+	/// cb2Body::GetHandle). Use it to match the transforms with the bodies when
+	/// movedOnly is set.
+	/// @param capacity the room for transforms in buffer and handleIndices.
+	/// @param movedOnly only write the bodies moved since the last call to Step began:
+	/// those solved by it, moved by SetTransform or created since.
+	/// @return the number of bodies found. This may exceed capacity, only the first
+	/// capacity are written.
+	/// @warning Don't call this during Step.
+	int ExportTransforms(void* buffer, int stride, cb2TransformFormat format, int* handleIndices, int capacity,
+						bool movedOnly = false) const;
+
 	/// Get the world body list. With the returned body, use cb2Body::GetNext to get
 	/// the next body in the world list. A NULL body indicates the end of the list.
 	/// @return the head of the world body list.
@@ -133,6 +555,14 @@ public:
 	cb2Joint* GetJointList();
 	const cb2Joint* GetJointList() const;
 
+	/// Get the world controller list. Use cb2Controller::GetNext to walk it.
+	cb2Controller* GetControllerList();
+	const cb2Controller* GetControllerList() const;
+
+	/// Get the world particle system list. Use cb2ParticleSystem::GetNext to walk it.
+	cb2ParticleSystem* GetParticleSystemList();
+	const cb2ParticleSystem* GetParticleSystemList() const;
+
 	/// Get the world contact list. With the returned contact, use cb2Contact::GetNext to get
 	/// the next contact in the world list. A NULL contact indicates the end of the list.
 	/// @return the head of the world contact list.
@@ -141,6 +571,24 @@ public:
 	cb2Contact* GetContactList();
 	const cb2Contact* GetContactList() const;
 
+	/// Get the body of a handle in constant time.
+	/// @return NULL if the body was destroyed.
+	/// @see cb2Body::GetHandle
+	cb2Body* GetBody(cb2Handle handle);
+	const cb2Body* GetBody(cb2Handle handle) const;
+
+	/// Get the fixture of a handle in constant time.
+	/// @return NULL if the fixture was destroyed.
+	/// @see cb2Fixture::GetHandle
+	cb2Fixture* GetFixture(cb2Handle handle);
+	const cb2Fixture* GetFixture(cb2Handle handle) const;
+
+	/// Get the joint of a handle in constant time.
+	/// @return NULL if the joint was destroyed.
+	/// @see cb2Joint::GetHandle
+	cb2Joint* GetJoint(cb2Handle handle);
+	const cb2Joint* GetJoint(cb2Handle handle) const;
+
 	/// Enable/disable sleep.
 	void SetAllowSleeping(bool flag);
 	bool GetAllowSleeping() const { return m_allowSleep; }
@@ -153,19 +601,157 @@ public:
 	void SetContinuousPhysics(bool flag) { m_continuousPhysics = flag; }
 	bool GetContinuousPhysics() const { return m_continuousPhysics; }
 
+	/// Enable/disable speculative contacts in place of the time of impact phase, when
+	/// continuous physics is enabled. The pairs it would handle get their contact points
+	/// once they may meet within the step, and the island solve only lets them approach
+	/// by the gap. This is cheaper and runs in parallel with the rest of the solve, but
+	/// it is not exact: the motion is predicted from the velocities before the solve,
+	/// fast bodies may stop short of bouncing and contacts begin up to a step before
+	/// the shapes touch.
+	void SetSpeculativeContacts(bool flag) { m_speculativeContacts = flag; }
+	bool GetSpeculativeContacts() const { return m_speculativeContacts; }
+
 	/// Enable/disable single stepped continuous physics. For testing.
 	void SetSubStepping(bool flag) { m_subStepping = flag; }
 	bool GetSubStepping() const { return m_subStepping; }
 
+	/// Solve contacts as soft constraints over this many substeps per step instead
+	/// of using position iterations. Each substep costs one biased and one relaxing
+	/// pass over the constraints, and Step then ignores its iteration counts.
+	/// Zero, the default, uses the velocity and position iterations. The soft step
+	/// solver runs on the stepping thread even if the world has a task scheduler.
+	void SetSoftStepCount(int count);
+	int GetSoftStepCount() const { return m_softStepCount; }
+
+	/// Enable/disable adaptive velocity iterations. Each island then stops iterating
+	/// once its velocities settle (see cb2_linearIterationTolerance) and runs at most
+	/// one iteration more than it has contacts and joints. The iteration count passed
+	/// to Step stays the upper limit.
+	void SetAdaptiveIterations(bool flag) { m_adaptiveIterations = flag; }
+	bool GetAdaptiveIterations() const { return m_adaptiveIterations; }
+
+	/// Enable/disable the direct solver for revolute joints. The point constraints of
+	/// the revolute joints of each island are then also solved exactly after every
+	/// velocity iteration, in time linear in the joint count, as long as the joints
+	/// form trees. Joints closing a loop are left to the iterations, so is the drift
+	/// the position iterations remove. Ropes, chains and ragdolls then hold together
+	/// with few iterations.
+	void SetDirectJoints(bool flag) { m_directJoints = flag; }
+	bool GetDirectJoints() const { return m_directJoints; }
+
+	/// Enable/disable contact reduction. The contacts of a body pair whose manifolds
+	/// share a normal then get a single constraint with at most two points, the deepest
+	/// and the one farthest from it. A body resting on a chain or a compound body
+	/// touches several children at once, reducing their contacts gives fewer
+	/// constraints and stops the overlapping edges from fighting. The time of impact
+	/// solve and the soft step solver do not reduce.
+	void SetContactReduction(bool flag) { m_contactReduction = flag; }
+	bool GetContactReduction() const { return m_contactReduction; }
+
+	/// Set how islands fall asleep, see cb2SleepDef.
+	void SetSleepDef(const cb2SleepDef& def) { m_sleepDef = def; }
+	const cb2SleepDef& GetSleepDef() const { return m_sleepDef; }
+
+	/// Set the contact tolerances, for example cb2Tolerances::LowCost() for a cheap world
+	/// next to an accurate one. Takes effect at the next step.
+	void SetTolerances(const cb2Tolerances& tolerances) { m_tolerances = tolerances; }
+	const cb2Tolerances& GetTolerances() const { return m_tolerances; }
+
+	/// Register a listener that assigns awake islands a simulation detail level each
+	/// step, NULL to step everything at full detail. The listener is owned by you and
+	/// must remain in scope.
+	void SetLodListener(cb2LodListener* listener) { m_lodListener = listener; }
+	cb2LodListener* GetLodListener() const { return m_lodListener; }
+
+	/// Set how the islands of a detail level are stepped. By default level 0 is full
+	/// detail and the others are solved every 2nd, 4th and 8th step, the last two
+	/// without continuous collision. An island that changes level catches up on the
+	/// time it skipped in its next solve.
+	void SetLodDef(int level, const cb2LodDef& def);
+	const cb2LodDef& GetLodDef(int level) const;
+
+	/// Enable/disable a four wide SIMD copy of the broad-phase tree for QueryAABB,
+	/// RayCast and the other world queries. The copy is rebuilt at the end of each
+	/// step in which the tree changed, until then queries fall back to the dynamic
+	/// tree. This pays off when there are many more queries than steps.
+	/// @warning This function is locked during callbacks.
+	void SetQueryTreeEnabled(bool flag);
+	bool GetQueryTreeEnabled() const;
+
+	/// Keep the broad-phase proxies of moving bodies in a uniform grid instead of
+	/// the dynamic tree. A grid is faster for many bodies of about the same size,
+	/// such as particles, with cells about twice their size. Static bodies stay in
+	/// their tree. The proxies are moved over, contacts are kept.
+	/// @param cellSize the cell size, 0 to go back to the dynamic tree.
+	/// @warning This function is locked during callbacks.
+	void SetGridCellSize(float cellSize);
+
+	/// Get the cell size of the broad-phase grid, 0 if the dynamic tree is used.
+	float GetGridCellSize() const;
+
+	/// Register a task scheduler used to run the parallel phases of Step on your
+	/// own job system. The scheduler is owned by you and must remain in scope.
+	/// Pass NULL (the default) to run everything on the calling thread. Listener
+	/// callbacks are always made from the calling thread.
+	/// @warning This function is locked during callbacks.
+	void SetTaskScheduler(cb2TaskScheduler* scheduler);
+
+	/// Get the task scheduler, this may be the built-in pool (see SetThreadCount).
+	cb2TaskScheduler* GetTaskScheduler() const { return m_taskScheduler; }
+
+	/// Use the built-in worker pool with the given total number of threads. One
+	/// runs everything on the calling thread. This replaces any task scheduler.
+	/// @warning This function is locked during callbacks.
+	void SetThreadCount(int count);
+
+	/// Get the number of threads the task scheduler may use.
+	int GetThreadCount() const;
+
 	/// Get the number of broad-phase proxies.
 	int GetProxyCount() const;
 
+	/// Grow the pools of bodies and joints up front for the expected number of them,
+	/// best right after creating the world. Otherwise a pool that runs full is copied
+	/// to one twice the size, which is a noticeable stall for hundreds of thousands
+	/// of bodies.
+	/// @warning This function is locked during callbacks.
+	void ReserveBodies(int bodyCount, int jointCount);
+
+	/// Grow the fixture and broad-phase pools up front for the expected number of
+	/// fixture proxies of moving and of static bodies, like ReserveBodies. Chains and
+	/// heightfields have a proxy per child. Call this after SetGridCellSize.
+	/// @warning This function is locked during callbacks.
+	void ReserveProxies(int movingCount, int staticCount);
+
+	/// Grow the contact tables, the broad-phase pair buffers and the block allocator
+	/// up front for the expected number of contacts, like ReserveBodies. A step then
+	/// creates contacts without asking the heap for memory until there are more.
+	/// A block allocator trim may release the memory again, see SetTrimThreshold.
+	/// @warning This function is locked during callbacks.
+	void ReserveContacts(int contactCount);
+
+	/// Grow the stack allocators of the step, the one of each task scheduler thread
+	/// included, to at least this many bytes. They grow on their own past the most a
+	/// step ever needed, but the step that first needs more goes to the heap.
+	/// @warning This function is locked during callbacks.
+	void ReserveStack(int stackSize);
+
+	/// Get how often broad-phase proxies left their fat AABB so far, see
+	/// cb2Fixture::GetReinsertCount.
+	int GetProxyReinsertCount() const;
+
 	/// Get the number of bodies.
 	int GetBodyCount() const;
 
 	/// Get the number of joints.
 	int GetJointCount() const;
 
+	/// Get the number of controllers.
+	int GetControllerCount() const;
+
+	/// Get the number of particle systems.
+	int GetParticleSystemCount() const;
+
 	/// Get the number of contacts (each may have 0 or more contact points).
 	int GetContactCount() const;
 
@@ -179,6 +765,71 @@ public:
 	/// The minimum is 1.
 	float GetTreeQuality() const;
 
+	/// Set how many broad-phase proxies the dynamic tree may rebuild per step. Each
+	/// step one subtree of at most this many leaves is rebuilt, sweeping over the
+	/// tree from step to step. A budget of a few hundred keeps the tree quality steady over
+	/// long runs where most proxies are at rest, busy worlds reinsert their proxies
+	/// often enough on their own. Zero, the default, leaves the tree as incremental
+	/// insertion made it.
+	void SetTreeRebalanceBudget(int leafBudget) { cb2Assert(leafBudget >= 0); m_treeRebalanceBudget = leafBudget; }
+	int GetTreeRebalanceBudget() const { return m_treeRebalanceBudget; }
+
+	/// Let contacts keep their manifold without running the narrow phase while the
+	/// pose of one body relative to the other drifts less than the tolerances from
+	/// where the manifold was last computed. The impulses and feature ids carry over,
+	/// so warm starting is unaffected. This pays off for awake stacks that barely
+	/// move. A linear tolerance of a fraction of cb2_linearSlop keeps the contact
+	/// points accurate enough.
+	/// @param linearTolerance the translation drift in meters, 0 (the default) is off.
+	/// @param angularTolerance the rotation drift in radians.
+	void SetManifoldReuseTolerance(float linearTolerance, float angularTolerance);
+	float GetManifoldReuseLinearTolerance() const;
+	float GetManifoldReuseAngularTolerance() const;
+
+	/// Collect the begin and end of sensor overlaps in one array per step instead of
+	/// calling BeginContact and EndContact for sensor contacts. With many trigger
+	/// volumes this saves the interleaved virtual calls, and the array can be read
+	/// after the step when the world may be changed. Off by default.
+	/// @see GetSensorEvents
+	void SetSensorEventBatching(bool flag);
+	bool GetSensorEventBatching() const;
+
+	/// Get the sensor events of the last step, in the order they happened. Events of
+	/// contacts destroyed between steps, like those of a destroyed fixture, follow and
+	/// are reported again by the next step. The array is valid until the next step.
+	/// Resolve the fixture handles with GetFixture, they may have been destroyed.
+	const cb2SensorEvent* GetSensorEvents(int* count) const;
+
+	/// Collect the begin and end of contacts without sensors in arrays per step
+	/// instead of calling BeginContact and EndContact. The events carry the contact
+	/// point and approach speed, and hit events add the impulse, so sounds and damage
+	/// need no listener. PreSolve and PostSolve are still called. Off by default.
+	/// @see cb2FixtureDef::enableContactEvents, cb2FixtureDef::enableHitEvents
+	void SetContactEventBatching(bool flag);
+	bool GetContactEventBatching() const;
+
+	/// Get the contacts that began to touch in the last step. The array is valid
+	/// until the next step. Resolve the fixture handles with GetFixture.
+	const cb2ContactBeginEvent* GetContactBeginEvents(int* count) const;
+
+	/// Get the contacts that ceased to touch in the last step, in the order they
+	/// happened. Contacts destroyed between steps follow, as with GetSensorEvents.
+	const cb2ContactEndEvent* GetContactEndEvents(int* count) const;
+
+	/// Get the contacts of the last step that began to touch faster than the hit
+	/// event threshold, with the impulse the step applied.
+	const cb2ContactHitEvent* GetContactHitEvents(int* count) const;
+
+	/// Set the approach speed above which a new contact is a hit, in meters per
+	/// second. The default is 1 m/s.
+	void SetHitEventThreshold(float speed);
+	float GetHitEventThreshold() const;
+
+	/// Get the joints that broke and were destroyed by the last step, ordered by
+	/// their handles. The array is valid until the next step.
+	/// @see cb2JointDef::breakForce
+	const cb2JointBreakEvent* GetJointBreakEvents(int* count) const;
+
 	/// Change the global gravity vector.
 	void SetGravity(const ci::Vec2f& gravity);
 	
@@ -205,6 +856,116 @@ public:
 	/// Get the current profile.
 	const cb2Profile& GetProfile() const;
 
+	/// Get the number of per step allocations that did not fit the stack
+	/// allocators and went to cb2Alloc. The count is never reset. Once the stacks
+	/// have grown it only rises in steps that need more than any step before.
+	int GetStackFallbackCount() const;
+
+	/// Watch the heap during each step. With cb2_auditCount the profile counts the
+	/// heap allocations of the step, cb2_auditAssert also asserts on each of them.
+	/// After a few steps of warm-up the stacks, pools and buffers have reached the
+	/// size the scene needs and a step makes none, unless the scene grows: more
+	/// proxies, contacts or islands than ever before, or a block allocator trim.
+	/// ReserveBodies, ReserveProxies, ReserveContacts and ReserveStack grow them up
+	/// front. Only the threads of this step are audited: the stepping thread and the
+	/// ranges it hands to the task scheduler. Other threads and other worlds are not
+	/// counted. The view built at the end of the step is part of the step, commands
+	/// are not, see cb2CommandQueue.
+	void SetAllocationAudit(cb2AllocationAudit audit) { m_allocationAudit = audit; }
+	cb2AllocationAudit GetAllocationAudit() const { return m_allocationAudit; }
+
+	/// Get the memory counters of the allocator that holds the bodies, fixtures,
+	/// shapes, contacts and joints.
+	void GetBlockAllocatorStats(cb2BlockAllocatorStats* stats) const;
+
+	/// Release the unused memory of the block allocator at the end of a step when
+	/// less than this fraction of it is in use, for example 0.5. The default of 0
+	/// never releases memory while the world exists.
+	/// @see cb2BlockAllocator::Trim
+	void SetTrimThreshold(float threshold);
+	float GetTrimThreshold() const { return m_trimThreshold; }
+
+	/// Get a hash of the simulation state: the position, rotation, velocity and
+	/// awake flag of every body in world list order. Peers running a deterministic
+	/// simulation (see CB2_DETERMINISTIC) compare it after each step to detect
+	/// divergence. This walks all the bodies.
+	unsigned int GetStateChecksum() const;
+
+	/// Save the simulation state into a binary snapshot: the bodies, fixtures and
+	/// shapes, the joints and contacts with their warm starting impulses, the islands
+	/// and the broad-phase. User data, listeners and controllers are not saved, and
+	/// shared shapes are saved as copies.
+	/// @warning this should be called outside of a time step.
+	void SaveSnapshot(cb2Snapshot* snapshot) const;
+
+	/// Restore a snapshot into this world, which must have no bodies. The contacts
+	/// and the broad-phase are taken over as saved instead of being found again, so
+	/// the world steps on exactly like the saved one. The handles of the saved world
+	/// resolve to the restored objects. Returns false for a bad snapshot, the world
+	/// is then left without bodies.
+	/// @warning this should be called outside of a time step.
+	bool LoadSnapshot(cb2Snapshot* snapshot);
+
+	/// Save the active static bodies with their fixtures and the static broad-phase
+	/// tree as a level for LoadLevel. This is meant for an offline tool that writes
+	/// the bytes to a file. Other bodies, joints and user data are not saved.
+	void SaveLevel(cb2Snapshot* level) const;
+
+	/// Add the static bodies of a level saved by SaveLevel. The saved static tree is
+	/// taken over as is instead of inserting each proxy, and chain vertices are used in
+	/// place, so the data must remain valid, for example mapped from the level file,
+	/// until the chains are destroyed. The world must have no static proxies yet. The
+	/// level bodies go to the front of the body list in saved order. Returns false for
+	/// a bad level, nothing is added then.
+	/// @warning this should be called outside of a time step.
+	bool LoadLevel(const void* data, int size);
+
+	/// Add the static bodies of a layer that other worlds share, see cb2StaticLayer.
+	/// The bodies and fixtures are the world's own, but they hold the shapes of the
+	/// layer and the broad-phase uses its static tree, so the layer must outlive the
+	/// world. The level bodies must not be changed in ways that change their proxies:
+	/// moved, deactivated, refiltered or destroyed, and ShiftOrigin is not allowed.
+	/// Static bodies added later go with the moving proxies. The tree of an aggregate
+	/// body is copied. The world must have no static proxies yet, returns false then.
+	/// @warning this should be called outside of a time step.
+	bool LoadLevel(const cb2StaticLayer* layer);
+
+	/// Save a body with its fixtures for LoadBody, for example to hand it to the world
+	/// of a neighbouring region. Joints, contacts and user data are not saved.
+	/// @warning this should be called outside of a time step.
+	void SaveBody(const cb2Body* body, cb2Snapshot* snapshot) const;
+
+	/// Create a body saved by SaveBody, possibly in another world, with its fixtures,
+	/// velocities, mass and sleep state. The body gets new handles.
+	/// @param offset moves the body, like ShiftOrigin does, for worlds that put
+	/// their origin elsewhere.
+	/// @return the body, NULL for bad data.
+	/// @warning this should be called outside of a time step.
+	cb2Body* LoadBody(cb2Snapshot* snapshot, const ci::Vec2f& offset);
+
+	/// Get the topology stamp. It changes whenever a body, fixture or joint is created
+	/// or destroyed, a body changes its type or activity, a fixture changes its filter
+	/// or sensor flag, or the broad-phase changes between tree and grid. The state of
+	/// SaveState only restores while the stamp stays the same.
+	unsigned int GetTopologyStamp() const { return m_topologyStamp; }
+
+	/// Save the state that stepping changes, for rollback: the transforms, sweeps,
+	/// velocities, forces and mass of the bodies, their sleep state and islands, the
+	/// joint impulses, the contacts with their manifolds and the broad-phase. Unlike
+	/// SaveSnapshot nothing is allocated, the state goes into the buffer as is.
+	/// @return the size of the state. The buffer only holds all of it if that is at
+	/// most capacity, call with a capacity of zero to size the buffer.
+	/// @warning this should be called outside of a time step.
+	int SaveState(void* buffer, int capacity) const;
+
+	/// Restore a state saved by this world. Contacts that began since are destroyed
+	/// and contacts that ended are created again, without calling the listeners.
+	/// Returns false and leaves the world as it is if the state is from another world
+	/// or the topology stamp changed since, LoadSnapshot must be used then, or if size
+	/// is not the size SaveState returned.
+	/// @warning this should be called outside of a time step.
+	bool RestoreState(const void* buffer, int size);
+
 	/// Dump the world into the log file.
 	/// @warning this should be called outside of a time step.
 	void Dump();
@@ -216,32 +977,181 @@ private:
 	{
 		e_newFixture	= 0x0001,
 		e_locked		= 0x0002,
-		e_clearForces	= 0x0004
+		e_clearForces	= 0x0004,
+		e_massDirty		= 0x0008,
+		e_spreadWake	= 0x0010
 	};
 
 	friend class cb2Body;
 	friend class cb2Fixture;
 	friend class cb2ContactManager;
+	friend class cb2Contact;
 	friend class cb2Controller;
-
+	friend class cb2ParticleSystem;
+	friend class cb2Island;
+	friend class cb2WorldView;
+	friend class cb2StaticLayer;
+	friend struct cb2ControllerQueryWrapper;
+	friend struct cb2RadialImpulseWrapper;
+
+	// Persistent island graph, see cb2PersistentIsland.
+	cb2PersistentIsland* CreateIsland(bool awake);
+	void DestroyIsland(cb2PersistentIsland* island);
+	void AddToIsland(cb2Body* body);
+	void RemoveFromIsland(cb2Body* body);
+	void DetachBody(cb2Body* body);
+	void DestroyBodyProxies(cb2Body** bodies, int count);
+	void FreeBody(cb2Body* body);
+	void LinkContact(cb2Contact* contact);
+	void UnlinkContact(cb2Contact* contact);
+	void LinkJoint(cb2Joint* joint);
+	void UnlinkJoint(cb2Joint* joint);
+	cb2PersistentIsland* MergeIslands(cb2PersistentIsland* islandA, cb2PersistentIsland* islandB);
+	void SplitIsland(cb2PersistentIsland* island);
+	void WakeIsland(cb2PersistentIsland* island, cb2Body* seed);
+	void WakeRegion(cb2PersistentIsland* island, cb2Body* seed, int hopCount);
+	cb2PersistentIsland* AdoptContacts(cb2PersistentIsland* island, cb2Body* bodies, int count);
+	void SpreadWake();
+	void SleepIsland(cb2PersistentIsland* island);
+
+	template <typename T> static void LinkToIsland(T** list, T* item);
+	template <typename T> static void UnlinkFromIsland(T** list, T* item);
+	template <typename T> static void SpliceIsland(T** list, T* other, cb2PersistentIsland* island);
+
+	bool UpdateLod(cb2PersistentIsland* island, const cb2TimeStep& step, cb2TimeStep* islandStep);
+	int UpdateDegradation();
 	void Solve(const cb2TimeStep& step);
+	void SolveIslands(cb2Body** bodies, cb2Contact** contacts, cb2Joint** joints,
+					cb2IslandRange* ranges, int islandCount);
 	void SolveTOI(const cb2TimeStep& step);
+	void ResetTOI();
+	void TrimBlockAllocator();
+
+	// TOI events are kept in a min-heap on alpha. Entries go stale when their
+	// contact is invalidated, they are dropped when popped.
+	static bool IsTOICandidate(cb2Contact* contact);
+	static bool IsTOIBodyPair(const cb2Body* bodyA, const cb2Body* bodyB);
+	static bool IsBulletContact(cb2Contact* contact);
+	static int ComputeTOI(cb2Contact* contact);
+	static void ComputeTOITask(void* context, int begin, int end, int threadIndex);
+	static void ComputeFixtureAABBsTask(void* context, int begin, int end, int threadIndex);
+	static void TeleportTask(void* context, int begin, int end, int threadIndex);
+	static void StepWorldsTask(void* context, int begin, int end, int threadIndex);
+	static void StepAsyncJob(void* context);
+	cb2WorldView* BuildView();
+	void ReleaseShape(cb2Shape* shape);
+	void FreeRetiredShapes();
+	static void RayCastBatchTask(void* context, int begin, int end, int threadIndex);
+	static void QueryAABBBatchTask(void* context, int begin, int end, int threadIndex);
+	void PushTOIEvent(cb2Contact* contact);
+	void GrowTOIEvents(int capacity);
+
+	// Joints that exceeded their break limits are destroyed once the step is done.
+	void PushJointBreak(cb2Joint* joint, const ci::Vec2f& force, float torque);
+	void DestroyBrokenJoints();
+
+	// Gather the bodies of each controller and add its forces to them.
+	void ApplyControllers(const cb2TimeStep& step);
+	void GatherControllerBatch(const cb2Controller* controller, cb2ControllerBatch* batch);
+	void AddControllerProxy(const cb2FixtureProxy* proxy, const cb2Controller* controller, cb2ControllerBatch* batch);
+	void AddControllerFixture(cb2Fixture* fixture, const cb2Controller* controller, cb2ControllerBatch* batch);
+
+	// Keep the closest point of each body in range of a radial impulse.
+	void AddRadialImpulseProxy(const cb2FixtureProxy* proxy, cb2RadialImpulseWrapper* wrapper);
+
+	bool LoadBodies(cb2Snapshot* snapshot, cb2SnapshotLoad* load);
+	bool LoadProxies(cb2SnapshotLoad* load);
+	bool LoadJoints(cb2Snapshot* snapshot, cb2SnapshotLoad* load);
+	bool LoadContacts(cb2Snapshot* snapshot, cb2SnapshotLoad* load);
+	bool LoadIslands(cb2Snapshot* snapshot, cb2SnapshotLoad* load, bool awake);
+	void UnloadSnapshot(cb2SnapshotLoad* load);
+
+	bool LoadLevelFixture(cb2Snapshot* level, cb2Body* body);
+	int LinkLevelProxies(cb2Body** bodies, int bodyCount);
+	void ActivateLevel(cb2Body** bodies, int bodyCount, int proxyCount);
+	cb2ChainShape* LoadLevelChain(cb2Snapshot* level, float radius);
+
+	void RestoreContacts(cb2Snapshot* state);
+	void RestoreIslands(cb2Snapshot* state, bool awake);
+	void ClearIslands();
+
+	template <typename T> static void SaveIslandList(cb2Snapshot* snapshot, const T* list,
+													const cb2SnapshotIndex* indices, int indexCount);
+	template <typename T> static bool LoadIslandList(cb2Snapshot* snapshot, cb2PersistentIsland* island,
+													T** list, int* count, T** items, int itemCount);
+	template <typename T> static void AppendToIsland(cb2PersistentIsland* island, T** list, T** tail, T* item);
+
+	void GrowBodyTransforms();
+	void StoreBodyTransforms(bool previous);
 
 	void DrawJoint(cb2Joint* joint);
 	void DrawShape(cb2Fixture* shape, const cb2Transform& xf, const cb2Color& color);
 
+	cb2AllocatorInterface* m_allocator;
 	cb2BlockAllocator m_blockAllocator;
 	cb2StackAllocator m_stackAllocator;
 
+	// Optional task scheduler, each of its threads gets its own stack allocator.
+	// m_threadPool is set when the scheduler is the pool owned by the world. The
+	// world and its parts enqueue through m_stepScheduler, which carries the
+	// allocation audit of the step over to the scheduler threads.
+	cb2TaskScheduler* m_taskScheduler;
+	cb2ThreadPool* m_threadPool;
+	cb2AuditedTaskScheduler m_stepScheduler;
+
+	// StepAsync runs Step on m_stepThread. With the view enabled each step builds a
+	// view of the pool that is neither published nor acquired, growing the pool if
+	// readers hold all of them. Synchronous steps publish it at once, async ones
+	// leave it in m_pendingView for WaitStep.
+	cb2BackgroundThread* m_stepThread;
+	cb2CommandQueue m_commandQueue;
+	cb2WorldView** m_views;
+	int m_viewCount;
+	std::atomic<cb2WorldView*> m_publishedView;
+	cb2WorldView* m_pendingView;
+	bool m_viewEnabled;
+
+	// The views hold the shapes of their fixtures. A shape freed while views exist
+	// waits here with the stamp of the newest view, until every published or
+	// acquired view is newer. BuildView stamps each view it builds.
+	cb2RetiredShape* m_retiredShapes;
+	int m_retiredShapeCount;
+	int m_retiredShapeCapacity;
+	unsigned int m_viewStamp;
+	float m_asyncTimeStep;
+	int m_asyncVelocityIterations;
+	int m_asyncPositionIterations;
+	bool m_stepInFlight;
+	cb2StackAllocator* m_threadStacks;
+	int m_threadStackCount;
+	int m_stackSize;
+
+	// Block allocator trimming, m_trimLiveBytes is the use at the last attempt
+	// or -1 if the use went back above the threshold since.
+	float m_trimThreshold;
+	int m_trimLiveBytes;
+
 	int m_flags;
 
 	cb2ContactManager m_contactManager;
 
 	cb2Body* m_bodyList;
 	cb2Joint* m_jointList;
+	cb2Controller* m_controllerList;
+	cb2ParticleSystem* m_particleSystemList;
+
+	cb2HandleTable m_bodyHandles;
+	cb2HandleTable m_fixtureHandles;
+	cb2HandleTable m_jointHandles;
+
+	// The persistent islands, the awake ones are solved every step.
+	cb2PersistentIsland* m_awakeIslandList;
+	cb2PersistentIsland* m_sleepingIslandList;
 
 	int m_bodyCount;
 	int m_jointCount;
+	int m_controllerCount;
+	int m_particleSystemCount;
 
 	ci::Vec2f m_gravity;
 	bool m_allowSleep;
@@ -256,10 +1166,60 @@ private:
 	// These are for debugging the solver.
 	bool m_warmStarting;
 	bool m_continuousPhysics;
+	bool m_speculativeContacts;
 	bool m_subStepping;
 
+	int m_softStepCount;
+	bool m_adaptiveIterations;
+	bool m_directJoints;
+	bool m_contactReduction;
+	cb2AllocationAudit m_allocationAudit;
+	cb2AllocationAuditScope m_allocationAuditScope;
+	cb2Tolerances m_tolerances;
+	cb2SleepDef m_sleepDef;
+
+	cb2LodListener* m_lodListener;
+	cb2LodDef m_lodDefs[cb2_maxLodLevels];
+
+	// The budget of the current step, see UpdateDegradation.
+	cb2StepBudget m_stepBudget;
+	cb2Timer m_stepTimer;
+
+	// Counts the calls to Step, see cb2Body::m_moveStamp.
+	unsigned int m_stepIndex;
+
+	// See GetTopologyStamp.
+	unsigned int m_topologyStamp;
+
 	bool m_stepComplete;
 
+	int m_treeRebalanceBudget;
+
+	// The fixed step accumulator of Advance.
+	float m_fixedTimeStep;
+	int m_fixedVelocityIterations;
+	int m_fixedPositionIterations;
+	int m_maxFixedSteps;
+	float m_accumulator;
+
+	// Indexed by body handle index, m_bodyTransformCount follows the capacity of
+	// m_bodyHandles once Advance has taken a step.
+	cb2BodyTransforms* m_bodyTransforms;
+	int m_bodyTransformCount;
+
+	// The shared shapes the world still holds a reference to.
+	cb2Shape** m_sharedShapes;
+	int m_sharedShapeCount;
+	int m_sharedShapeCapacity;
+
+	cb2TOIEvent* m_toiEvents;
+	int m_toiEventCount;
+	int m_toiEventCapacity;
+
+	cb2JointBreakEvent* m_jointBreakEvents;
+	int m_jointBreakEventCount;
+	int m_jointBreakEventCapacity;
+
 	cb2Profile m_profile;
 };
 
@@ -283,6 +1243,26 @@ inline const cb2Joint* cb2World::GetJointList() const
 	return m_jointList;
 }
 
+inline cb2Controller* cb2World::GetControllerList()
+{
+	return m_controllerList;
+}
+
+inline const cb2Controller* cb2World::GetControllerList() const
+{
+	return m_controllerList;
+}
+
+inline cb2ParticleSystem* cb2World::GetParticleSystemList()
+{
+	return m_particleSystemList;
+}
+
+inline const cb2ParticleSystem* cb2World::GetParticleSystemList() const
+{
+	return m_particleSystemList;
+}
+
 inline cb2Contact* cb2World::GetContactList()
 {
 	return m_contactManager.m_contactList;
@@ -293,6 +1273,36 @@ inline const cb2Contact* cb2World::GetContactList() const
 	return m_contactManager.m_contactList;
 }
 
+inline cb2Body* cb2World::GetBody(cb2Handle handle)
+{
+	return (cb2Body*)m_bodyHandles.Get(handle);
+}
+
+inline const cb2Body* cb2World::GetBody(cb2Handle handle) const
+{
+	return (const cb2Body*)m_bodyHandles.Get(handle);
+}
+
+inline cb2Fixture* cb2World::GetFixture(cb2Handle handle)
+{
+	return (cb2Fixture*)m_fixtureHandles.Get(handle);
+}
+
+inline const cb2Fixture* cb2World::GetFixture(cb2Handle handle) const
+{
+	return (const cb2Fixture*)m_fixtureHandles.Get(handle);
+}
+
+inline cb2Joint* cb2World::GetJoint(cb2Handle handle)
+{
+	return (cb2Joint*)m_jointHandles.Get(handle);
+}
+
+inline const cb2Joint* cb2World::GetJoint(cb2Handle handle) const
+{
+	return (const cb2Joint*)m_jointHandles.Get(handle);
+}
+
 inline int cb2World::GetBodyCount() const
 {
 	return m_bodyCount;
@@ -303,6 +1313,16 @@ inline int cb2World::GetJointCount() const
 	return m_jointCount;
 }
 
+inline int cb2World::GetControllerCount() const
+{
+	return m_controllerCount;
+}
+
+inline int cb2World::GetParticleSystemCount() const
+{
+	return m_particleSystemCount;
+}
+
 inline int cb2World::GetContactCount() const
 {
 	return m_contactManager.m_contactCount;
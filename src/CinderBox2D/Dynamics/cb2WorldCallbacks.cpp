@@ -34,3 +34,28 @@ bool cb2ContactFilter::ShouldCollide(cb2Fixture* fixtureA, cb2Fixture* fixtureB)
 	bool collide = (filterA.maskBits & filterB.categoryBits) != 0 && (filterA.categoryBits & filterB.maskBits) != 0;
 	return collide;
 }
+
+bool cb2QueryFilter::ShouldQuery(const cb2Fixture* fixture) const
+{
+	const cb2Filter& filter = fixture->GetFilterData();
+	if ((filter.categoryBits & maskBits) == 0 || (filter.maskBits & categoryBits) == 0)
+	{
+		return false;
+	}
+
+	if (skipSensors && fixture->IsSensor())
+	{
+		return false;
+	}
+
+	const cb2Body* body = fixture->GetBody();
+	for (int i = 0; i < ignoreBodyCount; ++i)
+	{
+		if (ignoreBodies[i] == body)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
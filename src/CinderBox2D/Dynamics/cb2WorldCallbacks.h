@@ -21,6 +21,7 @@
 
 #include <CinderBox2D/Common/cb2Settings.h>
 #include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2HandleTable.h>
 
 class cb2Fixture;
 class cb2Body;
@@ -58,6 +59,115 @@ public:
 	virtual bool ShouldCollide(cb2Fixture* fixtureA, cb2Fixture* fixtureB);
 };
 
+/// Implement this class to step islands that matter less, such as ones far from the
+/// camera or the players, at a reduced rate. See cb2World::SetLodListener.
+class cb2LodListener
+{
+public:
+	virtual ~cb2LodListener() {}
+
+	/// Return the simulation detail level of an awake body, from 0 for full detail to
+	/// cb2_maxLodLevels - 1. An island takes the lowest level of its bodies. This is
+	/// called for the bodies of every awake island each step, so keep it cheap.
+	virtual int GetLodLevel(cb2Body* body) = 0;
+};
+
+/// How the islands of a simulation detail level are stepped.
+struct cb2LodDef
+{
+	cb2LodDef()
+	{
+		stepInterval = 1;
+		velocityIterations = 0;
+		positionIterations = 0;
+		continuous = true;
+	}
+
+	/// Solve the island every this many steps with the time step scaled to match.
+	/// The bodies don't move in between, and cb2_maxTranslation limits how far they
+	/// get per solve.
+	int stepInterval;
+
+	/// The iteration counts used instead of those passed to Step, 0 to keep them.
+	int velocityIterations;
+	int positionIterations;
+
+	/// Set this flag to false to skip continuous collision of the bodies, even bullets.
+	bool continuous;
+};
+
+/// How islands fall asleep, see cb2World::SetSleepDef. The defaults are the build
+/// settings.
+struct cb2SleepDef
+{
+	cb2SleepDef()
+	{
+		timeToSleep = cb2_timeToSleep;
+		linearTolerance = cb2_linearSleepTolerance;
+		angularTolerance = cb2_angularSleepTolerance;
+		energyTest = false;
+		wakeHopCount = 0;
+	}
+
+	/// The time an island must be still before it goes to sleep, in seconds.
+	float timeToSleep;
+
+	/// A body is still below these velocities, which cb2Body::SetSleepScale scales.
+	float linearTolerance;
+	float angularTolerance;
+
+	/// Test the kinetic energy of each island instead of each body. An island is still
+	/// while it holds no more energy than it would with every body at its tolerances,
+	/// and no body exceeds them by more than cb2_energySleepFactor. Piles then fall
+	/// asleep while a few of their bodies still jitter.
+	bool energyTest;
+
+	/// How many contact hops a wake spreads from the woken body, 0 wakes the whole
+	/// island. The rest of the island sleeps on and holds still like static bodies
+	/// do. The wake spreads this many hops further each step while the bodies at its
+	/// edge still move, so a box dropped on a large sleeping pile only wakes the
+	/// part of the pile it disturbs. Joints always wake their bodies together.
+	int wakeHopCount;
+};
+
+/// A time budget for cb2World::Step. Once the step has used a fraction of the budget
+/// it cuts the work that follows in stages, the first stages cost the least accuracy.
+/// cb2Profile::degradation reports the stages reached. The step still runs to the
+/// end, so it can take longer than the budget when the remaining work is heavy.
+struct cb2StepBudget
+{
+	cb2StepBudget()
+	{
+		milliseconds = 0.0f;
+		iterationFraction = 0.5f;
+		continuousFraction = 0.7f;
+		wakeFraction = 0.8f;
+		velocityIterations = 4;
+		positionIterations = 2;
+		wakeHopCount = 1;
+	}
+
+	/// The time the step should take, in milliseconds. 0 disables the budget.
+	float milliseconds;
+
+	/// The fractions of the budget after which the islands still to be solved use the
+	/// budget iteration counts, continuous collision is left to bullets, and bodies
+	/// wake only the part of a sleeping island near them. A fraction above 1 keeps
+	/// its stage off.
+	float iterationFraction;
+	float continuousFraction;
+	float wakeFraction;
+
+	/// The most iterations a degraded island gets. The soft step solver uses the
+	/// velocity iterations as its substep count.
+	int velocityIterations;
+	int positionIterations;
+
+	/// How many contact hops a degraded wake spreads, see cb2SleepDef::wakeHopCount.
+	/// The rest of the island wakes in the next steps while the woken part still moves.
+	int wakeHopCount;
+};
+
 /// Contact impulses for reporting. Impulses are used instead of forces because
 /// sub-step forces may approach infinity for rigid body collisions. These
 /// match up one-to-one with the contact points in cb2Manifold.
@@ -68,6 +178,91 @@ struct cb2ContactImpulse
 	int count;
 };
 
+/// A sensor began or ceased to overlap a fixture.
+/// @see cb2World::SetSensorEventBatching
+struct cb2SensorEvent
+{
+	/// The sensor fixture. If both fixtures are sensors this is fixture A of the contact.
+	cb2Handle sensor;
+
+	/// The other fixture.
+	cb2Handle visitor;
+
+	/// The children of the fixtures.
+	int sensorChildIndex;
+	int visitorChildIndex;
+
+	/// True if the overlap began, false if it ended.
+	bool begin;
+};
+
+/// Two fixtures began to touch.
+/// @see cb2World::SetContactEventBatching
+struct cb2ContactBeginEvent
+{
+	/// The fixtures of the contact and their children.
+	cb2Handle fixtureA;
+	cb2Handle fixtureB;
+	int childIndexA;
+	int childIndexB;
+
+	/// The middle of the contact points and the normal from A to B, in world coordinates.
+	ci::Vec2f point;
+	ci::Vec2f normal;
+
+	/// The speed at which the fixtures approached along the normal, in meters per second.
+	float approachSpeed;
+};
+
+/// Two fixtures ceased to touch, or their contact was destroyed while touching.
+/// @see cb2World::SetContactEventBatching
+struct cb2ContactEndEvent
+{
+	/// The handles may refer to fixtures that were destroyed.
+	cb2Handle fixtureA;
+	cb2Handle fixtureB;
+	int childIndexA;
+	int childIndexB;
+};
+
+/// Two fixtures began to touch faster than the hit event threshold and one of them
+/// has hit events enabled.
+/// @see cb2World::SetHitEventThreshold
+struct cb2ContactHitEvent
+{
+	cb2Handle fixtureA;
+	cb2Handle fixtureB;
+
+	/// The point and normal of the begin event.
+	ci::Vec2f point;
+	ci::Vec2f normal;
+
+	/// The speed at which the fixtures approached along the normal.
+	float approachSpeed;
+
+	/// The sum of the normal impulses of the contact points after the step.
+	float normalImpulse;
+};
+
+/// A joint broke and was destroyed by the step.
+/// @see cb2JointDef::breakForce
+struct cb2JointBreakEvent
+{
+	/// The handle of the destroyed joint, it no longer resolves.
+	cb2Handle joint;
+
+	/// The bodies the joint connected.
+	cb2Handle bodyA;
+	cb2Handle bodyB;
+
+	/// The user data of the joint.
+	void* userData;
+
+	/// The reaction force on body B and the torque that broke the joint.
+	ci::Vec2f force;
+	float torque;
+};
+
 /// Implement this class to get contact information. You can use these results for
 /// things like sounds and game logic. You can also get contact results by
 /// traversing the contact lists after the time step. However, you might miss
@@ -83,9 +278,13 @@ public:
 	virtual ~cb2ContactListener() {}
 
 	/// Called when two fixtures begin to touch.
+	/// Note: this is not called for sensors with cb2World::SetSensorEventBatching,
+	/// nor for other contacts with cb2World::SetContactEventBatching.
 	virtual void BeginContact(cb2Contact* contact) { CB2_NOT_USED(contact); }
 
 	/// Called when two fixtures cease to touch.
+	/// Note: this is not called for sensors with cb2World::SetSensorEventBatching,
+	/// nor for other contacts with cb2World::SetContactEventBatching.
 	virtual void EndContact(cb2Contact* contact) { CB2_NOT_USED(contact); }
 
 	/// This is called after a contact is updated. This allows you to inspect a
@@ -98,6 +297,7 @@ public:
 	/// Note: if you set the number of contact points to zero, you will not
 	/// get an EndContact callback. However, you may get a BeginContact callback
 	/// the next step.
+	/// Note: conveyor belts do not need this, see cb2FixtureDef::tangentSpeed.
 	virtual void PreSolve(cb2Contact* contact, const cb2Manifold* oldManifold)
 	{
 		CB2_NOT_USED(contact);
@@ -117,6 +317,40 @@ public:
 	}
 };
 
+/// Which fixtures a world query or ray-cast reports, see cb2World::QueryAABB and
+/// cb2World::RayCast. The filter is applied while the broad-phase is traversed,
+/// before the callback and before the ray meets the shape. Subtrees holding no
+/// category of maskBits are skipped whole. The default filter passes everything.
+struct cb2QueryFilter
+{
+	cb2QueryFilter()
+	{
+		categoryBits = 0xFFFF;
+		maskBits = 0xFFFF;
+		skipSensors = false;
+		ignoreBodies = NULL;
+		ignoreBodyCount = 0;
+	}
+
+	/// Return true if the query should report this fixture.
+	bool ShouldQuery(const cb2Fixture* fixture) const;
+
+	/// The categories of the query. A fixture is only found if its mask bits have one
+	/// of these, like a fixture that would collide with the query.
+	unsigned short categoryBits;
+
+	/// Only fixtures with a category bit in this mask are found.
+	unsigned short maskBits;
+
+	/// Skip the sensor fixtures.
+	bool skipSensors;
+
+	/// Skip the fixtures of these bodies, for example the shooter of a hitscan. The
+	/// list is searched for each candidate, so keep it short.
+	cb2Body* const* ignoreBodies;
+	int ignoreBodyCount;
+};
+
 /// Callback class for AABB queries.
 /// See cb2World::Query
 class cb2QueryCallback
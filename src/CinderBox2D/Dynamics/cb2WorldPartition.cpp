@@ -0,0 +1,633 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Dynamics/cb2WorldPartition.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <memory.h>
+#include <new>
+
+// "CB2P" and the message format version.
+static const unsigned int cb2_partitionMagic = 0x50324243;
+static const int cb2_partitionVersion = 1;
+
+// The records of a message.
+enum cb2PartitionRecord
+{
+	e_endRecord,
+	e_handOffRecord,
+	e_ghostCreateRecord,
+	e_ghostUpdateRecord,
+	e_ghostRemoveRecord
+};
+
+// The direction of a neighbour, 4 is the cell itself.
+static inline int cb2GetDirection(int dx, int dy)
+{
+	cb2Assert(-1 <= dx && dx <= 1 && -1 <= dy && dy <= 1);
+	return 3 * (dy + 1) + dx + 1;
+}
+
+static void cb2ComputeBodyAABB(cb2AABB* aabb, const cb2Body* body)
+{
+	const cb2Transform& xf = body->GetTransform();
+	aabb->lowerBound = body->GetWorldCenter();
+	aabb->upperBound = aabb->lowerBound;
+	for (const cb2Fixture* f = body->GetFixtureList(); f; f = f->GetNext())
+	{
+		const cb2Shape* shape = f->GetShape();
+		for (int i = 0; i < shape->GetChildCount(); ++i)
+		{
+			cb2AABB childAABB;
+			shape->ComputeAABB(&childAABB, xf, i);
+			aabb->Combine(childAABB);
+		}
+	}
+}
+
+cb2PartitionCell::cb2PartitionCell(const cb2PartitionDef* def, int x, int y, cb2PartitionTransport* transport)
+	: m_world(def->gravity)
+{
+	cb2Assert(def->cellSize > 2.0f * def->ghostMargin);
+	m_transport = transport;
+	m_listener = NULL;
+	m_cellSize = def->cellSize;
+	m_ghostMargin = def->ghostMargin;
+	m_x = x;
+	m_y = y;
+
+	m_bodies = NULL;
+	m_bodyCount = 0;
+	m_bodyCapacity = 0;
+}
+
+cb2PartitionCell::~cb2PartitionCell()
+{
+	cb2Free(m_bodies);
+}
+
+ci::Vec2f cb2PartitionCell::GetOrigin() const
+{
+	return ci::Vec2f(m_x * m_cellSize, m_y * m_cellSize);
+}
+
+cb2PartitionBody* cb2PartitionCell::Find(unsigned int id) const
+{
+	int low = 0;
+	int high = m_bodyCount;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (m_bodies[mid].id < id)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	if (low < m_bodyCount && m_bodies[low].id == id)
+	{
+		return m_bodies + low;
+	}
+	return NULL;
+}
+
+cb2PartitionBody* cb2PartitionCell::Insert(unsigned int id, cb2Body* body, bool ghost)
+{
+	if (m_bodyCount == m_bodyCapacity)
+	{
+		m_bodyCapacity = cb2Max(2 * m_bodyCapacity, 64);
+		cb2PartitionBody* bodies = (cb2PartitionBody*)cb2Alloc(m_bodyCapacity * sizeof(cb2PartitionBody));
+		if (m_bodyCount > 0)
+		{
+			memcpy(bodies, m_bodies, m_bodyCount * sizeof(cb2PartitionBody));
+		}
+		cb2Free(m_bodies);
+		m_bodies = bodies;
+	}
+
+	int index = m_bodyCount;
+	while (index > 0 && m_bodies[index - 1].id > id)
+	{
+		--index;
+	}
+	cb2Assert(index == 0 || m_bodies[index - 1].id != id);
+
+	memmove(m_bodies + index + 1, m_bodies + index, (m_bodyCount - index) * sizeof(cb2PartitionBody));
+	++m_bodyCount;
+
+	cb2PartitionBody* entry = m_bodies + index;
+	entry->id = id;
+	entry->body = body;
+	entry->ghostMask = 0;
+	entry->ghost = ghost;
+	entry->awake = body->IsAwake();
+	return entry;
+}
+
+void cb2PartitionCell::Remove(cb2PartitionBody* entry)
+{
+	int index = (int)(entry - m_bodies);
+	cb2Assert(0 <= index && index < m_bodyCount);
+	--m_bodyCount;
+	memmove(m_bodies + index, m_bodies + index + 1, (m_bodyCount - index) * sizeof(cb2PartitionBody));
+}
+
+void cb2PartitionCell::AddBody(cb2Body* body, unsigned int id)
+{
+	cb2Assert(body->GetWorld() == &m_world);
+	cb2Assert(Find(id) == NULL);
+	Insert(id, body, false);
+}
+
+void cb2PartitionCell::DestroyBody(unsigned int id)
+{
+	cb2PartitionBody* entry = Find(id);
+	cb2Assert(entry != NULL && entry->ghost == false);
+	if (entry == NULL || entry->ghost)
+	{
+		return;
+	}
+
+	for (int direction = 0; direction < 9; ++direction)
+	{
+		if (entry->ghostMask & (1 << direction))
+		{
+			cb2Snapshot* message = BeginMessage(direction);
+			message->Write((int)e_ghostRemoveRecord);
+			message->Write(id);
+		}
+	}
+
+	if (m_listener)
+	{
+		m_listener->BodyRemoved(this, entry->body, id, false);
+	}
+
+	m_world.DestroyBody(entry->body);
+	Remove(entry);
+}
+
+cb2Body* cb2PartitionCell::FindBody(unsigned int id) const
+{
+	const cb2PartitionBody* entry = Find(id);
+	return entry ? entry->body : NULL;
+}
+
+bool cb2PartitionCell::IsGhost(unsigned int id) const
+{
+	const cb2PartitionBody* entry = Find(id);
+	return entry != NULL && entry->ghost;
+}
+
+void cb2PartitionCell::WriteHeader(cb2Snapshot* message)
+{
+	message->Write(cb2_partitionMagic);
+	message->Write(cb2_partitionVersion);
+	message->Write(m_x);
+	message->Write(m_y);
+}
+
+cb2Snapshot* cb2PartitionCell::BeginMessage(int direction)
+{
+	cb2Snapshot* message = m_messages + direction;
+	if (message->GetSize() == 0)
+	{
+		WriteHeader(message);
+	}
+	return message;
+}
+
+void cb2PartitionCell::WriteBody(cb2Snapshot* message, int type, unsigned int id, const cb2Body* body)
+{
+	m_scratch.Clear();
+	m_world.SaveBody(body, &m_scratch);
+
+	message->Write(type);
+	message->Write(id);
+	message->Write(m_scratch.GetSize());
+	message->Write(m_scratch.GetData(), m_scratch.GetSize());
+}
+
+// The body is copied out of the message, which may not be aligned.
+cb2Body* cb2PartitionCell::ReadBody(cb2Snapshot* message, const ci::Vec2f& offset)
+{
+	int size = message->ReadCount(1);
+	if (message->IsValid() == false || size == 0)
+	{
+		return NULL;
+	}
+
+	void* data = cb2Alloc(size);
+	message->Read(data, size);
+	cb2Snapshot snapshot(data, size);
+	cb2Body* body = m_world.LoadBody(&snapshot, offset);
+	cb2Free(data);
+	return body;
+}
+
+void cb2PartitionCell::HandOff(cb2PartitionBody* entry, int dx, int dy)
+{
+	cb2Body* body = entry->body;
+	unsigned int id = entry->id;
+	bool neighbour = cb2Abs(dx) <= 1 && cb2Abs(dy) <= 1;
+	int target = neighbour ? cb2GetDirection(dx, dy) : -1;
+
+	if (neighbour)
+	{
+		WriteBody(BeginMessage(target), e_handOffRecord, id, body);
+	}
+	else
+	{
+		// A body that skipped a cell gets a message of its own.
+		cb2Snapshot message;
+		WriteHeader(&message);
+		WriteBody(&message, e_handOffRecord, id, body);
+		message.Write((int)e_endRecord);
+		m_transport->Send(m_x + dx, m_y + dy, message.GetData(), message.GetSize());
+	}
+
+	// The other ghosts followed this cell, the new owner makes its own.
+	for (int direction = 0; direction < 9; ++direction)
+	{
+		if (direction != target && (entry->ghostMask & (1 << direction)))
+		{
+			cb2Snapshot* message = BeginMessage(direction);
+			message->Write((int)e_ghostRemoveRecord);
+			message->Write(id);
+		}
+	}
+
+	if (m_listener)
+	{
+		m_listener->BodyRemoved(this, body, id, false);
+	}
+
+	if (neighbour)
+	{
+		// The body stays as a ghost of its new owner, which removes it when it is far.
+		body->SetType(cb2_kinematicBody);
+		entry->ghost = true;
+		entry->ghostMask = 0;
+		if (m_listener)
+		{
+			m_listener->BodyAdded(this, body, id, true);
+		}
+	}
+	else
+	{
+		m_world.DestroyBody(body);
+		Remove(entry);
+	}
+}
+
+void cb2PartitionCell::Exchange()
+{
+	cb2Assert(m_world.IsLocked() == false);
+
+	// Back to front, as hand offs may remove entries.
+	for (int i = m_bodyCount - 1; i >= 0; --i)
+	{
+		cb2PartitionBody* entry = m_bodies + i;
+		if (entry->ghost)
+		{
+			continue;
+		}
+
+		cb2Body* body = entry->body;
+		ci::Vec2f center = body->GetWorldCenter();
+		int dx = (int)floorf(center.x / m_cellSize);
+		int dy = (int)floorf(center.y / m_cellSize);
+		if ((dx != 0 || dy != 0) && body->GetJointList() == NULL)
+		{
+			HandOff(entry, dx, dy);
+			continue;
+		}
+
+		// Sleeping bodies send one more update, so their ghosts stop as well.
+		bool awake = body->IsAwake();
+		bool update = awake || entry->awake;
+		entry->awake = awake;
+
+		cb2AABB aabb;
+		cb2ComputeBodyAABB(&aabb, body);
+
+		for (int direction = 0; direction < 9; ++direction)
+		{
+			int nx = direction % 3 - 1;
+			int ny = direction / 3 - 1;
+			if (nx == 0 && ny == 0)
+			{
+				continue;
+			}
+
+			cb2AABB border;
+			border.lowerBound.set(nx * m_cellSize - m_ghostMargin, ny * m_cellSize - m_ghostMargin);
+			border.upperBound.set((nx + 1) * m_cellSize + m_ghostMargin, (ny + 1) * m_cellSize + m_ghostMargin);
+			bool near = cb2TestOverlap(aabb, border);
+
+			int bit = 1 << direction;
+			if (near && (entry->ghostMask & bit) == 0)
+			{
+				WriteBody(BeginMessage(direction), e_ghostCreateRecord, entry->id, body);
+				entry->ghostMask |= bit;
+			}
+			else if (near && update)
+			{
+				const cb2Transform& xf = body->GetTransform();
+				cb2Snapshot* message = BeginMessage(direction);
+				message->Write((int)e_ghostUpdateRecord);
+				message->Write(entry->id);
+				message->Write(xf.p);
+				message->Write(body->GetAngle());
+				message->Write(body->GetLinearVelocity());
+				message->Write(body->GetAngularVelocity());
+				message->Write(awake);
+			}
+			else if (near == false && (entry->ghostMask & bit))
+			{
+				cb2Snapshot* message = BeginMessage(direction);
+				message->Write((int)e_ghostRemoveRecord);
+				message->Write(entry->id);
+				entry->ghostMask &= ~bit;
+			}
+		}
+	}
+
+	Flush();
+}
+
+void cb2PartitionCell::Flush()
+{
+	for (int direction = 0; direction < 9; ++direction)
+	{
+		cb2Snapshot* message = m_messages + direction;
+		if (message->GetSize() == 0)
+		{
+			continue;
+		}
+
+		message->Write((int)e_endRecord);
+		m_transport->Send(m_x + direction % 3 - 1, m_y + direction / 3 - 1, message->GetData(), message->GetSize());
+		message->Clear();
+	}
+}
+
+bool cb2PartitionCell::Receive(const void* data, int size)
+{
+	cb2Assert(m_world.IsLocked() == false);
+
+	cb2Snapshot message(data, size);
+	unsigned int magic = message.Read<unsigned int>();
+	int version = message.Read<int>();
+	int x = message.Read<int>();
+	int y = message.Read<int>();
+	if (message.IsValid() == false || magic != cb2_partitionMagic || version != cb2_partitionVersion)
+	{
+		return false;
+	}
+
+	// The sender's co-ordinates are moved to this cell's origin. They come from the
+	// message, so the difference is taken in 64 bits where it cannot overflow.
+	long long dx = (long long)x - m_x;
+	long long dy = (long long)y - m_y;
+	ci::Vec2f offset((float)dx * m_cellSize, (float)dy * m_cellSize);
+	bool neighbour = -1 <= dx && dx <= 1 && -1 <= dy && dy <= 1 && (dx != 0 || dy != 0);
+	int sender = neighbour ? cb2GetDirection((int)dx, (int)dy) : -1;
+
+	for (;;)
+	{
+		int type = message.Read<int>();
+		if (message.IsValid() == false)
+		{
+			return false;
+		}
+
+		if (type == e_endRecord)
+		{
+			return true;
+		}
+
+		unsigned int id = message.Read<unsigned int>();
+		switch (type)
+		{
+		case e_handOffRecord:
+		case e_ghostCreateRecord:
+			{
+				cb2Body* body = ReadBody(&message, offset);
+				if (body == NULL)
+				{
+					return false;
+				}
+
+				cb2PartitionBody* entry = Find(id);
+				bool ghost = type == e_ghostCreateRecord;
+				if (ghost)
+				{
+					if (entry && entry->ghost == false)
+					{
+						// This cell took the body over since the ghost was sent.
+						m_world.DestroyBody(body);
+						break;
+					}
+					body->SetType(cb2_kinematicBody);
+				}
+
+				if (entry)
+				{
+					if (m_listener)
+					{
+						m_listener->BodyRemoved(this, entry->body, id, entry->ghost);
+					}
+					m_world.DestroyBody(entry->body);
+					Remove(entry);
+				}
+
+				entry = Insert(id, body, ghost);
+				if (ghost == false && sender >= 0)
+				{
+					// The sender keeps the body as a ghost.
+					entry->ghostMask = 1 << sender;
+				}
+
+				if (m_listener)
+				{
+					m_listener->BodyAdded(this, body, id, ghost);
+				}
+			}
+			break;
+
+		case e_ghostUpdateRecord:
+			{
+				ci::Vec2f position = message.Read<ci::Vec2f>();
+				float angle = message.Read<float>();
+				ci::Vec2f linearVelocity = message.Read<ci::Vec2f>();
+				float angularVelocity = message.Read<float>();
+				bool awake = message.ReadBool();
+				cb2PartitionBody* entry = Find(id);
+				if (message.IsValid() && entry && entry->ghost)
+				{
+					cb2Body* body = entry->body;
+					body->SetTransform(position + offset, angle);
+					body->SetLinearVelocity(linearVelocity);
+					body->SetAngularVelocity(angularVelocity);
+					body->SetAwake(awake);
+				}
+			}
+			break;
+
+		case e_ghostRemoveRecord:
+			{
+				cb2PartitionBody* entry = Find(id);
+				if (entry && entry->ghost)
+				{
+					if (m_listener)
+					{
+						m_listener->BodyRemoved(this, entry->body, id, true);
+					}
+					m_world.DestroyBody(entry->body);
+					Remove(entry);
+				}
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+}
+
+cb2WorldPartition::cb2WorldPartition(const cb2PartitionDef* def)
+{
+	m_def = *def;
+	m_listener = NULL;
+
+	m_cells = NULL;
+	m_cellCount = 0;
+	m_cellCapacity = 0;
+
+	m_pending = NULL;
+	m_pendingCount = 0;
+	m_pendingCapacity = 0;
+}
+
+cb2WorldPartition::~cb2WorldPartition()
+{
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		m_cells[i]->~cb2PartitionCell();
+		cb2Free(m_cells[i]);
+	}
+	cb2Free(m_cells);
+	cb2Free(m_pending);
+}
+
+cb2PartitionCell* cb2WorldPartition::GetCell(int x, int y)
+{
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		if (m_cells[i]->GetX() == x && m_cells[i]->GetY() == y)
+		{
+			return m_cells[i];
+		}
+	}
+
+	if (m_cellCount == m_cellCapacity)
+	{
+		m_cellCapacity = cb2Max(2 * m_cellCapacity, 16);
+		cb2PartitionCell** cells = (cb2PartitionCell**)cb2Alloc(m_cellCapacity * sizeof(cb2PartitionCell*));
+		if (m_cellCount > 0)
+		{
+			memcpy(cells, m_cells, m_cellCount * sizeof(cb2PartitionCell*));
+		}
+		cb2Free(m_cells);
+		m_cells = cells;
+	}
+
+	void* mem = cb2Alloc(sizeof(cb2PartitionCell));
+	cb2PartitionCell* cell = new (mem) cb2PartitionCell(&m_def, x, y, this);
+	cell->SetListener(m_listener);
+	m_cells[m_cellCount++] = cell;
+	return cell;
+}
+
+cb2PartitionCell* cb2WorldPartition::GetCellAt(const ci::Vec2f& point)
+{
+	return GetCell((int)floorf(point.x / m_def.cellSize), (int)floorf(point.y / m_def.cellSize));
+}
+
+void cb2WorldPartition::SetListener(cb2PartitionListener* listener)
+{
+	m_listener = listener;
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		m_cells[i]->SetListener(listener);
+	}
+}
+
+void cb2WorldPartition::Send(int x, int y, const void* data, int size)
+{
+	if (m_pendingCount == m_pendingCapacity)
+	{
+		m_pendingCapacity = cb2Max(2 * m_pendingCapacity, 64);
+		cb2PartitionMessage* pending = (cb2PartitionMessage*)cb2Alloc(m_pendingCapacity * sizeof(cb2PartitionMessage));
+		if (m_pendingCount > 0)
+		{
+			memcpy(pending, m_pending, m_pendingCount * sizeof(cb2PartitionMessage));
+		}
+		cb2Free(m_pending);
+		m_pending = pending;
+	}
+
+	cb2PartitionMessage* message = m_pending + m_pendingCount++;
+	message->x = x;
+	message->y = y;
+	message->offset = m_queue.GetSize();
+	message->size = size;
+	m_queue.Write(data, size);
+}
+
+void cb2WorldPartition::Step(float timeStep, int velocityIterations, int positionIterations)
+{
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		m_cells[i]->GetWorld()->Step(timeStep, velocityIterations, positionIterations);
+	}
+
+	// All cells send before any receives, as they would across machines.
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		m_cells[i]->Exchange();
+	}
+
+	const unsigned char* queue = (const unsigned char*)m_queue.GetData();
+	for (int i = 0; i < m_pendingCount; ++i)
+	{
+		const cb2PartitionMessage& message = m_pending[i];
+		bool valid = GetCell(message.x, message.y)->Receive(queue + message.offset, message.size);
+		cb2Assert(valid);
+		CB2_NOT_USED(valid);
+	}
+
+	m_queue.Clear();
+	m_pendingCount = 0;
+}
@@ -0,0 +1,256 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_WORLD_PARTITION_H
+#define CB2_WORLD_PARTITION_H
+
+#include <CinderBox2D/Common/cb2Math.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+
+class cb2PartitionCell;
+
+/// A partition definition. Every cell of a partition must use the same one.
+struct cb2PartitionDef
+{
+	/// The constructor sets the default partition definition values.
+	cb2PartitionDef()
+	{
+		gravity.set(0.0f, -10.0f);
+		cellSize = 256.0f;
+		ghostMargin = 8.0f;
+	}
+
+	/// The gravity of the cell worlds.
+	ci::Vec2f gravity;
+
+	/// The width and height of a cell, in meters.
+	float cellSize;
+
+	/// A body gets a ghost in a neighbouring cell when its AABB comes this close to
+	/// the cell. This should cover the distance bodies move between exchanges.
+	float ghostMargin;
+};
+
+/// Carries the messages between the cells of a partition, for example over sockets
+/// to the servers of the neighbouring cells.
+class cb2PartitionTransport
+{
+public:
+	virtual ~cb2PartitionTransport() {}
+
+	/// Send a message to the cell at (x, y), to be passed to its
+	/// cb2PartitionCell::Receive. The data is only valid during the call.
+	virtual void Send(int x, int y, const void* data, int size) = 0;
+};
+
+/// Tells the application about the bodies that come and go through a cell, so it can
+/// set their user data. A body handed to another cell while it stays close is
+/// removed as an owned body and added back as a ghost.
+class cb2PartitionListener
+{
+public:
+	virtual ~cb2PartitionListener() {}
+
+	/// A body was handed to this cell, or a ghost of a body was created.
+	virtual void BodyAdded(cb2PartitionCell* cell, cb2Body* body, unsigned int id, bool ghost)
+	{
+		CB2_NOT_USED(cell);
+		CB2_NOT_USED(body);
+		CB2_NOT_USED(id);
+		CB2_NOT_USED(ghost);
+	}
+
+	/// A body is about to be destroyed or handed to another cell.
+	virtual void BodyRemoved(cb2PartitionCell* cell, cb2Body* body, unsigned int id, bool ghost)
+	{
+		CB2_NOT_USED(cell);
+		CB2_NOT_USED(body);
+		CB2_NOT_USED(id);
+		CB2_NOT_USED(ghost);
+	}
+};
+
+/// A body of a cell. This is an internal struct.
+struct cb2PartitionBody
+{
+	unsigned int id;
+	cb2Body* body;
+	int ghostMask;		// the neighbours that have a ghost of an owned body
+	bool ghost;
+	bool awake;			// the awake state last sent to the ghosts
+};
+
+/// One cell of a world that is split into a grid of square cells, each simulated by
+/// its own cb2World, possibly in another process. The world of a cell has its origin
+/// at the lower corner of the cell, so every cell keeps small co-ordinates.
+///
+/// Each body is owned by the cell that holds its center of mass. Bodies near the
+/// border of a neighbour are mirrored there as kinematic ghosts that follow the
+/// owner, so the bodies of both cells collide with them. A body whose center moves
+/// into another cell is handed to that cell with cb2World::SaveBody and LoadBody,
+/// moved by the offset between the cell origins, and becomes a ghost where it was.
+///
+/// After each step call Exchange, which sends one message to each neighbour that
+/// needs one, and pass the messages of the neighbours to Receive before the next
+/// step. Bodies with joints are never handed off, as joints cannot span cells. Static
+/// level geometry is best created in every cell it covers without AddBody.
+class cb2PartitionCell
+{
+public:
+	/// @param def the partition, no reference to it is retained.
+	/// @param x the column of the cell.
+	/// @param y the row of the cell.
+	/// @param transport where the messages to the other cells go.
+	cb2PartitionCell(const cb2PartitionDef* def, int x, int y, cb2PartitionTransport* transport);
+	~cb2PartitionCell();
+
+	/// Get the world of the cell.
+	cb2World* GetWorld() { return &m_world; }
+	const cb2World* GetWorld() const { return &m_world; }
+
+	/// Get the column and row of the cell.
+	int GetX() const { return m_x; }
+	int GetY() const { return m_y; }
+
+	/// Get the position of the world origin of the cell in the partition.
+	ci::Vec2f GetOrigin() const;
+
+	/// Register a listener for the bodies that come and go.
+	void SetListener(cb2PartitionListener* listener) { m_listener = listener; }
+
+	/// Let the partition manage a body of the world of this cell. The cell owns it
+	/// until it is handed to another cell.
+	/// @param id an id of the body that is unique across all cells.
+	void AddBody(cb2Body* body, unsigned int id);
+
+	/// Destroy a body owned by this cell together with its ghosts.
+	void DestroyBody(unsigned int id);
+
+	/// Find a body, owned or ghost, by id. Returns NULL if the cell does not have it.
+	cb2Body* FindBody(unsigned int id) const;
+
+	/// Is the body with this id a ghost in this cell?
+	bool IsGhost(unsigned int id) const;
+
+	/// Get the number of bodies of the cell, owned and ghosts.
+	int GetBodyCount() const { return m_bodyCount; }
+
+	/// Hand off the bodies that left the cell and send the ghost states to the
+	/// neighbours.
+	/// @warning Don't call this during Step.
+	void Exchange();
+
+	/// Apply a message sent by another cell.
+	/// @return false for a bad message, the part before the bad data is applied.
+	/// @warning Don't call this during Step.
+	bool Receive(const void* data, int size);
+
+private:
+
+	cb2PartitionCell(const cb2PartitionCell&);
+	cb2PartitionCell& operator=(const cb2PartitionCell&);
+
+	cb2PartitionBody* Find(unsigned int id) const;
+	cb2PartitionBody* Insert(unsigned int id, cb2Body* body, bool ghost);
+	void Remove(cb2PartitionBody* entry);
+
+	void HandOff(cb2PartitionBody* entry, int dx, int dy);
+	cb2Snapshot* BeginMessage(int direction);
+	void WriteHeader(cb2Snapshot* message);
+	void WriteBody(cb2Snapshot* message, int type, unsigned int id, const cb2Body* body);
+	cb2Body* ReadBody(cb2Snapshot* message, const ci::Vec2f& offset);
+	void Flush();
+
+	cb2World m_world;
+	cb2PartitionTransport* m_transport;
+	cb2PartitionListener* m_listener;
+	float m_cellSize;
+	float m_ghostMargin;
+	int m_x;
+	int m_y;
+
+	// Sorted by id.
+	cb2PartitionBody* m_bodies;
+	int m_bodyCount;
+	int m_bodyCapacity;
+
+	// The message to each of the eight neighbours, indexed by direction.
+	cb2Snapshot m_messages[9];
+	cb2Snapshot m_scratch;
+};
+
+/// A partition whose cells all live in this process and pass their messages
+/// directly, created as bodies reach them. Use it to run a partition on one
+/// machine, or to test a transport through cb2PartitionCell.
+class cb2WorldPartition : public cb2PartitionTransport
+{
+public:
+	/// @param def the partition, no reference to it is retained.
+	cb2WorldPartition(const cb2PartitionDef* def);
+	~cb2WorldPartition();
+
+	/// Get the cell at a column and row, creating it if it does not exist yet.
+	cb2PartitionCell* GetCell(int x, int y);
+
+	/// Get the cell that holds a point of the partition, creating it if needed.
+	cb2PartitionCell* GetCellAt(const ci::Vec2f& point);
+
+	/// Get the number of cells.
+	int GetCellCount() const { return m_cellCount; }
+
+	/// Get a cell by index, in the order they were created.
+	cb2PartitionCell* GetCellByIndex(int index) { return m_cells[index]; }
+
+	/// Register a listener for all cells, including the ones created later.
+	void SetListener(cb2PartitionListener* listener);
+
+	/// Step every cell, then exchange their messages.
+	void Step(float timeStep, int velocityIterations, int positionIterations);
+
+	/// Implements cb2PartitionTransport, the message is delivered at the end of Step.
+	void Send(int x, int y, const void* data, int size);
+
+private:
+
+	cb2WorldPartition(const cb2WorldPartition&);
+	cb2WorldPartition& operator=(const cb2WorldPartition&);
+
+	struct cb2PartitionMessage
+	{
+		int x;
+		int y;
+		int offset;
+		int size;
+	};
+
+	cb2PartitionDef m_def;
+	cb2PartitionListener* m_listener;
+
+	cb2PartitionCell** m_cells;
+	int m_cellCount;
+	int m_cellCapacity;
+
+	cb2Snapshot m_queue;
+	cb2PartitionMessage* m_pending;
+	int m_pendingCount;
+	int m_pendingCapacity;
+};
+
+#endif
@@ -0,0 +1,2650 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/cb2Island.h>
+#include <CinderBox2D/Dynamics/cb2StaticLayer.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
+#include <CinderBox2D/Dynamics/Joints/cb2DistanceJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2FrictionJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2GearJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MotorJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2MouseJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PrismaticJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2PulleyJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RevoluteJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2RopeJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WeldJoint.h>
+#include <CinderBox2D/Dynamics/Joints/cb2WheelJoint.h>
+#include <CinderBox2D/Collision/Shapes/cb2CircleShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2EdgeShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2ChainShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2HeightfieldShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2PolygonShape.h>
+#include <CinderBox2D/Collision/Shapes/cb2CapsuleShape.h>
+#include <CinderBox2D/Common/cb2Snapshot.h>
+#include <algorithm>
+
+// "CB2S" and the format version. Bump the version when the layout changes.
+static const unsigned int cb2_snapshotMagic = 0x53324243;
+static const int cb2_snapshotVersion = 10;
+
+// Snapshots store structures as they are in memory, so they only load into builds
+// where these agree.
+static const int cb2_snapshotLayout[] =
+{
+	sizeof(float),
+	sizeof(cb2Sweep),
+	sizeof(cb2Manifold),
+	sizeof(cb2SimplexCache),
+	sizeof(cb2TreeNode),
+	sizeof(cb2GridProxy),
+	cb2_maxPolygonVertices
+};
+
+static const int cb2_snapshotLayoutCount = sizeof(cb2_snapshotLayout) / sizeof(cb2_snapshotLayout[0]);
+
+// A pointer of the saved world with its place in the snapshot, sorted by pointer so
+// the save can look up what a joint, contact or island refers to.
+struct cb2SnapshotIndex
+{
+	bool operator<(const cb2SnapshotIndex& other) const
+	{
+		return (size_t)pointer < (size_t)other.pointer;
+	}
+
+	const void* pointer;
+	int index;
+};
+
+static int cb2FindSnapshotIndex(const cb2SnapshotIndex* indices, int count, const void* pointer)
+{
+	cb2SnapshotIndex key;
+	key.pointer = pointer;
+	key.index = -1;
+
+	const cb2SnapshotIndex* found = std::lower_bound(indices, indices + count, key);
+	cb2Assert(found != indices + count && found->pointer == pointer);
+	return found->index;
+}
+
+// The objects restored so far, in snapshot order, with the handles they had in the
+// saved world. They keep the handles of this world until the load succeeds.
+struct cb2SnapshotLoad
+{
+	cb2HandleTable* bodyHandleTable;
+	cb2HandleTable* fixtureHandleTable;
+	cb2HandleTable* jointHandleTable;
+
+	cb2Body** bodies;
+	cb2Handle* bodyHandles;
+	int bodyCount;
+	int bodyCapacity;
+
+	cb2Fixture** fixtures;
+	cb2Handle* fixtureHandles;
+	int fixtureCount;
+	int fixtureCapacity;
+
+	cb2Joint** joints;
+	cb2Handle* jointHandles;
+	int jointCount;
+	int jointCapacity;
+
+	cb2Contact** contacts;
+	int contactCount;
+	int contactCapacity;
+};
+
+// The shapes a fixture is loaded into. The fixture clones the one in use.
+struct cb2SnapshotShapes
+{
+	cb2CircleShape circle;
+	cb2EdgeShape edge;
+	cb2PolygonShape polygon;
+	cb2ChainShape chain;
+	cb2CapsuleShape capsule;
+	cb2HeightfieldShape heightfield;
+};
+
+static void cb2SaveShape(cb2Snapshot* snapshot, const cb2Shape* shape)
+{
+	snapshot->Write(shape->m_type);
+	snapshot->Write(shape->m_radius);
+
+	switch (shape->m_type)
+	{
+	case cb2Shape::e_circle:
+		{
+			const cb2CircleShape* circle = (const cb2CircleShape*)shape;
+			snapshot->Write(circle->m_p);
+		}
+		break;
+
+	case cb2Shape::e_edge:
+		{
+			const cb2EdgeShape* edge = (const cb2EdgeShape*)shape;
+			snapshot->Write(edge->m_vertex0);
+			snapshot->Write(edge->m_vertex1);
+			snapshot->Write(edge->m_vertex2);
+			snapshot->Write(edge->m_vertex3);
+			snapshot->Write(edge->m_hasVertex0);
+			snapshot->Write(edge->m_hasVertex3);
+		}
+		break;
+
+	case cb2Shape::e_polygon:
+		{
+			const cb2PolygonShape* polygon = (const cb2PolygonShape*)shape;
+			snapshot->Write(polygon->m_count);
+			snapshot->Write(polygon->m_centroid);
+			snapshot->Write(polygon->m_vertices, polygon->m_count * sizeof(ci::Vec2f));
+			snapshot->Write(polygon->m_normals, polygon->m_count * sizeof(ci::Vec2f));
+		}
+		break;
+
+	case cb2Shape::e_chain:
+		{
+			const cb2ChainShape* chain = (const cb2ChainShape*)shape;
+			snapshot->Write(chain->m_count);
+			snapshot->Write(chain->m_vertices, chain->m_count * sizeof(ci::Vec2f));
+			snapshot->Write(chain->m_prevVertex);
+			snapshot->Write(chain->m_nextVertex);
+			snapshot->Write(chain->m_hasPrevVertex);
+			snapshot->Write(chain->m_hasNextVertex);
+			snapshot->Write(chain->m_useEdgeTree);
+		}
+		break;
+
+	case cb2Shape::e_capsule:
+		{
+			const cb2CapsuleShape* capsule = (const cb2CapsuleShape*)shape;
+			snapshot->Write(capsule->m_vertex1);
+			snapshot->Write(capsule->m_vertex2);
+		}
+		break;
+
+	case cb2Shape::e_heightfield:
+		{
+			const cb2HeightfieldShape* heightfield = (const cb2HeightfieldShape*)shape;
+			snapshot->Write(heightfield->m_count);
+			snapshot->Write(heightfield->m_spacing);
+			snapshot->Write(heightfield->m_heights, heightfield->m_count * sizeof(float));
+			bool hasHoles = heightfield->m_holes != NULL;
+			snapshot->Write(hasHoles);
+			if (hasHoles)
+			{
+				snapshot->Write(heightfield->m_holes, (heightfield->m_count - 1) * sizeof(bool));
+			}
+		}
+		break;
+
+	default:
+		cb2Assert(false);
+		break;
+	}
+}
+
+// Returns the loaded shape, or NULL for a bad snapshot.
+static const cb2Shape* cb2LoadShape(cb2Snapshot* snapshot, cb2SnapshotShapes* shapes)
+{
+	cb2Shape::Type type = snapshot->ReadEnum<cb2Shape::Type>(cb2Shape::e_typeCount);
+	float radius = snapshot->Read<float>();
+
+	cb2Shape* shape = NULL;
+	switch (type)
+	{
+	case cb2Shape::e_circle:
+		{
+			cb2CircleShape* circle = &shapes->circle;
+			snapshot->Read(&circle->m_p, sizeof(ci::Vec2f));
+			shape = circle;
+		}
+		break;
+
+	case cb2Shape::e_edge:
+		{
+			cb2EdgeShape* edge = &shapes->edge;
+			snapshot->Read(&edge->m_vertex0, sizeof(ci::Vec2f));
+			snapshot->Read(&edge->m_vertex1, sizeof(ci::Vec2f));
+			snapshot->Read(&edge->m_vertex2, sizeof(ci::Vec2f));
+			snapshot->Read(&edge->m_vertex3, sizeof(ci::Vec2f));
+			edge->m_hasVertex0 = snapshot->ReadBool();
+			edge->m_hasVertex3 = snapshot->ReadBool();
+			shape = edge;
+		}
+		break;
+
+	case cb2Shape::e_polygon:
+		{
+			cb2PolygonShape* polygon = &shapes->polygon;
+			int count = snapshot->Read<int>();
+			if (count < 3 || count > cb2_maxPolygonVertices)
+			{
+				snapshot->Invalidate();
+				return NULL;
+			}
+
+			polygon->m_count = count;
+			snapshot->Read(&polygon->m_centroid, sizeof(ci::Vec2f));
+			snapshot->Read(polygon->m_vertices, count * sizeof(ci::Vec2f));
+			snapshot->Read(polygon->m_normals, count * sizeof(ci::Vec2f));
+			polygon->UpdateLanes();
+			shape = polygon;
+		}
+		break;
+
+	case cb2Shape::e_chain:
+		{
+			cb2ChainShape* chain = &shapes->chain;
+			int count = snapshot->ReadCount(sizeof(ci::Vec2f));
+			if (count < 2)
+			{
+				snapshot->Invalidate();
+				return NULL;
+			}
+
+			// The chain frees the vertices when it goes out of scope.
+			chain->m_vertices = (ci::Vec2f*)cb2Alloc(count * sizeof(ci::Vec2f));
+			chain->m_count = count;
+			snapshot->Read(chain->m_vertices, count * sizeof(ci::Vec2f));
+			snapshot->Read(&chain->m_prevVertex, sizeof(ci::Vec2f));
+			snapshot->Read(&chain->m_nextVertex, sizeof(ci::Vec2f));
+			chain->m_hasPrevVertex = snapshot->ReadBool();
+			chain->m_hasNextVertex = snapshot->ReadBool();
+			chain->m_useEdgeTree = snapshot->ReadBool();
+			shape = chain;
+		}
+		break;
+
+	case cb2Shape::e_capsule:
+		{
+			cb2CapsuleShape* capsule = &shapes->capsule;
+			snapshot->Read(&capsule->m_vertex1, sizeof(ci::Vec2f));
+			snapshot->Read(&capsule->m_vertex2, sizeof(ci::Vec2f));
+			shape = capsule;
+		}
+		break;
+
+	case cb2Shape::e_heightfield:
+		{
+			int count = snapshot->ReadCount(sizeof(float));
+			float spacing = snapshot->Read<float>();
+			if (count < 2 || (spacing > cb2_linearSlop) == false)
+			{
+				snapshot->Invalidate();
+				return NULL;
+			}
+
+			float* heights = (float*)cb2Alloc(count * sizeof(float));
+			snapshot->Read(heights, count * sizeof(float));
+
+			bool* holes = NULL;
+			if (snapshot->ReadBool())
+			{
+				holes = (bool*)cb2Alloc((count - 1) * sizeof(bool));
+				snapshot->Read(holes, (count - 1) * sizeof(bool));
+			}
+
+			cb2HeightfieldShape* heightfield = &shapes->heightfield;
+			heightfield->Create(heights, count, spacing, holes);
+			cb2Free(holes);
+			cb2Free(heights);
+			shape = heightfield;
+		}
+		break;
+
+	default:
+		snapshot->Invalidate();
+		return NULL;
+	}
+
+	shape->m_radius = radius;
+	return snapshot->IsValid() ? shape : NULL;
+}
+
+template <typename T>
+void cb2World::SaveIslandList(cb2Snapshot* snapshot, const T* list, const cb2SnapshotIndex* indices, int indexCount)
+{
+	int count = 0;
+	for (const T* item = list; item; item = item->m_islandNext)
+	{
+		++count;
+	}
+
+	snapshot->Write(count);
+	for (const T* item = list; item; item = item->m_islandNext)
+	{
+		snapshot->Write(cb2FindSnapshotIndex(indices, indexCount, item));
+	}
+}
+
+// Link items to the island in saved order.
+template <typename T>
+bool cb2World::LoadIslandList(cb2Snapshot* snapshot, cb2PersistentIsland* island, T** list, int* count,
+							T** items, int itemCount)
+{
+	int itemsInList = snapshot->ReadCount(sizeof(int));
+	T* tail = NULL;
+	for (int i = 0; i < itemsInList; ++i)
+	{
+		int index = snapshot->Read<int>();
+		if (snapshot->IsValid() == false || index < 0 || index >= itemCount || items[index]->m_island != NULL)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		T* item = items[index];
+		item->m_island = island;
+		item->m_islandPrev = tail;
+		item->m_islandNext = NULL;
+		if (tail)
+		{
+			tail->m_islandNext = item;
+		}
+		else
+		{
+			*list = item;
+		}
+		tail = item;
+		++*count;
+	}
+
+	return snapshot->IsValid();
+}
+
+void cb2World::SaveSnapshot(cb2Snapshot* snapshot) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(snapshot->IsLoading() == false);
+
+	snapshot->Write(cb2_snapshotMagic);
+	snapshot->Write(cb2_snapshotVersion);
+	snapshot->Write(cb2_snapshotLayout, sizeof(cb2_snapshotLayout));
+
+	snapshot->Write(m_flags & ~e_locked);
+	snapshot->Write(m_gravity);
+	snapshot->Write(m_allowSleep);
+	snapshot->Write(m_warmStarting);
+	snapshot->Write(m_continuousPhysics);
+	snapshot->Write(m_speculativeContacts);
+	snapshot->Write(m_subStepping);
+	snapshot->Write(m_softStepCount);
+	snapshot->Write(m_adaptiveIterations);
+	snapshot->Write(m_directJoints);
+	snapshot->Write(m_contactReduction);
+	snapshot->Write(m_tolerances);
+	snapshot->Write(m_sleepDef);
+	for (int i = 0; i < cb2_maxLodLevels; ++i)
+	{
+		snapshot->Write(m_lodDefs[i].stepInterval);
+		snapshot->Write(m_lodDefs[i].velocityIterations);
+		snapshot->Write(m_lodDefs[i].positionIterations);
+		snapshot->Write(m_lodDefs[i].continuous);
+	}
+	snapshot->Write(m_inv_dt0);
+	snapshot->Write(m_stepIndex);
+	snapshot->Write(m_stepComplete);
+	snapshot->Write(m_treeRebalanceBudget);
+	snapshot->Write(m_fixedTimeStep);
+	snapshot->Write(m_fixedVelocityIterations);
+	snapshot->Write(m_fixedPositionIterations);
+	snapshot->Write(m_maxFixedSteps);
+	snapshot->Write(m_accumulator);
+	snapshot->Write(m_contactManager.m_reuseLinearTolerance);
+	snapshot->Write(m_contactManager.m_reuseAngularTolerance);
+
+	m_bodyHandles.Save(snapshot);
+	m_fixtureHandles.Save(snapshot);
+	m_jointHandles.Save(snapshot);
+
+	// Lists are saved back to front. Loading pushes each object on the front of its
+	// list again, which restores the order.
+	int fixtureCount = 0;
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, cb2Max(m_bodyCount, 1) * sizeof(cb2Body*));
+	cb2SnapshotIndex* bodyIndices = (cb2SnapshotIndex*)cb2Alloc(m_allocator, cb2Max(m_bodyCount, 1) * sizeof(cb2SnapshotIndex));
+	int bodyIndex = m_bodyCount;
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		--bodyIndex;
+		bodies[bodyIndex] = b;
+		bodyIndices[bodyIndex].pointer = b;
+		bodyIndices[bodyIndex].index = bodyIndex;
+		fixtureCount += b->m_fixtureCount;
+	}
+	std::sort(bodyIndices, bodyIndices + m_bodyCount);
+
+	cb2Fixture** fixtures = (cb2Fixture**)cb2Alloc(m_allocator, cb2Max(fixtureCount, 1) * sizeof(cb2Fixture*));
+	cb2SnapshotIndex* fixtureIndices = (cb2SnapshotIndex*)cb2Alloc(m_allocator, cb2Max(fixtureCount, 1) * sizeof(cb2SnapshotIndex));
+
+	snapshot->Write(m_bodyCount);
+	snapshot->Write(fixtureCount);
+	int fixtureIndex = 0;
+	for (int i = 0; i < m_bodyCount; ++i)
+	{
+		const cb2Body* b = bodies[i];
+		snapshot->Write(b->m_type);
+		snapshot->Write(b->m_flags);
+		snapshot->Write(b->m_handle);
+		snapshot->Write(b->m_aggregate != NULL);
+		snapshot->Write(b->m_xf);
+		snapshot->Write(b->m_sweep);
+		snapshot->Write(b->m_linearVelocity);
+		snapshot->Write(b->m_angularVelocity);
+		snapshot->Write(b->m_force);
+		snapshot->Write(b->m_torque);
+		snapshot->Write(b->m_mass);
+		snapshot->Write(b->m_invMass);
+		snapshot->Write(b->m_I);
+		snapshot->Write(b->m_invI);
+		snapshot->Write(b->m_linearDamping);
+		snapshot->Write(b->m_angularDamping);
+		snapshot->Write(b->m_gravityScale);
+		snapshot->Write(b->m_sleepScale);
+		snapshot->Write(b->m_sleepTime);
+		snapshot->Write(b->m_moveStamp);
+		snapshot->Write(b->m_region);
+
+		int first = fixtureIndex;
+		fixtureIndex += b->m_fixtureCount;
+		int j = fixtureIndex;
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			--j;
+			fixtures[j] = f;
+			fixtureIndices[j].pointer = f;
+			fixtureIndices[j].index = j;
+		}
+		cb2Assert(j == first);
+
+		snapshot->Write(b->m_fixtureCount);
+		for (j = first; j < fixtureIndex; ++j)
+		{
+			const cb2Fixture* f = fixtures[j];
+			cb2SaveShape(snapshot, f->m_shape);
+			snapshot->Write(f->m_density);
+			snapshot->Write(f->m_friction);
+			snapshot->Write(f->m_restitution);
+			snapshot->Write(f->m_tangentSpeed);
+			snapshot->Write(f->m_filter);
+			snapshot->Write(f->m_isSensor);
+			snapshot->Write(f->m_enableContactEvents);
+			snapshot->Write(f->m_enableHitEvents);
+			snapshot->Write(f->m_handle);
+
+			snapshot->Write(f->m_proxyCount);
+			for (int k = 0; k < f->m_proxyCount; ++k)
+			{
+				const cb2FixtureProxy* proxy = f->m_proxies + k;
+				snapshot->Write(proxy->childIndex);
+				snapshot->Write(proxy->aabb);
+				snapshot->Write(proxy->proxyId);
+			}
+		}
+
+		if (b->m_aggregate)
+		{
+			b->m_aggregate->Save(snapshot);
+		}
+	}
+	std::sort(fixtureIndices, fixtureIndices + fixtureCount);
+
+	m_contactManager.m_broadPhase.Save(snapshot);
+
+	// Back to front is creation order, so the joints of a gear joint come first.
+	cb2SnapshotIndex* jointIndices = (cb2SnapshotIndex*)cb2Alloc(m_allocator, cb2Max(m_jointCount, 1) * sizeof(cb2SnapshotIndex));
+	cb2Joint** joints = (cb2Joint**)cb2Alloc(m_allocator, cb2Max(m_jointCount, 1) * sizeof(cb2Joint*));
+	int jointIndex = m_jointCount;
+	for (cb2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		--jointIndex;
+		joints[jointIndex] = j;
+		jointIndices[jointIndex].pointer = j;
+		jointIndices[jointIndex].index = jointIndex;
+	}
+	std::sort(jointIndices, jointIndices + m_jointCount);
+
+	snapshot->Write(m_jointCount);
+	for (int i = 0; i < m_jointCount; ++i)
+	{
+		cb2Joint* j = joints[i];
+		snapshot->Write(j->m_type);
+		snapshot->Write(cb2FindSnapshotIndex(bodyIndices, m_bodyCount, j->m_bodyA));
+		snapshot->Write(cb2FindSnapshotIndex(bodyIndices, m_bodyCount, j->m_bodyB));
+		snapshot->Write(j->m_collideConnected);
+		snapshot->Write(j->m_breakForce);
+		snapshot->Write(j->m_breakTorque);
+		snapshot->Write(j->m_handle);
+
+		if (j->m_type == e_gearJoint)
+		{
+			cb2GearJoint* gear = (cb2GearJoint*)j;
+			snapshot->Write(cb2FindSnapshotIndex(jointIndices, m_jointCount, gear->GetJoint1()));
+			snapshot->Write(cb2FindSnapshotIndex(jointIndices, m_jointCount, gear->GetJoint2()));
+		}
+
+		j->TransferState(snapshot);
+	}
+
+	int contactCount = m_contactManager.m_contactCount;
+	cb2Contact** contacts = (cb2Contact**)cb2Alloc(m_allocator, cb2Max(contactCount, 1) * sizeof(cb2Contact*));
+	cb2SnapshotIndex* contactIndices = (cb2SnapshotIndex*)cb2Alloc(m_allocator, cb2Max(contactCount, 1) * sizeof(cb2SnapshotIndex));
+	int contactIndex = contactCount;
+	for (cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	{
+		--contactIndex;
+		contacts[contactIndex] = c;
+		contactIndices[contactIndex].pointer = c;
+		contactIndices[contactIndex].index = contactIndex;
+	}
+	cb2Assert(contactIndex == 0);
+	std::sort(contactIndices, contactIndices + contactCount);
+
+	snapshot->Write(contactCount);
+	for (int i = 0; i < contactCount; ++i)
+	{
+		const cb2Contact* c = contacts[i];
+		snapshot->Write(cb2FindSnapshotIndex(fixtureIndices, fixtureCount, c->m_fixtureA));
+		snapshot->Write(c->m_indexA);
+		snapshot->Write(cb2FindSnapshotIndex(fixtureIndices, fixtureCount, c->m_fixtureB));
+		snapshot->Write(c->m_indexB);
+		snapshot->Write(c->m_flags & ~cb2Contact::e_awakeFlag);
+		snapshot->Write(*c->GetManifold());
+		snapshot->Write(c->m_relativeXf);
+		snapshot->Write(c->m_sensorSeparation);
+		snapshot->Write(c->m_sensorExtent);
+		snapshot->Write(c->m_toiCount);
+		snapshot->Write(c->m_toi);
+		snapshot->Write(c->m_simplexCache);
+		snapshot->Write(c->m_friction);
+		snapshot->Write(c->m_restitution);
+		snapshot->Write(c->m_tangentSpeed);
+	}
+
+	// The awake array is walked in order by the narrow phase.
+	snapshot->Write(m_contactManager.m_awakeContactCount);
+	for (int i = 0; i < m_contactManager.m_awakeContactCount; ++i)
+	{
+		const cb2Contact* c = m_contactManager.m_awakeContacts[i].contact;
+		snapshot->Write(cb2FindSnapshotIndex(contactIndices, contactCount, c));
+	}
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const cb2PersistentIsland* list = pass == 0 ? m_awakeIslandList : m_sleepingIslandList;
+
+		int islandCount = 0;
+		for (const cb2PersistentIsland* island = list; island; island = island->next)
+		{
+			++islandCount;
+		}
+
+		snapshot->Write(islandCount);
+		for (const cb2PersistentIsland* island = list; island; island = island->next)
+		{
+			snapshot->Write(island->constraintRemoveCount);
+			snapshot->Write(island->readyToSleep);
+			snapshot->Write(island->lodLevel);
+			snapshot->Write(island->lodStepCount);
+			snapshot->Write(island->lodDt);
+			SaveIslandList(snapshot, island->bodyList, bodyIndices, m_bodyCount);
+			SaveIslandList(snapshot, island->contactList, contactIndices, contactCount);
+			SaveIslandList(snapshot, island->jointList, jointIndices, m_jointCount);
+		}
+	}
+
+	cb2Free(m_allocator, contactIndices);
+	cb2Free(m_allocator, contacts);
+	cb2Free(m_allocator, joints);
+	cb2Free(m_allocator, jointIndices);
+	cb2Free(m_allocator, fixtureIndices);
+	cb2Free(m_allocator, fixtures);
+	cb2Free(m_allocator, bodyIndices);
+	cb2Free(m_allocator, bodies);
+}
+
+// Is a constraint in the island it would be linked to? That is the shared island of
+// its bodies if it links them at all, static bodies have none.
+static bool cb2CheckIslandLink(const cb2PersistentIsland* island, bool linked,
+							   const cb2PersistentIsland* islandA, const cb2PersistentIsland* islandB)
+{
+	if (island == NULL)
+	{
+		return linked == false || (islandA == NULL && islandB == NULL);
+	}
+
+	return linked && (islandA == island || islandA == NULL) && (islandB == island || islandB == NULL);
+}
+
+bool cb2World::LoadSnapshot(cb2Snapshot* snapshot)
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(snapshot->IsLoading());
+	cb2Assert(m_bodyCount == 0 && m_jointCount == 0);
+	if (IsLocked() || m_bodyCount > 0 || m_jointCount > 0)
+	{
+		return false;
+	}
+
+	int layout[cb2_snapshotLayoutCount];
+	unsigned int magic = snapshot->Read<unsigned int>();
+	int version = snapshot->Read<int>();
+	snapshot->Read(layout, sizeof(layout));
+	if (magic != cb2_snapshotMagic || version != cb2_snapshotVersion ||
+		memcmp(layout, cb2_snapshotLayout, sizeof(layout)) != 0)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	// The settings are applied once the load succeeded.
+	int flags = snapshot->Read<int>();
+	ci::Vec2f gravity = snapshot->Read<ci::Vec2f>();
+	bool allowSleep = snapshot->ReadBool();
+	bool warmStarting = snapshot->ReadBool();
+	bool continuousPhysics = snapshot->ReadBool();
+	bool speculativeContacts = snapshot->ReadBool();
+	bool subStepping = snapshot->ReadBool();
+	int softStepCount = snapshot->Read<int>();
+	bool adaptiveIterations = snapshot->ReadBool();
+	bool directJoints = snapshot->ReadBool();
+	bool contactReduction = snapshot->ReadBool();
+	cb2Tolerances tolerances = snapshot->Read<cb2Tolerances>();
+	cb2SleepDef sleepDef = snapshot->Read<cb2SleepDef>();
+	cb2LodDef lodDefs[cb2_maxLodLevels];
+	for (int i = 0; i < cb2_maxLodLevels; ++i)
+	{
+		lodDefs[i].stepInterval = snapshot->Read<int>();
+		lodDefs[i].velocityIterations = snapshot->Read<int>();
+		lodDefs[i].positionIterations = snapshot->Read<int>();
+		lodDefs[i].continuous = snapshot->ReadBool();
+		if (lodDefs[i].stepInterval < 1)
+		{
+			snapshot->Invalidate();
+		}
+	}
+	float inv_dt0 = snapshot->Read<float>();
+	unsigned int stepIndex = snapshot->Read<unsigned int>();
+	bool stepComplete = snapshot->ReadBool();
+	int treeRebalanceBudget = snapshot->Read<int>();
+	float fixedTimeStep = snapshot->Read<float>();
+	int fixedVelocityIterations = snapshot->Read<int>();
+	int fixedPositionIterations = snapshot->Read<int>();
+	int maxFixedSteps = snapshot->Read<int>();
+	float accumulator = snapshot->Read<float>();
+	float reuseLinearTolerance = snapshot->Read<float>();
+	float reuseAngularTolerance = snapshot->Read<float>();
+
+	// The saved handles are bound in tables of their own, which replace the tables of
+	// this world at the end. Until then the objects live under handles of this world,
+	// so a failed load can destroy them as usual.
+	cb2HandleTable bodyHandles(m_allocator);
+	cb2HandleTable fixtureHandles(m_allocator);
+	cb2HandleTable jointHandles(m_allocator);
+	if (snapshot->IsValid() == false || bodyHandles.Load(snapshot) == false ||
+		fixtureHandles.Load(snapshot) == false || jointHandles.Load(snapshot) == false)
+	{
+		snapshot->Invalidate();
+		return false;
+	}
+
+	// The broad-phase load is not atomic, keep the empty one to go back to.
+	cb2Snapshot emptyBroadPhase(m_allocator);
+	m_contactManager.m_broadPhase.Save(&emptyBroadPhase);
+
+	cb2SnapshotLoad load;
+	memset(&load, 0, sizeof(load));
+	load.bodyHandleTable = &bodyHandles;
+	load.fixtureHandleTable = &fixtureHandles;
+	load.jointHandleTable = &jointHandles;
+
+	bool loaded = LoadBodies(snapshot, &load) &&
+		m_contactManager.m_broadPhase.Load(snapshot) &&
+		LoadProxies(&load) &&
+		LoadJoints(snapshot, &load) &&
+		LoadContacts(snapshot, &load) &&
+		LoadIslands(snapshot, &load, true) &&
+		LoadIslands(snapshot, &load, false);
+
+	// Every body that is simulated must have its island.
+	for (int i = 0; loaded && i < load.bodyCount; ++i)
+	{
+		cb2Body* b = load.bodies[i];
+		bool simulated = b->m_type != cb2_staticBody && b->IsActive();
+		loaded = simulated == (b->m_island != NULL);
+	}
+
+	// The contacts and joints are in the island of their bodies, just where LinkContact
+	// and LinkJoint would have put them.
+	for (int i = 0; loaded && i < load.contactCount; ++i)
+	{
+		cb2Contact* c = load.contacts[i];
+		bool linked = c->IsTouching() && c->m_fixtureA->m_isSensor == false && c->m_fixtureB->m_isSensor == false;
+		loaded = cb2CheckIslandLink(c->m_island, linked, c->m_fixtureA->m_body->m_island, c->m_fixtureB->m_body->m_island);
+	}
+	for (int i = 0; loaded && i < load.jointCount; ++i)
+	{
+		cb2Joint* j = load.joints[i];
+		bool linked = j->m_bodyA->IsActive() && j->m_bodyB->IsActive();
+		loaded = cb2CheckIslandLink(j->m_island, linked, j->m_bodyA->m_island, j->m_bodyB->m_island);
+	}
+
+	if (loaded == false)
+	{
+		snapshot->Invalidate();
+
+		// Destroy what was restored without calling listeners or touching the
+		// broad-phase, then go back to the empty broad-phase.
+		cb2DestructionListener* destructionListener = m_destructionListener;
+		m_destructionListener = NULL;
+		for (cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+		{
+			c->m_flags &= ~cb2Contact::e_touchingFlag;
+		}
+		for (cb2Body* b = m_bodyList; b; b = b->m_next)
+		{
+			for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+			{
+				f->m_proxyCount = 0;
+			}
+		}
+		while (m_bodyList)
+		{
+			DestroyBody(m_bodyList);
+		}
+		while (m_awakeIslandList)
+		{
+			DestroyIsland(m_awakeIslandList);
+		}
+		while (m_sleepingIslandList)
+		{
+			DestroyIsland(m_sleepingIslandList);
+		}
+		m_destructionListener = destructionListener;
+
+		cb2Snapshot empty(emptyBroadPhase.GetData(), emptyBroadPhase.GetSize());
+		bool restored = m_contactManager.m_broadPhase.Load(&empty);
+		cb2Assert(restored);
+		CB2_NOT_USED(restored);
+
+		UnloadSnapshot(&load);
+		return false;
+	}
+
+	m_bodyHandles.Swap(&bodyHandles);
+	m_fixtureHandles.Swap(&fixtureHandles);
+	m_jointHandles.Swap(&jointHandles);
+	for (int i = 0; i < load.bodyCount; ++i)
+	{
+		load.bodies[i]->m_handle = load.bodyHandles[i];
+	}
+	for (int i = 0; i < load.fixtureCount; ++i)
+	{
+		load.fixtures[i]->m_handle = load.fixtureHandles[i];
+	}
+	for (int i = 0; i < load.jointCount; ++i)
+	{
+		load.joints[i]->m_handle = load.jointHandles[i];
+	}
+	UnloadSnapshot(&load);
+
+	m_flags = flags & ~e_locked;
+	m_gravity = gravity;
+	m_allowSleep = allowSleep;
+	m_warmStarting = warmStarting;
+	m_continuousPhysics = continuousPhysics;
+	m_speculativeContacts = speculativeContacts;
+	m_subStepping = subStepping;
+	m_softStepCount = softStepCount;
+	m_adaptiveIterations = adaptiveIterations;
+	m_directJoints = directJoints;
+	m_contactReduction = contactReduction;
+	m_tolerances = tolerances;
+	m_sleepDef = sleepDef;
+	for (int i = 0; i < cb2_maxLodLevels; ++i)
+	{
+		m_lodDefs[i] = lodDefs[i];
+	}
+	m_inv_dt0 = inv_dt0;
+	m_stepIndex = stepIndex;
+	m_stepComplete = stepComplete;
+	m_treeRebalanceBudget = treeRebalanceBudget;
+	m_fixedTimeStep = fixedTimeStep;
+	m_fixedVelocityIterations = fixedVelocityIterations;
+	m_fixedPositionIterations = fixedPositionIterations;
+	m_maxFixedSteps = maxFixedSteps;
+	m_accumulator = accumulator;
+	m_contactManager.m_reuseLinearTolerance = reuseLinearTolerance;
+	m_contactManager.m_reuseAngularTolerance = reuseAngularTolerance;
+
+	// The interpolated transforms are indexed by handle, which changed.
+	if (m_bodyTransforms)
+	{
+		cb2Free(m_allocator, m_bodyTransforms);
+		m_bodyTransforms = NULL;
+		m_bodyTransformCount = 0;
+		StoreBodyTransforms(true);
+		StoreBodyTransforms(false);
+	}
+
+	return true;
+}
+
+bool cb2World::LoadBodies(cb2Snapshot* snapshot, cb2SnapshotLoad* load)
+{
+	load->bodyCapacity = snapshot->ReadCount(sizeof(cb2Sweep));
+	load->fixtureCapacity = snapshot->ReadCount(sizeof(cb2Filter));
+	if (snapshot->IsValid() == false)
+	{
+		return false;
+	}
+
+	load->bodies = (cb2Body**)cb2Alloc(m_allocator, cb2Max(load->bodyCapacity, 1) * sizeof(cb2Body*));
+	load->bodyHandles = (cb2Handle*)cb2Alloc(m_allocator, cb2Max(load->bodyCapacity, 1) * sizeof(cb2Handle));
+	load->fixtures = (cb2Fixture**)cb2Alloc(m_allocator, cb2Max(load->fixtureCapacity, 1) * sizeof(cb2Fixture*));
+	load->fixtureHandles = (cb2Handle*)cb2Alloc(m_allocator, cb2Max(load->fixtureCapacity, 1) * sizeof(cb2Handle));
+
+	for (int i = 0; i < load->bodyCapacity; ++i)
+	{
+		cb2BodyType type = snapshot->ReadEnum<cb2BodyType>(cb2_dynamicBody + 1);
+		unsigned short flags = snapshot->Read<unsigned short>();
+		cb2Handle handle = snapshot->Read<cb2Handle>();
+		bool aggregate = snapshot->ReadBool();
+		if (snapshot->IsValid() == false)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		// Bodies are created inactive so that they get no proxies or island, the
+		// flags below may make them active again.
+		cb2BodyDef def;
+		def.type = type;
+		def.active = false;
+		def.aggregate = aggregate;
+		cb2Body* b = CreateBody(&def);
+		load->bodies[load->bodyCount] = b;
+		load->bodyHandles[load->bodyCount] = handle;
+		++load->bodyCount;
+		if (load->bodyHandleTable->Bind(handle, b) == false)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		b->m_flags = flags;
+		snapshot->Read(&b->m_xf, sizeof(cb2Transform));
+		snapshot->Read(&b->m_sweep, sizeof(cb2Sweep));
+		snapshot->Read(&b->m_linearVelocity, sizeof(ci::Vec2f));
+		b->m_angularVelocity = snapshot->Read<float>();
+		snapshot->Read(&b->m_force, sizeof(ci::Vec2f));
+		b->m_torque = snapshot->Read<float>();
+		b->m_mass = snapshot->Read<float>();
+		b->m_invMass = snapshot->Read<float>();
+		b->m_I = snapshot->Read<float>();
+		b->m_invI = snapshot->Read<float>();
+		b->m_linearDamping = snapshot->Read<float>();
+		b->m_angularDamping = snapshot->Read<float>();
+		b->m_gravityScale = snapshot->Read<float>();
+		b->m_sleepScale = snapshot->Read<float>();
+		b->m_sleepTime = snapshot->Read<float>();
+		b->m_moveStamp = snapshot->Read<unsigned int>();
+		b->m_region = snapshot->Read<int>();
+
+		int fixtureCount = snapshot->ReadCount(sizeof(cb2Filter));
+		if (snapshot->IsValid() == false || fixtureCount > load->fixtureCapacity - load->fixtureCount)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		for (int j = 0; j < fixtureCount; ++j)
+		{
+			cb2SnapshotShapes shapes;
+			cb2FixtureDef fd;
+			fd.shape = cb2LoadShape(snapshot, &shapes);
+			if (fd.shape == NULL)
+			{
+				return false;
+			}
+
+			fd.density = snapshot->Read<float>();
+			fd.friction = snapshot->Read<float>();
+			fd.restitution = snapshot->Read<float>();
+			fd.tangentSpeed = snapshot->Read<float>();
+			fd.filter = snapshot->Read<cb2Filter>();
+			fd.isSensor = snapshot->ReadBool();
+			fd.enableContactEvents = snapshot->ReadBool();
+			fd.enableHitEvents = snapshot->ReadBool();
+			cb2Handle fixtureHandle = snapshot->Read<cb2Handle>();
+			if (snapshot->IsValid() == false)
+			{
+				return false;
+			}
+
+			cb2Fixture* f = b->AddFixture(&fd);
+			load->fixtures[load->fixtureCount] = f;
+			load->fixtureHandles[load->fixtureCount] = fixtureHandle;
+			++load->fixtureCount;
+			if (load->fixtureHandleTable->Bind(fixtureHandle, f) == false)
+			{
+				snapshot->Invalidate();
+				return false;
+			}
+
+			// Active bodies have all their proxies, see cb2Fixture::CreateProxies.
+			int proxyCount = snapshot->Read<int>();
+			if (proxyCount != (b->IsActive() ? f->ComputeProxyCount() : 0))
+			{
+				snapshot->Invalidate();
+				return false;
+			}
+
+			f->m_proxyCount = proxyCount;
+			for (int k = 0; k < proxyCount; ++k)
+			{
+				cb2FixtureProxy* proxy = f->m_proxies + k;
+				proxy->fixture = f;
+				proxy->childIndex = snapshot->Read<int>();
+				snapshot->Read(&proxy->aabb, sizeof(cb2AABB));
+				proxy->proxyId = snapshot->Read<int>();
+			}
+		}
+
+		// The fixture proxies of an aggregate are in its tree.
+		if (b->m_aggregate && b->m_aggregate->Load(snapshot) == false)
+		{
+			return false;
+		}
+	}
+
+	return snapshot->IsValid();
+}
+
+// Give the loaded broad-phase proxies their fixture proxies as user data.
+bool cb2World::LoadProxies(cb2SnapshotLoad* load)
+{
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+
+	int proxyCount = 0;
+	for (int i = 0; i < load->fixtureCount; ++i)
+	{
+		cb2Fixture* f = load->fixtures[i];
+		for (int j = 0; j < f->m_proxyCount; ++j)
+		{
+			cb2FixtureProxy* proxy = f->m_proxies + j;
+			int childIndex = proxy->childIndex;
+			bool validChild = f->m_sharedProxy ? childIndex == cb2Shape::e_allChildren : childIndex == j;
+			if (validChild == false)
+			{
+				return false;
+			}
+
+			if (f->m_body->m_aggregate)
+			{
+				continue;
+			}
+
+			if (broadPhase->IsProxy(proxy->proxyId) == false ||
+				broadPhase->GetUserData(proxy->proxyId) != NULL)
+			{
+				return false;
+			}
+
+			broadPhase->SetUserData(proxy->proxyId, proxy);
+			++proxyCount;
+		}
+	}
+
+	for (int i = 0; i < load->bodyCount; ++i)
+	{
+		cb2BodyAggregate* aggregate = load->bodies[i]->m_aggregate;
+		if (aggregate == NULL || aggregate->m_proxy.proxyId == cb2BroadPhase::e_nullProxy)
+		{
+			continue;
+		}
+
+		int proxyId = aggregate->m_proxy.proxyId;
+		if (broadPhase->IsProxy(proxyId) == false || broadPhase->GetUserData(proxyId) != NULL)
+		{
+			return false;
+		}
+
+		broadPhase->SetUserData(proxyId, &aggregate->m_proxy);
+		++proxyCount;
+	}
+
+	return proxyCount == broadPhase->GetProxyCount();
+}
+
+bool cb2World::LoadJoints(cb2Snapshot* snapshot, cb2SnapshotLoad* load)
+{
+	load->jointCapacity = snapshot->ReadCount(3 * sizeof(int));
+	if (snapshot->IsValid() == false)
+	{
+		return false;
+	}
+
+	load->joints = (cb2Joint**)cb2Alloc(m_allocator, cb2Max(load->jointCapacity, 1) * sizeof(cb2Joint*));
+	load->jointHandles = (cb2Handle*)cb2Alloc(m_allocator, cb2Max(load->jointCapacity, 1) * sizeof(cb2Handle));
+
+	for (int i = 0; i < load->jointCapacity; ++i)
+	{
+		cb2JointType type = snapshot->ReadEnum<cb2JointType>(e_motorJoint + 1);
+		int indexA = snapshot->Read<int>();
+		int indexB = snapshot->Read<int>();
+		bool collideConnected = snapshot->ReadBool();
+		float breakForce = snapshot->Read<float>();
+		float breakTorque = snapshot->Read<float>();
+		cb2Handle handle = snapshot->Read<cb2Handle>();
+		if (snapshot->IsValid() == false || indexA < 0 || indexA >= load->bodyCount ||
+			indexB < 0 || indexB >= load->bodyCount || indexA == indexB)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		cb2Body* bodyA = load->bodies[indexA];
+		cb2Body* bodyB = load->bodies[indexB];
+
+		// The definitions only need to make a valid joint, its state is loaded after.
+		cb2Joint* joint = NULL;
+		switch (type)
+		{
+		case e_revoluteJoint:
+			{
+				cb2RevoluteJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_prismaticJoint:
+			{
+				cb2PrismaticJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_distanceJoint:
+			{
+				cb2DistanceJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_pulleyJoint:
+			{
+				cb2PulleyJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_mouseJoint:
+			{
+				cb2MouseJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_gearJoint:
+			{
+				int index1 = snapshot->Read<int>();
+				int index2 = snapshot->Read<int>();
+				if (snapshot->IsValid() == false || index1 < 0 || index1 >= load->jointCount ||
+					index2 < 0 || index2 >= load->jointCount)
+				{
+					snapshot->Invalidate();
+					return false;
+				}
+
+				cb2GearJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				def.joint1 = load->joints[index1];
+				def.joint2 = load->joints[index2];
+				cb2JointType type1 = def.joint1->GetType();
+				cb2JointType type2 = def.joint2->GetType();
+				if ((type1 != e_revoluteJoint && type1 != e_prismaticJoint) ||
+					(type2 != e_revoluteJoint && type2 != e_prismaticJoint))
+				{
+					snapshot->Invalidate();
+					return false;
+				}
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_wheelJoint:
+			{
+				cb2WheelJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_weldJoint:
+			{
+				cb2WeldJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_frictionJoint:
+			{
+				cb2FrictionJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_ropeJoint:
+			{
+				cb2RopeJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		case e_motorJoint:
+			{
+				cb2MotorJointDef def;
+				def.bodyA = bodyA;
+				def.bodyB = bodyB;
+				def.collideConnected = collideConnected;
+				joint = CreateJoint(&def);
+			}
+			break;
+
+		default:
+			snapshot->Invalidate();
+			return false;
+		}
+
+		// A gear joint takes its bodies from its joints.
+		if (joint->m_bodyA != bodyA || joint->m_bodyB != bodyB)
+		{
+			snapshot->Invalidate();
+			DestroyJoint(joint);
+			return false;
+		}
+
+		load->joints[load->jointCount] = joint;
+		load->jointHandles[load->jointCount] = handle;
+		++load->jointCount;
+		if (load->jointHandleTable->Bind(handle, joint) == false)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		joint->m_breakForce = breakForce;
+		joint->m_breakTorque = breakTorque;
+		joint->TransferState(snapshot);
+	}
+
+	return snapshot->IsValid();
+}
+
+// The feature ids of the manifold and the simplex cache index the vertices of the
+// two children, which the narrow phase and time of impact look up unchecked.
+static bool cb2CheckContactIndices(const cb2Manifold& manifold, const cb2SimplexCache& cache,
+								   const cb2Shape* shapeA, int indexA, const cb2Shape* shapeB, int indexB)
+{
+	// The metric of the cache is only set, and read, for two or three vertices.
+	if (manifold.pointCount < 0 || manifold.pointCount > cb2_maxManifoldPoints ||
+		cache.count > 3 || (cache.count > 1 && cb2::isValid(cache.metric) == false))
+	{
+		return false;
+	}
+
+	// The type is checked as an int, out of range it is no valid enum. Without points it
+	// is never used and keeps whatever the manifold had before.
+	int type;
+	cb2Assert(sizeof(type) == sizeof(manifold.type));
+	memcpy(&type, &manifold.type, sizeof(type));
+	if (manifold.pointCount > 0 && (type < cb2Manifold::e_circles || type > cb2Manifold::e_faceB))
+	{
+		return false;
+	}
+
+	cb2DistanceProxy proxyA, proxyB;
+	proxyA.set(shapeA, indexA);
+	proxyB.set(shapeB, indexB);
+
+	// The edge collider keys the points of a face B manifold on the polygon alone, so a
+	// feature may index either child.
+	int featureCount = cb2Max(proxyA.GetVertexCount(), proxyB.GetVertexCount());
+	for (int i = 0; i < manifold.pointCount; ++i)
+	{
+		const cb2ContactFeature& cf = manifold.points[i].id.cf;
+		if (cf.indexA >= featureCount || cf.indexB >= featureCount ||
+			cf.typeA > cb2ContactFeature::e_face || cf.typeB > cb2ContactFeature::e_face)
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < cache.count; ++i)
+	{
+		if (cache.indexA[i] >= proxyA.GetVertexCount() || cache.indexB[i] >= proxyB.GetVertexCount())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool cb2World::LoadContacts(cb2Snapshot* snapshot, cb2SnapshotLoad* load)
+{
+	load->contactCapacity = snapshot->ReadCount(sizeof(cb2Manifold));
+	if (snapshot->IsValid() == false)
+	{
+		return false;
+	}
+
+	load->contacts = (cb2Contact**)cb2Alloc(m_allocator, cb2Max(load->contactCapacity, 1) * sizeof(cb2Contact*));
+
+	for (int i = 0; i < load->contactCapacity; ++i)
+	{
+		int fixtureIndexA = snapshot->Read<int>();
+		int indexA = snapshot->Read<int>();
+		int fixtureIndexB = snapshot->Read<int>();
+		int indexB = snapshot->Read<int>();
+		if (snapshot->IsValid() == false || fixtureIndexA < 0 || fixtureIndexA >= load->fixtureCount ||
+			fixtureIndexB < 0 || fixtureIndexB >= load->fixtureCount)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		cb2Fixture* fixtureA = load->fixtures[fixtureIndexA];
+		cb2Fixture* fixtureB = load->fixtures[fixtureIndexB];
+		if (fixtureA->m_body == fixtureB->m_body ||
+			indexA < 0 || indexA >= fixtureA->m_shape->GetChildCount() ||
+			indexB < 0 || indexB >= fixtureB->m_shape->GetChildCount() ||
+			m_contactManager.FindContact(fixtureA, indexA, fixtureB, indexB) != NULL)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		// The saved fixtures are in the order the factory puts them.
+		cb2Contact* c = cb2Contact::Create(fixtureA, indexA, fixtureB, indexB, &m_blockAllocator);
+		if (c == NULL)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		if (c->m_fixtureA != fixtureA)
+		{
+			cb2Contact::Destroy(c, &m_blockAllocator);
+			snapshot->Invalidate();
+			return false;
+		}
+
+		m_contactManager.InsertContact(c);
+		load->contacts[load->contactCount++] = c;
+
+		c->m_flags = snapshot->Read<unsigned int>() & ~cb2Contact::e_awakeFlag;
+		cb2Manifold manifold;
+		snapshot->Read(&manifold, sizeof(cb2Manifold));
+		snapshot->Read(&c->m_relativeXf, sizeof(cb2Transform));
+		c->m_sensorSeparation = snapshot->Read<float>();
+		c->m_sensorExtent = snapshot->Read<float>();
+		c->m_toiCount = snapshot->Read<int>();
+		c->m_toi = snapshot->Read<float>();
+		snapshot->Read(&c->m_simplexCache, sizeof(cb2SimplexCache));
+		c->m_friction = snapshot->Read<float>();
+		c->m_restitution = snapshot->Read<float>();
+		c->m_tangentSpeed = snapshot->Read<float>();
+
+		if (cb2CheckContactIndices(manifold, c->m_simplexCache, fixtureA->m_shape, indexA,
+								   fixtureB->m_shape, indexB) == false)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		c->SetManifold(manifold, &m_blockAllocator);
+	}
+
+	int awakeCount = snapshot->ReadCount(sizeof(int));
+	for (int i = 0; i < awakeCount; ++i)
+	{
+		int index = snapshot->Read<int>();
+		if (snapshot->IsValid() == false || index < 0 || index >= load->contactCount ||
+			(load->contacts[index]->m_flags & cb2Contact::e_awakeFlag))
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		m_contactManager.AppendAwake(load->contacts[index]);
+	}
+
+	return snapshot->IsValid();
+}
+
+bool cb2World::LoadIslands(cb2Snapshot* snapshot, cb2SnapshotLoad* load, bool awake)
+{
+	cb2PersistentIsland** list = awake ? &m_awakeIslandList : &m_sleepingIslandList;
+	cb2Assert(*list == NULL);
+
+	int islandCount = snapshot->ReadCount(3 * sizeof(int));
+	cb2PersistentIsland* tail = NULL;
+	for (int i = 0; i < islandCount; ++i)
+	{
+		int constraintRemoveCount = snapshot->Read<int>();
+		bool readyToSleep = snapshot->ReadBool();
+		int lodLevel = snapshot->Read<int>();
+		int lodStepCount = snapshot->Read<int>();
+		float lodDt = snapshot->Read<float>();
+		if (snapshot->IsValid() == false || lodLevel < 0 || lodLevel >= cb2_maxLodLevels || lodStepCount < 0 ||
+			cb2::isValid(lodDt) == false || lodDt < 0.0f)
+		{
+			return false;
+		}
+
+		// Like CreateIsland, but the islands are appended to keep their order.
+		void* mem = m_blockAllocator.Allocate(sizeof(cb2PersistentIsland));
+		cb2PersistentIsland* island = (cb2PersistentIsland*)mem;
+		island->bodyList = NULL;
+		island->contactList = NULL;
+		island->jointList = NULL;
+		island->bodyCount = 0;
+		island->contactCount = 0;
+		island->jointCount = 0;
+		island->constraintRemoveCount = constraintRemoveCount;
+		island->awake = awake;
+		island->readyToSleep = readyToSleep;
+		island->lodLevel = lodLevel;
+		island->lodStepCount = lodStepCount;
+		island->lodDt = lodDt;
+		island->lodSkipped = false;
+
+		island->prev = tail;
+		island->next = NULL;
+		if (tail)
+		{
+			tail->next = island;
+		}
+		else
+		{
+			*list = island;
+		}
+		tail = island;
+
+		if (LoadIslandList(snapshot, island, &island->bodyList, &island->bodyCount, load->bodies, load->bodyCount) == false ||
+			island->bodyCount == 0)
+		{
+			snapshot->Invalidate();
+			return false;
+		}
+
+		if (LoadIslandList(snapshot, island, &island->contactList, &island->contactCount, load->contacts, load->contactCount) == false ||
+			LoadIslandList(snapshot, island, &island->jointList, &island->jointCount, load->joints, load->jointCount) == false)
+		{
+			return false;
+		}
+	}
+
+	return snapshot->IsValid();
+}
+
+void cb2World::UnloadSnapshot(cb2SnapshotLoad* load)
+{
+	cb2Free(m_allocator, load->contacts);
+	cb2Free(m_allocator, load->jointHandles);
+	cb2Free(m_allocator, load->joints);
+	cb2Free(m_allocator, load->fixtureHandles);
+	cb2Free(m_allocator, load->fixtures);
+	cb2Free(m_allocator, load->bodyHandles);
+	cb2Free(m_allocator, load->bodies);
+}
+
+// "CB2R", the state a world saves for rollback. It is only restored by the world that
+// saved it, so it needs no version.
+static const unsigned int cb2_stateMagic = 0x52324243;
+
+// Where the sections of a state end, written after the magic once the state is
+// complete. A restore checks the buffer against it before it changes the world.
+struct cb2StateLayout
+{
+	int bodiesEnd;
+	int broadPhaseEnd;
+	int jointsEnd;
+	int contactsEnd;
+	int size;
+};
+
+// The state of a body, written in one go.
+struct cb2BodyState
+{
+	cb2Transform xf;
+	cb2Sweep sweep;
+	ci::Vec2f linearVelocity;
+	float angularVelocity;
+	ci::Vec2f force;
+	float torque;
+	float mass, invMass;
+	float I, invI;
+	float sleepTime;
+	unsigned int moveStamp;
+	unsigned short flags;
+};
+
+// A contact is found again by its fixture children.
+struct cb2ContactKey
+{
+	cb2Handle fixtureA;
+	cb2Handle fixtureB;
+	int indexA;
+	int indexB;
+};
+
+// The state of a contact, written in one go. awakeIndex is -1 for sleeping contacts.
+struct cb2ContactState
+{
+	cb2ContactKey key;
+	unsigned int flags;
+	int awakeIndex;
+	cb2Manifold manifold;
+	cb2Transform relativeXf;
+	float sensorSeparation;
+	float sensorExtent;
+	int toiCount;
+	float toi;
+	cb2SimplexCache simplexCache;
+	float friction;
+	float restitution;
+	float tangentSpeed;
+};
+
+static void cb2GetContactKey(cb2ContactKey* key, const cb2Contact* c)
+{
+	// Zero the padding so the same state always has the same bytes.
+	memset(key, 0, sizeof(cb2ContactKey));
+	key->fixtureA = c->GetFixtureA()->GetHandle();
+	key->fixtureB = c->GetFixtureB()->GetHandle();
+	key->indexA = c->GetChildIndexA();
+	key->indexB = c->GetChildIndexB();
+}
+
+template <typename T>
+void cb2World::AppendToIsland(cb2PersistentIsland* island, T** list, T** tail, T* item)
+{
+	cb2Assert(item != NULL && item->m_island == NULL);
+	item->m_island = island;
+	item->m_islandPrev = *tail;
+	item->m_islandNext = NULL;
+	if (*tail)
+	{
+		(*tail)->m_islandNext = item;
+	}
+	else
+	{
+		*list = item;
+	}
+	*tail = item;
+}
+
+int cb2World::SaveState(void* buffer, int capacity) const
+{
+	cb2Assert(IsLocked() == false);
+
+	cb2Snapshot state;
+	state.SetBuffer(buffer, capacity);
+
+	cb2StateLayout layout;
+	memset(&layout, 0, sizeof(layout));
+
+	state.Write(cb2_stateMagic);
+	state.Write(layout);
+	state.Write((size_t)this);
+	state.Write(m_topologyStamp);
+	state.Write(m_bodyCount);
+	state.Write(m_jointCount);
+
+	state.Write(m_flags & ~e_locked);
+	state.Write(m_inv_dt0);
+	state.Write(m_stepIndex);
+	state.Write(m_stepComplete);
+	state.Write(m_treeRebalanceBudget);
+	state.Write(m_accumulator);
+
+	// The topology is unchanged on restore, so the lists are walked in the same order.
+	for (const cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		cb2BodyState bodyState;
+		memset((void*)&bodyState, 0, sizeof(bodyState));
+		bodyState.xf = b->m_xf;
+		bodyState.sweep = b->m_sweep;
+		bodyState.linearVelocity = b->m_linearVelocity;
+		bodyState.angularVelocity = b->m_angularVelocity;
+		bodyState.force = b->m_force;
+		bodyState.torque = b->m_torque;
+		bodyState.mass = b->m_mass;
+		bodyState.invMass = b->m_invMass;
+		bodyState.I = b->m_I;
+		bodyState.invI = b->m_invI;
+		bodyState.sleepTime = b->m_sleepTime;
+		bodyState.moveStamp = b->m_moveStamp;
+		bodyState.flags = b->m_flags;
+		state.Write(bodyState);
+
+		for (const cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int i = 0; i < f->m_proxyCount; ++i)
+			{
+				state.Write(f->m_proxies[i].aabb);
+				state.Write(f->m_proxies[i].proxyId);
+			}
+		}
+
+		if (b->m_aggregate)
+		{
+			b->m_aggregate->Save(&state);
+		}
+	}
+	layout.bodiesEnd = state.GetSize();
+
+	m_contactManager.m_broadPhase.Save(&state, true);
+	layout.broadPhaseEnd = state.GetSize();
+
+	for (cb2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		j->TransferState(&state);
+	}
+	layout.jointsEnd = state.GetSize();
+
+	state.Write(m_contactManager.m_contactCount);
+	state.Write(m_contactManager.m_awakeContactCount);
+	for (const cb2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	{
+		cb2ContactState contactState;
+		memset((void*)&contactState, 0, sizeof(contactState));
+		cb2GetContactKey(&contactState.key, c);
+		contactState.flags = c->m_flags & ~cb2Contact::e_awakeFlag;
+		contactState.awakeIndex = (c->m_flags & cb2Contact::e_awakeFlag) ? c->m_awakeIndex : -1;
+		contactState.manifold = *c->GetManifold();
+		contactState.relativeXf = c->m_relativeXf;
+		contactState.sensorSeparation = c->m_sensorSeparation;
+		contactState.sensorExtent = c->m_sensorExtent;
+		contactState.toiCount = c->m_toiCount;
+		contactState.toi = c->m_toi;
+		contactState.simplexCache = c->m_simplexCache;
+		contactState.friction = c->m_friction;
+		contactState.restitution = c->m_restitution;
+		contactState.tangentSpeed = c->m_tangentSpeed;
+		state.Write(contactState);
+	}
+	layout.contactsEnd = state.GetSize();
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const cb2PersistentIsland* list = pass == 0 ? m_awakeIslandList : m_sleepingIslandList;
+
+		int islandCount = 0;
+		for (const cb2PersistentIsland* island = list; island; island = island->next)
+		{
+			++islandCount;
+		}
+
+		state.Write(islandCount);
+		for (const cb2PersistentIsland* island = list; island; island = island->next)
+		{
+			state.Write(island->constraintRemoveCount);
+			state.Write(island->readyToSleep);
+			state.Write(island->lodLevel);
+			state.Write(island->lodStepCount);
+			state.Write(island->lodDt);
+
+			state.Write(island->bodyCount);
+			for (const cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+			{
+				state.Write(b->m_handle);
+			}
+
+			state.Write(island->contactCount);
+			for (const cb2Contact* c = island->contactList; c; c = c->m_islandNext)
+			{
+				cb2ContactKey key;
+				cb2GetContactKey(&key, c);
+				state.Write(key);
+			}
+
+			state.Write(island->jointCount);
+			for (const cb2Joint* j = island->jointList; j; j = j->m_islandNext)
+			{
+				state.Write(j->m_handle);
+			}
+		}
+	}
+	layout.size = state.GetSize();
+
+	if (state.IsValid())
+	{
+		memcpy((unsigned char*)buffer + sizeof(cb2_stateMagic), &layout, sizeof(layout));
+	}
+
+	return layout.size;
+}
+
+bool cb2World::RestoreState(const void* buffer, int size)
+{
+	cb2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return false;
+	}
+
+	cb2Snapshot state(buffer, size);
+	unsigned int magic = state.Read<unsigned int>();
+	cb2StateLayout layout = state.Read<cb2StateLayout>();
+	size_t world = state.Read<size_t>();
+	unsigned int topologyStamp = state.Read<unsigned int>();
+	int bodyCount = state.Read<int>();
+	int jointCount = state.Read<int>();
+	if (state.IsValid() == false || magic != cb2_stateMagic || world != (size_t)this ||
+		topologyStamp != m_topologyStamp || bodyCount != m_bodyCount || jointCount != m_jointCount)
+	{
+		return false;
+	}
+
+	// A truncated or padded buffer is refused before anything is restored, the
+	// sections below would otherwise fail half way.
+	if (layout.size != size || layout.bodiesEnd < state.GetPosition() ||
+		layout.broadPhaseEnd < layout.bodiesEnd || layout.jointsEnd < layout.broadPhaseEnd ||
+		layout.contactsEnd < layout.jointsEnd || layout.size < layout.contactsEnd)
+	{
+		return false;
+	}
+
+	m_flags = state.Read<int>() & ~e_locked;
+	m_inv_dt0 = state.Read<float>();
+	m_stepIndex = state.Read<unsigned int>();
+	m_stepComplete = state.ReadBool();
+	m_treeRebalanceBudget = state.Read<int>();
+	m_accumulator = state.Read<float>();
+
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		cb2BodyState bodyState = state.Read<cb2BodyState>();
+		b->m_xf = bodyState.xf;
+		b->m_sweep = bodyState.sweep;
+		b->m_linearVelocity = bodyState.linearVelocity;
+		b->m_angularVelocity = bodyState.angularVelocity;
+		b->m_force = bodyState.force;
+		b->m_torque = bodyState.torque;
+		b->m_mass = bodyState.mass;
+		b->m_invMass = bodyState.invMass;
+		b->m_I = bodyState.I;
+		b->m_invI = bodyState.invI;
+		b->m_sleepTime = bodyState.sleepTime;
+		b->m_moveStamp = bodyState.moveStamp;
+		b->m_flags = bodyState.flags;
+
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int i = 0; i < f->m_proxyCount; ++i)
+			{
+				state.Read(&f->m_proxies[i].aabb, sizeof(cb2AABB));
+				f->m_proxies[i].proxyId = state.Read<int>();
+			}
+		}
+
+		if (b->m_aggregate)
+		{
+			bool aggregateLoaded = b->m_aggregate->Load(&state);
+			cb2Assert(aggregateLoaded);
+			CB2_NOT_USED(aggregateLoaded);
+		}
+	}
+	cb2Assert(state.GetPosition() == layout.bodiesEnd);
+
+	// The loaded broad-phase has no user data, give it the fixture proxies again.
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	bool loaded = broadPhase->Load(&state, true);
+	cb2Assert(loaded && state.GetPosition() == layout.broadPhaseEnd);
+	CB2_NOT_USED(loaded);
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_aggregate)
+		{
+			if (b->m_aggregate->m_proxy.proxyId != cb2BroadPhase::e_nullProxy)
+			{
+				broadPhase->SetUserData(b->m_aggregate->m_proxy.proxyId, &b->m_aggregate->m_proxy);
+			}
+			continue;
+		}
+
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int i = 0; i < f->m_proxyCount; ++i)
+			{
+				broadPhase->SetUserData(f->m_proxies[i].proxyId, f->m_proxies + i);
+			}
+		}
+	}
+
+	for (cb2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		j->TransferState(&state);
+	}
+	cb2Assert(state.GetPosition() == layout.jointsEnd);
+
+	// The islands refer to contacts that may go away, so they are rebuilt last.
+	ClearIslands();
+	RestoreContacts(&state);
+	cb2Assert(state.GetPosition() == layout.contactsEnd);
+	RestoreIslands(&state, true);
+	RestoreIslands(&state, false);
+
+	// The interpolated transforms belong to the restored step.
+	if (m_bodyTransforms)
+	{
+		StoreBodyTransforms(true);
+		StoreBodyTransforms(false);
+	}
+
+	cb2Assert(state.IsValid() && state.GetPosition() == layout.size);
+	return state.IsValid();
+}
+
+void cb2World::ClearIslands()
+{
+	while (m_awakeIslandList || m_sleepingIslandList)
+	{
+		cb2PersistentIsland* island = m_awakeIslandList ? m_awakeIslandList : m_sleepingIslandList;
+		for (cb2Body* b = island->bodyList; b; b = b->m_islandNext)
+		{
+			b->m_island = NULL;
+		}
+		for (cb2Contact* c = island->contactList; c; c = c->m_islandNext)
+		{
+			c->m_island = NULL;
+		}
+		for (cb2Joint* j = island->jointList; j; j = j->m_islandNext)
+		{
+			j->m_island = NULL;
+		}
+		DestroyIsland(island);
+	}
+}
+
+void cb2World::RestoreContacts(cb2Snapshot* state)
+{
+	cb2ContactManager* manager = &m_contactManager;
+
+	// The awake flag marks the contacts that are kept while the saved ones are matched,
+	// the awake array is restored after.
+	for (int i = 0; i < manager->m_awakeContactCount; ++i)
+	{
+		manager->m_awakeContacts[i].contact->m_flags &= ~cb2Contact::e_awakeFlag;
+	}
+	manager->m_awakeContactCount = 0;
+
+	int contactCount = state->Read<int>();
+	int awakeCount = state->Read<int>();
+	cb2Contact** contacts = (cb2Contact**)m_stackAllocator.Allocate(cb2Max(contactCount, 1) * sizeof(cb2Contact*));
+	cb2Contact** awakeContacts = (cb2Contact**)m_stackAllocator.Allocate(cb2Max(awakeCount, 1) * sizeof(cb2Contact*));
+
+	for (int i = 0; i < contactCount; ++i)
+	{
+		cb2ContactState contactState = state->Read<cb2ContactState>();
+		const cb2ContactKey& key = contactState.key;
+		cb2Fixture* fixtureA = (cb2Fixture*)m_fixtureHandles.Get(key.fixtureA);
+		cb2Fixture* fixtureB = (cb2Fixture*)m_fixtureHandles.Get(key.fixtureB);
+		cb2Assert(fixtureA != NULL && fixtureB != NULL);
+
+		cb2Contact* c = manager->FindContact(fixtureA, key.indexA, fixtureB, key.indexB);
+		if (c == NULL)
+		{
+			// The contact ended since the save.
+			c = cb2Contact::Create(fixtureA, key.indexA, fixtureB, key.indexB, &m_blockAllocator);
+			cb2Assert(c != NULL && c->m_fixtureA == fixtureA);
+			manager->InsertContact(c);
+		}
+
+		c->m_flags = contactState.flags | cb2Contact::e_awakeFlag;
+		c->SetManifold(contactState.manifold, &m_blockAllocator);
+		c->m_relativeXf = contactState.relativeXf;
+		c->m_sensorSeparation = contactState.sensorSeparation;
+		c->m_sensorExtent = contactState.sensorExtent;
+		c->m_toiCount = contactState.toiCount;
+		c->m_toi = contactState.toi;
+		c->m_simplexCache = contactState.simplexCache;
+		c->m_friction = contactState.friction;
+		c->m_restitution = contactState.restitution;
+		c->m_tangentSpeed = contactState.tangentSpeed;
+
+		contacts[i] = c;
+		if (contactState.awakeIndex >= 0)
+		{
+			cb2Assert(contactState.awakeIndex < awakeCount);
+			awakeContacts[contactState.awakeIndex] = c;
+		}
+	}
+
+	// Contacts that began since the save are dropped quietly, without the wake of a
+	// contact destroyed with points.
+	cb2Manifold emptyManifold;
+	emptyManifold.pointCount = 0;
+	cb2Contact* c = manager->m_contactList;
+	while (c)
+	{
+		cb2Contact* next = c->m_next;
+		if ((c->m_flags & cb2Contact::e_awakeFlag) == 0)
+		{
+			c->m_flags &= ~cb2Contact::e_touchingFlag;
+			c->SetManifold(emptyManifold, &m_blockAllocator);
+			manager->Destroy(c);
+		}
+		c = next;
+	}
+
+	for (int i = 0; i < contactCount; ++i)
+	{
+		contacts[i]->m_flags &= ~cb2Contact::e_awakeFlag;
+	}
+
+	manager->RelinkContacts(contacts, contactCount);
+	for (int i = 0; i < awakeCount; ++i)
+	{
+		manager->AppendAwake(awakeContacts[i]);
+	}
+
+	m_stackAllocator.Free(awakeContacts);
+	m_stackAllocator.Free(contacts);
+}
+
+void cb2World::RestoreIslands(cb2Snapshot* state, bool awake)
+{
+	cb2PersistentIsland** list = awake ? &m_awakeIslandList : &m_sleepingIslandList;
+	cb2Assert(*list == NULL);
+
+	int islandCount = state->Read<int>();
+	cb2PersistentIsland* tail = NULL;
+	for (int i = 0; i < islandCount; ++i)
+	{
+		// Like CreateIsland, but the islands are appended to keep their order.
+		void* mem = m_blockAllocator.Allocate(sizeof(cb2PersistentIsland));
+		cb2PersistentIsland* island = (cb2PersistentIsland*)mem;
+		island->bodyList = NULL;
+		island->contactList = NULL;
+		island->jointList = NULL;
+		island->constraintRemoveCount = state->Read<int>();
+		island->awake = awake;
+		island->readyToSleep = state->ReadBool();
+		island->lodLevel = state->Read<int>();
+		island->lodStepCount = state->Read<int>();
+		island->lodDt = state->Read<float>();
+		island->lodSkipped = false;
+
+		island->prev = tail;
+		island->next = NULL;
+		if (tail)
+		{
+			tail->next = island;
+		}
+		else
+		{
+			*list = island;
+		}
+		tail = island;
+
+		island->bodyCount = state->Read<int>();
+		cb2Body* bodyTail = NULL;
+		for (int j = 0; j < island->bodyCount; ++j)
+		{
+			cb2Body* b = (cb2Body*)m_bodyHandles.Get(state->Read<cb2Handle>());
+			AppendToIsland(island, &island->bodyList, &bodyTail, b);
+		}
+
+		island->contactCount = state->Read<int>();
+		cb2Contact* contactTail = NULL;
+		for (int j = 0; j < island->contactCount; ++j)
+		{
+			cb2ContactKey key = state->Read<cb2ContactKey>();
+			const cb2Fixture* fixtureA = (const cb2Fixture*)m_fixtureHandles.Get(key.fixtureA);
+			const cb2Fixture* fixtureB = (const cb2Fixture*)m_fixtureHandles.Get(key.fixtureB);
+			cb2Contact* c = m_contactManager.FindContact(fixtureA, key.indexA, fixtureB, key.indexB);
+			AppendToIsland(island, &island->contactList, &contactTail, c);
+		}
+
+		island->jointCount = state->Read<int>();
+		cb2Joint* jointTail = NULL;
+		for (int j = 0; j < island->jointCount; ++j)
+		{
+			cb2Joint* joint = (cb2Joint*)m_jointHandles.Get(state->Read<cb2Handle>());
+			AppendToIsland(island, &island->jointList, &jointTail, joint);
+		}
+	}
+}
+
+// "CB2L" and the level format version.
+static const unsigned int cb2_levelMagic = 0x4C324243;
+static const int cb2_levelVersion = 3;
+
+// Finds the proxy of each edge in the edge tree of a chain.
+struct cb2LevelEdgeQuery
+{
+	bool QueryCallback(int proxyId)
+	{
+		proxyIds[(size_t)tree->GetUserData(proxyId)] = proxyId;
+		return true;
+	}
+
+	const cb2DynamicTree* tree;
+	int* proxyIds;
+};
+
+// Chains are saved so that their vertices and edges can be used in place.
+static void cb2SaveLevelChain(cb2Snapshot* level, const cb2ChainShape* chain, cb2AllocatorInterface* allocator)
+{
+	level->Write(chain->m_count);
+	level->Write(chain->m_prevVertex);
+	level->Write(chain->m_nextVertex);
+	level->Write(chain->m_hasPrevVertex);
+	level->Write(chain->m_hasNextVertex);
+	bool hasEdgeTree = chain->m_edgeTree != NULL;
+	level->Write(hasEdgeTree);
+	level->Align(4);
+	level->Write(chain->m_vertices, chain->m_count * sizeof(ci::Vec2f));
+
+	if (hasEdgeTree)
+	{
+		int edgeCount = chain->m_count - 1;
+		int* proxyIds = (int*)cb2Alloc(allocator, edgeCount * sizeof(int));
+		cb2LevelEdgeQuery query;
+		query.tree = chain->m_edgeTree;
+		query.proxyIds = proxyIds;
+
+		cb2AABB all;
+		all.lowerBound.set(-cb2_maxFloat, -cb2_maxFloat);
+		all.upperBound.set(cb2_maxFloat, cb2_maxFloat);
+		chain->m_edgeTree->Query(&query, all);
+
+		chain->m_edgeTree->Save(level);
+		level->Align(4);
+		level->Write(proxyIds, edgeCount * sizeof(int));
+		cb2Free(allocator, proxyIds);
+	}
+}
+
+void cb2World::SaveLevel(cb2Snapshot* level) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(m_contactManager.m_broadPhase.IsStaticTreeShared() == false);
+	cb2Assert(level->IsLoading() == false);
+
+	level->Write(cb2_levelMagic);
+	level->Write(cb2_levelVersion);
+	level->Write(cb2_snapshotLayout, sizeof(cb2_snapshotLayout));
+
+	// Saved back to front, like SaveSnapshot, so loading restores the order.
+	int bodyCount = 0;
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, cb2Max(m_bodyCount, 1) * sizeof(cb2Body*));
+	for (cb2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_type == cb2_staticBody && b->IsActive())
+		{
+			bodies[bodyCount++] = b;
+		}
+	}
+
+	int proxyCount = 0;
+	level->Write(bodyCount);
+	for (int i = bodyCount - 1; i >= 0; --i)
+	{
+		const cb2Body* b = bodies[i];
+		level->Write(b->m_aggregate != NULL);
+		level->Write(b->m_xf);
+		level->Write(b->m_sweep);
+		level->Write(b->m_region);
+		level->Write(b->m_fixtureCount);
+
+		cb2Fixture** fixtures = (cb2Fixture**)cb2Alloc(m_allocator, cb2Max(b->m_fixtureCount, 1) * sizeof(cb2Fixture*));
+		int j = b->m_fixtureCount;
+		for (cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			fixtures[--j] = f;
+		}
+
+		for (j = 0; j < b->m_fixtureCount; ++j)
+		{
+			const cb2Fixture* f = fixtures[j];
+			level->Write(f->m_shape->m_type);
+			if (f->m_shape->m_type == cb2Shape::e_chain)
+			{
+				level->Write(f->m_shape->m_radius);
+				cb2SaveLevelChain(level, (const cb2ChainShape*)f->m_shape, m_allocator);
+			}
+			else
+			{
+				cb2SaveShape(level, f->m_shape);
+			}
+
+			level->Write(f->m_density);
+			level->Write(f->m_friction);
+			level->Write(f->m_restitution);
+			level->Write(f->m_tangentSpeed);
+			level->Write(f->m_filter);
+			level->Write(f->m_isSensor);
+			level->Write(f->m_enableContactEvents);
+			level->Write(f->m_enableHitEvents);
+
+			level->Write(f->m_proxyCount);
+			for (int k = 0; k < f->m_proxyCount; ++k)
+			{
+				const cb2FixtureProxy* proxy = f->m_proxies + k;
+				level->Write(proxy->childIndex);
+				level->Write(proxy->aabb);
+				level->Write(proxy->proxyId);
+			}
+			proxyCount += b->m_aggregate ? 0 : f->m_proxyCount;
+		}
+		cb2Free(m_allocator, fixtures);
+
+		if (b->m_aggregate)
+		{
+			b->m_aggregate->Save(level);
+			proxyCount += b->m_aggregate->m_proxyCount > 0 ? 1 : 0;
+		}
+	}
+	cb2Free(m_allocator, bodies);
+
+	// Static proxies only belong to active static bodies, so these are all of them.
+	const cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	cb2Assert(proxyCount == broadPhase->GetStaticProxyCount());
+	level->Write(proxyCount);
+	broadPhase->SaveStaticTree(level);
+}
+
+bool cb2World::LoadLevel(const void* data, int size)
+{
+	cb2Assert(IsLocked() == false);
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	cb2Assert(broadPhase->GetStaticProxyCount() == 0);
+	if (IsLocked() || broadPhase->GetStaticProxyCount() > 0)
+	{
+		return false;
+	}
+
+	cb2Snapshot level(data, size);
+	int layout[cb2_snapshotLayoutCount];
+	unsigned int magic = level.Read<unsigned int>();
+	int version = level.Read<int>();
+	level.Read(layout, sizeof(layout));
+	if (magic != cb2_levelMagic || version != cb2_levelVersion ||
+		memcmp(layout, cb2_snapshotLayout, sizeof(layout)) != 0)
+	{
+		return false;
+	}
+
+	int bodyCapacity = level.ReadCount(sizeof(cb2Sweep));
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, cb2Max(bodyCapacity, 1) * sizeof(cb2Body*));
+	int bodyCount = 0;
+
+	// The bodies stay inactive until their proxies are in place.
+	bool loaded = level.IsValid();
+	for (int i = 0; loaded && i < bodyCapacity; ++i)
+	{
+		cb2BodyDef def;
+		def.type = cb2_staticBody;
+		def.active = false;
+		def.aggregate = level.ReadBool();
+		cb2Body* b = CreateBody(&def);
+		bodies[bodyCount++] = b;
+
+		level.Read(&b->m_xf, sizeof(cb2Transform));
+		level.Read(&b->m_sweep, sizeof(cb2Sweep));
+		b->m_region = level.Read<int>();
+		int fixtureCount = level.ReadCount(sizeof(cb2Filter));
+		for (int j = 0; loaded && j < fixtureCount; ++j)
+		{
+			loaded = LoadLevelFixture(&level, b);
+		}
+		if (loaded && b->m_aggregate)
+		{
+			loaded = b->m_aggregate->Load(&level);
+		}
+		loaded = loaded && level.IsValid();
+	}
+
+	// The load of the static tree is not atomic, keep the empty one to go back to.
+	cb2Snapshot emptyTree(m_allocator);
+	broadPhase->SaveStaticTree(&emptyTree);
+
+	int proxyCount = level.Read<int>();
+	loaded = loaded && level.IsValid() && proxyCount >= 0 && broadPhase->LoadStaticTree(&level, proxyCount);
+
+	loaded = loaded && LinkLevelProxies(bodies, bodyCount) == proxyCount;
+
+	if (loaded == false)
+	{
+		// The bodies are inactive, so destroying them leaves the broad-phase alone.
+		for (int i = 0; i < bodyCount; ++i)
+		{
+			for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+			{
+				f->m_proxyCount = 0;
+			}
+			DestroyBody(bodies[i]);
+		}
+
+		cb2Snapshot empty(emptyTree.GetData(), emptyTree.GetSize());
+		bool restored = broadPhase->LoadStaticTree(&empty, 0);
+		cb2Assert(restored);
+		CB2_NOT_USED(restored);
+
+		cb2Free(m_allocator, bodies);
+		return false;
+	}
+
+	ActivateLevel(bodies, bodyCount, proxyCount);
+
+	cb2Free(m_allocator, bodies);
+	return true;
+}
+
+bool cb2World::LoadLevel(const cb2StaticLayer* layer)
+{
+	cb2Assert(IsLocked() == false);
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	cb2Assert(broadPhase->GetStaticProxyCount() == 0);
+	if (IsLocked() || broadPhase->GetStaticProxyCount() > 0)
+	{
+		return false;
+	}
+
+	// The bodies and fixtures are created back to front to keep the order of the layer.
+	const cb2World* source = &layer->m_world;
+	int bodyCount = source->m_bodyCount;
+	cb2Body** bodies = (cb2Body**)cb2Alloc(m_allocator, cb2Max(bodyCount, 1) * sizeof(cb2Body*));
+	int i = 0;
+	for (cb2Body* b = source->m_bodyList; b; b = b->m_next)
+	{
+		bodies[i++] = b;
+	}
+
+	for (i = bodyCount - 1; i >= 0; --i)
+	{
+		const cb2Body* sb = bodies[i];
+		cb2BodyDef def;
+		def.type = cb2_staticBody;
+		def.active = false;
+		def.aggregate = sb->m_aggregate != NULL;
+		cb2Body* b = CreateBody(&def);
+		b->m_xf = sb->m_xf;
+		b->m_sweep = sb->m_sweep;
+		b->m_region = sb->m_region;
+		bodies[i] = b;
+
+		cb2Fixture** fixtures = (cb2Fixture**)cb2Alloc(m_allocator, cb2Max(sb->m_fixtureCount, 1) * sizeof(cb2Fixture*));
+		int j = 0;
+		for (cb2Fixture* f = sb->m_fixtureList; f; f = f->m_next)
+		{
+			fixtures[j++] = f;
+		}
+
+		for (j = sb->m_fixtureCount - 1; j >= 0; --j)
+		{
+			const cb2Fixture* sf = fixtures[j];
+			cb2FixtureDef fd;
+			fd.shape = sf->m_shape;
+			fd.density = sf->m_density;
+			fd.friction = sf->m_friction;
+			fd.restitution = sf->m_restitution;
+			fd.tangentSpeed = sf->m_tangentSpeed;
+			fd.filter = sf->m_filter;
+			fd.isSensor = sf->m_isSensor;
+			fd.enableContactEvents = sf->m_enableContactEvents;
+			fd.enableHitEvents = sf->m_enableHitEvents;
+
+			// The proxies are those of the layer, in the shared tree.
+			cb2Fixture* f = b->AddFixture(&fd);
+			f->m_proxyCount = sf->m_proxyCount;
+			for (int k = 0; k < f->m_proxyCount; ++k)
+			{
+				f->m_proxies[k] = sf->m_proxies[k];
+				f->m_proxies[k].fixture = f;
+			}
+		}
+		cb2Free(m_allocator, fixtures);
+
+		// The tree of an aggregate holds the proxies of its world, so it is copied.
+		if (sb->m_aggregate)
+		{
+			cb2Snapshot tree(m_allocator);
+			sb->m_aggregate->Save(&tree);
+			cb2Snapshot copy(tree.GetData(), tree.GetSize());
+			bool copied = b->m_aggregate->Load(&copy);
+			cb2Assert(copied);
+			CB2_NOT_USED(copied);
+		}
+	}
+
+	broadPhase->ShareStaticTree(&source->m_contactManager.m_broadPhase);
+	int proxyCount = LinkLevelProxies(bodies, bodyCount);
+	cb2Assert(proxyCount == layer->GetProxyCount());
+	ActivateLevel(bodies, bodyCount, proxyCount);
+
+	cb2Free(m_allocator, bodies);
+	return true;
+}
+
+// Give the proxies of the level bodies their user data in the static tree. Returns
+// the number of proxies, or -1 if one of them is not a static proxy without one.
+int cb2World::LinkLevelProxies(cb2Body** bodies, int bodyCount)
+{
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	int linkedCount = 0;
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		cb2BodyAggregate* aggregate = bodies[i]->m_aggregate;
+		if (aggregate)
+		{
+			int proxyId = aggregate->m_proxy.proxyId;
+			if (proxyId != cb2BroadPhase::e_nullProxy)
+			{
+				if (cb2BroadPhase::IsStaticProxy(proxyId) == false || broadPhase->IsProxy(proxyId) == false ||
+					broadPhase->GetUserData(proxyId) != NULL)
+				{
+					return -1;
+				}
+
+				broadPhase->SetUserData(proxyId, &aggregate->m_proxy);
+				++linkedCount;
+			}
+			continue;
+		}
+
+		for (cb2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			for (int j = 0; j < f->m_proxyCount; ++j)
+			{
+				cb2FixtureProxy* proxy = f->m_proxies + j;
+				if (cb2BroadPhase::IsStaticProxy(proxy->proxyId) == false ||
+					broadPhase->IsProxy(proxy->proxyId) == false ||
+					broadPhase->GetUserData(proxy->proxyId) != NULL)
+				{
+					return -1;
+				}
+
+				broadPhase->SetUserData(proxy->proxyId, proxy);
+				++linkedCount;
+			}
+		}
+	}
+	return linkedCount;
+}
+
+// Activate the level bodies once their proxies are linked.
+void cb2World::ActivateLevel(cb2Body** bodies, int bodyCount, int proxyCount)
+{
+	// Moving proxies that are already there find their pairs with the level once the
+	// level proxies are touched.
+	cb2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	bool touch = broadPhase->GetProxyCount() > proxyCount;
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		cb2Body* b = bodies[i];
+		b->m_flags |= cb2Body::e_activeFlag;
+		if (b->m_aggregate)
+		{
+			if (touch)
+			{
+				b->m_aggregate->Touch(broadPhase);
+			}
+			continue;
+		}
+
+		for (cb2Fixture* f = b->m_fixtureList; touch && f; f = f->m_next)
+		{
+			for (int j = 0; j < f->m_proxyCount; ++j)
+			{
+				broadPhase->TouchProxy(f->m_proxies[j].proxyId);
+			}
+		}
+	}
+	m_flags |= e_newFixture;
+}
+
+bool cb2World::LoadLevelFixture(cb2Snapshot* level, cb2Body* body)
+{
+	cb2SnapshotShapes shapes;
+	cb2FixtureDef fd;
+	cb2ChainShape* chain = NULL;
+
+	cb2Shape::Type type = level->ReadEnum<cb2Shape::Type>(cb2Shape::e_typeCount);
+	if (type == cb2Shape::e_chain)
+	{
+		float radius = level->Read<float>();
+		chain = LoadLevelChain(level, radius);
+		fd.shape = chain;
+	}
+	else
+	{
+		fd.shape = cb2LoadShape(level, &shapes);
+	}
+
+	if (fd.shape == NULL || type != fd.shape->m_type)
+	{
+		level->Invalidate();
+		return false;
+	}
+
+	fd.density = level->Read<float>();
+	fd.friction = level->Read<float>();
+	fd.restitution = level->Read<float>();
+	fd.tangentSpeed = level->Read<float>();
+	fd.filter = level->Read<cb2Filter>();
+	fd.isSensor = level->ReadBool();
+	fd.enableContactEvents = level->ReadBool();
+	fd.enableHitEvents = level->ReadBool();
+
+	// The fixture takes over the chain as a shared shape, then holds the only reference.
+	cb2Fixture* f = body->AddFixture(&fd);
+	if (chain)
+	{
+		cb2Fixture::ReleaseShape(&m_blockAllocator, chain);
+	}
+
+	int proxyCount = level->Read<int>();
+	if (level->IsValid() == false || proxyCount != f->ComputeProxyCount())
+	{
+		level->Invalidate();
+		return false;
+	}
+
+	f->m_proxyCount = proxyCount;
+	for (int i = 0; i < proxyCount; ++i)
+	{
+		cb2FixtureProxy* proxy = f->m_proxies + i;
+		proxy->fixture = f;
+		proxy->childIndex = level->Read<int>();
+		level->Read(&proxy->aabb, sizeof(cb2AABB));
+		proxy->proxyId = level->Read<int>();
+
+		bool validChild = f->m_sharedProxy ? proxy->childIndex == cb2Shape::e_allChildren : proxy->childIndex == i;
+		if (validChild == false)
+		{
+			level->Invalidate();
+		}
+	}
+
+	return level->IsValid();
+}
+
+// Returns a chain on the vertices of the level with a reference held by the caller,
+// or NULL for a bad level.
+cb2ChainShape* cb2World::LoadLevelChain(cb2Snapshot* level, float radius)
+{
+	int count = level->ReadCount(sizeof(ci::Vec2f));
+	ci::Vec2f prevVertex = level->Read<ci::Vec2f>();
+	ci::Vec2f nextVertex = level->Read<ci::Vec2f>();
+	bool hasPrevVertex = level->ReadBool();
+	bool hasNextVertex = level->ReadBool();
+	bool hasEdgeTree = level->ReadBool();
+	level->Align(4);
+	const ci::Vec2f* vertices = (const ci::Vec2f*)level->ReadInPlace(count * sizeof(ci::Vec2f));
+	if (vertices == NULL || count < 2)
+	{
+		level->Invalidate();
+		return NULL;
+	}
+
+	void* mem = m_blockAllocator.Allocate(sizeof(cb2ChainShape));
+	cb2ChainShape* chain = new (mem) cb2ChainShape;
+	chain->m_radius = radius;
+	chain->BorrowChain(vertices, count);
+	chain->m_prevVertex = prevVertex;
+	chain->m_nextVertex = nextVertex;
+	chain->m_hasPrevVertex = hasPrevVertex;
+	chain->m_hasNextVertex = hasNextVertex;
+	chain->m_useEdgeTree = hasEdgeTree;
+	chain->m_shareCount = 1;
+
+	if (hasEdgeTree)
+	{
+		// The chain frees the tree with its vertices.
+		void* treeMem = cb2Alloc(sizeof(cb2DynamicTree));
+		chain->m_edgeTree = new (treeMem) cb2DynamicTree;
+
+		int edgeCount = count - 1;
+		bool loaded = chain->m_edgeTree->Load(level);
+		level->Align(4);
+		const int* proxyIds = (const int*)level->ReadInPlace(edgeCount * sizeof(int));
+		for (int i = 0; loaded && proxyIds && i < edgeCount; ++i)
+		{
+			loaded = proxyIds[i] >= 0 && proxyIds[i] < chain->m_edgeTree->GetNodeCapacity();
+			if (loaded)
+			{
+				chain->m_edgeTree->SetUserData(proxyIds[i], (void*)(size_t)i);
+			}
+		}
+
+		if (loaded == false || proxyIds == NULL)
+		{
+			level->Invalidate();
+			cb2Fixture::ReleaseShape(&m_blockAllocator, chain);
+			return NULL;
+		}
+	}
+
+	return chain;
+}
+
+// "CB2B" and the body format version.
+static const unsigned int cb2_bodyMagic = 0x42324243;
+static const int cb2_bodyVersion = 3;
+
+void cb2World::SaveBody(const cb2Body* b, cb2Snapshot* snapshot) const
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(snapshot->IsLoading() == false);
+
+	snapshot->Write(cb2_bodyMagic);
+	snapshot->Write(cb2_bodyVersion);
+	snapshot->Write(cb2_snapshotLayout, sizeof(cb2_snapshotLayout));
+
+	snapshot->Write(b->m_type);
+	snapshot->Write(b->IsAwake());
+	snapshot->Write(b->IsSleepingAllowed());
+	snapshot->Write(b->IsBullet());
+	snapshot->Write(b->IsFixedRotation());
+	snapshot->Write(b->IsActive());
+	snapshot->Write(b->m_aggregate != NULL);
+	snapshot->Write(b->m_xf);
+	snapshot->Write(b->m_sweep);
+	snapshot->Write(b->m_linearVelocity);
+	snapshot->Write(b->m_angularVelocity);
+	snapshot->Write(b->m_force);
+	snapshot->Write(b->m_torque);
+	snapshot->Write(b->m_mass);
+	snapshot->Write(b->m_invMass);
+	snapshot->Write(b->m_I);
+	snapshot->Write(b->m_invI);
+	snapshot->Write(b->m_linearDamping);
+	snapshot->Write(b->m_angularDamping);
+	snapshot->Write(b->m_gravityScale);
+	snapshot->Write(b->m_sleepScale);
+	snapshot->Write(b->m_sleepTime);
+	snapshot->Write(b->m_region);
+
+	// Back to front, so the fixtures keep their order.
+	snapshot->Write(b->m_fixtureCount);
+	const cb2Fixture** fixtures = (const cb2Fixture**)cb2Alloc(m_allocator, cb2Max(b->m_fixtureCount, 1) * sizeof(cb2Fixture*));
+	int fixtureIndex = b->m_fixtureCount;
+	for (const cb2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+	{
+		fixtures[--fixtureIndex] = f;
+	}
+
+	for (int i = 0; i < b->m_fixtureCount; ++i)
+	{
+		const cb2Fixture* f = fixtures[i];
+		cb2SaveShape(snapshot, f->m_shape);
+		snapshot->Write(f->m_density);
+		snapshot->Write(f->m_friction);
+		snapshot->Write(f->m_restitution);
+		snapshot->Write(f->m_tangentSpeed);
+		snapshot->Write(f->m_filter);
+		snapshot->Write(f->m_isSensor);
+		snapshot->Write(f->m_enableContactEvents);
+		snapshot->Write(f->m_enableHitEvents);
+	}
+	cb2Free(m_allocator, fixtures);
+}
+
+cb2Body* cb2World::LoadBody(cb2Snapshot* snapshot, const ci::Vec2f& offset)
+{
+	cb2Assert(IsLocked() == false);
+	cb2Assert(snapshot->IsLoading());
+	if (IsLocked())
+	{
+		return NULL;
+	}
+
+	int layout[cb2_snapshotLayoutCount];
+	unsigned int magic = snapshot->Read<unsigned int>();
+	int version = snapshot->Read<int>();
+	snapshot->Read(layout, sizeof(layout));
+	if (magic != cb2_bodyMagic || version != cb2_bodyVersion ||
+		memcmp(layout, cb2_snapshotLayout, sizeof(layout)) != 0)
+	{
+		snapshot->Invalidate();
+		return NULL;
+	}
+
+	cb2BodyDef def;
+	def.type = snapshot->ReadEnum<cb2BodyType>(cb2_dynamicBody + 1);
+	def.awake = snapshot->ReadBool();
+	def.allowSleep = snapshot->ReadBool();
+	def.bullet = snapshot->ReadBool();
+	def.fixedRotation = snapshot->ReadBool();
+	def.active = snapshot->ReadBool();
+	def.aggregate = snapshot->ReadBool();
+	if (snapshot->IsValid() == false)
+	{
+		snapshot->Invalidate();
+		return NULL;
+	}
+
+	cb2Transform xf;
+	cb2Sweep sweep;
+	snapshot->Read(&xf, sizeof(cb2Transform));
+	snapshot->Read(&sweep, sizeof(cb2Sweep));
+	xf.p += offset;
+	sweep.c0 += offset;
+	sweep.c += offset;
+
+	// The fixtures get their proxies where the body is, the rest of the state is
+	// taken over as saved below.
+	def.position = xf.p;
+	def.angle = xf.q.GetAngle();
+	cb2Body* b = CreateBody(&def);
+
+	snapshot->Read(&b->m_linearVelocity, sizeof(ci::Vec2f));
+	b->m_angularVelocity = snapshot->Read<float>();
+	snapshot->Read(&b->m_force, sizeof(ci::Vec2f));
+	b->m_torque = snapshot->Read<float>();
+	float mass = snapshot->Read<float>();
+	float invMass = snapshot->Read<float>();
+	float I = snapshot->Read<float>();
+	float invI = snapshot->Read<float>();
+	b->m_linearDamping = snapshot->Read<float>();
+	b->m_angularDamping = snapshot->Read<float>();
+	b->m_gravityScale = snapshot->Read<float>();
+	b->m_sleepScale = snapshot->Read<float>();
+	float sleepTime = snapshot->Read<float>();
+	b->m_region = snapshot->Read<int>();
+
+	int fixtureCount = snapshot->ReadCount(sizeof(cb2Filter));
+	for (int i = 0; i < fixtureCount && snapshot->IsValid(); ++i)
+	{
+		cb2SnapshotShapes shapes;
+		cb2FixtureDef fd;
+		fd.shape = cb2LoadShape(snapshot, &shapes);
+		if (fd.shape == NULL)
+		{
+			break;
+		}
+
+		fd.density = snapshot->Read<float>();
+		fd.friction = snapshot->Read<float>();
+		fd.restitution = snapshot->Read<float>();
+		fd.tangentSpeed = snapshot->Read<float>();
+		fd.filter = snapshot->Read<cb2Filter>();
+		fd.isSensor = snapshot->ReadBool();
+		fd.enableContactEvents = snapshot->ReadBool();
+		fd.enableHitEvents = snapshot->ReadBool();
+		if (snapshot->IsValid())
+		{
+			b->CreateFixture(&fd);
+		}
+	}
+
+	if (snapshot->IsValid() == false)
+	{
+		DestroyBody(b);
+		return NULL;
+	}
+
+	// The fixtures reset the mass, which may have been set by hand.
+	b->m_xf = xf;
+	b->m_sweep = sweep;
+	b->m_mass = mass;
+	b->m_invMass = invMass;
+	b->m_I = I;
+	b->m_invI = invI;
+	b->m_sleepTime = sleepTime;
+	return b;
+}
@@ -0,0 +1,266 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <CinderBox2D/Dynamics/cb2WorldView.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/Contacts/cb2Contact.h>
+#include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <string.h>
+
+// Grow an array to at least count elements, dropping its contents.
+template <typename T>
+static inline void cb2ReserveView(cb2AllocatorInterface* allocator, T** array, int* capacity, int count)
+{
+	if (count <= *capacity)
+	{
+		return;
+	}
+
+	cb2Free(allocator, *array);
+	*capacity = cb2Max(count, 2 * *capacity);
+	*array = (T*)cb2Alloc(allocator, *capacity * sizeof(T));
+}
+
+cb2WorldView::cb2WorldView(cb2AllocatorInterface* allocator)
+: m_tree(allocator), m_readerCount(0)
+{
+	m_allocator = allocator;
+	m_bodies = NULL;
+	m_bodyCount = 0;
+	m_bodyCapacity = 0;
+	m_bodyIndices = NULL;
+	m_bodyIndexCapacity = 0;
+	m_fixtures = NULL;
+	m_fixtureAABBs = NULL;
+	m_fixtureUserData = NULL;
+	m_fixtureProxyIds = NULL;
+	m_fixtureCount = 0;
+	m_fixtureCapacity = 0;
+	m_contacts = NULL;
+	m_contactCount = 0;
+	m_contactCapacity = 0;
+	m_stepIndex = 0;
+	m_stamp = 0;
+}
+
+cb2WorldView::~cb2WorldView()
+{
+	cb2Free(m_allocator, m_bodies);
+	cb2Free(m_allocator, m_bodyIndices);
+	cb2Free(m_allocator, m_fixtures);
+	cb2Free(m_allocator, m_fixtureAABBs);
+	cb2Free(m_allocator, m_fixtureUserData);
+	cb2Free(m_allocator, m_fixtureProxyIds);
+	cb2Free(m_allocator, m_contacts);
+}
+
+void cb2WorldView::Build(const cb2World* world)
+{
+	m_stepIndex = world->m_stepIndex;
+
+	// Bodies.
+	m_bodyCount = world->GetBodyCount();
+	cb2ReserveView(m_allocator, &m_bodies, &m_bodyCapacity, m_bodyCount);
+	cb2ReserveView(m_allocator, &m_bodyIndices, &m_bodyIndexCapacity, world->m_bodyHandles.GetCapacity());
+
+	// The array stays NULL until the world makes its first body handle.
+	if (m_bodyIndexCapacity > 0)
+	{
+		memset(m_bodyIndices, 0xFF, m_bodyIndexCapacity * sizeof(int));
+	}
+
+	int fixtureCount = 0;
+	int bodyIndex = 0;
+	for (const cb2Body* b = world->GetBodyList(); b; b = b->GetNext())
+	{
+		cb2ViewBody* vb = m_bodies + bodyIndex;
+		vb->handle = b->GetHandle();
+		vb->type = b->GetType();
+		vb->transform = b->GetTransform();
+		vb->angle = b->GetAngle();
+		vb->worldCenter = b->GetWorldCenter();
+		vb->linearVelocity = b->GetLinearVelocity();
+		vb->angularVelocity = b->GetAngularVelocity();
+		vb->awake = b->IsAwake();
+		vb->active = b->IsActive();
+		vb->userData = b->GetUserData();
+		m_bodyIndices[vb->handle.index] = bodyIndex;
+		++bodyIndex;
+
+		for (const cb2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+		{
+			fixtureCount += f->m_proxyCount;
+		}
+	}
+	cb2Assert(bodyIndex == m_bodyCount);
+
+	// Fixture proxies, they hold the AABBs of the last synchronize.
+	m_fixtureCount = fixtureCount;
+	int capacity = m_fixtureCapacity;
+	cb2ReserveView(m_allocator, &m_fixtures, &capacity, fixtureCount);
+	capacity = m_fixtureCapacity;
+	cb2ReserveView(m_allocator, &m_fixtureAABBs, &capacity, fixtureCount);
+	capacity = m_fixtureCapacity;
+	cb2ReserveView(m_allocator, &m_fixtureUserData, &capacity, fixtureCount);
+	cb2ReserveView(m_allocator, &m_fixtureProxyIds, &m_fixtureCapacity, fixtureCount);
+
+	int fixtureIndex = 0;
+	bodyIndex = 0;
+	for (const cb2Body* b = world->GetBodyList(); b; b = b->GetNext(), ++bodyIndex)
+	{
+		for (const cb2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+		{
+			for (int i = 0; i < f->m_proxyCount; ++i)
+			{
+				const cb2FixtureProxy* proxy = f->m_proxies + i;
+				cb2ViewFixture* vf = m_fixtures + fixtureIndex;
+				vf->handle = f->GetHandle();
+				vf->shape = f->GetShape();
+				vf->filter = f->GetFilterData();
+				vf->isSensor = f->IsSensor();
+				vf->userData = f->GetUserData();
+				vf->bodyIndex = bodyIndex;
+				vf->childIndex = proxy->childIndex;
+				vf->aabb = proxy->aabb;
+				m_fixtureAABBs[fixtureIndex] = proxy->aabb;
+				m_fixtureUserData[fixtureIndex] = vf;
+				++fixtureIndex;
+			}
+		}
+	}
+
+	// A batch this size is built top-down in one go.
+	m_tree.Clear();
+	m_tree.CreateProxies(m_fixtureCount, m_fixtureAABBs, m_fixtureUserData, m_fixtureProxyIds);
+
+	// Touching contacts.
+	int contactCount = 0;
+	for (const cb2Contact* c = world->GetContactList(); c; c = c->GetNext())
+	{
+		if (c->IsTouching())
+		{
+			++contactCount;
+		}
+	}
+
+	m_contactCount = contactCount;
+	cb2ReserveView(m_allocator, &m_contacts, &m_contactCapacity, contactCount);
+
+	int contactIndex = 0;
+	for (const cb2Contact* c = world->GetContactList(); c; c = c->GetNext())
+	{
+		if (c->IsTouching() == false)
+		{
+			continue;
+		}
+
+		cb2ViewContact* vc = m_contacts + contactIndex;
+		++contactIndex;
+		vc->fixtureA = c->GetFixtureA()->GetHandle();
+		vc->fixtureB = c->GetFixtureB()->GetHandle();
+		vc->bodyIndexA = m_bodyIndices[c->GetFixtureA()->GetBody()->GetHandle().index];
+		vc->bodyIndexB = m_bodyIndices[c->GetFixtureB()->GetBody()->GetHandle().index];
+		vc->childIndexA = c->GetChildIndexA();
+		vc->childIndexB = c->GetChildIndexB();
+
+		const cb2Manifold* manifold = c->GetManifold();
+		cb2WorldManifold worldManifold;
+		c->GetWorldManifold(&worldManifold);
+		vc->normal = worldManifold.normal;
+		vc->pointCount = manifold->pointCount;
+		for (int i = 0; i < manifold->pointCount; ++i)
+		{
+			vc->points[i] = worldManifold.points[i];
+			vc->separations[i] = worldManifold.separations[i];
+			vc->normalImpulses[i] = manifold->points[i].normalImpulse;
+		}
+	}
+}
+
+const cb2ViewBody* cb2WorldView::GetBody(cb2Handle handle) const
+{
+	if (handle.index < 0 || handle.index >= m_bodyIndexCapacity || m_bodyIndices[handle.index] < 0)
+	{
+		return NULL;
+	}
+
+	const cb2ViewBody* body = m_bodies + m_bodyIndices[handle.index];
+	return body->handle == handle ? body : NULL;
+}
+
+struct cb2ViewQueryWrapper
+{
+	bool QueryCallback(int proxyId)
+	{
+		const cb2ViewFixture* fixture = (const cb2ViewFixture*)tree->GetUserData(proxyId);
+		if (cb2TestOverlap(fixture->aabb, aabb) == false)
+		{
+			return true;
+		}
+		return callback->ReportFixture(fixture);
+	}
+
+	const cb2DynamicTree* tree;
+	cb2ViewQueryCallback* callback;
+	cb2AABB aabb;
+};
+
+void cb2WorldView::QueryAABB(cb2ViewQueryCallback* callback, const cb2AABB& aabb) const
+{
+	cb2ViewQueryWrapper wrapper;
+	wrapper.tree = &m_tree;
+	wrapper.callback = callback;
+	wrapper.aabb = aabb;
+	m_tree.Query(&wrapper, aabb);
+}
+
+struct cb2ViewRayCastWrapper
+{
+	float RayCastCallback(const cb2RayCastInput& input, int proxyId)
+	{
+		const cb2ViewFixture* fixture = (const cb2ViewFixture*)view->m_tree.GetUserData(proxyId);
+		const cb2Transform& xf = view->m_bodies[fixture->bodyIndex].transform;
+		cb2RayCastOutput output;
+		bool hit = fixture->shape->RayCast(&output, input, xf, fixture->childIndex);
+
+		if (hit)
+		{
+			float fraction = output.fraction;
+			ci::Vec2f point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+			return callback->ReportFixture(fixture, point, output.normal, fraction);
+		}
+
+		return input.maxFraction;
+	}
+
+	const cb2WorldView* view;
+	cb2ViewRayCastCallback* callback;
+};
+
+void cb2WorldView::RayCast(cb2ViewRayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2) const
+{
+	cb2ViewRayCastWrapper wrapper;
+	wrapper.view = this;
+	wrapper.callback = callback;
+	cb2RayCastInput input;
+	input.maxFraction = 1.0f;
+	input.p1 = point1;
+	input.p2 = point2;
+	m_tree.RayCast(&wrapper, input);
+}
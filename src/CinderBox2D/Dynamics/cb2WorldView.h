@@ -0,0 +1,182 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef CB2_WORLD_VIEW_H
+#define CB2_WORLD_VIEW_H
+
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Collision/cb2DynamicTree.h>
+
+#include <atomic>
+
+class cb2World;
+
+/// The state of a body at the end of a step.
+struct cb2ViewBody
+{
+	cb2Handle handle;
+	cb2BodyType type;
+	cb2Transform transform;
+	float angle;
+	ci::Vec2f worldCenter;
+	ci::Vec2f linearVelocity;
+	float angularVelocity;
+	bool awake;
+	bool active;
+	void* userData;
+};
+
+/// A fixture proxy at the end of a step, index of its body in the view. The shape
+/// stays alive while the view is in use, even if the fixture is destroyed, and must
+/// not be changed.
+struct cb2ViewFixture
+{
+	cb2Handle handle;
+	const cb2Shape* shape;
+	cb2Filter filter;
+	bool isSensor;
+	void* userData;
+	int bodyIndex;
+	int childIndex;
+	cb2AABB aabb;
+};
+
+/// A touching contact at the end of a step, in world coordinates, with the index
+/// of the body of each fixture in the view.
+struct cb2ViewContact
+{
+	cb2Handle fixtureA;
+	cb2Handle fixtureB;
+	int bodyIndexA;
+	int bodyIndexB;
+	int childIndexA;
+	int childIndexB;
+	ci::Vec2f normal;
+	ci::Vec2f points[cb2_maxManifoldPoints];
+	float separations[cb2_maxManifoldPoints];
+	float normalImpulses[cb2_maxManifoldPoints];
+	int pointCount;
+};
+
+/// Callback class for cb2WorldView::QueryAABB.
+class cb2ViewQueryCallback
+{
+public:
+	virtual ~cb2ViewQueryCallback() {}
+
+	/// Called for each fixture found in the query AABB.
+	/// @return false to terminate the query.
+	virtual bool ReportFixture(const cb2ViewFixture* fixture) = 0;
+};
+
+/// Callback class for cb2WorldView::RayCast, see cb2RayCastCallback.
+class cb2ViewRayCastCallback
+{
+public:
+	virtual ~cb2ViewRayCastCallback() {}
+
+	/// Called for each fixture hit by the ray.
+	/// @return -1 to filter, 0 to terminate, fraction to clip the ray for
+	/// closest hit, 1 to continue
+	virtual float ReportFixture(	const cb2ViewFixture* fixture, const ci::Vec2f& point,
+									const ci::Vec2f& normal, float fraction) = 0;
+};
+
+/// An immutable copy of the bodies, fixtures and touching contacts of a world at the
+/// end of a step, with its own tree for queries. Other threads read it while the
+/// world steps, see cb2World::AcquireView. It refers to fixtures by handle only, the
+/// fixtures themselves may be destroyed by the step.
+class cb2WorldView
+{
+public:
+	/// @param allocator where the copy lives, NULL for cb2Alloc.
+	cb2WorldView(cb2AllocatorInterface* allocator = NULL);
+	~cb2WorldView();
+
+	/// Copy the current state of a world. This reuses the memory of the last copy.
+	void Build(const cb2World* world);
+
+	/// Get the bodies, in the order of the world body list.
+	const cb2ViewBody* GetBodies() const { return m_bodies; }
+	int GetBodyCount() const { return m_bodyCount; }
+
+	/// Get a body by handle in constant time.
+	/// @return NULL if the body did not exist at the end of the step.
+	const cb2ViewBody* GetBody(cb2Handle handle) const;
+
+	/// Get the fixture proxies of the active bodies.
+	const cb2ViewFixture* GetFixtures() const { return m_fixtures; }
+	int GetFixtureCount() const { return m_fixtureCount; }
+
+	/// Get the touching contacts.
+	const cb2ViewContact* GetContacts() const { return m_contacts; }
+	int GetContactCount() const { return m_contactCount; }
+
+	/// Get the step count of the world when the view was built.
+	unsigned int GetStepIndex() const { return m_stepIndex; }
+
+	/// Query the fixtures whose AABB overlaps the query AABB.
+	/// @see cb2World::QueryAABB
+	void QueryAABB(cb2ViewQueryCallback* callback, const cb2AABB& aabb) const;
+
+	/// Ray-cast the fixtures at their transforms in the view.
+	/// @see cb2World::RayCast
+	void RayCast(cb2ViewRayCastCallback* callback, const ci::Vec2f& point1, const ci::Vec2f& point2) const;
+
+private:
+
+	friend class cb2World;
+	friend struct cb2ViewQueryWrapper;
+	friend struct cb2ViewRayCastWrapper;
+
+	cb2WorldView(const cb2WorldView&);
+	cb2WorldView& operator=(const cb2WorldView&);
+
+	cb2AllocatorInterface* m_allocator;
+
+	cb2ViewBody* m_bodies;
+	int m_bodyCount;
+	int m_bodyCapacity;
+
+	// The body index of each body handle index, -1 for none.
+	int* m_bodyIndices;
+	int m_bodyIndexCapacity;
+
+	cb2ViewFixture* m_fixtures;
+	cb2AABB* m_fixtureAABBs;
+	void** m_fixtureUserData;
+	int* m_fixtureProxyIds;
+	int m_fixtureCount;
+	int m_fixtureCapacity;
+
+	cb2ViewContact* m_contacts;
+	int m_contactCount;
+	int m_contactCapacity;
+
+	cb2DynamicTree m_tree;
+	unsigned int m_stepIndex;
+
+	// The build count of the world when this was built, see cb2World::m_viewStamp.
+	unsigned int m_stamp;
+
+	// The number of cb2World::AcquireView holders.
+	mutable std::atomic<int> m_readerCount;
+};
+
+#endif
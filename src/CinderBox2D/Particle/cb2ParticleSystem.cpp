@@ -0,0 +1,792 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Particle/cb2ParticleSystem.h>
+#include <CinderBox2D/Collision/Shapes/cb2Shape.h>
+#include <CinderBox2D/Common/cb2Draw.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <CinderBox2D/Dynamics/cb2BodyAggregate.h>
+#include <CinderBox2D/Dynamics/cb2Fixture.h>
+#include <CinderBox2D/Dynamics/cb2World.h>
+#include <CinderBox2D/Dynamics/cb2TimeStep.h>
+#include <memory.h>
+
+// LiquidFun style weights: particles push apart once their neighbour weights add up
+// to more than one, the pressure is capped at five.
+static const float cb2_particleMinWeight = 1.0f;
+static const float cb2_particleMaxWeight = 5.0f;
+
+// Particles are packed closer than a diameter, which is about where the pressure of
+// a liquid at rest balances.
+static const float cb2_particleStride = 0.75f;
+
+// Pick the iterations of a step so gravity moves a particle at most about a hundredth
+// of its radius per iteration squared, see b2CalculateParticleIterations.
+static const float cb2_particleRadiusThreshold = 0.01f;
+static const int cb2_particleMaxIterations = 8;
+
+cb2ParticleSystem::cb2ParticleSystem(const cb2ParticleSystemDef* def, cb2World* world)
+{
+	cb2Assert(def->radius > 0.0f);
+	cb2Assert(def->density > 0.0f);
+
+	m_world = world;
+	m_allocator = world->m_allocator;
+	m_prev = NULL;
+	m_next = NULL;
+
+	m_radius = def->radius;
+	m_diameter = 2.0f * def->radius;
+	m_inverseDiameter = 1.0f / m_diameter;
+	m_density = def->density;
+	m_gravityScale = def->gravityScale;
+	m_pressureStrength = def->pressureStrength;
+	m_viscousStrength = def->viscousStrength;
+	m_damping = def->damping;
+	m_restitution = def->restitution;
+	m_iterations = def->iterations;
+	m_maskBits = def->maskBits;
+	m_userDataPointer = def->userData;
+
+	m_count = 0;
+	m_capacity = 0;
+	m_hasZombies = false;
+	m_hasLifetimes = false;
+	m_positions = NULL;
+	m_velocities = NULL;
+	m_newVelocities = NULL;
+	m_userData = NULL;
+	m_lifetimes = NULL;
+	m_flags = NULL;
+	m_weights = NULL;
+	m_pressures = NULL;
+	m_buckets = NULL;
+	m_neighbourStarts = NULL;
+
+	m_bucketCount = 0;
+	m_bucketCapacity = 0;
+	m_bucketStarts = NULL;
+	m_sortedParticles = NULL;
+	m_sortedPositions = NULL;
+
+	m_neighbours = NULL;
+	m_neighbourCount = 0;
+	m_neighbourCapacity = 0;
+
+	m_dt = 0.0f;
+	m_inv_dt = 0.0f;
+	cb2::setZero(m_gravityVelocity);
+}
+
+cb2ParticleSystem::~cb2ParticleSystem()
+{
+	cb2Free(m_allocator, m_positions);
+	cb2Free(m_allocator, m_velocities);
+	cb2Free(m_allocator, m_newVelocities);
+	cb2Free(m_allocator, m_userData);
+	cb2Free(m_allocator, m_lifetimes);
+	cb2Free(m_allocator, m_flags);
+	cb2Free(m_allocator, m_weights);
+	cb2Free(m_allocator, m_pressures);
+	cb2Free(m_allocator, m_buckets);
+	cb2Free(m_allocator, m_neighbourStarts);
+	cb2Free(m_allocator, m_bucketStarts);
+	cb2Free(m_allocator, m_sortedParticles);
+	cb2Free(m_allocator, m_sortedPositions);
+	cb2Free(m_allocator, m_neighbours);
+}
+
+// Grow a particle buffer, keeping the first count entries.
+template <typename T>
+static T* cb2ReallocateBuffer(cb2AllocatorInterface* allocator, T* buffer, int count, int capacity)
+{
+	T* newBuffer = (T*)cb2Alloc(allocator, capacity * sizeof(T));
+	if (buffer)
+	{
+		memcpy(newBuffer, buffer, count * sizeof(T));
+		cb2Free(allocator, buffer);
+	}
+	return newBuffer;
+}
+
+void cb2ParticleSystem::Reserve(int capacity)
+{
+	if (capacity <= m_capacity)
+	{
+		return;
+	}
+
+	capacity = cb2Max(capacity, cb2Max(2 * m_capacity, 256));
+	m_positions = cb2ReallocateBuffer(m_allocator, m_positions, m_count, capacity);
+	m_velocities = cb2ReallocateBuffer(m_allocator, m_velocities, m_count, capacity);
+	m_userData = cb2ReallocateBuffer(m_allocator, m_userData, m_count, capacity);
+	m_lifetimes = cb2ReallocateBuffer(m_allocator, m_lifetimes, m_count, capacity);
+	m_flags = cb2ReallocateBuffer(m_allocator, m_flags, m_count, capacity);
+
+	// Scratch buffers, only valid during a step.
+	m_newVelocities = cb2ReallocateBuffer(m_allocator, m_newVelocities, 0, capacity);
+	m_weights = cb2ReallocateBuffer(m_allocator, m_weights, 0, capacity);
+	m_pressures = cb2ReallocateBuffer(m_allocator, m_pressures, 0, capacity);
+	m_buckets = cb2ReallocateBuffer(m_allocator, m_buckets, 0, capacity);
+	m_sortedParticles = cb2ReallocateBuffer(m_allocator, m_sortedParticles, 0, capacity);
+	m_sortedPositions = cb2ReallocateBuffer(m_allocator, m_sortedPositions, 0, capacity);
+	m_neighbourStarts = cb2ReallocateBuffer(m_allocator, m_neighbourStarts, 0, capacity + 1);
+	m_capacity = capacity;
+}
+
+int cb2ParticleSystem::CreateParticle(const cb2ParticleDef& def)
+{
+	cb2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return -1;
+	}
+
+	Reserve(m_count + 1);
+
+	int index = m_count;
+	m_positions[index] = def.position;
+	m_velocities[index] = def.velocity;
+	m_userData[index] = def.userData;
+	m_lifetimes[index] = def.lifetime;
+	m_hasLifetimes = m_hasLifetimes || def.lifetime > 0.0f;
+	m_flags[index] = 0;
+	++m_count;
+	return index;
+}
+
+int cb2ParticleSystem::CreateParticles(const cb2Shape* shape, const cb2Transform& xf, const ci::Vec2f& velocity)
+{
+	cb2AABB aabb;
+	shape->ComputeAABB(&aabb, xf, 0);
+	for (int i = 1; i < shape->GetChildCount(); ++i)
+	{
+		cb2AABB childAABB;
+		shape->ComputeAABB(&childAABB, xf, i);
+		aabb.Combine(childAABB);
+	}
+
+	cb2ParticleDef def;
+	def.velocity = velocity;
+
+	float stride = cb2_particleStride * m_diameter;
+	int count = 0;
+	for (float y = aabb.lowerBound.y + 0.5f * stride; y < aabb.upperBound.y; y += stride)
+	{
+		for (float x = aabb.lowerBound.x + 0.5f * stride; x < aabb.upperBound.x; x += stride)
+		{
+			def.position.set(x, y);
+			if (shape->TestPoint(xf, def.position) && CreateParticle(def) >= 0)
+			{
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+void cb2ParticleSystem::DestroyParticle(int index)
+{
+	cb2Assert(0 <= index && index < m_count);
+	m_flags[index] |= e_zombieFlag;
+	m_hasZombies = true;
+}
+
+int cb2ParticleSystem::DestroyParticlesInShape(const cb2Shape* shape, const cb2Transform& xf)
+{
+	int count = 0;
+	for (int i = 0; i < m_count; ++i)
+	{
+		if ((m_flags[i] & e_zombieFlag) == 0 && shape->TestPoint(xf, m_positions[i]))
+		{
+			DestroyParticle(i);
+			++count;
+		}
+	}
+	return count;
+}
+
+// Destroy the particles whose lifetime ran out.
+void cb2ParticleSystem::ExpireParticles(float dt)
+{
+	if (m_hasLifetimes == false)
+	{
+		return;
+	}
+
+	bool hasLifetimes = false;
+	for (int i = 0; i < m_count; ++i)
+	{
+		float lifetime = m_lifetimes[i];
+		if (lifetime <= 0.0f)
+		{
+			continue;
+		}
+
+		lifetime -= dt;
+		if (lifetime <= 0.0f)
+		{
+			m_flags[i] |= e_zombieFlag;
+			m_hasZombies = true;
+		}
+		else
+		{
+			hasLifetimes = true;
+		}
+		m_lifetimes[i] = cb2Max(lifetime, 0.0f);
+	}
+	m_hasLifetimes = hasLifetimes;
+}
+
+void cb2ParticleSystem::RemoveZombies()
+{
+	if (m_hasZombies == false)
+	{
+		return;
+	}
+
+	// Keep the order, so the indices only shift down.
+	int count = 0;
+	for (int i = 0; i < m_count; ++i)
+	{
+		if (m_flags[i] & e_zombieFlag)
+		{
+			continue;
+		}
+
+		m_positions[count] = m_positions[i];
+		m_velocities[count] = m_velocities[i];
+		m_userData[count] = m_userData[i];
+		m_lifetimes[count] = m_lifetimes[i];
+		m_flags[count] = m_flags[i];
+		++count;
+	}
+
+	m_count = count;
+	m_hasZombies = false;
+}
+
+// Cells are one interaction distance wide and hashed into a power of two buckets.
+unsigned int cb2ParticleSystem::GetBucket(int x, int y) const
+{
+	unsigned int h = ((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u);
+	return h & (unsigned int)(m_bucketCount - 1);
+}
+
+// Get the distinct buckets of the cells around a point, two cells may share a bucket.
+int cb2ParticleSystem::GatherBuckets(const ci::Vec2f& p, unsigned int* buckets) const
+{
+	int cx = (int)floorf(p.x * m_inverseDiameter);
+	int cy = (int)floorf(p.y * m_inverseDiameter);
+
+	int count = 0;
+	for (int y = cy - 1; y <= cy + 1; ++y)
+	{
+		for (int x = cx - 1; x <= cx + 1; ++x)
+		{
+			unsigned int bucket = GetBucket(x, y);
+			bool found = false;
+			for (int i = 0; i < count; ++i)
+			{
+				found = found || buckets[i] == bucket;
+			}
+
+			if (found == false)
+			{
+				buckets[count++] = bucket;
+			}
+		}
+	}
+	return count;
+}
+
+void cb2ParticleSystem::UpdateHash()
+{
+	int bucketCount = 64;
+	while (bucketCount < 2 * m_count)
+	{
+		bucketCount *= 2;
+	}
+
+	if (bucketCount > m_bucketCapacity)
+	{
+		cb2Free(m_allocator, m_bucketStarts);
+		m_bucketCapacity = bucketCount;
+		m_bucketStarts = (int*)cb2Alloc(m_allocator, (m_bucketCapacity + 1) * sizeof(int));
+	}
+	m_bucketCount = bucketCount;
+
+	// A counting sort of the particles by bucket.
+	memset(m_bucketStarts, 0, (m_bucketCount + 1) * sizeof(int));
+	for (int i = 0; i < m_count; ++i)
+	{
+		const ci::Vec2f& p = m_positions[i];
+		unsigned int bucket = GetBucket((int)floorf(p.x * m_inverseDiameter), (int)floorf(p.y * m_inverseDiameter));
+		m_buckets[i] = bucket;
+		++m_bucketStarts[bucket + 1];
+	}
+
+	for (int i = 0; i < m_bucketCount; ++i)
+	{
+		m_bucketStarts[i + 1] += m_bucketStarts[i];
+	}
+
+	// Fill back to front, using the starts of the next buckets as cursors.
+	for (int i = m_count - 1; i >= 0; --i)
+	{
+		int slot = --m_bucketStarts[m_buckets[i] + 1];
+		m_sortedParticles[slot] = i;
+		m_sortedPositions[slot] = m_positions[i];
+	}
+
+	// The cursor of bucket b moved down to its start, shift them into place.
+	for (int i = 0; i < m_bucketCount; ++i)
+	{
+		m_bucketStarts[i] = m_bucketStarts[i + 1];
+	}
+	m_bucketStarts[m_bucketCount] = m_count;
+}
+
+void cb2ParticleSystem::Run(cb2TaskFunction* task, int count, int rangeSize)
+{
+	if (m_world->m_taskScheduler && count > rangeSize)
+	{
+		cb2TaskScheduler* scheduler = &m_world->m_stepScheduler;
+		void* group = scheduler->EnqueueRange(task, this, count, rangeSize);
+		scheduler->Wait(group);
+	}
+	else
+	{
+		task(this, 0, count, 0);
+	}
+}
+
+// Count the neighbours of each particle and add up their weights, which gives the
+// pressure of the particle.
+void cb2ParticleSystem::CountNeighbours(int begin, int end)
+{
+	float criticalVelocity = m_diameter * m_inv_dt;
+	float pressurePerWeight = m_pressureStrength * m_density * criticalVelocity * criticalVelocity;
+	float diameterSquared = m_diameter * m_diameter;
+
+	for (int i = begin; i < end; ++i)
+	{
+		const ci::Vec2f p = m_positions[i];
+		unsigned int buckets[9];
+		int bucketCount = GatherBuckets(p, buckets);
+
+		int count = 0;
+		float weight = 0.0f;
+		for (int k = 0; k < bucketCount; ++k)
+		{
+			int last = m_bucketStarts[buckets[k] + 1];
+			for (int s = m_bucketStarts[buckets[k]]; s < last; ++s)
+			{
+				float distanceSquared = (m_sortedPositions[s] - p).lengthSquared();
+				if (distanceSquared >= diameterSquared || m_sortedParticles[s] == i)
+				{
+					continue;
+				}
+
+				weight += 1.0f - cb2Sqrt(distanceSquared) * m_inverseDiameter;
+				++count;
+			}
+		}
+
+		m_neighbourStarts[i] = count;
+		m_weights[i] = weight;
+		float h = cb2Min(weight, cb2_particleMaxWeight) - cb2_particleMinWeight;
+		m_pressures[i] = pressurePerWeight * cb2Max(h, 0.0f);
+	}
+}
+
+// List the neighbours in the slots counted for them.
+void cb2ParticleSystem::FindNeighbours(int begin, int end)
+{
+	float diameterSquared = m_diameter * m_diameter;
+
+	for (int i = begin; i < end; ++i)
+	{
+		const ci::Vec2f p = m_positions[i];
+		unsigned int buckets[9];
+		int bucketCount = GatherBuckets(p, buckets);
+
+		cb2ParticleNeighbour* neighbour = m_neighbours + m_neighbourStarts[i];
+		for (int k = 0; k < bucketCount; ++k)
+		{
+			int last = m_bucketStarts[buckets[k] + 1];
+			for (int s = m_bucketStarts[buckets[k]]; s < last; ++s)
+			{
+				ci::Vec2f d = m_sortedPositions[s] - p;
+				float distanceSquared = d.lengthSquared();
+				int j = m_sortedParticles[s];
+				if (distanceSquared >= diameterSquared || j == i)
+				{
+					continue;
+				}
+
+				float distance = cb2Sqrt(distanceSquared);
+				neighbour->index = j;
+				neighbour->weight = 1.0f - distance * m_inverseDiameter;
+				if (distance > 0.0f)
+				{
+					neighbour->normal = (1.0f / distance) * d;
+				}
+				else
+				{
+					// Particles on top of each other are pushed apart along x.
+					neighbour->normal.set(i < j ? 1.0f : -1.0f, 0.0f);
+				}
+				++neighbour;
+			}
+		}
+
+		cb2Assert(neighbour == m_neighbours + m_neighbourStarts[i + 1]);
+	}
+}
+
+// Apply gravity, pressure and viscosity. Each particle gathers the impulses of its
+// neighbours, which are the same as the pairwise impulses of LiquidFun for the
+// pressure. The viscosity reads the velocities from before the pass, so its strength
+// is capped by the weights to keep the average from overshooting.
+void cb2ParticleSystem::SolveFluid(int begin, int end)
+{
+	float velocityPerPressure = m_dt / (m_density * m_diameter);
+	float criticalVelocity = m_diameter * m_inv_dt;
+	float maxSpeedSquared = criticalVelocity * criticalVelocity;
+	float damping = 1.0f / (1.0f + m_dt * m_damping);
+
+	for (int i = begin; i < end; ++i)
+	{
+		const ci::Vec2f v = m_velocities[i];
+		float pressure = m_pressures[i];
+		float viscosity = m_weights[i] > 0.0f ? cb2Min(m_viscousStrength, 1.0f / m_weights[i]) : 0.0f;
+
+		ci::Vec2f dv(0.0f, 0.0f);
+		int last = m_neighbourStarts[i + 1];
+		for (int k = m_neighbourStarts[i]; k < last; ++k)
+		{
+			const cb2ParticleNeighbour& neighbour = m_neighbours[k];
+			float w = neighbour.weight;
+			dv -= (velocityPerPressure * w * (pressure + m_pressures[neighbour.index])) * neighbour.normal;
+			dv += (viscosity * w) * (m_velocities[neighbour.index] - v);
+		}
+
+		ci::Vec2f vNew = damping * (v + m_gravityVelocity) + dv;
+
+		// Particles move at most one diameter per step.
+		float speedSquared = vNew.lengthSquared();
+		if (speedSquared > maxSpeedSquared)
+		{
+			vNew *= cb2Sqrt(maxSpeedSquared / speedSquared);
+		}
+
+		m_newVelocities[i] = vNew;
+	}
+}
+
+struct cb2ParticleCollisionCallback
+{
+	bool QueryProxy(const cb2FixtureProxy* proxy)
+	{
+		const cb2Fixture* fixture = proxy->fixture;
+		if (fixture->IsSensor() || (fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		const cb2Body* body = fixture->GetBody();
+		float friction = fixture->GetFriction();
+		float bounce = cb2Max(restitution, fixture->GetRestitution());
+
+		for (int s = first; s < last; ++s)
+		{
+			int i = sortedParticles[s];
+			ci::Vec2f p = positions[i];
+			ci::Vec2f v = velocities[i];
+
+			// Cast the motion relative to the surface, one radius further so the
+			// particle stops a radius short of the surface.
+			ci::Vec2f vb = body->GetLinearVelocityFromWorldPoint(p);
+			ci::Vec2f vr = v - vb;
+			float length = dt * vr.length();
+			if (length < cb2_epsilon)
+			{
+				continue;
+			}
+
+			cb2RayCastInput input;
+			input.p1 = p;
+			input.p2 = p + (dt + radius / length * dt) * vr;
+			input.maxFraction = 1.0f;
+
+			cb2AABB segment;
+			segment.lowerBound = cb2Min(input.p1, input.p2);
+			segment.upperBound = cb2Max(input.p1, input.p2);
+			if (cb2TestOverlap(segment, proxy->aabb) == false)
+			{
+				continue;
+			}
+
+			cb2RayCastOutput output;
+			if (fixture->RayCast(&output, input, proxy->childIndex) == false)
+			{
+				continue;
+			}
+
+			// The gap is the distance to the surface along its normal.
+			const ci::Vec2f& n = output.normal;
+			float en = (input.p2 - input.p1).dot(n);
+			if (en >= 0.0f)
+			{
+				continue;
+			}
+
+			float gap = -output.fraction * en;
+			float vn = vr.dot(n);
+			float vnTarget = (radius - gap) * inv_dt;
+			if (vn >= vnTarget)
+			{
+				continue;
+			}
+
+			if (-vn > cb2_velocityThreshold)
+			{
+				vnTarget = cb2Max(vnTarget, -bounce * vn);
+			}
+
+			// Coulomb friction on the normal velocity that was removed.
+			ci::Vec2f vt = vr - vn * n;
+			float tangentSpeed = vt.length();
+			float scale = 0.0f;
+			if (tangentSpeed > 0.0f)
+			{
+				scale = cb2Max(1.0f - friction * (vnTarget - vn) / tangentSpeed, 0.0f);
+			}
+
+			velocities[i] = vb + scale * vt + vnTarget * n;
+			collided = true;
+		}
+
+		return true;
+	}
+
+	const cb2BroadPhase* broadPhase;
+	const ci::Vec2f* positions;
+	ci::Vec2f* velocities;
+	const int* sortedParticles;
+	int first;
+	int last;
+	float radius;
+	float restitution;
+	float dt;
+	float inv_dt;
+	unsigned short maskBits;
+	bool collided;
+};
+
+// Collide the particles of each bucket with the fixtures near them, then move them.
+// Every particle is in one bucket, so buckets can be solved in parallel.
+void cb2ParticleSystem::SolveCollision(int begin, int end)
+{
+	cb2ParticleCollisionCallback callback;
+	callback.broadPhase = &m_world->m_contactManager.m_broadPhase;
+	callback.positions = m_positions;
+	callback.velocities = m_velocities;
+	callback.sortedParticles = m_sortedParticles;
+	callback.radius = m_radius;
+	callback.restitution = m_restitution;
+	callback.dt = m_dt;
+	callback.inv_dt = m_inv_dt;
+	callback.maskBits = m_maskBits;
+
+	for (int b = begin; b < end; ++b)
+	{
+		int first = m_bucketStarts[b];
+		int last = m_bucketStarts[b + 1];
+		if (first == last)
+		{
+			continue;
+		}
+
+		cb2AABB aabb;
+		aabb.lowerBound.set(cb2_maxFloat, cb2_maxFloat);
+		aabb.upperBound.set(-cb2_maxFloat, -cb2_maxFloat);
+		for (int s = first; s < last; ++s)
+		{
+			int i = m_sortedParticles[s];
+			ci::Vec2f p1 = m_positions[i];
+			ci::Vec2f p2 = p1 + m_dt * m_velocities[i];
+			aabb.lowerBound = cb2Min(aabb.lowerBound, cb2Min(p1, p2));
+			aabb.upperBound = cb2Max(aabb.upperBound, cb2Max(p1, p2));
+		}
+
+		ci::Vec2f r(m_radius, m_radius);
+		aabb.lowerBound -= r;
+		aabb.upperBound += r;
+
+		// A particle that slides off one fixture can be turned into another one it
+		// already missed, as in a corner, so buckets that collided are queried again.
+		callback.first = first;
+		callback.last = last;
+		callback.collided = false;
+		cb2QueryFixtureProxies(callback.broadPhase, &callback, aabb);
+		if (callback.collided)
+		{
+			cb2QueryFixtureProxies(callback.broadPhase, &callback, aabb);
+		}
+
+		for (int s = first; s < last; ++s)
+		{
+			int i = m_sortedParticles[s];
+			m_positions[i] += m_dt * m_velocities[i];
+		}
+	}
+}
+
+void cb2ParticleSystem::CountNeighboursTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	((cb2ParticleSystem*)context)->CountNeighbours(begin, end);
+}
+
+void cb2ParticleSystem::FindNeighboursTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	((cb2ParticleSystem*)context)->FindNeighbours(begin, end);
+}
+
+void cb2ParticleSystem::SolveFluidTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	((cb2ParticleSystem*)context)->SolveFluid(begin, end);
+}
+
+void cb2ParticleSystem::SolveCollisionTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	((cb2ParticleSystem*)context)->SolveCollision(begin, end);
+}
+
+bool cb2ParticleSystem::IsInteracting() const
+{
+	return m_pressureStrength > 0.0f || m_viscousStrength > 0.0f;
+}
+
+void cb2ParticleSystem::Solve(const cb2TimeStep& step)
+{
+	if (step.dt > 0.0f)
+	{
+		ExpireParticles(step.dt);
+	}
+
+	RemoveZombies();
+	if (m_count == 0 || step.dt <= 0.0f)
+	{
+		return;
+	}
+
+	// Small particles under strong gravity pile up faster than the pressure can push
+	// them apart in one step, so the step is split like LiquidFun suggests. Particles
+	// that do not interact have nothing to pile up against.
+	float gravity = m_gravityScale * m_world->GetGravity().length();
+	int iterations = m_iterations;
+	if (iterations == 0 && IsInteracting() == false)
+	{
+		iterations = 1;
+	}
+	else if (iterations == 0)
+	{
+		iterations = (int)ceilf(cb2Sqrt(gravity / (cb2_particleRadiusThreshold * m_radius)) * step.dt);
+		iterations = cb2Clamp(iterations, 1, cb2_particleMaxIterations);
+	}
+
+	m_dt = step.dt / iterations;
+	m_inv_dt = step.inv_dt * iterations;
+	m_gravityVelocity = (m_dt * m_gravityScale) * m_world->GetGravity();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		SolveIteration();
+	}
+}
+
+void cb2ParticleSystem::SolveIteration()
+{
+	UpdateHash();
+
+	if (IsInteracting() == false)
+	{
+		// The fluid pass only applies gravity and damping without neighbours.
+		memset(m_neighbourStarts, 0, (m_count + 1) * sizeof(int));
+		memset(m_weights, 0, m_count * sizeof(float));
+		memset(m_pressures, 0, m_count * sizeof(float));
+		m_neighbourCount = 0;
+		Run(SolveFluidTask, m_count, 1024);
+
+		ci::Vec2f* velocities = m_velocities;
+		m_velocities = m_newVelocities;
+		m_newVelocities = velocities;
+
+		Run(SolveCollisionTask, m_bucketCount, 512);
+		return;
+	}
+
+	Run(CountNeighboursTask, m_count, 256);
+
+	// Turn the counts into the starts of the neighbour lists.
+	int neighbourCount = 0;
+	for (int i = 0; i < m_count; ++i)
+	{
+		int count = m_neighbourStarts[i];
+		m_neighbourStarts[i] = neighbourCount;
+		neighbourCount += count;
+	}
+	m_neighbourStarts[m_count] = neighbourCount;
+
+	if (neighbourCount > m_neighbourCapacity)
+	{
+		cb2Free(m_allocator, m_neighbours);
+		m_neighbourCapacity = cb2Max(neighbourCount, 2 * m_neighbourCapacity);
+		m_neighbours = (cb2ParticleNeighbour*)cb2Alloc(m_allocator, m_neighbourCapacity * sizeof(cb2ParticleNeighbour));
+	}
+	m_neighbourCount = neighbourCount;
+
+	Run(FindNeighboursTask, m_count, 256);
+	Run(SolveFluidTask, m_count, 256);
+
+	ci::Vec2f* velocities = m_velocities;
+	m_velocities = m_newVelocities;
+	m_newVelocities = velocities;
+
+	Run(SolveCollisionTask, m_bucketCount, 512);
+}
+
+void cb2ParticleSystem::ShiftOrigin(const ci::Vec2f& newOrigin)
+{
+	for (int i = 0; i < m_count; ++i)
+	{
+		m_positions[i] -= newOrigin;
+	}
+}
+
+void cb2ParticleSystem::Draw(cb2Draw* draw) const
+{
+	draw->DrawParticles(m_positions, m_radius, m_count, cb2Color(0.3f, 0.5f, 0.9f));
+}
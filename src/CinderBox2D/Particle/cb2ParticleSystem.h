@@ -0,0 +1,291 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_PARTICLE_SYSTEM_H
+#define CB2_PARTICLE_SYSTEM_H
+
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Collision/cb2Collision.h>
+
+class cb2World;
+class cb2Shape;
+class cb2Draw;
+struct cb2TimeStep;
+
+/// A particle definition, used to create particles.
+struct cb2ParticleDef
+{
+	cb2ParticleDef()
+	{
+		cb2::setZero(position);
+		cb2::setZero(velocity);
+		lifetime = 0.0f;
+		userData = NULL;
+	}
+
+	/// The world position of the particle.
+	ci::Vec2f position;
+
+	/// The linear velocity of the particle in world co-ordinates.
+	ci::Vec2f velocity;
+
+	/// The particle is destroyed after this many seconds, 0 keeps it.
+	float lifetime;
+
+	/// Use this to store application specific particle data.
+	void* userData;
+};
+
+/// A particle system definition, used to create a particle system.
+struct cb2ParticleSystemDef
+{
+	cb2ParticleSystemDef()
+	{
+		radius = 0.05f;
+		density = 1.0f;
+		gravityScale = 1.0f;
+		pressureStrength = 0.05f;
+		viscousStrength = 0.25f;
+		damping = 0.0f;
+		restitution = 0.0f;
+		iterations = 0;
+		maskBits = 0xFFFF;
+		userData = NULL;
+	}
+
+	/// The radius of every particle. Particles interact within twice the radius.
+	float radius;
+
+	/// The density of the fluid, it scales the pressure.
+	float density;
+
+	/// Scale the world gravity applied to the particles.
+	float gravityScale;
+
+	/// How strongly particles that are pushed together repel each other. Around
+	/// 0.05 gives a liquid, higher values a stiffer fluid.
+	float pressureStrength;
+
+	/// How strongly neighbours take on each others velocity, in [0, 1]. Low values
+	/// splash, high values behave like honey. Granular materials want a low pressure
+	/// and a high viscosity.
+	///
+	/// With no pressure and no viscosity the particles do not interact, which suits
+	/// sparks and debris. Their steps skip the neighbour search and take a single
+	/// iteration, they only collide with the fixtures.
+	float viscousStrength;
+
+	/// Linear damping of the particle velocities.
+	float damping;
+
+	/// How much particles bounce off fixtures, mixed with the fixture restitution
+	/// like contacts are.
+	float restitution;
+
+	/// The iterations per step, or 0 to pick them from the gravity and the radius.
+	int iterations;
+
+	/// The category bits of the fixtures the particles collide with.
+	unsigned short maskBits;
+
+	/// Use this to store application specific particle system data.
+	void* userData;
+};
+
+/// A swarm of small particles that form liquids and granular materials, stepped with
+/// the world but without bodies, proxies or contacts of their own. Each step finds
+/// the neighbours of every particle in a spatial hash, applies a pressure that
+/// pushes crowded particles apart and a viscosity that evens out their velocities,
+/// and then collides the particles with the fixtures near them. The coupling is one
+/// way: fixtures stop particles, but bodies do not feel them. The per particle work
+/// runs on the task scheduler of the world.
+///
+/// The particle buffers are separate arrays, so the positions can be handed to a
+/// renderer as they are. Particle indices are stable, except that destroyed particles
+/// are removed at the start of the next step, which moves the later particles down.
+class cb2ParticleSystem
+{
+public:
+
+	/// Create a particle.
+	/// @return the index of the particle.
+	int CreateParticle(const cb2ParticleDef& def);
+
+	/// Fill a shape with particles on a grid a bit closer than a particle diameter.
+	/// @param shape the shape, in the frame of xf.
+	/// @param xf where the shape is.
+	/// @param velocity the velocity of the new particles.
+	/// @return the number of particles created.
+	int CreateParticles(const cb2Shape* shape, const cb2Transform& xf, const ci::Vec2f& velocity);
+
+	/// Destroy a particle. It is removed at the start of the next step.
+	void DestroyParticle(int index);
+
+	/// Destroy the particles inside a shape, for example at a drain.
+	/// @return the number of particles destroyed.
+	int DestroyParticlesInShape(const cb2Shape* shape, const cb2Transform& xf);
+
+	/// Get the number of particles, including those destroyed since the last step.
+	int GetParticleCount() const { return m_count; }
+
+	/// Get the particle positions, one per particle.
+	const ci::Vec2f* GetPositionBuffer() const { return m_positions; }
+
+	/// Get the particle velocities, one per particle. They may be changed between steps.
+	ci::Vec2f* GetVelocityBuffer() { return m_velocities; }
+	const ci::Vec2f* GetVelocityBuffer() const { return m_velocities; }
+
+	/// Get the user data of the particles, one per particle.
+	void** GetUserDataBuffer() { return m_userData; }
+
+	/// Get the time left of the particles, one per particle, 0 for particles that
+	/// live on.
+	float* GetLifetimeBuffer() { return m_lifetimes; }
+	const float* GetLifetimeBuffer() const { return m_lifetimes; }
+
+	/// Get the radius of the particles.
+	float GetRadius() const { return m_radius; }
+
+	/// Set the material, see cb2ParticleSystemDef.
+	void SetPressureStrength(float strength) { m_pressureStrength = strength; }
+	float GetPressureStrength() const { return m_pressureStrength; }
+	void SetViscousStrength(float strength) { m_viscousStrength = strength; }
+	float GetViscousStrength() const { return m_viscousStrength; }
+	void SetDamping(float damping) { m_damping = damping; }
+	float GetDamping() const { return m_damping; }
+	void SetRestitution(float restitution) { m_restitution = restitution; }
+	float GetRestitution() const { return m_restitution; }
+	void SetGravityScale(float scale) { m_gravityScale = scale; }
+	float GetGravityScale() const { return m_gravityScale; }
+
+	/// Set the iterations per step, 0 picks them from the gravity and the radius.
+	void SetIterations(int iterations) { m_iterations = iterations; }
+	int GetIterations() const { return m_iterations; }
+
+	/// Get the next particle system in the world list.
+	cb2ParticleSystem* GetNext() { return m_next; }
+	const cb2ParticleSystem* GetNext() const { return m_next; }
+
+	/// Get the parent world.
+	cb2World* GetWorld() { return m_world; }
+
+	/// Get/set the user data of the particle system.
+	void* GetUserData() const { return m_userDataPointer; }
+	void SetUserData(void* data) { m_userDataPointer = data; }
+
+	/// Draw the particles as circles.
+	void Draw(cb2Draw* draw) const;
+
+protected:
+
+	friend class cb2World;
+
+	cb2ParticleSystem(const cb2ParticleSystemDef* def, cb2World* world);
+	~cb2ParticleSystem();
+
+	/// A neighbour of a particle within the interaction distance.
+	struct cb2ParticleNeighbour
+	{
+		int index;
+		float weight;		// 1 at the same position, 0 at the interaction distance
+		ci::Vec2f normal;	// from the particle to the neighbour
+	};
+
+	enum
+	{
+		e_zombieFlag = 0x0001
+	};
+
+	void Solve(const cb2TimeStep& step);
+	void SolveIteration();
+	void ShiftOrigin(const ci::Vec2f& newOrigin);
+
+	void Reserve(int capacity);
+	void RemoveZombies();
+	void ExpireParticles(float dt);
+	bool IsInteracting() const;
+	void UpdateHash();
+	unsigned int GetBucket(int x, int y) const;
+	int GatherBuckets(const ci::Vec2f& p, unsigned int* buckets) const;
+	void Run(cb2TaskFunction* task, int count, int rangeSize);
+
+	void CountNeighbours(int begin, int end);
+	void FindNeighbours(int begin, int end);
+	void SolveFluid(int begin, int end);
+	void SolveCollision(int begin, int end);
+
+	static void CountNeighboursTask(void* context, int begin, int end, int threadIndex);
+	static void FindNeighboursTask(void* context, int begin, int end, int threadIndex);
+	static void SolveFluidTask(void* context, int begin, int end, int threadIndex);
+	static void SolveCollisionTask(void* context, int begin, int end, int threadIndex);
+
+	cb2World* m_world;
+	cb2AllocatorInterface* m_allocator;
+	cb2ParticleSystem* m_prev;
+	cb2ParticleSystem* m_next;
+
+	float m_radius;
+	float m_diameter;
+	float m_inverseDiameter;
+	float m_density;
+	float m_gravityScale;
+	float m_pressureStrength;
+	float m_viscousStrength;
+	float m_damping;
+	float m_restitution;
+	int m_iterations;
+	unsigned short m_maskBits;
+	void* m_userDataPointer;
+
+	// Per particle.
+	int m_count;
+	int m_capacity;
+	bool m_hasZombies;
+	bool m_hasLifetimes;
+	ci::Vec2f* m_positions;
+	ci::Vec2f* m_velocities;
+	ci::Vec2f* m_newVelocities;
+	void** m_userData;
+	float* m_lifetimes;
+	int* m_flags;
+	float* m_weights;
+	float* m_pressures;
+	unsigned int* m_buckets;
+	int* m_neighbourStarts;
+
+	// The particles sorted by hash bucket. The particles of bucket b are
+	// m_sortedParticles[m_bucketStarts[b], m_bucketStarts[b + 1]). Their positions
+	// are copied in the same order, so the neighbour search reads them in a row.
+	int m_bucketCount;
+	int m_bucketCapacity;
+	int* m_bucketStarts;
+	int* m_sortedParticles;
+	ci::Vec2f* m_sortedPositions;
+
+	cb2ParticleNeighbour* m_neighbours;
+	int m_neighbourCount;
+	int m_neighbourCapacity;
+
+	// The step being solved.
+	float m_dt;
+	float m_inv_dt;
+	ci::Vec2f m_gravityVelocity;
+};
+
+#endif
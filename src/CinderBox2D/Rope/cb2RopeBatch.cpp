@@ -0,0 +1,500 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <CinderBox2D/Rope/cb2RopeBatch.h>
+#include <CinderBox2D/Common/cb2Draw.h>
+#include <CinderBox2D/Common/cb2TaskScheduler.h>
+#include <CinderBox2D/Dynamics/cb2Body.h>
+#include <algorithm>
+#include <memory.h>
+
+struct cb2RopeCountLess
+{
+	bool operator()(int a, int b) const
+	{
+		return defs[a].count > defs[b].count;
+	}
+
+	const cb2RopeDef* defs;
+};
+
+struct cb2RopeStepContext
+{
+	cb2RopeBatch* batch;
+	float h;
+	int iterations;
+};
+
+cb2RopeBatch::cb2RopeBatch()
+{
+	m_ropeCount = 0;
+	m_ropeIndices = NULL;
+	m_ropeVertexCounts = NULL;
+	m_groupCount = 0;
+	m_groupRows = NULL;
+	m_groupRowCounts = NULL;
+	m_xs = NULL;
+	m_ys = NULL;
+	m_x0s = NULL;
+	m_y0s = NULL;
+	m_vxs = NULL;
+	m_vys = NULL;
+	m_ims = NULL;
+	m_Ls = NULL;
+	m_k2s = NULL;
+	m_as = NULL;
+	m_k3s = NULL;
+	m_gravityXs = NULL;
+	m_gravityYs = NULL;
+	m_dampings = NULL;
+	m_attachments = NULL;
+	m_attachmentCount = 0;
+	m_attachmentCapacity = 0;
+}
+
+cb2RopeBatch::~cb2RopeBatch()
+{
+	Free();
+}
+
+void cb2RopeBatch::Free()
+{
+	cb2Free(m_ropeIndices);
+	cb2Free(m_ropeVertexCounts);
+	cb2Free(m_groupRows);
+	cb2Free(m_groupRowCounts);
+	cb2Free(m_xs);
+	cb2Free(m_ys);
+	cb2Free(m_x0s);
+	cb2Free(m_y0s);
+	cb2Free(m_vxs);
+	cb2Free(m_vys);
+	cb2Free(m_ims);
+	cb2Free(m_Ls);
+	cb2Free(m_k2s);
+	cb2Free(m_as);
+	cb2Free(m_k3s);
+	cb2Free(m_gravityXs);
+	cb2Free(m_gravityYs);
+	cb2Free(m_dampings);
+	cb2Free(m_attachments);
+
+	m_ropeCount = 0;
+	m_groupCount = 0;
+	m_attachments = NULL;
+	m_attachmentCount = 0;
+	m_attachmentCapacity = 0;
+}
+
+static float* cb2AllocZeroed(int count)
+{
+	float* values = (float*)cb2Alloc(count * sizeof(float));
+	memset(values, 0, count * sizeof(float));
+	return values;
+}
+
+void cb2RopeBatch::Initialize(const cb2RopeDef* defs, int count)
+{
+	Free();
+
+	m_ropeCount = count;
+	m_ropeIndices = (int*)cb2Alloc(count * sizeof(int));
+	m_ropeVertexCounts = (int*)cb2Alloc(count * sizeof(int));
+
+	// Group the longest ropes together.
+	int* order = (int*)cb2Alloc(count * sizeof(int));
+	for (int i = 0; i < count; ++i)
+	{
+		cb2Assert(defs[i].count >= 3);
+		order[i] = i;
+	}
+
+	cb2RopeCountLess less;
+	less.defs = defs;
+	std::stable_sort(order, order + count, less);
+
+	m_groupCount = (count + cb2_simdWidth - 1) / cb2_simdWidth;
+	m_groupRows = (int*)cb2Alloc(m_groupCount * sizeof(int));
+	m_groupRowCounts = (int*)cb2Alloc(m_groupCount * sizeof(int));
+
+	int rowCount = 0;
+	for (int i = 0; i < m_groupCount; ++i)
+	{
+		m_groupRows[i] = rowCount;
+		m_groupRowCounts[i] = defs[order[cb2_simdWidth * i]].count;
+		rowCount += m_groupRowCounts[i];
+	}
+
+	int slotCount = cb2_simdWidth * rowCount;
+	m_xs = cb2AllocZeroed(slotCount);
+	m_ys = cb2AllocZeroed(slotCount);
+	m_x0s = cb2AllocZeroed(slotCount);
+	m_y0s = cb2AllocZeroed(slotCount);
+	m_vxs = cb2AllocZeroed(slotCount);
+	m_vys = cb2AllocZeroed(slotCount);
+	m_ims = cb2AllocZeroed(slotCount);
+	m_Ls = cb2AllocZeroed(slotCount);
+	m_k2s = cb2AllocZeroed(slotCount);
+	m_as = cb2AllocZeroed(slotCount);
+	m_k3s = cb2AllocZeroed(slotCount);
+
+	int laneCount = cb2_simdWidth * m_groupCount;
+	m_gravityXs = cb2AllocZeroed(laneCount);
+	m_gravityYs = cb2AllocZeroed(laneCount);
+	m_dampings = cb2AllocZeroed(laneCount);
+
+	for (int i = 0; i < count; ++i)
+	{
+		int group = i / cb2_simdWidth;
+		int lane = i - cb2_simdWidth * group;
+		const cb2RopeDef* def = defs + order[i];
+
+		int first = cb2_simdWidth * m_groupRows[group] + lane;
+		m_ropeIndices[order[i]] = first;
+		m_ropeVertexCounts[order[i]] = def->count;
+
+		m_gravityXs[cb2_simdWidth * group + lane] = def->gravity.x;
+		m_gravityYs[cb2_simdWidth * group + lane] = def->gravity.y;
+		m_dampings[cb2_simdWidth * group + lane] = def->damping;
+
+		// Same as cb2Rope::Initialize.
+		for (int j = 0; j < def->count; ++j)
+		{
+			int index = first + cb2_simdWidth * j;
+			m_xs[index] = def->vertices[j].x;
+			m_ys[index] = def->vertices[j].y;
+			m_x0s[index] = def->vertices[j].x;
+			m_y0s[index] = def->vertices[j].y;
+
+			float m = def->masses[j];
+			m_ims[index] = m > 0.0f ? 1.0f / m : 0.0f;
+		}
+
+		for (int j = 0; j < def->count - 1; ++j)
+		{
+			int index = first + cb2_simdWidth * j;
+			m_Ls[index] = cb2Distance(def->vertices[j], def->vertices[j + 1]);
+			m_k2s[index] = def->k2;
+		}
+
+		for (int j = 0; j < def->count - 2; ++j)
+		{
+			ci::Vec2f d1 = def->vertices[j + 1] - def->vertices[j];
+			ci::Vec2f d2 = def->vertices[j + 2] - def->vertices[j + 1];
+
+			int index = first + cb2_simdWidth * j;
+			m_as[index] = cb2Atan2(cb2Cross(d1, d2), cb2Dot(d1, d2));
+			m_k3s[index] = def->k3;
+		}
+	}
+
+	cb2Free(order);
+}
+
+int cb2RopeBatch::GetLane(int rope) const
+{
+	int first = m_ropeIndices[rope];
+	int row = first / cb2_simdWidth;
+	int group = int(std::upper_bound(m_groupRows, m_groupRows + m_groupCount, row) - m_groupRows) - 1;
+	return cb2_simdWidth * group + first - cb2_simdWidth * row;
+}
+
+void cb2RopeBatch::Attach(int rope, int vertex, cb2Body* body, const ci::Vec2f& localAnchor)
+{
+	if (m_attachmentCount == m_attachmentCapacity)
+	{
+		cb2RopeAttachment* oldAttachments = m_attachments;
+		m_attachmentCapacity = cb2Max(2 * m_attachmentCapacity, 16);
+		m_attachments = (cb2RopeAttachment*)cb2Alloc(m_attachmentCapacity * sizeof(cb2RopeAttachment));
+		if (oldAttachments)
+		{
+			memcpy(m_attachments, oldAttachments, m_attachmentCount * sizeof(cb2RopeAttachment));
+			cb2Free(oldAttachments);
+		}
+	}
+
+	// The pinned vertex is moved by the body only.
+	int index = GetIndex(rope, vertex);
+	cb2RopeAttachment* attachment = m_attachments + m_attachmentCount++;
+	attachment->body = body;
+	attachment->localAnchor = localAnchor;
+	attachment->index = index;
+	attachment->invMass = m_ims[index];
+	attachment->damping = m_dampings[GetLane(rope)];
+	m_ims[index] = 0.0f;
+}
+
+void cb2RopeBatch::Detach(const cb2Body* body)
+{
+	for (int i = 0; i < m_attachmentCount; )
+	{
+		cb2RopeAttachment* attachment = m_attachments + i;
+		if (attachment->body != body)
+		{
+			++i;
+			continue;
+		}
+
+		m_ims[attachment->index] = attachment->invMass;
+		*attachment = m_attachments[--m_attachmentCount];
+	}
+}
+
+void cb2RopeBatch::Step(float h, int iterations, cb2TaskScheduler* scheduler)
+{
+	if (h == 0.0f)
+	{
+		return;
+	}
+
+	// Give pinned vertices the velocity that makes the integration land them
+	// on their anchor, this also gives the rope the motion of the body.
+	for (int i = 0; i < m_attachmentCount; ++i)
+	{
+		const cb2RopeAttachment* attachment = m_attachments + i;
+		int index = attachment->index;
+		float d = expf(-h * attachment->damping);
+
+		ci::Vec2f target = attachment->body->GetWorldPoint(attachment->localAnchor);
+		m_vxs[index] = (target.x - m_xs[index]) / (h * d);
+		m_vys[index] = (target.y - m_ys[index]) / (h * d);
+	}
+
+	cb2RopeStepContext context;
+	context.batch = this;
+	context.h = h;
+	context.iterations = iterations;
+
+	if (scheduler && m_groupCount > 1)
+	{
+		void* group = scheduler->EnqueueRange(StepTask, &context, m_groupCount, 4);
+		scheduler->Wait(group);
+	}
+	else
+	{
+		StepTask(&context, 0, m_groupCount, 0);
+	}
+}
+
+void cb2RopeBatch::StepTask(void* context, int begin, int end, int threadIndex)
+{
+	CB2_NOT_USED(threadIndex);
+	cb2RopeStepContext* stepContext = (cb2RopeStepContext*)context;
+	for (int i = begin; i < end; ++i)
+	{
+		stepContext->batch->StepGroup(i, stepContext->h, stepContext->iterations);
+	}
+}
+
+// cb2Rope::Step for the four ropes of a group.
+void cb2RopeBatch::StepGroup(int group, float h, int iterations)
+{
+	int row = m_groupRows[group];
+	int rowCount = m_groupRowCounts[group];
+
+	const float* dampings = m_dampings + cb2_simdWidth * group;
+	cb2FloatW d = cb2SetW(expf(-h * dampings[0]), expf(-h * dampings[1]), expf(-h * dampings[2]), expf(-h * dampings[3]));
+	cb2FloatW hW = cb2SplatW(h);
+	cb2FloatW gx = cb2MulW(hW, cb2LoadW(m_gravityXs + cb2_simdWidth * group));
+	cb2FloatW gy = cb2MulW(hW, cb2LoadW(m_gravityYs + cb2_simdWidth * group));
+	cb2FloatW zero = cb2ZeroW();
+
+	for (int i = 0; i < rowCount; ++i)
+	{
+		int slot = cb2_simdWidth * (row + i);
+		cb2FloatW x = cb2LoadW(m_xs + slot);
+		cb2FloatW y = cb2LoadW(m_ys + slot);
+		cb2StoreW(m_x0s + slot, x);
+		cb2StoreW(m_y0s + slot, y);
+
+		// Only vertices with mass feel gravity.
+		cb2FloatW massless = cb2GreaterEqualW(zero, cb2LoadW(m_ims + slot));
+		cb2FloatW vx = cb2AddW(cb2LoadW(m_vxs + slot), cb2SelectW(massless, zero, gx));
+		cb2FloatW vy = cb2AddW(cb2LoadW(m_vys + slot), cb2SelectW(massless, zero, gy));
+		vx = cb2MulW(vx, d);
+		vy = cb2MulW(vy, d);
+
+		cb2StoreW(m_vxs + slot, vx);
+		cb2StoreW(m_vys + slot, vy);
+		cb2StoreW(m_xs + slot, cb2AddW(x, cb2MulW(hW, vx)));
+		cb2StoreW(m_ys + slot, cb2AddW(y, cb2MulW(hW, vy)));
+	}
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		SolveStretch(row, rowCount);
+		SolveBend(row, rowCount);
+		SolveStretch(row, rowCount);
+	}
+
+	cb2FloatW inv_h = cb2SplatW(1.0f / h);
+	for (int i = 0; i < rowCount; ++i)
+	{
+		int slot = cb2_simdWidth * (row + i);
+		cb2StoreW(m_vxs + slot, cb2MulW(inv_h, cb2SubW(cb2LoadW(m_xs + slot), cb2LoadW(m_x0s + slot))));
+		cb2StoreW(m_vys + slot, cb2MulW(inv_h, cb2SubW(cb2LoadW(m_ys + slot), cb2LoadW(m_y0s + slot))));
+	}
+}
+
+// cb2Rope::SolveC2 for four ropes. Vertex i + 1 of one segment is vertex i of
+// the next, so it stays in registers.
+void cb2RopeBatch::SolveStretch(int row, int rowCount)
+{
+	const cb2FloatW zero = cb2ZeroW();
+	const cb2FloatW one = cb2SplatW(1.0f);
+	const cb2FloatW tiny = cb2SplatW(cb2_epsilon);
+
+	int slot = cb2_simdWidth * row;
+	cb2FloatW x1 = cb2LoadW(m_xs + slot);
+	cb2FloatW y1 = cb2LoadW(m_ys + slot);
+	cb2FloatW im1 = cb2LoadW(m_ims + slot);
+
+	for (int i = 0; i < rowCount - 1; ++i)
+	{
+		int next = slot + cb2_simdWidth;
+		cb2FloatW x2 = cb2LoadW(m_xs + next);
+		cb2FloatW y2 = cb2LoadW(m_ys + next);
+		cb2FloatW im2 = cb2LoadW(m_ims + next);
+
+		cb2FloatW dx = cb2SubW(x2, x1);
+		cb2FloatW dy = cb2SubW(y2, y1);
+		cb2FloatW L = cb2SqrtW(cb2AddW(cb2MulW(dx, dx), cb2MulW(dy, dy)));
+		cb2FloatW invL = cb2DivW(one, cb2MaxW(L, tiny));
+
+		// Two massless vertices, like those of padding, get a zero share each.
+		cb2FloatW sum = cb2AddW(im1, im2);
+		cb2FloatW valid = cb2GreaterEqualW(sum, tiny);
+		cb2FloatW invSum = cb2SelectW(valid, cb2DivW(one, cb2SelectW(valid, sum, one)), zero);
+		cb2FloatW C = cb2MulW(cb2MulW(cb2LoadW(m_k2s + slot), cb2SubW(cb2LoadW(m_Ls + slot), L)), cb2MulW(invSum, invL));
+		cb2FloatW c1 = cb2MulW(C, im1);
+		cb2FloatW c2 = cb2MulW(C, im2);
+
+		cb2StoreW(m_xs + slot, cb2SubW(x1, cb2MulW(c1, dx)));
+		cb2StoreW(m_ys + slot, cb2SubW(y1, cb2MulW(c1, dy)));
+
+		x1 = cb2AddW(x2, cb2MulW(c2, dx));
+		y1 = cb2AddW(y2, cb2MulW(c2, dy));
+		im1 = im2;
+		slot = next;
+	}
+
+	cb2StoreW(m_xs + slot, x1);
+	cb2StoreW(m_ys + slot, y1);
+}
+
+// cb2Rope::SolveC3 for four ropes.
+void cb2RopeBatch::SolveBend(int row, int rowCount)
+{
+	const cb2FloatW zero = cb2ZeroW();
+	const cb2FloatW one = cb2SplatW(1.0f);
+	const cb2FloatW tiny = cb2SplatW(FLT_MIN);
+	const cb2FloatW pi = cb2SplatW(cb2_pi);
+	const cb2FloatW twoPi = cb2SplatW(2.0f * cb2_pi);
+
+	int slot = cb2_simdWidth * row;
+	cb2FloatW x1 = cb2LoadW(m_xs + slot);
+	cb2FloatW y1 = cb2LoadW(m_ys + slot);
+	cb2FloatW m1 = cb2LoadW(m_ims + slot);
+	cb2FloatW x2 = cb2LoadW(m_xs + slot + cb2_simdWidth);
+	cb2FloatW y2 = cb2LoadW(m_ys + slot + cb2_simdWidth);
+	cb2FloatW m2 = cb2LoadW(m_ims + slot + cb2_simdWidth);
+
+	for (int i = 0; i < rowCount - 2; ++i)
+	{
+		int last = slot + 2 * cb2_simdWidth;
+		cb2FloatW x3 = cb2LoadW(m_xs + last);
+		cb2FloatW y3 = cb2LoadW(m_ys + last);
+		cb2FloatW m3 = cb2LoadW(m_ims + last);
+
+		cb2FloatW d1x = cb2SubW(x2, x1);
+		cb2FloatW d1y = cb2SubW(y2, y1);
+		cb2FloatW d2x = cb2SubW(x3, x2);
+		cb2FloatW d2y = cb2SubW(y3, y2);
+
+		cb2FloatW L1sqr = cb2AddW(cb2MulW(d1x, d1x), cb2MulW(d1y, d1y));
+		cb2FloatW L2sqr = cb2AddW(cb2MulW(d2x, d2x), cb2MulW(d2y, d2y));
+		cb2FloatW valid = cb2GreaterEqualW(cb2MulW(L1sqr, L2sqr), tiny);
+		L1sqr = cb2SelectW(valid, L1sqr, one);
+		L2sqr = cb2SelectW(valid, L2sqr, one);
+
+		cb2FloatW a = cb2SubW(cb2MulW(d1x, d2y), cb2MulW(d1y, d2x));
+		cb2FloatW b = cb2AddW(cb2MulW(d1x, d2x), cb2MulW(d1y, d2y));
+		cb2FloatW angle = cb2Atan2W(a, b);
+
+		// Jd1 = -skew(d1) / L1sqr, Jd2 = skew(d2) / L2sqr
+		cb2FloatW s1 = cb2DivW(one, L1sqr);
+		cb2FloatW s2 = cb2DivW(one, L2sqr);
+		cb2FloatW Jd1x = cb2MulW(s1, d1y);
+		cb2FloatW Jd1y = cb2SubW(zero, cb2MulW(s1, d1x));
+		cb2FloatW Jd2x = cb2SubW(zero, cb2MulW(s2, d2y));
+		cb2FloatW Jd2y = cb2MulW(s2, d2x);
+
+		cb2FloatW J1x = cb2SubW(zero, Jd1x);
+		cb2FloatW J1y = cb2SubW(zero, Jd1y);
+		cb2FloatW J2x = cb2SubW(Jd1x, Jd2x);
+		cb2FloatW J2y = cb2SubW(Jd1y, Jd2y);
+
+		cb2FloatW mass = cb2MulW(m1, cb2AddW(cb2MulW(J1x, J1x), cb2MulW(J1y, J1y)));
+		mass = cb2AddW(mass, cb2MulW(m2, cb2AddW(cb2MulW(J2x, J2x), cb2MulW(J2y, J2y))));
+		mass = cb2AddW(mass, cb2MulW(m3, cb2AddW(cb2MulW(Jd2x, Jd2x), cb2MulW(Jd2y, Jd2y))));
+		valid = cb2AndW(valid, cb2GreaterEqualW(mass, tiny));
+		mass = cb2DivW(one, cb2SelectW(valid, mass, one));
+
+		// The angles are in [-pi, pi], so one wrap is enough.
+		cb2FloatW C = cb2SubW(angle, cb2LoadW(m_as + slot));
+		C = cb2SelectW(cb2GreaterEqualW(pi, C), C, cb2SubW(C, twoPi));
+		C = cb2SelectW(cb2GreaterEqualW(C, cb2SubW(zero, pi)), C, cb2AddW(C, twoPi));
+
+		cb2FloatW impulse = cb2SubW(zero, cb2MulW(cb2MulW(cb2LoadW(m_k3s + slot), mass), C));
+		impulse = cb2SelectW(valid, impulse, zero);
+
+		cb2FloatW i1 = cb2MulW(m1, impulse);
+		cb2FloatW i2 = cb2MulW(m2, impulse);
+		cb2FloatW i3 = cb2MulW(m3, impulse);
+
+		cb2StoreW(m_xs + slot, cb2AddW(x1, cb2MulW(i1, J1x)));
+		cb2StoreW(m_ys + slot, cb2AddW(y1, cb2MulW(i1, J1y)));
+
+		x1 = cb2AddW(x2, cb2MulW(i2, J2x));
+		y1 = cb2AddW(y2, cb2MulW(i2, J2y));
+		m1 = m2;
+		x2 = cb2AddW(x3, cb2MulW(i3, Jd2x));
+		y2 = cb2AddW(y3, cb2MulW(i3, Jd2y));
+		m2 = m3;
+		slot += cb2_simdWidth;
+	}
+
+	cb2StoreW(m_xs + slot, x1);
+	cb2StoreW(m_ys + slot, y1);
+	cb2StoreW(m_xs + slot + cb2_simdWidth, x2);
+	cb2StoreW(m_ys + slot + cb2_simdWidth, y2);
+}
+
+void cb2RopeBatch::Draw(cb2Draw* draw) const
+{
+	cb2Color c(0.4f, 0.5f, 0.7f);
+
+	for (int i = 0; i < m_ropeCount; ++i)
+	{
+		for (int j = 0; j < m_ropeVertexCounts[i] - 1; ++j)
+		{
+			draw->DrawSegment(GetVertex(i, j), GetVertex(i, j + 1), c);
+		}
+	}
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright (c) 2006-2010 Erin Catto http://www.box2d.org
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef CB2_ROPE_BATCH_H
+#define CB2_ROPE_BATCH_H
+
+#include <CinderBox2D/Common/cb2Simd.h>
+#include <CinderBox2D/Rope/cb2Rope.h>
+
+class cb2Body;
+class cb2Draw;
+class cb2TaskScheduler;
+
+/// Many ropes stepped together with the same position based solver as cb2Rope. The
+/// vertices of four ropes at a time are stored interleaved by coordinate, so the
+/// stretching and bending passes solve the four ropes of a group at once. Groups are
+/// padded to their longest rope, ropes are grouped by vertex count to keep the
+/// padding small. The groups do not interact and may be spread over a task scheduler.
+/// The results are close to those of cb2Rope, but not identical.
+class cb2RopeBatch
+{
+public:
+	cb2RopeBatch();
+	~cb2RopeBatch();
+
+	/// Set up the ropes, replacing those of an earlier call.
+	/// @param defs the rope definitions, see cb2RopeDef.
+	/// @param count the number of ropes.
+	void Initialize(const cb2RopeDef* defs, int count);
+
+	/// Pin a rope vertex to a point on a body. From the next step on the vertex
+	/// follows the body and pulls the rope along, the body does not feel the rope.
+	/// @param rope the rope index, in the order of Initialize.
+	/// @param vertex the vertex of the rope.
+	/// @param body the body, it must stay alive until it is detached.
+	/// @param localAnchor the point in body coordinates.
+	void Attach(int rope, int vertex, cb2Body* body, const ci::Vec2f& localAnchor);
+
+	/// Remove the attachments to a body, for example before destroying it. The
+	/// vertices get their mass back.
+	void Detach(const cb2Body* body);
+
+	/// Step all ropes.
+	/// @param timeStep the time step.
+	/// @param iterations the number of constraint passes.
+	/// @param scheduler spreads the rope groups over its threads, NULL steps them on
+	/// the calling thread.
+	void Step(float timeStep, int iterations, cb2TaskScheduler* scheduler = NULL);
+
+	/// Get the number of ropes.
+	int GetRopeCount() const { return m_ropeCount; }
+
+	/// Get the number of vertices of a rope.
+	int GetVertexCount(int rope) const
+	{
+		cb2Assert(0 <= rope && rope < m_ropeCount);
+		return m_ropeVertexCounts[rope];
+	}
+
+	/// Get a vertex of a rope.
+	ci::Vec2f GetVertex(int rope, int vertex) const
+	{
+		int index = GetIndex(rope, vertex);
+		return ci::Vec2f(m_xs[index], m_ys[index]);
+	}
+
+	/// Draw all ropes.
+	void Draw(cb2Draw* draw) const;
+
+private:
+
+	struct cb2RopeAttachment
+	{
+		cb2Body* body;
+		ci::Vec2f localAnchor;
+		int index;
+		float invMass;
+		float damping;
+	};
+
+	// Vertex i of a rope is at (row + i) * cb2_simdWidth + lane of the arrays.
+	int GetIndex(int rope, int vertex) const
+	{
+		cb2Assert(0 <= rope && rope < m_ropeCount);
+		cb2Assert(0 <= vertex && vertex < m_ropeVertexCounts[rope]);
+		return m_ropeIndices[rope] + vertex * cb2_simdWidth;
+	}
+
+	// The slot of a rope in the per lane arrays.
+	int GetLane(int rope) const;
+
+	void Free();
+
+	void StepGroup(int group, float h, int iterations);
+	void SolveStretch(int row, int rowCount);
+	void SolveBend(int row, int rowCount);
+
+	static void StepTask(void* context, int begin, int end, int threadIndex);
+
+	int m_ropeCount;
+	int* m_ropeIndices;
+	int* m_ropeVertexCounts;
+
+	// A group is rowCount rows of four lanes starting at row groupRows[group].
+	int m_groupCount;
+	int* m_groupRows;
+	int* m_groupRowCounts;
+
+	// Per vertex. Padding vertices have no mass and are never moved.
+	float* m_xs;
+	float* m_ys;
+	float* m_x0s;
+	float* m_y0s;
+	float* m_vxs;
+	float* m_vys;
+	float* m_ims;
+
+	// Per segment and per bend, stored at the slot of their first vertex. The
+	// stiffness of padding segments and bends is 0.
+	float* m_Ls;
+	float* m_k2s;
+	float* m_as;
+	float* m_k3s;
+
+	// Per lane of a group.
+	float* m_gravityXs;
+	float* m_gravityYs;
+	float* m_dampings;
+
+	cb2RopeAttachment* m_attachments;
+	int m_attachmentCount;
+	int m_attachmentCapacity;
+};
+
+#endif